@@ -16,38 +16,50 @@
 // Applies a tag to a signed file.
 
 #include "omaha/base/apply_tag.h"
-#include <intsafe.h>
-#include <atlrx.h>
+#include <string.h>
 #include <vector>
-#include "base/scoped_ptr.h"
-#include "omaha/base/utils.h"
-#include "omaha/base/extractor.h"
+#include "omaha/base/file.h"
+#include "omaha/base/tag_template.h"
 
 namespace omaha {
 
-// TODO(omaha3): There is duplication between this code and the Extractor class.
-// Would be nice to eliminate or reduce the duplication.
-const char kMagicBytes[]    = "Gact2.0Omaha";
-const size_t kMagicBytesLen = arraysize(kMagicBytes) - 1;
+namespace {
 
-const uint32 kPEHeaderOffset = 60;
+// Reads the signed file for TagTemplate, which only reads the headers and
+// the certificate directory.
+class FileTagTemplateInput : public TagTemplateInput {
+ public:
+  explicit FileTagTemplateInput(File* file) : file_(file) {}
 
-ApplyTag::ApplyTag()
-    : prev_tag_string_length_(0),
-      append_(0) {}
-
-bool ApplyTag::IsValidTagString(const char* tag_string) {
-  ASSERT1(tag_string);
+  virtual uint64 GetSize() {
+    uint32 length = 0;
+    return SUCCEEDED(file_->GetLength(&length)) ? length : 0;
+  }
 
-  CAtlRegExp<CAtlRECharTraitsA> regex;
-  REParseError error = regex.Parse(kValidTagStringRegEx);
-  if (error != REPARSE_ERROR_OK) {
-    return false;
+  virtual bool ReadAt(uint64 offset, uint8* data, size_t size) {
+    if (offset > kuint32max || size > kuint32max) {
+      return false;
+    }
+    if (!size) {
+      return true;
+    }
+    uint32 bytes_read = 0;
+    return SUCCEEDED(file_->ReadAt(static_cast<uint32>(offset),
+                                   data,
+                                   static_cast<uint32>(size),
+                                   0,
+                                   &bytes_read));
   }
 
-  CAtlREMatchContext<CAtlRECharTraitsA> context;
-  return !!regex.Match(tag_string, &context);
-}
+ private:
+  File* file_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileTagTemplateInput);
+};
+
+}  // namespace
+
+ApplyTag::ApplyTag() : append_(0) {}
 
 HRESULT ApplyTag::Init(const TCHAR* signed_exe_file,
                        const char* tag_string,
@@ -63,7 +75,7 @@ HRESULT ApplyTag::Init(const TCHAR* signed_exe_file,
   append_ = append;
 
   // Check the tag_string for invalid characters.
-  if (!IsValidTagString(tag_string)) {
+  if (!IsValidTagString(tag_string, strlen(tag_string))) {
     return E_INVALIDARG;
   }
 
@@ -75,147 +87,73 @@ HRESULT ApplyTag::Init(const TCHAR* signed_exe_file,
 }
 
 HRESULT ApplyTag::EmbedTagString() {
-  std::vector<byte> input_file_buffer;
-  HRESULT hr = ReadEntireFileShareMode(signed_exe_file_,
-                                       0,
-                                       FILE_SHARE_READ,
-                                       &input_file_buffer);
+  ASSERT1(!tag_string_.empty());
+
+  TagTemplate tag_template;
+  File signed_file;
+  HRESULT hr = signed_file.OpenShareMode(signed_exe_file_,
+                                         false,
+                                         false,
+                                         FILE_SHARE_READ);
   if (FAILED(hr)) {
     return hr;
   }
 
-  ASSERT1(!input_file_buffer.empty());
-  VERIFY1(ReadExistingTag(&input_file_buffer));
-  if (!append_ && prev_tag_string_length_) {
+  // Applying tags require the file be signed with Authenticode and have a
+  // padded certificate that contains the magic bytes.
+  FileTagTemplateInput input(&signed_file);
+  const bool is_signed = tag_template.Open(&input);
+  VERIFY1(SUCCEEDED(signed_file.Close()));
+  if (!is_signed) {
+    return APPLYTAG_E_NOT_SIGNED;
+  }
+
+  if (!append_ && !tag_template.existing_tag().empty()) {
     // If there is a previous tag and the append flag is not set, then
     // we should error out.
     return APPLYTAG_E_ALREADY_TAGGED;
   }
 
-  if (!CreateBufferToWrite()) {
+  TaggedFile tagged_file;
+  if (!tag_template.MakeTaggedFile(&tag_string_.front(),
+                                   tag_string_.size(),
+                                   append_,
+                                   &tagged_file)) {
     return E_FAIL;
   }
 
-  buffer_data_.resize(input_file_buffer.size());
-
-  copy(input_file_buffer.begin(),
-       input_file_buffer.end(),
-       buffer_data_.begin());
-
-  // Applying tags require the file be signed with Authenticode and have a
-  // padded certificate that contains kMagicBytes.
-  if (!ApplyTagToBuffer()) {
-    return APPLYTAG_E_NOT_SIGNED;
-  }
-
-  return WriteEntireFile(tagged_file_, buffer_data_);
-}
-
-uint32 ApplyTag::GetUint32(const void* p) {
-  ASSERT1(p);
-
-  const uint32* pu = reinterpret_cast<const uint32*>(p);
-  return *pu;
-}
-
-void ApplyTag::PutUint32(uint32 i, void* p) {
-  ASSERT1(p);
-
-  uint32* pu = reinterpret_cast<uint32*>(p);
-  *pu = i;
-}
-
-bool ApplyTag::ReadExistingTag(std::vector<byte>* binary) {
-  ASSERT1(binary);
-
-  int len = 0;
-  TagExtractor tag;
-  char* bin = reinterpret_cast<char*>(&binary->front());
-  ASSERT1(bin);
-  if (tag.ExtractTag(bin, binary->size(), NULL, &len)) {
-    prev_tag_string_.resize(len);
-    if (tag.ExtractTag(bin, binary->size(), &prev_tag_string_.front(), &len)) {
-      // The extractor returns the actual length
-      // of the string + 1 for the terminating null.
-      prev_tag_string_length_ = len - 1;
+  // The tagged file only differs from the signed file in the tag block, so
+  // the signed file is copied by the file system instead of being read, and
+  // the tag block is written over the copy.
+  if (signed_exe_file_.CompareNoCase(tagged_file_) != 0) {
+    hr = File::Copy(signed_exe_file_, tagged_file_, true);
+    if (FAILED(hr)) {
+      return hr;
     }
   }
 
-  return true;
-}
-
-bool ApplyTag::CreateBufferToWrite() {
-  ASSERT1(!append_ && !prev_tag_string_length_ || append_);
-  ASSERT1(!tag_string_.empty());
-  ASSERT1(!prev_tag_string_.size() ||
-          prev_tag_string_.size() ==
-          static_cast<size_t>(prev_tag_string_length_ + 1));
-
-  // Build the tag buffer.
-  // The format of the tag buffer is:
-  // 000000-00000B: 12-byte magic (big-endian)
-  // 00000C-00000D: unsigned 16-bit int string length (big-endian)
-  // 00000E-??????: ASCII string
-  size_t tag_string_len = tag_string_.size() + prev_tag_string_length_;
-  size_t tag_header_len = kMagicBytesLen + 2;
-  size_t tag_buffer_length = tag_string_len + tag_header_len;
-
-  tag_buffer_.clear();
-  tag_buffer_.resize(tag_buffer_length, 0);
-  memcpy(&tag_buffer_.front(), kMagicBytes, kMagicBytesLen);
-  tag_buffer_[kMagicBytesLen] =
-      static_cast<char>((tag_string_len & 0xff00) >> 8);
-  tag_buffer_[kMagicBytesLen+1] = static_cast<char>(tag_string_len & 0xff);
-
-  if (prev_tag_string_length_ > 0) {
-    copy(prev_tag_string_.begin(),
-         prev_tag_string_.end(),
-         tag_buffer_.begin() + tag_header_len);
-  }
-
-  copy(tag_string_.begin(),
-       tag_string_.end(),
-       tag_buffer_.begin() + tag_header_len + prev_tag_string_length_);
-  ASSERT1(static_cast<int>(tag_buffer_.size()) == tag_buffer_length);
-
-  return true;
-}
-
-bool ApplyTag::ApplyTagToBuffer() {
-  uint32 peheader = GetUint32(&buffer_data_.front() + kPEHeaderOffset);
-  uint32 kCertDirAddressOffset = 152;
-  uint32 kCertDirInfoSize = 4 + 4;
-
-  ASSERT1(peheader + kCertDirAddressOffset + kCertDirInfoSize <=
-          buffer_data_.size());
-
-  // Read certificate directory info.
-  uint32 cert_dir_offset = GetUint32(&buffer_data_.front() + peheader +
-                                     kCertDirAddressOffset);
-  if (cert_dir_offset == 0) {
-    return false;
+  File output;
+  hr = output.Open(tagged_file_, true, false);
+  if (FAILED(hr)) {
+    return hr;
   }
 
-  uint32 cert_dir_len = GetUint32(&buffer_data_.front() + peheader +
-                                  kCertDirAddressOffset + 4);
-  ASSERT1(cert_dir_offset + cert_dir_len == buffer_data_.size());
-
-  // Find kMagicBytes and add the tag buffer there.
-  const byte* cert_dir_start = &buffer_data_.front() + cert_dir_offset;
-  const byte* cert_dir_end = cert_dir_start + cert_dir_len;
-  const byte* mc = std::search(cert_dir_start,
-                               cert_dir_end,
-                               kMagicBytes,
-                               kMagicBytes + kMagicBytesLen);
-  if (mc >= cert_dir_end) {
-    return false;
+  for (size_t i = 0; i != tagged_file.num_segments(); ++i) {
+    const TaggedFileSegment& segment = tagged_file.segment(i);
+    if (!segment.data) {
+      continue;
+    }
+    hr = output.WriteAt(static_cast<uint32>(segment.offset),
+                        segment.data,
+                        static_cast<uint32>(segment.size),
+                        0,
+                        NULL);
+    if (FAILED(hr)) {
+      return hr;
+    }
   }
 
-  // Copy the tag buffer.
-  copy(tag_buffer_.begin(), tag_buffer_.end(),
-       buffer_data_.begin() + (mc - &buffer_data_.front()));
-
-  return true;
+  return output.Close();
 }
 
 }  // namespace omaha
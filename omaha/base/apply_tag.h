@@ -22,7 +22,6 @@
 #include <vector>
 
 #include "base/basictypes.h"
-#include "base/scoped_ptr.h"
 #include "omaha/base/error.h"
 
 namespace omaha {
@@ -43,6 +42,9 @@ const char* const kValidTagStringRegEx = "^[-%{}/&=.,_a-zA-Z0-9_]*$";
 // <Signature>Gact.<tag_len><tag_string>
 // There are no restrictions on the tag_string, it is just treated
 // as a sequence of bytes.
+// The tagged file is a copy of the signed file with the tag block written
+// over the padding of the certificate. The servers which tag a binary for
+// every download use TagTemplate directly.
 class ApplyTag {
  public:
   ApplyTag();
@@ -54,22 +56,9 @@ class ApplyTag {
   HRESULT EmbedTagString();
 
  private:
-  static uint32 GetUint32(const void* p);
-  static void PutUint32(uint32 i, void* p);
-  bool ReadExistingTag(std::vector<byte>* binary);
-  bool CreateBufferToWrite();
-  bool ApplyTagToBuffer();
-  bool IsValidTagString(const char* tag_string);
-
   // The string to be tagged into the binary.
   std::vector<char> tag_string_;
 
-  // Existing tag string inside the binary.
-  std::vector<char> prev_tag_string_;
-
-  // This is prev_tag_string_.size - 1, to exclude the terminating null.
-  int prev_tag_string_length_;
-
   // The input binary to be tagged.
   CString signed_exe_file_;
 
@@ -79,13 +68,6 @@ class ApplyTag {
   // Whether to append the tag string to the existing one.
   bool append_;
 
-  // Internal buffer to hold the appended string.
-  std::vector<char> tag_buffer_;
-
-  // The output buffer that contains the original binary
-  // data with the tagged information.
-  std::vector<byte> buffer_data_;
-
   DISALLOW_EVIL_CONSTRUCTORS(ApplyTag);
 };
 
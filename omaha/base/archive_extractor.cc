@@ -0,0 +1,777 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/archive_extractor.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+extern "C" {
+#include "third_party/lzma/files/C/7z.h"
+#include "third_party/lzma/files/C/7zCrc.h"
+#include "third_party/lzma/files/C/Bra.h"
+#include "third_party/lzma/files/C/Lzma2Dec.h"
+#include "third_party/lzma/files/C/LzmaDec.h"
+#include "third_party/lzma/files/C/Xz.h"
+#include "third_party/lzma/files/C/XzCrc64.h"
+}
+
+namespace omaha {
+
+namespace {
+
+// The size of the chunks read from the archive and decoded at once.
+const size_t kChunkSize = 64 * 1024;
+
+// The 7z coders which are streamed.
+const uint64 kMethodCopy = 0;
+const uint64 kMethodLzma2 = 0x21;
+const uint64 kMethodLzma = 0x030101;
+const uint64 kMethodBcj = 0x03030103;
+const uint64 kMethodArm = 0x03030501;
+
+const uint8 kXzSignature[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+const uint8 k7zSignature[] = { '7', 'z', 0xBC, 0xAF, 0x27, 0x1C };
+
+void* AllocateMemory(void*, size_t size) {
+  return size ? malloc(size) : NULL;
+}
+
+void FreeMemory(void*, void* address) {
+  free(address);
+}
+
+ISzAlloc allocator = { &AllocateMemory, &FreeMemory };
+
+// Adapts an ArchiveInput to the streams of the LZMA SDK, which read at a
+// current position. Each user of the input has its own adapter.
+class LookInStream {
+ public:
+  explicit LookInStream(ArchiveInput* input) {
+    seek_stream_.stream.Read = &Read;
+    seek_stream_.stream.Seek = &Seek;
+    seek_stream_.input = input;
+    seek_stream_.size = input->GetSize();
+    seek_stream_.position = 0;
+
+    LookToRead_CreateVTable(&look_stream_, False);
+    look_stream_.realStream = &seek_stream_.stream;
+    LookToRead_Init(&look_stream_);
+  }
+
+  ILookInStream* get() { return &look_stream_.s; }
+
+ private:
+  struct SeekStream {
+    ISeekInStream stream;  // Must be the first member.
+    ArchiveInput* input;
+    uint64 size;
+    uint64 position;
+  };
+
+  static SRes Read(void* p, void* buf, size_t* size) {
+    SeekStream* stream = static_cast<SeekStream*>(p);
+    const uint64 remaining = stream->position < stream->size ?
+                             stream->size - stream->position : 0;
+    const size_t to_read =
+        static_cast<size_t>(std::min(static_cast<uint64>(*size), remaining));
+    *size = 0;
+    if (to_read &&
+        !stream->input->ReadAt(stream->position,
+                               static_cast<uint8*>(buf),
+                               to_read)) {
+      return SZ_ERROR_READ;
+    }
+    stream->position += to_read;
+    *size = to_read;
+    return SZ_OK;
+  }
+
+  static SRes Seek(void* p, Int64* pos, ESzSeek origin) {
+    SeekStream* stream = static_cast<SeekStream*>(p);
+    int64 base = 0;
+    switch (origin) {
+      case SZ_SEEK_SET:
+        break;
+      case SZ_SEEK_CUR:
+        base = static_cast<int64>(stream->position);
+        break;
+      case SZ_SEEK_END:
+        base = static_cast<int64>(stream->size);
+        break;
+      default:
+        return SZ_ERROR_PARAM;
+    }
+    if (base + *pos < 0) {
+      return SZ_ERROR_PARAM;
+    }
+    stream->position = static_cast<uint64>(base + *pos);
+    *pos = static_cast<Int64>(stream->position);
+    return SZ_OK;
+  }
+
+  SeekStream seek_stream_;
+  CLookToRead look_stream_;
+
+  DISALLOW_COPY_AND_ASSIGN(LookInStream);
+};
+
+uint32 GetLzma2DictionarySize(uint8 prop) {
+  return prop >= 40 ? 0xFFFFFFFF : (2U | (prop & 1)) << (prop / 2 + 11);
+}
+
+// Returns true if the folder is made of a copy, LZMA or LZMA2 coder,
+// optionally followed by a BCJ or ARM filter, which are streamed.
+bool IsStreamedFolder(const CSzFolder& folder) {
+  if (folder.NumPackStreams != 1 || folder.PackStreams[0] != 0) {
+    return false;
+  }
+  const CSzCoderInfo& coder = folder.Coders[0];
+  if (coder.NumInStreams != 1 || coder.NumOutStreams != 1 ||
+      (coder.MethodID != kMethodCopy &&
+       coder.MethodID != kMethodLzma &&
+       coder.MethodID != kMethodLzma2)) {
+    return false;
+  }
+  if (folder.NumCoders == 1) {
+    return folder.NumBindPairs == 0;
+  }
+
+  const CSzCoderInfo& filter = folder.Coders[1];
+  return folder.NumCoders == 2 &&
+         filter.NumInStreams == 1 &&
+         filter.NumOutStreams == 1 &&
+         (filter.MethodID == kMethodBcj || filter.MethodID == kMethodArm) &&
+         folder.NumBindPairs == 1 &&
+         folder.BindPairs[0].InIndex == 1 &&
+         folder.BindPairs[0].OutIndex == 0;
+}
+
+// Decodes the main coder of a streamed 7z folder. The dictionary is not
+// larger than the output of the coder, since the coder never refers to data
+// before its start.
+class MainDecoder {
+ public:
+  MainDecoder() : method_(kMethodCopy) {
+    LzmaDec_Construct(&lzma_);
+    Lzma2Dec_Construct(&lzma2_);
+  }
+
+  ~MainDecoder() {
+    LzmaDec_Free(&lzma_, &allocator);
+    Lzma2Dec_Free(&lzma2_, &allocator);
+  }
+
+  bool Init(const CSzCoderInfo& coder, uint64 unpack_size) {
+    method_ = coder.MethodID;
+    const uint32 needed_size = static_cast<uint32>(
+        std::min(unpack_size, static_cast<uint64>(0xFFFFFFFF)));
+
+    if (method_ == kMethodLzma) {
+      if (coder.Props.size != LZMA_PROPS_SIZE) {
+        return false;
+      }
+      uint8 props[LZMA_PROPS_SIZE] = {0};
+      memcpy(props, coder.Props.data, sizeof(props));
+      uint32 dictionary_size = props[1] | (props[2] << 8) |
+                               (props[3] << 16) | (props[4] << 24);
+      dictionary_size = std::min(dictionary_size, needed_size);
+      if (dictionary_size > kMaxArchiveDictionarySize) {
+        return false;
+      }
+      for (int i = 0; i != 4; ++i) {
+        props[1 + i] = static_cast<uint8>(dictionary_size >> (8 * i));
+      }
+      if (LzmaDec_Allocate(&lzma_, props, sizeof(props), &allocator) !=
+          SZ_OK) {
+        return false;
+      }
+      LzmaDec_Init(&lzma_);
+    } else if (method_ == kMethodLzma2) {
+      if (coder.Props.size != 1 || coder.Props.data[0] > 40) {
+        return false;
+      }
+      uint8 prop = coder.Props.data[0];
+      while (prop > 0 && GetLzma2DictionarySize(prop - 1) >= needed_size) {
+        --prop;
+      }
+      if (GetLzma2DictionarySize(prop) > kMaxArchiveDictionarySize) {
+        return false;
+      }
+      if (Lzma2Dec_Allocate(&lzma2_, prop, &allocator) != SZ_OK) {
+        return false;
+      }
+      Lzma2Dec_Init(&lzma2_);
+    }
+    return true;
+  }
+
+  // Decodes up to |*in_size| bytes to up to |*out_size| bytes, and returns
+  // the sizes which were consumed and produced.
+  bool Decode(uint8* out, size_t* out_size, const uint8* in, size_t* in_size) {
+    ELzmaStatus status = LZMA_STATUS_NOT_SPECIFIED;
+    if (method_ == kMethodLzma) {
+      return LzmaDec_DecodeToBuf(&lzma_, out, out_size, in, in_size,
+                                 LZMA_FINISH_ANY, &status) == SZ_OK;
+    }
+    if (method_ == kMethodLzma2) {
+      return Lzma2Dec_DecodeToBuf(&lzma2_, out, out_size, in, in_size,
+                                  LZMA_FINISH_ANY, &status) == SZ_OK;
+    }
+
+    const size_t size = std::min(*in_size, *out_size);
+    memcpy(out, in, size);
+    *in_size = size;
+    *out_size = size;
+    return true;
+  }
+
+ private:
+  uint64 method_;
+  CLzmaDec lzma_;
+  CLzma2Dec lzma2_;
+
+  DISALLOW_COPY_AND_ASSIGN(MainDecoder);
+};
+
+// Receives the decoded data of a 7z folder.
+class FolderOutput {
+ public:
+  virtual ~FolderOutput() {}
+  virtual bool Write(const uint8* data, size_t size) = 0;
+};
+
+// Splits the decoded data of a 7z folder into its members and checks their
+// CRCs and the CRC of the folder.
+class FolderWriter : public FolderOutput {
+ public:
+  FolderWriter(const CSzArEx& db,
+               const CSzFolder& folder,
+               const std::vector<uint32>& members,
+               ArchiveOutput* output)
+      : db_(db),
+        folder_(folder),
+        members_(members),
+        output_(output),
+        current_(0),
+        offset_(0),
+        member_crc_(CRC_INIT_VAL),
+        folder_crc_(CRC_INIT_VAL) {}
+
+  virtual bool Write(const uint8* data, size_t size) {
+    while (size) {
+      if (!FinishCompleteMembers() || current_ == members_.size()) {
+        return false;
+      }
+
+      const size_t index = members_[current_];
+      const uint64 remaining = db_.db.Files[index].Size - offset_;
+      const size_t to_write =
+          static_cast<size_t>(std::min(static_cast<uint64>(size), remaining));
+      if (!output_->WriteMember(index, offset_, data, to_write)) {
+        return false;
+      }
+      member_crc_ = CrcUpdate(member_crc_, data, to_write);
+      folder_crc_ = CrcUpdate(folder_crc_, data, to_write);
+      offset_ += to_write;
+      data += to_write;
+      size -= to_write;
+    }
+    return true;
+  }
+
+  // Returns true if all the members were written and the CRCs match.
+  bool Finish() {
+    if (!FinishCompleteMembers() || current_ != members_.size()) {
+      return false;
+    }
+    return !folder_.UnpackCRCDefined ||
+           CRC_GET_DIGEST(folder_crc_) == folder_.UnpackCRC;
+  }
+
+ private:
+  bool FinishCompleteMembers() {
+    while (current_ != members_.size() &&
+           offset_ == db_.db.Files[members_[current_]].Size) {
+      const CSzFileItem& file = db_.db.Files[members_[current_]];
+      if (file.CrcDefined && CRC_GET_DIGEST(member_crc_) != file.Crc) {
+        return false;
+      }
+      ++current_;
+      offset_ = 0;
+      member_crc_ = CRC_INIT_VAL;
+    }
+    return true;
+  }
+
+  const CSzArEx& db_;
+  const CSzFolder& folder_;
+  const std::vector<uint32>& members_;
+  ArchiveOutput* output_;
+  size_t current_;
+  uint64 offset_;
+  uint32 member_crc_;
+  uint32 folder_crc_;
+
+  DISALLOW_COPY_AND_ASSIGN(FolderWriter);
+};
+
+// Converts the branches of the output of the main coder of a 7z folder. The
+// converters process whole instructions, so the last bytes of a chunk wait
+// for the next chunk, and the bytes left at the end are not converted.
+class BranchFilter : public FolderOutput {
+ public:
+  BranchFilter(uint64 method, FolderOutput* output)
+      : method_(method),
+        output_(output),
+        ip_(0),
+        x86_state_(0),
+        buffer_(kChunkSize),
+        size_(0) {
+    x86_Convert_Init(x86_state_);
+  }
+
+  virtual bool Write(const uint8* data, size_t size) {
+    while (size) {
+      const size_t to_copy = std::min(size, buffer_.size() - size_);
+      memcpy(&buffer_.front() + size_, data, to_copy);
+      size_ += to_copy;
+      data += to_copy;
+      size -= to_copy;
+
+      const size_t converted = method_ == kMethodBcj ?
+          x86_Convert(&buffer_.front(), size_, ip_, &x86_state_, 0) :
+          ARM_Convert(&buffer_.front(), size_, ip_, 0);
+      if (!output_->Write(&buffer_.front(), converted)) {
+        return false;
+      }
+      memmove(&buffer_.front(),
+              &buffer_.front() + converted,
+              size_ - converted);
+      size_ -= converted;
+      ip_ += static_cast<uint32>(converted);
+    }
+    return true;
+  }
+
+  bool Finish() {
+    return output_->Write(&buffer_.front(), size_);
+  }
+
+ private:
+  const uint64 method_;
+  FolderOutput* output_;
+  uint32 ip_;
+  uint32 x86_state_;
+  std::vector<uint8> buffer_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(BranchFilter);
+};
+
+}  // namespace
+
+struct ArchiveExtractor::SevenZipArchive {
+  SevenZipArchive() {
+    SzArEx_Init(&db);
+  }
+
+  ~SevenZipArchive() {
+    SzArEx_Free(&db, &allocator);
+  }
+
+  CSzArEx db;
+
+  // The members which have data, for each folder, in the order of the
+  // decoded data.
+  std::vector<std::vector<uint32> > folder_members;
+};
+
+ArchiveExtractor::ArchiveExtractor()
+    : input_(NULL),
+      output_(NULL),
+      format_(ARCHIVE_FORMAT_NONE),
+      unpacked_size_(0),
+      seven_zip_(NULL) {
+}
+
+ArchiveExtractor::~ArchiveExtractor() {
+  delete seven_zip_;
+}
+
+bool ArchiveExtractor::Open(ArchiveInput* input,
+                            const std::wstring& xz_member_name,
+                            ArchiveOutput* output) {
+  if (format_ != ARCHIVE_FORMAT_NONE) {
+    return false;
+  }
+
+  uint8 header[sizeof(kXzSignature)] = {0};
+  if (input->GetSize() < sizeof(header) ||
+      !input->ReadAt(0, header, sizeof(header))) {
+    return false;
+  }
+
+  // The tables are the same every time they are generated.
+  CrcGenerateTable();
+  Crc64GenerateTable();
+
+  input_ = input;
+  output_ = output;
+  format_ = GetArchiveFormat(header, sizeof(header));
+  bool is_open = false;
+  if (format_ == ARCHIVE_FORMAT_XZ) {
+    is_open = OpenXz();
+    if (is_open) {
+      members_.resize(1);
+      members_[0].name = xz_member_name;
+      members_[0].size = unpacked_size_;
+    }
+  } else if (format_ == ARCHIVE_FORMAT_7Z) {
+    is_open = Open7z();
+  }
+  if (!is_open) {
+    format_ = ARCHIVE_FORMAT_NONE;
+    return false;
+  }
+
+  for (size_t i = 0; i != members_.size(); ++i) {
+    if (!output_->CreateMember(i,
+                               members_[i].name,
+                               members_[i].size,
+                               members_[i].is_directory)) {
+      return false;
+    }
+  }
+
+  std::stable_sort(tasks_.begin(), tasks_.end(), &IsLargerTask);
+  return true;
+}
+
+bool ArchiveExtractor::ExtractTask(size_t index) {
+  if (index >= tasks_.size()) {
+    return false;
+  }
+  return format_ == ARCHIVE_FORMAT_XZ ? ExtractXzBlock(tasks_[index]) :
+                                        Extract7zFolder(tasks_[index]);
+}
+
+bool ArchiveExtractor::IsLargerTask(const Task& task1, const Task& task2) {
+  return task1.unpack_size > task2.unpack_size;
+}
+
+bool ArchiveExtractor::OpenXz() {
+  LookInStream stream(input_);
+  CXzs xzs;
+  Xzs_Construct(&xzs);
+  Int64 start_offset = 0;
+  bool is_valid =
+      Xzs_ReadBackward(&xzs, stream.get(), &start_offset, NULL, &allocator) ==
+          SZ_OK &&
+      start_offset == 0 &&
+      Xzs_GetUnpackSize(&xzs) != XZ_SIZE_OVERFLOW;
+
+  // The streams are listed from the end of the archive.
+  uint64 unpack_offset = 0;
+  for (size_t i = xzs.num; is_valid && i-- > 0;) {
+    const CXzStream& xz_stream = xzs.streams[i];
+    uint64 block_offset = xz_stream.startOffset + XZ_STREAM_HEADER_SIZE;
+    for (size_t j = 0; j != xz_stream.numBlocks; ++j) {
+      Task task;
+      task.stream_offset = xz_stream.startOffset;
+      task.pack_offset = block_offset;
+      task.pack_size = (xz_stream.blocks[j].totalSize + 3) & ~3ULL;
+      task.unpack_offset = unpack_offset;
+      task.unpack_size = xz_stream.blocks[j].unpackSize;
+      tasks_.push_back(task);
+
+      block_offset += task.pack_size;
+      unpack_offset += task.unpack_size;
+    }
+  }
+  Xzs_Free(&xzs, &allocator);
+
+  unpacked_size_ = unpack_offset;
+  return is_valid;
+}
+
+bool ArchiveExtractor::Open7z() {
+  seven_zip_ = new SevenZipArchive;
+  CSzArEx& db = seven_zip_->db;
+  LookInStream stream(input_);
+  if (SzArEx_Open(&db, stream.get(), &allocator, &allocator) != SZ_OK) {
+    return false;
+  }
+
+  const CSzAr& ar = db.db;
+  members_.resize(ar.NumFiles);
+  seven_zip_->folder_members.resize(ar.NumFolders);
+  for (uint32 i = 0; i != ar.NumFiles; ++i) {
+    const CSzFileItem& file = ar.Files[i];
+    if (file.IsAnti) {
+      return false;
+    }
+
+    std::vector<UInt16> name(SzArEx_GetFileNameUtf16(&db, i, NULL));
+    if (name.size() < 2) {
+      return false;
+    }
+    SzArEx_GetFileNameUtf16(&db, i, &name.front());
+    members_[i].name.assign(name.begin(), name.end() - 1);
+    members_[i].is_directory = file.IsDir != 0;
+
+    if (file.HasStream) {
+      const uint32 folder_index = db.FileIndexToFolderIndexMap[i];
+      if (folder_index >= ar.NumFolders) {
+        return false;
+      }
+      members_[i].size = file.Size;
+      seven_zip_->folder_members[folder_index].push_back(i);
+      unpacked_size_ += file.Size;
+    }
+  }
+
+  for (uint32 i = 0; i != ar.NumFolders; ++i) {
+    CSzFolder* folder = &ar.Folders[i];
+    const std::vector<uint32>& folder_members = seven_zip_->folder_members[i];
+    if (folder_members.size() != folder->NumUnpackStreams) {
+      return false;
+    }
+    if (folder_members.empty()) {
+      continue;
+    }
+
+    Task task;
+    task.folder_index = i;
+    task.pack_offset = SzArEx_GetFolderStreamPos(&db, i, 0);
+    UInt64 pack_size = 0;
+    if (SzArEx_GetFolderFullPackSize(&db, i, &pack_size) != SZ_OK) {
+      return false;
+    }
+    task.pack_size = pack_size;
+    task.unpack_size = SzFolder_GetUnpackSize(folder);
+
+    uint64 members_size = 0;
+    for (size_t j = 0; j != folder_members.size(); ++j) {
+      members_size += ar.Files[folder_members[j]].Size;
+    }
+    if (members_size != task.unpack_size) {
+      return false;
+    }
+    if (!IsStreamedFolder(*folder) &&
+        task.unpack_size > kMaxInMemoryFolderSize) {
+      return false;
+    }
+    tasks_.push_back(task);
+  }
+  return true;
+}
+
+// The stream header is decoded first to set up the unpacker, then the block.
+// The byte after the block, which is either the header of the next block or
+// the index, is decoded too, since the unpacker checks the footer of the
+// block when it reads the next byte.
+bool ArchiveExtractor::ExtractXzBlock(const Task& task) {
+  std::vector<uint8> in(kChunkSize);
+  std::vector<uint8> out(kChunkSize);
+  if (!input_->ReadAt(task.stream_offset, &in.front(), XZ_STREAM_HEADER_SIZE)) {
+    return false;
+  }
+  size_t in_pos = 0;
+  size_t in_size = XZ_STREAM_HEADER_SIZE;
+  uint64 pack_offset = task.pack_offset;
+  const uint64 pack_end = task.pack_offset + task.pack_size + 1;
+  uint64 unpacked = 0;
+
+  CXzUnpacker unpacker;
+  XzUnpacker_Create(&unpacker, &allocator);
+  bool result = true;
+  for (;;) {
+    if (in_pos == in_size) {
+      if (pack_offset == pack_end) {
+        break;
+      }
+      in_pos = 0;
+      in_size = static_cast<size_t>(
+          std::min(static_cast<uint64>(kChunkSize), pack_end - pack_offset));
+      if (!input_->ReadAt(pack_offset, &in.front(), in_size)) {
+        result = false;
+        break;
+      }
+      pack_offset += in_size;
+    }
+
+    SizeT out_size = out.size();
+    SizeT in_processed = in_size - in_pos;
+    ECoderStatus status = CODER_STATUS_NOT_SPECIFIED;
+    if (XzUnpacker_Code(&unpacker,
+                        &out.front(),
+                        &out_size,
+                        &in.front() + in_pos,
+                        &in_processed,
+                        LZMA_FINISH_ANY,
+                        &status) != SZ_OK ||
+        (in_processed == 0 && out_size == 0) ||
+        out_size > task.unpack_size - unpacked) {
+      result = false;
+      break;
+    }
+    in_pos += in_processed;
+
+    if (out_size &&
+        !output_->WriteMember(0,
+                              task.unpack_offset + unpacked,
+                              &out.front(),
+                              out_size)) {
+      result = false;
+      break;
+    }
+    unpacked += out_size;
+  }
+
+  result = result &&
+           unpacked == task.unpack_size &&
+           (unpacker.state == XZ_STATE_BLOCK_HEADER ||
+            unpacker.state == XZ_STATE_STREAM_INDEX);
+  XzUnpacker_Free(&unpacker);
+  return result;
+}
+
+bool ArchiveExtractor::Extract7zFolder(const Task& task) {
+  const CSzArEx& db = seven_zip_->db;
+  const CSzFolder& folder = db.db.Folders[task.folder_index];
+  if (!IsStreamedFolder(folder)) {
+    return Extract7zFolderInMemory(task);
+  }
+
+  // The size of the output of the main coder, which the filter converts
+  // without changing its size.
+  const uint64 coder_unpack_size = folder.UnpackSizes[0];
+  MainDecoder decoder;
+  if (!decoder.Init(folder.Coders[0], coder_unpack_size)) {
+    return false;
+  }
+
+  FolderWriter writer(db,
+                      folder,
+                      seven_zip_->folder_members[task.folder_index],
+                      output_);
+  const bool has_filter = folder.NumCoders == 2;
+  BranchFilter filter(has_filter ? folder.Coders[1].MethodID : kMethodCopy,
+                      &writer);
+  FolderOutput* folder_output = has_filter ?
+                                static_cast<FolderOutput*>(&filter) :
+                                &writer;
+
+  std::vector<uint8> in(kChunkSize);
+  std::vector<uint8> out(kChunkSize);
+  size_t in_pos = 0;
+  size_t in_size = 0;
+  uint64 pack_offset = task.pack_offset;
+  const uint64 pack_end = task.pack_offset + task.pack_size;
+  uint64 unpacked = 0;
+  while (unpacked != coder_unpack_size) {
+    if (in_pos == in_size && pack_offset != pack_end) {
+      in_pos = 0;
+      in_size = static_cast<size_t>(
+          std::min(static_cast<uint64>(kChunkSize), pack_end - pack_offset));
+      if (!input_->ReadAt(pack_offset, &in.front(), in_size)) {
+        return false;
+      }
+      pack_offset += in_size;
+    }
+
+    size_t out_size = static_cast<size_t>(
+        std::min(static_cast<uint64>(out.size()),
+                 coder_unpack_size - unpacked));
+    size_t in_processed = in_size - in_pos;
+    if (!decoder.Decode(&out.front(),
+                        &out_size,
+                        &in.front() + in_pos,
+                        &in_processed) ||
+        (in_processed == 0 && out_size == 0)) {
+      return false;
+    }
+    in_pos += in_processed;
+
+    if (!folder_output->Write(&out.front(), out_size)) {
+      return false;
+    }
+    unpacked += out_size;
+  }
+
+  return (!has_filter || filter.Finish()) && writer.Finish();
+}
+
+bool ArchiveExtractor::Extract7zFolderInMemory(const Task& task) {
+  const CSzArEx& db = seven_zip_->db;
+  const CSzFolder& folder = db.db.Folders[task.folder_index];
+  if (task.unpack_size > kMaxInMemoryFolderSize) {
+    return false;
+  }
+
+  std::vector<uint8> data(static_cast<size_t>(task.unpack_size));
+  LookInStream stream(input_);
+  if (SzFolder_Decode(&folder,
+                      db.db.PackSizes +
+                          db.FolderStartPackStreamIndex[task.folder_index],
+                      stream.get(),
+                      task.pack_offset,
+                      data.empty() ? NULL : &data.front(),
+                      data.size(),
+                      &allocator) != SZ_OK) {
+    return false;
+  }
+
+  FolderWriter writer(db,
+                      folder,
+                      seven_zip_->folder_members[task.folder_index],
+                      output_);
+  for (size_t pos = 0; pos < data.size(); pos += kChunkSize) {
+    if (!writer.Write(&data[pos], std::min(kChunkSize, data.size() - pos))) {
+      return false;
+    }
+  }
+  return writer.Finish();
+}
+
+ArchiveFormat GetArchiveFormat(const uint8* header, size_t size) {
+  if (size >= sizeof(kXzSignature) &&
+      !memcmp(header, kXzSignature, sizeof(kXzSignature))) {
+    return ARCHIVE_FORMAT_XZ;
+  }
+  if (size >= sizeof(k7zSignature) &&
+      !memcmp(header, k7zSignature, sizeof(k7zSignature))) {
+    return ARCHIVE_FORMAT_7Z;
+  }
+  return ARCHIVE_FORMAT_NONE;
+}
+
+bool ExtractArchive(ArchiveInput* input,
+                    const std::wstring& xz_member_name,
+                    ArchiveOutput* output) {
+  ArchiveExtractor extractor;
+  if (!extractor.Open(input, xz_member_name, output)) {
+    return false;
+  }
+  for (size_t i = 0; i != extractor.num_tasks(); ++i) {
+    if (!extractor.ExtractTask(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace omaha
@@ -0,0 +1,173 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Extracts the members of the xz and 7z archives which are served as
+// packages, using the decoders of the LZMA SDK.
+//
+// An archive is divided in tasks which are decoded independently: the blocks
+// of an xz archive and the folders of a 7z archive, a folder being the unit
+// which 7z compresses as one stream. xz archives have several blocks when
+// they are created with "--block-size" or "-T", and 7z archives have a folder
+// per member when they are created with "-ms=off". The tasks read the archive
+// at positions and write the members at offsets, so they can run on several
+// threads at once.
+//
+// The archive is read in chunks of 64KB and the members are written as they
+// are decoded, so a task uses the dictionary of its stream plus a few chunks.
+// The 7z folders which use the filters which are not streamed, such as BCJ2,
+// are decoded in memory up to kMaxInMemoryFolderSize. The code does not
+// depend on Windows, so the benchmarks can run on other platforms.
+
+#ifndef OMAHA_BASE_ARCHIVE_EXTRACTOR_H_
+#define OMAHA_BASE_ARCHIVE_EXTRACTOR_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+enum ArchiveFormat {
+  ARCHIVE_FORMAT_NONE = 0,
+  ARCHIVE_FORMAT_XZ,
+  ARCHIVE_FORMAT_7Z,
+};
+
+// The largest 7z folder decoded in memory, for the filters which are not
+// streamed.
+const uint64 kMaxInMemoryFolderSize = 64 * 1024 * 1024;
+
+// The largest LZMA dictionary of a 7z folder. The xz decoder allocates the
+// dictionary the archive declares.
+const uint32 kMaxArchiveDictionarySize = 64 * 1024 * 1024;
+
+// Reads the archive. ReadAt is called by the tasks on several threads.
+class ArchiveInput {
+ public:
+  virtual ~ArchiveInput() {}
+  virtual uint64 GetSize() = 0;
+  virtual bool ReadAt(uint64 offset, uint8* data, size_t size) = 0;
+};
+
+// Receives the members of the archive. CreateMember is called for every
+// member before any task runs. WriteMember is called by the tasks on several
+// threads, for different members or different ranges of a member.
+class ArchiveOutput {
+ public:
+  virtual ~ArchiveOutput() {}
+  virtual bool CreateMember(size_t index,
+                            const std::wstring& name,
+                            uint64 size,
+                            bool is_directory) = 0;
+  virtual bool WriteMember(size_t index,
+                           uint64 offset,
+                           const uint8* data,
+                           size_t size) = 0;
+};
+
+struct ArchiveMember {
+  ArchiveMember() : size(0), is_directory(false) {}
+
+  // The relative path of the member, which uses '/' or '\' as separator.
+  std::wstring name;
+  uint64 size;
+  bool is_directory;
+};
+
+class ArchiveExtractor {
+ public:
+  ArchiveExtractor();
+  ~ArchiveExtractor();
+
+  // Reads the index of the archive, describes the members to |output|, and
+  // divides the archive in tasks. An xz archive has one member, which is
+  // named |xz_member_name|. Returns false if the archive is invalid or uses
+  // methods which are not supported.
+  bool Open(ArchiveInput* input,
+            const std::wstring& xz_member_name,
+            ArchiveOutput* output);
+
+  ArchiveFormat format() const { return format_; }
+  const std::vector<ArchiveMember>& members() const { return members_; }
+  uint64 unpacked_size() const { return unpacked_size_; }
+
+  // The tasks are ordered from the largest, so that the threads which take
+  // them in order finish at about the same time.
+  size_t num_tasks() const { return tasks_.size(); }
+
+  // Decodes a task and writes its members. The decoded data is checked
+  // against the CRCs of the archive. Tasks can run concurrently, but each
+  // task runs once.
+  bool ExtractTask(size_t index);
+
+ private:
+  struct Task {
+    Task()
+        : pack_offset(0),
+          pack_size(0),
+          unpack_offset(0),
+          unpack_size(0),
+          stream_offset(0),
+          folder_index(0) {}
+
+    // The position and the size of the compressed data in the archive.
+    uint64 pack_offset;
+    uint64 pack_size;
+
+    // The offset of the decoded data in the member, for an xz block, and the
+    // size of the decoded data.
+    uint64 unpack_offset;
+    uint64 unpack_size;
+
+    // The position of the header of the xz stream which contains the block.
+    uint64 stream_offset;
+
+    uint32 folder_index;
+  };
+
+  struct SevenZipArchive;
+
+  static bool IsLargerTask(const Task& task1, const Task& task2);
+
+  bool OpenXz();
+  bool Open7z();
+  bool ExtractXzBlock(const Task& task);
+  bool Extract7zFolder(const Task& task);
+  bool Extract7zFolderInMemory(const Task& task);
+
+  ArchiveInput* input_;
+  ArchiveOutput* output_;
+  ArchiveFormat format_;
+  std::vector<ArchiveMember> members_;
+  std::vector<Task> tasks_;
+  uint64 unpacked_size_;
+  SevenZipArchive* seven_zip_;
+
+  DISALLOW_COPY_AND_ASSIGN(ArchiveExtractor);
+};
+
+// Returns the format of the archive which starts with |header|, or
+// ARCHIVE_FORMAT_NONE.
+ArchiveFormat GetArchiveFormat(const uint8* header, size_t size);
+
+// Extracts all the tasks on the calling thread.
+bool ExtractArchive(ArchiveInput* input,
+                    const std::wstring& xz_member_name,
+                    ArchiveOutput* output);
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_ARCHIVE_EXTRACTOR_H_
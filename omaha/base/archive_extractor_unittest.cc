@@ -0,0 +1,797 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "omaha/base/archive_extractor.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/testing/unit_test.h"
+extern "C" {
+#include "third_party/lzma/files/C/7zCrc.h"
+#include "third_party/lzma/files/C/Bra.h"
+}
+
+namespace omaha {
+
+namespace {
+
+// A linear congruential generator, so that the tests do not depend on the
+// state of the CRT generator.
+class TestRandom {
+ public:
+  explicit TestRandom(uint32 seed) : state_(seed) {}
+
+  uint32 Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 16;
+  }
+
+ private:
+  uint32 state_;
+};
+
+// Fills the buffer with bytes which look like x86 code: random bytes with a
+// call opcode every few bytes, which the BCJ filter converts.
+std::vector<uint8> MakeCode(size_t size, TestRandom* random) {
+  std::vector<uint8> data(size);
+  for (size_t i = 0; i != size; ++i) {
+    data[i] = static_cast<uint8>(i % 16 ? random->Next() : 0xe8);
+  }
+  return data;
+}
+
+// Fills the buffer with text, which has no branch opcodes.
+std::vector<uint8> MakeText(size_t size) {
+  const char kText[] = "The quick brown fox jumps over the lazy dog. ";
+  std::vector<uint8> data(size);
+  for (size_t i = 0; i != size; ++i) {
+    data[i] = kText[i % (arraysize(kText) - 1)];
+  }
+  return data;
+}
+
+// MakeText(4096) compressed with LZMA, without an end marker.
+const uint8 kLzmaProps[] = { 0x5d, 0x00, 0x00, 0x01, 0x00 };
+const uint8 kLzmaText[] = {
+  0x00, 0x2a, 0x1a, 0x08, 0xa2, 0x03, 0x25, 0x66, 0xf1, 0x4b, 0x78, 0xc5,
+  0xa2, 0x05, 0xff, 0x2e, 0xe6, 0xd9, 0xd2, 0x20, 0x1a, 0xad, 0x34, 0xf8,
+  0xe2, 0x1d, 0xe8, 0x41, 0x36, 0xfa, 0xdc, 0x06, 0x69, 0xbb, 0x3c, 0xe4,
+  0x10, 0x34, 0x27, 0x09, 0xeb, 0xb3, 0x66, 0xe3, 0xed, 0x37, 0x98, 0xed,
+  0x92, 0xad, 0xd5, 0x27, 0x45, 0x08, 0x30, 0x5e, 0x5d, 0x9a, 0x3c, 0x41,
+  0xc4, 0x18, 0x4a, 0x53, 0xf6, 0x6a, 0xd9, 0xf6, 0x43, 0xff, 0x23, 0x00,
+};
+const size_t kLzmaTextSize = 4096;
+
+void AppendBytes(const uint8* data, size_t size, std::vector<uint8>* out) {
+  out->insert(out->end(), data, data + size);
+}
+
+void AppendUint32(uint32 value, std::vector<uint8>* out) {
+  for (int i = 0; i != 4; ++i) {
+    out->push_back(static_cast<uint8>(value >> (8 * i)));
+  }
+}
+
+void AppendUint64(uint64 value, std::vector<uint8>* out) {
+  for (int i = 0; i != 8; ++i) {
+    out->push_back(static_cast<uint8>(value >> (8 * i)));
+  }
+}
+
+void AppendCrc(const uint8* data, size_t size, std::vector<uint8>* out) {
+  AppendUint32(CrcCalc(data, size), out);
+}
+
+void AppendXzVarint(uint64 value, std::vector<uint8>* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8>(value));
+}
+
+// The numbers of the 7z headers have as many leading one bits in their first
+// byte as they have extra bytes.
+void Append7zNumber(uint64 value, std::vector<uint8>* out) {
+  uint8 first_byte = 0;
+  uint8 mask = 0x80;
+  int num_extra_bytes = 0;
+  for (; num_extra_bytes < 8; ++num_extra_bytes) {
+    if (value < (1ULL << (7 * (num_extra_bytes + 1)))) {
+      first_byte |= static_cast<uint8>(value >> (8 * num_extra_bytes));
+      break;
+    }
+    first_byte |= mask;
+    mask >>= 1;
+  }
+  out->push_back(first_byte);
+  for (int i = 0; i != num_extra_bytes; ++i) {
+    out->push_back(static_cast<uint8>(value >> (8 * i)));
+  }
+}
+
+// Encodes the data in uncompressed LZMA2 chunks, so that the tests do not
+// need an encoder.
+std::vector<uint8> EncodeStoredLzma2(const std::vector<uint8>& data) {
+  const size_t kMaxChunkSize = 64 * 1024;
+  std::vector<uint8> encoded;
+  for (size_t pos = 0; pos < data.size(); pos += kMaxChunkSize) {
+    const size_t size = std::min(kMaxChunkSize, data.size() - pos);
+    encoded.push_back(pos ? 0x02 : 0x01);
+    encoded.push_back(static_cast<uint8>((size - 1) >> 8));
+    encoded.push_back(static_cast<uint8>(size - 1));
+    AppendBytes(&data[pos], size, &encoded);
+  }
+  encoded.push_back(0x00);
+  return encoded;
+}
+
+// Builds an xz stream with a block for each buffer and CRC32 checks.
+std::vector<uint8> BuildXzStream(
+    const std::vector<std::vector<uint8> >& blocks) {
+  const uint8 kMagic[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+  const uint8 kFlags[] = { 0x00, 0x01 };
+  const uint8 kFooterMagic[] = { 'Y', 'Z' };
+
+  std::vector<uint8> stream;
+  AppendBytes(kMagic, sizeof(kMagic), &stream);
+  AppendBytes(kFlags, sizeof(kFlags), &stream);
+  AppendCrc(kFlags, sizeof(kFlags), &stream);
+
+  std::vector<uint8> index;
+  index.push_back(0x00);
+  AppendXzVarint(blocks.size(), &index);
+  for (size_t i = 0; i != blocks.size(); ++i) {
+    // A header of 12 bytes with one LZMA2 filter, whose dictionary is 1MB.
+    const uint8 kHeader[] = { 0x02, 0x00, 0x21, 0x01, 0x10, 0x00, 0x00, 0x00 };
+    const size_t block_start = stream.size();
+    AppendBytes(kHeader, sizeof(kHeader), &stream);
+    AppendCrc(kHeader, sizeof(kHeader), &stream);
+
+    const std::vector<uint8> encoded(EncodeStoredLzma2(blocks[i]));
+    AppendBytes(&encoded.front(), encoded.size(), &stream);
+    const uint64 unpadded_size = stream.size() - block_start + 4;
+    while ((stream.size() - block_start) % 4) {
+      stream.push_back(0x00);
+    }
+    AppendUint32(blocks[i].empty() ? 0 : CrcCalc(&blocks[i].front(),
+                                                 blocks[i].size()),
+                 &stream);
+
+    AppendXzVarint(unpadded_size, &index);
+    AppendXzVarint(blocks[i].size(), &index);
+  }
+  while (index.size() % 4) {
+    index.push_back(0x00);
+  }
+  AppendCrc(&index.front(), index.size(), &index);
+  AppendBytes(&index.front(), index.size(), &stream);
+
+  std::vector<uint8> footer;
+  AppendUint32(static_cast<uint32>(index.size() / 4 - 1), &footer);
+  AppendBytes(kFlags, sizeof(kFlags), &footer);
+  AppendCrc(&footer.front(), footer.size(), &stream);
+  AppendBytes(&footer.front(), footer.size(), &stream);
+  AppendBytes(kFooterMagic, sizeof(kFooterMagic), &stream);
+  return stream;
+}
+
+// The layouts of the 7z folders the tests build.
+enum FolderMethod {
+  FOLDER_COPY,
+  FOLDER_LZMA,       // The folder holds MakeText(kLzmaTextSize) only.
+  FOLDER_LZMA2,
+  FOLDER_LZMA2_BCJ,
+  FOLDER_LZMA2_ARM,
+  FOLDER_BCJ2,       // The members must not contain branch opcodes.
+};
+
+struct TestFolder {
+  explicit TestFolder(FolderMethod method) : method(method) {}
+
+  void AddMember(const std::wstring& name, const std::vector<uint8>& data) {
+    names.push_back(name);
+    members.push_back(data);
+  }
+
+  FolderMethod method;
+  std::vector<std::wstring> names;
+  std::vector<std::vector<uint8> > members;
+};
+
+struct TestCoder {
+  TestCoder(uint64 id, size_t id_size)
+      : id(id), id_size(id_size), num_in_streams(1) {}
+
+  uint64 id;
+  size_t id_size;
+  uint32 num_in_streams;
+  std::vector<uint8> props;
+};
+
+void AppendCoder(const TestCoder& coder, std::vector<uint8>* header) {
+  uint8 flags = static_cast<uint8>(coder.id_size);
+  if (coder.num_in_streams != 1) {
+    flags |= 0x10;
+  }
+  if (!coder.props.empty()) {
+    flags |= 0x20;
+  }
+  header->push_back(flags);
+  for (size_t i = coder.id_size; i-- > 0;) {
+    header->push_back(static_cast<uint8>(coder.id >> (8 * i)));
+  }
+  if (coder.num_in_streams != 1) {
+    Append7zNumber(coder.num_in_streams, header);
+    Append7zNumber(1, header);
+  }
+  if (!coder.props.empty()) {
+    Append7zNumber(coder.props.size(), header);
+    AppendBytes(&coder.props.front(), coder.props.size(), header);
+  }
+}
+
+void AppendBitVector(const std::vector<bool>& bits,
+                     std::vector<uint8>* header) {
+  std::vector<uint8> bytes((bits.size() + 7) / 8);
+  for (size_t i = 0; i != bits.size(); ++i) {
+    if (bits[i]) {
+      bytes[i / 8] |= static_cast<uint8>(0x80 >> (i % 8));
+    }
+  }
+  Append7zNumber(bytes.size(), header);
+  AppendBytes(&bytes.front(), bytes.size(), header);
+}
+
+// Builds a 7z archive with an uncompressed header. The directories come
+// first, then the members of the folders, then the empty files.
+std::vector<uint8> Build7z(const std::vector<TestFolder>& folders,
+                           const std::vector<std::wstring>& directories,
+                           const std::vector<std::wstring>& empty_files) {
+  std::vector<uint8> packed;
+  std::vector<uint64> pack_sizes;
+  std::vector<uint8> folders_info;
+  std::vector<uint8> unpack_sizes;
+  for (size_t i = 0; i != folders.size(); ++i) {
+    const TestFolder& folder = folders[i];
+    std::vector<uint8> data;
+    for (size_t j = 0; j != folder.members.size(); ++j) {
+      data.insert(data.end(),
+                  folder.members[j].begin(),
+                  folder.members[j].end());
+    }
+
+    std::vector<TestCoder> coders;
+    std::vector<std::vector<uint8> > streams;
+    TestCoder lzma2(0x21, 1);
+    lzma2.props.push_back(0x10);
+    switch (folder.method) {
+      case FOLDER_COPY:
+        coders.push_back(TestCoder(0x00, 1));
+        streams.push_back(data);
+        break;
+      case FOLDER_LZMA:
+        EXPECT_TRUE(data == MakeText(kLzmaTextSize));
+        coders.push_back(TestCoder(0x030101, 3));
+        AppendBytes(kLzmaProps, sizeof(kLzmaProps), &coders.back().props);
+        streams.push_back(
+            std::vector<uint8>(kLzmaText, kLzmaText + sizeof(kLzmaText)));
+        break;
+      case FOLDER_LZMA2:
+        coders.push_back(lzma2);
+        streams.push_back(EncodeStoredLzma2(data));
+        break;
+      case FOLDER_LZMA2_BCJ:
+      case FOLDER_LZMA2_ARM: {
+        std::vector<uint8> converted(data);
+        if (folder.method == FOLDER_LZMA2_BCJ) {
+          uint32 state = 0;
+          x86_Convert_Init(state);
+          x86_Convert(&converted.front(), converted.size(), 0, &state, 1);
+          coders.push_back(lzma2);
+          coders.push_back(TestCoder(0x03030103, 4));
+        } else {
+          ARM_Convert(&converted.front(), converted.size(), 0, 1);
+          coders.push_back(lzma2);
+          coders.push_back(TestCoder(0x03030501, 4));
+        }
+        streams.push_back(EncodeStoredLzma2(converted));
+        break;
+      }
+      case FOLDER_BCJ2: {
+        // Without branches, the main stream is the data, the call and jump
+        // streams are empty, and the range decoder only reads its 5 bytes of
+        // initialization.
+        coders.push_back(TestCoder(0x00, 1));
+        coders.push_back(TestCoder(0x00, 1));
+        coders.push_back(TestCoder(0x00, 1));
+        coders.push_back(TestCoder(0x0303011B, 4));
+        coders.back().num_in_streams = 4;
+        streams.push_back(data);
+        streams.push_back(std::vector<uint8>(5, 0));
+        streams.push_back(std::vector<uint8>());
+        streams.push_back(std::vector<uint8>());
+        break;
+      }
+    }
+
+    Append7zNumber(coders.size(), &folders_info);
+    for (size_t j = 0; j != coders.size(); ++j) {
+      AppendCoder(coders[j], &folders_info);
+    }
+    if (coders.size() == 2) {
+      Append7zNumber(1, &folders_info);
+      Append7zNumber(0, &folders_info);
+      Append7zNumber(data.size(), &unpack_sizes);
+    } else if (coders.size() == 4) {
+      const uint32 kBindPairs[] = { 5, 0, 4, 1, 3, 2 };
+      const uint32 kPackStreams[] = { 2, 6, 1, 0 };
+      for (size_t j = 0; j != arraysize(kBindPairs); ++j) {
+        Append7zNumber(kBindPairs[j], &folders_info);
+      }
+      for (size_t j = 0; j != arraysize(kPackStreams); ++j) {
+        Append7zNumber(kPackStreams[j], &folders_info);
+      }
+      Append7zNumber(0, &unpack_sizes);
+      Append7zNumber(0, &unpack_sizes);
+      Append7zNumber(data.size(), &unpack_sizes);
+    }
+    Append7zNumber(data.size(), &unpack_sizes);
+
+    for (size_t j = 0; j != streams.size(); ++j) {
+      packed.insert(packed.end(), streams[j].begin(), streams[j].end());
+      pack_sizes.push_back(streams[j].size());
+    }
+  }
+
+  std::vector<uint8> header;
+  header.push_back(0x01);  // Header.
+  header.push_back(0x04);  // Main streams info.
+  header.push_back(0x06);  // Pack info.
+  Append7zNumber(0, &header);
+  Append7zNumber(pack_sizes.size(), &header);
+  header.push_back(0x09);  // Size.
+  for (size_t i = 0; i != pack_sizes.size(); ++i) {
+    Append7zNumber(pack_sizes[i], &header);
+  }
+  header.push_back(0x00);
+  header.push_back(0x07);  // Unpack info.
+  header.push_back(0x0B);  // Folder.
+  Append7zNumber(folders.size(), &header);
+  header.push_back(0x00);
+  AppendBytes(&folders_info.front(), folders_info.size(), &header);
+  header.push_back(0x0C);  // Coders unpack size.
+  AppendBytes(&unpack_sizes.front(), unpack_sizes.size(), &header);
+  header.push_back(0x00);
+  header.push_back(0x08);  // Substreams info.
+  header.push_back(0x0D);  // Number of unpack streams.
+  for (size_t i = 0; i != folders.size(); ++i) {
+    Append7zNumber(folders[i].members.size(), &header);
+  }
+  header.push_back(0x09);  // Size.
+  for (size_t i = 0; i != folders.size(); ++i) {
+    for (size_t j = 0; j + 1 < folders[i].members.size(); ++j) {
+      Append7zNumber(folders[i].members[j].size(), &header);
+    }
+  }
+  header.push_back(0x0A);  // CRC.
+  header.push_back(0x01);
+  for (size_t i = 0; i != folders.size(); ++i) {
+    for (size_t j = 0; j != folders[i].members.size(); ++j) {
+      AppendCrc(&folders[i].members[j].front(),
+                folders[i].members[j].size(),
+                &header);
+    }
+  }
+  header.push_back(0x00);
+  header.push_back(0x00);
+
+  std::vector<std::wstring> names(directories);
+  std::vector<bool> empty_streams(directories.size(), true);
+  std::vector<bool> empty_files_bits(directories.size(), false);
+  for (size_t i = 0; i != folders.size(); ++i) {
+    names.insert(names.end(), folders[i].names.begin(), folders[i].names.end());
+    empty_streams.resize(names.size(), false);
+  }
+  names.insert(names.end(), empty_files.begin(), empty_files.end());
+  empty_streams.resize(names.size(), true);
+  empty_files_bits.resize(empty_files_bits.size() + empty_files.size(), true);
+
+  header.push_back(0x05);  // Files info.
+  Append7zNumber(names.size(), &header);
+  if (!directories.empty() || !empty_files.empty()) {
+    header.push_back(0x0E);  // Empty stream.
+    AppendBitVector(empty_streams, &header);
+    header.push_back(0x0F);  // Empty file.
+    AppendBitVector(empty_files_bits, &header);
+  }
+  std::vector<uint8> names_data;
+  names_data.push_back(0x00);
+  for (size_t i = 0; i != names.size(); ++i) {
+    for (size_t j = 0; j <= names[i].size(); ++j) {
+      const uint16 c = j < names[i].size() ? names[i][j] : 0;
+      names_data.push_back(static_cast<uint8>(c));
+      names_data.push_back(static_cast<uint8>(c >> 8));
+    }
+  }
+  header.push_back(0x11);  // Name.
+  Append7zNumber(names_data.size(), &header);
+  AppendBytes(&names_data.front(), names_data.size(), &header);
+  header.push_back(0x00);
+  header.push_back(0x00);
+
+  const uint8 kSignature[] = { '7', 'z', 0xBC, 0xAF, 0x27, 0x1C, 0x00, 0x04 };
+  std::vector<uint8> start_header;
+  AppendUint64(packed.size(), &start_header);
+  AppendUint64(header.size(), &start_header);
+  AppendCrc(&header.front(), header.size(), &start_header);
+
+  std::vector<uint8> archive;
+  AppendBytes(kSignature, sizeof(kSignature), &archive);
+  AppendCrc(&start_header.front(), start_header.size(), &archive);
+  AppendBytes(&start_header.front(), start_header.size(), &archive);
+  archive.insert(archive.end(), packed.begin(), packed.end());
+  archive.insert(archive.end(), header.begin(), header.end());
+  return archive;
+}
+
+class MemoryInput : public ArchiveInput {
+ public:
+  explicit MemoryInput(const std::vector<uint8>& data) : data_(data) {}
+
+  virtual uint64 GetSize() { return data_.size(); }
+
+  virtual bool ReadAt(uint64 offset, uint8* data, size_t size) {
+    if (offset > data_.size() || size > data_.size() - offset) {
+      return false;
+    }
+    memcpy(data, &data_[static_cast<size_t>(offset)], size);
+    return true;
+  }
+
+ private:
+  const std::vector<uint8>& data_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryInput);
+};
+
+class MemoryOutput : public ArchiveOutput {
+ public:
+  MemoryOutput() : max_write_size_(0), fail_(false) {}
+
+  virtual bool CreateMember(size_t index,
+                            const std::wstring& name,
+                            uint64 size,
+                            bool is_directory) {
+    EXPECT_EQ(members_.size(), index);
+    EXPECT_TRUE(!is_directory || !size);
+    names_.push_back(name);
+    members_.push_back(std::vector<uint8>(static_cast<size_t>(size)));
+    return true;
+  }
+
+  virtual bool WriteMember(size_t index,
+                           uint64 offset,
+                           const uint8* data,
+                           size_t size) {
+    EXPECT_GT(members_.size(), index);
+    std::vector<uint8>& member = members_[index];
+    EXPECT_GE(member.size(), offset + size);
+    if (fail_ || member.size() < offset + size) {
+      return false;
+    }
+    memcpy(&member[static_cast<size_t>(offset)], data, size);
+    max_write_size_ = std::max(max_write_size_, size);
+    return true;
+  }
+
+  const std::vector<std::wstring>& names() const { return names_; }
+  const std::vector<std::vector<uint8> >& members() const { return members_; }
+  size_t max_write_size() const { return max_write_size_; }
+  void set_fail(bool fail) { fail_ = fail; }
+
+ private:
+  std::vector<std::wstring> names_;
+  std::vector<std::vector<uint8> > members_;
+  size_t max_write_size_;
+  bool fail_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryOutput);
+};
+
+std::vector<uint8> Concatenate(const std::vector<std::vector<uint8> >& parts) {
+  std::vector<uint8> result;
+  for (size_t i = 0; i != parts.size(); ++i) {
+    result.insert(result.end(), parts[i].begin(), parts[i].end());
+  }
+  return result;
+}
+
+}  // namespace
+
+class ArchiveExtractorTest : public testing::Test {
+ protected:
+  // The builders compute CRCs before the extractor initializes the table.
+  static void SetUpTestCase() {
+    CrcGenerateTable();
+  }
+};
+
+TEST_F(ArchiveExtractorTest, GetArchiveFormat) {
+  const uint8 kXz[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00, 0x00 };
+  const uint8 k7z[] = { '7', 'z', 0xBC, 0xAF, 0x27, 0x1C, 0x00 };
+  const uint8 kExe[] = { 'M', 'Z', 0x90, 0x00, 0x03, 0x00, 0x00 };
+  EXPECT_EQ(ARCHIVE_FORMAT_XZ, GetArchiveFormat(kXz, sizeof(kXz)));
+  EXPECT_EQ(ARCHIVE_FORMAT_7Z, GetArchiveFormat(k7z, sizeof(k7z)));
+  EXPECT_EQ(ARCHIVE_FORMAT_NONE, GetArchiveFormat(kExe, sizeof(kExe)));
+  EXPECT_EQ(ARCHIVE_FORMAT_NONE, GetArchiveFormat(kXz, 3));
+}
+
+TEST_F(ArchiveExtractorTest, Xz_BlocksAreTasks) {
+  TestRandom random(1);
+  std::vector<std::vector<uint8> > blocks1;
+  blocks1.push_back(MakeCode(100 * 1024, &random));
+  blocks1.push_back(MakeCode(1, &random));
+  blocks1.push_back(MakeCode(30000, &random));
+  std::vector<std::vector<uint8> > blocks2;
+  blocks2.push_back(MakeCode(70000, &random));
+
+  // Concatenated streams are one member.
+  std::vector<uint8> archive(BuildXzStream(blocks1));
+  const std::vector<uint8> stream2(BuildXzStream(blocks2));
+  archive.insert(archive.end(), stream2.begin(), stream2.end());
+  std::vector<uint8> expected(Concatenate(blocks1));
+  expected.insert(expected.end(), blocks2[0].begin(), blocks2[0].end());
+
+  MemoryInput input(archive);
+  MemoryOutput output;
+  ArchiveExtractor extractor;
+  ASSERT_TRUE(extractor.Open(&input, L"setup.exe", &output));
+  EXPECT_EQ(ARCHIVE_FORMAT_XZ, extractor.format());
+  EXPECT_EQ(4, extractor.num_tasks());
+  EXPECT_EQ(expected.size(), extractor.unpacked_size());
+  ASSERT_EQ(1, output.members().size());
+  EXPECT_STREQ(L"setup.exe", output.names()[0].c_str());
+
+  // The tasks are independent.
+  for (size_t i = extractor.num_tasks(); i-- > 0;) {
+    EXPECT_TRUE(extractor.ExtractTask(i));
+  }
+  EXPECT_TRUE(expected == output.members()[0]);
+  EXPECT_GE(64U * 1024, output.max_write_size());
+}
+
+TEST_F(ArchiveExtractorTest, Xz_Empty) {
+  const std::vector<uint8> archive(
+      BuildXzStream(std::vector<std::vector<uint8> >()));
+  MemoryInput input(archive);
+  MemoryOutput output;
+  EXPECT_TRUE(ExtractArchive(&input, L"empty", &output));
+  ASSERT_EQ(1, output.members().size());
+  EXPECT_TRUE(output.members()[0].empty());
+}
+
+TEST_F(ArchiveExtractorTest, Xz_CorruptedArchivesAreRejected) {
+  TestRandom random(2);
+  std::vector<std::vector<uint8> > blocks;
+  blocks.push_back(MakeCode(5000, &random));
+  blocks.push_back(MakeCode(5000, &random));
+  const std::vector<uint8> archive(BuildXzStream(blocks));
+
+  // A byte of the data, a byte of the check of the last block, and a byte of
+  // the index.
+  const size_t kOffsets[] = { 100, 10054, archive.size() - 20 };
+  for (size_t i = 0; i != arraysize(kOffsets); ++i) {
+    std::vector<uint8> corrupted(archive);
+    corrupted[kOffsets[i]] ^= 0x01;
+    MemoryInput input(corrupted);
+    MemoryOutput output;
+    EXPECT_FALSE(ExtractArchive(&input, L"setup.exe", &output)) << i;
+  }
+
+  for (size_t size = 0; size < archive.size(); size += 97) {
+    const std::vector<uint8> truncated(archive.begin(), archive.begin() + size);
+    MemoryInput input(truncated);
+    MemoryOutput output;
+    EXPECT_FALSE(ExtractArchive(&input, L"setup.exe", &output));
+  }
+}
+
+TEST_F(ArchiveExtractorTest, 7z_Methods) {
+  TestRandom random(3);
+  std::vector<TestFolder> folders;
+  folders.push_back(TestFolder(FOLDER_COPY));
+  folders.back().AddMember(L"copy.bin", MakeCode(1000, &random));
+  folders.push_back(TestFolder(FOLDER_LZMA));
+  folders.back().AddMember(L"docs\\lzma.txt", MakeText(kLzmaTextSize));
+  folders.push_back(TestFolder(FOLDER_LZMA2));
+  folders.back().AddMember(L"lzma2.bin", MakeCode(200 * 1024, &random));
+  folders.push_back(TestFolder(FOLDER_LZMA2_BCJ));
+  folders.back().AddMember(L"bin/x86.exe", MakeCode(300 * 1024 + 3, &random));
+  folders.push_back(TestFolder(FOLDER_LZMA2_ARM));
+  folders.back().AddMember(L"bin/arm.exe", MakeCode(100 * 1024 + 1, &random));
+  folders.push_back(TestFolder(FOLDER_BCJ2));
+  folders.back().AddMember(L"bcj2.txt", MakeText(150 * 1024));
+  std::vector<std::wstring> directories;
+  directories.push_back(L"bin");
+  directories.push_back(L"docs");
+  std::vector<std::wstring> empty_files;
+  empty_files.push_back(L"empty.txt");
+  const std::vector<uint8> archive(Build7z(folders, directories, empty_files));
+
+  MemoryInput input(archive);
+  MemoryOutput output;
+  ArchiveExtractor extractor;
+  ASSERT_TRUE(extractor.Open(&input, L"unused", &output));
+  EXPECT_EQ(ARCHIVE_FORMAT_7Z, extractor.format());
+  EXPECT_EQ(folders.size(), extractor.num_tasks());
+  for (size_t i = 0; i != extractor.num_tasks(); ++i) {
+    EXPECT_TRUE(extractor.ExtractTask(i)) << i;
+  }
+
+  const std::vector<ArchiveMember>& members = extractor.members();
+  ASSERT_EQ(9, members.size());
+  ASSERT_EQ(9, output.members().size());
+  EXPECT_STREQ(L"bin", members[0].name.c_str());
+  EXPECT_TRUE(members[0].is_directory);
+  EXPECT_STREQ(L"docs", output.names()[1].c_str());
+  EXPECT_TRUE(members[1].is_directory);
+  for (size_t i = 0; i != folders.size(); ++i) {
+    EXPECT_STREQ(folders[i].names[0].c_str(), members[2 + i].name.c_str());
+    EXPECT_FALSE(members[2 + i].is_directory);
+    EXPECT_EQ(folders[i].members[0].size(), members[2 + i].size);
+    EXPECT_TRUE(folders[i].members[0] == output.members()[2 + i]) << i;
+  }
+  EXPECT_STREQ(L"empty.txt", members[8].name.c_str());
+  EXPECT_FALSE(members[8].is_directory);
+  EXPECT_EQ(0, members[8].size);
+  EXPECT_GE(64U * 1024, output.max_write_size());
+}
+
+TEST_F(ArchiveExtractorTest, 7z_SolidFolder) {
+  TestRandom random(4);
+  std::vector<TestFolder> folders;
+  folders.push_back(TestFolder(FOLDER_LZMA2_BCJ));
+  for (int i = 0; i < 20; ++i) {
+    folders.back().AddMember(std::wstring(1, L'a' + i),
+                             MakeCode(1 + random.Next() % 50000, &random));
+  }
+  folders.push_back(TestFolder(FOLDER_COPY));
+  folders.back().AddMember(L"small", MakeCode(10, &random));
+  const std::vector<uint8> archive(
+      Build7z(folders, std::vector<std::wstring>(),
+              std::vector<std::wstring>()));
+
+  MemoryInput input(archive);
+  MemoryOutput output;
+  ArchiveExtractor extractor;
+  ASSERT_TRUE(extractor.Open(&input, L"unused", &output));
+  EXPECT_EQ(2, extractor.num_tasks());
+  EXPECT_TRUE(extractor.ExtractTask(1));
+  EXPECT_TRUE(extractor.ExtractTask(0));
+  ASSERT_EQ(21, output.members().size());
+  for (size_t i = 0; i != 20; ++i) {
+    EXPECT_TRUE(folders[0].members[i] == output.members()[i]) << i;
+  }
+  EXPECT_TRUE(folders[1].members[0] == output.members()[20]);
+}
+
+TEST_F(ArchiveExtractorTest, 7z_CorruptedMembersAreRejected) {
+  TestRandom random(5);
+  std::vector<TestFolder> folders;
+  folders.push_back(TestFolder(FOLDER_COPY));
+  folders.back().AddMember(L"first", MakeCode(1000, &random));
+  folders.back().AddMember(L"second", MakeCode(1000, &random));
+  const std::vector<uint8> archive(
+      Build7z(folders, std::vector<std::wstring>(),
+              std::vector<std::wstring>()));
+
+  // The packed streams start after the signature header of 32 bytes.
+  const size_t kOffsets[] = { 32, 32 + 1500 };
+  for (size_t i = 0; i != arraysize(kOffsets); ++i) {
+    std::vector<uint8> corrupted(archive);
+    corrupted[kOffsets[i]] ^= 0x01;
+    MemoryInput input(corrupted);
+    MemoryOutput output;
+    EXPECT_FALSE(ExtractArchive(&input, L"unused", &output)) << i;
+  }
+
+  // The header is corrupted.
+  std::vector<uint8> corrupted(archive);
+  corrupted[archive.size() - 10] ^= 0x01;
+  MemoryInput input(corrupted);
+  MemoryOutput output;
+  EXPECT_FALSE(ExtractArchive(&input, L"unused", &output));
+
+  for (size_t size = 0; size < archive.size(); size += 97) {
+    const std::vector<uint8> truncated(archive.begin(), archive.begin() + size);
+    MemoryInput truncated_input(truncated);
+    MemoryOutput truncated_output;
+    EXPECT_FALSE(ExtractArchive(&truncated_input, L"unused",
+                                &truncated_output));
+  }
+}
+
+TEST_F(ArchiveExtractorTest, OutputFailure) {
+  TestRandom random(6);
+  std::vector<TestFolder> folders;
+  folders.push_back(TestFolder(FOLDER_LZMA2));
+  folders.back().AddMember(L"member", MakeCode(1000, &random));
+  const std::vector<uint8> archive(
+      Build7z(folders, std::vector<std::wstring>(),
+              std::vector<std::wstring>()));
+
+  MemoryInput input(archive);
+  MemoryOutput output;
+  output.set_fail(true);
+  EXPECT_FALSE(ExtractArchive(&input, L"unused", &output));
+}
+
+TEST_F(ArchiveExtractorTest, NotAnArchive) {
+  TestRandom random(7);
+  const std::vector<uint8> data(MakeCode(1000, &random));
+  MemoryInput input(data);
+  MemoryOutput output;
+  ArchiveExtractor extractor;
+  EXPECT_FALSE(extractor.Open(&input, L"setup.exe", &output));
+  EXPECT_EQ(ARCHIVE_FORMAT_NONE, extractor.format());
+  EXPECT_TRUE(output.members().empty());
+}
+
+// Measures the overhead of the extractor on an archive of the size of a large
+// installer, and the time of its largest task, which bounds the time of the
+// extraction on several threads. The blocks are stored, so the time of the
+// LZMA decoder itself is not included.
+TEST_F(ArchiveExtractorTest, DISABLED_Benchmark) {
+  const size_t kBlockSize = 4 * 1024 * 1024;
+  const int kNumBlocks = 8;
+
+  TestRandom random(8);
+  std::vector<std::vector<uint8> > blocks;
+  for (int i = 0; i < kNumBlocks; ++i) {
+    blocks.push_back(MakeCode(kBlockSize, &random));
+  }
+  const std::vector<uint8> archive(BuildXzStream(blocks));
+
+  MemoryInput input(archive);
+  MemoryOutput output;
+  ArchiveExtractor extractor;
+  ASSERT_TRUE(extractor.Open(&input, L"setup.exe", &output));
+  ULONGLONG largest_task_ticks = 0;
+  const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  for (size_t i = 0; i != extractor.num_tasks(); ++i) {
+    const ULONGLONG task_start_ticks = HighresTimer::GetCurrentTicks();
+    EXPECT_TRUE(extractor.ExtractTask(i));
+    largest_task_ticks = std::max(largest_task_ticks,
+                                  HighresTimer::GetCurrentTicks() -
+                                      task_start_ticks);
+  }
+  const ULONGLONG ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+  EXPECT_TRUE(Concatenate(blocks) == output.members()[0]);
+
+  const double ms_per_tick = 1000.0 / HighresTimer::GetTimerFrequency();
+  const double ms = ticks * ms_per_tick;
+  OPT_LOG(L1, (_T("[extracted %llu bytes in %d tasks][%f ms][%f MB/s]")
+               _T("[largest task %f ms]"),
+               extractor.unpacked_size(),
+               static_cast<int>(extractor.num_tasks()), ms,
+               extractor.unpacked_size() / 1000.0 / ms,
+               largest_task_ticks * ms_per_tick));
+}
+
+}  // namespace omaha
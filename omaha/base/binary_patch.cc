@@ -0,0 +1,611 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/binary_patch.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace omaha {
+
+namespace {
+
+const uint8 kMagic[] = { 'O', 'M', 'D', 'I', 'F', 'F', '0', '1' };
+
+// The size of the chunks written to the output.
+const size_t kOutputChunkSize = 64 * 1024;
+
+// A run of zeros shorter than this is cheaper to encode as literal bytes.
+const size_t kMinZeroRun = 3;
+
+// A match is used once it is longer by this many bytes than the match which
+// continues the previous block.
+const int64 kMinMatchGain = 8;
+
+void AppendVarint(uint64 value, std::vector<uint8>* patch) {
+  while (value >= 0x80) {
+    patch->push_back(static_cast<uint8>(value | 0x80));
+    value >>= 7;
+  }
+  patch->push_back(static_cast<uint8>(value));
+}
+
+uint64 ZigZagEncode(int64 value) {
+  return (static_cast<uint64>(value) << 1) ^ static_cast<uint64>(value >> 63);
+}
+
+int64 ZigZagDecode(uint64 value) {
+  return static_cast<int64>(value >> 1) ^ -static_cast<int64>(value & 1);
+}
+
+// Reads the patch sequentially and fails once it reads past the end.
+class PatchReader {
+ public:
+  PatchReader(const uint8* patch, size_t patch_size)
+      : patch_(patch), size_(patch_size), position_(0) {}
+
+  bool ReadVarint(uint64* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (position_ == size_) {
+        return false;
+      }
+      const uint8 byte = patch_[position_++];
+      if (shift == 63 && byte > 1) {
+        return false;
+      }
+      *value |= static_cast<uint64>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Returns a pointer to the next |size| bytes of the patch.
+  bool ReadBytes(uint64 size, const uint8** bytes) {
+    if (size > size_ - position_) {
+      return false;
+    }
+    *bytes = patch_ + position_;
+    position_ += static_cast<size_t>(size);
+    return true;
+  }
+
+  bool at_end() const { return position_ == size_; }
+
+ private:
+  const uint8* patch_;
+  size_t size_;
+  size_t position_;
+
+  DISALLOW_COPY_AND_ASSIGN(PatchReader);
+};
+
+// Buffers the new file into chunks of kOutputChunkSize.
+class ChunkWriter {
+ public:
+  explicit ChunkWriter(BinaryPatchOutput* output) : output_(output) {
+    chunk_.reserve(kOutputChunkSize);
+  }
+
+  uint8* Reserve(size_t size) {
+    const size_t chunk_size = chunk_.size();
+    chunk_.resize(chunk_size + size);
+    return &chunk_[chunk_size];
+  }
+
+  size_t available() const { return kOutputChunkSize - chunk_.size(); }
+
+  bool FlushIfFull() {
+    return chunk_.size() < kOutputChunkSize || Flush();
+  }
+
+  bool Flush() {
+    if (chunk_.empty()) {
+      return true;
+    }
+    const bool result = output_->Write(&chunk_[0], chunk_.size());
+    chunk_.clear();
+    return result;
+  }
+
+ private:
+  BinaryPatchOutput* output_;
+  std::vector<uint8> chunk_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkWriter);
+};
+
+class VectorOutput : public BinaryPatchOutput {
+ public:
+  explicit VectorOutput(std::vector<uint8>* data) : data_(data) {}
+
+  virtual bool Write(const uint8* data, size_t size) {
+    data_->insert(data_->end(), data, data + size);
+    return true;
+  }
+
+ private:
+  std::vector<uint8>* data_;
+
+  DISALLOW_COPY_AND_ASSIGN(VectorOutput);
+};
+
+// Writes |size| bytes of the new file, which are the old bytes plus the
+// differences. A NULL |differences| means the differences are all zero.
+bool WriteSum(const uint8* old_bytes,
+              const uint8* differences,
+              size_t size,
+              ChunkWriter* writer) {
+  while (size) {
+    const size_t count = std::min(size, writer->available());
+    uint8* out = writer->Reserve(count);
+    if (differences) {
+      for (size_t i = 0; i != count; ++i) {
+        out[i] = static_cast<uint8>(old_bytes[i] + differences[i]);
+      }
+      differences += count;
+    } else {
+      memcpy(out, old_bytes, count);
+    }
+    old_bytes += count;
+    size -= count;
+    if (!writer->FlushIfFull()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WriteCopy(const uint8* bytes, size_t size, ChunkWriter* writer) {
+  while (size) {
+    const size_t count = std::min(size, writer->available());
+    memcpy(writer->Reserve(count), bytes, count);
+    bytes += count;
+    size -= count;
+    if (!writer->FlushIfFull()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Sorts the suffixes of |data| by prefix doubling. Each round sorts the
+// suffixes by their first 2k bytes, using the ranks of the previous round
+// for the first k bytes and for the next k bytes.
+void BuildSuffixArray(const uint8* data,
+                      int32 size,
+                      std::vector<int32>* suffix_array) {
+  std::vector<int32>& sa = *suffix_array;
+  sa.resize(size);
+  if (!size) {
+    return;
+  }
+
+  std::vector<int32> rank(size);
+  std::vector<int32> next(size);
+  std::vector<int32> count(std::max(256, size) + 1, 0);
+
+  for (int32 i = 0; i != size; ++i) {
+    ++count[data[i] + 1];
+  }
+  for (int i = 1; i <= 256; ++i) {
+    count[i] += count[i - 1];
+  }
+  for (int32 i = 0; i != size; ++i) {
+    sa[count[data[i]]++] = i;
+  }
+  int32 num_ranks = 1;
+  rank[sa[0]] = 0;
+  for (int32 i = 1; i != size; ++i) {
+    if (data[sa[i]] != data[sa[i - 1]]) {
+      ++num_ranks;
+    }
+    rank[sa[i]] = num_ranks - 1;
+  }
+
+  for (int64 k = 1; num_ranks < size; k *= 2) {
+    // Orders the suffixes by their second half. The suffixes which are too
+    // short to have one come first.
+    int32 j = 0;
+    for (int64 i = std::max(size - k, static_cast<int64>(0)); i < size; ++i) {
+      next[j++] = static_cast<int32>(i);
+    }
+    for (int32 i = 0; i != size; ++i) {
+      if (sa[i] >= k) {
+        next[j++] = static_cast<int32>(sa[i] - k);
+      }
+    }
+
+    // Stable counting sort by the first half.
+    std::fill(count.begin(), count.begin() + num_ranks + 1, 0);
+    for (int32 i = 0; i != size; ++i) {
+      ++count[rank[i] + 1];
+    }
+    for (int32 i = 1; i <= num_ranks; ++i) {
+      count[i] += count[i - 1];
+    }
+    for (int32 i = 0; i != size; ++i) {
+      sa[count[rank[next[i]]]++] = next[i];
+    }
+
+    // Ranks the suffixes by both halves.
+    next[sa[0]] = 0;
+    num_ranks = 1;
+    for (int32 i = 1; i != size; ++i) {
+      const int32 current = sa[i];
+      const int32 previous = sa[i - 1];
+      const int32 current_second =
+          current + k < size ? rank[static_cast<size_t>(current + k)] : -1;
+      const int32 previous_second =
+          previous + k < size ? rank[static_cast<size_t>(previous + k)] : -1;
+      if (rank[current] != rank[previous] ||
+          current_second != previous_second) {
+        ++num_ranks;
+      }
+      next[current] = num_ranks - 1;
+    }
+    rank.swap(next);
+  }
+}
+
+int64 MatchLength(const uint8* a, int64 a_size, const uint8* b, int64 b_size) {
+  const int64 size = std::min(a_size, b_size);
+  int64 i = 0;
+
+  // The matches of similar files are long, so most of the bytes are compared
+  // in blocks.
+  const int64 kBlockSize = 64;
+  while (size - i >= kBlockSize && !memcmp(a + i, b + i, kBlockSize)) {
+    i += kBlockSize;
+  }
+  while (i < size && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+// Finds the longest match of |target| in |old_data| by binary search in the
+// suffix array. Returns the length of the match and its position in |pos|.
+int64 FindLongestMatch(const std::vector<int32>& sa,
+                       const uint8* old_data,
+                       int64 old_size,
+                       const uint8* target,
+                       int64 target_size,
+                       int64* pos) {
+  size_t low = 0;
+  size_t high = sa.size() - 1;
+  while (high - low >= 2) {
+    const size_t middle = low + (high - low) / 2;
+    const int64 compare_size = std::min(old_size - sa[middle], target_size);
+    if (memcmp(old_data + sa[middle], target,
+               static_cast<size_t>(compare_size)) < 0) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  const int64 low_length = MatchLength(old_data + sa[low], old_size - sa[low],
+                                       target, target_size);
+  const int64 high_length = MatchLength(old_data + sa[high],
+                                        old_size - sa[high],
+                                        target, target_size);
+  if (low_length > high_length) {
+    *pos = sa[low];
+    return low_length;
+  }
+  *pos = sa[high];
+  return high_length;
+}
+
+// Appends the differences between the new and the old bytes. The zeros are
+// encoded as runs, since they are most of the differences of similar files.
+void AppendDifferences(const uint8* old_bytes,
+                       const uint8* new_bytes,
+                       size_t size,
+                       std::vector<uint8>* patch) {
+  size_t i = 0;
+  while (i < size) {
+    const size_t zeros_start = i;
+    while (i < size && old_bytes[i] == new_bytes[i]) {
+      ++i;
+    }
+    const size_t literal_start = i;
+    while (i < size) {
+      if (old_bytes[i] != new_bytes[i]) {
+        ++i;
+        continue;
+      }
+      size_t run = 0;
+      while (i + run < size && run < kMinZeroRun &&
+             old_bytes[i + run] == new_bytes[i + run]) {
+        ++run;
+      }
+      if (run == kMinZeroRun || i + run == size) {
+        break;
+      }
+      i += run;
+    }
+
+    AppendVarint(literal_start - zeros_start, patch);
+    AppendVarint(i - literal_start, patch);
+    for (size_t j = literal_start; j != i; ++j) {
+      patch->push_back(static_cast<uint8>(new_bytes[j] - old_bytes[j]));
+    }
+  }
+}
+
+bool ReadHeader(PatchReader* reader, uint64* old_size, uint64* new_size) {
+  const uint8* magic = NULL;
+  return reader->ReadBytes(sizeof(kMagic), &magic) &&
+         !memcmp(magic, kMagic, sizeof(kMagic)) &&
+         reader->ReadVarint(old_size) &&
+         reader->ReadVarint(new_size);
+}
+
+}  // namespace
+
+// The new file is scanned for matches in the old file. A match ends the
+// current block once it is better than the bytes which continue the previous
+// match. The block is then made of the extension of the previous match, the
+// bytes which match neither, and the backward extension of the new match.
+// This follows the bsdiff algorithm by Colin Percival.
+bool CreateBinaryPatch(const uint8* old_data,
+                       size_t old_size,
+                       const uint8* new_data,
+                       size_t new_size,
+                       std::vector<uint8>* patch) {
+  if (!patch ||
+      (!old_data && old_size) ||
+      (!new_data && new_size) ||
+      old_size > static_cast<size_t>(kint32max)) {
+    return false;
+  }
+
+  patch->clear();
+  patch->insert(patch->end(), kMagic, kMagic + sizeof(kMagic));
+  AppendVarint(old_size, patch);
+  AppendVarint(new_size, patch);
+
+  std::vector<int32> sa;
+  BuildSuffixArray(old_data, static_cast<int32>(old_size), &sa);
+
+  const int64 old_length = static_cast<int64>(old_size);
+  const int64 new_length = static_cast<int64>(new_size);
+  int64 scan = 0;
+  int64 length = 0;
+  int64 pos = 0;
+  int64 last_scan = 0;
+  int64 last_pos = 0;
+  int64 last_offset = 0;
+
+  while (scan < new_length) {
+    int64 old_score = 0;
+    int64 scored = scan += length;
+    for (; scan < new_length; ++scan) {
+      length = sa.empty() ? 0 : FindLongestMatch(sa,
+                                                 old_data,
+                                                 old_length,
+                                                 new_data + scan,
+                                                 new_length - scan,
+                                                 &pos);
+      for (; scored < scan + length; ++scored) {
+        if (scored + last_offset < old_length &&
+            old_data[scored + last_offset] == new_data[scored]) {
+          ++old_score;
+        }
+      }
+      if ((length == old_score && length) ||
+          length > old_score + kMinMatchGain) {
+        break;
+      }
+      if (scan + last_offset < old_length &&
+          old_data[scan + last_offset] == new_data[scan]) {
+        --old_score;
+      }
+    }
+
+    if (length == old_score && scan != new_length) {
+      continue;
+    }
+
+    // Extends the previous match forward while at least half the bytes match.
+    int64 forward_length = 0;
+    int64 score = 0;
+    int64 best_score = 0;
+    for (int64 i = 0; last_scan + i < scan && last_pos + i < old_length;) {
+      if (old_data[last_pos + i] == new_data[last_scan + i]) {
+        ++score;
+      }
+      ++i;
+      if (score * 2 - i > best_score * 2 - forward_length) {
+        best_score = score;
+        forward_length = i;
+      }
+    }
+
+    // Extends the new match backward the same way.
+    int64 backward_length = 0;
+    if (scan < new_length) {
+      score = 0;
+      best_score = 0;
+      for (int64 i = 1; scan >= last_scan + i && pos >= i; ++i) {
+        if (old_data[pos - i] == new_data[scan - i]) {
+          ++score;
+        }
+        if (score * 2 - i > best_score * 2 - backward_length) {
+          best_score = score;
+          backward_length = i;
+        }
+      }
+    }
+
+    // Splits the overlap of the extensions where it matches best.
+    if (last_scan + forward_length > scan - backward_length) {
+      const int64 overlap = last_scan + forward_length -
+                            (scan - backward_length);
+      score = 0;
+      best_score = 0;
+      int64 split = 0;
+      for (int64 i = 0; i < overlap; ++i) {
+        if (new_data[last_scan + forward_length - overlap + i] ==
+            old_data[last_pos + forward_length - overlap + i]) {
+          ++score;
+        }
+        if (new_data[scan - backward_length + i] ==
+            old_data[pos - backward_length + i]) {
+          --score;
+        }
+        if (score > best_score) {
+          best_score = score;
+          split = i + 1;
+        }
+      }
+      forward_length += split - overlap;
+      backward_length -= split;
+    }
+
+    const int64 extra_length = (scan - backward_length) -
+                               (last_scan + forward_length);
+    const int64 seek = (pos - backward_length) - (last_pos + forward_length);
+    AppendVarint(static_cast<uint64>(forward_length), patch);
+    AppendVarint(static_cast<uint64>(extra_length), patch);
+    AppendVarint(ZigZagEncode(seek), patch);
+    AppendDifferences(old_data + last_pos,
+                      new_data + last_scan,
+                      static_cast<size_t>(forward_length),
+                      patch);
+    const uint8* extra = new_data + last_scan + forward_length;
+    patch->insert(patch->end(), extra, extra + extra_length);
+
+    last_scan = scan - backward_length;
+    last_pos = pos - backward_length;
+    last_offset = pos - scan;
+  }
+
+  return true;
+}
+
+bool ApplyBinaryPatch(const uint8* old_data,
+                      size_t old_size,
+                      const uint8* patch,
+                      size_t patch_size,
+                      BinaryPatchOutput* output) {
+  if (!patch || !output || (!old_data && old_size)) {
+    return false;
+  }
+
+  PatchReader reader(patch, patch_size);
+  uint64 expected_old_size = 0;
+  uint64 new_size = 0;
+  if (!ReadHeader(&reader, &expected_old_size, &new_size) ||
+      expected_old_size != old_size) {
+    return false;
+  }
+
+  ChunkWriter writer(output);
+  uint64 new_pos = 0;
+  uint64 old_pos = 0;
+  while (new_pos < new_size) {
+    uint64 diff_length = 0;
+    uint64 extra_length = 0;
+    uint64 encoded_seek = 0;
+    if (!reader.ReadVarint(&diff_length) ||
+        !reader.ReadVarint(&extra_length) ||
+        !reader.ReadVarint(&encoded_seek) ||
+        diff_length > old_size - old_pos ||
+        diff_length > new_size - new_pos ||
+        extra_length > new_size - new_pos - diff_length) {
+      return false;
+    }
+
+    const uint8* old_bytes = old_data + old_pos;
+    uint64 remaining = diff_length;
+    while (remaining) {
+      uint64 zeros = 0;
+      uint64 literals = 0;
+      const uint8* differences = NULL;
+      if (!reader.ReadVarint(&zeros) ||
+          !reader.ReadVarint(&literals) ||
+          zeros > remaining ||
+          literals > remaining - zeros ||
+          (!zeros && !literals) ||
+          !reader.ReadBytes(literals, &differences)) {
+        return false;
+      }
+      const size_t num_zeros = static_cast<size_t>(zeros);
+      const size_t num_literals = static_cast<size_t>(literals);
+      if (!WriteSum(old_bytes, NULL, num_zeros, &writer) ||
+          !WriteSum(old_bytes + num_zeros, differences, num_literals,
+                    &writer)) {
+        return false;
+      }
+      old_bytes += num_zeros + num_literals;
+      remaining -= zeros + literals;
+    }
+
+    const uint8* extra = NULL;
+    if (!reader.ReadBytes(extra_length, &extra) ||
+        !WriteCopy(extra, static_cast<size_t>(extra_length), &writer)) {
+      return false;
+    }
+
+    const int64 seek = ZigZagDecode(encoded_seek);
+    const int64 next_old_pos = static_cast<int64>(old_pos + diff_length) + seek;
+    if (next_old_pos < 0 || static_cast<uint64>(next_old_pos) > old_size) {
+      return false;
+    }
+    old_pos = static_cast<uint64>(next_old_pos);
+    new_pos += diff_length + extra_length;
+  }
+
+  return reader.at_end() && writer.Flush();
+}
+
+bool ApplyBinaryPatch(const uint8* old_data,
+                      size_t old_size,
+                      const uint8* patch,
+                      size_t patch_size,
+                      std::vector<uint8>* new_data) {
+  if (!new_data) {
+    return false;
+  }
+
+  // The size in the header is not trusted for the allocation.
+  new_data->clear();
+  uint64 new_size = 0;
+  if (GetBinaryPatchNewSize(patch, patch_size, &new_size)) {
+    new_data->reserve(static_cast<size_t>(
+        std::min(new_size, static_cast<uint64>(old_size) + patch_size)));
+  }
+
+  VectorOutput output(new_data);
+  return ApplyBinaryPatch(old_data, old_size, patch, patch_size, &output);
+}
+
+bool GetBinaryPatchNewSize(const uint8* patch,
+                           size_t patch_size,
+                           uint64* new_size) {
+  if (!patch || !new_size) {
+    return false;
+  }
+  PatchReader reader(patch, patch_size);
+  uint64 old_size = 0;
+  return ReadHeader(&reader, &old_size, new_size);
+}
+
+}  // namespace omaha
@@ -0,0 +1,93 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Creates and applies binary patches which reconstruct a new version of a
+// file from an old version. The patches are generated with the bsdiff
+// algorithm: the new file is described as blocks which are added bytewise to
+// approximate matches in the old file, followed by bytes which are copied
+// from the patch. The differences of similar code are mostly zero, and the
+// runs of zeros are encoded in the patch so it stays small without a
+// separate compressor.
+//
+// The code does not depend on Windows, so the tools and the benchmarks can
+// run on other platforms. The applier does not verify the result; callers
+// compare it with the expected hash.
+//
+// The format of a patch is:
+//   char[8] magic ("OMDIFF01")
+//   varint  size of the old file
+//   varint  size of the new file
+//   blocks until the new file is complete, each one made of
+//     varint  number of bytes added to the old file
+//     varint  number of bytes copied from the patch
+//     varint  seek in the old file after the block, zigzag encoded
+//     the differences, as pairs of a varint count of zeros and a varint
+//       count of literal bytes followed by the bytes, until the number of
+//       bytes added to the old file is reached
+//     the bytes copied from the patch
+// The varints are unsigned LEB128.
+
+#ifndef OMAHA_BASE_BINARY_PATCH_H_
+#define OMAHA_BASE_BINARY_PATCH_H_
+
+#include <stddef.h>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+// Receives the new file as it is reconstructed.
+class BinaryPatchOutput {
+ public:
+  virtual ~BinaryPatchOutput() {}
+  virtual bool Write(const uint8* data, size_t size) = 0;
+};
+
+// Creates a patch which reconstructs |new_data| from |old_data|. The memory
+// used is about 17 times the size of the old file, which is only a concern
+// for the machines which build the patches. Returns false if the old file is
+// larger than 2GB.
+bool CreateBinaryPatch(const uint8* old_data,
+                       size_t old_size,
+                       const uint8* new_data,
+                       size_t new_size,
+                       std::vector<uint8>* patch);
+
+// Applies |patch| to |old_data| and writes the new file to |output| in
+// chunks. Besides the inputs, the memory used is a chunk of 64KB. Returns
+// false if the patch is invalid, was created for an old file of a different
+// size, or if |output| fails.
+bool ApplyBinaryPatch(const uint8* old_data,
+                      size_t old_size,
+                      const uint8* patch,
+                      size_t patch_size,
+                      BinaryPatchOutput* output);
+
+// Same as above, but the new file is returned in |new_data|.
+bool ApplyBinaryPatch(const uint8* old_data,
+                      size_t old_size,
+                      const uint8* patch,
+                      size_t patch_size,
+                      std::vector<uint8>* new_data);
+
+// Returns the size of the new file the patch reconstructs, or false if the
+// patch header is invalid.
+bool GetBinaryPatchNewSize(const uint8* patch,
+                           size_t patch_size,
+                           uint64* new_size);
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_BINARY_PATCH_H_
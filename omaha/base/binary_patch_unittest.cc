@@ -0,0 +1,275 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <algorithm>
+#include "omaha/base/binary_patch.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// A linear congruential generator, so that the tests do not depend on the
+// state of the CRT generator.
+class TestRandom {
+ public:
+  explicit TestRandom(uint32 seed) : state_(seed) {}
+
+  uint32 Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 8;
+  }
+
+ private:
+  uint32 state_;
+};
+
+// Fills the buffer with bytes which look like code: random bytes with an
+// opcode every few bytes.
+std::vector<uint8> MakeData(size_t size, TestRandom* random) {
+  std::vector<uint8> data(size);
+  for (size_t i = 0; i != size; ++i) {
+    data[i] = static_cast<uint8>(i % 16 ? random->Next() : 0x8b);
+  }
+  return data;
+}
+
+// Replaces, inserts, deletes, and shifts short ranges of bytes.
+std::vector<uint8> Edit(const std::vector<uint8>& data,
+                        int num_edits,
+                        TestRandom* random) {
+  std::vector<uint8> edited(data);
+  for (int i = 0; i < num_edits && !edited.empty(); ++i) {
+    const size_t pos = random->Next() % edited.size();
+    const size_t length = std::min(static_cast<size_t>(random->Next() % 64 + 1),
+                                   edited.size() - pos);
+    switch (random->Next() % 4) {
+      case 0:
+        for (size_t j = 0; j != length; ++j) {
+          edited[pos + j] = static_cast<uint8>(random->Next());
+        }
+        break;
+      case 1: {
+        const std::vector<uint8> inserted(MakeData(length, random));
+        edited.insert(edited.begin() + pos, inserted.begin(), inserted.end());
+        break;
+      }
+      case 2:
+        edited.erase(edited.begin() + pos, edited.begin() + pos + length);
+        break;
+      default:
+        for (size_t j = 0; j != length; ++j) {
+          ++edited[pos + j];
+        }
+        break;
+    }
+  }
+  return edited;
+}
+
+const uint8* DataOrNull(const std::vector<uint8>& data) {
+  return data.empty() ? NULL : &data.front();
+}
+
+void ExpectRoundTrip(const std::vector<uint8>& old_data,
+                     const std::vector<uint8>& new_data) {
+  std::vector<uint8> patch;
+  ASSERT_TRUE(CreateBinaryPatch(DataOrNull(old_data), old_data.size(),
+                                DataOrNull(new_data), new_data.size(),
+                                &patch));
+
+  uint64 new_size = 0;
+  EXPECT_TRUE(GetBinaryPatchNewSize(&patch.front(), patch.size(), &new_size));
+  EXPECT_EQ(new_data.size(), new_size);
+
+  std::vector<uint8> patched;
+  ASSERT_TRUE(ApplyBinaryPatch(DataOrNull(old_data), old_data.size(),
+                               &patch.front(), patch.size(), &patched));
+  EXPECT_TRUE(new_data == patched);
+}
+
+class CountingOutput : public BinaryPatchOutput {
+ public:
+  CountingOutput() : size_(0), max_write_size_(0), fail_(false) {}
+
+  virtual bool Write(const uint8* data, size_t size) {
+    EXPECT_TRUE(data);
+    size_ += size;
+    max_write_size_ = std::max(max_write_size_, size);
+    return !fail_;
+  }
+
+  size_t size() const { return size_; }
+  size_t max_write_size() const { return max_write_size_; }
+  void set_fail(bool fail) { fail_ = fail; }
+
+ private:
+  size_t size_;
+  size_t max_write_size_;
+  bool fail_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingOutput);
+};
+
+}  // namespace
+
+TEST(BinaryPatchTest, EmptyFiles) {
+  TestRandom random(1);
+  ExpectRoundTrip(std::vector<uint8>(), std::vector<uint8>());
+  ExpectRoundTrip(std::vector<uint8>(), MakeData(100, &random));
+  ExpectRoundTrip(MakeData(100, &random), std::vector<uint8>());
+}
+
+TEST(BinaryPatchTest, EditedFiles) {
+  TestRandom random(2);
+  for (int i = 0; i < 50; ++i) {
+    const std::vector<uint8> old_data(MakeData(random.Next() % 8192, &random));
+    ExpectRoundTrip(old_data, Edit(old_data, random.Next() % 10, &random));
+  }
+}
+
+TEST(BinaryPatchTest, UnrelatedFiles) {
+  TestRandom random(3);
+  ExpectRoundTrip(MakeData(5000, &random), MakeData(3000, &random));
+  ExpectRoundTrip(std::vector<uint8>(4096, 0), std::vector<uint8>(4096, 0xff));
+}
+
+TEST(BinaryPatchTest, SmallEditsMakeSmallPatches) {
+  TestRandom random(4);
+  const std::vector<uint8> old_data(MakeData(256 * 1024, &random));
+  const std::vector<uint8> new_data(Edit(old_data, 20, &random));
+
+  std::vector<uint8> patch;
+  ASSERT_TRUE(CreateBinaryPatch(&old_data.front(), old_data.size(),
+                                &new_data.front(), new_data.size(),
+                                &patch));
+  EXPECT_GT(new_data.size() / 50, patch.size());
+
+  // Identical files.
+  ASSERT_TRUE(CreateBinaryPatch(&old_data.front(), old_data.size(),
+                                &old_data.front(), old_data.size(),
+                                &patch));
+  EXPECT_GT(64U, patch.size());
+}
+
+TEST(BinaryPatchTest, OutputIsWrittenInChunks) {
+  TestRandom random(5);
+  const std::vector<uint8> old_data(MakeData(1024 * 1024, &random));
+  const std::vector<uint8> new_data(Edit(old_data, 10, &random));
+  std::vector<uint8> patch;
+  ASSERT_TRUE(CreateBinaryPatch(&old_data.front(), old_data.size(),
+                                &new_data.front(), new_data.size(),
+                                &patch));
+
+  CountingOutput output;
+  EXPECT_TRUE(ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                               &patch.front(), patch.size(), &output));
+  EXPECT_EQ(new_data.size(), output.size());
+  EXPECT_GE(64U * 1024, output.max_write_size());
+
+  CountingOutput failing_output;
+  failing_output.set_fail(true);
+  EXPECT_FALSE(ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                                &patch.front(), patch.size(),
+                                &failing_output));
+}
+
+TEST(BinaryPatchTest, InvalidPatches) {
+  TestRandom random(6);
+  const std::vector<uint8> old_data(MakeData(4096, &random));
+  const std::vector<uint8> new_data(Edit(old_data, 5, &random));
+  std::vector<uint8> patch;
+  ASSERT_TRUE(CreateBinaryPatch(&old_data.front(), old_data.size(),
+                                &new_data.front(), new_data.size(),
+                                &patch));
+
+  std::vector<uint8> patched;
+
+  // The old file is not the one the patch was created for.
+  EXPECT_FALSE(ApplyBinaryPatch(&old_data.front(), old_data.size() - 1,
+                                &patch.front(), patch.size(), &patched));
+
+  // Bad magic.
+  std::vector<uint8> bad_patch(patch);
+  bad_patch[0] = 'X';
+  EXPECT_FALSE(ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                                &bad_patch.front(), bad_patch.size(),
+                                &patched));
+  uint64 new_size = 0;
+  EXPECT_FALSE(GetBinaryPatchNewSize(&bad_patch.front(), bad_patch.size(),
+                                     &new_size));
+
+  // Truncated, or followed by extra bytes.
+  for (size_t size = 0; size < patch.size(); size += 7) {
+    EXPECT_FALSE(ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                                  &patch.front(), size, &patched));
+  }
+  bad_patch = patch;
+  bad_patch.push_back(0);
+  EXPECT_FALSE(ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                                &bad_patch.front(), bad_patch.size(),
+                                &patched));
+
+  // Corrupted bytes either fail or produce a different file, which the
+  // callers reject by its hash.
+  for (int i = 0; i < 200; ++i) {
+    bad_patch = patch;
+    bad_patch[8 + random.Next() % (bad_patch.size() - 8)] ^=
+        static_cast<uint8>(1 + random.Next() % 255);
+    ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                     &bad_patch.front(), bad_patch.size(), &patched);
+  }
+}
+
+// Measures the throughput of applying a patch to a file of the size of a
+// typical installer.
+TEST(BinaryPatchBenchmarkTest, DISABLED_Apply) {
+  const size_t kFileSize = 4 * 1024 * 1024;
+  const int kIterations = 5;
+
+  TestRandom random(7);
+  const std::vector<uint8> old_data(MakeData(kFileSize, &random));
+  const std::vector<uint8> new_data(Edit(old_data, kFileSize / 4096, &random));
+
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  std::vector<uint8> patch;
+  ASSERT_TRUE(CreateBinaryPatch(&old_data.front(), old_data.size(),
+                                &new_data.front(), new_data.size(),
+                                &patch));
+  const ULONGLONG create_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+
+  CountingOutput output;
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kIterations; ++i) {
+    EXPECT_TRUE(ApplyBinaryPatch(&old_data.front(), old_data.size(),
+                                 &patch.front(), patch.size(), &output));
+  }
+  const ULONGLONG apply_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+  EXPECT_EQ(new_data.size() * kIterations, output.size());
+
+  const double ms_per_tick = 1000.0 / HighresTimer::GetTimerFrequency();
+  const double apply_ms = apply_ticks * ms_per_tick / kIterations;
+  OPT_LOG(L1, (_T("[patch of %d bytes for %d bytes][create %f ms]")
+               _T("[apply %f ms][%f MB/s][largest write %d bytes]"),
+               static_cast<int>(patch.size()),
+               static_cast<int>(new_data.size()),
+               create_ticks * ms_per_tick, apply_ms,
+               new_data.size() / 1000.0 / apply_ms,
+               static_cast<int>(output.max_write_size())));
+}
+
+}  // namespace omaha
@@ -280,6 +280,46 @@ const TCHAR* const kRegValueProxyHost               = _T("ProxyHost");
 const TCHAR* const kRegValueProxyPort               = _T("ProxyPort");
 const TCHAR* const kRegValueMID                     = _T("mid");
 
+// Enables the paranoid verification mode of the package cache. The DWORD value
+// is the number of seconds a verified package hash is trusted before the
+// cached package is hashed again.
+const TCHAR* const kRegValuePackageCacheReverifySec =
+    _T("PackageCacheReverifySec");
+
+// Stores the packages put in the package cache as content-defined chunks
+// which are shared by all the cached packages. A DWORD value of 0 stores each
+// package as a full copy.
+const TCHAR* const kRegValuePackageCacheChunkStore =
+    _T("PackageCacheChunkStore");
+
+// Number of apps in a bundle that may be downloading at the same time while
+// the apps ahead of them are installed. A DWORD value of 1 downloads and
+// installs the apps one at a time.
+const TCHAR* const kRegValueDownloadPipelineDepth =
+    _T("DownloadPipelineDepth");
+
+// Number of connections the download manager may open at the same time for
+// the packages of one bundle. A DWORD value of 1 downloads the packages one
+// at a time.
+const TCHAR* const kRegValueMaxDownloadConnections =
+    _T("MaxDownloadConnections");
+
+// Enables racing the first two download urls of a package. The DWORD value is
+// how long, in milliseconds, the first url is given before the second url is
+// tried as well. The slower of the two downloads is canceled.
+const TCHAR* const kRegValueDownloadHedgeDelayMs = _T("DownloadHedgeDelayMs");
+
+// How long, in milliseconds, a proxy configuration is given to reach the
+// server before the next detected configuration is tried as well. A DWORD
+// value of 0 tries the configurations one after another.
+const TCHAR* const kRegValueProxyRaceDelayMs = _T("ProxyRaceDelayMs");
+
+// How often, in milliseconds, the download progress of a package is sampled
+// to estimate the remaining download time. A DWORD value of 0 samples every
+// chunk that is read from the network.
+const TCHAR* const kRegValueDownloadProgressSampleIntervalMs =
+    _T("DownloadProgressSampleIntervalMs");
+
 // The values below can be overriden in unofficial builds.
 const TCHAR* const kRegValueNameWindowsInstalling = _T("WindowsInstalling");
 
@@ -452,6 +492,27 @@ const int kMinCodeRedCheckPeriodMs  = 60 * 1000;              // 1 minute.
 // be in OEM mode regardless of audit mode.
 const int kMinOemModeSec = 72 * 60 * 60;  // 72 hours.
 
+// Default and maximum number of apps downloaded ahead of installation.
+const int kDefaultDownloadPipelineDepth = 3;
+const int kMaxDownloadPipelineDepth     = 8;
+
+// Default and maximum number of concurrent package downloads in a bundle.
+const int kDefaultMaxDownloadConnections = 4;
+const int kMaxDownloadConnections        = 16;
+
+// How many proxy configurations a request may use at once, the request
+// itself and the race of its fallbacks, and the default delay after which
+// the fallbacks are raced.
+const int kProxyRaceSize           = 3;
+const int kDefaultProxyRaceDelayMs = 2000;  // 2 seconds.
+
+// Default and maximum interval between the download progress samples of a
+// package, and the minimum interval between writes of the download progress
+// of an app to the registry.
+const int kDefaultDownloadProgressSampleIntervalMs = 100;
+const int kMaxDownloadProgressSampleIntervalMs     = 500;
+const int kMinDownloadProgressWriteIntervalMs      = 250;
+
 // The amount of time to wait for the setup lock before giving up.
 const int kSetupLockWaitMs = 1000;  // 1 second.
 
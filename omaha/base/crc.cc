@@ -30,6 +30,17 @@
 #include "omaha/base/debug.h"
 #include "omaha/base/commontypes.h"
 
+// Long strings are folded 128 bits at a time with the carry-less
+// multiplication instructions (PCLMULQDQ) of x86 processors which have them.
+#if defined(_M_IX86) || defined(_M_X64)
+#define CRC_HAVE_CLMUL 1
+#include <intrin.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#else
+#define CRC_HAVE_CLMUL 0
+#endif
+
 namespace omaha {
 
 static const int SMALL_BITS = 8;
@@ -41,6 +52,16 @@ static const char zeroes[1 << SMALL_BITS] = { 0 };  // an array of zeroes
 
 static const uint8 *zero_ptr = 0;   // The 0 pointer---used for alignment
 
+static const int SLICE_BYTES = 16;
+                   // The tables extend a CRC by this many bytes at a time.
+
+static const size_t MIN_CLMUL_LENGTH = 256;
+                   // Strings shorter than this are extended with the tables,
+                   // since folding has a fixed cost.
+
+static bool clmul_enabled = true;
+                   // Cleared by CRC::SetClmulEnabled().
+
 // These are used to index a 2-entry array of words that together
 // for a longer integer.  LO indexes the low-order half.
 #define LO 0
@@ -78,21 +99,33 @@ class CRCImpl : public CRC {    // Implemention of the abstract class CRC
 // This is the 32-bit implementation.  It handles all sizes from 8 to 32.
 class CRC32 : public CRCImpl {
  public:
-  CRC32() {}
+  CRC32() : use_clmul_(false) {}
   virtual ~CRC32() {}
 
   virtual void Extend(uint64 *lo, uint64 *hi,
                       const void *bytes, size_t length) const;
   virtual void ExtendByZeroes(uint64 *lo, uint64 *hi, size_t length) const;
+  virtual void Combine(uint64 *lo, uint64 *hi,
+                       uint64 lo_b, uint64 hi_b, size_t length_b) const;
   virtual void Roll(uint64 *lo, uint64 *hi, uint8 o_byte, uint8 i_byte) const;
 
-  uint32 table0_[256];  // table of byte extensions
-  uint32 table1_[256];  // table of byte extensions, shifted by 1 byte
-  uint32 table2_[256];  // table of byte extensions, shifted by 2 bytes
-  uint32 table3_[256];  // table of byte extensions, shifted by 3 bytes
+  // Returns x**n mod P, where P is the CRC polynomial.
+  uint32 XPowModPoly(int n) const;
+
+  // Extends "l" by the bytes [p, e) with the tables.
+  uint32 ExtendWithTables(uint32 l, const uint8 *p, const uint8 *e) const;
+
+  uint32 table_[SLICE_BYTES][256];  // table_[i] is the table of byte
+                                    // extensions, shifted by i bytes
   uint32 roll_[256];    // table of byte roll values
   uint32 zeroes_[256];  // table of zero extensions
 
+  // Multipliers which fold 128 bits of a string forward by 512 bits,
+  // and by 128 bits, for the carry-less multiplication.
+  uint64 fold_512_[2];
+  uint64 fold_128_[2];
+  bool use_clmul_;      // whether Extend() folds long strings
+
  private:
   DISALLOW_EVIL_CONSTRUCTORS(CRC32);
 };
@@ -653,6 +686,82 @@ SELECTANY const int CRC::N_POLYS = sizeof (poly_list) / sizeof (poly_list[0]);
 // This guarantees that the size of poly_list is opaque.
 SELECTANY const struct CRC::Poly *const CRC::POLYS = poly_list;
 
+#if CRC_HAVE_CLMUL
+
+// Returns true if the processor has the PCLMULQDQ and SSE2 instructions.
+static bool IsClmulSupported() {
+  int regs[4] = {0};
+  __cpuid(regs, 1);
+  const int kEcxPclmulqdq = 1 << 1;
+  const int kEdxSse2 = 1 << 26;
+  return (regs[2] & kEcxPclmulqdq) != 0 && (regs[3] & kEdxSse2) != 0;
+}
+
+// Multiplies the two 64-bit halves of "x" by the corresponding multipliers
+// in "k", which folds "x" forward.
+static __m128i Fold(__m128i x, __m128i k) {
+  return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                       _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+// Folds the "length" bytes at "p", a multiple of 16 which is at least 64,
+// into a 16-byte string that has the same CRC from an initial CRC of zero,
+// and places it in "folded".  "l" is xored into the start of the string first.
+// Four slices are folded in parallel, which hides the latency of the
+// multiplications, and then folded into one.
+static void FoldWithClmul(uint32 l, const uint8 *p, size_t length,
+                          const uint64 *fold_512, const uint64 *fold_128,
+                          uint8 *folded) {
+  ASSERT1(length >= 64 && length % 16 == 0);
+
+  const __m128i *src = reinterpret_cast<const __m128i *>(p);
+  const __m128i *end = reinterpret_cast<const __m128i *>(p + length);
+  const __m128i k512 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(fold_512));
+  const __m128i k128 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(fold_128));
+
+  __m128i x0 = _mm_xor_si128(_mm_loadu_si128(src),
+                             _mm_cvtsi32_si128(static_cast<int>(l)));
+  __m128i x1 = _mm_loadu_si128(src + 1);
+  __m128i x2 = _mm_loadu_si128(src + 2);
+  __m128i x3 = _mm_loadu_si128(src + 3);
+  src += 4;
+
+  while (end - src >= 4) {
+    x0 = _mm_xor_si128(Fold(x0, k512), _mm_loadu_si128(src));
+    x1 = _mm_xor_si128(Fold(x1, k512), _mm_loadu_si128(src + 1));
+    x2 = _mm_xor_si128(Fold(x2, k512), _mm_loadu_si128(src + 2));
+    x3 = _mm_xor_si128(Fold(x3, k512), _mm_loadu_si128(src + 3));
+    src += 4;
+  }
+
+  x0 = _mm_xor_si128(Fold(x0, k128), x1);
+  x0 = _mm_xor_si128(Fold(x0, k128), x2);
+  x0 = _mm_xor_si128(Fold(x0, k128), x3);
+  for (; src != end; ++src) {
+    x0 = _mm_xor_si128(Fold(x0, k128), _mm_loadu_si128(src));
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(folded), x0);
+}
+
+#else
+
+static bool IsClmulSupported() {
+  return false;
+}
+
+#endif  // CRC_HAVE_CLMUL
+
+bool CRC::SetClmulEnabled(bool enabled) {
+  if (enabled && !IsClmulSupported()) {
+    return false;
+  }
+  clmul_enabled = enabled;
+  return true;
+}
+
 // The "constructor" for a CRC with an default polynomial.
 CRC *CRC::Default(int degree, size_t roll_length) {
   ASSERT1(32 == degree);
@@ -673,7 +782,7 @@ CRCImpl *CRCImpl::NewInternal(uint64 lo, uint64 hi,
   ASSERT1(8 <= degree && degree <= 64);  // precondition
   ASSERT1(lo != 0 || hi != 0);            // precondition
   // Generate the tables for extending a CRC by 4 bytes at a time.
-  // Why 4 and not 8?  Because Pentium 4 has such small caches.
+  // The tables for the other bytes of a slice are derived from them below.
   struct CRC_pair t[4][256];
   for (int j = 0; j != 4; j++) {      // for each byte of extension....
     t[j][0].lo = 0;                   // a zero has no effect
@@ -718,11 +827,17 @@ CRCImpl *CRCImpl::NewInternal(uint64 lo, uint64 hi,
   CRCImpl *result = 0;
   CRC32 *crc32 = 0;
   crc32 = new CRC32();
-  for (int i = 0; i != 256; i++) {
-    crc32->table0_[i] = static_cast<uint32>(t[0][i].lo);
-    crc32->table1_[i] = static_cast<uint32>(t[1][i].lo);
-    crc32->table2_[i] = static_cast<uint32>(t[2][i].lo);
-    crc32->table3_[i] = static_cast<uint32>(t[3][i].lo);
+  for (int j = 0; j != 4; j++) {
+    for (int i = 0; i != 256; i++) {
+      crc32->table_[j][i] = static_cast<uint32>(t[j][i].lo);
+    }
+  }
+  // Each further table extends the entries of the previous one by a zero byte.
+  for (int j = 4; j != SLICE_BYTES; j++) {
+    for (int i = 0; i != 256; i++) {
+      uint32 prev = crc32->table_[j-1][i];
+      crc32->table_[j][i] = crc32->table_[0][prev & 0xff] ^ (prev >> 8);
+    }
   }
   result = crc32;
 
@@ -740,10 +855,12 @@ CRCImpl *CRCImpl::NewInternal(uint64 lo, uint64 hi,
   // a CRC by Pi mod P, where P is the CRC polynomial, is equivalent to
   // appending a*2**(2*b+SMALL_BITS) zero bytes to the original string.
   // Entry is generated by calling ExtendByZeroes() twice using
-  // half the length from the previous entry.
+  // half the length from the previous entry, starting from the
+  // polynomial 1 rather than the CRC of the empty string.
   int pos = 0;
   for (uint64 inc_len = (1 << SMALL_BITS); inc_len != 0; inc_len <<= 2) {
-    result->Empty(&lo, &hi);
+    lo = crc32->XPowModPoly(0);
+    hi = 0;
     for (int k = 0; k != 3; k++) {
       result->ExtendByZeroes(&lo, &hi, (size_t) (inc_len >> 1));
       result->ExtendByZeroes(&lo, &hi, (size_t) (inc_len >> 1));
@@ -787,6 +904,19 @@ CRCImpl *CRCImpl::NewInternal(uint64 lo, uint64 hi,
     crc32->roll_[i] = static_cast<uint32>(t[0][i].lo);
   }
 
+  // Calculate the multipliers for folding.   A 128-bit slice of the string
+  // is folded forward by "n" bits by multiplying its two halves by
+  // x**(n+64) and x**n mod P.  The multipliers are one power of x short,
+  // since the carry-less product of two bit-reflected 64-bit values is one
+  // bit short of the bit-reflected 128-bit product.  They are bit-reflected
+  // over 64 bits, like the halves of the slice.
+  const int shift = 64 - degree;
+  crc32->fold_512_[0] = static_cast<uint64>(crc32->XPowModPoly(575)) << shift;
+  crc32->fold_512_[1] = static_cast<uint64>(crc32->XPowModPoly(511)) << shift;
+  crc32->fold_128_[0] = static_cast<uint64>(crc32->XPowModPoly(191)) << shift;
+  crc32->fold_128_[1] = static_cast<uint64>(crc32->XPowModPoly(127)) << shift;
+  crc32->use_clmul_ = clmul_enabled && IsClmulSupported();
+
   return result;
 }
 
@@ -801,16 +931,23 @@ void CRCImpl::Empty(uint64 *lo, uint64 *hi) const {
 
 //  The 32-bit implementation
 
-void CRC32::Extend(uint64 *lo, uint64 *hi, const void *bytes, size_t length)
-                      const {
-  ASSERT1(hi);
-  ASSERT1(lo);
+uint32 CRC32::XPowModPoly(int n) const {
+  ASSERT1(n >= 0);
 
-  hi;   // unreferenced formal parameter
+  // x**0 is the highest order bit, and multiplying by x shifts it right.
+  uint32 l = static_cast<uint32>(1) << (this->degree_ - 1);
+  for (int i = 0; i != n; i++) {
+    if (l & 1) {
+      l = (l >> 1) ^ static_cast<uint32>(this->poly_lo_);
+    } else {
+      l = (l >> 1);
+    }
+  }
+  return l;
+}
 
-  const uint8 *p = static_cast<const uint8 *>(bytes);
-  const uint8 *e = p + length;
-  uint32 l = static_cast<uint32>(*lo);
+uint32 CRC32::ExtendWithTables(uint32 l, const uint8 *p, const uint8 *e)
+                                  const {
   // point x at MIN(first 4-byte aligned byte in string, end of string)
   const uint8 *x = p + ((zero_ptr - p) & 3);
   if (x > e) {
@@ -819,26 +956,76 @@ void CRC32::Extend(uint64 *lo, uint64 *hi, const void *bytes, size_t length)
   // Process bytes until finished or p is 4-byte aligned
   while (p != x) {
     int c = (l & 0xff) ^ *p++;
-    l = this->table0_[c] ^ (l >> 8);
+    l = this->table_[0][c] ^ (l >> 8);
   }
   // point x at MIN(last 4-byte aligned byte in string, end of string)
   x = e - ((e - zero_ptr) & 3);
+  // Process bytes 16 at a time
+  while (x - p >= SLICE_BYTES) {
+    const uint32 *w = reinterpret_cast<const uint32 *>(p);
+    uint32 c0 = l ^ w[0];
+    uint32 c1 = w[1];
+    uint32 c2 = w[2];
+    uint32 c3 = w[3];
+    p += SLICE_BYTES;
+    l = this->table_[15][c0 & 0xff] ^
+        this->table_[14][(c0 >> 8) & 0xff] ^
+        this->table_[13][(c0 >> 16) & 0xff] ^
+        this->table_[12][c0 >> 24] ^
+        this->table_[11][c1 & 0xff] ^
+        this->table_[10][(c1 >> 8) & 0xff] ^
+        this->table_[9][(c1 >> 16) & 0xff] ^
+        this->table_[8][c1 >> 24] ^
+        this->table_[7][c2 & 0xff] ^
+        this->table_[6][(c2 >> 8) & 0xff] ^
+        this->table_[5][(c2 >> 16) & 0xff] ^
+        this->table_[4][c2 >> 24] ^
+        this->table_[3][c3 & 0xff] ^
+        this->table_[2][(c3 >> 8) & 0xff] ^
+        this->table_[1][(c3 >> 16) & 0xff] ^
+        this->table_[0][c3 >> 24];
+  }
   // Process bytes 4 at a time
   while (p < x) {
     uint32 c = l ^ *reinterpret_cast<const uint32*>(p);
     p += 4;
-    l = this->table3_[c & 0xff] ^
-        this->table2_[(c >> 8) & 0xff] ^
-        this->table1_[(c >> 16) & 0xff] ^
-        this->table0_[c >> 24];
+    l = this->table_[3][c & 0xff] ^
+        this->table_[2][(c >> 8) & 0xff] ^
+        this->table_[1][(c >> 16) & 0xff] ^
+        this->table_[0][c >> 24];
   }
 
   // Process the last few bytes
   while (p != e) {
     int c = (l & 0xff) ^ *p++;
-    l = this->table0_[c] ^ (l >> 8);
+    l = this->table_[0][c] ^ (l >> 8);
+  }
+  return l;
+}
+
+void CRC32::Extend(uint64 *lo, uint64 *hi, const void *bytes, size_t length)
+                      const {
+  ASSERT1(hi);
+  ASSERT1(lo);
+
+  hi;   // unreferenced formal parameter
+
+  const uint8 *p = static_cast<const uint8 *>(bytes);
+  const uint8 *e = p + length;
+  uint32 l = static_cast<uint32>(*lo);
+#if CRC_HAVE_CLMUL
+  if (this->use_clmul_ && length >= MIN_CLMUL_LENGTH) {
+    // The CRC of the folded string from zero is the CRC of the whole
+    // 16-byte slices; the remaining bytes are extended with the tables.
+    uint8 folded[16];
+    size_t folded_length = length & ~static_cast<size_t>(15);
+    FoldWithClmul(l, p, folded_length,
+                  this->fold_512_, this->fold_128_, folded);
+    l = ExtendWithTables(0, folded, folded + sizeof(folded));
+    p += folded_length;
   }
-  *lo = l;
+#endif
+  *lo = ExtendWithTables(l, p, e);
 }
 
 void CRC32::ExtendByZeroes(uint64 *lo, uint64 *hi, size_t length) const {
@@ -884,6 +1071,21 @@ void CRC32::ExtendByZeroes(uint64 *lo, uint64 *hi, size_t length) const {
   }
 }
 
+void CRC32::Combine(uint64 *lo, uint64 *hi,
+                    uint64 lo_b, uint64 hi_b, size_t length_b) const {
+  ASSERT1(hi);
+  ASSERT1(lo);
+
+  hi_b;   // unreferenced formal parameter
+
+  // Both CRCs start from the CRC of the empty string.   Extending A by
+  // length_b zeroes and xoring in the CRC of B counts the CRC of the empty
+  // string twice, so it is xored out before the extension.
+  uint64 l = *lo ^ this->poly_lo_;
+  this->ExtendByZeroes(&l, hi, length_b);
+  *lo = l ^ lo_b;
+}
+
 void CRC32::Roll(uint64 *lo, uint64 *hi, uint8 o_byte, uint8 i_byte) const {
   ASSERT1(hi);
   ASSERT1(lo);
@@ -892,7 +1094,7 @@ void CRC32::Roll(uint64 *lo, uint64 *hi, uint8 o_byte, uint8 i_byte) const {
 
   uint32 l = static_cast<uint32>(*lo);
   // Roll in i_byte and out o_byte
-  *lo = this->table0_[(l & 0xff) ^ i_byte] ^ (l >> 8) ^ this->roll_[o_byte];
+  *lo = this->table_[0][(l & 0xff) ^ i_byte] ^ (l >> 8) ^ this->roll_[o_byte];
 }
 
 }  // namespace omaha
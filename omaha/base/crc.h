@@ -105,6 +105,13 @@ public:
  virtual void ExtendByZeroes(/*INOUT*/ uint64 *lo, /*INOUT*/ uint64 *hi,
                              size_t length) const = 0;
 
+ // If "*lo,*hi" is the CRC of bytestring A and "lo_b,hi_b" is the CRC of
+ // bytestring B, which is "length_b" bytes long, place the CRC of the
+ // concatenation of A and B into "*lo,*hi".  This lets the CRC of a large
+ // buffer be computed in chunks, in parallel, and the chunk CRCs combined.
+ virtual void Combine(/*INOUT*/ uint64 *lo, /*INOUT*/ uint64 *hi,
+                      uint64 lo_b, uint64 hi_b, size_t length_b) const = 0;
+
  // If "*lo,*hi" is the CRC of a byte string of length "roll_length"
  // (which is an argument to New() and Default()) that consists of
  // byte "o_byte" followed by string S, set "*lo,*hi" to the CRC of
@@ -127,6 +134,13 @@ public:
 
  static const int N_POLYS;         // Number of elements in POLYS array.
 
+ // Selects whether the CRCs created afterwards use the carry-less
+ // multiplication instructions of the processor to extend long strings.
+ // They are used by default when the processor supports them.  Returns false
+ // if "enabled" is true and the processor does not support them.  For tests
+ // and benchmarks.
+ static bool SetClmulEnabled(bool enabled);
+
 protected:
  CRC();      // Clients may not call constructor;
                // use Default() or New() instead.
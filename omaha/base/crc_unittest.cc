@@ -0,0 +1,327 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/crc.h"
+#include <algorithm>
+#include <vector>
+#include "base/scoped_ptr.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// The degrees of the polynomials which the tests use, from CRC::POLYS.
+const int kDegrees[] = {32, 31, 24, 16, 8};
+
+std::vector<uint8> MakeData(size_t length) {
+  std::vector<uint8> data(length);
+  uint32 seed = 12345;
+  for (size_t i = 0; i != length; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<uint8>(seed >> 16);
+  }
+  return data;
+}
+
+CRC* NewCrc(int degree, size_t roll_length) {
+  return CRC::New(CRC::POLYS[degree].lo,
+                  CRC::POLYS[degree].hi,
+                  degree,
+                  roll_length);
+}
+
+// Computes the CRC one bit at a time, from its definition.
+uint32 ComputeBitwiseCrc(int degree, const uint8* p, size_t length) {
+  const uint32 poly = static_cast<uint32>(CRC::POLYS[degree].lo);
+  uint32 l = poly;
+  for (size_t i = 0; i != length; ++i) {
+    for (int bit = 0; bit != 8; ++bit) {
+      const uint32 feedback = (l ^ (p[i] >> bit)) & 1;
+      l >>= 1;
+      if (feedback) {
+        l ^= poly;
+      }
+    }
+  }
+  return l;
+}
+
+// The slicing-by-4 implementation which preceded slicing-by-16 and folding,
+// for the benchmark.
+class SlicingBy4Crc {
+ public:
+  explicit SlicingBy4Crc(int degree) {
+    const uint32 poly = static_cast<uint32>(CRC::POLYS[degree].lo);
+    for (int i = 0; i != 256; ++i) {
+      uint32 l = static_cast<uint32>(i);
+      for (int bit = 0; bit != 8; ++bit) {
+        l = (l & 1) ? (l >> 1) ^ poly : l >> 1;
+      }
+      table_[0][i] = l;
+    }
+    for (int j = 1; j != 4; ++j) {
+      for (int i = 0; i != 256; ++i) {
+        const uint32 prev = table_[j - 1][i];
+        table_[j][i] = table_[0][prev & 0xff] ^ (prev >> 8);
+      }
+    }
+  }
+
+  uint32 Extend(uint32 l, const uint8* p, size_t length) const {
+    const uint8* e = p + length;
+    while (p != e && (reinterpret_cast<size_t>(p) & 3)) {
+      l = table_[0][(l ^ *p++) & 0xff] ^ (l >> 8);
+    }
+    while (e - p >= 4) {
+      const uint32 c = l ^ *reinterpret_cast<const uint32*>(p);
+      p += 4;
+      l = table_[3][c & 0xff] ^
+          table_[2][(c >> 8) & 0xff] ^
+          table_[1][(c >> 16) & 0xff] ^
+          table_[0][c >> 24];
+    }
+    while (p != e) {
+      l = table_[0][(l ^ *p++) & 0xff] ^ (l >> 8);
+    }
+    return l;
+  }
+
+ private:
+  uint32 table_[4][256];
+
+  DISALLOW_COPY_AND_ASSIGN(SlicingBy4Crc);
+};
+
+}  // namespace
+
+// Runs the tests with and without the carry-less multiplication.
+class CrcTest : public testing::TestWithParam<bool> {
+ protected:
+  virtual void SetUp() {
+    is_supported_ = CRC::SetClmulEnabled(GetParam());
+    if (!is_supported_) {
+      OPT_LOG(L2, (_T("[the processor does not support CLMUL]")));
+    }
+  }
+
+  virtual void TearDown() {
+    CRC::SetClmulEnabled(true);
+  }
+
+  uint32 Extend(const CRC& crc, const uint8* p, size_t length) {
+    uint64 lo = 0;
+    uint64 hi = 0;
+    crc.Empty(&lo, &hi);
+    crc.Extend(&lo, &hi, p, length);
+    return static_cast<uint32>(lo);
+  }
+
+  bool is_supported_;
+};
+
+INSTANTIATE_TEST_CASE_P(Clmul, CrcTest, ::testing::Bool());
+
+TEST_P(CrcTest, Extend) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const std::vector<uint8> data(MakeData(20000));
+  for (size_t i = 0; i != arraysize(kDegrees); ++i) {
+    scoped_ptr<CRC> crc(NewCrc(kDegrees[i], 0));
+
+    // Every length around the slice and folding sizes, at every alignment.
+    for (size_t offset = 0; offset != 4; ++offset) {
+      for (size_t length = 0; length != 600; ++length) {
+        EXPECT_EQ(ComputeBitwiseCrc(kDegrees[i], &data[offset], length),
+                  Extend(*crc, &data[offset], length))
+            << kDegrees[i] << _T(" ") << offset << _T(" ") << length;
+      }
+    }
+
+    const size_t kLengths[] = {4096, 4097, 10000, 19999};
+    for (size_t j = 0; j != arraysize(kLengths); ++j) {
+      EXPECT_EQ(ComputeBitwiseCrc(kDegrees[i], &data[1], kLengths[j]),
+                Extend(*crc, &data[1], kLengths[j]));
+    }
+  }
+}
+
+// Extending in pieces gives the same CRC as extending at once.
+TEST_P(CrcTest, Extend_Pieces) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const std::vector<uint8> data(MakeData(100000));
+  scoped_ptr<CRC> crc(NewCrc(32, 0));
+
+  uint64 lo = 0;
+  uint64 hi = 0;
+  crc->Empty(&lo, &hi);
+  for (size_t start = 0, length = 1; start < data.size(); length *= 3) {
+    const size_t piece = std::min(length, data.size() - start);
+    crc->Extend(&lo, &hi, &data[start], piece);
+    start += piece;
+  }
+  EXPECT_EQ(Extend(*crc, &data[0], data.size()), static_cast<uint32>(lo));
+}
+
+TEST_P(CrcTest, ExtendByZeroes) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const size_t kLengths[] = {0, 1, 255, 256, 257, 1000, 65536, 70001};
+  const std::vector<uint8> zeroes(70001, 0);
+  for (size_t i = 0; i != arraysize(kDegrees); ++i) {
+    scoped_ptr<CRC> crc(NewCrc(kDegrees[i], 0));
+    for (size_t j = 0; j != arraysize(kLengths); ++j) {
+      uint64 lo = 0;
+      uint64 hi = 0;
+      crc->Empty(&lo, &hi);
+      crc->Extend(&lo, &hi, "abc", 3);
+      uint64 expected_lo = lo;
+      uint64 expected_hi = hi;
+      crc->ExtendByZeroes(&lo, &hi, kLengths[j]);
+      crc->Extend(&expected_lo, &expected_hi, &zeroes[0], kLengths[j]);
+      EXPECT_EQ(expected_lo, lo);
+    }
+  }
+}
+
+TEST_P(CrcTest, Combine) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const std::vector<uint8> data(MakeData(70000));
+  const size_t kSplits[] = {0, 1, 15, 256, 1000, 65536, 70000};
+  for (size_t i = 0; i != arraysize(kDegrees); ++i) {
+    scoped_ptr<CRC> crc(NewCrc(kDegrees[i], 0));
+    const uint32 expected = Extend(*crc, &data[0], data.size());
+
+    for (size_t j = 0; j != arraysize(kSplits); ++j) {
+      const size_t length_b = data.size() - kSplits[j];
+      uint64 lo = Extend(*crc, &data[0], kSplits[j]);
+      uint64 hi = 0;
+      const uint64 lo_b = Extend(*crc, &data[0] + kSplits[j], length_b);
+      crc->Combine(&lo, &hi, lo_b, 0, length_b);
+      EXPECT_EQ(expected, static_cast<uint32>(lo)) << kSplits[j];
+    }
+  }
+}
+
+// Checksums a buffer in chunks, as threads would, and combines the chunks.
+TEST_P(CrcTest, Combine_Chunks) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const size_t kNumChunks = 7;
+  const std::vector<uint8> data(MakeData(1024 * 1024 + 5));
+  const size_t chunk_size = data.size() / kNumChunks;
+  scoped_ptr<CRC> crc(NewCrc(32, 0));
+
+  uint64 lo = 0;
+  uint64 hi = 0;
+  crc->Empty(&lo, &hi);
+  for (size_t start = 0; start < data.size(); start += chunk_size) {
+    const size_t length = std::min(chunk_size, data.size() - start);
+    crc->Combine(&lo, &hi, Extend(*crc, &data[start], length), 0, length);
+  }
+  EXPECT_EQ(Extend(*crc, &data[0], data.size()), static_cast<uint32>(lo));
+}
+
+TEST_P(CrcTest, Roll) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const size_t kWindow = 6;
+  const std::vector<uint8> data(MakeData(1000));
+  scoped_ptr<CRC> crc(NewCrc(32, kWindow));
+
+  uint64 lo = Extend(*crc, &data[0], kWindow);
+  uint64 hi = 0;
+  for (size_t i = kWindow; i != data.size(); ++i) {
+    crc->Roll(&lo, &hi, data[i - kWindow], data[i]);
+    EXPECT_EQ(Extend(*crc, &data[i - kWindow + 1], kWindow),
+              static_cast<uint32>(lo));
+  }
+}
+
+TEST_P(CrcTest, DISABLED_Benchmark) {
+  if (!is_supported_) {
+    return;
+  }
+
+  // The 1 GB input is extended 16 MB at a time, from the same buffer.
+  const size_t kBufferSize = 16 * 1024 * 1024;
+  const size_t kMinTotalSize = 64 * 1024 * 1024;
+  const size_t kInputSizes[] = {
+    4 * 1024, 64 * 1024, 1024 * 1024, kBufferSize, 1024 * 1024 * 1024
+  };
+  const std::vector<uint8> buffer(MakeData(kBufferSize));
+  scoped_ptr<CRC> crc(NewCrc(32, 0));
+  const SlicingBy4Crc slicing_by_4(32);
+
+  for (size_t i = 0; i != arraysize(kInputSizes); ++i) {
+    const size_t input_size = kInputSizes[i];
+    const size_t num_inputs = std::max<size_t>(1, kMinTotalSize / input_size);
+    const size_t piece = std::min(input_size, kBufferSize);
+    const size_t num_pieces = input_size / piece;
+    const double mb =
+        static_cast<double>(num_inputs) * input_size / (1024 * 1024);
+
+    uint32 old_crc = 0;
+    HighresTimer timer;
+    for (size_t j = 0; j != num_inputs; ++j) {
+      uint32 l = static_cast<uint32>(CRC::POLYS[32].lo);
+      for (size_t k = 0; k != num_pieces; ++k) {
+        l = slicing_by_4.Extend(l, &buffer[0], piece);
+      }
+      old_crc ^= l;
+    }
+    const double old_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                          1000 / HighresTimer::GetTimerFrequency();
+
+    uint32 new_crc = 0;
+    timer.Start();
+    for (size_t j = 0; j != num_inputs; ++j) {
+      uint64 lo = 0;
+      uint64 hi = 0;
+      crc->Empty(&lo, &hi);
+      for (size_t k = 0; k != num_pieces; ++k) {
+        crc->Extend(&lo, &hi, &buffer[0], piece);
+      }
+      new_crc ^= static_cast<uint32>(lo);
+    }
+    const double new_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                          1000 / HighresTimer::GetTimerFrequency();
+
+    EXPECT_EQ(old_crc, new_crc);
+    OPT_LOG(L1, (_T("[%s][inputs of %d bytes][slicing-by-4 %f MB/s]")
+                 _T("[new %f MB/s]"),
+                 GetParam() ? _T("CLMUL") : _T("slicing-by-16"),
+                 static_cast<int>(input_size),
+                 mb * 1000 / (old_ms + 1e-9), mb * 1000 / (new_ms + 1e-9)));
+  }
+}
+
+}  // namespace omaha
@@ -19,10 +19,12 @@
 // program name.
 
 #include <shlobj.h>
+#include <string>
 #include "base/scoped_ptr.h"
 #include "omaha/base/app_util.h"
 #include "omaha/base/apply_tag.h"
 #include "omaha/base/extractor.h"
+#include "omaha/base/file.h"
 #include "omaha/base/scope_guard.h"
 #include "omaha/base/utils.h"
 #include "omaha/testing/unit_test.h"
@@ -234,5 +236,25 @@ TEST(ApplyTagTest, InvalidCharsTest) {
                                   false));
 }
 
+TEST(ApplyTagTest, TagLongerThanThePadding) {
+  CString signed_exe_file;
+  signed_exe_file.Format(_T("%s\\%s\\%s"),
+                         app_util::GetCurrentModuleDirectory(),
+                         kFilePath, kFileName);
+  CString tagged_file;
+  tagged_file.Format(_T("%s%d%s"), app_util::GetTempDir(), 4, kFileName);
+
+  // The length of a tag is a 16-bit integer.
+  const std::string long_tag(0x10000, 'a');
+  omaha::ApplyTag tag;
+  ASSERT_HRESULT_SUCCEEDED(tag.Init(signed_exe_file,
+                                    long_tag.c_str(),
+                                    static_cast<int>(long_tag.size()),
+                                    tagged_file,
+                                    false));
+  EXPECT_EQ(E_FAIL, tag.EmbedTagString());
+  EXPECT_FALSE(File::Exists(tagged_file));
+}
+
 }  // namespace omaha
 
@@ -52,6 +52,7 @@
 #include <string.h>
 #include <atlpath.h>
 #include <atlsecurity.h>
+#include <vector>
 #include "base/basictypes.h"
 #include "omaha/base/app_util.h"
 #include "omaha/base/const_debug.h"
@@ -182,6 +183,10 @@ Logging::Logging()
       log_to_file_(true),
       log_to_debug_out_(true),
       append_to_file_(true),
+      async_logging_(false),
+      async_pipeline_(NULL),
+      num_async_pipeline_users_(0),
+      is_crashing_(0),
       logging_shutdown_(false),
       num_writers_(0),
       file_log_writer_(NULL),
@@ -204,6 +209,10 @@ Logging::Logging()
 // TODO(omaha): why aren't we using a mutexscope and what if an the code
 // throws? Will the lock be unlocked?
 Logging::~Logging() {
+  // The writer thread takes the lock to output the records, therefore the
+  // pipeline is stopped and flushed before the lock is acquired.
+  DeleteAsyncPipeline();
+
   // Acquire the lock outside the try/except block so we'll always release it
   lock_.Lock();
 
@@ -286,6 +295,12 @@ void Logging::ReadLoggingSettings() {
         kDefaultAppendToFile,
         config_file) == 0 ? false : true;
 
+    async_logging_ = ::GetPrivateProfileInt(
+        kConfigSectionLoggingSettings,
+        kConfigAttrAsyncLogging,
+        kDefaultAsyncLogging,
+        config_file) == 0 ? false : true;
+
     ::GetPrivateProfileString(kConfigSectionLoggingSettings,
                               kConfigAttrLogFilePath,
                               kDefaultLogFileName,
@@ -298,6 +313,7 @@ void Logging::ReadLoggingSettings() {
     log_to_file_ = kDefaultLogToFile;
     log_to_debug_out_ = kDefaultLogToOutputDebug;
     append_to_file_ = kDefaultAppendToFile;
+    async_logging_ = kDefaultAsyncLogging;
     log_file_name_ = kDefaultLogFileName;
   }
 
@@ -473,6 +489,10 @@ bool Logging::InternalInitialize() {
     if (logging_enabled_) {
       logging_initialized_ = ConfigureLogging();
     }
+
+    // Whether the messages are output asynchronously is only decided here,
+    // so that the messages of a thread are never written out of order.
+    StartAsyncPipeline();
   } __except(SehNoMinidump(GetExceptionCode(),
                            GetExceptionInformation(),
                            __FILE__,
@@ -539,6 +559,9 @@ void Logging::DisableLogging() {
     return;
   }
 
+  // Output the queued messages while the log writers are still registered.
+  Flush();
+
   // Acquire the lock outside the try/except block so we'll always release it.
   lock_.Lock();
 
@@ -660,6 +683,41 @@ void Logging::LogMessageVA(LogCategory cat, LogLevel level,
                      args);
 }
 
+void Logging::FormatLogMessage(CString* log_buffer,
+                               CString* prefix,
+                               const wchar_t* fmt,
+                               va_list args) {
+  // Initial buffer size in characters.
+  // It will adjust dynamically if the message is bigger.
+  DWORD buffer_size = 512;
+
+  // Count of chars / bytes written.
+  int num_chars = 0;
+
+  // Write the message in the buffer.
+  // Dynamically adjust the size to hold the entire message.
+
+  while ((num_chars = _vsnwprintf_s(
+      log_buffer->GetBufferSetLength(buffer_size),
+      buffer_size,
+      _TRUNCATE,
+      fmt,
+      args)) == -1) {
+    // Truncate if the message is too big.
+    if (buffer_size >= kMaxLogMessageSize) {
+      num_chars = buffer_size;
+      break;
+    }
+
+    // Get a buffer that is big enough.
+    buffer_size *= 2;
+  }
+
+  log_buffer->ReleaseBuffer(num_chars);
+
+  FormatLinePrefix(show_time_, proc_name_, *prefix);
+}
+
 void Logging::InternalLogMessageMaskedVA(DWORD writer_mask,
                                          LogCategory cat,
                                          LogLevel level,
@@ -668,36 +726,7 @@ void Logging::InternalLogMessageMaskedVA(DWORD writer_mask,
                                          const wchar_t* fmt,
                                          va_list args) {
   __try {
-    // Initial buffer size in characters.
-    // It will adjust dynamically if the message is bigger.
-    DWORD buffer_size = 512;
-
-    // Count of chars / bytes written.
-    int num_chars = 0;
-    bool result = false;
-
-    // Write the message in the buffer.
-    // Dynamically adjust the size to hold the entire message.
-
-    while ((num_chars = _vsnwprintf_s(
-        log_buffer->GetBufferSetLength(buffer_size),
-        buffer_size,
-        _TRUNCATE,
-        fmt,
-        args)) == -1) {
-      // Truncate if the message is too big.
-      if (buffer_size >= kMaxLogMessageSize) {
-        num_chars = buffer_size;
-        break;
-      }
-
-      // Get a buffer that is big enough.
-      buffer_size *= 2;
-    }
-
-    log_buffer->ReleaseBuffer(num_chars);
-
-    FormatLinePrefix(show_time_, proc_name_, *prefix);
+    FormatLogMessage(log_buffer, prefix, fmt, args);
 
     // Log the message.
     OutputInfo info(cat, level, *prefix, *log_buffer);
@@ -724,6 +753,27 @@ void Logging::LogMessageMaskedVA(DWORD writer_mask,
     return;
   }
 
+  // When logging asynchronously, the message is formatted on the calling
+  // thread without taking the lock, then it is queued for the writer thread.
+  AsyncLogPipeline* async_pipeline = AcquireAsyncPipeline();
+  if (async_pipeline) {
+    if (async_pipeline->is_running()) {
+      LogRecord* record = new LogRecord(writer_mask, cat, level);
+      if (InternalFormatLogRecord(record, fmt, args)) {
+        if (!async_pipeline->Push(record)) {
+          // The pipeline has stopped. The message is output on this thread.
+          OutputRecords(&record, 1);
+          delete record;
+        }
+      } else {
+        delete record;
+      }
+      ReleaseAsyncPipeline();
+      return;
+    }
+    ReleaseAsyncPipeline();
+  }
+
   CString log_buffer;    // The buffer for formatted log messages.
   CString prefix;
 
@@ -746,6 +796,172 @@ void Logging::LogMessageMaskedVA(DWORD writer_mask,
   }
 }
 
+bool Logging::InternalFormatLogRecord(LogRecord* record,
+                                      const wchar_t* fmt,
+                                      va_list args) {
+  __try {
+    FormatLogMessage(&record->message, &record->prefix, fmt, args);
+    return true;
+  } __except(SehSendMinidump(GetExceptionCode(),
+                             GetExceptionInformation(),
+                             kMinsTo100ns)) {
+    OutputDebugStringA("Unexpected exception in: " __FUNCTION__ "\r\n");
+    OutputDebugString(fmt);
+    OutputDebugString(L"\n\r");
+    return false;
+  }
+}
+
+void Logging::StartAsyncPipeline() {
+  if (!async_logging_ || async_pipeline_) {
+    return;
+  }
+
+  AsyncLogPipeline* async_pipeline =
+      new AsyncLogPipeline(kLogRecordQueueCapacity,
+                           &Logging::OutputRecordsCallback,
+                           this);
+  if (!async_pipeline->Start()) {
+    OutputDebugString(SPRINTF(L"LOG_SYSTEM: [%s]: ERROR - "
+                              L"Cannot start the asynchronous logging",
+                              proc_name_));
+    delete async_pipeline;
+    return;
+  }
+  async_pipeline_ = async_pipeline;
+}
+
+AsyncLogPipeline* Logging::AcquireAsyncPipeline() {
+  // The reference is taken before the pointer is read, so that
+  // DeleteAsyncPipeline either sees the reference or this thread sees NULL.
+  ::InterlockedIncrement(&num_async_pipeline_users_);
+  AsyncLogPipeline* async_pipeline = async_pipeline_;
+  if (!async_pipeline) {
+    ::InterlockedDecrement(&num_async_pipeline_users_);
+  }
+  return async_pipeline;
+}
+
+void Logging::ReleaseAsyncPipeline() {
+  VERIFY1(::InterlockedDecrement(&num_async_pipeline_users_) >= 0);
+}
+
+void Logging::DeleteAsyncPipeline() {
+  AsyncLogPipeline* async_pipeline = static_cast<AsyncLogPipeline*>(
+      ::InterlockedExchangePointer(
+          reinterpret_cast<void* volatile*>(&async_pipeline_), NULL));
+  if (!async_pipeline) {
+    return;
+  }
+
+  async_pipeline->Stop();
+
+  // A thread which logs while the module is unloaded may not be able to
+  // release its reference while the loader lock is held. The pipeline is
+  // leaked rather than deleted under such a thread.
+  const DWORD start_ms = ::GetTickCount();
+  while (num_async_pipeline_users_) {
+    if (::GetTickCount() - start_ms >= kLogWriterStopTimeoutMs) {
+      OutputDebugStringA("LOG_SYSTEM: the asynchronous logging is in use\r\n");
+      return;
+    }
+    ::Sleep(1);
+  }
+  delete async_pipeline;
+}
+
+void Logging::Flush() {
+  AsyncLogPipeline* async_pipeline = AcquireAsyncPipeline();
+  if (async_pipeline) {
+    async_pipeline->Flush();
+    ReleaseAsyncPipeline();
+  }
+}
+
+void Logging::FlushOnCrash() {
+  ::InterlockedExchange(&is_crashing_, 1);
+  Flush();
+}
+
+// static
+void Logging::OutputRecordsCallback(void* context,
+                                    LogRecord* const* records,
+                                    int count) {
+  static_cast<Logging*>(context)->OutputRecords(records, count);
+}
+
+// Outputs the records to each log writer as a single batch. The writer mask
+// of a record selects the writers in the same way as for the synchronous
+// OutputMessage.
+void Logging::OutputRecords(LogRecord* const* records, int count) {
+  // The crashing thread may hold the lock, and the crash handler must not
+  // wait for it forever.
+  if (is_crashing_) {
+    if (!lock_.Lock(kMaxMutexWaitTimeMs)) {
+      OutputDebugStringA("LOG_SYSTEM: Couldn't acquire lock on crash\r\n");
+      return;
+    }
+  } else {
+    lock_.Lock();
+  }
+
+  if (!logging_shutdown_) {
+    InternalOutputRecords(records, count);
+  }
+
+  lock_.Unlock();
+}
+
+void Logging::InternalOutputRecords(LogRecord* const* records, int count) {
+  std::vector<OutputInfo> output_infos;
+  output_infos.reserve(count);
+
+  for (int i = 0; i < count; ++i) {
+    const LogRecord* record = records[i];
+    if (record->level <= kMaxLevelToStoreInLogHistory &&
+        IsCategoryEnabledForBuffering(record->category)) {
+      OutputInfo info(record->category, record->level,
+                      record->prefix, record->message);
+      StoreInHistory(&info);
+    }
+  }
+
+  for (int i = 0; i < num_writers_; ++i) {
+    output_infos.clear();
+    for (int j = 0; j < count; ++j) {
+      const LogRecord* record = records[j];
+      if ((record->writer_mask >> i) & 1) {
+        output_infos.push_back(OutputInfo(record->category, record->level,
+                                          record->prefix, record->message));
+      }
+    }
+
+    if (!output_infos.empty()) {
+      OutputMessagesToWriter(writers_[i],
+                             &output_infos.front(),
+                             static_cast<int>(output_infos.size()));
+    }
+  }
+}
+
+void Logging::OutputMessagesToWriter(LogWriter* log_writer,
+                                     const OutputInfo* output_infos,
+                                     int count) {
+  __try {
+    if (logging_enabled_ || log_writer->WantsToLogRegardless()) {
+      log_writer->OutputMessages(output_infos, count);
+    }
+  }
+  __except(SehNoMinidump(GetExceptionCode(),
+                         GetExceptionInformation(),
+                         __FILE__,
+                         __LINE__,
+                         true)) {
+    // Just eat errors that happen from within the LogWriters, as
+    // OutputMessage does.
+  }
+}
+
 void Logging::OutputMessage(DWORD writer_mask, LogCategory cat, LogLevel level,
                             const wchar_t* msg1, const wchar_t* msg2) {
   OutputInfo info(cat, level, msg1, msg2);
@@ -929,6 +1145,12 @@ bool LogWriter::IsCatLevelEnabled(LogCategory, LogLevel) const {
 
 void LogWriter::OutputMessage(const OutputInfo*) { }
 
+void LogWriter::OutputMessages(const OutputInfo* output_infos, int count) {
+  for (int i = 0; i < count; ++i) {
+    OutputMessage(&output_infos[i]);
+  }
+}
+
 bool LogWriter::Register() {
   Logging* logger = GetLogging();
   if (logger) {
@@ -1214,6 +1436,11 @@ int FileLogWriter::FindFirstInMultiString(const wchar_t* multi_str,
 }
 
 void FileLogWriter::OutputMessage(const OutputInfo* output_info) {
+  OutputMessages(output_info, 1);
+}
+
+void FileLogWriter::OutputMessages(const OutputInfo* output_infos,
+                                   int count) {
   if (!initialized_) {
     Initialize();
   }
@@ -1222,6 +1449,36 @@ void FileLogWriter::OutputMessage(const OutputInfo* output_info) {
     return;
   }
 
+  // Build the lines of the batch before acquiring the mutex, so that they are
+  // appended to the file with a single write.
+  int length = 0;
+  for (int i = 0; i < count; ++i) {
+    if (output_infos[i].msg1) {
+      length += lstrlen(output_infos[i].msg1);
+    }
+    if (output_infos[i].msg2) {
+      length += lstrlen(output_infos[i].msg2);
+    }
+    length += 2;
+  }
+
+  CString lines;
+  lines.Preallocate(length);
+  for (int i = 0; i < count; ++i) {
+    if (output_infos[i].msg1) {
+      lines.Append(output_infos[i].msg1);
+    }
+    if (output_infos[i].msg2) {
+      lines.Append(output_infos[i].msg2);
+    }
+    lines.Append(L"\r\n");
+  }
+
+  CStringA ansi_lines;
+  if (!log_file_wide_) {
+    ansi_lines = WideToAnsiDirect(lines);
+  }
+
   // Acquire the mutex.
   if (!GetMutex()) {
     return;
@@ -1235,41 +1492,19 @@ void FileLogWriter::OutputMessage(const OutputInfo* output_info) {
     if (!TruncateLoggingFile()) {
       // Logging stops until the log can be archived over since we do not
       // want to overfill the disk.
+      ReleaseMutex();
       return;
     }
   }
   pos = ::SetFilePointer(log_file_, 0, NULL, FILE_END);
 
-  // Write the date, followed by a CRLF
   DWORD written_size = 0;
-  if (output_info->msg1) {
-    if (log_file_wide_) {
-      ::WriteFile(log_file_, output_info->msg1,
-                  lstrlen(output_info->msg1) * sizeof(wchar_t), &written_size,
-                  NULL);
-    } else {
-      CStringA msg(WideToAnsiDirect(output_info->msg1));
-      ::WriteFile(log_file_, msg.GetString(), msg.GetLength(), &written_size,
-                  NULL);
-    }
-  }
-
-  if (output_info->msg2) {
-    if (log_file_wide_) {
-      ::WriteFile(log_file_, output_info->msg2,
-                  lstrlen(output_info->msg2) * sizeof(wchar_t), &written_size,
-                  NULL);
-    } else {
-      CStringA msg(WideToAnsiDirect(output_info->msg2));
-      ::WriteFile(log_file_, msg.GetString(), msg.GetLength(), &written_size,
-                  NULL);
-    }
-  }
-
   if (log_file_wide_) {
-    ::WriteFile(log_file_, L"\r\n", 2 * sizeof(wchar_t), &written_size, NULL);
+    ::WriteFile(log_file_, lines.GetString(),
+                lines.GetLength() * sizeof(wchar_t), &written_size, NULL);
   } else {
-    ::WriteFile(log_file_, "\r\n", 2, &written_size, NULL);
+    ::WriteFile(log_file_, ansi_lines.GetString(), ansi_lines.GetLength(),
+                &written_size, NULL);
   }
 
   ReleaseMutex();
@@ -1366,6 +1601,222 @@ void OverrideConfigLogWriter::OutputMessage(const OutputInfo* output_info) {
   return;
 }
 
+void OverrideConfigLogWriter::OutputMessages(const OutputInfo* output_infos,
+                                             int count) {
+  if (log_writer_) {
+    log_writer_->OutputMessages(output_infos, count);
+  }
+}
+
+// LogRecordQueue.
+LogRecordQueue::LogRecordQueue(int capacity)
+    : slots_(NULL),
+      mask_(0),
+      push_position_(0),
+      pop_position_(0) {
+  LONG size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+  mask_ = size - 1;
+
+  // Slot i is free for the push at position i.
+  slots_ = new Slot[size];
+  for (LONG i = 0; i < size; ++i) {
+    slots_[i].sequence = i;
+    slots_[i].record = NULL;
+  }
+}
+
+LogRecordQueue::~LogRecordQueue() {
+  LogRecord* record = NULL;
+  while ((record = Pop()) != NULL) {
+    delete record;
+  }
+  delete [] slots_;
+}
+
+// The positions only increase and may wrap around, therefore they are
+// compared by the sign of their difference.
+bool LogRecordQueue::Push(LogRecord* record) {
+  LONG position = push_position_;
+  for (;;) {
+    Slot* slot = &slots_[position & mask_];
+    const LONG difference = static_cast<LONG>(
+        static_cast<ULONG>(slot->sequence) - static_cast<ULONG>(position));
+    if (difference == 0) {
+      // The slot is free. Claim it by advancing the position.
+      const LONG claimed_position = ::InterlockedCompareExchange(
+          &push_position_, position + 1, position);
+      if (claimed_position == position) {
+        slot->record = record;
+
+        // Publish the record to the consumer.
+        ::InterlockedExchange(&slot->sequence, position + 1);
+        return true;
+      }
+      position = claimed_position;
+    } else if (difference < 0) {
+      // The slot still holds the record pushed one lap ago.
+      return false;
+    } else {
+      // Another producer has claimed the slot.
+      position = push_position_;
+    }
+  }
+}
+
+LogRecord* LogRecordQueue::Pop() {
+  Slot* slot = &slots_[pop_position_ & mask_];
+  const LONG difference = static_cast<LONG>(
+      static_cast<ULONG>(slot->sequence) -
+      static_cast<ULONG>(pop_position_ + 1));
+  if (difference < 0) {
+    return NULL;
+  }
+
+  LogRecord* record = slot->record;
+  slot->record = NULL;
+
+  // Free the slot for the push one lap ahead.
+  ::InterlockedExchange(&slot->sequence, pop_position_ + mask_ + 1);
+  ++pop_position_;
+  return record;
+}
+
+// AsyncLogPipeline.
+AsyncLogPipeline::AsyncLogPipeline(int capacity,
+                                   OutputRecordsFunction output_records,
+                                   void* context)
+    : queue_(capacity),
+      output_records_(output_records),
+      context_(context),
+      is_writer_waiting_(0),
+      is_running_(0),
+      records_available_event_(NULL),
+      stop_event_(NULL),
+      writer_thread_(NULL) {
+}
+
+AsyncLogPipeline::~AsyncLogPipeline() {
+  Stop();
+  if (records_available_event_) {
+    ::CloseHandle(records_available_event_);
+  }
+  if (stop_event_) {
+    ::CloseHandle(stop_event_);
+  }
+}
+
+bool AsyncLogPipeline::Start() {
+  if (writer_thread_) {
+    return true;
+  }
+
+  records_available_event_ = ::CreateEvent(NULL, false, false, NULL);
+  stop_event_ = ::CreateEvent(NULL, true, false, NULL);
+  if (!records_available_event_ || !stop_event_) {
+    return false;
+  }
+
+  ::InterlockedExchange(&is_running_, 1);
+  writer_thread_ = ::CreateThread(NULL, 0, &WriterThreadProc, this, 0, NULL);
+  if (!writer_thread_) {
+    ::InterlockedExchange(&is_running_, 0);
+    return false;
+  }
+  return true;
+}
+
+void AsyncLogPipeline::Stop() {
+  ::InterlockedExchange(&is_running_, 0);
+
+  if (writer_thread_) {
+    // When the module is unloaded, the writer thread may not be able to exit
+    // while the loader lock is held, hence the bounded wait.
+    ::SetEvent(stop_event_);
+    ::WaitForSingleObject(writer_thread_, kLogWriterStopTimeoutMs);
+    ::CloseHandle(writer_thread_);
+    writer_thread_ = NULL;
+  }
+
+  Flush();
+}
+
+bool AsyncLogPipeline::Push(LogRecord* record) {
+  if (!is_running_) {
+    return false;
+  }
+
+  if (!queue_.Push(record)) {
+    // The writer thread is falling behind. Make room for the record instead of
+    // growing the queue without bounds.
+    Flush();
+    if (!queue_.Push(record)) {
+      return false;
+    }
+  }
+
+  if (::InterlockedExchange(&is_writer_waiting_, 0)) {
+    ::SetEvent(records_available_event_);
+  }
+  return true;
+}
+
+void AsyncLogPipeline::Flush() {
+  if (!drain_lock_.Lock(kMaxMutexWaitTimeMs)) {
+    return;
+  }
+  DrainQueue();
+  drain_lock_.Unlock();
+}
+
+DWORD WINAPI AsyncLogPipeline::WriterThreadProc(void* param) {
+  static_cast<AsyncLogPipeline*>(param)->WriteRecords();
+  return 0;
+}
+
+void AsyncLogPipeline::WriteRecords() {
+  const HANDLE handles[] = { stop_event_, records_available_event_ };
+  for (;;) {
+    // The flag is set before the queue is drained, so that a record pushed
+    // after the last pop of the drain always signals the event.
+    ::InterlockedExchange(&is_writer_waiting_, 1);
+
+    drain_lock_.Lock();
+    DrainQueue();
+    drain_lock_.Unlock();
+
+    const DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                                  handles,
+                                                  false,
+                                                  INFINITE);
+    if (result != WAIT_OBJECT_0 + 1) {
+      return;
+    }
+  }
+}
+
+void AsyncLogPipeline::DrainQueue() {
+  LogRecord* records[kMaxLogBatchSize] = {0};
+  for (;;) {
+    int count = 0;
+    while (count < kMaxLogBatchSize &&
+           (records[count] = queue_.Pop()) != NULL) {
+      ++count;
+    }
+    if (count == 0) {
+      return;
+    }
+
+    output_records_(context_, records, count);
+
+    for (int i = 0; i < count; ++i) {
+      delete records[i];
+    }
+  }
+}
+
 }  // namespace omaha
 
 #endif  // LOGGING
@@ -55,6 +55,7 @@ namespace omaha {
 #define kDefaultLogFileWide             1
 #define kDefaultShowTime                1
 #define kDefaultAppendToFile            1
+#define kDefaultAsyncLogging            0
 
 #ifdef _DEBUG
 #define kDefaultMaxLogFileSize          0xFFFFFFFF  // 4GB
@@ -85,6 +86,7 @@ namespace omaha {
 #define kConfigAttrLogToOutputDebug     L"LogToOutputDebug"
 #define kConfigAttrAppendToFile         L"AppendToFile"
 #define kConfigAttrMaxLogFileSize       L"MaxLogFileSize"
+#define kConfigAttrAsyncLogging         L"AsyncLogging"
 
 #define kLoggingMutexName               kLockPrefix L"logging_mutex"
 #define kMaxMutexWaitTimeMs             500
@@ -92,6 +94,13 @@ namespace omaha {
 // Does not allow messages bigger than 1 MB.
 #define kMaxLogMessageSize              (1024 * 1024)
 
+// Asynchronous logging: the number of records which can be queued, the
+// number of records output with each batch, and how long the shutdown waits
+// for the writer thread to exit.
+#define kLogRecordQueueCapacity         4096
+#define kMaxLogBatchSize                256
+#define kLogWriterStopTimeoutMs         1000
+
 #define kLogSettingsCheckInterval       (5 * kSecsTo100ns)
 
 #define kStartOfLogMessage \
@@ -230,6 +239,10 @@ class LogWriter {
 
   virtual void OutputMessage(const OutputInfo* output_info);
 
+  // Outputs a batch of messages. The default implementation outputs the
+  // messages one at a time.
+  virtual void OutputMessages(const OutputInfo* output_infos, int count);
+
   // Registers and unregisters this LogWriter with the Logging system.  When
   // registered, the Logging class assumes ownership.
   bool Register();
@@ -250,6 +263,10 @@ class FileLogWriter : public LogWriter {
   static FileLogWriter* Create(const wchar_t* file_name, bool append);
   virtual void OutputMessage(const OutputInfo* output_info);
 
+  // Appends the batch to the log file with a single write, while holding the
+  // logging mutex once.
+  virtual void OutputMessages(const OutputInfo* output_infos, int count);
+
  private:
   void Initialize();
   bool CreateLoggingMutex();
@@ -309,6 +326,7 @@ class OverrideConfigLogWriter : public LogWriter {
   virtual bool WantsToLogRegardless() const;
   virtual bool IsCatLevelEnabled(LogCategory category, LogLevel level) const;
   virtual void OutputMessage(const OutputInfo* output_info);
+  virtual void OutputMessages(const OutputInfo* output_infos, int count);
  private:
   LogCategory category_;
   LogLevel level_;
@@ -320,6 +338,124 @@ class OverrideConfigLogWriter : public LogWriter {
 // This log writer outputs to Event Tracing for Windows.
 class EtwLogWriter;
 
+// A formatted log message waiting in the AsyncLogPipeline to be output.
+struct LogRecord {
+  LogRecord(DWORD mask, LogCategory cat, LogLevel log_level)
+      : writer_mask(mask),
+        category(cat),
+        level(log_level) {}
+
+  DWORD writer_mask;
+  LogCategory category;
+  LogLevel level;
+  CString prefix;
+  CString message;
+};
+
+// A bounded queue of log records, which any number of threads can push to
+// without locking. Only one thread at a time may pop records. Each slot of the
+// ring carries a sequence number which tells the producers when the slot is
+// free and the consumer when the slot is filled.
+class LogRecordQueue {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit LogRecordQueue(int capacity);
+
+  // Deletes the records left in the queue.
+  ~LogRecordQueue();
+
+  // Returns false if the queue is full. The queue owns the record otherwise.
+  bool Push(LogRecord* record);
+
+  // Returns NULL if the queue is empty. The caller owns the record otherwise.
+  LogRecord* Pop();
+
+  int capacity() const { return static_cast<int>(mask_) + 1; }
+
+ private:
+  struct Slot {
+    volatile LONG sequence;
+    LogRecord* record;
+  };
+
+  Slot* slots_;
+  LONG mask_;
+
+  // The producers and the consumer advance separate positions, which are kept
+  // in separate cache lines.
+  volatile LONG push_position_;
+  char padding_[64];
+  LONG pop_position_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(LogRecordQueue);
+};
+
+// Decouples formatting log messages from writing them. The threads logging a
+// message push the formatted record into a LogRecordQueue and go on. A
+// dedicated writer thread pops the records and outputs them in batches, so
+// that the log writers take their locks and write to the disk once per batch
+// instead of once per message.
+class AsyncLogPipeline {
+ public:
+  // Outputs a batch of records. The callee does not own the records.
+  typedef void (*OutputRecordsFunction)(void* context,
+                                        LogRecord* const* records,
+                                        int count);
+
+  AsyncLogPipeline(int capacity,
+                   OutputRecordsFunction output_records,
+                   void* context);
+
+  // Stops the writer thread and outputs the records left in the queue.
+  ~AsyncLogPipeline();
+
+  // Starts the writer thread.
+  bool Start();
+
+  // Stops the writer thread, then outputs the records left in the queue on the
+  // calling thread. The records pushed afterwards are rejected.
+  void Stop();
+
+  // Queues the record for output. When the queue is full, the calling thread
+  // helps by outputting the queued records before retrying. Returns false if
+  // the record could not be queued, in which case the caller keeps
+  // ownership of the record.
+  bool Push(LogRecord* record);
+
+  // Outputs the queued records on the calling thread. Gives up if another
+  // thread is outputting records for longer than kMaxMutexWaitTimeMs.
+  void Flush();
+
+  bool is_running() const { return is_running_ != 0; }
+
+ private:
+  static DWORD WINAPI WriterThreadProc(void* param);
+  void WriteRecords();
+
+  // Pops and outputs the queued records in batches of up to
+  // kMaxLogBatchSize. The caller must hold drain_lock_.
+  void DrainQueue();
+
+  LogRecordQueue queue_;
+  OutputRecordsFunction output_records_;
+  void* context_;
+
+  // Serializes popping the records, since the queue has a single consumer.
+  LLock drain_lock_;
+
+  // Set by the writer thread before it waits for records. The producers reset
+  // it and wake up the writer thread, which avoids signaling the event for
+  // each record.
+  volatile LONG is_writer_waiting_;
+  volatile LONG is_running_;
+
+  HANDLE records_available_event_;
+  HANDLE stop_event_;
+  HANDLE writer_thread_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(AsyncLogPipeline);
+};
+
 // The Logging class - Singleton class
 // Fine-grain logging based on categories and levels.
 // Can log to a file, stdout or debugger.
@@ -370,6 +506,17 @@ class Logging {
   const CString& proc_name() const { return proc_name_; }
 
   bool IsCategoryEnabledForBuffering(LogCategory cat);
+
+  // Writes out the messages waiting to be output by the asynchronous logging
+  // pipeline. Called when logging is disabled or shuts down. The caller must
+  // not hold the logging lock.
+  void Flush();
+
+  // Same as Flush, but called when the process crashes. The crashing thread
+  // may hold the logging lock, so the messages are dropped if the lock is not
+  // acquired within kMaxMutexWaitTimeMs.
+  void FlushOnCrash();
+
  private:
   bool InternalInitialize();
   void InternalLogMessageMaskedVA(DWORD writer_mask,
@@ -379,6 +526,36 @@ class Logging {
                                   CString* prefix,
                                   const wchar_t* fmt,
                                   va_list args);
+  void FormatLogMessage(CString* log_buffer,
+                        CString* prefix,
+                        const wchar_t* fmt,
+                        va_list args);
+  bool InternalFormatLogRecord(LogRecord* record,
+                               const wchar_t* fmt,
+                               va_list args);
+
+  // Starts the asynchronous logging pipeline if the configuration asks for it.
+  void StartAsyncPipeline();
+
+  // Returns the pipeline with a reference that ReleaseAsyncPipeline drops, or
+  // NULL if there is no pipeline. The pipeline is not deleted while there are
+  // references to it.
+  AsyncLogPipeline* AcquireAsyncPipeline();
+  void ReleaseAsyncPipeline();
+
+  // Stops the pipeline and deletes it once the threads using it are done.
+  void DeleteAsyncPipeline();
+
+  // Outputs the records of the asynchronous logging pipeline while holding the
+  // logging lock once.
+  static void OutputRecordsCallback(void* context,
+                                    LogRecord* const* records,
+                                    int count);
+  void OutputRecords(LogRecord* const* records, int count);
+  void InternalOutputRecords(LogRecord* const* records, int count);
+  void OutputMessagesToWriter(LogWriter* log_writer,
+                              const OutputInfo* output_infos,
+                              int count);
 
   friend class LoggingHelper;
   void LogMessageMaskedVA(DWORD writer_mask, LogCategory cat, LogLevel level,
@@ -447,6 +624,16 @@ class Logging {
   CString log_file_name_;
   bool log_to_debug_out_;
   bool append_to_file_;
+  bool async_logging_;
+
+  // Queues the messages for the writer thread when logging asynchronously.
+  // The threads which log hold a reference while they use it, so that it is
+  // not deleted under them when logging shuts down.
+  AsyncLogPipeline* volatile async_pipeline_;
+  volatile LONG num_async_pipeline_users_;
+
+  // Set once the process has crashed.
+  volatile LONG is_crashing_;
 
   // Signals the logging system is shutting down.
   bool logging_shutdown_;
@@ -13,12 +13,192 @@
 // limitations under the License.
 // ========================================================================
 
+#include <algorithm>
+#include <vector>
 #include "base/basictypes.h"
+#include "omaha/base/app_util.h"
+#include "omaha/base/file.h"
 #include "omaha/base/logging.h"
+#include "omaha/base/path.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/utils.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
 
+namespace {
+
+const int kNumProducers = 4;
+
+// Checks that the records of each producer are output in the order they were
+// pushed. The writer mask of a record identifies its producer and the message
+// holds its sequence number.
+class RecordOrderChecker {
+ public:
+  RecordOrderChecker() : num_records_(0), num_batches_(0) {
+    for (int i = 0; i < kNumProducers; ++i) {
+      next_sequence_[i] = 0;
+    }
+  }
+
+  static void OutputRecords(void* context,
+                            LogRecord* const* records,
+                            int count) {
+    RecordOrderChecker* checker = static_cast<RecordOrderChecker*>(context);
+    EXPECT_LE(count, kMaxLogBatchSize);
+    for (int i = 0; i < count; ++i) {
+      const int producer = records[i]->writer_mask;
+      EXPECT_EQ(checker->next_sequence_[producer]++,
+                _wtoi(records[i]->message));
+    }
+    checker->num_records_ += count;
+    ++checker->num_batches_;
+  }
+
+  int num_records() const { return num_records_; }
+  int num_batches() const { return num_batches_; }
+
+ private:
+  int next_sequence_[kNumProducers];
+  int num_records_;
+  int num_batches_;
+};
+
+struct ProducerParam {
+  AsyncLogPipeline* pipeline;
+  int producer;
+  int num_records;
+};
+
+DWORD WINAPI PushRecords(void* param) {
+  const ProducerParam* producer_param = static_cast<ProducerParam*>(param);
+  for (int i = 0; i < producer_param->num_records; ++i) {
+    LogRecord* record = new LogRecord(producer_param->producer,
+                                      LC_LOGGING,
+                                      L1);
+    record->message.Format(_T("%d"), i);
+    EXPECT_TRUE(producer_param->pipeline->Push(record));
+  }
+  return 0;
+}
+
+// Logs messages to a FileLogWriter either the way Logging does it
+// synchronously, one message at a time under a lock, or through an
+// AsyncLogPipeline, and measures how long the logging calls take.
+class LoggingBenchmark {
+ public:
+  LoggingBenchmark(LogWriter* writer, bool is_async)
+      : writer_(writer),
+        pipeline_(kLogRecordQueueCapacity, &OutputRecords, writer),
+        is_async_(is_async),
+        num_threads_(0),
+        num_messages_per_thread_(0),
+        total_ticks_(0),
+        max_ticks_(0) {}
+
+  // Returns the total duration, in milliseconds.
+  double Run(int num_threads, int num_messages_per_thread) {
+    num_threads_ = num_threads;
+    num_messages_per_thread_ = num_messages_per_thread;
+    if (is_async_) {
+      EXPECT_TRUE(pipeline_.Start());
+    }
+
+    const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+    std::vector<HANDLE> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.push_back(::CreateThread(NULL, 0, &LogMessages, this, 0, NULL));
+      EXPECT_TRUE(threads.back());
+    }
+    EXPECT_EQ(WAIT_OBJECT_0, ::WaitForMultipleObjects(threads.size(),
+                                                      &threads.front(),
+                                                      true,
+                                                      INFINITE));
+    if (is_async_) {
+      pipeline_.Stop();
+    }
+    const ULONGLONG end_ticks = HighresTimer::GetCurrentTicks();
+
+    for (size_t i = 0; i != threads.size(); ++i) {
+      ::CloseHandle(threads[i]);
+    }
+    return TicksToMs(end_ticks - start_ticks);
+  }
+
+  double average_latency_us() const {
+    return TicksToMs(total_ticks_) * 1000 /
+           (num_threads_ * num_messages_per_thread_);
+  }
+  double max_latency_us() const { return TicksToMs(max_ticks_) * 1000; }
+
+ private:
+  static double TicksToMs(ULONGLONG ticks) {
+    return static_cast<double>(ticks) * 1000 /
+           HighresTimer::GetTimerFrequency();
+  }
+
+  static void OutputRecords(void* context,
+                            LogRecord* const* records,
+                            int count) {
+    std::vector<OutputInfo> output_infos;
+    for (int i = 0; i < count; ++i) {
+      output_infos.push_back(OutputInfo(records[i]->category,
+                                        records[i]->level,
+                                        records[i]->prefix,
+                                        records[i]->message));
+    }
+    static_cast<LogWriter*>(context)->OutputMessages(&output_infos.front(),
+                                                     count);
+  }
+
+  static DWORD WINAPI LogMessages(void* param) {
+    static_cast<LoggingBenchmark*>(param)->LogMessages();
+    return 0;
+  }
+
+  void LogMessages() {
+    ULONGLONG total_ticks = 0;
+    ULONGLONG max_ticks = 0;
+    for (int i = 0; i < num_messages_per_thread_; ++i) {
+      const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+      CString prefix;
+      prefix.Format(_T("[benchmark][%u]"), ::GetCurrentThreadId());
+      CString message;
+      message.Format(_T("message %d of a typical length for a log line"), i);
+      if (is_async_) {
+        LogRecord* record = new LogRecord(0, LC_LOGGING, L1);
+        record->prefix = prefix;
+        record->message = message;
+        EXPECT_TRUE(pipeline_.Push(record));
+      } else {
+        __mutexScope(lock_);
+        OutputInfo info(LC_LOGGING, L1, prefix, message);
+        writer_->OutputMessage(&info);
+      }
+      const ULONGLONG ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+      total_ticks += ticks;
+      max_ticks = std::max(max_ticks, ticks);
+    }
+
+    __mutexScope(lock_);
+    total_ticks_ += total_ticks;
+    max_ticks_ = std::max(max_ticks_, max_ticks);
+  }
+
+  LogWriter* writer_;
+  AsyncLogPipeline pipeline_;
+  const bool is_async_;
+  LLock lock_;
+  int num_threads_;
+  int num_messages_per_thread_;
+  ULONGLONG total_ticks_;
+  ULONGLONG max_ticks_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(LoggingBenchmark);
+};
+
+}  // namespace
+
 TEST(LoggingTest, Logging) {
 #ifdef _DEBUG
   OPT_LOG(L1, (_T("[OPT_LOG from debug build.]")));
@@ -35,6 +215,51 @@ class FileLogWriterTest : public testing::Test {
                              const TCHAR* str) {
     return FileLogWriter::FindFirstInMultiString(multi_str, count, str);
   }
+
+ protected:
+  FileLogWriterTest()
+      : log_file_path_(ConcatenatePath(app_util::GetTempDir(),
+                                       _T("logging_unittest.log"))) {
+  }
+
+  virtual void SetUp() {
+    ::DeleteFile(log_file_path_);
+  }
+
+  virtual void TearDown() {
+    ::DeleteFile(log_file_path_);
+  }
+
+  // Returns the lines of the log file, without the byte order mark.
+  std::vector<CString> ReadLogLines(const FileLogWriter* writer) const {
+    std::vector<byte> buffer;
+    EXPECT_HRESULT_SUCCEEDED(ReadEntireFileShareMode(log_file_path_,
+                                                     0,
+                                                     FILE_SHARE_WRITE,
+                                                     &buffer));
+    CString contents;
+    if (writer->log_file_wide_) {
+      EXPECT_LE(sizeof(kUnicodeBom), buffer.size());
+      contents.SetString(
+          reinterpret_cast<const wchar_t*>(&buffer[sizeof(kUnicodeBom)]),
+          (buffer.size() - sizeof(kUnicodeBom)) / sizeof(wchar_t));
+    } else if (!buffer.empty()) {
+      contents = CString(CStringA(reinterpret_cast<const char*>(&buffer[0]),
+                                  buffer.size()));
+    }
+
+    std::vector<CString> lines;
+    int start = 0;
+    int end = 0;
+    while ((end = contents.Find(_T("\r\n"), start)) != -1) {
+      lines.push_back(contents.Mid(start, end - start));
+      start = end + 2;
+    }
+    EXPECT_EQ(contents.GetLength(), start);
+    return lines;
+  }
+
+  const CString log_file_path_;
 };
 
 class HistoryTest : public testing::Test {
@@ -101,6 +326,143 @@ TEST_F(FileLogWriterTest, FindInMultiString) {
   EXPECT_EQ(FindFirstInMultiString(s11, arraysize(s11), _T("a")), -1);
 }
 
+TEST_F(FileLogWriterTest, OutputMessages) {
+  LogWriter* writer = FileLogWriter::Create(log_file_path_, false);
+  const OutputInfo output_infos[] = {
+    OutputInfo(LC_CORE, L1, _T("[prefix1]"), _T("message1")),
+    OutputInfo(LC_CORE, L2, NULL, _T("message2")),
+    OutputInfo(LC_NET, L3, _T("[prefix3]"), NULL),
+  };
+  writer->OutputMessages(output_infos, arraysize(output_infos));
+  writer->OutputMessage(&output_infos[0]);
+
+  std::vector<CString> lines(
+      ReadLogLines(static_cast<FileLogWriter*>(writer)));
+  delete writer;
+
+  ASSERT_EQ(4, lines.size());
+  EXPECT_STREQ(_T("[prefix1]message1"), lines[0]);
+  EXPECT_STREQ(_T("message2"), lines[1]);
+  EXPECT_STREQ(_T("[prefix3]"), lines[2]);
+  EXPECT_STREQ(_T("[prefix1]message1"), lines[3]);
+}
+
+// Compares the throughput and the latency of the logging calls when the
+// messages are written synchronously and through the asynchronous pipeline.
+TEST_F(FileLogWriterTest, DISABLED_SynchronousVersusAsynchronousBenchmark) {
+  const int kNumThreads = 8;
+  const int kNumMessagesPerThread = 2000;
+  const TCHAR* const kModeNames[] = { _T("synchronous"), _T("asynchronous") };
+
+  for (int mode = 0; mode != arraysize(kModeNames); ++mode) {
+    ::DeleteFile(log_file_path_);
+    LogWriter* writer = FileLogWriter::Create(log_file_path_, false);
+
+    double duration_ms = 0;
+    double average_latency_us = 0;
+    double max_latency_us = 0;
+    {
+      LoggingBenchmark benchmark(writer, mode == 1);
+      duration_ms = benchmark.Run(kNumThreads, kNumMessagesPerThread);
+      average_latency_us = benchmark.average_latency_us();
+      max_latency_us = benchmark.max_latency_us();
+    }
+
+    EXPECT_EQ(kNumThreads * kNumMessagesPerThread,
+              ReadLogLines(static_cast<FileLogWriter*>(writer)).size());
+    delete writer;
+
+    OPT_LOG(L1, (_T("[%s][%f messages/s][average latency %f us]")
+                 _T("[max latency %f us]"),
+                 kModeNames[mode],
+                 kNumThreads * kNumMessagesPerThread * 1000 / duration_ms,
+                 average_latency_us,
+                 max_latency_us));
+  }
+}
+
+TEST(LogRecordQueueTest, PushPop) {
+  LogRecordQueue queue(3);
+  EXPECT_EQ(4, queue.capacity());
+  EXPECT_TRUE(queue.Pop() == NULL);
+
+  // Go around the ring a few times.
+  for (int i = 0; i < 10; ++i) {
+    LogRecord* records[4] = {0};
+    for (int j = 0; j != arraysize(records); ++j) {
+      records[j] = new LogRecord(0, LC_LOGGING, L1);
+      EXPECT_TRUE(queue.Push(records[j]));
+    }
+
+    LogRecord extra_record(0, LC_LOGGING, L1);
+    EXPECT_FALSE(queue.Push(&extra_record));
+
+    for (int j = 0; j != arraysize(records); ++j) {
+      LogRecord* record = queue.Pop();
+      EXPECT_EQ(records[j], record);
+      delete record;
+    }
+    EXPECT_TRUE(queue.Pop() == NULL);
+  }
+
+  // The records left in the queue are deleted with the queue.
+  EXPECT_TRUE(queue.Push(new LogRecord(0, LC_LOGGING, L1)));
+}
+
+// The records pushed concurrently by several threads, including the ones
+// which find the queue full, are all output in order.
+TEST(AsyncLogPipelineTest, MultipleProducers) {
+  const int kNumRecordsPerProducer = 20000;
+
+  RecordOrderChecker checker;
+  AsyncLogPipeline pipeline(64, &RecordOrderChecker::OutputRecords, &checker);
+  ASSERT_TRUE(pipeline.Start());
+  EXPECT_TRUE(pipeline.is_running());
+
+  ProducerParam params[kNumProducers] = {0};
+  HANDLE threads[kNumProducers] = {0};
+  for (int i = 0; i < kNumProducers; ++i) {
+    params[i].pipeline = &pipeline;
+    params[i].producer = i;
+    params[i].num_records = kNumRecordsPerProducer;
+    threads[i] = ::CreateThread(NULL, 0, &PushRecords, &params[i], 0, NULL);
+    ASSERT_TRUE(threads[i]);
+  }
+  EXPECT_EQ(WAIT_OBJECT_0,
+            ::WaitForMultipleObjects(kNumProducers, threads, true, INFINITE));
+  for (int i = 0; i < kNumProducers; ++i) {
+    ::CloseHandle(threads[i]);
+  }
+
+  pipeline.Stop();
+  EXPECT_FALSE(pipeline.is_running());
+  EXPECT_EQ(kNumProducers * kNumRecordsPerProducer, checker.num_records());
+  EXPECT_GT(checker.num_records(), checker.num_batches());
+
+  // Once stopped, the pipeline rejects the records.
+  LogRecord record(0, LC_LOGGING, L1);
+  EXPECT_FALSE(pipeline.Push(&record));
+}
+
+TEST(AsyncLogPipelineTest, Flush) {
+  RecordOrderChecker checker;
+  AsyncLogPipeline pipeline(kLogRecordQueueCapacity,
+                            &RecordOrderChecker::OutputRecords,
+                            &checker);
+  ASSERT_TRUE(pipeline.Start());
+
+  for (int i = 0; i < 100; ++i) {
+    LogRecord* record = new LogRecord(0, LC_LOGGING, L1);
+    record->message.Format(_T("%d"), i);
+    EXPECT_TRUE(pipeline.Push(record));
+  }
+
+  // The records have all been output when Flush returns, whether by the
+  // writer thread or by the flush.
+  pipeline.Flush();
+  EXPECT_EQ(100, checker.num_records());
+}
+
 TEST_F(HistoryTest, GetHistory) {
   EXPECT_TRUE(GetHistory().IsEmpty());
 
@@ -43,6 +43,16 @@ typedef struct {
   p256_digit a[P256_NDIGITS];
 } p256_int;
 
+#define P256_TABLE_WINDOWS 64
+
+// The multiples d * 16**w of the base point and of a fixed point, for
+// 1 <= d <= 15 and each 4-bit window w of the scalars. The entries are affine
+// points in the internal format of p256_ec64.c. A table takes 120 KB.
+typedef struct {
+  uint64_t base[P256_TABLE_WINDOWS][15][8];
+  uint64_t point[P256_TABLE_WINDOWS][15][8];
+} p256_point_table;
+
 extern const p256_int SECP256r1_n;  // Curve order
 extern const p256_int SECP256r1_p;  // Curve prime
 extern const p256_int SECP256r1_b;  // Curve param
@@ -131,6 +141,18 @@ void p256_points_mul_vartime(
     const p256_int *in_x, const p256_int *in_y,
     p256_int *out_x, p256_int *out_y);
 
+// Fills |table| for the fixed point {in_x,in_y}.
+// Returns 0 if the point is not on the curve.
+int p256_point_table_init(const p256_int* in_x, const p256_int* in_y,
+                          p256_point_table* table);
+
+// Returns whether the x coordinate of n1G + n2P, mod n, is r, where P is the
+// point of |table|. Returns 0 if r >= n or the sum is the point at infinity.
+// Not constant-time.
+int p256_points_mul_x_equals_vartime(const p256_point_table* table,
+                                     const p256_int* n1, const p256_int* n2,
+                                     const p256_int* r);
+
 // Return whether point {x,y} is on curve.
 int p256_is_valid_point(const p256_int* x, const p256_int* y);
 
@@ -0,0 +1,451 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Variable-time computation of n1*G + n2*P for a fixed point P, for verifying
+// signatures with a pinned public key. The field uses four 64-bit limbs in
+// Montgomery form, and both points have tables of their multiples so that the
+// scalar multiplication is additions only.
+//
+// WARNING: This code is not constant-time. Only use it with public inputs,
+//          such as when verifying signatures. Signing uses p256_ec.c.
+
+#include <string.h>
+#include "p256.h"
+
+#if defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#endif
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+/* A field element is four 64-bit limbs in little-endian order, holding
+ * (x * 2**256) mod p, fully reduced. */
+typedef u64 fe[4];
+
+static const fe kP = {
+  0xffffffffffffffffULL, 0x00000000ffffffffULL,
+  0x0000000000000000ULL, 0xffffffff00000001ULL
+};
+
+static const fe kN = {
+  0xf3b9cac2fc632551ULL, 0xbce6faada7179e84ULL,
+  0xffffffffffffffffULL, 0xffffffff00000000ULL
+};
+
+/* kOne is 2**256 mod p, the number 1 in Montgomery form. */
+static const fe kOne = {
+  0x0000000000000001ULL, 0xffffffff00000000ULL,
+  0xffffffffffffffffULL, 0x00000000fffffffeULL
+};
+
+/* kRR is 2**512 mod p, which converts numbers to Montgomery form. */
+static const fe kRR = {
+  0x0000000000000003ULL, 0xfffffffbffffffffULL,
+  0xfffffffffffffffeULL, 0x00000004fffffffdULL
+};
+
+static const fe kGx = {
+  0xf4a13945d898c296ULL, 0x77037d812deb33a0ULL,
+  0xf8bce6e563a440f2ULL, 0x6b17d1f2e12c4247ULL
+};
+
+static const fe kGy = {
+  0xcbb6406837bf51f5ULL, 0x2bce33576b315eceULL,
+  0x8ee7eb4a7c0f9e16ULL, 0x4fe342e2fe1a7f9bULL
+};
+
+/* Returns the low half of a*b and stores the high half in |hi|. */
+#if defined(_M_X64)
+static u64 mul64(u64 a, u64 b, u64* hi) {
+  return _umul128(a, b, hi);
+}
+#else
+static u64 mul64(u64 a, u64 b, u64* hi) {
+  const u64 a_lo = (u32)a;
+  const u64 a_hi = a >> 32;
+  const u64 b_lo = (u32)b;
+  const u64 b_hi = b >> 32;
+  const u64 lo_lo = a_lo * b_lo;
+  const u64 hi_lo = a_hi * b_lo;
+  const u64 lo_hi = a_lo * b_hi;
+  const u64 cross = (lo_lo >> 32) + (u32)hi_lo + lo_hi;
+
+  *hi = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+  return (cross << 32) | (u32)lo_lo;
+}
+#endif
+
+/* Returns the low half of acc + a*b + *carry, and stores the high half in
+ * |carry|. The sum fits in 128 bits. */
+static u64 mac(u64 acc, u64 a, u64 b, u64* carry) {
+  u64 hi;
+  u64 lo = mul64(a, b, &hi);
+
+  lo += acc;
+  hi += lo < acc;
+  lo += *carry;
+  hi += lo < *carry;
+  *carry = hi;
+  return lo;
+}
+
+/* r = a + b, returns the carry. */
+static u64 add4(fe r, const fe a, const fe b) {
+  u64 carry = 0;
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    const u64 sum = a[i] + carry;
+    carry = sum < carry;
+    r[i] = sum + b[i];
+    carry += r[i] < sum;
+  }
+  return carry;
+}
+
+/* r = a - b, returns the borrow. */
+static u64 sub4(fe r, const fe a, const fe b) {
+  u64 borrow = 0;
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    const u64 diff = a[i] - b[i];
+    const u64 next = (a[i] < b[i]) | (diff < borrow);
+    r[i] = diff - borrow;
+    borrow = next;
+  }
+  return borrow;
+}
+
+static void fe_copy(fe r, const fe a) {
+  memcpy(r, a, sizeof(fe));
+}
+
+static int fe_is_zero(const fe a) {
+  return (a[0] | a[1] | a[2] | a[3]) == 0;
+}
+
+static int fe_equal(const fe a, const fe b) {
+  return memcmp(a, b, sizeof(fe)) == 0;
+}
+
+static void fe_add(fe r, const fe a, const fe b) {
+  fe sum, reduced;
+  const u64 carry = add4(sum, a, b);
+  const u64 borrow = sub4(reduced, sum, kP);
+
+  fe_copy(r, (carry || !borrow) ? reduced : sum);
+}
+
+static void fe_sub(fe r, const fe a, const fe b) {
+  fe diff;
+
+  if (sub4(diff, a, b)) {
+    add4(diff, diff, kP);
+  }
+  fe_copy(r, diff);
+}
+
+/* r = a * b / 2**256 mod p, by word-wise Montgomery reduction. Since the low
+ * limb of p is 2**64 - 1, -1/p mod 2**64 is 1 and the multiple of p to add
+ * is the low limb itself. */
+static void fe_mul(fe r, const fe a, const fe b) {
+  u64 t[6] = {0};
+  u64 carry;
+  u64 m;
+  int i, j;
+
+  for (i = 0; i < 4; ++i) {
+    carry = 0;
+    for (j = 0; j < 4; ++j) {
+      t[j] = mac(t[j], a[j], b[i], &carry);
+    }
+    t[4] += carry;
+    t[5] = t[4] < carry;
+
+    m = t[0];
+    carry = 0;
+    mac(t[0], m, kP[0], &carry);
+    for (j = 1; j < 4; ++j) {
+      t[j - 1] = mac(t[j], m, kP[j], &carry);
+    }
+    t[3] = t[4] + carry;
+    t[4] = t[5] + (t[3] < carry);
+  }
+
+  /* t is less than 2p. */
+  if (sub4(r, t, kP) && !t[4]) {
+    fe_copy(r, t);
+  }
+}
+
+static void fe_sqr(fe r, const fe a) {
+  fe_mul(r, a, a);
+}
+
+/* r = 1/a by Fermat's little theorem, a**(p-2). */
+static void fe_inv(fe r, const fe a) {
+  static const fe kPMinus2 = {
+    0xfffffffffffffffdULL, 0x00000000ffffffffULL,
+    0x0000000000000000ULL, 0xffffffff00000001ULL
+  };
+  fe result;
+  int i;
+
+  fe_copy(result, kOne);
+  for (i = 255; i >= 0; --i) {
+    fe_sqr(result, result);
+    if ((kPMinus2[i / 64] >> (i % 64)) & 1) {
+      fe_mul(result, result, a);
+    }
+  }
+  fe_copy(r, result);
+}
+
+static void fe_from_p256(fe r, const p256_int* a) {
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    r[i] = (u64)P256_DIGIT(a, 2 * i) |
+           ((u64)P256_DIGIT(a, 2 * i + 1) << 32);
+  }
+}
+
+/* Points are in Jacobian coordinates, {x/z**2, y/z**3}. The point at infinity
+ * has z = 0. */
+
+/* See http://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-3.html
+ * #doubling-dbl-2001-b. The output may alias the input. */
+static void point_double(fe x3, fe y3, fe z3,
+                         const fe x1, const fe y1, const fe z1) {
+  fe delta, gamma, beta, alpha, t0, t1;
+
+  fe_sqr(delta, z1);
+  fe_sqr(gamma, y1);
+  fe_mul(beta, x1, gamma);
+
+  /* alpha = 3 * (x1 - delta) * (x1 + delta) */
+  fe_sub(t0, x1, delta);
+  fe_add(t1, x1, delta);
+  fe_mul(alpha, t0, t1);
+  fe_add(t0, alpha, alpha);
+  fe_add(alpha, t0, alpha);
+
+  /* z3 = (y1 + z1)**2 - gamma - delta */
+  fe_add(t0, y1, z1);
+  fe_sqr(t0, t0);
+  fe_sub(t0, t0, gamma);
+  fe_sub(z3, t0, delta);
+
+  /* x3 = alpha**2 - 8 * beta */
+  fe_add(beta, beta, beta);
+  fe_add(beta, beta, beta);
+  fe_sqr(t0, alpha);
+  fe_sub(t0, t0, beta);
+  fe_sub(x3, t0, beta);
+
+  /* y3 = alpha * (4 * beta - x3) - 8 * gamma**2 */
+  fe_sub(t0, beta, x3);
+  fe_mul(t0, alpha, t0);
+  fe_sqr(gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_sub(y3, t0, gamma);
+}
+
+/* Adds the affine point {x2,y2} to {x1,y1,z1}. See
+ * http://hyperelliptic.org/EFD/g1p/auto-shortw-jacobian-3.html
+ * #addition-madd-2007-bl. Unlike the formula, this handles the point at
+ * infinity and equal points. The output may alias the first input. */
+static void point_add_mixed(fe x3, fe y3, fe z3,
+                            const fe x1, const fe y1, const fe z1,
+                            const fe x2, const fe y2) {
+  fe z1z1, u2, s2, h, hh, i, j, r, v, t;
+
+  if (fe_is_zero(z1)) {
+    fe_copy(x3, x2);
+    fe_copy(y3, y2);
+    fe_copy(z3, kOne);
+    return;
+  }
+
+  fe_sqr(z1z1, z1);
+  fe_mul(u2, x2, z1z1);
+  fe_mul(s2, y2, z1);
+  fe_mul(s2, s2, z1z1);
+  fe_sub(h, u2, x1);
+  fe_sub(r, s2, y1);
+
+  if (fe_is_zero(h)) {
+    if (fe_is_zero(r)) {
+      point_double(x3, y3, z3, x1, y1, z1);
+    } else {
+      fe_copy(x3, kOne);
+      fe_copy(y3, kOne);
+      memset(z3, 0, sizeof(fe));
+    }
+    return;
+  }
+
+  fe_add(r, r, r);
+  fe_sqr(hh, h);
+  fe_add(i, hh, hh);
+  fe_add(i, i, i);
+  fe_mul(j, h, i);
+  fe_mul(v, x1, i);
+
+  /* z3 = (z1 + h)**2 - z1z1 - hh */
+  fe_add(t, z1, h);
+  fe_sqr(t, t);
+  fe_sub(t, t, z1z1);
+  fe_sub(z3, t, hh);
+
+  /* x3 = r**2 - j - 2 * v */
+  fe_sqr(t, r);
+  fe_sub(t, t, j);
+  fe_sub(t, t, v);
+  fe_sub(t, t, v);
+
+  /* y3 = r * (v - x3) - 2 * y1 * j */
+  fe_mul(j, j, y1);
+  fe_add(j, j, j);
+  fe_copy(x3, t);
+  fe_sub(t, v, t);
+  fe_mul(t, r, t);
+  fe_sub(y3, t, j);
+}
+
+/* Fills |table| with the affine multiples d * 16**w * {x,y} for
+ * 1 <= d <= 15, with one inversion per window. */
+static void build_table(const fe x, const fe y,
+                        u64 table[P256_TABLE_WINDOWS][15][8]) {
+  fe px[16], py[16], pz[16], prefix[16];
+  fe base_x, base_y, inv, zinv, zinv2;
+  int w, d;
+
+  fe_copy(base_x, x);
+  fe_copy(base_y, y);
+
+  for (w = 0; w < P256_TABLE_WINDOWS; ++w) {
+    /* The multiples 1 to 16 of the base of the window. The 16th is the base
+     * of the next window. */
+    fe_copy(px[0], base_x);
+    fe_copy(py[0], base_y);
+    fe_copy(pz[0], kOne);
+    for (d = 1; d < 16; ++d) {
+      point_add_mixed(px[d], py[d], pz[d],
+                      px[d - 1], py[d - 1], pz[d - 1],
+                      base_x, base_y);
+    }
+
+    /* Montgomery's trick: invert the product of the z coordinates, then
+     * recover each inverse with two multiplications. None of the multiples
+     * is the point at infinity, since the order of the group is prime. */
+    fe_copy(prefix[0], pz[0]);
+    for (d = 1; d < 16; ++d) {
+      fe_mul(prefix[d], prefix[d - 1], pz[d]);
+    }
+    fe_inv(inv, prefix[15]);
+
+    for (d = 15; d >= 0; --d) {
+      u64* entry = d < 15 ? table[w][d] : NULL;
+
+      if (d > 0) {
+        fe_mul(zinv, inv, prefix[d - 1]);
+        fe_mul(inv, inv, pz[d]);
+      } else {
+        fe_copy(zinv, inv);
+      }
+      fe_sqr(zinv2, zinv);
+
+      if (entry) {
+        fe_mul(entry, px[d], zinv2);
+        fe_mul(zinv2, zinv2, zinv);
+        fe_mul(entry + 4, py[d], zinv2);
+      } else {
+        fe_mul(base_x, px[d], zinv2);
+        fe_mul(zinv2, zinv2, zinv);
+        fe_mul(base_y, py[d], zinv2);
+      }
+    }
+  }
+}
+
+int p256_point_table_init(const p256_int* in_x, const p256_int* in_y,
+                          p256_point_table* table) {
+  fe x, y;
+
+  if (!p256_is_valid_point(in_x, in_y)) return 0;
+
+  fe_mul(x, kGx, kRR);
+  fe_mul(y, kGy, kRR);
+  build_table(x, y, table->base);
+
+  fe_from_p256(x, in_x);
+  fe_from_p256(y, in_y);
+  fe_mul(x, x, kRR);
+  fe_mul(y, y, kRR);
+  build_table(x, y, table->point);
+
+  return 1;
+}
+
+/* Adds the multiples of the windows of |n| to {x,y,z}. */
+static void add_windows(fe x, fe y, fe z, const p256_int* n,
+                        const u64 table[P256_TABLE_WINDOWS][15][8]) {
+  fe scalar;
+  int w;
+
+  fe_from_p256(scalar, n);
+  for (w = 0; w < P256_TABLE_WINDOWS; ++w) {
+    const int d = (int)(scalar[w / 16] >> (4 * (w % 16))) & 15;
+    if (d != 0) {
+      point_add_mixed(x, y, z, x, y, z, table[w][d - 1], table[w][d - 1] + 4);
+    }
+  }
+}
+
+int p256_points_mul_x_equals_vartime(const p256_point_table* table,
+                                     const p256_int* n1, const p256_int* n2,
+                                     const p256_int* r) {
+  fe x, y, z, zz, candidate, t;
+
+  fe_copy(x, kOne);
+  fe_copy(y, kOne);
+  memset(z, 0, sizeof(z));
+  add_windows(x, y, z, n1, table->base);
+  add_windows(x, y, z, n2, table->point);
+
+  if (fe_is_zero(z)) return 0;
+
+  /* The affine x is x/z**2, which is compared with r and, if it is less
+   * than p, with r + n, the other number which is r mod n. This saves
+   * inverting z. */
+  fe_from_p256(candidate, r);
+  if (!sub4(t, candidate, kN)) return 0;
+
+  fe_sqr(zz, z);
+  fe_mul(t, candidate, kRR);
+  fe_mul(t, t, zz);
+  if (fe_equal(t, x)) return 1;
+
+  if (add4(candidate, candidate, kN) || !sub4(t, candidate, kP)) return 0;
+  fe_mul(t, candidate, kRR);
+  fe_mul(t, t, zz);
+  return fe_equal(t, x);
+}
@@ -110,3 +110,23 @@ int p256_ecdsa_verify(const p256_int* key_x, const p256_int* key_y,
   p256_mod(&SECP256r1_n, &u, &u);  // (x coord % p) % n
   return p256_cmp(r, &u) == 0;
 }
+
+int p256_ecdsa_verify_with_table(const p256_point_table* key_table,
+                                 const p256_int* message,
+                                 const p256_int* r, const p256_int* s) {
+  p256_int u, v;
+
+  // The public key was checked when the table was filled.
+
+  // Check r and s are != 0 % n.
+  p256_mod(&SECP256r1_n, r, &u);
+  p256_mod(&SECP256r1_n, s, &v);
+  if (p256_is_zero(&u) || p256_is_zero(&v)) return 0;
+
+  p256_modinv_vartime(&SECP256r1_n, s, &v);
+  p256_modmul(&SECP256r1_n, message, 0, &v, &u);  // message / s % n
+  p256_modmul(&SECP256r1_n, r, 0, &v, &v);  // r / s % n
+
+  // (x coord % p) % n == r
+  return p256_points_mul_x_equals_vartime(key_table, &u, &v, r);
+}
@@ -43,6 +43,13 @@ int p256_ecdsa_verify(const p256_int* key_x,
                       const p256_int* message,
                       const p256_int* r, const p256_int* s);
 
+// Same as p256_ecdsa_verify(), using the table of the public key, which
+// p256_point_table_init() fills. The verification is several times faster,
+// which pays off when a pinned key verifies many signatures.
+int p256_ecdsa_verify_with_table(const p256_point_table* key_table,
+                                 const p256_int* message,
+                                 const p256_int* r, const p256_int* s);
+
 #ifdef __cplusplus
 }
 #endif
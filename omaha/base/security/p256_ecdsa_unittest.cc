@@ -23,6 +23,9 @@
 #include "p256.h"
 #include "p256_ecdsa.h"
 #include "p256_prng.h"
+#include "base/scoped_ptr.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
 #include "omaha/testing/unit_test.h"
 
 
@@ -110,3 +113,128 @@ TEST(P256_ECDSA, InvalidSigsTest) {
   }
 }
 
+// Pick well distributed random number 0 < a < n.
+static void DrawPrivateKey(P256_PRNG_CTX* prng, p256_int* a) {
+  uint8_t tmp[P256_PRNG_SIZE];
+  do {
+    p256_int p1, p2;
+    p256_prng_draw(prng, tmp);
+    p256_from_bin(tmp, &p1);
+    p256_prng_draw(prng, tmp);
+    p256_from_bin(tmp, &p2);
+    p256_modmul(&SECP256r1_n, &p1, 0, &p2, a);
+  } while (p256_is_zero(a));
+}
+
+// The verification with a key table must agree with p256_ecdsa_verify on
+// valid and on tampered signatures.
+TEST(P256_ECDSA, TableVerifyTest) {
+  P256_PRNG_CTX prng;
+  uint8_t tmp[P256_PRNG_SIZE];
+  uint32_t boot_count = static_cast<uint32_t>(time(NULL));
+  scoped_ptr<p256_point_table> table(new p256_point_table);
+
+  p256_prng_init(&prng, "table_verify_test", 17, boot_count);
+
+  for (int n = 0; n < 10; ++n) {
+    p256_int a, Gx, Gy;
+    DrawPrivateKey(&prng, &a);
+    p256_base_point_mul(&a, &Gx, &Gy);
+    ASSERT_TRUE(p256_point_table_init(&Gx, &Gy, table.get()));
+
+    for (int m = 0; m < 10; ++m) {
+      p256_int b, r, s, other;
+      p256_prng_draw(&prng, tmp);
+      p256_from_bin(tmp, &b);
+      p256_ecdsa_sign(&a, &b, &r, &s);
+
+      EXPECT_TRUE(p256_ecdsa_verify_with_table(table.get(), &b, &r, &s));
+
+      // Another message.
+      p256_add_d(&b, 1, &other);
+      EXPECT_EQ(p256_ecdsa_verify(&Gx, &Gy, &other, &r, &s),
+                p256_ecdsa_verify_with_table(table.get(), &other, &r, &s));
+      EXPECT_FALSE(p256_ecdsa_verify_with_table(table.get(), &other, &r, &s));
+
+      // Another r, r + n and r = 0.
+      p256_add_d(&r, 1, &other);
+      EXPECT_FALSE(p256_ecdsa_verify_with_table(table.get(), &b, &other, &s));
+      p256_add(&r, &SECP256r1_n, &other);
+      EXPECT_EQ(p256_ecdsa_verify(&Gx, &Gy, &b, &other, &s),
+                p256_ecdsa_verify_with_table(table.get(), &b, &other, &s));
+      p256_clear(&other);
+      EXPECT_FALSE(p256_ecdsa_verify_with_table(table.get(), &b, &other, &s));
+
+      // Another s, and s = n.
+      p256_add_d(&s, 1, &other);
+      EXPECT_FALSE(p256_ecdsa_verify_with_table(table.get(), &b, &r, &other));
+      EXPECT_FALSE(p256_ecdsa_verify_with_table(table.get(), &b, &r,
+                                                &SECP256r1_n));
+    }
+  }
+
+  // The message is 0, so only the multiple of the key is summed.
+  p256_int one = P256_ONE;
+  p256_int zero = P256_ZERO;
+  p256_int Gx, Gy, r, s;
+  p256_base_point_mul(&one, &Gx, &Gy);
+  ASSERT_TRUE(p256_point_table_init(&Gx, &Gy, table.get()));
+  p256_ecdsa_sign(&one, &zero, &r, &s);
+  EXPECT_TRUE(p256_ecdsa_verify(&Gx, &Gy, &zero, &r, &s));
+  EXPECT_TRUE(p256_ecdsa_verify_with_table(table.get(), &zero, &r, &s));
+
+  // Not a point on the curve.
+  p256_add_d(&Gy, 1, &Gy);
+  EXPECT_FALSE(p256_point_table_init(&Gx, &Gy, table.get()));
+}
+
+TEST(P256_ECDSA, DISABLED_TableVerifyBenchmark) {
+  const int kNumSignatures = 16;
+  const int kNumVerifications = 1000;
+  P256_PRNG_CTX prng;
+  uint8_t tmp[P256_PRNG_SIZE];
+  p256_int a, Gx, Gy;
+  p256_int b[kNumSignatures], r[kNumSignatures], s[kNumSignatures];
+  scoped_ptr<p256_point_table> table(new p256_point_table);
+
+  p256_prng_init(&prng, "table_verify_benchmark", 22, 0);
+  DrawPrivateKey(&prng, &a);
+  p256_base_point_mul(&a, &Gx, &Gy);
+  for (int i = 0; i < kNumSignatures; ++i) {
+    p256_prng_draw(&prng, tmp);
+    p256_from_bin(tmp, &b[i]);
+    p256_ecdsa_sign(&a, &b[i], &r[i], &s[i]);
+  }
+
+  omaha::HighresTimer timer;
+  ASSERT_TRUE(p256_point_table_init(&Gx, &Gy, table.get()));
+  const double init_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                         1000 / omaha::HighresTimer::GetTimerFrequency();
+
+  int old_verified = 0;
+  timer.Start();
+  for (int i = 0; i < kNumVerifications; ++i) {
+    const int j = i % kNumSignatures;
+    old_verified += p256_ecdsa_verify(&Gx, &Gy, &b[j], &r[j], &s[j]);
+  }
+  const double old_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                        1000 / omaha::HighresTimer::GetTimerFrequency();
+
+  int new_verified = 0;
+  timer.Start();
+  for (int i = 0; i < kNumVerifications; ++i) {
+    const int j = i % kNumSignatures;
+    new_verified += p256_ecdsa_verify_with_table(table.get(),
+                                                 &b[j], &r[j], &s[j]);
+  }
+  const double new_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                        1000 / omaha::HighresTimer::GetTimerFrequency();
+
+  EXPECT_EQ(kNumVerifications, old_verified);
+  EXPECT_EQ(kNumVerifications, new_verified);
+  OPT_LOG(omaha::L1, (_T("[p256_ecdsa_verify %f/s][with a table %f/s]")
+                      _T("[filling the table %f ms]"),
+                      kNumVerifications * 1000 / (old_ms + 1e-9),
+                      kNumVerifications * 1000 / (new_ms + 1e-9),
+                      init_ms));
+}
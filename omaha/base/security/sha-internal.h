@@ -0,0 +1,64 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// The compression functions of the SHA backends. Each function hashes
+// |num_blocks| consecutive 64-byte blocks into |state|.
+
+#ifndef OMAHA_BASE_SECURITY_SHA_INTERNAL_H_
+#define OMAHA_BASE_SECURITY_SHA_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha_backend.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define SHA_HAVE_X86_BACKENDS 1
+#else
+#define SHA_HAVE_X86_BACKENDS 0
+#endif
+
+extern const uint32_t SHA256_K[64];
+
+void SHA1_transform_scalar(uint32_t* state,
+                           const uint8_t* data,
+                           size_t num_blocks);
+void SHA256_transform_scalar(uint32_t* state,
+                             const uint8_t* data,
+                             size_t num_blocks);
+
+#if SHA_HAVE_X86_BACKENDS
+void SHA1_transform_sha_ni(uint32_t* state,
+                           const uint8_t* data,
+                           size_t num_blocks);
+void SHA256_transform_sha_ni(uint32_t* state,
+                             const uint8_t* data,
+                             size_t num_blocks);
+
+// Hashes |num_blocks| blocks of eight messages at the same time. The state of
+// the message |i| is states[i], and its blocks start at data[i].
+void SHA256_transform_avx2_x8(uint32_t states[8][8],
+                              const uint8_t* const data[8],
+                              size_t num_blocks);
+#endif  // SHA_HAVE_X86_BACKENDS
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif  // OMAHA_BASE_SECURITY_SHA_INTERNAL_H_
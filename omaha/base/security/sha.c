@@ -13,20 +13,21 @@
 // limitations under the License.
 // ========================================================================
 //
-// Optimized for minimal code size.
+// The portable compression function is optimized for minimal code size. The
+// processors which support them use the faster backends of sha_backend.h.
 
 #include "sha.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include "sha-internal.h"
 
 #define rol(bits, value) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
-static void SHA1_Transform(SHA_CTX* ctx) {
+static void SHA1_Transform(uint32_t* state, const uint8_t* p) {
   uint32_t W[80];
   uint32_t A, B, C, D, E;
-  uint8_t* p = ctx->buf;
   int t;
 
   for(t = 0; t < 16; ++t) {
@@ -41,11 +42,11 @@ static void SHA1_Transform(SHA_CTX* ctx) {
     W[t] = rol(1,W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]);
   }
 
-  A = ctx->state[0];
-  B = ctx->state[1];
-  C = ctx->state[2];
-  D = ctx->state[3];
-  E = ctx->state[4];
+  A = state[0];
+  B = state[1];
+  C = state[2];
+  D = state[3];
+  E = state[4];
 
   for(t = 0; t < 80; t++) {
     uint32_t tmp = rol(5,A) + E + W[t];
@@ -66,11 +67,32 @@ static void SHA1_Transform(SHA_CTX* ctx) {
     A = tmp;
   }
 
-  ctx->state[0] += A;
-  ctx->state[1] += B;
-  ctx->state[2] += C;
-  ctx->state[3] += D;
-  ctx->state[4] += E;
+  state[0] += A;
+  state[1] += B;
+  state[2] += C;
+  state[3] += D;
+  state[4] += E;
+}
+
+void SHA1_transform_scalar(uint32_t* state,
+                           const uint8_t* data,
+                           size_t num_blocks) {
+  for (; num_blocks; --num_blocks, data += 64) {
+    SHA1_Transform(state, data);
+  }
+}
+
+// Hashes |num_blocks| blocks with the backend in use.
+static void SHA1_Transform_blocks(uint32_t* state,
+                                  const uint8_t* data,
+                                  size_t num_blocks) {
+#if SHA_HAVE_X86_BACKENDS
+  if (SHA_get_backend() == SHA_BACKEND_SHA_NI) {
+    SHA1_transform_sha_ni(state, data, num_blocks);
+    return;
+  }
+#endif
+  SHA1_transform_scalar(state, data, num_blocks);
 }
 
 static const HASH_VTAB SHA_VTAB = {
@@ -98,13 +120,27 @@ void SHA_update(SHA_CTX* ctx, const void* data, unsigned int len) {
 
   ctx->count += len;
 
-  while (len--) {
-    ctx->buf[i++] = *p++;
-    if (i == 64) {
-      SHA1_Transform(ctx);
-      i = 0;
+  // Completes the buffered block first. The whole blocks which follow are
+  // hashed in place, without copying them.
+  if (i) {
+    const unsigned int fill = 64 - i;
+    if (len < fill) {
+      memcpy(ctx->buf + i, p, len);
+      return;
     }
+    memcpy(ctx->buf + i, p, fill);
+    SHA1_Transform_blocks(ctx->state, ctx->buf, 1);
+    p += fill;
+    len -= fill;
+  }
+
+  if (len >= 64) {
+    SHA1_Transform_blocks(ctx->state, p, len / 64);
+    p += len & ~63u;
+    len &= 63;
   }
+
+  memcpy(ctx->buf, p, len);
 }
 
 
@@ -113,14 +149,14 @@ const uint8_t* SHA_final(SHA_CTX* ctx) {
   uint64_t cnt = ctx->count * 8;
   int i;
 
-  SHA_update(ctx, (uint8_t*)"\x80", 1);
-  while ((ctx->count & 63) != 56) {
-    SHA_update(ctx, (uint8_t*)"\0", 1);
-  }
+  // The padding and the length are hashed in a single update.
+  uint8_t pad[72] = {0x80};
+  const unsigned int used = (unsigned int)(ctx->count & 63);
+  const unsigned int pad_len = (used < 56 ? 56 : 120) - used;
   for (i = 0; i < 8; ++i) {
-    uint8_t tmp = (uint8_t) (cnt >> ((7 - i) * 8));
-    SHA_update(ctx, &tmp, 1);
+    pad[pad_len + i] = (uint8_t) (cnt >> ((7 - i) * 8));
   }
+  SHA_update(ctx, pad, pad_len + 8);
 
   for (i = 0; i < 5; i++) {
     uint32_t tmp = ctx->state[i];
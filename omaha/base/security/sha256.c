@@ -13,17 +13,19 @@
 // limitations under the License.
 // ========================================================================
 //
-// Optimized for minimal code size.
+// The portable compression function is optimized for minimal code size. The
+// processors which support them use the faster backends of sha_backend.h.
 
 #include "sha256.h"
 
 #include <stdio.h>
 #include <string.h>
+#include "sha-internal.h"
 
 #define ror(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
 #define shr(value, bits) ((value) >> (bits))
 
-static const uint32_t K[64] = {
+const uint32_t SHA256_K[64] = {
   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
   0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -41,10 +43,9 @@ static const uint32_t K[64] = {
   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
 
-static void SHA256_Transform(LITE_SHA256_CTX* ctx) {
+static void SHA256_Transform(uint32_t* state, const uint8_t* p) {
   uint32_t W[64];
   uint32_t A, B, C, D, E, F, G, H;
-  uint8_t* p = ctx->buf;
   int t;
 
   for(t = 0; t < 16; ++t) {
@@ -61,14 +62,14 @@ static void SHA256_Transform(LITE_SHA256_CTX* ctx) {
     W[t] = W[t-16] + s0 + W[t-7] + s1;
   }
 
-  A = ctx->state[0];
-  B = ctx->state[1];
-  C = ctx->state[2];
-  D = ctx->state[3];
-  E = ctx->state[4];
-  F = ctx->state[5];
-  G = ctx->state[6];
-  H = ctx->state[7];
+  A = state[0];
+  B = state[1];
+  C = state[2];
+  D = state[3];
+  E = state[4];
+  F = state[5];
+  G = state[6];
+  H = state[7];
 
   for(t = 0; t < 64; t++) {
     uint32_t s0 = ror(A, 2) ^ ror(A, 13) ^ ror(A, 22);
@@ -76,7 +77,7 @@ static void SHA256_Transform(LITE_SHA256_CTX* ctx) {
     uint32_t t2 = s0 + maj;
     uint32_t s1 = ror(E, 6) ^ ror(E, 11) ^ ror(E, 25);
     uint32_t ch = (E & F) ^ ((~E) & G);
-    uint32_t t1 = H + s1 + ch + K[t] + W[t];
+    uint32_t t1 = H + s1 + ch + SHA256_K[t] + W[t];
 
     H = G;
     G = F;
@@ -88,14 +89,35 @@ static void SHA256_Transform(LITE_SHA256_CTX* ctx) {
     A = t1 + t2;
   }
 
-  ctx->state[0] += A;
-  ctx->state[1] += B;
-  ctx->state[2] += C;
-  ctx->state[3] += D;
-  ctx->state[4] += E;
-  ctx->state[5] += F;
-  ctx->state[6] += G;
-  ctx->state[7] += H;
+  state[0] += A;
+  state[1] += B;
+  state[2] += C;
+  state[3] += D;
+  state[4] += E;
+  state[5] += F;
+  state[6] += G;
+  state[7] += H;
+}
+
+void SHA256_transform_scalar(uint32_t* state,
+                             const uint8_t* data,
+                             size_t num_blocks) {
+  for (; num_blocks; --num_blocks, data += 64) {
+    SHA256_Transform(state, data);
+  }
+}
+
+// Hashes |num_blocks| blocks with the backend in use.
+static void SHA256_Transform_blocks(uint32_t* state,
+                                    const uint8_t* data,
+                                    size_t num_blocks) {
+#if SHA_HAVE_X86_BACKENDS
+  if (SHA_get_backend() == SHA_BACKEND_SHA_NI) {
+    SHA256_transform_sha_ni(state, data, num_blocks);
+    return;
+  }
+#endif
+  SHA256_transform_scalar(state, data, num_blocks);
 }
 
 static const HASH_VTAB SHA256_VTAB = {
@@ -121,18 +143,32 @@ void SHA256_init(LITE_SHA256_CTX* ctx) {
 
 
 void SHA256_update(LITE_SHA256_CTX* ctx, const void* data, unsigned int len) {
-  int i = (int) (ctx->count & 63);
+  unsigned int i = (unsigned int)(ctx->count & 63);
   const uint8_t* p = (const uint8_t*)data;
 
   ctx->count += len;
 
-  while (len--) {
-    ctx->buf[i++] = *p++;
-    if (i == 64) {
-      SHA256_Transform(ctx);
-      i = 0;
+  // Completes the buffered block first. The whole blocks which follow are
+  // hashed in place, without copying them.
+  if (i) {
+    const unsigned int fill = 64 - i;
+    if (len < fill) {
+      memcpy(ctx->buf + i, p, len);
+      return;
     }
+    memcpy(ctx->buf + i, p, fill);
+    SHA256_Transform_blocks(ctx->state, ctx->buf, 1);
+    p += fill;
+    len -= fill;
+  }
+
+  if (len >= 64) {
+    SHA256_Transform_blocks(ctx->state, p, len / 64);
+    p += len & ~63u;
+    len &= 63;
   }
+
+  memcpy(ctx->buf, p, len);
 }
 
 
@@ -141,14 +177,14 @@ const uint8_t* SHA256_final(LITE_SHA256_CTX* ctx) {
   uint64_t cnt = ctx->count * 8;
   int i;
 
-  SHA256_update(ctx, (uint8_t*)"\x80", 1);
-  while ((ctx->count & 63) != 56) {
-    SHA256_update(ctx, (uint8_t*)"\0", 1);
-  }
+  // The padding and the length are hashed in a single update.
+  uint8_t pad[72] = {0x80};
+  const unsigned int used = (unsigned int)(ctx->count & 63);
+  const unsigned int pad_len = (used < 56 ? 56 : 120) - used;
   for (i = 0; i < 8; ++i) {
-    uint8_t tmp = (uint8_t) (cnt >> ((7 - i) * 8));
-    SHA256_update(ctx, &tmp, 1);
+    pad[pad_len + i] = (uint8_t) (cnt >> ((7 - i) * 8));
   }
+  SHA256_update(ctx, pad, pad_len + 8);
 
   for (i = 0; i < 8; i++) {
     uint32_t tmp = ctx->state[i];
@@ -170,3 +206,55 @@ const uint8_t* SHA256_hash(const void* data, unsigned int len,
   memcpy(digest, SHA256_final(&ctx), SHA256_DIGEST_SIZE);
   return digest;
 }
+
+void SHA256_hash_many(const void* const* data,
+                      const unsigned int* len,
+                      unsigned int count,
+                      uint8_t* digests) {
+  unsigned int first = 0;
+
+#if SHA_HAVE_X86_BACKENDS
+  // The whole blocks which all the messages of a group have are hashed eight
+  // messages at a time. Each message is then finished on its own.
+  if (SHA_get_backend() == SHA_BACKEND_AVX2) {
+    for (; count - first >= 8; first += 8) {
+      uint32_t states[8][8];
+      const uint8_t* lanes[8];
+      size_t num_blocks = len[first] / 64;
+      int i;
+
+      for (i = 0; i < 8; ++i) {
+        LITE_SHA256_CTX ctx;
+        SHA256_init(&ctx);
+        memcpy(states[i], ctx.state, sizeof(states[i]));
+        lanes[i] = (const uint8_t*)data[first + i];
+        if (len[first + i] / 64 < num_blocks) {
+          num_blocks = len[first + i] / 64;
+        }
+      }
+
+      if (num_blocks) {
+        SHA256_transform_avx2_x8(states, lanes, num_blocks);
+      }
+
+      for (i = 0; i < 8; ++i) {
+        LITE_SHA256_CTX ctx;
+        const size_t hashed = num_blocks * 64;
+        SHA256_init(&ctx);
+        memcpy(ctx.state, states[i], sizeof(states[i]));
+        ctx.count = hashed;
+        SHA256_update(&ctx, lanes[i] + hashed,
+                      (unsigned int)(len[first + i] - hashed));
+        memcpy(digests + (first + i) * SHA256_DIGEST_SIZE,
+               SHA256_final(&ctx),
+               SHA256_DIGEST_SIZE);
+      }
+    }
+  }
+#endif
+
+  for (; first != count; ++first) {
+    SHA256_hash(data[first], len[first],
+                digests + first * SHA256_DIGEST_SIZE);
+  }
+}
@@ -32,6 +32,14 @@ const uint8_t* SHA256_final(LITE_SHA256_CTX* ctx);
 // Convenience method. Returns digest address.
 const uint8_t* SHA256_hash(const void* data, unsigned int len, uint8_t* digest);
 
+// Hashes the |count| messages data[i] of len[i] bytes. The digest of the
+// message i is written at digests + i * SHA256_DIGEST_SIZE. The AVX2 backend
+// hashes eight messages at a time.
+void SHA256_hash_many(const void* const* data,
+                      const unsigned int* len,
+                      unsigned int count,
+                      uint8_t* digests);
+
 #define SHA256_DIGEST_SIZE 32
 
 #ifdef __cplusplus
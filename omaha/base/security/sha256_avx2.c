@@ -0,0 +1,127 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// SHA-256 of eight messages at the same time, one message in each 32-bit lane
+// of the AVX2 registers. A single message does not benefit from it, since the
+// rounds of SHA-256 depend on each other.
+
+#include "sha-internal.h"
+
+#if SHA_HAVE_X86_BACKENDS
+
+#include <immintrin.h>
+
+#define vror(value, bits) \
+    _mm256_or_si256(_mm256_srli_epi32((value), (bits)), \
+                    _mm256_slli_epi32((value), 32 - (bits)))
+#define vshr(value, bits) _mm256_srli_epi32((value), (bits))
+#define vadd(a, b) _mm256_add_epi32((a), (b))
+#define vxor(a, b) _mm256_xor_si256((a), (b))
+#define vand(a, b) _mm256_and_si256((a), (b))
+
+static uint32_t load_be32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// Loads the big-endian word at |offset| of each message.
+static __m256i load_words(const uint8_t* const data[8], size_t offset) {
+  return _mm256_set_epi32(load_be32(data[7] + offset),
+                          load_be32(data[6] + offset),
+                          load_be32(data[5] + offset),
+                          load_be32(data[4] + offset),
+                          load_be32(data[3] + offset),
+                          load_be32(data[2] + offset),
+                          load_be32(data[1] + offset),
+                          load_be32(data[0] + offset));
+}
+
+void SHA256_transform_avx2_x8(uint32_t states[8][8],
+                              const uint8_t* const data[8],
+                              size_t num_blocks) {
+  __m256i S[8];
+  __m256i W[64];
+  uint32_t lanes[8];
+  size_t block;
+  int i;
+  int t;
+
+  for (i = 0; i < 8; ++i) {
+    S[i] = _mm256_set_epi32(states[7][i], states[6][i], states[5][i],
+                            states[4][i], states[3][i], states[2][i],
+                            states[1][i], states[0][i]);
+  }
+
+  for (block = 0; block != num_blocks; ++block) {
+    __m256i A = S[0];
+    __m256i B = S[1];
+    __m256i C = S[2];
+    __m256i D = S[3];
+    __m256i E = S[4];
+    __m256i F = S[5];
+    __m256i G = S[6];
+    __m256i H = S[7];
+
+    for (t = 0; t < 16; ++t) {
+      W[t] = load_words(data, block * 64 + t * 4);
+    }
+
+    for (; t < 64; ++t) {
+      __m256i s0 = vxor(vxor(vror(W[t-15], 7), vror(W[t-15], 18)),
+                        vshr(W[t-15], 3));
+      __m256i s1 = vxor(vxor(vror(W[t-2], 17), vror(W[t-2], 19)),
+                        vshr(W[t-2], 10));
+      W[t] = vadd(vadd(W[t-16], s0), vadd(W[t-7], s1));
+    }
+
+    for (t = 0; t < 64; ++t) {
+      __m256i s0 = vxor(vxor(vror(A, 2), vror(A, 13)), vror(A, 22));
+      __m256i maj = vxor(vxor(vand(A, B), vand(A, C)), vand(B, C));
+      __m256i t2 = vadd(s0, maj);
+      __m256i s1 = vxor(vxor(vror(E, 6), vror(E, 11)), vror(E, 25));
+      __m256i ch = vxor(vand(E, F), _mm256_andnot_si256(E, G));
+      __m256i t1 = vadd(vadd(H, s1),
+                        vadd(ch, vadd(_mm256_set1_epi32(SHA256_K[t]), W[t])));
+
+      H = G;
+      G = F;
+      F = E;
+      E = vadd(D, t1);
+      D = C;
+      C = B;
+      B = A;
+      A = vadd(t1, t2);
+    }
+
+    S[0] = vadd(S[0], A);
+    S[1] = vadd(S[1], B);
+    S[2] = vadd(S[2], C);
+    S[3] = vadd(S[3], D);
+    S[4] = vadd(S[4], E);
+    S[5] = vadd(S[5], F);
+    S[6] = vadd(S[6], G);
+    S[7] = vadd(S[7], H);
+  }
+
+  for (i = 0; i < 8; ++i) {
+    int lane;
+    _mm256_storeu_si256((__m256i*)lanes, S[i]);
+    for (lane = 0; lane < 8; ++lane) {
+      states[lane][i] = lanes[lane];
+    }
+  }
+}
+
+#endif  // SHA_HAVE_X86_BACKENDS
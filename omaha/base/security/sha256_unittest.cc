@@ -14,8 +14,12 @@
 // ========================================================================
 
 #include "omaha/base/security/sha256.h"
+#include <algorithm>
 #include <cstring>
 #include <vector>
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/security/sha_backend.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
@@ -42,7 +46,53 @@ struct {
     0xfb, 0x6c
 };
 
-TEST(Security, Sha256) {
+// Runs the tests with each backend which the processor supports.
+class Sha256Test : public testing::TestWithParam<SHA_BACKEND> {
+ protected:
+  virtual void SetUp() {
+    is_supported_ = SHA_set_backend(GetParam()) != 0;
+    if (!is_supported_) {
+      OPT_LOG(L2, (_T("[backend %d is not supported]"), GetParam()));
+    }
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(SHA_set_backend(SHA_BACKEND_DEFAULT));
+  }
+
+  // Returns the digest of |data| computed by the portable implementation.
+  static std::vector<uint8_t> ScalarHash(const std::vector<uint8_t>& data) {
+    const SHA_BACKEND backend = SHA_get_backend();
+    EXPECT_TRUE(SHA_set_backend(SHA_BACKEND_SCALAR));
+    std::vector<uint8_t> digest(SHA256_DIGEST_SIZE);
+    SHA256_hash(data.empty() ? NULL : &data[0],
+                static_cast<unsigned int>(data.size()),
+                &digest[0]);
+    EXPECT_TRUE(SHA_set_backend(backend));
+    return digest;
+  }
+
+  static std::vector<uint8_t> MakeData(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i != size; ++i) {
+      data[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+    }
+    return data;
+  }
+
+  bool is_supported_;
+};
+
+INSTANTIATE_TEST_CASE_P(Backends, Sha256Test,
+                        ::testing::Values(SHA_BACKEND_SCALAR,
+                                          SHA_BACKEND_SHA_NI,
+                                          SHA_BACKEND_AVX2));
+
+TEST_P(Sha256Test, Sha256) {
+  if (!is_supported_) {
+    return;
+  }
+
   const size_t kDigestSize = SHA256_DIGEST_SIZE;
 
   for (size_t i = 0; i != arraysize(test_hash256); ++i) {
@@ -66,5 +116,109 @@ TEST(Security, Sha256) {
   }
 }
 
+// The digest does not depend on how the message is split between the calls
+// to SHA256_update, including across the 64-byte blocks.
+TEST_P(Sha256Test, Update) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const std::vector<uint8_t> data(MakeData(1000));
+  const std::vector<uint8_t> expected(ScalarHash(data));
+
+  const size_t kChunkSizes[] = {1, 3, 63, 64, 65, 128, 200, 1000};
+  for (size_t i = 0; i != arraysize(kChunkSizes); ++i) {
+    LITE_SHA256_CTX context = {0};
+    SHA256_init(&context);
+    for (size_t offset = 0; offset < data.size(); offset += kChunkSizes[i]) {
+      const size_t size = std::min(kChunkSizes[i], data.size() - offset);
+      SHA256_update(&context, &data[offset], static_cast<unsigned int>(size));
+    }
+    EXPECT_EQ(0, memcmp(SHA256_final(&context), &expected[0],
+                        SHA256_DIGEST_SIZE));
+  }
+}
+
+TEST_P(Sha256Test, HashMany) {
+  if (!is_supported_) {
+    return;
+  }
+
+  // More than eight messages, with different lengths, some of them shorter
+  // than a block.
+  const size_t kNumMessages = 19;
+  std::vector<std::vector<uint8_t> > messages;
+  std::vector<const void*> data;
+  std::vector<unsigned int> len;
+  for (size_t i = 0; i != kNumMessages; ++i) {
+    messages.push_back(MakeData(i * 97 + (i % 3 ? 128 : 5)));
+  }
+  for (size_t i = 0; i != kNumMessages; ++i) {
+    data.push_back(&messages[i][0]);
+    len.push_back(static_cast<unsigned int>(messages[i].size()));
+  }
+
+  std::vector<uint8_t> digests(kNumMessages * SHA256_DIGEST_SIZE);
+  SHA256_hash_many(&data[0], &len[0], kNumMessages, &digests[0]);
+
+  for (size_t i = 0; i != kNumMessages; ++i) {
+    EXPECT_EQ(0, memcmp(&digests[i * SHA256_DIGEST_SIZE],
+                        &ScalarHash(messages[i])[0],
+                        SHA256_DIGEST_SIZE));
+  }
+}
+
+// Prints the throughput of SHA256_hash and SHA256_hash_many.
+TEST_P(Sha256Test, DISABLED_Benchmark) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const size_t kTotalSize = 16 * 1024 * 1024;
+  const size_t kBufferSizes[] = {64, 1024, 64 * 1024, 8 * 1024 * 1024};
+  const TCHAR* const kBackendNames[] = {_T(""), _T("scalar"), _T("SHA-NI"),
+                                        _T("AVX2")};
+  const std::vector<uint8_t> buffer(MakeData(kBufferSizes[3]));
+  uint8_t digests[8 * SHA256_DIGEST_SIZE] = {0};
+
+  for (size_t i = 0; i != arraysize(kBufferSizes); ++i) {
+    const size_t size = kBufferSizes[i];
+    const size_t num_iterations = kTotalSize / size;
+
+    HighresTimer timer;
+    for (size_t j = 0; j != num_iterations; ++j) {
+      SHA256_hash(&buffer[0], static_cast<unsigned int>(size), digests);
+    }
+    const double single_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                             1000 / HighresTimer::GetTimerFrequency();
+
+    // Hashes eight messages per call, for about the same number of bytes.
+    const void* data[8] = {0};
+    unsigned int len[8] = {0};
+    for (size_t j = 0; j != arraysize(data); ++j) {
+      data[j] = &buffer[0];
+      len[j] = static_cast<unsigned int>(size);
+    }
+    const size_t num_calls =
+        std::max<size_t>(1, num_iterations / arraysize(data));
+    timer.Start();
+    for (size_t j = 0; j != num_calls; ++j) {
+      SHA256_hash_many(data, len, arraysize(data), digests);
+    }
+    const double many_ms = static_cast<double>(timer.GetElapsedTicks()) *
+                           1000 / HighresTimer::GetTimerFrequency();
+
+    const double single_mb =
+        static_cast<double>(num_iterations * size) / (1024 * 1024);
+    const double many_mb =
+        static_cast<double>(num_calls * arraysize(data) * size) /
+        (1024 * 1024);
+    OPT_LOG(L1, (_T("[%s][buffers of %d bytes][%f MB/s][%f MB/s eight at a ")
+                 _T("time]"),
+                 kBackendNames[GetParam()], static_cast<int>(size),
+                 single_mb * 1000 / single_ms, many_mb * 1000 / many_ms));
+  }
+}
+
 }  // namespace omaha
 
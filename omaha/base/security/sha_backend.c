@@ -0,0 +1,121 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "sha_backend.h"
+#include "sha-internal.h"
+
+#if SHA_HAVE_X86_BACKENDS
+#include <intrin.h>
+#endif
+
+// The backend is selected when it is first needed. Threads which select it at
+// the same time select the same backend.
+static volatile SHA_BACKEND g_backend = SHA_BACKEND_DEFAULT;
+
+#if SHA_HAVE_X86_BACKENDS
+
+// CPUID.1:ECX
+#define CPUID_SSSE3    (1 << 9)
+#define CPUID_SSE41    (1 << 19)
+#define CPUID_OSXSAVE  (1 << 27)
+#define CPUID_AVX      (1 << 28)
+
+// CPUID.7.0:EBX
+#define CPUID_AVX2     (1 << 5)
+#define CPUID_SHA      (1 << 29)
+
+// XCR0: the operating system saves the XMM and the YMM registers.
+#define XCR0_SSE_AVX   0x6
+
+static int is_sha_ni_supported(void) {
+  int regs[4] = {0};
+  __cpuid(regs, 0);
+  if (regs[0] < 7) {
+    return 0;
+  }
+
+  __cpuid(regs, 1);
+  if ((regs[2] & (CPUID_SSSE3 | CPUID_SSE41)) != (CPUID_SSSE3 | CPUID_SSE41)) {
+    return 0;
+  }
+
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & CPUID_SHA) != 0;
+}
+
+static int is_avx2_supported(void) {
+  int regs[4] = {0};
+  __cpuid(regs, 0);
+  if (regs[0] < 7) {
+    return 0;
+  }
+
+  // AVX is unusable unless the operating system saves the YMM registers on
+  // context switches, which Windows does since Windows 7 SP1.
+  __cpuid(regs, 1);
+  if ((regs[2] & (CPUID_OSXSAVE | CPUID_AVX)) != (CPUID_OSXSAVE | CPUID_AVX)) {
+    return 0;
+  }
+  if ((_xgetbv(0) & XCR0_SSE_AVX) != XCR0_SSE_AVX) {
+    return 0;
+  }
+
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & CPUID_AVX2) != 0;
+}
+
+#endif  // SHA_HAVE_X86_BACKENDS
+
+int SHA_is_backend_supported(SHA_BACKEND backend) {
+  switch (backend) {
+    case SHA_BACKEND_DEFAULT:
+    case SHA_BACKEND_SCALAR:
+      return 1;
+#if SHA_HAVE_X86_BACKENDS
+    case SHA_BACKEND_SHA_NI:
+      return is_sha_ni_supported();
+    case SHA_BACKEND_AVX2:
+      return is_avx2_supported();
+#endif
+    default:
+      return 0;
+  }
+}
+
+int SHA_set_backend(SHA_BACKEND backend) {
+  if (!SHA_is_backend_supported(backend)) {
+    return 0;
+  }
+  g_backend = backend;
+  return 1;
+}
+
+SHA_BACKEND SHA_get_backend(void) {
+  SHA_BACKEND backend = g_backend;
+  if (backend != SHA_BACKEND_DEFAULT) {
+    return backend;
+  }
+
+  // The SHA extensions hash a single message faster than AVX2 hashes eight.
+  if (SHA_is_backend_supported(SHA_BACKEND_SHA_NI)) {
+    backend = SHA_BACKEND_SHA_NI;
+  } else if (SHA_is_backend_supported(SHA_BACKEND_AVX2)) {
+    backend = SHA_BACKEND_AVX2;
+  } else {
+    backend = SHA_BACKEND_SCALAR;
+  }
+  g_backend = backend;
+  return backend;
+}
@@ -0,0 +1,56 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Selects the implementation of the SHA-1 and SHA-256 compression functions.
+// By default, the fastest implementation which the processor supports is
+// used. The portable implementation is used on other architectures.
+
+#ifndef OMAHA_BASE_SECURITY_SHA_BACKEND_H_
+#define OMAHA_BASE_SECURITY_SHA_BACKEND_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+typedef enum SHA_BACKEND {
+  SHA_BACKEND_DEFAULT = 0,
+
+  // The portable implementation.
+  SHA_BACKEND_SCALAR,
+
+  // The SHA extensions of the x86 processors.
+  SHA_BACKEND_SHA_NI,
+
+  // The portable implementation for a single message. SHA256_hash_many
+  // hashes eight messages at a time with AVX2.
+  SHA_BACKEND_AVX2,
+} SHA_BACKEND;
+
+// Returns 1 if the processor and the operating system support |backend|.
+int SHA_is_backend_supported(SHA_BACKEND backend);
+
+// Selects the backend used by the process, for tests and benchmarks.
+// SHA_BACKEND_DEFAULT restores the default backend. Returns 0 and leaves the
+// backend unchanged if |backend| is not supported.
+int SHA_set_backend(SHA_BACKEND backend);
+
+// Returns the backend in use, which is never SHA_BACKEND_DEFAULT.
+SHA_BACKEND SHA_get_backend(void);
+
+#ifdef __cplusplus
+}
+#endif  // __cplusplus
+
+#endif  // OMAHA_BASE_SECURITY_SHA_BACKEND_H_
@@ -0,0 +1,103 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/security/sha.h"
+#include <cstring>
+#include <string>
+#include "omaha/base/logging.h"
+#include "omaha/base/security/sha_backend.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+// Test vectors from FIPS 180-2 and http://en.wikipedia.org/wiki/SHA-1.
+struct {
+  const char* binary;
+  uint8_t hash[SHA_DIGEST_SIZE];
+} test_hash1[] = {
+  { "",
+    { 0xda, 0x39, 0xa3, 0xee, 0x5e, 0x6b, 0x4b, 0x0d, 0x32, 0x55,
+      0xbf, 0xef, 0x95, 0x60, 0x18, 0x90, 0xaf, 0xd8, 0x07, 0x09 } },
+  { "abc",
+    { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+      0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d } },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    { 0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+      0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1 } },
+  { "The quick brown fox jumps over the lazy dog",
+    { 0x2f, 0xd4, 0xe1, 0xc6, 0x7a, 0x2d, 0x28, 0xfc, 0xed, 0x84,
+      0x9e, 0xe1, 0xbb, 0x76, 0xe7, 0x39, 0x1b, 0x93, 0xeb, 0x12 } },
+};
+
+// Runs the tests with each backend which the processor supports.
+class ShaTest : public testing::TestWithParam<SHA_BACKEND> {
+ protected:
+  virtual void SetUp() {
+    is_supported_ = SHA_set_backend(GetParam()) != 0;
+    if (!is_supported_) {
+      OPT_LOG(L2, (_T("[backend %d is not supported]"), GetParam()));
+    }
+  }
+
+  virtual void TearDown() {
+    EXPECT_TRUE(SHA_set_backend(SHA_BACKEND_DEFAULT));
+  }
+
+  bool is_supported_;
+};
+
+INSTANTIATE_TEST_CASE_P(Backends, ShaTest,
+                        ::testing::Values(SHA_BACKEND_SCALAR,
+                                          SHA_BACKEND_SHA_NI,
+                                          SHA_BACKEND_AVX2));
+
+TEST_P(ShaTest, Sha1) {
+  if (!is_supported_) {
+    return;
+  }
+
+  for (size_t i = 0; i != arraysize(test_hash1); ++i) {
+    uint8_t hash[SHA_DIGEST_SIZE] = {0};
+    const unsigned int len =
+        static_cast<unsigned int>(strlen(test_hash1[i].binary));
+    EXPECT_EQ(hash, SHA_hash(test_hash1[i].binary, len, hash));
+    EXPECT_EQ(0, memcmp(hash, test_hash1[i].hash, SHA_DIGEST_SIZE));
+  }
+}
+
+// One million times 'a', hashed in chunks which are not aligned with the
+// 64-byte blocks.
+TEST_P(ShaTest, Sha1_MillionA) {
+  if (!is_supported_) {
+    return;
+  }
+
+  const uint8_t kExpected[SHA_DIGEST_SIZE] = {
+    0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e,
+    0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f
+  };
+  const std::string chunk(1000, 'a');
+
+  SHA_CTX context = {0};
+  SHA_init(&context);
+  SHA_update(&context, chunk.data(), 1);
+  for (int i = 0; i != 999; ++i) {
+    SHA_update(&context, chunk.data(), 1000);
+  }
+  SHA_update(&context, chunk.data(), 999);
+  EXPECT_EQ(0, memcmp(SHA_final(&context), kExpected, SHA_DIGEST_SIZE));
+}
+
+}  // namespace omaha
@@ -36,6 +36,7 @@
 #include "omaha/base/security/sha256.h"
 #include "omaha/base/security/sha.h"
 #include "omaha/base/string.h"
+#include "omaha/base/thread.h"
 #include "omaha/base/utils.h"
 
 namespace omaha {
@@ -52,6 +53,15 @@ const size_t kMaxFileSizeForAuthentication = 512 * 1024 * 1024;  // 512MB
 // Buffer size used to read files from disk.
 const size_t kFileReadBufferSize = 128 * 1024;
 
+// VerifyFileHashes reads the files up to this size whole, and computes their
+// SHA256 hashes up to kMaxFilesPerHashBatch files at a time.
+const size_t kMaxFileSizeForHashBatch = 1024 * 1024;
+const size_t kMaxFilesPerHashBatch = 8;
+
+// VerifyFileHashes reads the larger files in chunks of this size, reading the
+// next chunk while the current one is hashed.
+const size_t kHashChunkSize = 1024 * 1024;
+
 namespace CryptDetails {
 
 void crypt_release_context(HCRYPTPROV provider) {
@@ -1197,4 +1207,337 @@ HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
   return crypto.Validate(files, kMaxFileSizeForAuthentication, hash_vector);
 }
 
+namespace {
+
+// Starts reading the chunk of the file at |offset|. Returns S_FALSE if the
+// offset is at the end of the file.
+HRESULT BeginReadChunk(HANDLE file,
+                       uint64 offset,
+                       std::vector<byte>* buffer,
+                       OVERLAPPED* overlapped) {
+  ASSERT1(!buffer->empty());
+  ASSERT1(overlapped->hEvent);
+
+  overlapped->Offset = static_cast<DWORD>(offset);
+  overlapped->OffsetHigh = static_cast<DWORD>(offset >> 32);
+  if (::ReadFile(file,
+                 &buffer->front(),
+                 static_cast<DWORD>(buffer->size()),
+                 NULL,
+                 overlapped)) {
+    return S_OK;
+  }
+
+  const DWORD error = ::GetLastError();
+  if (error == ERROR_IO_PENDING) {
+    return S_OK;
+  }
+  return error == ERROR_HANDLE_EOF ? S_FALSE : HRESULT_FROM_WIN32(error);
+}
+
+// Computes the hash of a file while reading it, so that reading the next chunk
+// of the file overlaps with hashing the current one.
+HRESULT ComputeFileHashReadAhead(const CString& filename,
+                                 bool use_sha256,
+                                 std::vector<byte>* hash_out) {
+  ASSERT1(hash_out);
+
+  scoped_hfile file(::CreateFile(filename,
+                                 FILE_READ_DATA,
+                                 FILE_SHARE_READ,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 FILE_FLAG_OVERLAPPED |
+                                     FILE_FLAG_SEQUENTIAL_SCAN,
+                                 NULL));
+  if (!file) {
+    return HRESULTFromLastError();
+  }
+
+  scoped_event read_event(::CreateEvent(NULL, true, false, NULL));
+  if (!read_event) {
+    return HRESULTFromLastError();
+  }
+
+  scoped_ptr<CryptDetails::HashInterface> hasher(
+      CryptDetails::CreateHasher(use_sha256));
+
+  std::vector<byte> buffers[2];
+  buffers[0].resize(kHashChunkSize);
+  buffers[1].resize(kHashChunkSize);
+  COMPILE_ASSERT(kHashChunkSize <= INT_MAX, chunk_size_too_large);
+
+  OVERLAPPED overlapped = {0};
+  overlapped.hEvent = get(read_event);
+
+  uint64 offset = 0;
+  int current = 0;
+  HRESULT hr = BeginReadChunk(get(file), offset, &buffers[current],
+                              &overlapped);
+  while (hr == S_OK) {
+    DWORD bytes_read = 0;
+    if (!::GetOverlappedResult(get(file), &overlapped, &bytes_read, true)) {
+      const DWORD error = ::GetLastError();
+      if (error != ERROR_HANDLE_EOF) {
+        return HRESULT_FROM_WIN32(error);
+      }
+      bytes_read = 0;
+    }
+    if (!bytes_read) {
+      break;
+    }
+
+    // A short read is the last chunk of the file, so no read follows it.
+    const int filled = current;
+    current = 1 - current;
+    offset += bytes_read;
+    hr = bytes_read < kHashChunkSize ?
+         S_FALSE :
+         BeginReadChunk(get(file), offset, &buffers[current], &overlapped);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    hasher->update(&buffers[filled].front(), bytes_read);
+  }
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  const uint8* hash = hasher->final();
+  hash_out->assign(hash, hash + hasher->hash_size());
+  return S_OK;
+}
+
+// Decodes the expected hash of a file for VerifyFileHashes.
+HRESULT DecodeExpectedHash(const FileHashVerification& file,
+                           std::vector<byte>* hash) {
+  ASSERT1(hash);
+
+  if (file.use_sha256) {
+    if (!SafeHexStringToVector(file.expected_hash, hash)) {
+      return E_INVALIDARG;
+    }
+  } else {
+    HRESULT hr = Base64::Decode(file.expected_hash, hash);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  CryptoHash crypto(file.use_sha256 ? CryptoHash::kSha256 :
+                                      CryptoHash::kSha1);
+  return crypto.IsValidSize(hash->size()) ? S_OK : E_INVALIDARG;
+}
+
+// Verifies batches of files on several threads. A batch is either one file,
+// which is hashed while it is read, or up to kMaxFilesPerHashBatch small files
+// whose SHA256 hashes are computed together. The threads take the batches in
+// order, and each file belongs to one batch only, so the threads never write
+// the result of the same file.
+class FileHashBatchVerifier : public Runnable {
+ public:
+  FileHashBatchVerifier(std::vector<FileHashVerification>* files,
+                        const std::vector<std::vector<byte> >& expected_hashes)
+      : files_(files),
+        expected_hashes_(expected_hashes),
+        next_batch_(0) {
+    ASSERT1(files);
+    ASSERT1(files->size() == expected_hashes.size());
+  }
+
+  virtual ~FileHashBatchVerifier() {}
+
+  // Adds a batch of small files whose SHA256 hashes are computed together.
+  void AddSmallFiles(const std::vector<size_t>& indexes) {
+    ASSERT1(!indexes.empty());
+    ASSERT1(indexes.size() <= kMaxFilesPerHashBatch);
+    batches_.push_back(Batch(indexes, true));
+  }
+
+  // Adds a batch of one file which is hashed while it is read.
+  void AddFile(size_t index) {
+    batches_.push_back(Batch(std::vector<size_t>(1, index), false));
+  }
+
+  size_t num_batches() const { return batches_.size(); }
+
+  // Verifies batches until none are left. Called by each thread.
+  virtual void Run() {
+    for (;;) {
+      const size_t next = static_cast<size_t>(
+          ::InterlockedIncrement(&next_batch_) - 1);
+      if (next >= batches_.size()) {
+        return;
+      }
+
+      const Batch& batch = batches_[next];
+      if (batch.are_small_files) {
+        VerifySmallFiles(batch.indexes);
+      } else {
+        VerifyFile(batch.indexes[0]);
+      }
+    }
+  }
+
+ private:
+  struct Batch {
+    Batch(const std::vector<size_t>& indexes, bool are_small_files)
+        : indexes(indexes), are_small_files(are_small_files) {}
+
+    std::vector<size_t> indexes;
+    bool are_small_files;
+  };
+
+  void VerifyFile(size_t index) {
+    FileHashVerification& file = (*files_)[index];
+    std::vector<byte> hash;
+    file.result = ComputeFileHashReadAhead(file.file, file.use_sha256, &hash);
+    if (SUCCEEDED(file.result)) {
+      file.result = CompareHash(index, &hash.front());
+    }
+  }
+
+  void VerifySmallFiles(const std::vector<size_t>& batch) {
+    ASSERT1(batch.size() <= kMaxFilesPerHashBatch);
+
+    std::vector<byte> contents[kMaxFilesPerHashBatch];
+    const void* data[kMaxFilesPerHashBatch] = {0};
+    unsigned int len[kMaxFilesPerHashBatch] = {0};
+    size_t indexes[kMaxFilesPerHashBatch] = {0};
+    unsigned int count = 0;
+
+    for (size_t i = 0; i != batch.size(); ++i) {
+      FileHashVerification& file = (*files_)[batch[i]];
+      contents[count].clear();
+      file.result = ReadEntireFileShareMode(
+          file.file,
+          static_cast<uint32>(kMaxFileSizeForHashBatch),
+          FILE_SHARE_READ,
+          &contents[count]);
+      if (FAILED(file.result)) {
+        continue;
+      }
+
+      data[count] = contents[count].empty() ? NULL : &contents[count].front();
+      len[count] = static_cast<unsigned int>(contents[count].size());
+      indexes[count] = batch[i];
+      ++count;
+    }
+
+    uint8 digests[kMaxFilesPerHashBatch * SHA256_DIGEST_SIZE] = {0};
+    SHA256_hash_many(data, len, count, digests);
+
+    for (unsigned int i = 0; i != count; ++i) {
+      (*files_)[indexes[i]].result =
+          CompareHash(indexes[i], digests + i * SHA256_DIGEST_SIZE);
+    }
+  }
+
+  HRESULT CompareHash(size_t index, const uint8* hash) const {
+    const std::vector<byte>& expected_hash = expected_hashes_[index];
+    if (!memcmp(&expected_hash.front(), hash, expected_hash.size())) {
+      return S_OK;
+    }
+
+    UTIL_LOG(LE, (_T("[hash mismatch][%s]"), (*files_)[index].file));
+    return SIGS_E_INVALID_SIGNATURE;
+  }
+
+  std::vector<FileHashVerification>* files_;
+  const std::vector<std::vector<byte> >& expected_hashes_;
+  std::vector<Batch> batches_;
+  volatile LONG next_batch_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileHashBatchVerifier);
+};
+
+}  // namespace
+
+HRESULT VerifyFileHashes(std::vector<FileHashVerification>* files,
+                         int max_threads) {
+  ASSERT1(files);
+  ASSERT1(max_threads > 0);
+  UTIL_LOG(L3, (_T("[VerifyFileHashes][%u files]"), files->size()));
+
+  std::vector<std::vector<byte> > expected_hashes(files->size());
+  FileHashBatchVerifier verifier(files, expected_hashes);
+
+  // The large files are verified first since they take the longest.
+  std::vector<std::pair<uint64, size_t> > small_files;
+  for (size_t i = 0; i != files->size(); ++i) {
+    FileHashVerification& file = (*files)[i];
+    file.result = DecodeExpectedHash(file, &expected_hashes[i]);
+    if (FAILED(file.result)) {
+      continue;
+    }
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {0};
+    if (!::GetFileAttributesEx(file.file, GetFileExInfoStandard, &attributes)) {
+      file.result = HRESULTFromLastError();
+      continue;
+    }
+
+    const uint64 file_size =
+        (static_cast<uint64>(attributes.nFileSizeHigh) << 32) |
+        attributes.nFileSizeLow;
+    if (file_size > kMaxFileSizeForAuthentication) {
+      UTIL_LOG(LE, (_T("[exceed max len][%s][%I64u]"), file.file, file_size));
+      file.result = E_FAIL;
+      continue;
+    }
+
+    if (file.use_sha256 && file_size <= kMaxFileSizeForHashBatch) {
+      small_files.push_back(std::make_pair(file_size, i));
+    } else {
+      verifier.AddFile(i);
+    }
+  }
+
+  // The small files are hashed together with the files closest to them in
+  // size, since only the blocks which all the files of a batch have are
+  // hashed in parallel.
+  std::sort(small_files.begin(), small_files.end());
+  for (size_t first = 0; first < small_files.size();
+       first += kMaxFilesPerHashBatch) {
+    const size_t last = std::min(first + kMaxFilesPerHashBatch,
+                                 small_files.size());
+    std::vector<size_t> indexes;
+    for (size_t i = first; i != last; ++i) {
+      indexes.push_back(small_files[i].second);
+    }
+    verifier.AddSmallFiles(indexes);
+  }
+
+  // The calling thread verifies batches along with the worker threads. If a
+  // worker thread fails to start, the other threads verify its batches.
+  const size_t num_worker_threads =
+      std::min(static_cast<size_t>(max_threads), verifier.num_batches());
+  scoped_array<Thread> threads(num_worker_threads > 1 ?
+                               new Thread[num_worker_threads - 1] :
+                               NULL);
+  size_t num_started_threads = 0;
+  for (; num_started_threads + 1 < num_worker_threads; ++num_started_threads) {
+    if (!threads[num_started_threads].Start(&verifier)) {
+      UTIL_LOG(LW, (_T("[failed to start hash thread][0x%08x]"),
+                    HRESULTFromLastError()));
+      break;
+    }
+  }
+
+  verifier.Run();
+
+  for (size_t i = 0; i != num_started_threads; ++i) {
+    VERIFY1(threads[i].WaitTillExit(INFINITE));
+  }
+
+  for (size_t i = 0; i != files->size(); ++i) {
+    ASSERT1((*files)[i].result != E_PENDING);
+    if (FAILED((*files)[i].result)) {
+      return (*files)[i].result;
+    }
+  }
+  return S_OK;
+}
+
 }  // namespace omaha
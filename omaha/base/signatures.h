@@ -314,6 +314,37 @@ HRESULT VerifyFileHash(const std::vector<CString>& files,
 HRESULT VerifyFileHashSha256(const std::vector<CString>& files,
                              const CString& expected_hash);
 
+// A file and its expected hash, for VerifyFileHashes.
+struct FileHashVerification {
+  FileHashVerification() : use_sha256(true), result(E_PENDING) {}
+  FileHashVerification(const CString& file,
+                       const CString& expected_hash,
+                       bool use_sha256)
+      : file(file),
+        expected_hash(expected_hash),
+        use_sha256(use_sha256),
+        result(E_PENDING) {}
+
+  CString file;
+
+  // A hex-digit encoded SHA256 hash, or a base64 encoded SHA1 hash.
+  CString expected_hash;
+  bool use_sha256;
+
+  // Set by VerifyFileHashes: S_OK if the file matches its hash,
+  // SIGS_E_INVALID_SIGNATURE if it does not, or the error which prevented the
+  // file from being hashed.
+  HRESULT result;
+};
+
+// Verifies the hash of each file on its own, using up to max_threads threads
+// including the calling thread. The SHA256 hashes of small files are computed
+// several files at a time, and large files are read ahead while they are
+// hashed. Returns S_OK if all the files match their hashes, or the first
+// failed result otherwise.
+HRESULT VerifyFileHashes(std::vector<FileHashVerification>* files,
+                         int max_threads);
+
 }  // namespace omaha
 
 #endif  // OMAHA_BASE_SIGNATURES_H_
@@ -26,6 +26,8 @@
 #include "omaha/base/app_util.h"
 #include "omaha/base/error.h"
 #include "omaha/base/path.h"
+#include "omaha/base/security/sha.h"
+#include "omaha/base/security/sha256.h"
 #include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
 #include "omaha/base/utils.h"
@@ -302,5 +304,115 @@ TEST(SignaturesTest, VerifyFileHashSha256) {
   EXPECT_STREQ(hash_files, CString(actual_hash_files.c_str()));
 }
 
+TEST(SignaturesTest, VerifyFileHashes) {
+  const CString executable_path(app_util::GetCurrentModuleDirectory());
+
+  const CString source_file1 = ConcatenatePath(
+      executable_path,
+      _T("unittest_support\\download_cache_test\\")
+      _T("{89640431-FE64-4da8-9860-1A1085A60E13}\\gears-win32-opt.msi"));
+
+  const CString hash_file1 =
+      _T("49b45f78865621b154fa65089f955182345a67f9746841e43e2d6daa288988d0");
+
+  const CString source_file2 = ConcatenatePath(
+       executable_path,
+       _T("unittest_support\\download_cache_test\\")
+       _T("{7101D597-3481-4971-AD23-455542964072}\\livelysetup.exe"));
+
+  const CString hash_file2 =
+      _T("f0bbd84d7ec364f6c33161d781b49d840ed792b8b10668c4180b9e6e128d0bc9");
+
+  const CString sha1_hash_file2 = _T("Igq6bYaeXFJCjH770knXyJ6V53s=");
+
+  std::vector<FileHashVerification> files;
+  files.push_back(FileHashVerification(source_file1, hash_file1, true));
+  files.push_back(FileHashVerification(source_file2, hash_file2, true));
+  files.push_back(FileHashVerification(source_file2, sha1_hash_file2, false));
+  EXPECT_HRESULT_SUCCEEDED(VerifyFileHashes(&files, 4));
+  for (size_t i = 0; i != files.size(); ++i) {
+    EXPECT_EQ(S_OK, files[i].result);
+  }
+
+  // Incorrect hash, missing file, and bad hash.
+  files.push_back(FileHashVerification(source_file1, hash_file2, true));
+  files.push_back(FileHashVerification(
+      ConcatenatePath(executable_path, _T("no_such_file.exe")),
+      hash_file1,
+      true));
+  files.push_back(FileHashVerification(source_file1, _T("00bad000"), true));
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, VerifyFileHashes(&files, 4));
+  EXPECT_EQ(S_OK, files[0].result);
+  EXPECT_EQ(S_OK, files[1].result);
+  EXPECT_EQ(S_OK, files[2].result);
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, files[3].result);
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), files[4].result);
+  EXPECT_EQ(E_INVALIDARG, files[5].result);
+}
+
+// Verifies files of many sizes, so that the small files are hashed several
+// files at a time and the large files are read in several chunks.
+TEST(SignaturesTest, VerifyFileHashes_ManyFiles) {
+  const size_t kFileSizes[] = {
+    1, 63, 64, 65, 1000, 4096, 4097, 65536, 100000, 870400,
+    1024 * 1024, 1024 * 1024 + 1, 2 * 1024 * 1024 + 17, 3 * 1024 * 1024,
+  };
+
+  std::vector<CString> temp_files;
+  std::vector<FileHashVerification> files;
+  for (size_t i = 0; i != arraysize(kFileSizes); ++i) {
+    std::vector<byte> contents(kFileSizes[i]);
+    for (size_t j = 0; j != contents.size(); ++j) {
+      contents[j] = static_cast<byte>(j * 7 + i);
+    }
+
+    const CString temp_file = GetTempFilename(_T("ut_"));
+    ASSERT_FALSE(temp_file.IsEmpty());
+    temp_files.push_back(temp_file);
+    ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(temp_file, contents));
+
+    const unsigned int len = static_cast<unsigned int>(contents.size());
+    std::vector<byte> sha256_hash(SHA256_DIGEST_SIZE);
+    SHA256_hash(&contents.front(), len, &sha256_hash.front());
+    std::string sha256_hash_string;
+    b2a_hex(&sha256_hash.front(), &sha256_hash_string, SHA256_DIGEST_SIZE);
+    files.push_back(FileHashVerification(
+        temp_file, CString(sha256_hash_string.c_str()), true));
+
+    std::vector<byte> sha1_hash(SHA_DIGEST_SIZE);
+    SHA_hash(&contents.front(), len, &sha1_hash.front());
+    CStringA sha1_hash_string;
+    EXPECT_HRESULT_SUCCEEDED(Base64::Encode(sha1_hash, &sha1_hash_string));
+    files.push_back(FileHashVerification(
+        temp_file, CString(sha1_hash_string), false));
+  }
+
+  for (int max_threads = 1; max_threads <= 16; max_threads *= 2) {
+    EXPECT_HRESULT_SUCCEEDED(VerifyFileHashes(&files, max_threads));
+    for (size_t i = 0; i != files.size(); ++i) {
+      EXPECT_EQ(S_OK, files[i].result) << files[i].file.GetString();
+    }
+  }
+
+  // Only the hashes of the modified files fail to verify.
+  const size_t kModifiedFiles[] = {5, 12};
+  for (size_t i = 0; i != arraysize(kModifiedFiles); ++i) {
+    std::vector<byte> contents(kFileSizes[kModifiedFiles[i]], 0);
+    EXPECT_HRESULT_SUCCEEDED(
+        WriteEntireFile(temp_files[kModifiedFiles[i]], contents));
+  }
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, VerifyFileHashes(&files, 4));
+  for (size_t i = 0; i != files.size(); ++i) {
+    const size_t file_index = i / 2;
+    const bool is_modified =
+        file_index == kModifiedFiles[0] || file_index == kModifiedFiles[1];
+    EXPECT_EQ(is_modified ? SIGS_E_INVALID_SIGNATURE : S_OK, files[i].result);
+  }
+
+  for (size_t i = 0; i != temp_files.size(); ++i) {
+    EXPECT_TRUE(::DeleteFile(temp_files[i]));
+  }
+}
+
 }  // namespace omaha
 
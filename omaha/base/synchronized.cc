@@ -120,6 +120,20 @@ bool AutoSync::FirstTime() {
   return false;
 }
 
+AutoSharedSync::AutoSharedSync(const SharedLock* lock) : lock_(lock) {
+  ASSERT(lock_, (L""));
+  VERIFY(lock_->LockShared(), (L"Failed to lock in constructor"));
+}
+
+AutoSharedSync::AutoSharedSync(const SharedLock& lock) : lock_(&lock) {
+  VERIFY(lock_->LockShared(), (L"Failed to lock in constructor"));
+}
+
+AutoSharedSync::~AutoSharedSync() {
+  ASSERT(lock_, (L""));
+  VERIFY(lock_->UnlockShared(), (L"Failed to unlock in destructor"));
+}
+
 // Constructor.
 GLock::GLock() : mutex_(NULL) {
 }
@@ -216,6 +230,133 @@ DWORD_PTR LLock::GetOwner() const {
          reinterpret_cast<DWORD_PTR>(critical_section_.OwningThread) : 0;
 }
 
+SharedLock::SharedLock()
+    : no_readers_event_(NULL),
+      num_readers_(0),
+      owner_(0),
+      recursion_count_(0),
+      tls_index_(TLS_OUT_OF_INDEXES) {
+  InitializeCriticalSection(&writer_critical_section_);
+  InitializeCriticalSection(&readers_critical_section_);
+  no_readers_event_ = ::CreateEvent(NULL, true, true, NULL);
+  ASSERT1(no_readers_event_);
+
+  // Without a thread local slot, the shared mode degrades to the exclusive
+  // mode, which is correct but serializes the readers.
+  tls_index_ = ::TlsAlloc();
+  ASSERT1(tls_index_ != TLS_OUT_OF_INDEXES);
+}
+
+SharedLock::~SharedLock() {
+  ASSERT1(!owner_);
+  ASSERT1(!num_readers_);
+  if (tls_index_ != TLS_OUT_OF_INDEXES) {
+    ::TlsFree(tls_index_);
+  }
+  if (no_readers_event_) {
+    ::CloseHandle(no_readers_event_);
+  }
+  DeleteCriticalSection(&readers_critical_section_);
+  DeleteCriticalSection(&writer_critical_section_);
+}
+
+bool SharedLock::Lock() const {
+  EnterCriticalSection(&writer_critical_section_);
+  if (recursion_count_++ == 0) {
+    // Upgrading a shared lock to an exclusive one deadlocks.
+    ASSERT1(!GetSharedCount());
+
+    // New readers can't get in while the writer critical section is held.
+    // Wait for the ones that are already in to leave.
+    VERIFY1(::WaitForSingleObject(no_readers_event_, INFINITE) ==
+            WAIT_OBJECT_0);
+    owner_ = ::GetCurrentThreadId();
+  }
+  return true;
+}
+
+bool SharedLock::Unlock() const {
+  ASSERT1(owner_ == ::GetCurrentThreadId());
+  ASSERT1(recursion_count_ > 0);
+  if (--recursion_count_ == 0) {
+    owner_ = 0;
+  }
+  LeaveCriticalSection(&writer_critical_section_);
+  return true;
+}
+
+bool SharedLock::LockShared() const {
+  if (owner_ == ::GetCurrentThreadId() ||
+      tls_index_ == TLS_OUT_OF_INDEXES) {
+    return Lock();
+  }
+
+  const int shared_count = GetSharedCount();
+  if (shared_count) {
+    // The thread is already counted as a reader. It must not wait for a
+    // writer, which in turn waits for this thread to leave.
+    SetSharedCount(shared_count + 1);
+    return true;
+  }
+
+  EnterCriticalSection(&writer_critical_section_);
+  EnterCriticalSection(&readers_critical_section_);
+  if (num_readers_++ == 0) {
+    VERIFY1(::ResetEvent(no_readers_event_));
+  }
+  LeaveCriticalSection(&readers_critical_section_);
+  LeaveCriticalSection(&writer_critical_section_);
+
+  SetSharedCount(1);
+  return true;
+}
+
+bool SharedLock::UnlockShared() const {
+  const int shared_count = GetSharedCount();
+  if (!shared_count) {
+    // The shared acquisition was counted as an exclusive one.
+    return Unlock();
+  }
+
+  SetSharedCount(shared_count - 1);
+  if (shared_count > 1) {
+    return true;
+  }
+
+  EnterCriticalSection(&readers_critical_section_);
+  ASSERT1(num_readers_ > 0);
+  if (--num_readers_ == 0) {
+    VERIFY1(::SetEvent(no_readers_event_));
+  }
+  LeaveCriticalSection(&readers_critical_section_);
+  return true;
+}
+
+DWORD_PTR SharedLock::GetOwner() const {
+  return owner_;
+}
+
+bool SharedLock::IsLockedSharedByCaller() const {
+  if (owner_ == ::GetCurrentThreadId()) {
+    return true;
+  }
+  return tls_index_ != TLS_OUT_OF_INDEXES && GetSharedCount() > 0;
+}
+
+int SharedLock::GetSharedCount() const {
+  if (tls_index_ == TLS_OUT_OF_INDEXES) {
+    return 0;
+  }
+  return static_cast<int>(
+      reinterpret_cast<INT_PTR>(::TlsGetValue(tls_index_)));
+}
+
+void SharedLock::SetSharedCount(int count) const {
+  ASSERT1(tls_index_ != TLS_OUT_OF_INDEXES);
+  VERIFY1(::TlsSetValue(tls_index_,
+                        reinterpret_cast<void*>(static_cast<INT_PTR>(count))));
+}
+
 // Use this c-tor for interprocess gates.
 Gate::Gate(const TCHAR * event_name) : gate_(NULL) {
   VERIFY(Initialize(event_name), (_T("")));
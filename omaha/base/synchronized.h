@@ -101,6 +101,23 @@ class AutoSync {
     for (AutoSync MAKE_NAME_LINE(hiddenBlockLock)(lock); \
                   MAKE_NAME_LINE(hiddenBlockLock).FirstTime(); )
 
+class SharedLock;
+
+// Scope based shared access. Acquires the lock in shared mode on
+// construction and releases it during destruction.
+class AutoSharedSync {
+ public:
+  explicit AutoSharedSync(const SharedLock* lock);
+  explicit AutoSharedSync(const SharedLock& lock);
+  ~AutoSharedSync();
+ private:
+  const SharedLock* lock_;
+  DISALLOW_EVIL_CONSTRUCTORS(AutoSharedSync);
+};
+
+#define __mutexSharedScope(lock) \
+    AutoSharedSync MAKE_NAME(hiddenSharedLock)(lock)
+
 // GLock stands for global lock.
 // Implementaion of Lockable to allow mutual exclusion
 // between different processes.
@@ -169,6 +186,60 @@ class LLock : public Lockable {
   DISALLOW_EVIL_CONSTRUCTORS(LLock);
 };
 
+// A recursive reader/writer lock for in-process use. Lock() and Unlock()
+// acquire the lock exclusively, which keeps the class a drop-in Lockable for
+// __mutexScope. LockShared() and UnlockShared() allow any number of threads to
+// hold the lock at the same time as long as no thread holds it exclusively.
+//
+// Both modes are recursive. A thread that owns the lock exclusively may also
+// acquire it in shared mode, in which case the acquisition is counted as
+// another exclusive one. A thread that only holds the lock in shared mode must
+// not acquire it exclusively: the upgrade would wait for itself to release.
+//
+// Writers are preferred. Once a writer is waiting, new readers block until the
+// writer is done, while threads that already hold the lock in shared mode can
+// still re-enter it.
+class SharedLock : public Lockable {
+ public:
+  SharedLock();
+  virtual ~SharedLock();
+  virtual bool Lock() const;
+  virtual bool Unlock() const;
+
+  bool LockShared() const;
+  bool UnlockShared() const;
+
+  // Returns the thread id of the exclusive owner or 0 if the lock is not
+  // owned exclusively.
+  DWORD_PTR GetOwner() const;
+
+  // Returns true if the calling thread holds the lock in either mode.
+  bool IsLockedSharedByCaller() const;
+
+ private:
+  int GetSharedCount() const;
+  void SetSharedCount(int count) const;
+
+  // Held by the writer for the whole time it owns the lock, and briefly by
+  // readers while they register themselves.
+  mutable CRITICAL_SECTION writer_critical_section_;
+
+  // Protects the number of readers and the state of the event.
+  mutable CRITICAL_SECTION readers_critical_section_;
+
+  // Manual reset event, signaled when no thread holds the lock shared.
+  HANDLE no_readers_event_;
+  mutable int num_readers_;
+
+  mutable volatile DWORD owner_;
+  mutable int recursion_count_;
+
+  // Thread local slot counting the shared acquisitions of each thread.
+  DWORD tls_index_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(SharedLock);
+};
+
 // A gate is a synchronization object used to either stop all
 // threads from proceeding through a point or to allow them all to proceed.
 class Gate {
@@ -14,6 +14,7 @@
 // ========================================================================
 
 #include "omaha/base/synchronized.h"
+#include "omaha/base/scoped_any.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
@@ -30,6 +31,166 @@ TEST(LLockTest, GetOwner) {
   EXPECT_EQ(0, lock.GetOwner());
 }
 
+namespace {
+
+struct SharedLockTestParams {
+  const SharedLock* lock;
+  HANDLE locked_event;
+  HANDLE release_event;
+  bool exclusive;
+};
+
+// Acquires the lock, signals that it did, and holds the lock until released.
+DWORD WINAPI HoldSharedLock(void* context) {
+  SharedLockTestParams* params = static_cast<SharedLockTestParams*>(context);
+  if (params->exclusive) {
+    params->lock->Lock();
+  } else {
+    params->lock->LockShared();
+  }
+  ::SetEvent(params->locked_event);
+  ::WaitForSingleObject(params->release_event, INFINITE);
+  if (params->exclusive) {
+    params->lock->Unlock();
+  } else {
+    params->lock->UnlockShared();
+  }
+  return 0;
+}
+
+HANDLE StartHoldingSharedLock(SharedLockTestParams* params) {
+  return ::CreateThread(NULL, 0, &HoldSharedLock, params, 0, NULL);
+}
+
+}  // namespace
+
+TEST(SharedLockTest, Exclusive) {
+  SharedLock lock;
+  EXPECT_EQ(0, lock.GetOwner());
+  EXPECT_FALSE(lock.IsLockedSharedByCaller());
+
+  EXPECT_TRUE(lock.Lock());
+  EXPECT_TRUE(lock.Lock());
+  EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+  EXPECT_TRUE(lock.IsLockedSharedByCaller());
+
+  EXPECT_TRUE(lock.Unlock());
+  EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+  EXPECT_TRUE(lock.Unlock());
+  EXPECT_EQ(0, lock.GetOwner());
+  EXPECT_FALSE(lock.IsLockedSharedByCaller());
+}
+
+TEST(SharedLockTest, SharedIsRecursive) {
+  SharedLock lock;
+
+  EXPECT_TRUE(lock.LockShared());
+  EXPECT_TRUE(lock.LockShared());
+  EXPECT_TRUE(lock.IsLockedSharedByCaller());
+  EXPECT_EQ(0, lock.GetOwner());
+
+  EXPECT_TRUE(lock.UnlockShared());
+  EXPECT_TRUE(lock.IsLockedSharedByCaller());
+  EXPECT_TRUE(lock.UnlockShared());
+  EXPECT_FALSE(lock.IsLockedSharedByCaller());
+
+  // The lock can be taken exclusively once the readers are gone.
+  EXPECT_TRUE(lock.Lock());
+  EXPECT_TRUE(lock.Unlock());
+}
+
+TEST(SharedLockTest, OwnerCanLockShared) {
+  SharedLock lock;
+
+  EXPECT_TRUE(lock.Lock());
+  {
+    __mutexSharedScope(lock);
+    EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+    EXPECT_TRUE(lock.IsLockedSharedByCaller());
+  }
+  EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+  EXPECT_TRUE(lock.Unlock());
+  EXPECT_EQ(0, lock.GetOwner());
+}
+
+TEST(SharedLockTest, ReadersDoNotExcludeEachOther) {
+  SharedLock lock;
+  scoped_event locked(::CreateEvent(NULL, false, false, NULL));
+  scoped_event release(::CreateEvent(NULL, true, false, NULL));
+  SharedLockTestParams params = {&lock, get(locked), get(release), false};
+
+  scoped_handle thread(StartHoldingSharedLock(&params));
+  ASSERT_TRUE(thread);
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(locked), INFINITE));
+
+  // The other thread holds the lock shared. So can this one.
+  {
+    __mutexSharedScope(lock);
+    EXPECT_TRUE(lock.IsLockedSharedByCaller());
+  }
+
+  ::SetEvent(get(release));
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(thread), INFINITE));
+}
+
+TEST(SharedLockTest, WriterExcludesReaders) {
+  SharedLock lock;
+  scoped_event locked(::CreateEvent(NULL, false, false, NULL));
+  scoped_event release(::CreateEvent(NULL, true, false, NULL));
+  SharedLockTestParams params = {&lock, get(locked), get(release), false};
+
+  EXPECT_TRUE(lock.Lock());
+  scoped_handle thread(StartHoldingSharedLock(&params));
+  ASSERT_TRUE(thread);
+
+  // The reader can't get in while the lock is held exclusively.
+  EXPECT_EQ(WAIT_TIMEOUT, ::WaitForSingleObject(get(locked), 100));
+  EXPECT_TRUE(lock.Unlock());
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(locked), INFINITE));
+
+  // Now the writer has to wait for the reader.
+  EXPECT_FALSE(lock.IsLockedSharedByCaller());
+  ::SetEvent(get(release));
+  EXPECT_TRUE(lock.Lock());
+  EXPECT_EQ(::GetCurrentThreadId(), lock.GetOwner());
+  EXPECT_TRUE(lock.Unlock());
+
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(thread), INFINITE));
+}
+
+TEST(SharedLockTest, WaitingWriterBlocksNewReaders) {
+  SharedLock lock;
+  scoped_event reader_locked(::CreateEvent(NULL, false, false, NULL));
+  scoped_event writer_locked(::CreateEvent(NULL, false, false, NULL));
+  scoped_event release(::CreateEvent(NULL, true, false, NULL));
+  SharedLockTestParams reader = {&lock, get(reader_locked), get(release),
+                                 false};
+  SharedLockTestParams writer = {&lock, get(writer_locked), get(release),
+                                 true};
+
+  EXPECT_TRUE(lock.LockShared());
+  scoped_handle writer_thread(StartHoldingSharedLock(&writer));
+  ASSERT_TRUE(writer_thread);
+  EXPECT_EQ(WAIT_TIMEOUT, ::WaitForSingleObject(get(writer_locked), 100));
+
+  // A new reader queues behind the waiting writer.
+  scoped_handle reader_thread(StartHoldingSharedLock(&reader));
+  ASSERT_TRUE(reader_thread);
+  EXPECT_EQ(WAIT_TIMEOUT, ::WaitForSingleObject(get(reader_locked), 100));
+
+  // This thread already holds the lock, so it can re-enter it.
+  EXPECT_TRUE(lock.LockShared());
+  EXPECT_TRUE(lock.UnlockShared());
+
+  EXPECT_TRUE(lock.UnlockShared());
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(writer_locked), INFINITE));
+  ::SetEvent(get(release));
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(reader_locked), INFINITE));
+
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(writer_thread), INFINITE));
+  EXPECT_EQ(WAIT_OBJECT_0, ::WaitForSingleObject(get(reader_thread), INFINITE));
+}
+
 TEST(GateTest, WaitAny) {
   const DWORD kTimeout = 100;
   const size_t kFewGates = 10;
@@ -0,0 +1,262 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/tag_template.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace omaha {
+
+namespace {
+
+const char kMagicBytes[] = "Gact2.0Omaha";
+const size_t kMagicBytesLength = arraysize(kMagicBytes) - 1;
+
+// The magic bytes followed by the length of the tag.
+const size_t kTagHeaderSize = kMagicBytesLength + 2;
+const size_t kMaxTagLength = 0xffff;
+
+// The offsets of the PE format. The offset of the PE header is stored in
+// IMAGE_DOS_HEADER::e_lfanew. The optional header follows the signature and
+// IMAGE_FILE_HEADER, and its data directories follow NumberOfRvaAndSizes.
+const size_t kDosHeaderSize = 64;
+const size_t kPeHeaderPointerOffset = 60;
+const size_t kOptionalHeaderOffset = 24;
+const uint16 kPe32Magic = 0x10b;
+const uint16 kPe32PlusMagic = 0x20b;
+const size_t kPe32DataDirectoryOffset = 96;
+const size_t kPe32PlusDataDirectoryOffset = 112;
+const uint32 kSecurityDirectoryIndex = 4;
+const size_t kDataDirectoryEntrySize = 8;
+const size_t kMaxPeHeaderSize =
+    kOptionalHeaderOffset + kPe32PlusDataDirectoryOffset +
+    (kSecurityDirectoryIndex + 1) * kDataDirectoryEntrySize;
+
+// WIN_CERTIFICATE is dwLength, wRevision, and wCertificateType, followed by
+// the signature.
+const size_t kWinCertificateHeaderSize = 8;
+
+uint16 GetUint16(const uint8* p) {
+  return static_cast<uint16>(p[0] | p[1] << 8);
+}
+
+uint32 GetUint32(const uint8* p) {
+  return static_cast<uint32>(p[0]) |
+         static_cast<uint32>(p[1]) << 8 |
+         static_cast<uint32>(p[2]) << 16 |
+         static_cast<uint32>(p[3]) << 24;
+}
+
+}  // namespace
+
+bool IsValidTagString(const char* tag, size_t length) {
+  for (size_t i = 0; i != length; ++i) {
+    const char c = tag[i];
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9')) {
+      continue;
+    }
+    if (c == '\0' || !strchr("-%{}/&=.,_", c)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TaggedFile::TaggedFile() : num_segments_(0), size_(0) {}
+
+TagTemplate::TagTemplate() : file_size_(0), tag_offset_(0), tag_capacity_(0) {}
+
+bool TagTemplate::Open(TagTemplateInput* input) {
+  file_size_ = 0;
+  tag_offset_ = 0;
+  tag_capacity_ = 0;
+  existing_tag_.clear();
+
+  file_size_ = input->GetSize();
+
+  uint32 cert_dir_offset = 0;
+  uint32 cert_dir_size = 0;
+  if (!ReadCertificateDirectory(input, &cert_dir_offset, &cert_dir_size)) {
+    return false;
+  }
+
+  std::vector<uint8> cert_dir(cert_dir_size);
+  if (!input->ReadAt(cert_dir_offset, &cert_dir.front(), cert_dir.size())) {
+    return false;
+  }
+
+  // The signature is a DER sequence with a two-byte length, which is what
+  // TagExtractor checks as well.
+  if (cert_dir[kWinCertificateHeaderSize] != 0x30 ||
+      cert_dir[kWinCertificateHeaderSize + 1] != 0x82) {
+    return false;
+  }
+
+  const uint8* cert_dir_begin = &cert_dir.front();
+  const uint8* cert_dir_end = cert_dir_begin + cert_dir.size();
+  const uint8* magic = std::search(cert_dir_begin,
+                                   cert_dir_end,
+                                   kMagicBytes,
+                                   kMagicBytes + kMagicBytesLength);
+  if (static_cast<size_t>(cert_dir_end - magic) < kTagHeaderSize) {
+    return false;
+  }
+
+  const size_t capacity = cert_dir_end - magic;
+  const size_t existing_tag_length =
+      magic[kMagicBytesLength] << 8 | magic[kMagicBytesLength + 1];
+  if (existing_tag_length > capacity - kTagHeaderSize) {
+    return false;
+  }
+
+  existing_tag_.assign(reinterpret_cast<const char*>(magic) + kTagHeaderSize,
+                       existing_tag_length);
+  tag_offset_ = cert_dir_offset + (magic - cert_dir_begin);
+  tag_capacity_ = static_cast<uint32>(capacity);
+  return true;
+}
+
+bool TagTemplate::ReadCertificateDirectory(TagTemplateInput* input,
+                                           uint32* offset,
+                                           uint32* size) {
+  if (file_size_ < kDosHeaderSize) {
+    return false;
+  }
+
+  uint8 dos_header[kDosHeaderSize] = {0};
+  if (!input->ReadAt(0, dos_header, sizeof(dos_header)) ||
+      dos_header[0] != 'M' || dos_header[1] != 'Z') {
+    return false;
+  }
+
+  const uint32 pe_offset = GetUint32(dos_header + kPeHeaderPointerOffset);
+  if (pe_offset > file_size_ ||
+      file_size_ - pe_offset < kOptionalHeaderOffset + 2) {
+    return false;
+  }
+
+  uint8 pe_header[kMaxPeHeaderSize] = {0};
+  const size_t pe_header_size = static_cast<size_t>(
+      std::min<uint64>(sizeof(pe_header), file_size_ - pe_offset));
+  if (!input->ReadAt(pe_offset, pe_header, pe_header_size) ||
+      memcmp(pe_header, "PE\0\0", 4) != 0) {
+    return false;
+  }
+
+  // The data directories are at a different offset in the images of 32-bit
+  // and 64-bit programs. Unlike TagExtractor, a template reads both, since
+  // the servers tag the binaries of any architecture.
+  size_t data_directory_offset = 0;
+  switch (GetUint16(pe_header + kOptionalHeaderOffset)) {
+    case kPe32Magic:
+      data_directory_offset = kPe32DataDirectoryOffset;
+      break;
+    case kPe32PlusMagic:
+      data_directory_offset = kPe32PlusDataDirectoryOffset;
+      break;
+    default:
+      return false;
+  }
+
+  const size_t entry_offset = kOptionalHeaderOffset + data_directory_offset +
+                              kSecurityDirectoryIndex * kDataDirectoryEntrySize;
+  if (entry_offset + kDataDirectoryEntrySize > pe_header_size) {
+    return false;
+  }
+  const uint32 num_directories = GetUint32(
+      pe_header + kOptionalHeaderOffset + data_directory_offset - 4);
+  if (num_directories <= kSecurityDirectoryIndex) {
+    return false;
+  }
+
+  // The address of the security directory is an offset in the file, since
+  // the certificates are not loaded in memory.
+  *offset = GetUint32(pe_header + entry_offset);
+  *size = GetUint32(pe_header + entry_offset + 4);
+  return *offset != 0 &&
+         *size >= kWinCertificateHeaderSize + 4 &&
+         *size <= kMaxCertificateDirectorySize &&
+         *offset <= file_size_ &&
+         file_size_ - *offset >= *size;
+}
+
+size_t TagTemplate::max_tag_length() const {
+  if (tag_capacity_ < kTagHeaderSize) {
+    return 0;
+  }
+  return std::min(kMaxTagLength, tag_capacity_ - kTagHeaderSize);
+}
+
+bool TagTemplate::MakeTaggedFile(const char* tag,
+                                 size_t tag_length,
+                                 bool append,
+                                 TaggedFile* tagged_file) const {
+  if (!tag_capacity_ || !IsValidTagString(tag, tag_length)) {
+    return false;
+  }
+  if (!existing_tag_.empty() && !append) {
+    return false;
+  }
+
+  const size_t length = existing_tag_.size() + tag_length;
+  if (length > max_tag_length()) {
+    return false;
+  }
+
+  // The format of the tag block is:
+  // 000000-00000B: 12-byte magic
+  // 00000C-00000D: unsigned 16-bit int string length (big-endian)
+  // 00000E-??????: ASCII string
+  std::vector<uint8>& block = tagged_file->tag_block_;
+  block.resize(kTagHeaderSize + length);
+  memcpy(&block.front(), kMagicBytes, kMagicBytesLength);
+  block[kMagicBytesLength] = static_cast<uint8>(length >> 8);
+  block[kMagicBytesLength + 1] = static_cast<uint8>(length & 0xff);
+  if (!existing_tag_.empty()) {
+    memcpy(&block[kTagHeaderSize], existing_tag_.data(), existing_tag_.size());
+  }
+  if (tag_length) {
+    memcpy(&block[kTagHeaderSize + existing_tag_.size()], tag, tag_length);
+  }
+
+  TaggedFileSegment* segments = tagged_file->segments_;
+  size_t num_segments = 0;
+
+  segments[num_segments].data = NULL;
+  segments[num_segments].offset = 0;
+  segments[num_segments].size = tag_offset_;
+  ++num_segments;
+
+  segments[num_segments].data = &block.front();
+  segments[num_segments].offset = tag_offset_;
+  segments[num_segments].size = block.size();
+  ++num_segments;
+
+  const uint64 suffix_offset = tag_offset_ + block.size();
+  if (suffix_offset < file_size_) {
+    segments[num_segments].data = NULL;
+    segments[num_segments].offset = suffix_offset;
+    segments[num_segments].size = file_size_ - suffix_offset;
+    ++num_segments;
+  }
+
+  tagged_file->num_segments_ = num_segments;
+  tagged_file->size_ = file_size_;
+  return true;
+}
+
+}  // namespace omaha
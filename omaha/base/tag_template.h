@@ -0,0 +1,148 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Tags signed binaries without copying them, for the servers which tag an
+// installer for every download.
+//
+// The tag is written in the padding of the Authenticode certificate, after
+// the magic bytes "Gact2.0Omaha" which the signing process leaves there. The
+// size of the file and the certificate directory do not change, so a tagged
+// file is the base binary with the bytes of the tag block replaced:
+//   the base binary up to the magic bytes
+//   the tag block: the magic bytes, the length of the tag as a big-endian
+//     16-bit integer, and the tag
+//   the rest of the base binary
+// TagTemplate parses the PE headers and the certificate directory of a base
+// binary once, and produces the tagged files as these segments, which can be
+// written with writev, sendfile, or TransmitFile without copying the base
+// binary. Only the tag block is built in memory. The code does not depend on
+// Windows, so the tagging servers and the benchmarks can run on other
+// platforms.
+
+#ifndef OMAHA_BASE_TAG_TEMPLATE_H_
+#define OMAHA_BASE_TAG_TEMPLATE_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+// The largest certificate directory which is read. Authenticode signatures
+// are a few KB.
+const uint32 kMaxCertificateDirectorySize = 1024 * 1024;
+
+// Returns true if |tag| only has the characters which kValidTagStringRegEx
+// accepts.
+bool IsValidTagString(const char* tag, size_t length);
+
+// Reads the base binary.
+class TagTemplateInput {
+ public:
+  virtual ~TagTemplateInput() {}
+  virtual uint64 GetSize() = 0;
+  virtual bool ReadAt(uint64 offset, uint8* data, size_t size) = 0;
+};
+
+// A segment of a tagged file.
+struct TaggedFileSegment {
+  TaggedFileSegment() : data(NULL), offset(0), size(0) {}
+
+  // The bytes of the segment, or NULL if the segment is a range of the base
+  // binary. |offset| is the offset of the segment in the tagged file, which
+  // is also its offset in the base binary.
+  const uint8* data;
+  uint64 offset;
+  uint64 size;
+};
+
+// The segments of a tagged file. The object can be reused for several tags,
+// so that the tag block is not allocated again.
+class TaggedFile {
+ public:
+  TaggedFile();
+
+  size_t num_segments() const { return num_segments_; }
+  const TaggedFileSegment& segment(size_t index) const {
+    return segments_[index];
+  }
+
+  uint64 size() const { return size_; }
+
+  // The bytes which were built in memory for the tagged file, as opposed to
+  // the bytes which are read from the base binary.
+  size_t bytes_copied() const { return tag_block_.size(); }
+
+ private:
+  static const size_t kMaxSegments = 3;
+
+  std::vector<uint8> tag_block_;
+  TaggedFileSegment segments_[kMaxSegments];
+  size_t num_segments_;
+  uint64 size_;
+
+  friend class TagTemplate;
+  DISALLOW_COPY_AND_ASSIGN(TaggedFile);
+};
+
+// The layout of a base binary. Once opened, a template is not modified, so
+// it can be shared by the threads which tag the downloads.
+class TagTemplate {
+ public:
+  TagTemplate();
+
+  // Reads the PE headers and the certificate directory of the base binary.
+  // Returns false if the binary is not signed or if its certificate does
+  // not have the magic bytes.
+  bool Open(TagTemplateInput* input);
+
+  uint64 file_size() const { return file_size_; }
+
+  // The offset of the tag block in the base binary.
+  uint64 tag_offset() const { return tag_offset_; }
+
+  // The tag of the base binary, which is empty if the binary is not tagged.
+  const std::string& existing_tag() const { return existing_tag_; }
+
+  // The longest tag which fits in the padding of the certificate, including
+  // the existing tag when a tag is appended.
+  size_t max_tag_length() const;
+
+  // Builds the segments of the base binary tagged with |tag|. The tag is
+  // appended to the existing tag if |append| is true. Returns false if the
+  // tag has invalid characters or does not fit in the padding, or if the
+  // base binary is already tagged and |append| is false.
+  bool MakeTaggedFile(const char* tag,
+                      size_t tag_length,
+                      bool append,
+                      TaggedFile* tagged_file) const;
+
+ private:
+  bool ReadCertificateDirectory(TagTemplateInput* input,
+                                uint32* offset,
+                                uint32* size);
+
+  uint64 file_size_;
+  uint64 tag_offset_;
+  uint32 tag_capacity_;
+  std::string existing_tag_;
+
+  DISALLOW_COPY_AND_ASSIGN(TagTemplate);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_TAG_TEMPLATE_H_
@@ -0,0 +1,401 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/tag_template.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const char kMagicBytes[] = "Gact2.0Omaha";
+const size_t kMagicBytesLength = arraysize(kMagicBytes) - 1;
+
+// The offset of the PE header in the synthetic binaries.
+const size_t kPeOffset = 0x80;
+
+// A linear congruential generator, so that the tests do not depend on the
+// state of the CRT generator.
+class TestRandom {
+ public:
+  explicit TestRandom(uint32 seed) : state_(seed) {}
+
+  uint32 Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 16;
+  }
+
+ private:
+  uint32 state_;
+};
+
+void PutUint16(uint16 value, uint8* p) {
+  p[0] = static_cast<uint8>(value);
+  p[1] = static_cast<uint8>(value >> 8);
+}
+
+void PutUint32(uint32 value, uint8* p) {
+  for (int i = 0; i < 4; ++i) {
+    p[i] = static_cast<uint8>(value >> (8 * i));
+  }
+}
+
+// Builds a binary with the layout of a signed PE file: the headers, a body
+// of |body_size| random bytes, and a certificate directory which ends the
+// file. The certificate is a fake signature of |signature_size| bytes
+// followed by the magic bytes and |padding_size| bytes of zeros.
+std::vector<uint8> BuildSignedBinary(size_t body_size,
+                                     size_t signature_size,
+                                     size_t padding_size,
+                                     bool is_64_bit) {
+  const size_t data_directory_offset = kPeOffset + 24 + (is_64_bit ? 112 : 96);
+  const size_t headers_size = data_directory_offset + 16 * 8;
+
+  std::vector<uint8> binary(headers_size + body_size);
+  binary[0] = 'M';
+  binary[1] = 'Z';
+  PutUint32(kPeOffset, &binary[60]);
+  memcpy(&binary[kPeOffset], "PE\0\0", 4);
+  PutUint16(is_64_bit ? 0x20b : 0x10b, &binary[kPeOffset + 24]);
+  PutUint32(16, &binary[data_directory_offset - 4]);
+
+  TestRandom random(static_cast<uint32>(body_size));
+  for (size_t i = headers_size; i != binary.size(); ++i) {
+    binary[i] = static_cast<uint8>(random.Next());
+  }
+
+  // WIN_CERTIFICATE, then a DER sequence with a two-byte length.
+  std::vector<uint8> cert_dir(8 + 4 + signature_size);
+  PutUint16(0x200, &cert_dir[4]);
+  PutUint16(2, &cert_dir[6]);
+  cert_dir[8] = 0x30;
+  cert_dir[9] = 0x82;
+  cert_dir[10] = static_cast<uint8>(signature_size >> 8);
+  cert_dir[11] = static_cast<uint8>(signature_size);
+  for (size_t i = 12; i != cert_dir.size(); ++i) {
+    cert_dir[i] = static_cast<uint8>(random.Next() & 0x7f);
+  }
+  cert_dir.insert(cert_dir.end(), kMagicBytes, kMagicBytes + kMagicBytesLength);
+  cert_dir.resize(cert_dir.size() + 2 + padding_size);
+  cert_dir.resize((cert_dir.size() + 7) & ~static_cast<size_t>(7));
+  PutUint32(static_cast<uint32>(cert_dir.size()), &cert_dir[0]);
+
+  PutUint32(static_cast<uint32>(binary.size()),
+            &binary[data_directory_offset + 4 * 8]);
+  PutUint32(static_cast<uint32>(cert_dir.size()),
+            &binary[data_directory_offset + 4 * 8 + 4]);
+  binary.insert(binary.end(), cert_dir.begin(), cert_dir.end());
+  return binary;
+}
+
+// Returns the offset of the magic bytes in |binary|.
+size_t FindMagicBytes(const std::vector<uint8>& binary) {
+  const std::vector<uint8>::const_iterator it =
+      std::search(binary.begin(), binary.end(),
+                  kMagicBytes, kMagicBytes + kMagicBytesLength);
+  return it - binary.begin();
+}
+
+class MemoryInput : public TagTemplateInput {
+ public:
+  explicit MemoryInput(const std::vector<uint8>& data)
+      : data_(data),
+        bytes_read_(0) {}
+
+  virtual uint64 GetSize() {
+    return data_.size();
+  }
+
+  virtual bool ReadAt(uint64 offset, uint8* data, size_t size) {
+    if (offset > data_.size() || data_.size() - offset < size) {
+      return false;
+    }
+    memcpy(data, &data_[static_cast<size_t>(offset)], size);
+    bytes_read_ += size;
+    return true;
+  }
+
+  uint64 bytes_read() const { return bytes_read_; }
+
+ private:
+  const std::vector<uint8>& data_;
+  uint64 bytes_read_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryInput);
+};
+
+// Writes the segments of |tagged_file| in the way a server would, reading
+// the ranges of the base binary from |base|.
+std::vector<uint8> Assemble(const std::vector<uint8>& base,
+                            const TaggedFile& tagged_file) {
+  std::vector<uint8> output;
+  for (size_t i = 0; i != tagged_file.num_segments(); ++i) {
+    const TaggedFileSegment& segment = tagged_file.segment(i);
+    EXPECT_EQ(output.size(), segment.offset);
+    const uint8* data = segment.data ?
+                        segment.data :
+                        &base[static_cast<size_t>(segment.offset)];
+    output.insert(output.end(), data,
+                  data + static_cast<size_t>(segment.size));
+  }
+  EXPECT_EQ(tagged_file.size(), output.size());
+  return output;
+}
+
+// Tags a copy of |base| in the way ApplyTag writes a tagged file.
+std::vector<uint8> TagCopy(const std::vector<uint8>& base,
+                           const std::string& tag) {
+  std::vector<uint8> tagged(base);
+  const size_t magic_offset = FindMagicBytes(tagged);
+  tagged[magic_offset + kMagicBytesLength] =
+      static_cast<uint8>(tag.size() >> 8);
+  tagged[magic_offset + kMagicBytesLength + 1] =
+      static_cast<uint8>(tag.size());
+  std::copy(tag.begin(), tag.end(),
+            tagged.begin() + magic_offset + kMagicBytesLength + 2);
+  return tagged;
+}
+
+}  // namespace
+
+TEST(TagTemplateTest, IsValidTagString) {
+  const char kValid[] = "appguid={8A69D345-D564-463C-AFF1-A69D9E530F96}&"
+                        "appname=Google%20Chrome&needsadmin=prefers&lang=en,"
+                        "_.";
+  EXPECT_TRUE(IsValidTagString(kValid, strlen(kValid)));
+  EXPECT_TRUE(IsValidTagString("", 0));
+
+  const char* const kInvalid[] = {"a b", "a$b", "a#", "\"", "a\\b", "a\nb"};
+  for (size_t i = 0; i != arraysize(kInvalid); ++i) {
+    EXPECT_FALSE(IsValidTagString(kInvalid[i], strlen(kInvalid[i])))
+        << kInvalid[i];
+  }
+  EXPECT_FALSE(IsValidTagString("a\0b", 3));
+}
+
+TEST(TagTemplateTest, Open) {
+  const std::vector<uint8> base(BuildSignedBinary(10000, 3000, 200, false));
+  MemoryInput input(base);
+  TagTemplate tag_template;
+  ASSERT_TRUE(tag_template.Open(&input));
+
+  EXPECT_EQ(base.size(), tag_template.file_size());
+  EXPECT_EQ(FindMagicBytes(base), tag_template.tag_offset());
+  EXPECT_TRUE(tag_template.existing_tag().empty());
+  EXPECT_EQ(base.size() - FindMagicBytes(base) - kMagicBytesLength - 2,
+            tag_template.max_tag_length());
+
+  // Only the headers and the certificate directory are read.
+  EXPECT_GT(4096u, input.bytes_read());
+}
+
+TEST(TagTemplateTest, MakeTaggedFile) {
+  for (int is_64_bit = 0; is_64_bit < 2; ++is_64_bit) {
+    const std::vector<uint8> base(
+        BuildSignedBinary(10000, 3000, 200, !!is_64_bit));
+    MemoryInput input(base);
+    TagTemplate tag_template;
+    ASSERT_TRUE(tag_template.Open(&input));
+
+    const std::string tag("appguid={8A69D345-D564-463C-AFF1-A69D9E530F96}");
+    TaggedFile tagged_file;
+    ASSERT_TRUE(tag_template.MakeTaggedFile(tag.c_str(), tag.size(), false,
+                                            &tagged_file));
+    EXPECT_EQ(3u, tagged_file.num_segments());
+    EXPECT_EQ(kMagicBytesLength + 2 + tag.size(), tagged_file.bytes_copied());
+    EXPECT_TRUE(NULL == tagged_file.segment(0).data);
+    EXPECT_TRUE(NULL != tagged_file.segment(1).data);
+    EXPECT_TRUE(NULL == tagged_file.segment(2).data);
+    EXPECT_TRUE(TagCopy(base, tag) == Assemble(base, tagged_file));
+
+    // The object is reused for a shorter tag.
+    ASSERT_TRUE(tag_template.MakeTaggedFile("lang=en", 7, false,
+                                            &tagged_file));
+    EXPECT_TRUE(TagCopy(base, "lang=en") == Assemble(base, tagged_file));
+  }
+}
+
+TEST(TagTemplateTest, MakeTaggedFile_FillsThePadding) {
+  const std::vector<uint8> base(BuildSignedBinary(1000, 500, 40, false));
+  MemoryInput input(base);
+  TagTemplate tag_template;
+  ASSERT_TRUE(tag_template.Open(&input));
+
+  const std::string tag(tag_template.max_tag_length(), 'a');
+  TaggedFile tagged_file;
+  ASSERT_TRUE(tag_template.MakeTaggedFile(tag.c_str(), tag.size(), false,
+                                          &tagged_file));
+  EXPECT_EQ(2u, tagged_file.num_segments());
+  EXPECT_TRUE(TagCopy(base, tag) == Assemble(base, tagged_file));
+
+  const std::string long_tag(tag + "a");
+  EXPECT_FALSE(tag_template.MakeTaggedFile(long_tag.c_str(), long_tag.size(),
+                                           false, &tagged_file));
+}
+
+TEST(TagTemplateTest, MakeTaggedFile_Append) {
+  const std::vector<uint8> base(BuildSignedBinary(10000, 3000, 200, false));
+  MemoryInput input(base);
+  TagTemplate tag_template;
+  ASSERT_TRUE(tag_template.Open(&input));
+
+  TaggedFile tagged_file;
+  ASSERT_TRUE(tag_template.MakeTaggedFile("lang=en", 7, false,
+                                          &tagged_file));
+  const std::vector<uint8> tagged(Assemble(base, tagged_file));
+
+  MemoryInput tagged_input(tagged);
+  TagTemplate tagged_template;
+  ASSERT_TRUE(tagged_template.Open(&tagged_input));
+  EXPECT_STREQ("lang=en", tagged_template.existing_tag().c_str());
+  EXPECT_EQ(tag_template.max_tag_length(), tagged_template.max_tag_length());
+
+  EXPECT_FALSE(tagged_template.MakeTaggedFile("&usagestats=1", 13, false,
+                                              &tagged_file));
+  ASSERT_TRUE(tagged_template.MakeTaggedFile("&usagestats=1", 13, true,
+                                             &tagged_file));
+  EXPECT_TRUE(TagCopy(base, "lang=en&usagestats=1") ==
+              Assemble(tagged, tagged_file));
+}
+
+TEST(TagTemplateTest, MakeTaggedFile_InvalidTag) {
+  const std::vector<uint8> base(BuildSignedBinary(10000, 3000, 200, false));
+  MemoryInput input(base);
+  TagTemplate tag_template;
+  ASSERT_TRUE(tag_template.Open(&input));
+
+  TaggedFile tagged_file;
+  EXPECT_FALSE(tag_template.MakeTaggedFile("lang=en us", 10, false,
+                                           &tagged_file));
+
+  TagTemplate unopened_template;
+  EXPECT_FALSE(unopened_template.MakeTaggedFile("lang=en", 7, false,
+                                                &tagged_file));
+}
+
+TEST(TagTemplateTest, Open_InvalidBinaries) {
+  const std::vector<uint8> base(BuildSignedBinary(1000, 500, 40, false));
+  const size_t security_entry = kPeOffset + 24 + 96 + 4 * 8;
+
+  std::vector<std::vector<uint8> > binaries;
+
+  // Not a PE file.
+  binaries.push_back(base);
+  binaries.back()[0] = 'X';
+  binaries.push_back(base);
+  binaries.back()[kPeOffset] = 'X';
+  binaries.push_back(base);
+  binaries.back()[kPeOffset + 24] = 0x07;
+  binaries.push_back(std::vector<uint8>(base.begin(), base.begin() + 100));
+
+  // Not signed.
+  binaries.push_back(base);
+  PutUint32(0, &binaries.back()[security_entry]);
+  PutUint32(0, &binaries.back()[security_entry + 4]);
+  binaries.push_back(base);
+  PutUint32(4, &binaries.back()[kPeOffset + 24 + 92]);
+
+  // The certificate directory is out of the file.
+  binaries.push_back(std::vector<uint8>(base.begin(), base.end() - 1));
+  binaries.push_back(base);
+  PutUint32(0xfffffff0, &binaries.back()[security_entry]);
+
+  // The signature is not a DER sequence.
+  binaries.push_back(base);
+  binaries.back()[FindMagicBytes(base) - 500 - 4] = 0x31;
+
+  // No magic bytes.
+  binaries.push_back(base);
+  binaries.back()[FindMagicBytes(base)] = 'X';
+
+  // The existing tag is longer than the padding.
+  binaries.push_back(base);
+  binaries.back()[FindMagicBytes(base) + kMagicBytesLength] = 0x01;
+
+  for (size_t i = 0; i != binaries.size(); ++i) {
+    MemoryInput input(binaries[i]);
+    TagTemplate tag_template;
+    EXPECT_FALSE(tag_template.Open(&input)) << i;
+    EXPECT_EQ(0u, tag_template.max_tag_length()) << i;
+  }
+}
+
+// Measures how many tagged files are produced per second from a template,
+// and compares it with copying and patching the base binary for every tag.
+TEST(TagTemplateTest, DISABLED_Benchmark) {
+  const size_t kBodySize = 32 * 1024 * 1024;
+  const int kNumTags = 100000;
+  const int kNumCopies = 20;
+
+  const std::vector<uint8> base(BuildSignedBinary(kBodySize, 8000, 2000,
+                                                  false));
+  std::vector<std::string> tags(kNumTags);
+  for (int i = 0; i < kNumTags; ++i) {
+    tags[i] = "appguid={8A69D345-D564-463C-AFF1-A69D9E530F96}&lang=en&"
+              "needsadmin=prefers&iid=";
+    for (int n = i; n; n /= 10) {
+      tags[i] += static_cast<char>('0' + n % 10);
+    }
+  }
+
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  MemoryInput input(base);
+  TagTemplate tag_template;
+  ASSERT_TRUE(tag_template.Open(&input));
+  const ULONGLONG open_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+
+  TaggedFile tagged_file;
+  uint64 bytes_copied = 0;
+  uint64 bytes_served = 0;
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kNumTags; ++i) {
+    ASSERT_TRUE(tag_template.MakeTaggedFile(tags[i].c_str(), tags[i].size(),
+                                            false, &tagged_file));
+    bytes_copied += tagged_file.bytes_copied();
+    bytes_served += tagged_file.size();
+  }
+  const ULONGLONG tag_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+
+  start_ticks = HighresTimer::GetCurrentTicks();
+  size_t checksum = 0;
+  for (int i = 0; i < kNumCopies; ++i) {
+    const std::vector<uint8> tagged(TagCopy(base, tags[i]));
+    checksum += tagged[i];
+  }
+  const ULONGLONG copy_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+  EXPECT_NE(static_cast<size_t>(-1), checksum);
+
+  const double ms_per_tick = 1000.0 / HighresTimer::GetTimerFrequency();
+  const double tag_ms = tag_ticks * ms_per_tick;
+  const double copy_ms = copy_ticks * ms_per_tick;
+  OPT_LOG(L1, (_T("[base binary of %d bytes][open %f ms][reading %llu bytes]"),
+               static_cast<int>(base.size()), open_ticks * ms_per_tick,
+               input.bytes_read()));
+  OPT_LOG(L1, (_T("[template][%f tags/s][%llu bytes copied per tag]")
+               _T("[%llu bytes served per tag]"),
+               kNumTags * 1000.0 / tag_ms, bytes_copied / kNumTags,
+               bytes_served / kNumTags));
+  OPT_LOG(L1, (_T("[copy of the base binary][%f tags/s]")
+               _T("[%d bytes copied per tag]"),
+               kNumCopies * 1000.0 / copy_ms, static_cast<int>(base.size())));
+}
+
+}  // namespace omaha
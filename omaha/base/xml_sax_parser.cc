@@ -0,0 +1,660 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/xml_sax_parser.h"
+#include <string.h>
+
+namespace omaha {
+
+namespace {
+
+const char kUtf8Bom[] = "\xEF\xBB\xBF";
+
+bool IsWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool IsNameChar(char c) {
+  return !IsWhitespace(c) && !strchr("<>/=?!&;\"'", c) && c != '\0';
+}
+
+bool IsAsciiDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool EqualsIgnoreCase(const std::string& s, const char* ascii) {
+  const size_t length = strlen(ascii);
+  if (s.size() != length) {
+    return false;
+  }
+  for (size_t i = 0; i != length; ++i) {
+    char c = s[i];
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+    if (c != ascii[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IsValidCodePoint(unsigned int code_point) {
+  if (code_point < 0x20) {
+    return code_point == '\t' || code_point == '\n' || code_point == '\r';
+  }
+  return code_point <= 0x10FFFF &&
+         !(code_point >= 0xD800 && code_point <= 0xDFFF) &&
+         code_point != 0xFFFE && code_point != 0xFFFF;
+}
+
+void AppendUtf8(unsigned int code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+// Returns the offset of the first byte which is not valid UTF-8 or which
+// encodes a character that XML does not allow, or |size| if there is none.
+// Checking the whole document once allows the rest of the parser to copy
+// bytes without decoding them.
+size_t FindInvalidCharacter(const char* data, size_t size) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+  while (i < size) {
+    const unsigned int lead = bytes[i];
+    if (lead < 0x80) {
+      if (!IsValidCodePoint(lead)) {
+        return i;
+      }
+      ++i;
+      continue;
+    }
+
+    size_t length = 0;
+    unsigned int code_point = 0;
+    unsigned int min_code_point = 0;
+    if ((lead & 0xE0) == 0xC0) {
+      length = 2;
+      code_point = lead & 0x1F;
+      min_code_point = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+      length = 3;
+      code_point = lead & 0x0F;
+      min_code_point = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+      length = 4;
+      code_point = lead & 0x07;
+      min_code_point = 0x10000;
+    } else {
+      return i;
+    }
+
+    if (size - i < length) {
+      return i;
+    }
+    for (size_t j = 1; j != length; ++j) {
+      const unsigned int trail = bytes[i + j];
+      if ((trail & 0xC0) != 0x80) {
+        return i;
+      }
+      code_point = (code_point << 6) | (trail & 0x3F);
+    }
+    if (code_point < min_code_point || !IsValidCodePoint(code_point)) {
+      return i;
+    }
+    i += length;
+  }
+  return size;
+}
+
+// Appends the characters in [begin, end) to |out|, replacing the references
+// and normalizing the line breaks. The whitespace characters of attribute
+// values are also replaced by spaces. Returns false if a reference is not
+// valid.
+bool AppendCharacterData(const char* begin,
+                         const char* end,
+                         bool is_attribute_value,
+                         std::string* out) {
+  const char* p = begin;
+  while (p != end) {
+    // Copies the longest run that needs no replacement at once.
+    const char* run_end = p;
+    while (run_end != end && *run_end != '&' && *run_end != '\r' &&
+           !(is_attribute_value && (*run_end == '\t' || *run_end == '\n'))) {
+      ++run_end;
+    }
+    out->append(p, run_end);
+    p = run_end;
+    if (p == end) {
+      break;
+    }
+
+    if (*p == '\r') {
+      out->push_back(is_attribute_value ? ' ' : '\n');
+      ++p;
+      if (p != end && *p == '\n') {
+        ++p;
+      }
+      continue;
+    }
+
+    if (*p != '&') {
+      out->push_back(' ');
+      ++p;
+      continue;
+    }
+
+    const char* reference_end = static_cast<const char*>(
+        memchr(p, ';', end - p));
+    if (!reference_end) {
+      return false;
+    }
+    const std::string reference(p + 1, reference_end);
+    p = reference_end + 1;
+
+    if (reference == "lt") {
+      out->push_back('<');
+    } else if (reference == "gt") {
+      out->push_back('>');
+    } else if (reference == "amp") {
+      out->push_back('&');
+    } else if (reference == "quot") {
+      out->push_back('"');
+    } else if (reference == "apos") {
+      out->push_back('\'');
+    } else if (reference.size() >= 2 && reference[0] == '#') {
+      const bool is_hex = reference[1] == 'x';
+      const size_t first_digit = is_hex ? 2 : 1;
+      if (first_digit == reference.size()) {
+        return false;
+      }
+      unsigned int code_point = 0;
+      for (size_t i = first_digit; i != reference.size(); ++i) {
+        const int digit = is_hex ? HexDigitValue(reference[i]) :
+                          IsAsciiDigit(reference[i]) ? reference[i] - '0' :
+                          -1;
+        if (digit < 0) {
+          return false;
+        }
+        code_point = code_point * (is_hex ? 16 : 10) + digit;
+        if (code_point > 0x10FFFF) {
+          return false;
+        }
+      }
+      if (!IsValidCodePoint(code_point)) {
+        return false;
+      }
+      AppendUtf8(code_point, out);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+XmlSaxElement::XmlSaxElement()
+    : num_attributes_(0),
+      has_child_elements_(false),
+      is_text_split_(false) {
+}
+
+XmlSaxElement::~XmlSaxElement() {
+}
+
+const std::string* XmlSaxElement::FindAttribute(const char* name) const {
+  for (size_t i = 0; i != num_attributes_; ++i) {
+    if (attributes_[i].name == name) {
+      return &attributes_[i].value;
+    }
+  }
+  return NULL;
+}
+
+void XmlSaxElement::Clear() {
+  name_.clear();
+  num_attributes_ = 0;
+  text_.clear();
+  has_child_elements_ = false;
+  is_text_split_ = false;
+}
+
+XmlSaxElement::Attribute* XmlSaxElement::AddAttribute() {
+  if (num_attributes_ == attributes_.size()) {
+    attributes_.push_back(Attribute());
+  }
+  Attribute* attribute = &attributes_[num_attributes_++];
+  attribute->name.clear();
+  attribute->value.clear();
+  return attribute;
+}
+
+XmlSaxParser::XmlSaxParser()
+    : data_(NULL),
+      size_(0),
+      pos_(0),
+      handler_(NULL),
+      depth_(0),
+      has_root_(false),
+      pending_element_(NULL) {
+}
+
+XmlSaxParser::~XmlSaxParser() {
+}
+
+XmlSaxParser::Status XmlSaxParser::Parse(const char* data,
+                                         size_t size,
+                                         XmlSaxHandler* handler) {
+  data_ = data;
+  size_ = size;
+  pos_ = 0;
+  handler_ = handler;
+  depth_ = 0;
+  has_root_ = false;
+  pending_element_ = NULL;
+
+  // UTF-16 documents start with a byte order mark or with a '<' followed by
+  // a null byte.
+  if (size_ >= 2 &&
+      (data_[0] == '\xFE' || data_[0] == '\xFF' || data_[1] == '\0')) {
+    return kUnsupported;
+  }
+
+  if (IsAt(kUtf8Bom)) {
+    pos_ += strlen(kUtf8Bom);
+  }
+
+  const size_t invalid_character_offset = FindInvalidCharacter(data_, size_);
+  if (invalid_character_offset != size_) {
+    pos_ = invalid_character_offset;
+    return kMalformed;
+  }
+
+  Status status = kSucceeded;
+  if (IsAt("<?xml") && pos_ + 5 < size_ && IsWhitespace(data_[pos_ + 5])) {
+    status = ParseXmlDeclaration();
+  }
+
+  while (status == kSucceeded && pos_ < size_) {
+    if (data_[pos_] != '<') {
+      status = ParseText();
+    } else if (IsAt("<!--")) {
+      status = ParseComment();
+    } else if (IsAt("<![CDATA[")) {
+      status = ParseCData();
+    } else if (IsAt("<!DOCTYPE")) {
+      status = kUnsupported;
+    } else if (IsAt("<?")) {
+      status = ParseProcessingInstruction();
+    } else if (IsAt("</")) {
+      status = ParseEndTag();
+    } else {
+      status = ParseStartTag();
+    }
+  }
+
+  if (status == kSucceeded && (!has_root_ || depth_)) {
+    status = kMalformed;
+  }
+  return status;
+}
+
+bool XmlSaxParser::IsAt(const char* token) const {
+  const size_t length = strlen(token);
+  return size_ - pos_ >= length && memcmp(data_ + pos_, token, length) == 0;
+}
+
+bool XmlSaxParser::SkipWhitespace() {
+  const size_t start = pos_;
+  while (pos_ < size_ && IsWhitespace(data_[pos_])) {
+    ++pos_;
+  }
+  return pos_ != start;
+}
+
+// Only the encoding is checked. The declaration is otherwise skipped.
+XmlSaxParser::Status XmlSaxParser::ParseXmlDeclaration() {
+  pos_ += strlen("<?xml");
+
+  std::string name;
+  std::string value;
+  for (;;) {
+    SkipWhitespace();
+    if (IsAt("?>")) {
+      pos_ += 2;
+      SplitText();
+      return kSucceeded;
+    }
+    if (!ParseName(&name)) {
+      return kMalformed;
+    }
+    SkipWhitespace();
+    if (!IsAt("=")) {
+      return kMalformed;
+    }
+    ++pos_;
+    SkipWhitespace();
+    value.clear();
+    if (!ParseAttributeValue(&value)) {
+      return kMalformed;
+    }
+    if (name == "encoding" &&
+        !EqualsIgnoreCase(value, "utf-8") &&
+        !EqualsIgnoreCase(value, "utf8")) {
+      return kUnsupported;
+    }
+  }
+}
+
+XmlSaxParser::Status XmlSaxParser::ParseComment() {
+  pos_ += strlen("<!--");
+  for (;;) {
+    const char* dashes = static_cast<const char*>(
+        memchr(data_ + pos_, '-', size_ - pos_));
+    if (!dashes) {
+      pos_ = size_;
+      return kMalformed;
+    }
+    pos_ = dashes - data_;
+
+    // The comment ends at the first "--", which must be followed by '>'.
+    if (IsAt("--")) {
+      if (!IsAt("-->")) {
+        return kMalformed;
+      }
+      pos_ += 3;
+      SplitText();
+      return kSucceeded;
+    }
+    ++pos_;
+  }
+}
+
+XmlSaxParser::Status XmlSaxParser::ParseProcessingInstruction() {
+  pos_ += 2;
+
+  std::string target;
+  if (!ParseName(&target) || EqualsIgnoreCase(target, "xml")) {
+    return kMalformed;
+  }
+
+  for (; pos_ < size_; ++pos_) {
+    if (IsAt("?>")) {
+      pos_ += 2;
+      return kSucceeded;
+    }
+  }
+  return kMalformed;
+}
+
+XmlSaxParser::Status XmlSaxParser::ParseCData() {
+  if (!depth_) {
+    return kMalformed;
+  }
+
+  pos_ += strlen("<![CDATA[");
+  const size_t start = pos_;
+  for (; pos_ < size_; ++pos_) {
+    if (IsAt("]]>")) {
+      std::string* text = text_buffer();
+      if (text) {
+        // Only the line breaks are normalized in a CDATA section.
+        const char* p = data_ + start;
+        const char* end = data_ + pos_;
+        for (; p != end; ++p) {
+          if (*p != '\r') {
+            text->push_back(*p);
+          } else if (p + 1 == end || p[1] != '\n') {
+            text->push_back('\n');
+          }
+        }
+      }
+      pos_ += 3;
+      SplitText();
+      return kSucceeded;
+    }
+  }
+  return kMalformed;
+}
+
+XmlSaxParser::Status XmlSaxParser::ParseStartTag() {
+  if (has_root_ && !depth_) {
+    return kMalformed;
+  }
+
+  XmlSaxElement* element = pending_element_ == &elements_[0] ? &elements_[1] :
+                                                               &elements_[0];
+  element->Clear();
+
+  if (depth_ == open_elements_.size()) {
+    open_elements_.push_back(std::string());
+  }
+  std::string& qualified_name = open_elements_[depth_];
+
+  ++pos_;
+  if (!ParseName(&qualified_name)) {
+    return kMalformed;
+  }
+  const size_t colon = qualified_name.rfind(':');
+  if (colon == std::string::npos) {
+    element->name_ = qualified_name;
+  } else {
+    element->name_.assign(qualified_name, colon + 1, std::string::npos);
+  }
+
+  bool is_empty = false;
+  for (;;) {
+    const bool has_whitespace = SkipWhitespace();
+    if (IsAt(">")) {
+      ++pos_;
+      break;
+    }
+    if (IsAt("/>")) {
+      pos_ += 2;
+      is_empty = true;
+      break;
+    }
+    if (!has_whitespace) {
+      return kMalformed;
+    }
+
+    XmlSaxElement::Attribute* attribute = element->AddAttribute();
+    if (!ParseName(&attribute->name)) {
+      return kMalformed;
+    }
+    SkipWhitespace();
+    if (!IsAt("=")) {
+      return kMalformed;
+    }
+    ++pos_;
+    SkipWhitespace();
+    if (!ParseAttributeValue(&attribute->value)) {
+      return kMalformed;
+    }
+    for (size_t i = 0; i + 1 < element->num_attributes_; ++i) {
+      if (element->attributes_[i].name == attribute->name) {
+        return kMalformed;
+      }
+    }
+  }
+
+  // The parent is reported before its first child.
+  Status status = StartPendingElement(true);
+  if (status != kSucceeded) {
+    return status;
+  }
+
+  has_root_ = true;
+  ++depth_;
+  pending_element_ = element;
+
+  if (is_empty) {
+    status = StartPendingElement(false);
+    if (status != kSucceeded) {
+      return status;
+    }
+    --depth_;
+    if (!handler_->OnEndElement(element->name_)) {
+      return kAborted;
+    }
+  }
+  return kSucceeded;
+}
+
+XmlSaxParser::Status XmlSaxParser::ParseEndTag() {
+  if (!depth_) {
+    return kMalformed;
+  }
+
+  pos_ += 2;
+  const std::string& qualified_name = open_elements_[depth_ - 1];
+  if (!IsAt(qualified_name.c_str())) {
+    return kMalformed;
+  }
+  pos_ += qualified_name.size();
+  SkipWhitespace();
+  if (!IsAt(">")) {
+    return kMalformed;
+  }
+  ++pos_;
+
+  Status status = StartPendingElement(false);
+  if (status != kSucceeded) {
+    return status;
+  }
+
+  --depth_;
+  const size_t colon = qualified_name.rfind(':');
+  scratch_.assign(qualified_name,
+                  colon == std::string::npos ? 0 : colon + 1,
+                  std::string::npos);
+  return handler_->OnEndElement(scratch_) ? kSucceeded : kAborted;
+}
+
+XmlSaxParser::Status XmlSaxParser::ParseText() {
+  const char* start = data_ + pos_;
+  const char* end = static_cast<const char*>(
+      memchr(start, '<', size_ - pos_));
+  if (!end) {
+    end = data_ + size_;
+  }
+  pos_ = end - data_;
+
+  if (!depth_) {
+    for (const char* p = start; p != end; ++p) {
+      if (!IsWhitespace(*p)) {
+        pos_ = p - data_;
+        return kMalformed;
+      }
+    }
+    return kSucceeded;
+  }
+
+  std::string* text = text_buffer();
+  if (!text) {
+    scratch_.clear();
+    text = &scratch_;
+  }
+  if (!AppendCharacterData(start, end, false, text)) {
+    pos_ = start - data_;
+    return kMalformed;
+  }
+  return kSucceeded;
+}
+
+bool XmlSaxParser::ParseName(std::string* name) {
+  const size_t start = pos_;
+  while (pos_ < size_ && IsNameChar(data_[pos_])) {
+    ++pos_;
+  }
+  if (pos_ == start ||
+      IsAsciiDigit(data_[start]) ||
+      data_[start] == '-' ||
+      data_[start] == '.') {
+    pos_ = start;
+    return false;
+  }
+  name->assign(data_ + start, pos_ - start);
+  return true;
+}
+
+bool XmlSaxParser::ParseAttributeValue(std::string* value) {
+  if (pos_ == size_ || (data_[pos_] != '"' && data_[pos_] != '\'')) {
+    return false;
+  }
+  const char quote = data_[pos_];
+  const char* start = data_ + pos_ + 1;
+  const char* end = static_cast<const char*>(
+      memchr(start, quote, size_ - pos_ - 1));
+  if (!end || memchr(start, '<', end - start)) {
+    return false;
+  }
+  if (!AppendCharacterData(start, end, true, value)) {
+    return false;
+  }
+  pos_ = end - data_ + 1;
+  return true;
+}
+
+XmlSaxParser::Status XmlSaxParser::StartPendingElement(
+    bool has_child_elements) {
+  if (!pending_element_) {
+    return kSucceeded;
+  }
+
+  XmlSaxElement* element = pending_element_;
+  pending_element_ = NULL;
+  element->has_child_elements_ = has_child_elements;
+  return handler_->OnStartElement(*element) ? kSucceeded : kAborted;
+}
+
+std::string* XmlSaxParser::text_buffer() {
+  return pending_element_ ? &pending_element_->text_ : NULL;
+}
+
+void XmlSaxParser::SplitText() {
+  if (pending_element_) {
+    pending_element_->is_text_split_ = true;
+  }
+}
+
+}  // namespace omaha
@@ -0,0 +1,187 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// A streaming parser for UTF-8 XML documents. The parser does not build a
+// tree: it reports each element to a handler as soon as the element has been
+// read, reusing the same buffers for all the elements of the document.
+//
+// The parser supports the subset of XML that the update server sends:
+// the XML declaration, comments, processing instructions, CDATA sections, and
+// the predefined and numeric character references. Documents that declare
+// another encoding or a DTD are reported as unsupported, so that the caller
+// can load them with a complete XML parser instead.
+//
+// The parser only depends on the C++ standard library, so that it can be
+// built, tested, and fuzzed on any platform.
+
+#ifndef OMAHA_BASE_XML_SAX_PARSER_H_
+#define OMAHA_BASE_XML_SAX_PARSER_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+// The start tag of an element and the text that it contains. All strings are
+// UTF-8, with the references already replaced.
+class XmlSaxElement {
+ public:
+  XmlSaxElement();
+  ~XmlSaxElement();
+
+  // Returns the name of the element without its namespace prefix.
+  const std::string& name() const { return name_; }
+
+  // Returns the value of the attribute |name|, or NULL if the element does
+  // not have the attribute. The name must be given as written in the
+  // document, including its namespace prefix if any.
+  const std::string* FindAttribute(const char* name) const;
+
+  size_t num_attributes() const { return num_attributes_; }
+
+  // Returns the character data which precedes the first child element. This
+  // is the whole text of the element when it has no child elements.
+  const std::string& text() const { return text_; }
+
+  bool has_child_elements() const { return has_child_elements_; }
+
+  // Returns true if comments, processing instructions or CDATA sections occur
+  // before the first child element. A DOM holds such text in several nodes
+  // instead of a single text node.
+  bool is_text_split() const { return is_text_split_; }
+
+ private:
+  struct Attribute {
+    std::string name;
+    std::string value;
+  };
+
+  // Empties the element. The buffers are kept, so that parsing the next
+  // element does not allocate memory unless it is larger.
+  void Clear();
+
+  // Returns the storage for a new attribute.
+  Attribute* AddAttribute();
+
+  std::string name_;
+
+  // Only the first |num_attributes_| entries are in use.
+  std::vector<Attribute> attributes_;
+  size_t num_attributes_;
+
+  std::string text_;
+  bool has_child_elements_;
+  bool is_text_split_;
+
+  friend class XmlSaxParser;
+  DISALLOW_COPY_AND_ASSIGN(XmlSaxElement);
+};
+
+class XmlSaxHandler {
+ public:
+  virtual ~XmlSaxHandler() {}
+
+  // Called when the start tag of |element| and the text which precedes its
+  // first child element have been read. Parents are reported before their
+  // children, in document order. Returns false to stop parsing.
+  virtual bool OnStartElement(const XmlSaxElement& element) = 0;
+
+  // Called when the end tag of the element |name| has been read. Returns
+  // false to stop parsing.
+  virtual bool OnEndElement(const std::string& name) = 0;
+};
+
+class XmlSaxParser {
+ public:
+  enum Status {
+    kSucceeded,
+
+    // The document is not well-formed.
+    kMalformed,
+
+    // The document is not UTF-8 or it has a DTD.
+    kUnsupported,
+
+    // The handler stopped parsing.
+    kAborted,
+  };
+
+  XmlSaxParser();
+  ~XmlSaxParser();
+
+  // Parses the document and reports its elements to |handler|. The elements
+  // before an error are reported to the handler.
+  Status Parse(const char* data, size_t size, XmlSaxHandler* handler);
+
+  // Returns the offset in the document where parsing stopped.
+  size_t error_offset() const { return pos_; }
+
+ private:
+  bool IsAt(const char* token) const;
+  bool SkipWhitespace();
+
+  Status ParseXmlDeclaration();
+  Status ParseComment();
+  Status ParseProcessingInstruction();
+  Status ParseCData();
+  Status ParseStartTag();
+  Status ParseEndTag();
+  Status ParseText();
+
+  // Reads a name and advances past it.
+  bool ParseName(std::string* name);
+
+  // Reads an attribute value in quotes and advances past it.
+  bool ParseAttributeValue(std::string* value);
+
+  // Reports the pending element to the handler.
+  Status StartPendingElement(bool has_child_elements);
+
+  // Returns the buffer where the text of the current element is appended, or
+  // NULL if the text is not reported.
+  std::string* text_buffer();
+
+  // Records that the text of the current element is split by a node which is
+  // not text.
+  void SplitText();
+
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+  XmlSaxHandler* handler_;
+
+  // The qualified names of the elements which are open. Only the first
+  // |depth_| entries are in use.
+  std::vector<std::string> open_elements_;
+  size_t depth_;
+  bool has_root_;
+
+  // The element whose start tag has been read but which is not reported yet
+  // because its text is still being read. The two elements alternate, since
+  // the start tag of the first child is read before its parent is reported.
+  XmlSaxElement elements_[2];
+  XmlSaxElement* pending_element_;
+
+  // Receives the text which is not reported, so that it is still checked.
+  std::string scratch_;
+
+  DISALLOW_COPY_AND_ASSIGN(XmlSaxParser);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_XML_SAX_PARSER_H_
@@ -0,0 +1,223 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/xml_sax_parser.h"
+#include <string>
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// Records the elements as a compact string, for example "<a x=1>[text]</a>".
+// The text is marked with a '~' when it is split by other nodes.
+class RecordingHandler : public XmlSaxHandler {
+ public:
+  explicit RecordingHandler(const char* stop_element)
+      : stop_element_(stop_element) {}
+
+  virtual bool OnStartElement(const XmlSaxElement& element) {
+    events_ += "<" + element.name();
+    const char* const kAttributes[] = { "x", "y", "o:z" };
+    for (size_t i = 0; i != arraysize(kAttributes); ++i) {
+      const std::string* value = element.FindAttribute(kAttributes[i]);
+      if (value) {
+        events_ += std::string(" ") + kAttributes[i] + "=" + *value;
+      }
+    }
+    events_ += element.has_child_elements() ? ">+" : ">";
+    if (element.is_text_split()) {
+      events_ += "~";
+    }
+    if (!element.text().empty()) {
+      events_ += "[" + element.text() + "]";
+    }
+    return !stop_element_ || element.name() != stop_element_;
+  }
+
+  virtual bool OnEndElement(const std::string& name) {
+    events_ += "</" + name + ">";
+    return true;
+  }
+
+  const std::string& events() const { return events_; }
+
+ private:
+  const char* stop_element_;
+  std::string events_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordingHandler);
+};
+
+XmlSaxParser::Status Parse(const std::string& document, std::string* events) {
+  RecordingHandler handler(NULL);
+  XmlSaxParser parser;
+  XmlSaxParser::Status status = parser.Parse(document.data(),
+                                             document.size(),
+                                             &handler);
+  *events = handler.events();
+  return status;
+}
+
+}  // namespace
+
+TEST(XmlSaxParserTest, Elements) {
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                  "<a x=\"1\"><b y='2'/><c>text</c>tail</a>",
+                  &events));
+  EXPECT_STREQ("<a x=1>+<b y=2></b><c>[text]</c></a>", events.c_str());
+}
+
+// The parent is reported with the text which precedes its first child.
+TEST(XmlSaxParserTest, TextBeforeFirstChild) {
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<a>head<b/>tail</a>", &events));
+  EXPECT_STREQ("<a>+[head]<b></b></a>", events.c_str());
+}
+
+TEST(XmlSaxParserTest, NamespacePrefixes) {
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<o:a xmlns:o=\"http://www.google.com/update2/response\" "
+                  "o:z=\"3\"><o:b/></o:a>",
+                  &events));
+  EXPECT_STREQ("<a o:z=3>+<b></b></a>", events.c_str());
+}
+
+TEST(XmlSaxParserTest, References) {
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<a x=\"&lt;&gt;&amp;&quot;&apos;\">&#65;&#x42;&#xe9;</a>",
+                  &events));
+  EXPECT_STREQ("<a x=<>&\"'>[AB\xC3\xA9]</a>", events.c_str());
+
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a>&unknown;</a>", &events));
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a>&amp</a>", &events));
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a>&#0;</a>", &events));
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a>&#xD800;</a>", &events));
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a>&#x110000;</a>", &events));
+}
+
+TEST(XmlSaxParserTest, Whitespace) {
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("\xEF\xBB\xBF<a x=\"1\t2\r\n3\">one\r\ntwo\rthree</a>\r\n",
+                  &events));
+  EXPECT_STREQ("<a x=1 2 3>[one\ntwo\nthree]</a>", events.c_str());
+}
+
+TEST(XmlSaxParserTest, CommentsAndCData) {
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<!-- head --><?target data?>"
+                  "<a><!-- <b/> -->one<![CDATA[<&>]]>two</a>",
+                  &events));
+  EXPECT_STREQ("<a>~[one<&>two]</a>", events.c_str());
+
+  // Only the nodes which precede the first child element split the text.
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<a>one<b>two</b><!-- c --></a>", &events));
+  EXPECT_STREQ("<a>+[one]<b>[two]</b></a>", events.c_str());
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<a><?target data?>one</a>", &events));
+  EXPECT_STREQ("<a>~[one]</a>", events.c_str());
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            Parse("<a><![CDATA[one]]></a>", &events));
+  EXPECT_STREQ("<a>~[one]</a>", events.c_str());
+
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a><!-- -- --></a>", &events));
+  EXPECT_EQ(XmlSaxParser::kMalformed, Parse("<a><![CDATA[</a>", &events));
+}
+
+TEST(XmlSaxParserTest, Malformed) {
+  const char* const kDocuments[] = {
+    "",
+    "   ",
+    "text",
+    "<a>",
+    "<a></b>",
+    "<a><b></a></b>",
+    "<a/><b/>",
+    "text<a/>",
+    "<a/>text",
+    "<a x=1/>",
+    "<a x=\"1\"y=\"2\"/>",
+    "<a x=\"1\" x=\"2\"/>",
+    "<a x=\"<\"/>",
+    "<1a/>",
+    "<a>\x01</a>",
+    "<a>\xC3</a>",
+    "<a>\xC0\xAF</a>",
+    "<a>\xED\xA0\x80</a>",
+    "<a/><?xml version=\"1.0\"?>",
+  };
+
+  for (size_t i = 0; i != arraysize(kDocuments); ++i) {
+    std::string events;
+    EXPECT_EQ(XmlSaxParser::kMalformed, Parse(kDocuments[i], &events))
+        << kDocuments[i];
+  }
+}
+
+TEST(XmlSaxParserTest, Unsupported) {
+  const char* const kDocuments[] = {
+    "<?xml version=\"1.0\" encoding=\"UTF-16\"?><a/>",
+    "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><a/>",
+    "<!DOCTYPE a [<!ENTITY e \"entity\">]><a>&e;</a>",
+  };
+
+  for (size_t i = 0; i != arraysize(kDocuments); ++i) {
+    std::string events;
+    EXPECT_EQ(XmlSaxParser::kUnsupported, Parse(kDocuments[i], &events))
+        << kDocuments[i];
+  }
+
+  const char kUtf16Document[] = "\xFF\xFE<\0a\0/\0>\0";
+  std::string events;
+  EXPECT_EQ(XmlSaxParser::kUnsupported,
+            Parse(std::string(kUtf16Document, sizeof(kUtf16Document) - 1),
+                  &events));
+}
+
+TEST(XmlSaxParserTest, HandlerStopsParsing) {
+  const std::string document("<a><b/><c/></a>");
+  RecordingHandler handler("b");
+  XmlSaxParser parser;
+  EXPECT_EQ(XmlSaxParser::kAborted,
+            parser.Parse(document.data(), document.size(), &handler));
+  EXPECT_STREQ("<a>+<b>", handler.events().c_str());
+}
+
+// The same parser can be used for several documents.
+TEST(XmlSaxParserTest, Reuse) {
+  const std::string document1("<a x=\"1\" y=\"2\">one</a>");
+  const std::string document2("<b y=\"3\"/>");
+  XmlSaxParser parser;
+
+  RecordingHandler handler1(NULL);
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            parser.Parse(document1.data(), document1.size(), &handler1));
+  EXPECT_STREQ("<a x=1 y=2>[one]</a>", handler1.events().c_str());
+
+  RecordingHandler handler2(NULL);
+  EXPECT_EQ(XmlSaxParser::kSucceeded,
+            parser.Parse(document2.data(), document2.size(), &handler2));
+  EXPECT_STREQ("<b y=3></b>", handler2.events().c_str());
+}
+
+}  // namespace omaha
@@ -0,0 +1,229 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/xml_writer.h"
+#include <stdlib.h>
+#include <string.h>
+#include "omaha/base/debug.h"
+
+namespace omaha {
+
+namespace {
+
+const char kXmlDeclaration[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+
+// Returns the escape sequence of |c|, or NULL if |c| is written as is.
+const char* GetEscapeSequence(TCHAR c, bool is_attribute_value) {
+  switch (c) {
+    case _T('&'):
+      return "&amp;";
+    case _T('<'):
+      return "&lt;";
+    case _T('>'):
+      return "&gt;";
+    case _T('"'):
+      return is_attribute_value ? "&quot;" : NULL;
+    case _T('\t'):
+      return is_attribute_value ? "&#x9;" : NULL;
+    case _T('\n'):
+      return is_attribute_value ? "&#xA;" : NULL;
+    case _T('\r'):
+      return is_attribute_value ? "&#xD;" : NULL;
+    default:
+      return NULL;
+  }
+}
+
+}  // namespace
+
+XmlWriter::XmlWriter(CStringA* buffer)
+    : buffer_(buffer),
+      is_start_tag_open_(false) {
+  ASSERT1(buffer);
+}
+
+XmlWriter::~XmlWriter() {
+}
+
+void XmlWriter::WriteDeclaration() {
+  ASSERT1(open_elements_.empty());
+  buffer_->Append(kXmlDeclaration, arraysize(kXmlDeclaration) - 1);
+}
+
+void XmlWriter::StartElement(const TCHAR* name) {
+  ASSERT1(name && *name);
+
+  CloseStartTag();
+
+  buffer_->AppendChar('<');
+  ElementSpan element = {0};
+  element.name_offset = buffer_->GetLength();
+  AppendEscaped(name, false);
+  element.name_length = buffer_->GetLength() - element.name_offset;
+  open_elements_.push_back(element);
+
+  is_start_tag_open_ = true;
+  attributes_.clear();
+}
+
+void XmlWriter::AddAttribute(const TCHAR* name, const TCHAR* value) {
+  ASSERT1(name && *name);
+  ASSERT1(is_start_tag_open_);
+
+  // The value is also written if it is NULL, like the DOM does.
+  if (!value) {
+    value = _T("");
+  }
+
+  buffer_->AppendChar(' ');
+  AttributeSpan attribute = {0};
+  attribute.name_offset = buffer_->GetLength();
+  AppendEscaped(name, false);
+  attribute.name_length = buffer_->GetLength() - attribute.name_offset;
+  buffer_->Append("=\"", 2);
+  attribute.value_offset = buffer_->GetLength();
+  AppendEscaped(value, true);
+  attribute.value_length = buffer_->GetLength() - attribute.value_offset;
+  buffer_->AppendChar('"');
+
+  for (size_t i = 0; i != attributes_.size(); ++i) {
+    AttributeSpan& existing = attributes_[i];
+    if (existing.name_length != attribute.name_length ||
+        memcmp(buffer_->GetString() + existing.name_offset,
+               buffer_->GetString() + attribute.name_offset,
+               attribute.name_length)) {
+      continue;
+    }
+
+    // Moves the new value into the existing attribute, then shifts the
+    // attributes which follow it.
+    const CStringA new_value(buffer_->Mid(attribute.value_offset,
+                                          attribute.value_length));
+    buffer_->Truncate(attribute.name_offset - 1);
+    buffer_->Delete(existing.value_offset, existing.value_length);
+    buffer_->Insert(existing.value_offset, new_value);
+
+    const int delta = attribute.value_length - existing.value_length;
+    existing.value_length = attribute.value_length;
+    for (size_t j = i + 1; j != attributes_.size(); ++j) {
+      attributes_[j].name_offset += delta;
+      attributes_[j].value_offset += delta;
+    }
+    return;
+  }
+
+  attributes_.push_back(attribute);
+}
+
+void XmlWriter::AddAttribute(const TCHAR* name, int value) {
+  TCHAR value_string[16] = {0};
+  VERIFY1(!_itot_s(value, value_string, arraysize(value_string), 10));
+  AddAttribute(name, value_string);
+}
+
+void XmlWriter::WriteText(const TCHAR* text) {
+  ASSERT1(text);
+  ASSERT1(!open_elements_.empty());
+
+  CloseStartTag();
+  AppendEscaped(text, false);
+}
+
+void XmlWriter::EndElement() {
+  ASSERT1(!open_elements_.empty());
+
+  const ElementSpan element = open_elements_.back();
+  open_elements_.pop_back();
+
+  if (is_start_tag_open_) {
+    is_start_tag_open_ = false;
+    buffer_->Append("/>", 2);
+    return;
+  }
+
+  buffer_->Append("</", 2);
+
+  // Append() handles a source which is in the buffer being appended to.
+  buffer_->Append(buffer_->GetString() + element.name_offset,
+                  element.name_length);
+  buffer_->AppendChar('>');
+}
+
+void XmlWriter::AppendEscaped(const TCHAR* text, bool is_attribute_value) {
+  ASSERT1(text);
+
+  // The characters are converted in a small buffer on the stack, which is
+  // appended when it is almost full. No sequence is longer than 8 bytes.
+  const int kChunkSize = 256;
+  char chunk[kChunkSize] = {0};
+  int size = 0;
+  for (const TCHAR* p = text; *p; ++p) {
+    if (size > kChunkSize - 8) {
+      buffer_->Append(chunk, size);
+      size = 0;
+    }
+
+    const TCHAR c = *p;
+    const char* escape_sequence = GetEscapeSequence(c, is_attribute_value);
+    if (escape_sequence) {
+      const size_t length = strlen(escape_sequence);
+      memcpy(chunk + size, escape_sequence, length);
+      size += static_cast<int>(length);
+      continue;
+    }
+
+    if (c < 0x80) {
+      chunk[size++] = static_cast<char>(c);
+      continue;
+    }
+
+    // Decodes the surrogate pairs. The surrogates which are not paired are
+    // replaced, as WideCharToMultiByte does.
+    unsigned int code_point = c;
+    if (c >= 0xD800 && c <= 0xDBFF && p[1] >= 0xDC00 && p[1] <= 0xDFFF) {
+      code_point = 0x10000 + ((c - 0xD800) << 10) + (p[1] - 0xDC00);
+      ++p;
+    } else if (c >= 0xD800 && c <= 0xDFFF) {
+      code_point = 0xFFFD;
+    }
+
+    if (code_point < 0x800) {
+      chunk[size++] = static_cast<char>(0xC0 | (code_point >> 6));
+      chunk[size++] = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+      chunk[size++] = static_cast<char>(0xE0 | (code_point >> 12));
+      chunk[size++] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+      chunk[size++] = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+      chunk[size++] = static_cast<char>(0xF0 | (code_point >> 18));
+      chunk[size++] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+      chunk[size++] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+      chunk[size++] = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+  }
+
+  if (size) {
+    buffer_->Append(chunk, size);
+  }
+}
+
+void XmlWriter::CloseStartTag() {
+  if (is_start_tag_open_) {
+    is_start_tag_open_ = false;
+    buffer_->AppendChar('>');
+  }
+}
+
+}  // namespace omaha
@@ -0,0 +1,96 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Writes an XML document as UTF-8 directly into a buffer, without building a
+// DOM. The output has the same form as the xml property of an MSXML DOM
+// document: no whitespace between the elements, empty elements written as
+// <name/>, and the same characters escaped.
+
+#ifndef OMAHA_BASE_XML_WRITER_H_
+#define OMAHA_BASE_XML_WRITER_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+#include "base/basictypes.h"
+
+namespace omaha {
+
+class XmlWriter {
+ public:
+  // The document is appended to |buffer|, which is not owned. The buffer can
+  // be truncated and reused for the next document, to keep its memory.
+  explicit XmlWriter(CStringA* buffer);
+  ~XmlWriter();
+
+  // Writes the XML declaration.
+  void WriteDeclaration();
+
+  void StartElement(const TCHAR* name);
+
+  // Adds an attribute to the element which has just been started. Adding an
+  // attribute again replaces its value, as IXMLDOMNamedNodeMap::setNamedItem
+  // does.
+  void AddAttribute(const TCHAR* name, const TCHAR* value);
+  void AddAttribute(const TCHAR* name, int value);
+
+  void WriteText(const TCHAR* text);
+
+  // Ends the element which was started last.
+  void EndElement();
+
+  // Returns true if all the elements have been ended. A writer can be
+  // destroyed before it is complete, when the document is abandoned.
+  bool is_complete() const { return open_elements_.empty(); }
+
+ private:
+  // The location of the name of an element in the buffer.
+  struct ElementSpan {
+    int name_offset;
+    int name_length;
+  };
+
+  // The location of an attribute of the current start tag in the buffer.
+  struct AttributeSpan {
+    int name_offset;
+    int name_length;
+    int value_offset;
+    int value_length;
+  };
+
+  // Appends |text| as UTF-8. The characters which are markup are escaped,
+  // as well as the quotes and the whitespace other than spaces if the text
+  // is an attribute value.
+  void AppendEscaped(const TCHAR* text, bool is_attribute_value);
+
+  // Ends the start tag of the current element, before its content.
+  void CloseStartTag();
+
+  // Not owned by this object.
+  CStringA* buffer_;
+
+  // The elements which are not ended yet. Their names are copied from their
+  // start tags when they end.
+  std::vector<ElementSpan> open_elements_;
+
+  bool is_start_tag_open_;
+  std::vector<AttributeSpan> attributes_;
+
+  DISALLOW_COPY_AND_ASSIGN(XmlWriter);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_BASE_XML_WRITER_H_
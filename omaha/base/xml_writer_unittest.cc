@@ -0,0 +1,143 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <windows.h>
+#include <atlstr.h>
+#include "omaha/base/xml_writer.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+TEST(XmlWriterTest, Elements) {
+  CStringA buffer;
+  XmlWriter writer(&buffer);
+  writer.WriteDeclaration();
+  writer.StartElement(_T("request"));
+  writer.AddAttribute(_T("protocol"), _T("3.0"));
+  writer.StartElement(_T("hw"));
+  writer.AddAttribute(_T("physmemory"), 2);
+  writer.AddAttribute(_T("delta"), -15);
+  writer.EndElement();
+  writer.StartElement(_T("data"));
+  writer.WriteText(_T("text"));
+  writer.EndElement();
+  writer.StartElement(_T("app"));
+  writer.StartElement(_T("ping"));
+  writer.EndElement();
+  writer.EndElement();
+  EXPECT_FALSE(writer.is_complete());
+  writer.EndElement();
+  EXPECT_TRUE(writer.is_complete());
+
+  EXPECT_STREQ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+               "<request protocol=\"3.0\">"
+               "<hw physmemory=\"2\" delta=\"-15\"/>"
+               "<data>text</data>"
+               "<app><ping/></app>"
+               "</request>",
+               buffer);
+}
+
+TEST(XmlWriterTest, Abandoned) {
+  CStringA buffer;
+  {
+    XmlWriter writer(&buffer);
+    writer.StartElement(_T("request"));
+    writer.StartElement(_T("app"));
+    EXPECT_FALSE(writer.is_complete());
+  }
+  EXPECT_STREQ("<request><app", buffer);
+}
+
+TEST(XmlWriterTest, Escaping) {
+  CStringA buffer;
+  XmlWriter writer(&buffer);
+  writer.StartElement(_T("a"));
+  writer.AddAttribute(_T("x"), _T("<\"&'>"));
+  writer.AddAttribute(_T("y"), _T("1\t2\r\n3"));
+  writer.WriteText(_T("<\"&'>\t\r\n"));
+  writer.EndElement();
+
+  EXPECT_STREQ("<a x=\"&lt;&quot;&amp;'&gt;\" y=\"1&#x9;2&#xD;&#xA;3\">"
+               "&lt;\"&amp;'&gt;\t\r\n</a>",
+               buffer);
+}
+
+TEST(XmlWriterTest, Utf8) {
+  CStringA buffer;
+  XmlWriter writer(&buffer);
+  writer.StartElement(_T("a"));
+
+  // U+00E9, U+20AC, U+1F600, and a surrogate which is not paired.
+  writer.AddAttribute(_T("x"), L"\x00e9\x20ac\xD83D\xDE00\xDC00");
+  writer.EndElement();
+
+  EXPECT_STREQ("<a x=\"\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\xEF\xBF\xBD\"/>",
+               buffer);
+}
+
+// Adding an attribute again replaces its value in place, whether the value
+// gets longer or shorter.
+TEST(XmlWriterTest, ReplaceAttribute) {
+  CStringA buffer;
+  XmlWriter writer(&buffer);
+  writer.StartElement(_T("a"));
+  writer.AddAttribute(_T("x"), _T("1"));
+  writer.AddAttribute(_T("y"), _T("2"));
+  writer.AddAttribute(_T("z"), _T("3"));
+  writer.AddAttribute(_T("x"), _T("long&value"));
+  writer.AddAttribute(_T("z"), _T("4"));
+  writer.AddAttribute(_T("x"), _T(""));
+  writer.StartElement(_T("b"));
+  writer.AddAttribute(_T("x"), _T("5"));
+  writer.EndElement();
+  writer.EndElement();
+
+  EXPECT_STREQ("<a x=\"\" y=\"2\" z=\"4\"><b x=\"5\"/></a>", buffer);
+}
+
+// Long values are converted in several chunks.
+TEST(XmlWriterTest, LongText) {
+  CString text;
+  CStringA expected("<a>");
+  for (int i = 0; i != 1000; ++i) {
+    text += _T("&\x00e9");
+    expected += "&amp;\xC3\xA9";
+  }
+  expected += "</a>";
+
+  CStringA buffer;
+  XmlWriter writer(&buffer);
+  writer.StartElement(_T("a"));
+  writer.WriteText(text);
+  writer.EndElement();
+
+  EXPECT_STREQ(expected, buffer);
+}
+
+// The writer appends to the buffer.
+TEST(XmlWriterTest, Append) {
+  CStringA buffer("prefix");
+  XmlWriter writer(&buffer);
+  writer.StartElement(_T("a"));
+  writer.AddAttribute(_T("x"), _T("1"));
+  writer.AddAttribute(_T("x"), _T("2"));
+  writer.WriteText(_T("a"));
+  writer.EndElement();
+
+  EXPECT_STREQ("prefix<a x=\"2\">a</a>", buffer);
+}
+
+}  // namespace omaha
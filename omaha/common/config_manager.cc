@@ -103,11 +103,12 @@ HRESULT GetDir32(int csidl,
 
 // The app-specific value overrides the disable all value so read the former
 // first. If it doesn't exist, read the "disable all" value.
-bool GetEffectivePolicyForApp(const TCHAR* apps_default_value_name,
+bool GetEffectivePolicyForApp(const ConfigSnapshot& snapshot,
+                              const TCHAR* apps_default_value_name,
                               const TCHAR* app_prefix_name,
                               const GUID& app_guid,
                               DWORD* effective_policy) {
-  if (!IsEnrolledToDomain()) {
+  if (!snapshot.is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetEffectivePolicyForApp][Ignoring group policy for %s]")
                  _T("[machine is not part of a domain]"),
                  GuidToString(app_guid)));
@@ -121,20 +122,14 @@ bool GetEffectivePolicyForApp(const TCHAR* apps_default_value_name,
   CString app_value_name(app_prefix_name);
   app_value_name.Append(GuidToString(app_guid));
 
-  HRESULT hr = RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                                app_value_name,
-                                effective_policy);
-  if (SUCCEEDED(hr)) {
+  if (snapshot.GetPolicyValue(app_value_name, effective_policy)) {
     return true;
   } else {
     CORE_LOG(L4, (_T("[Failed to read Group Policy value][%s]"),
                   app_value_name));
   }
 
-  hr = RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                        apps_default_value_name,
-                        effective_policy);
-  if (SUCCEEDED(hr)) {
+  if (snapshot.GetPolicyValue(apps_default_value_name, effective_policy)) {
     return true;
   } else {
     CORE_LOG(L4, (_T("[Failed to read Group Policy value][%s]"),
@@ -148,19 +143,19 @@ bool GetEffectivePolicyForApp(const TCHAR* apps_default_value_name,
 // The value must be processed for limits and overflow before using.
 // Checks UpdateDev and Group Policy.
 // Returns true if either override was successefully read.
-bool GetLastCheckPeriodSecFromRegistry(DWORD* period_sec) {
+bool GetLastCheckPeriodSecFromRegistry(const ConfigSnapshot& snapshot,
+                                       DWORD* period_sec) {
   ASSERT1(period_sec);
 
   DWORD update_dev_sec = 0;
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueLastCheckPeriodSec,
-                                 &update_dev_sec))) {
+  if (snapshot.GetUpdateDevValue(kRegValueLastCheckPeriodSec,
+                                 &update_dev_sec)) {
     CORE_LOG(L5, (_T("['LastCheckPeriodSec' override %d]"), update_dev_sec));
     *period_sec = update_dev_sec;
     return true;
   }
 
-  if (!IsEnrolledToDomain()) {
+  if (!snapshot.is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetLastCheckPeriodSecFromRegistry]")
                  _T("[Ignoring group policy]")
                  _T("[machine is not part of a domain]")));
@@ -168,9 +163,8 @@ bool GetLastCheckPeriodSecFromRegistry(DWORD* period_sec) {
   }
 
   DWORD group_policy_minutes = 0;
-  if (SUCCEEDED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                                 kRegValueAutoUpdateCheckPeriodOverrideMinutes,
-                                 &group_policy_minutes))) {
+  if (snapshot.GetPolicyValue(kRegValueAutoUpdateCheckPeriodOverrideMinutes,
+                              &group_policy_minutes)) {
     CORE_LOG(L5, (_T("[Group Policy check period override %d]"),
                   group_policy_minutes));
 
@@ -185,24 +179,22 @@ bool GetLastCheckPeriodSecFromRegistry(DWORD* period_sec) {
   return false;
 }
 
-bool GetUpdatesSuppressedTimes(DWORD* start_hour,
+bool GetUpdatesSuppressedTimes(const ConfigSnapshot& snapshot,
+                               DWORD* start_hour,
                                DWORD* start_min,
                                DWORD* duration_min) {
-  if (!IsEnrolledToDomain()) {
+  if (!snapshot.is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetUpdatesSuppressedTimes][Ignoring group policy]")
                  _T("[machine is not part of a domain]")));
     return false;
   }
 
-  if (FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                              kRegValueUpdatesSuppressedStartHour,
-                              start_hour)) ||
-      FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                              kRegValueUpdatesSuppressedStartMin,
-                              start_min)) ||
-      FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                              kRegValueUpdatesSuppressedDurationMin,
-                              duration_min))) {
+  if (!snapshot.GetPolicyValue(kRegValueUpdatesSuppressedStartHour,
+                               start_hour) ||
+      !snapshot.GetPolicyValue(kRegValueUpdatesSuppressedStartMin,
+                               start_min) ||
+      !snapshot.GetPolicyValue(kRegValueUpdatesSuppressedDurationMin,
+                               duration_min)) {
     OPT_LOG(L5, (_T("[GetUpdatesSuppressedTimes][Missing time][%x][%x][%x]"),
                 *start_hour, *start_min, *duration_min));
     return false;
@@ -264,6 +256,29 @@ ConfigManager::ConfigManager() {
                                       path.GetLength(),
                                       true) == 0) :
                       false;
+
+  config_source_.reset(new RegistryConfigSource);
+}
+
+// The snapshot is replaced rather than modified, so the callers that still
+// hold the previous snapshot keep reading consistent values.
+shared_ptr<const ConfigSnapshot> ConfigManager::GetSnapshot() const {
+  __mutexScope(snapshot_lock_);
+  if (!snapshot_.get() || config_source_->HasChanged()) {
+    snapshot_.reset(new ConfigSnapshot(config_source_.get()));
+  }
+  return snapshot_;
+}
+
+void ConfigManager::InvalidateSnapshot() {
+  __mutexScope(snapshot_lock_);
+  snapshot_.reset();
+}
+
+void ConfigManager::SetConfigSourceForUnitTest(ConfigSource* source) {
+  __mutexScope(snapshot_lock_);
+  config_source_.reset(source ? source : new RegistryConfigSource);
+  snapshot_.reset();
 }
 
 CString ConfigManager::GetUserDownloadStorageDir() const {
@@ -375,16 +390,16 @@ int ConfigManager::GetPackageCacheSizeLimitMBytes() const {
   DWORD kDefaultCacheStorageLimit = 500;  // 500 MB
   DWORD kMaxCacheStorageLimit = 5000;     // 5 GB
 
-  if (!IsEnrolledToDomain()) {
+  shared_ptr<const ConfigSnapshot> snapshot(GetSnapshot());
+  if (!snapshot->is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetPackageCacheSizeLimitMBytes][Ignoring group policy]")
                  _T("[machine is not part of a domain]")));
     return kDefaultCacheStorageLimit;
   }
 
   DWORD cache_size_limit = 0;
-  if (FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                              kRegValueCacheSizeLimitMBytes,
-                              &cache_size_limit)) ||
+  if (!snapshot->GetPolicyValue(kRegValueCacheSizeLimitMBytes,
+                                &cache_size_limit) ||
       cache_size_limit > kMaxCacheStorageLimit ||
       cache_size_limit == 0) {
     cache_size_limit = kDefaultCacheStorageLimit;
@@ -397,7 +412,8 @@ int ConfigManager::GetPackageCacheExpirationTimeDays() const {
   DWORD kDefaultCacheLifeTimeInDays = 180;  // 180 days.
   DWORD kMaxCacheLifeTimeInDays = 1800;     // Roughly 5 years.
 
-  if (!IsEnrolledToDomain()) {
+  shared_ptr<const ConfigSnapshot> snapshot(GetSnapshot());
+  if (!snapshot->is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetPackageCacheExpirationTimeDays]")
                  _T("[Ignoring group policy]")
                  _T("[machine is not part of a domain]")));
@@ -405,9 +421,8 @@ int ConfigManager::GetPackageCacheExpirationTimeDays() const {
   }
 
   DWORD cache_life_limit = 0;
-  if (FAILED(RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                              kRegValueCacheLifeLimitDays,
-                              &cache_life_limit)) ||
+  if (!snapshot->GetPolicyValue(kRegValueCacheLifeLimitDays,
+                                &cache_life_limit) ||
       cache_life_limit > kMaxCacheLifeTimeInDays ||
       cache_life_limit == 0) {
     cache_life_limit = kDefaultCacheLifeTimeInDays;
@@ -416,6 +431,95 @@ int ConfigManager::GetPackageCacheExpirationTimeDays() const {
   return static_cast<int>(cache_life_limit);
 }
 
+int ConfigManager::GetPackageCacheReverifyIntervalSec() const {
+  DWORD reverify_interval_sec = 0;
+  if (GetSnapshot()->GetUpdateDevValue(kRegValuePackageCacheReverifySec,
+                                       &reverify_interval_sec)) {
+    CORE_LOG(L5, (_T("['PackageCacheReverifySec' override %d]"),
+                  reverify_interval_sec));
+    return reverify_interval_sec > INT_MAX ?
+        INT_MAX : static_cast<int>(reverify_interval_sec);
+  }
+
+  return 0;
+}
+
+bool ConfigManager::IsPackageCacheChunkStoreEnabled() const {
+  DWORD is_enabled = 0;
+  GetSnapshot()->GetUpdateDevValue(kRegValuePackageCacheChunkStore,
+                                   &is_enabled);
+  return is_enabled != 0;
+}
+
+int ConfigManager::GetDownloadPipelineDepth() const {
+  DWORD depth = 0;
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueDownloadPipelineDepth,
+                                       &depth)) {
+    CORE_LOG(L5, (_T("['DownloadPipelineDepth' override %d]"), depth));
+    if (depth < 1) {
+      return 1;
+    }
+    return depth > kMaxDownloadPipelineDepth ?
+        kMaxDownloadPipelineDepth : static_cast<int>(depth);
+  }
+
+  return kDefaultDownloadPipelineDepth;
+}
+
+int ConfigManager::GetMaxDownloadConnections() const {
+  DWORD max_connections = 0;
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueMaxDownloadConnections,
+                                       &max_connections)) {
+    CORE_LOG(L5, (_T("['MaxDownloadConnections' override %d]"),
+                  max_connections));
+    if (max_connections < 1) {
+      return 1;
+    }
+    return max_connections > kMaxDownloadConnections ?
+        kMaxDownloadConnections : static_cast<int>(max_connections);
+  }
+
+  return kDefaultMaxDownloadConnections;
+}
+
+int ConfigManager::GetDownloadHedgeDelayMs() const {
+  DWORD hedge_delay_ms = 0;
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueDownloadHedgeDelayMs,
+                                       &hedge_delay_ms)) {
+    CORE_LOG(L5, (_T("['DownloadHedgeDelayMs' override %d]"),
+                  hedge_delay_ms));
+    return hedge_delay_ms > INT_MAX ?
+        INT_MAX : static_cast<int>(hedge_delay_ms);
+  }
+
+  return 0;
+}
+
+int ConfigManager::GetProxyRaceDelayMs() const {
+  DWORD race_delay_ms = 0;
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueProxyRaceDelayMs,
+                                       &race_delay_ms)) {
+    CORE_LOG(L5, (_T("['ProxyRaceDelayMs' override %d]"), race_delay_ms));
+    return race_delay_ms > INT_MAX ?
+        INT_MAX : static_cast<int>(race_delay_ms);
+  }
+
+  return kDefaultProxyRaceDelayMs;
+}
+
+int ConfigManager::GetDownloadProgressSampleIntervalMs() const {
+  DWORD interval_ms = 0;
+  if (GetSnapshot()->GetUpdateDevValue(
+          kRegValueDownloadProgressSampleIntervalMs, &interval_ms)) {
+    CORE_LOG(L5, (_T("['DownloadProgressSampleIntervalMs' override %d]"),
+                  interval_ms));
+    return interval_ms > kMaxDownloadProgressSampleIntervalMs ?
+        kMaxDownloadProgressSampleIntervalMs : static_cast<int>(interval_ms);
+  }
+
+  return kDefaultDownloadProgressSampleIntervalMs;
+}
+
 CString ConfigManager::GetMachineGoopdateInstallDirNoCreate() const {
   CString path;
   VERIFY1(SUCCEEDED(GetDir32(CSIDL_PROGRAM_FILES,
@@ -441,9 +545,7 @@ bool ConfigManager::IsRunningFromMachineGoopdateInstallDir() const {
 HRESULT ConfigManager::GetPingUrl(CString* url) const {
   ASSERT1(url);
 
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNamePingUrl,
-                                 url))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNamePingUrl, url)) {
     CORE_LOG(L5, (_T("['ping url' override %s]"), *url));
     return S_OK;
   }
@@ -455,9 +557,7 @@ HRESULT ConfigManager::GetPingUrl(CString* url) const {
 HRESULT ConfigManager::GetUpdateCheckUrl(CString* url) const {
   ASSERT1(url);
 
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNameUrl,
-                                 url))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNameUrl, url)) {
     CORE_LOG(L5, (_T("['update check url' override %s]"), *url));
     return S_OK;
   }
@@ -469,9 +569,7 @@ HRESULT ConfigManager::GetUpdateCheckUrl(CString* url) const {
 HRESULT ConfigManager::GetCrashReportUrl(CString* url) const {
   ASSERT1(url);
 
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNameCrashReportUrl,
-                                 url))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNameCrashReportUrl, url)) {
     CORE_LOG(L5, (_T("['crash report url' override %s]"), *url));
     return S_OK;
   }
@@ -483,9 +581,7 @@ HRESULT ConfigManager::GetCrashReportUrl(CString* url) const {
 HRESULT ConfigManager::GetMoreInfoUrl(CString* url) const {
   ASSERT1(url);
 
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNameGetMoreInfoUrl,
-                                 url))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNameGetMoreInfoUrl, url)) {
     CORE_LOG(L5, (_T("['more info url' override %s]"), *url));
     return S_OK;
   }
@@ -497,9 +593,7 @@ HRESULT ConfigManager::GetMoreInfoUrl(CString* url) const {
 HRESULT ConfigManager::GetUsageStatsReportUrl(CString* url) const {
   ASSERT1(url);
 
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNameUsageStatsReportUrl,
-                                 url))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNameUsageStatsReportUrl, url)) {
     CORE_LOG(L5, (_T("['usage stats report url' override %s]"), *url));
     return S_OK;
   }
@@ -517,7 +611,8 @@ HRESULT ConfigManager::GetUsageStatsReportUrl(CString* url) const {
 int ConfigManager::GetLastCheckPeriodSec(bool* is_overridden) const {
   ASSERT1(is_overridden);
   DWORD registry_period_sec = 0;
-  *is_overridden = GetLastCheckPeriodSecFromRegistry(&registry_period_sec);
+  *is_overridden = GetLastCheckPeriodSecFromRegistry(*GetSnapshot(),
+                                                     &registry_period_sec);
   if (*is_overridden) {
     if (0 == registry_period_sec) {
       CORE_LOG(L5, (_T("[GetLastCheckPeriodSec][0 == registry_period_sec]")));
@@ -648,7 +743,7 @@ bool ConfigManager::Is24HoursSinceLastUpdate(bool is_machine) {
 // Uses app_registry_utils because this needs to be called in the server and
 // client and it is a best effort so locking isn't necessary.
 bool ConfigManager::CanCollectStats(bool is_machine) const {
-  if (RegKey::HasValue(MACHINE_REG_UPDATE_DEV, kRegValueForceUsageStats)) {
+  if (GetSnapshot()->HasUpdateDevValue(kRegValueForceUsageStats)) {
     return true;
   }
 
@@ -681,9 +776,7 @@ bool ConfigManager::CanCollectStats(bool is_machine) const {
 bool ConfigManager::CanOverInstall() const {
 #ifdef DEBUG
   DWORD value = 0;
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNameOverInstall,
-                                 &value))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNameOverInstall, &value)) {
     CORE_LOG(L5, (_T("['OverInstall' override %d]"), value));
     return value != 0;
   }
@@ -695,9 +788,7 @@ bool ConfigManager::CanOverInstall() const {
 // if the registry value exceeds INT_MAX.
 int ConfigManager::GetAutoUpdateTimerIntervalMs() const {
   DWORD interval(0);
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueAuCheckPeriodMs,
-                                 &interval))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueAuCheckPeriodMs, &interval)) {
     int ret_val = 0;
     if (interval > INT_MAX) {
       ret_val = INT_MAX;
@@ -723,7 +814,7 @@ int ConfigManager::GetUpdateWorkerStartUpDelayMs() const {
   const int au_timer_interval_ms = GetAutoUpdateTimerIntervalMs();
 
   // If the AuCheckPeriod is overriden then use that as the delay.
-  if (RegKey::HasValue(MACHINE_REG_UPDATE_DEV, kRegValueAuCheckPeriodMs)) {
+  if (GetSnapshot()->HasUpdateDevValue(kRegValueAuCheckPeriodMs)) {
     return au_timer_interval_ms;
   }
 
@@ -745,9 +836,8 @@ int ConfigManager::GetUpdateWorkerStartUpDelayMs() const {
 int ConfigManager::GetAutoUpdateJitterMs() const {
   const int kMaxJitterMs = 60000;
   DWORD auto_update_jitter_ms(0);
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueAutoUpdateJitterMs,
-                                 &auto_update_jitter_ms))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueAutoUpdateJitterMs,
+                                       &auto_update_jitter_ms)) {
     return auto_update_jitter_ms >= kMaxJitterMs ? kMaxJitterMs - 1 :
                                                    auto_update_jitter_ms;
   }
@@ -797,9 +887,7 @@ HRESULT ConfigManager::SetLastCoreRunTimeMs(bool is_machine, time64 time) {
 // INT_MAX if the registry value exceeds INT_MAX.
 int ConfigManager::GetCodeRedTimerIntervalMs() const {
   DWORD interval(0);
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueCrCheckPeriodMs,
-                                 &interval))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueCrCheckPeriodMs, &interval)) {
     int ret_val = 0;
     if (interval > INT_MAX) {
       ret_val = INT_MAX;
@@ -848,11 +936,9 @@ HRESULT ConfigManager::SetLastCodeRedCheckTimeMs(bool is_machine,
 // Returns true if logging is enabled for the event type.
 // Logging of errors and warnings is enabled by default.
 bool ConfigManager::CanLogEvents(WORD event_type) const {
-  const TCHAR* reg_update_key = MACHINE_REG_UPDATE_DEV;
   DWORD log_events_level = LOG_EVENT_LEVEL_NONE;
-  if (SUCCEEDED(RegKey::GetValue(reg_update_key,
-                                 kRegValueEventLogLevel,
-                                 &log_events_level))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueEventLogLevel,
+                                       &log_events_level)) {
     switch (log_events_level) {
       case LOG_EVENT_LEVEL_ALL:
         return true;
@@ -870,11 +956,9 @@ bool ConfigManager::CanLogEvents(WORD event_type) const {
 }
 
 CString ConfigManager::GetTestSource() const {
+  shared_ptr<const ConfigSnapshot> snapshot(GetSnapshot());
   CString test_source;
-  HRESULT hr = RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                kRegValueTestSource,
-                                &test_source);
-  if (SUCCEEDED(hr)) {
+  if (snapshot->GetUpdateDevValue(kRegValueTestSource, &test_source)) {
     if (test_source.IsEmpty()) {
       test_source = kRegValueTestSourceAuto;
     }
@@ -882,10 +966,7 @@ CString ConfigManager::GetTestSource() const {
   }
 
   DWORD interval = 0;
-  hr = RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                        kRegValueAuCheckPeriodMs,
-                        &interval);
-  if (SUCCEEDED(hr)) {
+  if (snapshot->GetUpdateDevValue(kRegValueAuCheckPeriodMs, &interval)) {
     return kRegValueTestSourceAuto;
   }
 
@@ -899,13 +980,12 @@ CString ConfigManager::GetTestSource() const {
 HRESULT ConfigManager::GetNetConfig(CString* net_config) {
   ASSERT1(net_config);
   CString val;
-  HRESULT hr = RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                kRegValueNetConfig,
-                                &val);
-  if (SUCCEEDED(hr)) {
-    *net_config = val;
+  if (!Instance()->GetSnapshot()->GetUpdateDevValue(kRegValueNetConfig,
+                                                    &val)) {
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
   }
-  return hr;
+  *net_config = val;
+  return S_OK;
 }
 
 // Returns false if running in the context of an OEM install or waiting for a
@@ -932,9 +1012,8 @@ bool ConfigManager::CanUseNetwork(bool is_machine) const {
 bool ConfigManager::IsWindowsInstalling() const {
 #if !OFFICIAL_BUILD
   DWORD value = 0;
-  if (SUCCEEDED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                                 kRegValueNameWindowsInstalling,
-                                 &value))) {
+  if (GetSnapshot()->GetUpdateDevValue(kRegValueNameWindowsInstalling,
+                                       &value)) {
     CORE_LOG(L3, (_T("['WindowsInstalling' override %d]"), value));
     return value != 0;
   }
@@ -977,7 +1056,8 @@ bool ConfigManager::IsInternalUser() const {
 
 DWORD ConfigManager::GetEffectivePolicyForAppInstalls(const GUID& app_guid) {
   DWORD effective_policy = kPolicyDisabled;
-  if (!GetEffectivePolicyForApp(kRegValueInstallAppsDefault,
+  if (!GetEffectivePolicyForApp(*Instance()->GetSnapshot(),
+                                kRegValueInstallAppsDefault,
                                 kRegValueInstallAppPrefix,
                                 app_guid,
                                 &effective_policy)) {
@@ -989,7 +1069,8 @@ DWORD ConfigManager::GetEffectivePolicyForAppInstalls(const GUID& app_guid) {
 
 DWORD ConfigManager::GetEffectivePolicyForAppUpdates(const GUID& app_guid) {
   DWORD effective_policy = kPolicyDisabled;
-  if (!GetEffectivePolicyForApp(kRegValueUpdateAppsDefault,
+  if (!GetEffectivePolicyForApp(*Instance()->GetSnapshot(),
+                                kRegValueUpdateAppsDefault,
                                 kRegValueUpdateAppPrefix,
                                 app_guid,
                                 &effective_policy)) {
@@ -1000,7 +1081,8 @@ DWORD ConfigManager::GetEffectivePolicyForAppUpdates(const GUID& app_guid) {
 }
 
 CString ConfigManager::GetTargetVersionPrefix(const GUID& app_guid) {
-  if (!IsEnrolledToDomain()) {
+  shared_ptr<const ConfigSnapshot> snapshot(Instance()->GetSnapshot());
+  if (!snapshot->is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetTargetVersionPrefix][Ignoring group policy for %s]")
                  _T("[machine is not part of a domain]"),
                  GuidToString(app_guid)));
@@ -1011,9 +1093,7 @@ CString ConfigManager::GetTargetVersionPrefix(const GUID& app_guid) {
   app_value_name.Append(GuidToString(app_guid));
 
   CString target_version_prefix;
-  RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                   app_value_name,
-                   &target_version_prefix);
+  snapshot->GetPolicyValue(app_value_name, &target_version_prefix);
   return target_version_prefix;
 }
 
@@ -1021,7 +1101,10 @@ bool ConfigManager::AreUpdatesSuppressedNow() {
   DWORD start_hour = 0;
   DWORD start_min = 0;
   DWORD duration_min = 0;
-  if (!GetUpdatesSuppressedTimes(&start_hour, &start_min, &duration_min)) {
+  if (!GetUpdatesSuppressedTimes(*Instance()->GetSnapshot(),
+                                 &start_hour,
+                                 &start_min,
+                                 &duration_min)) {
     return false;
   }
 
@@ -1073,17 +1156,15 @@ bool ConfigManager::CanUpdateApp(const GUID& app_guid, bool is_manual) const {
 
 bool ConfigManager::AlwaysAllowCrashUploads() const {
   DWORD always_allow_crash_uploads = 0;
-  RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                   kRegValueAlwaysAllowCrashUploads,
-                   &always_allow_crash_uploads);
+  GetSnapshot()->GetUpdateDevValue(kRegValueAlwaysAllowCrashUploads,
+                                   &always_allow_crash_uploads);
   return always_allow_crash_uploads != 0;
 }
 
 int ConfigManager::MaxCrashUploadsPerDay() const {
   DWORD num_uploads = 0;
-  if (FAILED(RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
-                              kRegValueMaxCrashUploadsPerDay,
-                              &num_uploads))) {
+  if (!GetSnapshot()->GetUpdateDevValue(kRegValueMaxCrashUploadsPerDay,
+                                        &num_uploads)) {
     num_uploads = kDefaultCrashUploadsPerDay;
   }
 
@@ -1097,17 +1178,17 @@ int ConfigManager::MaxCrashUploadsPerDay() const {
 CString ConfigManager::GetDownloadPreferenceGroupPolicy() const {
   CString download_preference;
 
-  if (!IsEnrolledToDomain()) {
+  shared_ptr<const ConfigSnapshot> snapshot(GetSnapshot());
+  if (!snapshot->is_enrolled_to_domain()) {
     OPT_LOG(L5, (_T("[GetDownloadPreferenceGroupPolicy]")
                  _T("[Ignoring group policy]")
                  _T("[machine is not part of a domain]")));
     return CString();
   }
 
-  HRESULT hr = RegKey::GetValue(kRegKeyGoopdateGroupPolicy,
-                                kRegValueDownloadPreference,
-                                &download_preference);
-  if (SUCCEEDED(hr) && download_preference == kDownloadPreferenceCacheable) {
+  if (snapshot->GetPolicyValue(kRegValueDownloadPreference,
+                               &download_preference) &&
+      download_preference == kDownloadPreferenceCacheable) {
     return download_preference;
   }
 
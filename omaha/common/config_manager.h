@@ -26,9 +26,12 @@
 #include <windows.h>
 #include <atlstr.h>
 #include "base/basictypes.h"
+#include "base/scoped_ptr.h"
 #include "omaha/base/constants.h"
 #include "omaha/base/synchronized.h"
 #include "omaha/base/time.h"
+#include "omaha/common/config_snapshot.h"
+#include "third_party/bar/shared_ptr.h"
 
 namespace omaha {
 
@@ -97,6 +100,38 @@ class ConfigManager {
   // limit, it should be removed.
   int GetPackageCacheExpirationTimeDays() const;
 
+  // Gets how long, in seconds, the package cache trusts a verified package
+  // hash before hashing the package again. Returns 0 when the paranoid
+  // verification mode is not enabled, in which case a verified hash is trusted
+  // for as long as the cached file is not modified.
+  int GetPackageCacheReverifyIntervalSec() const;
+
+  // Returns true if the package cache stores the packages as chunks shared
+  // between the cached versions instead of as full copies.
+  bool IsPackageCacheChunkStoreEnabled() const;
+
+  // Returns how many apps of a bundle may be downloading at the same time
+  // while the apps ahead of them are installed. A value of 1 means that each
+  // app is downloaded and installed before the next app is downloaded.
+  int GetDownloadPipelineDepth() const;
+
+  // Returns how many packages of a bundle may be downloaded at the same time.
+  int GetMaxDownloadConnections() const;
+
+  // Returns how long the first download url of a package is given before the
+  // second url is raced against it. Returns 0 when the urls are only tried
+  // one after another.
+  int GetDownloadHedgeDelayMs() const;
+
+  // Returns how long a proxy configuration is given to reach the server
+  // before the next configuration is raced against it. Returns 0 when the
+  // configurations are only tried one after another.
+  int GetProxyRaceDelayMs() const;
+
+  // Returns the minimum interval between two samples of the download progress
+  // of a package. Returns 0 when every chunk read is sampled.
+  int GetDownloadProgressSampleIntervalMs() const;
+
   // Creates download data dir:
   // %UserProfile%/Application Data/Google/Update/Download
   // This is the root of the package cache for the user.
@@ -294,6 +329,17 @@ class ConfigManager {
   // changes happen in between.
   static bool AreUpdatesSuppressedNow();
 
+  // Returns the group policy and UpdateDev values. The snapshot is shared by
+  // the callers and is rebuilt only after the values have changed.
+  shared_ptr<const ConfigSnapshot> GetSnapshot() const;
+
+  // Forces the next call to GetSnapshot to read the values again. Used when
+  // the registry hives are redirected, which is not reported as a change.
+  void InvalidateSnapshot();
+
+  // Takes ownership of the source. NULL restores the registry source.
+  void SetConfigSourceForUnitTest(ConfigSource* source);
+
   static ConfigManager* Instance();
   static void DeleteInstance();
 
@@ -306,6 +352,12 @@ class ConfigManager {
   bool is_running_from_official_user_dir_;
   bool is_running_from_official_machine_dir_;
 
+  // Protects the config source and the snapshot pointer. The snapshot itself
+  // is immutable and is read without the lock.
+  mutable LLock snapshot_lock_;
+  scoped_ptr<ConfigSource> config_source_;
+  mutable shared_ptr<const ConfigSnapshot> snapshot_;
+
   DISALLOW_EVIL_CONSTRUCTORS(ConfigManager);
 };
 
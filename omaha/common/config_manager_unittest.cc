@@ -1723,6 +1723,148 @@ TEST_P(ConfigManagerTest, GetPackageCacheExpirationTimeDays_Override_Valid) {
   EXPECT_EQ(IsDomain() ? 60 : 180, cm_->GetPackageCacheExpirationTimeDays());
 }
 
+TEST_P(ConfigManagerTest, GetPackageCacheReverifyIntervalSec) {
+  EXPECT_EQ(0, cm_->GetPackageCacheReverifyIntervalSec());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValuePackageCacheReverifySec,
+                                    static_cast<DWORD>(3600)));
+  EXPECT_EQ(3600, cm_->GetPackageCacheReverifyIntervalSec());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValuePackageCacheReverifySec,
+                                    static_cast<DWORD>(0xffffffff)));
+  EXPECT_EQ(INT_MAX, cm_->GetPackageCacheReverifyIntervalSec());
+}
+
+TEST_P(ConfigManagerTest, IsPackageCacheChunkStoreEnabled) {
+  EXPECT_FALSE(cm_->IsPackageCacheChunkStoreEnabled());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValuePackageCacheChunkStore,
+                                    static_cast<DWORD>(1)));
+  EXPECT_TRUE(cm_->IsPackageCacheChunkStoreEnabled());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValuePackageCacheChunkStore,
+                                    static_cast<DWORD>(0)));
+  EXPECT_FALSE(cm_->IsPackageCacheChunkStoreEnabled());
+}
+
+TEST_P(ConfigManagerTest, GetDownloadPipelineDepth) {
+  EXPECT_EQ(kDefaultDownloadPipelineDepth, cm_->GetDownloadPipelineDepth());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadPipelineDepth,
+                                    static_cast<DWORD>(5)));
+  EXPECT_EQ(5, cm_->GetDownloadPipelineDepth());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadPipelineDepth,
+                                    static_cast<DWORD>(0)));
+  EXPECT_EQ(1, cm_->GetDownloadPipelineDepth());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadPipelineDepth,
+                                    static_cast<DWORD>(1000)));
+  EXPECT_EQ(kMaxDownloadPipelineDepth, cm_->GetDownloadPipelineDepth());
+}
+
+TEST_P(ConfigManagerTest, GetMaxDownloadConnections) {
+  EXPECT_EQ(kDefaultMaxDownloadConnections, cm_->GetMaxDownloadConnections());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueMaxDownloadConnections,
+                                    static_cast<DWORD>(2)));
+  EXPECT_EQ(2, cm_->GetMaxDownloadConnections());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueMaxDownloadConnections,
+                                    static_cast<DWORD>(0)));
+  EXPECT_EQ(1, cm_->GetMaxDownloadConnections());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueMaxDownloadConnections,
+                                    static_cast<DWORD>(1000)));
+  EXPECT_EQ(kMaxDownloadConnections, cm_->GetMaxDownloadConnections());
+}
+
+TEST_P(ConfigManagerTest, GetDownloadHedgeDelayMs) {
+  EXPECT_EQ(0, cm_->GetDownloadHedgeDelayMs());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadHedgeDelayMs,
+                                    static_cast<DWORD>(250)));
+  EXPECT_EQ(250, cm_->GetDownloadHedgeDelayMs());
+}
+
+TEST_P(ConfigManagerTest, GetProxyRaceDelayMs) {
+  EXPECT_EQ(kDefaultProxyRaceDelayMs, cm_->GetProxyRaceDelayMs());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueProxyRaceDelayMs,
+                                    static_cast<DWORD>(0)));
+  EXPECT_EQ(0, cm_->GetProxyRaceDelayMs());
+}
+
+TEST_P(ConfigManagerTest, GetDownloadProgressSampleIntervalMs) {
+  EXPECT_EQ(kDefaultDownloadProgressSampleIntervalMs,
+            cm_->GetDownloadProgressSampleIntervalMs());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadProgressSampleIntervalMs,
+                                    static_cast<DWORD>(0)));
+  EXPECT_EQ(0, cm_->GetDownloadProgressSampleIntervalMs());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadProgressSampleIntervalMs,
+                                    static_cast<DWORD>(100000)));
+  EXPECT_EQ(kMaxDownloadProgressSampleIntervalMs,
+            cm_->GetDownloadProgressSampleIntervalMs());
+}
+
+// The snapshot is reused until a value changes.
+TEST_P(ConfigManagerTest, GetSnapshot_SharedUntilChanged) {
+  shared_ptr<const ConfigSnapshot> snapshot(cm_->GetSnapshot());
+  EXPECT_EQ(snapshot.get(), cm_->GetSnapshot().get());
+  EXPECT_EQ(IsDomain(), snapshot->is_enrolled_to_domain());
+
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadPipelineDepth,
+                                    static_cast<DWORD>(3)));
+  shared_ptr<const ConfigSnapshot> new_snapshot(cm_->GetSnapshot());
+  EXPECT_NE(snapshot.get(), new_snapshot.get());
+  EXPECT_EQ(new_snapshot.get(), cm_->GetSnapshot().get());
+
+  // The previous snapshot is not modified.
+  DWORD depth = 0;
+  EXPECT_FALSE(snapshot->GetUpdateDevValue(kRegValueDownloadPipelineDepth,
+                                           &depth));
+  EXPECT_TRUE(new_snapshot->GetUpdateDevValue(kRegValueDownloadPipelineDepth,
+                                              &depth));
+  EXPECT_EQ(3UL, depth);
+
+  EXPECT_SUCCEEDED(RegKey::DeleteValue(MACHINE_REG_UPDATE_DEV,
+                                       kRegValueDownloadPipelineDepth));
+  EXPECT_EQ(kDefaultDownloadPipelineDepth, cm_->GetDownloadPipelineDepth());
+}
+
+// The policy key does not exist until the first policy is set, which is
+// detected through the parent key.
+TEST_P(ConfigManagerTest, GetSnapshot_PolicyKeyCreated) {
+  EXPECT_FALSE(RegKey::HasKey(kPolicyKey));
+  EXPECT_EQ(500, cm_->GetPackageCacheSizeLimitMBytes());
+
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueCacheSizeLimitMBytes, 100));
+  EXPECT_EQ(IsDomain() ? 100 : 500, cm_->GetPackageCacheSizeLimitMBytes());
+
+  EXPECT_SUCCEEDED(RegKey::DeleteKey(kPolicyKey));
+  EXPECT_EQ(500, cm_->GetPackageCacheSizeLimitMBytes());
+
+  EXPECT_SUCCEEDED(SetPolicy(kRegValueCacheSizeLimitMBytes, 200));
+  EXPECT_EQ(IsDomain() ? 200 : 500, cm_->GetPackageCacheSizeLimitMBytes());
+}
+
 TEST_P(ConfigManagerTest, LastCheckedTime) {
   DWORD time = 500;
   EXPECT_SUCCEEDED(cm_->SetLastCheckedTime(true, time));
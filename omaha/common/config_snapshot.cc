@@ -0,0 +1,211 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/common/config_snapshot.h"
+#include "omaha/base/constants.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/const_group_policy.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR* const kConfigKeyNames[CONFIG_KEY_MAX] = {
+  kRegKeyGoopdateGroupPolicy,
+  MACHINE_REG_UPDATE_DEV,
+};
+
+}  // namespace
+
+RegistryConfigSource::RegistryConfigSource() {
+  for (int i = 0; i < CONFIG_KEY_MAX; ++i) {
+    reset(change_events_[i], ::CreateEvent(NULL, true, false, NULL));
+    ASSERT1(valid(change_events_[i]));
+    is_watching_[i] = false;
+  }
+}
+
+RegistryConfigSource::~RegistryConfigSource() {
+}
+
+// The notification is requested before the values are read, so that a change
+// made while they are read is not missed.
+HRESULT RegistryConfigSource::ReadValues(ConfigKey key, ConfigValues* values) {
+  ASSERT1(key < CONFIG_KEY_MAX);
+  ASSERT1(values);
+
+  values->dwords.clear();
+  values->strings.clear();
+  values->names.clear();
+
+  if (!Watch(key)) {
+    return S_OK;
+  }
+
+  RegKey& reg_key = watched_keys_[key];
+  const uint32 num_values = reg_key.GetValueCount();
+  for (uint32 i = 0; i < num_values; ++i) {
+    CString name;
+    DWORD type = REG_NONE;
+    if (FAILED(reg_key.GetValueNameAt(i, &name, &type))) {
+      continue;
+    }
+    values->names.insert(name);
+
+    if (type == REG_DWORD) {
+      DWORD value = 0;
+      if (SUCCEEDED(reg_key.GetValue(name, &value))) {
+        values->dwords[name] = value;
+      }
+    } else if (type == REG_SZ || type == REG_EXPAND_SZ) {
+      CString value;
+      if (SUCCEEDED(reg_key.GetValue(name, &value))) {
+        values->strings[name] = value;
+      }
+    }
+  }
+
+  CORE_LOG(L5, (_T("[RegistryConfigSource::ReadValues][%s][%u values]"),
+                kConfigKeyNames[key], num_values));
+  return S_OK;
+}
+
+bool RegistryConfigSource::Watch(ConfigKey key) {
+  ASSERT1(key < CONFIG_KEY_MAX);
+
+  is_watching_[key] = false;
+  VERIFY1(::ResetEvent(get(change_events_[key])));
+  watched_keys_[key].Close();
+
+  CString key_name(kConfigKeyNames[key]);
+  key_name.TrimRight(_T('\\'));
+
+  bool is_parent = false;
+  while (FAILED(watched_keys_[key].Open(key_name, KEY_READ))) {
+    const int pos = key_name.ReverseFind(_T('\\'));
+    if (pos <= 0) {
+      return false;
+    }
+    key_name = key_name.Left(pos);
+    is_parent = true;
+  }
+
+  // The parent of a missing key is only watched for new subkeys, since the
+  // values of the parent do not matter. Before Windows 8, the notification
+  // is also signaled when the calling thread exits, which only causes the
+  // values to be read again.
+  const DWORD filter = is_parent ?
+      REG_NOTIFY_CHANGE_NAME :
+      REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET;
+  const LONG result = ::RegNotifyChangeKeyValue(watched_keys_[key].Key(),
+                                                false,
+                                                filter,
+                                                get(change_events_[key]),
+                                                true);
+  if (result != ERROR_SUCCESS) {
+    CORE_LOG(LW, (_T("[RegNotifyChangeKeyValue failed][%s][%d]"),
+                  key_name, result));
+  } else {
+    is_watching_[key] = true;
+  }
+
+  return !is_parent;
+}
+
+bool RegistryConfigSource::IsEnrolledToDomain() {
+  return omaha::IsEnrolledToDomain();
+}
+
+bool RegistryConfigSource::HasChanged() {
+  HANDLE events[CONFIG_KEY_MAX] = {};
+  for (int i = 0; i < CONFIG_KEY_MAX; ++i) {
+    if (!is_watching_[i]) {
+      return true;
+    }
+    events[i] = get(change_events_[i]);
+  }
+
+  return ::WaitForMultipleObjects(CONFIG_KEY_MAX, events, false, 0) !=
+         WAIT_TIMEOUT;
+}
+
+ConfigSnapshot::ConfigSnapshot(ConfigSource* source)
+    : is_enrolled_to_domain_(false) {
+  ASSERT1(source);
+
+  for (int i = 0; i < CONFIG_KEY_MAX; ++i) {
+    VERIFY1(SUCCEEDED(source->ReadValues(static_cast<ConfigKey>(i),
+                                         &values_[i])));
+  }
+  is_enrolled_to_domain_ = source->IsEnrolledToDomain();
+}
+
+bool ConfigSnapshot::GetPolicyValue(const TCHAR* name, DWORD* value) const {
+  return GetValue(values_[CONFIG_KEY_GROUP_POLICY], name, value);
+}
+
+bool ConfigSnapshot::GetPolicyValue(const TCHAR* name, CString* value) const {
+  return GetValue(values_[CONFIG_KEY_GROUP_POLICY], name, value);
+}
+
+bool ConfigSnapshot::GetUpdateDevValue(const TCHAR* name, DWORD* value) const {
+  return GetValue(values_[CONFIG_KEY_UPDATE_DEV], name, value);
+}
+
+bool ConfigSnapshot::GetUpdateDevValue(const TCHAR* name,
+                                       CString* value) const {
+  return GetValue(values_[CONFIG_KEY_UPDATE_DEV], name, value);
+}
+
+bool ConfigSnapshot::HasUpdateDevValue(const TCHAR* name) const {
+  ASSERT1(name);
+  const ConfigValues& values = values_[CONFIG_KEY_UPDATE_DEV];
+  return values.names.find(name) != values.names.end();
+}
+
+bool ConfigSnapshot::GetValue(const ConfigValues& values,
+                              const TCHAR* name,
+                              DWORD* value) {
+  ASSERT1(name);
+  ASSERT1(value);
+
+  std::map<CString, DWORD, ConfigValueNameLess>::const_iterator it =
+      values.dwords.find(name);
+  if (it == values.dwords.end()) {
+    return false;
+  }
+  *value = it->second;
+  return true;
+}
+
+bool ConfigSnapshot::GetValue(const ConfigValues& values,
+                              const TCHAR* name,
+                              CString* value) {
+  ASSERT1(name);
+  ASSERT1(value);
+
+  std::map<CString, CString, ConfigValueNameLess>::const_iterator it =
+      values.strings.find(name);
+  if (it == values.strings.end()) {
+    return false;
+  }
+  *value = it->second;
+  return true;
+}
+
+}  // namespace omaha
@@ -0,0 +1,129 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// An immutable copy of the group policy and UpdateDev values, which most of
+// the ConfigManager getters are computed from. ConfigManager shares one
+// snapshot between all callers and replaces it when the source of the values
+// reports a change.
+
+#ifndef OMAHA_COMMON_CONFIG_SNAPSHOT_H_
+#define OMAHA_COMMON_CONFIG_SNAPSHOT_H_
+
+#include <windows.h>
+#include <tchar.h>
+#include <atlstr.h>
+#include <map>
+#include <set>
+#include "base/basictypes.h"
+#include "omaha/base/reg_key.h"
+#include "omaha/base/scoped_any.h"
+
+namespace omaha {
+
+enum ConfigKey {
+  CONFIG_KEY_GROUP_POLICY = 0,
+  CONFIG_KEY_UPDATE_DEV,
+  CONFIG_KEY_MAX,
+};
+
+// Registry value names are not case sensitive.
+struct ConfigValueNameLess {
+  bool operator()(const CString& a, const CString& b) const {
+    return _tcsicmp(a, b) < 0;
+  }
+};
+
+// The values of one configuration key.
+struct ConfigValues {
+  std::map<CString, DWORD, ConfigValueNameLess> dwords;
+  std::map<CString, CString, ConfigValueNameLess> strings;
+
+  // The names of all the values, including the ones of other types.
+  std::set<CString, ConfigValueNameLess> names;
+};
+
+// Provides the configuration values. The registry is the source in
+// production. Tests can provide the values from memory.
+class ConfigSource {
+ public:
+  virtual ~ConfigSource() {}
+
+  // Reads all the values under the key. A key that does not exist has no
+  // values.
+  virtual HRESULT ReadValues(ConfigKey key, ConfigValues* values) = 0;
+
+  virtual bool IsEnrolledToDomain() = 0;
+
+  // Returns true if the values may have changed since they were last read.
+  virtual bool HasChanged() = 0;
+};
+
+// Reads the values from the registry and watches the keys for changes with
+// RegNotifyChangeKeyValue. A key that does not exist yet is detected through
+// its closest existing parent, which is watched for new subkeys.
+class RegistryConfigSource : public ConfigSource {
+ public:
+  RegistryConfigSource();
+  virtual ~RegistryConfigSource();
+
+  virtual HRESULT ReadValues(ConfigKey key, ConfigValues* values);
+  virtual bool IsEnrolledToDomain();
+  virtual bool HasChanged();
+
+ private:
+  // Starts watching the key, or its closest existing parent. Returns true if
+  // the key itself exists.
+  bool Watch(ConfigKey key);
+
+  RegKey watched_keys_[CONFIG_KEY_MAX];
+  scoped_event change_events_[CONFIG_KEY_MAX];
+  bool is_watching_[CONFIG_KEY_MAX];
+
+  DISALLOW_EVIL_CONSTRUCTORS(RegistryConfigSource);
+};
+
+class ConfigSnapshot {
+ public:
+  // Reads all the values from the source.
+  explicit ConfigSnapshot(ConfigSource* source);
+
+  bool is_enrolled_to_domain() const { return is_enrolled_to_domain_; }
+
+  // The getters return false if the value does not exist or has a different
+  // type. The group policy values are returned regardless of the domain
+  // membership, which the callers check.
+  bool GetPolicyValue(const TCHAR* name, DWORD* value) const;
+  bool GetPolicyValue(const TCHAR* name, CString* value) const;
+  bool GetUpdateDevValue(const TCHAR* name, DWORD* value) const;
+  bool GetUpdateDevValue(const TCHAR* name, CString* value) const;
+  bool HasUpdateDevValue(const TCHAR* name) const;
+
+ private:
+  static bool GetValue(const ConfigValues& values,
+                       const TCHAR* name,
+                       DWORD* value);
+  static bool GetValue(const ConfigValues& values,
+                       const TCHAR* name,
+                       CString* value);
+
+  bool is_enrolled_to_domain_;
+  ConfigValues values_[CONFIG_KEY_MAX];
+
+  DISALLOW_EVIL_CONSTRUCTORS(ConfigSnapshot);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_COMMON_CONFIG_SNAPSHOT_H_
@@ -0,0 +1,195 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/constants.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/reg_key.h"
+#include "omaha/common/config_manager.h"
+#include "omaha/common/config_snapshot.h"
+#include "omaha/common/const_group_policy.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// Provides the values from memory and counts the reads.
+class FakeConfigSource : public ConfigSource {
+ public:
+  FakeConfigSource()
+      : is_enrolled_to_domain_(false),
+        has_changed_(false),
+        num_reads_(0) {}
+
+  virtual HRESULT ReadValues(ConfigKey key, ConfigValues* values) {
+    ++num_reads_;
+    *values = values_[key];
+    has_changed_ = false;
+    return S_OK;
+  }
+
+  virtual bool IsEnrolledToDomain() {
+    return is_enrolled_to_domain_;
+  }
+
+  virtual bool HasChanged() {
+    return has_changed_;
+  }
+
+  void SetDword(ConfigKey key, const TCHAR* name, DWORD value) {
+    values_[key].dwords[name] = value;
+    values_[key].names.insert(name);
+    has_changed_ = true;
+  }
+
+  void SetString(ConfigKey key, const TCHAR* name, const TCHAR* value) {
+    values_[key].strings[name] = value;
+    values_[key].names.insert(name);
+    has_changed_ = true;
+  }
+
+  void set_is_enrolled_to_domain(bool is_enrolled_to_domain) {
+    is_enrolled_to_domain_ = is_enrolled_to_domain;
+    has_changed_ = true;
+  }
+
+  int num_reads() const { return num_reads_; }
+
+ private:
+  ConfigValues values_[CONFIG_KEY_MAX];
+  bool is_enrolled_to_domain_;
+  bool has_changed_;
+  int num_reads_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(FakeConfigSource);
+};
+
+double ElapsedNs(ULONGLONG start_ticks, int iterations) {
+  return (HighresTimer::GetCurrentTicks() - start_ticks) * 1e9 /
+         HighresTimer::GetTimerFrequency() / iterations;
+}
+
+}  // namespace
+
+class ConfigSnapshotTest : public testing::Test {
+ protected:
+  ConfigSnapshotTest()
+      : cm_(ConfigManager::Instance()),
+        source_(new FakeConfigSource) {}
+
+  virtual void SetUp() {
+    cm_->SetConfigSourceForUnitTest(source_);
+  }
+
+  virtual void TearDown() {
+    cm_->SetConfigSourceForUnitTest(NULL);
+  }
+
+  ConfigManager* cm_;
+
+  // Owned by |cm_|.
+  FakeConfigSource* source_;
+};
+
+TEST_F(ConfigSnapshotTest, GetValues) {
+  source_->SetDword(CONFIG_KEY_UPDATE_DEV, _T("SomeDword"), 7);
+  source_->SetString(CONFIG_KEY_UPDATE_DEV, _T("SomeString"), _T("abc"));
+  source_->SetDword(CONFIG_KEY_GROUP_POLICY, _T("SomePolicy"), 3);
+  source_->set_is_enrolled_to_domain(true);
+
+  ConfigSnapshot snapshot(source_);
+  EXPECT_TRUE(snapshot.is_enrolled_to_domain());
+
+  // Value names are not case sensitive.
+  DWORD dword_value = 0;
+  EXPECT_TRUE(snapshot.GetUpdateDevValue(_T("somedword"), &dword_value));
+  EXPECT_EQ(7UL, dword_value);
+  CString string_value;
+  EXPECT_TRUE(snapshot.GetUpdateDevValue(_T("SOMESTRING"), &string_value));
+  EXPECT_STREQ(_T("abc"), string_value);
+  EXPECT_TRUE(snapshot.GetPolicyValue(_T("SomePolicy"), &dword_value));
+  EXPECT_EQ(3UL, dword_value);
+
+  // The values of each key are separate.
+  EXPECT_FALSE(snapshot.GetPolicyValue(_T("SomeDword"), &dword_value));
+  EXPECT_FALSE(snapshot.GetUpdateDevValue(_T("SomePolicy"), &dword_value));
+
+  // The type must match.
+  EXPECT_FALSE(snapshot.GetUpdateDevValue(_T("SomeDword"), &string_value));
+  EXPECT_FALSE(snapshot.GetUpdateDevValue(_T("SomeString"), &dword_value));
+  EXPECT_TRUE(snapshot.HasUpdateDevValue(_T("SomeDword")));
+  EXPECT_TRUE(snapshot.HasUpdateDevValue(_T("SomeString")));
+  EXPECT_FALSE(snapshot.HasUpdateDevValue(_T("SomePolicy")));
+}
+
+TEST_F(ConfigSnapshotTest, RebuiltOnlyWhenChanged) {
+  shared_ptr<const ConfigSnapshot> snapshot(cm_->GetSnapshot());
+  const int num_reads = source_->num_reads();
+  EXPECT_EQ(CONFIG_KEY_MAX, num_reads);
+
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(kDefaultDownloadPipelineDepth, cm_->GetDownloadPipelineDepth());
+  }
+  EXPECT_EQ(snapshot.get(), cm_->GetSnapshot().get());
+  EXPECT_EQ(num_reads, source_->num_reads());
+
+  source_->SetDword(CONFIG_KEY_UPDATE_DEV, kRegValueDownloadPipelineDepth, 2);
+  EXPECT_EQ(2, cm_->GetDownloadPipelineDepth());
+  EXPECT_EQ(2, cm_->GetDownloadPipelineDepth());
+  EXPECT_EQ(num_reads + CONFIG_KEY_MAX, source_->num_reads());
+  EXPECT_NE(snapshot.get(), cm_->GetSnapshot().get());
+
+  cm_->InvalidateSnapshot();
+  EXPECT_EQ(2, cm_->GetDownloadPipelineDepth());
+  EXPECT_EQ(num_reads + 2 * CONFIG_KEY_MAX, source_->num_reads());
+}
+
+TEST_F(ConfigSnapshotTest, GroupPolicyRequiresDomain) {
+  source_->SetDword(CONFIG_KEY_GROUP_POLICY, kRegValueCacheSizeLimitMBytes, 42);
+  EXPECT_EQ(500, cm_->GetPackageCacheSizeLimitMBytes());
+
+  source_->set_is_enrolled_to_domain(true);
+  EXPECT_EQ(42, cm_->GetPackageCacheSizeLimitMBytes());
+}
+
+// Compares the cached getters with reading the registry on every call, which
+// is what the getters did before the snapshot.
+TEST(ConfigSnapshotBenchmarkTest, DISABLED_CachedVersusRegistry) {
+  const int kIterations = 100000;
+  ConfigManager* cm = ConfigManager::Instance();
+  cm->InvalidateSnapshot();
+  EXPECT_LT(0, cm->GetDownloadPipelineDepth());
+
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kIterations; ++i) {
+    cm->GetDownloadPipelineDepth();
+  }
+  const double cached_ns = ElapsedNs(start_ticks, kIterations);
+
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kIterations; ++i) {
+    DWORD depth = 0;
+    RegKey::GetValue(MACHINE_REG_UPDATE_DEV,
+                     kRegValueDownloadPipelineDepth,
+                     &depth);
+  }
+  const double registry_ns = ElapsedNs(start_ticks, kIterations);
+
+  OPT_LOG(L1, (_T("[GetDownloadPipelineDepth][cached %f ns][registry %f ns]"),
+               cached_ns, registry_ns));
+}
+
+}  // namespace omaha
@@ -174,6 +174,15 @@ bool OmahaExceptionHandler::StaticMinidumpCallback(const wchar_t* dump_path,
     thisptr->MinidumpCallback(dump_path, minidump_id);
   }
 
+#ifdef LOGGING
+  // Write out the log messages queued by the asynchronous logging, which
+  // would be lost when the process is terminated.
+  Logging* logger = GetLogging();
+  if (logger) {
+    logger->FlushOnCrash();
+  }
+#endif
+
   // There are two ways to stop execution of the current process: ExitProcess
   // and TerminateProcess. Calling ExitProcess results in calling the
   // destructors of the static objects before the process exits.
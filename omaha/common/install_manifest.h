@@ -30,7 +30,7 @@ namespace omaha {
 namespace xml {
 
 struct InstallPackage {
-  InstallPackage() : is_required(false), size(0) {}
+  InstallPackage() : is_required(false), size(0), size_diff(0) {}
 
   CString name;
   CString version;
@@ -38,6 +38,16 @@ struct InstallPackage {
   int size;
   CString hash_sha1;  // base64 encoded.
   CString hash_sha256;  // hex-digit encoded.
+
+  // The differential patch which reconstructs the package from the package
+  // of the same name in the installed version. Empty if there is none.
+  CString name_diff;
+  int size_diff;
+  CString hash_diff_sha256;  // hex-digit encoded.
+
+  // The format of the package if it is an archive whose members are
+  // extracted before the installer runs: "xz" or "7z". Empty otherwise.
+  CString archive;
 };
 
 struct InstallAction {
@@ -14,6 +14,8 @@
 // ========================================================================
 
 #include "omaha/common/ping.h"
+#include <atlbase.h>
+#include <algorithm>
 #include "base/scoped_ptr.h"
 #include "omaha/base/constants.h"
 #include "omaha/base/debug.h"
@@ -26,6 +28,7 @@
 #include "omaha/base/utils.h"
 #include "omaha/base/vistautil.h"
 #include "omaha/base/vista_utils.h"
+#include "omaha/base/xml_utils.h"
 #include "omaha/common/app_registry_utils.h"
 #include "omaha/common/command_line.h"
 #include "omaha/common/command_line_builder.h"
@@ -34,6 +37,7 @@
 #include "omaha/common/goopdate_utils.h"
 #include "omaha/common/update_request.h"
 #include "omaha/common/update_response.h"
+#include "omaha/common/xml_const.h"
 #include "omaha/goopdate/app.h"
 #include "omaha/goopdate/app_bundle.h"
 #include "omaha/goopdate/update_request_utils.h"
@@ -46,11 +50,121 @@ const TCHAR* const Ping::kRegValuePersistedPingTime = _T("PersistedPingTime");
 const TCHAR* const Ping::kRegValuePersistedPingString =
     _T("PersistedPingString");
 const time64 Ping::kPersistedPingExpiry100ns  = 10 * kDaysTo100ns;  // 10 days.
+const time64 Ping::kPersistedPingBatchMaxAgeSpread100ns = kHoursTo100ns;
+const int Ping::kMaxPersistedPingBatchLength = 32 * 1024;
 
 // Minimum compatible Omaha version that understands the /ping command line.
 // 1.3.0.0.
 const ULONGLONG kMinOmahaVersionForPingOOP = 0x0001000300000000;
 
+namespace {
+
+// Returns the request element of the ping without its apps, its request id and
+// its session id. Pings which have the same envelope can share a request.
+HRESULT GetPingEnvelope(IXMLDOMElement* request, CString* envelope) {
+  ASSERT1(request);
+  ASSERT1(envelope);
+
+  CComPtr<IXMLDOMNode> clone;
+  HRESULT hr = request->cloneNode(VARIANT_TRUE, &clone);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  hr = RemoveXMLChildrenByName(clone, XMLFQName(NULL, xml::element::kApp));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CComQIPtr<IXMLDOMElement> clone_element(clone);
+  if (!clone_element) {
+    return E_NOINTERFACE;
+  }
+  hr = clone_element->removeAttribute(CComBSTR(xml::attribute::kRequestId));
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = clone_element->removeAttribute(CComBSTR(xml::attribute::kSessionId));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CComBSTR xml;
+  hr = clone->get_xml(&xml);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  *envelope = xml;
+  return S_OK;
+}
+
+// Appends copies of the apps of |from| to |to|.
+HRESULT CopyPingApps(IXMLDOMElement* from, IXMLDOMElement* to) {
+  ASSERT1(from);
+  ASSERT1(to);
+
+  CComPtr<IXMLDOMNodeList> children;
+  HRESULT hr = from->get_childNodes(&children);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  long num_children = 0;  // NOLINT
+  hr = children->get_length(&num_children);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  // All the apps are copied before |to| is modified.
+  std::vector<CComPtr<IXMLDOMNode> > apps;
+  for (long i = 0; i < num_children; ++i) {  // NOLINT
+    CComPtr<IXMLDOMNode> child;
+    hr = children->get_item(i, &child);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    if (!EqualXMLName(child, XMLFQName(NULL, xml::element::kApp))) {
+      continue;
+    }
+
+    CComPtr<IXMLDOMNode> app;
+    hr = child->cloneNode(VARIANT_TRUE, &app);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    apps.push_back(app);
+  }
+
+  for (size_t i = 0; i != apps.size(); ++i) {
+    hr = AppendXMLNode(to, apps[i]);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  return S_OK;
+}
+
+// The parsed request of a persisted ping, or of a batch of persisted pings.
+// The request is NULL if the ping could not be parsed, in which case it can't
+// be batched.
+struct PingDocument {
+  PingDocument() : length(0) {}
+
+  CComPtr<IXMLDOMDocument> document;
+  CComPtr<IXMLDOMElement> request;
+  CString envelope;
+  int length;
+};
+
+bool IsPersistedPingOlder(const std::pair<size_t, time64>& a,
+                          const std::pair<size_t, time64>& b) {
+  return a.second < b.second;
+}
+
+}  // namespace
+
 Ping::Ping(bool is_machine,
            const CString& session_id,
            const CString& install_source,
@@ -487,6 +601,86 @@ HRESULT Ping::PersistPing() {
                           time_now_str);
 }
 
+void Ping::BuildPersistedPingBatches(
+    const PingsVector& persisted_pings,
+    std::vector<PersistedPingBatch>* batches) {
+  ASSERT1(batches);
+  ASSERT1(batches->empty());
+
+  // The pings are batched from the oldest to the newest, so the first ping of
+  // a batch is its oldest.
+  std::vector<std::pair<size_t, time64> > pings_by_time;
+  for (size_t i = 0; i != persisted_pings.size(); ++i) {
+    pings_by_time.push_back(std::make_pair(i, persisted_pings[i].second.first));
+  }
+  std::stable_sort(pings_by_time.begin(), pings_by_time.end(),
+                   IsPersistedPingOlder);
+
+  // The requests of the batches, in the same order as the batches.
+  std::vector<PingDocument> batch_documents;
+
+  for (size_t i = 0; i != pings_by_time.size(); ++i) {
+    const size_t ping_index = pings_by_time[i].first;
+    const time64 persisted_time = pings_by_time[i].second;
+    const CString& ping_string(persisted_pings[ping_index].second.second);
+
+    PingDocument ping;
+    ping.length = ping_string.GetLength();
+    HRESULT hr = LoadXMLFromMemory(ping_string, false, &ping.document);
+    if (SUCCEEDED(hr)) {
+      hr = ping.document->get_documentElement(&ping.request);
+    }
+    if (SUCCEEDED(hr) && ping.request) {
+      hr = GetPingEnvelope(ping.request, &ping.envelope);
+    }
+    if (FAILED(hr) || !ping.request) {
+      CORE_LOG(LW, (_T("[Persisted ping not batched][%s][%#x]"),
+                    persisted_pings[ping_index].first, hr));
+      ping.request.Release();
+    }
+
+    bool is_batched = false;
+    for (size_t j = 0; ping.request && j != batch_documents.size(); ++j) {
+      PingDocument& batch_document(batch_documents[j]);
+      PersistedPingBatch& batch((*batches)[j]);
+      if (!batch_document.request ||
+          batch_document.envelope != ping.envelope ||
+          batch_document.length + ping.length > kMaxPersistedPingBatchLength ||
+          persisted_time - batch.persisted_time >
+              kPersistedPingBatchMaxAgeSpread100ns) {
+        continue;
+      }
+
+      if (FAILED(CopyPingApps(ping.request, batch_document.request))) {
+        continue;
+      }
+
+      batch_document.length += ping.length;
+      batch.ping_indexes.push_back(ping_index);
+      is_batched = true;
+      break;
+    }
+
+    if (!is_batched) {
+      PersistedPingBatch batch;
+      batch.request_string = ping_string;
+      batch.persisted_time = persisted_time;
+      batch.ping_indexes.push_back(ping_index);
+      batches->push_back(batch);
+      batch_documents.push_back(ping);
+    }
+  }
+
+  // A batch of a single ping is sent as it was persisted.
+  for (size_t i = 0; i != batches->size(); ++i) {
+    PersistedPingBatch& batch((*batches)[i]);
+    if (batch.ping_indexes.size() > 1) {
+      VERIFY1(SUCCEEDED(SaveXMLToMemory(batch_documents[i].document,
+                                        &batch.request_string)));
+    }
+  }
+}
+
 HRESULT Ping::SendPersistedPings(bool is_machine) {
   PingsVector persisted_pings;
   HRESULT hr = LoadPersistedPings(is_machine, &persisted_pings);
@@ -494,30 +688,40 @@ HRESULT Ping::SendPersistedPings(bool is_machine) {
     return hr;
   }
 
-  for (size_t i = 0; i != persisted_pings.size(); ++i) {
-    const CString& persisted_subkey_name(persisted_pings[i].first);
-    time64 persisted_time = persisted_pings[i].second.first;
+  std::vector<PersistedPingBatch> batches;
+  BuildPersistedPingBatches(persisted_pings, &batches);
+  CORE_LOG(L3, (_T("[Resending persisted pings][%Iu pings][%Iu requests]"),
+                persisted_pings.size(), batches.size()));
+
+  for (size_t i = 0; i != batches.size(); ++i) {
+    const PersistedPingBatch& batch(batches[i]);
     int32 request_age = Time64ToInt32(GetCurrent100NSTime()) -
-                        Time64ToInt32(persisted_time);
-    const CString& persisted_ping_string(persisted_pings[i].second.second);
+                        Time64ToInt32(batch.persisted_time);
 
-    CORE_LOG(L3, (_T("[Resending persisted ping][%s][%I64u][%d][%s]"),
-                  persisted_subkey_name,
-                  persisted_time,
+    CORE_LOG(L3, (_T("[Resending persisted pings][%Iu][%I64u][%d][%s]"),
+                  batch.ping_indexes.size(),
+                  batch.persisted_time,
                   request_age,
-                  persisted_ping_string));
+                  batch.request_string));
 
     CString request_age_string;
     SafeCStringFormat(&request_age_string, _T("%d"), request_age);
     HeadersVector headers;
     headers.push_back(std::make_pair(kHeaderXRequestAge, request_age_string));
 
-    hr = SendString(is_machine, headers, persisted_ping_string);
-
-    if (SUCCEEDED(hr) || IsPingExpired(persisted_time)) {
-      CORE_LOG(L3, (_T("[Deleting persisted ping][0x%x]"), hr));
-      VERIFY1(SUCCEEDED(DeletePersistedPing(is_machine,
-                                            persisted_subkey_name)));
+    hr = SendString(is_machine, headers, batch.request_string);
+
+    for (size_t j = 0; j != batch.ping_indexes.size(); ++j) {
+      const CString& persisted_subkey_name(
+          persisted_pings[batch.ping_indexes[j]].first);
+      const time64 persisted_time(
+          persisted_pings[batch.ping_indexes[j]].second.first);
+      if (SUCCEEDED(hr) || IsPingExpired(persisted_time)) {
+        CORE_LOG(L3, (_T("[Deleting persisted ping][%s][0x%x]"),
+                      persisted_subkey_name, hr));
+        VERIFY1(SUCCEEDED(DeletePersistedPing(is_machine,
+                                              persisted_subkey_name)));
+      }
     }
   }
 
@@ -151,7 +151,8 @@ class Ping {
   // Persists the current Ping object to the registry.
   HRESULT PersistPing();
 
-  // Sends all persisted pings. Deletes successful or expired pings.
+  // Sends all persisted pings, batching the pings which can share a request.
+  // Deletes successful or expired pings.
   static HRESULT SendPersistedPings(bool is_machine);
 
   // Sends a ping string to the server, in-process. The ping_string must be web
@@ -173,6 +174,9 @@ class Ping {
   FRIEND_TEST(PingTest, PersistPing);
   FRIEND_TEST(PingTest, PersistPing_Load_Delete);
   FRIEND_TEST(PingTest, PersistAndSendPersistedPings);
+  FRIEND_TEST(PingTest, BuildPersistedPingBatches);
+  FRIEND_TEST(PingTest, BuildPersistedPingBatches_SizeLimit);
+  FRIEND_TEST(PingTest, SendPersistedPings_OneRequest);
   FRIEND_TEST(PingTest, DISABLED_SendUsingGoogleUpdate);
   FRIEND_TEST(PersistedPingsTest, AddPingEvents);
 
@@ -183,6 +187,21 @@ class Ping {
   static const TCHAR* const kRegValuePersistedPingTime;
   static const TCHAR* const kRegValuePersistedPingString;
   static const time64 kPersistedPingExpiry100ns;
+  static const time64 kPersistedPingBatchMaxAgeSpread100ns;
+  static const int kMaxPersistedPingBatchLength;
+
+  // A request which carries the apps of one or more persisted pings.
+  struct PersistedPingBatch {
+    PersistedPingBatch() : persisted_time(0) {}
+
+    CString request_string;
+
+    // The time the oldest ping of the batch was persisted.
+    time64 persisted_time;
+
+    // The indexes of the pings in the PingsVector the batch was built from.
+    std::vector<size_t> ping_indexes;
+  };
 
   void Initialize(bool is_machine,
                   const CString& session_id,
@@ -207,6 +226,16 @@ class Ping {
   static HRESULT LoadPersistedPings(bool is_machine,
                                     PingsVector* persisted_pings);
   static bool IsPingExpired(time64 persisted_time);
+
+  // Merges the apps of the persisted pings which only differ by their request
+  // id and their session id into batches. The session id is an attribute of
+  // the request only, so a batch is sent with the session id of its oldest
+  // ping. The X-RequestAge header applies to the whole request, so only pings
+  // persisted within kPersistedPingBatchMaxAgeSpread100ns of each other are
+  // merged. A ping which can't be parsed is sent as is.
+  static void BuildPersistedPingBatches(
+      const PingsVector& persisted_pings,
+      std::vector<PersistedPingBatch>* batches);
   static HRESULT DeletePersistedPing(bool is_machine,
                                      const CString& persisted_subkey_name);
   void DeletePersistedPingOnSuccess(const HRESULT& hr);
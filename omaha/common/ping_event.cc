@@ -16,7 +16,7 @@
 #include "omaha/common/ping_event.h"
 #include "omaha/base/safe_format.h"
 #include "omaha/base/string.h"
-#include "omaha/base/xml_utils.h"
+#include "omaha/base/xml_writer.h"
 #include "omaha/common/xml_const.h"
 
 namespace omaha {
@@ -61,97 +61,39 @@ PingEvent::PingEvent(Types type,
   ASSERT1(EVENT_UNKNOWN != event_type_);
 }
 
-HRESULT PingEvent::ToXml(IXMLDOMNode* parent_node) const {
-  HRESULT hr = AddXMLAttributeNode(parent_node,
-                                   xml::kXmlNamespace,
-                                   xml::attribute::kEventType,
-                                   itostr(event_type_));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(parent_node,
-                           xml::kXmlNamespace,
-                           xml::attribute::kEventResult,
-                           itostr(event_result_));
-  if (FAILED(hr)) {
-    return hr;
-  }
+HRESULT PingEvent::ToXml(XmlWriter* writer) const {
+  ASSERT1(writer);
 
-  hr = AddXMLAttributeNode(parent_node,
-                           xml::kXmlNamespace,
-                           xml::attribute::kErrorCode,
-                           itostr(error_code_));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(parent_node,
-                           xml::kXmlNamespace,
-                           xml::attribute::kExtraCode1,
-                           itostr(extra_code1_));
-  if (FAILED(hr)) {
-    return hr;
-  }
+  writer->AddAttribute(xml::attribute::kEventType, event_type_);
+  writer->AddAttribute(xml::attribute::kEventResult, event_result_);
+  writer->AddAttribute(xml::attribute::kErrorCode, error_code_);
+  writer->AddAttribute(xml::attribute::kExtraCode1, extra_code1_);
 
   if (source_url_index_ >= 0) {
-    hr = AddXMLAttributeNode(parent_node,
-                             xml::kXmlNamespace,
-                             xml::attribute::kSourceUrlIndex,
-                             itostr(source_url_index_));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kSourceUrlIndex, source_url_index_);
   }
 
   if (update_check_time_ms_ != 0) {
-    hr = AddXMLAttributeNode(parent_node,
-                             xml::kXmlNamespace,
-                             xml::attribute::kUpdateCheckTime,
-                             itostr(update_check_time_ms_));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kUpdateCheckTime,
+                         update_check_time_ms_);
   }
 
   if (download_time_ms_ != 0) {
-    hr = AddXMLAttributeNode(parent_node,
-                             xml::kXmlNamespace,
-                             xml::attribute::kDownloadTime,
-                             itostr(download_time_ms_));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kDownloadTime, download_time_ms_);
   }
 
   if (num_bytes_downloaded_ != 0) {
-    hr = AddXMLAttributeNode(parent_node,
-                             xml::kXmlNamespace,
-                             xml::attribute::kAppBytesDownloaded,
-                             String_Uint64ToString(num_bytes_downloaded_, 10));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kAppBytesDownloaded,
+                         String_Uint64ToString(num_bytes_downloaded_, 10));
   }
 
   if (app_size_ != 0) {
-    hr = AddXMLAttributeNode(parent_node,
-                             xml::kXmlNamespace,
-                             xml::attribute::kAppBytesTotal,
-                             String_Uint64ToString(app_size_, 10));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kAppBytesTotal,
+                         String_Uint64ToString(app_size_, 10));
   }
 
   if (install_time_ms_ != 0) {
-    hr = AddXMLAttributeNode(parent_node,
-                             xml::kXmlNamespace,
-                             xml::attribute::kInstallTime,
-                             itostr(install_time_ms_));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kInstallTime, install_time_ms_);
   }
 
   return S_OK;
@@ -24,6 +24,8 @@
 
 namespace omaha {
 
+class XmlWriter;
+
 class PingEvent {
  public:
   // The extra code represents the file order as defined by the setup.
@@ -133,7 +135,10 @@ class PingEvent {
 
   virtual ~PingEvent() {}
 
-  virtual HRESULT ToXml(IXMLDOMNode* parent_node) const;
+  // Writes the attributes of the event to the element which the writer has
+  // just started.
+  virtual HRESULT ToXml(XmlWriter* writer) const;
+
   virtual CString ToString() const;
 
  private:
@@ -50,7 +50,7 @@ class PingEventDownloadMetrics : public PingEvent {
                            const DownloadMetrics& download_metrics);
   virtual ~PingEventDownloadMetrics() {}
 
-  virtual HRESULT ToXml(IXMLDOMNode* parent_node) const;
+  virtual HRESULT ToXml(XmlWriter* writer) const;
   virtual CString ToString() const;
 
  private:
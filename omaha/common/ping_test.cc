@@ -25,10 +25,50 @@
 #include "omaha/common/goopdate_utils.h"
 #include "omaha/common/ping.h"
 #include "omaha/goopdate/app_unittest_base.h"
+#include "omaha/testing/loopback_http_server.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
 
+namespace {
+
+// Returns the request string of an install ping for |version| of Omaha.
+CString BuildInstallPingString(const CString& session_id,
+                               const CString& version) {
+  PingEventPtr ping_event(
+      new PingEvent(PingEvent::EVENT_INSTALL_COMPLETE,
+                    PingEvent::EVENT_RESULT_SUCCESS,
+                    S_OK,
+                    0));
+
+  CommandLineExtraArgs command_line_extra_args;
+  command_line_extra_args.language = _T("en");
+
+  Ping ping(false, session_id, _T("oneclick"));
+  ping.LoadAppDataFromExtraArgs(command_line_extra_args);
+  ping.BuildOmahaPing(version, _T(""), ping_event);
+
+  CString ping_string;
+  EXPECT_SUCCEEDED(ping.BuildRequestString(&ping_string));
+  return ping_string;
+}
+
+size_t CountOccurrences(const CString& s, const TCHAR* substring) {
+  size_t count = 0;
+  for (int pos = s.Find(substring); pos != -1;
+       pos = s.Find(substring, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void RestoreAndDeleteRegistryHives() {
+  RestoreRegistryHives();
+  RegKey::DeleteKey(kRegistryHiveOverrideRoot, true);
+}
+
+}  // namespace
+
 class PingTest : public testing::Test {
  protected:
   virtual void SetUp() {
@@ -359,6 +399,168 @@ TEST_F(PingTest, PersistAndSendPersistedPings) {
   EXPECT_EQ(0, pings_reg_key.GetSubkeyCount());
 }
 
+TEST_F(PingTest, BuildPersistedPingBatches) {
+  const time64 now = GetCurrent100NSTime();
+  Ping::PingsVector persisted_pings;
+  persisted_pings.push_back(std::make_pair(_T("s1 first"), std::make_pair(
+      now,
+      BuildInstallPingString(_T("s1"), _T("1.0.0.1")))));
+  persisted_pings.push_back(std::make_pair(_T("s1 later"), std::make_pair(
+      now + 10 * kMinsTo100ns,
+      BuildInstallPingString(_T("s1"), _T("1.0.0.2")))));
+  persisted_pings.push_back(std::make_pair(_T("s2"), std::make_pair(
+      now + 5 * kMinsTo100ns,
+      BuildInstallPingString(_T("s2"), _T("1.0.0.3")))));
+  persisted_pings.push_back(std::make_pair(_T("s1 much later"), std::make_pair(
+      now + 2 * kHoursTo100ns,
+      BuildInstallPingString(_T("s1"), _T("1.0.0.4")))));
+  persisted_pings.push_back(std::make_pair(_T("corrupt"), std::make_pair(
+      now + kMinsTo100ns,
+      CString(_T("<request")))));
+
+  std::vector<Ping::PersistedPingBatch> batches;
+  Ping::BuildPersistedPingBatches(persisted_pings, &batches);
+
+  // The batches are ordered by the time of their oldest ping.
+  ASSERT_EQ(3U, batches.size());
+
+  // The pings which were persisted within an hour share the request of the
+  // oldest ping, including its session id, even if they were persisted by
+  // different sessions.
+  EXPECT_EQ(now, batches[0].persisted_time);
+  ASSERT_EQ(3U, batches[0].ping_indexes.size());
+  EXPECT_EQ(0U, batches[0].ping_indexes[0]);
+  EXPECT_EQ(2U, batches[0].ping_indexes[1]);
+  EXPECT_EQ(1U, batches[0].ping_indexes[2]);
+  EXPECT_EQ(1U, CountOccurrences(batches[0].request_string,
+                                 _T("requestid=")));
+  EXPECT_EQ(1U, CountOccurrences(batches[0].request_string,
+                                 _T("sessionid=")));
+  EXPECT_NE(-1, batches[0].request_string.Find(_T("sessionid=\"s1\"")));
+  EXPECT_EQ(3U, CountOccurrences(batches[0].request_string, _T("<app ")));
+  EXPECT_NE(-1, batches[0].request_string.Find(_T("version=\"1.0.0.1\"")));
+  EXPECT_NE(-1, batches[0].request_string.Find(_T("version=\"1.0.0.2\"")));
+  EXPECT_NE(-1, batches[0].request_string.Find(_T("version=\"1.0.0.3\"")));
+
+  // The pings which can't be batched are sent as they were persisted.
+  ASSERT_EQ(1U, batches[1].ping_indexes.size());
+  EXPECT_EQ(4U, batches[1].ping_indexes[0]);
+  EXPECT_STREQ(_T("<request"), batches[1].request_string);
+
+  ASSERT_EQ(1U, batches[2].ping_indexes.size());
+  EXPECT_EQ(3U, batches[2].ping_indexes[0]);
+  EXPECT_STREQ(persisted_pings[3].second.second, batches[2].request_string);
+}
+
+TEST_F(PingTest, BuildPersistedPingBatches_SizeLimit) {
+  const CString ping_string(BuildInstallPingString(_T("s"), _T("1.0.0.0")));
+  const int num_pings =
+      3 * Ping::kMaxPersistedPingBatchLength / ping_string.GetLength();
+
+  const time64 now = GetCurrent100NSTime();
+  Ping::PingsVector persisted_pings;
+  for (int i = 0; i < num_pings; ++i) {
+    CString subkey_name;
+    subkey_name.Format(_T("%d"), i);
+    persisted_pings.push_back(
+        std::make_pair(subkey_name, std::make_pair(now, ping_string)));
+  }
+
+  std::vector<Ping::PersistedPingBatch> batches;
+  Ping::BuildPersistedPingBatches(persisted_pings, &batches);
+
+  EXPECT_LE(3U, batches.size());
+  EXPECT_GE(4U, batches.size());
+
+  size_t num_batched_pings = 0;
+  for (size_t i = 0; i != batches.size(); ++i) {
+    for (size_t j = 0; j != batches[i].ping_indexes.size(); ++j) {
+      EXPECT_EQ(num_batched_pings++, batches[i].ping_indexes[j]);
+    }
+    EXPECT_EQ(batches[i].ping_indexes.size(),
+              CountOccurrences(batches[i].request_string, _T("<app ")));
+  }
+  EXPECT_EQ(static_cast<size_t>(num_pings), num_batched_pings);
+}
+
+// Sends the persisted pings to a local server, which counts the requests.
+TEST_F(PingTest, SendPersistedPings_OneRequest) {
+  RegKey::DeleteKey(kRegistryHiveOverrideRoot, true);
+  OverrideRegistryHives(kRegistryHiveOverrideRoot);
+  ON_SCOPE_EXIT(RestoreAndDeleteRegistryHives);
+
+  LoopbackHttpServer server;
+  ASSERT_SUCCEEDED(server.Start());
+  server.AddFile(_T("/ping"),
+                 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                 "<response protocol=\"3.0\"/>",
+                 0);
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueNamePingUrl,
+                                    server.base_url() + _T("ping")));
+
+  // The pings are persisted by different sessions, as they are when the
+  // machine stays offline across several updates.
+  const TCHAR* const kVersions[] = {
+    _T("1.0.0.1"), _T("1.0.0.2"), _T("1.0.0.3"),
+  };
+  const TCHAR* const kSessionIds[] = {
+    _T("session 1"), _T("session 2"), _T("session 3"),
+  };
+  for (size_t i = 0; i != arraysize(kVersions); ++i) {
+    PingEventPtr ping_event(
+        new PingEvent(PingEvent::EVENT_INSTALL_COMPLETE,
+                      PingEvent::EVENT_RESULT_SUCCESS,
+                      S_OK,
+                      0));
+    Ping ping(false, kSessionIds[i], _T("oneclick"));
+    ping.LoadAppDataFromExtraArgs(CommandLineExtraArgs());
+    ping.BuildOmahaPing(kVersions[i], _T(""), ping_event);
+    EXPECT_SUCCEEDED(ping.PersistPing());
+  }
+
+  const CString reg_path(Ping::GetPersistedPingsRegPath(false));
+  RegKey pings_reg_key;
+  EXPECT_SUCCEEDED(pings_reg_key.Open(reg_path, KEY_READ));
+  EXPECT_EQ(arraysize(kVersions), pings_reg_key.GetSubkeyCount());
+
+  EXPECT_SUCCEEDED(Ping::SendPersistedPings(false));
+
+  EXPECT_EQ(1, server.GetRequestCount(_T("/ping")));
+  const std::vector<std::string> requests(
+      server.GetPostRequests(_T("/ping")));
+  ASSERT_EQ(1U, requests.size());
+  EXPECT_NE(std::string::npos, requests[0].find("X-RequestAge: "));
+  const size_t session_id_pos = requests[0].find("sessionid=");
+  ASSERT_NE(std::string::npos, session_id_pos);
+  EXPECT_EQ(std::string::npos,
+            requests[0].find("sessionid=", session_id_pos + 1));
+  for (size_t i = 0; i != arraysize(kVersions); ++i) {
+    CStringA version_attribute;
+    version_attribute.Format("version=\"%S\"", kVersions[i]);
+    EXPECT_NE(std::string::npos,
+              requests[0].find(version_attribute.GetString()));
+  }
+  EXPECT_EQ(0U, pings_reg_key.GetSubkeyCount());
+
+  // The pings are kept if the server fails to accept them.
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueNamePingUrl,
+                                    server.base_url() + _T("missing")));
+  Ping ping(false, _T("unittest"), _T("oneclick"));
+  ping.LoadAppDataFromExtraArgs(CommandLineExtraArgs());
+  ping.BuildOmahaPing(_T("1.0.0.4"), _T(""), PingEventPtr(
+      new PingEvent(PingEvent::EVENT_INSTALL_COMPLETE,
+                    PingEvent::EVENT_RESULT_SUCCESS,
+                    S_OK,
+                    0)));
+  EXPECT_SUCCEEDED(ping.PersistPing());
+
+  EXPECT_SUCCEEDED(Ping::SendPersistedPings(false));
+  EXPECT_EQ(1, server.GetRequestCount(_T("/ping")));
+  EXPECT_EQ(1U, pings_reg_key.GetSubkeyCount());
+}
+
 // The tests below rely on the out-of-process mechanism to send install pings.
 // Enable the test to debug the sending code.
 TEST_F(PingTest, DISABLED_SendUsingGoogleUpdate) {
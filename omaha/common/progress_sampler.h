@@ -17,8 +17,6 @@
 #define OMAHA_COMMON_PROGRESS_SAMPLER_H_
 
 #include <windows.h>
-#include <algorithm>
-#include <queue>
 #include "omaha/base/debug.h"
 #include "omaha/base/time.h"
 
@@ -52,11 +50,20 @@ namespace omaha {
 //   // Samples in queue now: [(20, 200), (200, 300), [520, 450)].
 //   // Average speed: (520-20) / (450-200) = 2.
 //   ASSERT1(2 == progress_sampler.GetAverageProgressPerMs());
+//
+// The samples are kept in a ring buffer of kMaxSamples entries, so adding a
+// sample never allocates. When the buffer is full, the oldest sample is
+// discarded even if it is still within the time range. Callers which produce
+// samples faster than kMaxSamples per time range should coalesce them first.
 template<typename T> class ProgressSampler {
  public:
+  static const size_t kMaxSamples = 64;
+
   ProgressSampler(int sample_time_range_ms, int minimum_range_required_ms)
       : sample_time_range_ms_(sample_time_range_ms),
-        minimum_range_required_ms_(minimum_range_required_ms) {
+        minimum_range_required_ms_(minimum_range_required_ms),
+        first_(0),
+        size_(0) {
       ASSERT1(minimum_range_required_ms > 0);
   }
 
@@ -65,30 +72,34 @@ template<typename T> class ProgressSampler {
   }
 
   void AddSample(uint64 timestamp_in_ms, T sample_value) {
-    if (!samples_.empty() &&
-        (sample_value < samples_.back().value ||          // Value regression.
-         timestamp_in_ms < samples_.back().timestamp)) {  // Clock regression.
+    if (size_ != 0 &&
+        (sample_value < back().value ||          // Value regression.
+         timestamp_in_ms < back().timestamp)) {  // Clock regression.
       Reset();
       return;
     }
 
-    samples_.push(Sample(timestamp_in_ms, sample_value));
+    if (size_ == kMaxSamples) {
+      PopFront();
+    }
+    samples_[(first_ + size_) % kMaxSamples] =
+        Sample(timestamp_in_ms, sample_value);
+    ++size_;
 
     // Discard old data that is out of range.
-    while (samples_.back().timestamp - samples_.front().timestamp >
-           sample_time_range_ms_ && samples_.size() > 2) {
-      samples_.pop();
+    while (back().timestamp - front().timestamp > sample_time_range_ms_ &&
+           size_ > 2) {
+      PopFront();
     }
   }
 
   bool HasEnoughSamples() const {
-    if (samples_.size() < 2) {
+    if (size_ < 2) {
       return false;
     }
 
-    ASSERT1(samples_.back().timestamp >= samples_.front().timestamp);
-    return (samples_.back().timestamp - samples_.front().timestamp >
-            minimum_range_required_ms_);
+    ASSERT1(back().timestamp >= front().timestamp);
+    return (back().timestamp - front().timestamp > minimum_range_required_ms_);
   }
 
   T GetAverageProgressPerMs() const {
@@ -96,15 +107,16 @@ template<typename T> class ProgressSampler {
       return kUnknownProgressPerMs;
     }
 
-    uint64 time_diff = samples_.back().timestamp - samples_.front().timestamp;
+    uint64 time_diff = back().timestamp - front().timestamp;
     ASSERT1(time_diff > 0);
-    return (samples_.back().value - samples_.front().value) /
-            static_cast<T>(time_diff);
+    return (back().value - front().value) / static_cast<T>(time_diff);
   }
 
+  size_t num_samples() const { return size_; }
+
   void Reset() {
-    std::queue<Sample> empty_queue;
-    std::swap(samples_, empty_queue);
+    first_ = 0;
+    size_ = 0;
   }
 
   static const T kUnknownProgressPerMs = static_cast<T>(-1);
@@ -114,6 +126,8 @@ template<typename T> class ProgressSampler {
   const uint64 minimum_range_required_ms_;
 
   struct Sample {
+    Sample() : timestamp(0), value(T()) {
+    }
     Sample(uint64 local_timestamp, T local_value)
         : timestamp(local_timestamp), value(local_value) {
     }
@@ -121,7 +135,26 @@ template<typename T> class ProgressSampler {
     uint64  timestamp;
     T value;
   };
-  std::queue<Sample> samples_;
+
+  const Sample& front() const {
+    ASSERT1(size_ != 0);
+    return samples_[first_];
+  }
+
+  const Sample& back() const {
+    ASSERT1(size_ != 0);
+    return samples_[(first_ + size_ - 1) % kMaxSamples];
+  }
+
+  void PopFront() {
+    ASSERT1(size_ != 0);
+    first_ = (first_ + 1) % kMaxSamples;
+    --size_;
+  }
+
+  Sample samples_[kMaxSamples];
+  size_t first_;
+  size_t size_;
 };
 
 }  // namespace omaha
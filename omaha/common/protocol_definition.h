@@ -242,6 +242,9 @@ struct UpdateCheck {
 
   std::vector<CString> urls;
 
+  // The base urls of the differential patches.
+  std::vector<CString> diff_urls;
+
   InstallManifest install_manifest;
 };
 
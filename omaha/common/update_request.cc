@@ -152,6 +152,11 @@ HRESULT UpdateRequest::Serialize(CString* buffer) const {
   return XmlParser::SerializeRequest(*this, buffer);
 }
 
+HRESULT UpdateRequest::Serialize(CStringA* buffer) const {
+  ASSERT1(buffer);
+  return XmlParser::SerializeRequest(*this, buffer);
+}
+
 bool UpdateRequest::IsEmpty() const {
   return request_.apps.empty();
 }
@@ -51,6 +51,9 @@ class UpdateRequest {
   // Serializes the request into a buffer.
   HRESULT Serialize(CString* buffer) const;
 
+  // Serializes the request into a buffer as UTF-8.
+  HRESULT Serialize(CStringA* buffer) const;
+
   // Returns true if one of the applications in the request carries a
   // trusted tester token.
   bool has_tt_token() const;
@@ -14,6 +14,7 @@
 // ========================================================================
 
 #include "omaha/common/update_response.h"
+#include <algorithm>
 #include "omaha/base/utils.h"
 #include "omaha/common/xml_parser.h"
 
@@ -54,6 +55,33 @@ int UpdateResponse::GetElapsedDaysSinceDatum() const {
   return response_.day_start.elapsed_days;
 }
 
+const response::App* UpdateResponse::GetApp(const CString& appid) const {
+  CString key(appid);
+  key.MakeUpper();
+
+  // The app with the lowest index is returned if several have the app id.
+  std::vector<AppIndexEntry>::const_iterator it =
+      std::lower_bound(app_index_.begin(),
+                       app_index_.end(),
+                       std::make_pair(key, static_cast<size_t>(0)));
+  if (it == app_index_.end() || it->first != key) {
+    return NULL;
+  }
+
+  return &response_.apps[it->second];
+}
+
+void UpdateResponse::BuildAppIndex() {
+  app_index_.clear();
+  app_index_.reserve(response_.apps.size());
+  for (size_t i = 0; i != response_.apps.size(); ++i) {
+    CString key(response_.apps[i].appid);
+    key.MakeUpper();
+    app_index_.push_back(std::make_pair(key, i));
+  }
+  std::sort(app_index_.begin(), app_index_.end());
+}
+
 // Sets update_response's response_ member to response. Used by unit tests to
 // set the response without needing to craft corresponding XML. UpdateResponse
 // friends this function, allowing it to access the private member.
@@ -61,6 +89,7 @@ void SetResponseForUnitTest(UpdateResponse* update_response,
                             const response::Response& response) {
   ASSERT1(update_response);
   update_response->response_ = response;
+  update_response->BuildAppIndex();
 }
 
 }  // namespace xml
@@ -48,6 +48,10 @@ class UpdateResponse {
 
   const response::Response& response() const { return response_; }
 
+  // Returns the app in the response which has the |appid|, compared without
+  // regard to case, or NULL if there is no such app.
+  const response::App* GetApp(const CString& appid) const;
+
  private:
   friend class XmlParser;
   friend class XmlParserTest;
@@ -58,8 +62,18 @@ class UpdateResponse {
 
   UpdateResponse();
 
+  // Indexes the apps of response_ by their app ids. Must be called whenever
+  // response_ is assigned.
+  void BuildAppIndex();
+
   response::Response response_;
 
+  // The upper-cased app ids of the apps of response_ and their indexes in
+  // response_.apps, sorted, so that looking up the apps of an N-app response
+  // does not take N^2 string comparisons.
+  typedef std::pair<CString, size_t> AppIndexEntry;
+  std::vector<AppIndexEntry> app_index_;
+
   DISALLOW_COPY_AND_ASSIGN(UpdateResponse);
 };
 
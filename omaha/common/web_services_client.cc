@@ -16,6 +16,7 @@
 #include "omaha/common/web_services_client.h"
 #include <atlstr.h>
 #include "omaha/base/const_addresses.h"
+#include "omaha/base/constants.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/logging.h"
@@ -97,6 +98,9 @@ HRESULT WebServicesClient::CreateRequest() {
 
   network_request_->set_num_retries(1);
   network_request_->set_proxy_auth_config(proxy_auth_config_);
+  network_request_->set_proxy_race(
+      kProxyRaceSize,
+      ConfigManager::Instance()->GetProxyRaceDelayMs());
 
   return S_OK;
 }
@@ -112,14 +116,14 @@ HRESULT WebServicesClient::Send(const xml::UpdateRequest* update_request,
     return GOOPDATE_E_CANNOT_USE_NETWORK;
   }
 
-  CString request_string;
-  HRESULT hr = update_request->Serialize(&request_string);
+  CStringA utf8_request_string;
+  HRESULT hr = update_request->Serialize(&utf8_request_string);
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[Serialize failed][0x%x]"), hr));
     return hr;
   }
 
-  ASSERT1(!request_string.IsEmpty());
+  ASSERT1(!utf8_request_string.IsEmpty());
 
   __mutexBlock(lock_) {
     update_request_headers_.clear();
@@ -133,7 +137,7 @@ HRESULT WebServicesClient::Send(const xml::UpdateRequest* update_request,
   const bool use_encryption = update_request->has_tt_token();
 
   return SendStringWithFallback(use_encryption,
-                                &request_string,
+                                utf8_request_string,
                                 update_response);
 }
 
@@ -143,19 +147,19 @@ HRESULT WebServicesClient::SendString(const CString* request_string,
   ASSERT1(request_string);
   ASSERT1(update_response);
 
-  return SendStringWithFallback(false, request_string, update_response);
+  return SendStringWithFallback(false,
+                                WideToUtf8(*request_string),
+                                update_response);
 }
 
 HRESULT WebServicesClient::SendStringWithFallback(
     bool use_encryption,
-    const CString* request_string,
+    const CStringA& utf8_request_string,
     xml::UpdateResponse* update_response) {
   CORE_LOG(L3, (_T("[WebServicesClient::SendStringWithFallback]")));
 
-  ASSERT1(request_string);
   ASSERT1(update_response);
 
-  const CStringA utf8_request_string(WideToUtf8(*request_string));
   CORE_LOG(L3, (_T("[sending web services request as UTF-8][%S]"),
       utf8_request_string));
 
@@ -137,7 +137,7 @@ class WebServicesClient : public WebServicesClientInterface {
   // Returns S_OK if the request is successfully sent, otherwise it returns the
   // error corresponding to the first request sent.
   HRESULT SendStringWithFallback(bool use_encryption,
-                                 const CString* request_string,
+                                 const CStringA& utf8_request_string,
                                  xml::UpdateResponse* update_response);
 
   // Sends a string representing a protocol message and returns a parsed
@@ -62,12 +62,14 @@ const TCHAR* const kAppGuid = _T("appguid");
 const TCHAR* const kApplicationName = _T("appname");
 const TCHAR* const kAppId = _T("appid");
 const TCHAR* const kArch = _T("arch");
+const TCHAR* const kArchive = _T("archive");
 const TCHAR* const kArguments = _T("arguments");
 const TCHAR* const kAvx = _T("avx");
 const TCHAR* const kBrandCode = _T("brand");
 const TCHAR* const kBrowserType = _T("browser");
 const TCHAR* const kClientId = _T("client");
 const TCHAR* const kCodebase = _T("codebase");
+const TCHAR* const kCodebaseDiff = _T("codebasediff");
 const TCHAR* const kCohort = _T("cohort");
 const TCHAR* const kCohortHint = _T("cohorthint");
 const TCHAR* const kCohortName = _T("cohortname");
@@ -92,6 +94,7 @@ const TCHAR* const kExperiments = _T("experiments");
 const TCHAR* const kExtraCode1 = _T("extracode1");
 const TCHAR* const kHash = _T("hash");
 const TCHAR* const kHashSha256 = _T("hash_sha256");
+const TCHAR* const kHashDiffSha256 = _T("hashdiff_sha256");
 const TCHAR* const kIndex = _T("index");
 const TCHAR* const kInstallationId = _T("iid");
 const TCHAR* const kInstallDate = _T("installdate");
@@ -103,6 +106,7 @@ const TCHAR* const kIsMachine = _T("ismachine");
 const TCHAR* const kLang = _T("lang");
 const TCHAR* const kMinOSVersion = _T("min_os_version");
 const TCHAR* const kName = _T("name");
+const TCHAR* const kNameDiff = _T("namediff");
 const TCHAR* const kNextVersion = _T("nextversion");
 const TCHAR* const kOriginURL = _T("originurl");
 const TCHAR* const kParameter = _T("parameter");
@@ -119,6 +123,7 @@ const TCHAR* const kSessionId = _T("sessionid");
 const TCHAR* const kShellVersion = _T("shell_version");
 const TCHAR* const kSignature = _T("signature");
 const TCHAR* const kSize = _T("size");
+const TCHAR* const kSizeDiff = _T("sizediff");
 const TCHAR* const kSourceUrlIndex = _T("source_url_index");
 const TCHAR* const kSse = _T("sse");
 const TCHAR* const kSse2 = _T("sse2");
@@ -154,6 +159,8 @@ namespace value {
 const TCHAR* const kArchAmd64 = _T("x64");
 const TCHAR* const kArchIntel = _T("x86");
 const TCHAR* const kArchUnknown = _T("unknown");
+const TCHAR* const kArchive7z = _T("7z");
+const TCHAR* const kArchiveXz = _T("xz");
 const TCHAR* const kBits = _T("bits");
 const TCHAR* const kCacheable = _T("cacheable");
 const TCHAR* const kClientRegulated = _T("cr");
@@ -62,12 +62,14 @@ extern const TCHAR* const kAppGuid;
 extern const TCHAR* const kApplicationName;
 extern const TCHAR* const kAppId;
 extern const TCHAR* const kArch;
+extern const TCHAR* const kArchive;
 extern const TCHAR* const kArguments;
 extern const TCHAR* const kAvx;
 extern const TCHAR* const kBrandCode;
 extern const TCHAR* const kBrowserType;
 extern const TCHAR* const kClientId;
 extern const TCHAR* const kCodebase;
+extern const TCHAR* const kCodebaseDiff;
 extern const TCHAR* const kCohort;
 extern const TCHAR* const kCohortHint;
 extern const TCHAR* const kCohortName;
@@ -92,6 +94,7 @@ extern const TCHAR* const kExperiments;
 extern const TCHAR* const kExtraCode1;
 extern const TCHAR* const kHash;
 extern const TCHAR* const kHashSha256;
+extern const TCHAR* const kHashDiffSha256;
 extern const TCHAR* const kIndex;
 extern const TCHAR* const kInstallationId;
 extern const TCHAR* const kInstallDate;
@@ -103,6 +106,7 @@ extern const TCHAR* const kIsMachine;
 extern const TCHAR* const kLang;
 extern const TCHAR* const kMinOSVersion;
 extern const TCHAR* const kName;
+extern const TCHAR* const kNameDiff;
 extern const TCHAR* const kNextVersion;
 extern const TCHAR* const kOriginURL;
 extern const TCHAR* const kParameter;
@@ -119,6 +123,7 @@ extern const TCHAR* const kSessionId;
 extern const TCHAR* const kShellVersion;
 extern const TCHAR* const kSignature;
 extern const TCHAR* const kSize;
+extern const TCHAR* const kSizeDiff;
 extern const TCHAR* const kSourceUrlIndex;
 extern const TCHAR* const kSse;
 extern const TCHAR* const kSse2;
@@ -154,6 +159,8 @@ namespace value {
 extern const TCHAR* const kArchAmd64;
 extern const TCHAR* const kArchIntel;
 extern const TCHAR* const kArchUnknown;
+extern const TCHAR* const kArchive7z;
+extern const TCHAR* const kArchiveXz;
 extern const TCHAR* const kBits;
 extern const TCHAR* const kCacheable;
 extern const TCHAR* const kClientRegulated;
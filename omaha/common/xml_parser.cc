@@ -15,14 +15,18 @@
 
 #include "omaha/common/xml_parser.h"
 #include <stdlib.h>
+#include <string>
 #include <vector>
 #include "base/basictypes.h"
+#include "base/scoped_ptr.h"
 #include "omaha/base/constants.h"
 #include "omaha/base/error.h"
 #include "omaha/base/safe_format.h"
 #include "omaha/base/string.h"
 #include "omaha/base/utils.h"
+#include "omaha/base/xml_sax_parser.h"
 #include "omaha/base/xml_utils.h"
+#include "omaha/base/xml_writer.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_group_policy.h"
 #include "omaha/common/goopdate_utils.h"
@@ -159,6 +163,165 @@ CString ConvertProcessorArchitectureToString(DWORD arch) {
   }
 }
 
+// Provides the attributes and the text of the element being handled, whether
+// the response is parsed as a stream or loaded in a DOM.
+class ResponseElement {
+ public:
+  virtual ~ResponseElement() {}
+
+  virtual bool HasAttribute(const TCHAR* name) const = 0;
+
+  // Returns E_FAIL if the element does not have the attribute.
+  virtual HRESULT ReadStringAttribute(const TCHAR* name,
+                                      CString* value) const = 0;
+
+  // Reads the text of an element which only contains text.
+  virtual HRESULT ReadStringValue(CString* value) const = 0;
+};
+
+namespace {
+
+const size_t kMaxAttributeNameLength = 64;
+
+// Reads an element of a response loaded in a DOM.
+class DomResponseElement : public ResponseElement {
+ public:
+  explicit DomResponseElement(IXMLDOMNode* node) : node_(node) {
+    ASSERT1(node);
+  }
+
+  virtual bool HasAttribute(const TCHAR* name) const {
+    return omaha::HasAttribute(node_, name);
+  }
+
+  virtual HRESULT ReadStringAttribute(const TCHAR* name,
+                                      CString* value) const {
+    return omaha::ReadStringAttribute(node_, name, value);
+  }
+
+  virtual HRESULT ReadStringValue(CString* value) const {
+    return omaha::ReadStringValue(node_, value);
+  }
+
+ private:
+  IXMLDOMNode* node_;
+
+  DISALLOW_COPY_AND_ASSIGN(DomResponseElement);
+};
+
+// Reads an element of a response parsed by the XmlSaxParser.
+class StreamResponseElement : public ResponseElement {
+ public:
+  explicit StreamResponseElement(const XmlSaxElement& element)
+      : element_(element) {}
+
+  virtual bool HasAttribute(const TCHAR* name) const {
+    return FindAttribute(name) != NULL;
+  }
+
+  virtual HRESULT ReadStringAttribute(const TCHAR* name,
+                                      CString* value) const {
+    ASSERT1(value);
+
+    const std::string* attribute_value = FindAttribute(name);
+    if (!attribute_value) {
+      return E_FAIL;
+    }
+
+    *value = Utf8ToWideChar(attribute_value->data(),
+                            static_cast<uint32>(attribute_value->size()));
+    return S_OK;
+  }
+
+  // Fails if the element has child elements or if its text is only
+  // whitespace, since the DOM drops such text.
+  virtual HRESULT ReadStringValue(CString* value) const {
+    ASSERT1(value);
+
+    // The value must be a single text node, as ReadStringValue requires for
+    // a DOM node.
+    const std::string& text = element_.text();
+    if (element_.has_child_elements() ||
+        element_.is_text_split() ||
+        text.find_first_not_of(" \t\r\n") == std::string::npos) {
+      return E_INVALIDARG;
+    }
+
+    *value = Utf8ToWideChar(text.data(), static_cast<uint32>(text.size()));
+    return S_OK;
+  }
+
+ private:
+  // The attribute names are ASCII constants, which are converted on the
+  // stack to avoid allocating memory for each lookup.
+  const std::string* FindAttribute(const TCHAR* name) const {
+    ASSERT1(name);
+
+    char ascii_name[kMaxAttributeNameLength + 1] = {0};
+    for (size_t i = 0; name[i]; ++i) {
+      if (i == kMaxAttributeNameLength || name[i] > 0x7F) {
+        ASSERT(false, (_T("[unexpected attribute name][%s]"), name));
+        return NULL;
+      }
+      ascii_name[i] = static_cast<char>(name[i]);
+    }
+    return element_.FindAttribute(ascii_name);
+  }
+
+  const XmlSaxElement& element_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamResponseElement);
+};
+
+// The functions below read the elements the same way the functions in
+// xml_utils.h read the DOM nodes.
+bool HasAttribute(const ResponseElement& node, const TCHAR* name) {
+  return node.HasAttribute(name);
+}
+
+HRESULT ReadStringAttribute(const ResponseElement& node,
+                            const TCHAR* name,
+                            CString* value) {
+  return node.ReadStringAttribute(name, value);
+}
+
+HRESULT ReadIntAttribute(const ResponseElement& node,
+                         const TCHAR* name,
+                         int* value) {
+  ASSERT1(value);
+
+  CString string_value;
+  HRESULT hr = node.ReadStringAttribute(name, &string_value);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  if (!String_StringToDecimalIntChecked(string_value, value)) {
+    return GOOPDATEXML_E_STRTOUINT;
+  }
+  return S_OK;
+}
+
+HRESULT ReadBooleanAttribute(const ResponseElement& node,
+                             const TCHAR* name,
+                             bool* value) {
+  ASSERT1(value);
+
+  CString string_value;
+  HRESULT hr = node.ReadStringAttribute(name, &string_value);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  return String_StringToBool(string_value, value);
+}
+
+HRESULT ReadStringValue(const ResponseElement& node, CString* value) {
+  return node.ReadStringValue(value);
+}
+
+}  // namespace
+
 // The ElementHandler classes should also be in an anonymous namespace but
 // the base class cannot be because it is used in the header file.
 
@@ -170,8 +333,7 @@ class ElementHandler {
   ElementHandler() {}
   virtual ~ElementHandler() {}
 
-  HRESULT Handle(IXMLDOMNode* node, response::Response* response) {
-    ASSERT1(node);
+  HRESULT Handle(const ResponseElement& node, response::Response* response) {
     ASSERT1(response);
 
     HRESULT hr = Validate(node);
@@ -189,13 +351,14 @@ class ElementHandler {
 
  private:
   // Validates a node and returns S_OK in case of success.
-  virtual HRESULT Validate(IXMLDOMNode* node) {
+  virtual HRESULT Validate(const ResponseElement& node) {
     UNREFERENCED_PARAMETER(node);
     return S_OK;
   }
 
   // Parses the node and stores its values in the response.
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     UNREFERENCED_PARAMETER(node);
     UNREFERENCED_PARAMETER(response);
     return S_OK;
@@ -211,7 +374,8 @@ class ResponseElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new ResponseElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     HRESULT hr = ReadStringAttribute(node,
                                      xml::attribute::kProtocol,
                                      &response->protocol);
@@ -233,7 +397,8 @@ class AppElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new AppElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response::App app;
 
     HRESULT hr = ReadStringAttribute(node, xml::attribute::kAppId, &app.appid);
@@ -268,8 +433,8 @@ class AppElementHandler : public ElementHandler {
     return S_OK;
   }
 
-  HRESULT ReadCohortAttributes(IXMLDOMNode* node, response::App* app) {
-    ASSERT1(node);
+  HRESULT ReadCohortAttributes(const ResponseElement& node,
+                               response::App* app) {
     ASSERT1(app);
 
     if (HasAttribute(node, xml::attribute::kCohort)) {
@@ -310,7 +475,8 @@ class UpdateCheckElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new UpdateCheckElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response::UpdateCheck& update_check = response->apps.back().update_check;
 
     ReadStringAttribute(node,
@@ -341,14 +507,25 @@ class UrlElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new UrlElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
+    response::UpdateCheck& update_check = response->apps.back().update_check;
+
+    // An url has a codebase, a codebasediff for the differential patches, or
+    // both.
+    CString diff_url;
+    if (SUCCEEDED(ReadStringAttribute(node,
+                                      xml::attribute::kCodebaseDiff,
+                                      &diff_url))) {
+      update_check.diff_urls.push_back(diff_url);
+    }
+
     CString url;
     HRESULT hr = ReadStringAttribute(node, xml::attribute::kCodebase, &url);
     if (FAILED(hr)) {
-      return hr;
+      return diff_url.IsEmpty() ? hr : S_OK;
     }
 
-    response::UpdateCheck& update_check = response->apps.back().update_check;
     update_check.urls.push_back(url);
 
     return S_OK;
@@ -362,7 +539,8 @@ class ManifestElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new ManifestElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     InstallManifest& install_manifest =
         response->apps.back().update_check.install_manifest;
     ReadStringAttribute(node,
@@ -387,7 +565,8 @@ class PackageElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new PackageElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     InstallPackage install_package;
 
     HRESULT hr = ReadStringAttribute(node,
@@ -420,6 +599,32 @@ class PackageElementHandler : public ElementHandler {
       return hr;
     }
 
+    // The differential patch is optional, but it is only used if it is
+    // complete.
+    if (SUCCEEDED(ReadStringAttribute(node,
+                                      xml::attribute::kNameDiff,
+                                      &install_package.name_diff)) &&
+        (FAILED(ReadIntAttribute(node,
+                                 xml::attribute::kSizeDiff,
+                                 &install_package.size_diff)) ||
+         FAILED(ReadStringAttribute(node,
+                                    xml::attribute::kHashDiffSha256,
+                                    &install_package.hash_diff_sha256)))) {
+      install_package.name_diff.Empty();
+      install_package.size_diff = 0;
+      install_package.hash_diff_sha256.Empty();
+    }
+
+    // Running an archive as the installer would fail, so the formats which
+    // are not supported make the response invalid.
+    if (SUCCEEDED(ReadStringAttribute(node,
+                                      xml::attribute::kArchive,
+                                      &install_package.archive)) &&
+        install_package.archive.CompareNoCase(xml::value::kArchiveXz) != 0 &&
+        install_package.archive.CompareNoCase(xml::value::kArchive7z) != 0) {
+      return E_INVALIDARG;
+    }
+
     InstallManifest& install_manifest =
         response->apps.back().update_check.install_manifest;
     install_manifest.packages.push_back(install_package);
@@ -441,7 +646,8 @@ class ActionElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new ActionElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     InstallAction install_action;
 
     CString event;
@@ -491,7 +697,8 @@ class DataElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new DataElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response->apps.back().data.push_back(response::Data());
     response::Data& data = response->apps.back().data.back();
 
@@ -534,7 +741,8 @@ class PingElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new PingElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response::Ping& ping = response->apps.back().ping;
     ReadStringAttribute(node, xml::attribute::kStatus, &ping.status);
     ASSERT1(ping.status == xml::response::kStatusOkValue);
@@ -548,7 +756,8 @@ class EventElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new EventElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response::Event event;
     ReadStringAttribute(node, xml::attribute::kStatus, &event.status);
     ASSERT1(event.status == xml::response::kStatusOkValue);
@@ -564,7 +773,8 @@ class DayStartElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new DayStartElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     ReadIntAttribute(node,
                      xml::attribute::kElapsedSeconds,
                      &response->day_start.elapsed_seconds);
@@ -590,7 +800,8 @@ class SystemRequirementsElementHandler : public ElementHandler {
   }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response::SystemRequirements& sys_req = response->sys_req;
 
     HRESULT hr = ReadStringAttribute(node,
@@ -641,7 +852,8 @@ class GUpdateElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new GUpdateElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     HRESULT hr = ReadStringAttribute(node,
                                      xml::attribute::kProtocol,
                                      &response->protocol);
@@ -659,7 +871,8 @@ class UpdateCheckElementHandler : public ElementHandler {
   static ElementHandler* Create() { return new UpdateCheckElementHandler; }
 
  private:
-  virtual HRESULT Parse(IXMLDOMNode* node, response::Response* response) {
+  virtual HRESULT Parse(const ResponseElement& node,
+                        response::Response* response) {
     response::UpdateCheck& update_check = response->apps.back().update_check;
 
     HRESULT hr = ReadStringAttribute(node,
@@ -733,7 +946,7 @@ class UpdateCheckElementHandler : public ElementHandler {
     return S_OK;
   }
 
-  HRESULT ParsePostInstallActions(IXMLDOMNode* node,
+  HRESULT ParsePostInstallActions(const ResponseElement& node,
                                   InstallAction* post_install_action) {
     InstallAction install_action;
     CString success_action;
@@ -817,713 +1030,288 @@ HRESULT XmlParser::SerializeRequest(const UpdateRequest& update_request,
                                     CString* buffer) {
   ASSERT1(buffer);
 
-  XmlParser xml_parser;
-
-  HRESULT hr = xml_parser.BuildDom(update_request.request());
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = xml_parser.GetXml(buffer);
+  CStringA utf8_buffer;
+  HRESULT hr = SerializeRequest(update_request, &utf8_buffer);
   if (FAILED(hr)) {
     return hr;
   }
 
+  *buffer = Utf8ToWideChar(utf8_buffer.GetString(), utf8_buffer.GetLength());
   return S_OK;
 }
 
-HRESULT XmlParser::BuildDom(const request::Request& request) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildDom]")));
-  HRESULT hr = CoCreateSafeDOMDocument(&document_);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  request_ = &request;
-
-  hr = BuildRequestElement();
-  if (FAILED(hr)) {
-    return hr;
-  }
+HRESULT XmlParser::SerializeRequest(const UpdateRequest& update_request,
+                                    CStringA* buffer) {
+  CORE_LOG(L3, (_T("[XmlParser::SerializeRequest]")));
 
-  return S_OK;
-}
+  ASSERT1(buffer);
 
-// Extract the string out of the DOM, and add the initial processing
-// instruction. The xml property of the document converts to the document from
-// its original encoding to Unicode. As a result, the xml directive and the
-// desired encoding must be explicitely set here.
-HRESULT XmlParser::GetXml(CString* buffer) {
-  CORE_LOG(L3, (_T("[XmlParser::GetXml]")));
+  // The elements are written without a namespace prefix.
+  ASSERT1(!kXmlNamespace);
 
-  ASSERT1(buffer);
+  XmlParser xml_parser;
+  xml_parser.request_ = &update_request.request();
 
-  CComBSTR xml_body;
-  HRESULT hr = document_->get_xml(&xml_body);
+  buffer->Truncate(0);
+  XmlWriter writer(buffer);
+  writer.WriteDeclaration();
+  HRESULT hr = xml_parser.WriteRequestElement(&writer);
   if (FAILED(hr)) {
+    buffer->Truncate(0);
     return hr;
   }
 
-  *buffer = kXmlDirective;
-  *buffer += xml_body;
-
-  // The xml string contains a CR LF pair at the end.
-  buffer->TrimRight(_T("\r\n"));
-
+  ASSERT1(writer.is_complete());
   return S_OK;
 }
 
-
-HRESULT XmlParser::BuildRequestElement() {
-  CORE_LOG(L3, (_T("[XmlParser::BuildRequestElement]")));
-
-  CComPtr<IXMLDOMNode> element;
-  HRESULT hr = CreateElementNode(xml::element::kRequest, _T(""), &element);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
+HRESULT XmlParser::WriteRequestElement(XmlWriter* writer) {
+  ASSERT1(writer);
   ASSERT1(request_);
 
-  // Add attributes to the top element:
-  // * protocol - protocol version
-  // * version - Omaha (goopdate.dll) version
-  // * shell_version - Omaha shell (GoogleUpdate.exe) version
-  // * ismachine - is machine Omaha
-  // * installsource - install source
-  // * originurl - origin url, primarily set by Update3Web plugins
-  // * testsource - test source
-  // * requestid - unique request ID
-  // * periodoverridesec - override value for update check frequency
-  // * dedup - the algorithm used to dedup users
-  // * dlpref - the GPO settings for download url preference
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kProtocol,
-                           request_->protocol_version);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kVersion,
-                           request_->omaha_version);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kShellVersion,
-                           request_->omaha_shell_version);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kIsMachine,
-                           request_->is_machine ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
+  writer->StartElement(xml::element::kRequest);
 
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSessionId,
-                           request_->session_id);
-  if (FAILED(hr)) {
-    return hr;
-  }
+  writer->AddAttribute(xml::attribute::kProtocol, request_->protocol_version);
+  writer->AddAttribute(xml::attribute::kVersion, request_->omaha_version);
+  writer->AddAttribute(xml::attribute::kShellVersion,
+                       request_->omaha_shell_version);
+  writer->AddAttribute(xml::attribute::kIsMachine,
+                       request_->is_machine ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kSessionId, request_->session_id);
 
   if (!request_->uid.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kUserId,
-                             request_->uid);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kUserId, request_->uid);
   }
 
   if (!request_->install_source.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kInstallSource,
-                             request_->install_source);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kInstallSource,
+                         request_->install_source);
   }
 
   if (!request_->origin_url.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kOriginURL,
-                             request_->origin_url);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kOriginURL, request_->origin_url);
   }
 
   if (!request_->test_source.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kTestSource,
-                             request_->test_source);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kTestSource, request_->test_source);
   }
 
   if (!request_->request_id.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kRequestId,
-                             request_->request_id);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kRequestId, request_->request_id);
   }
 
   if (request_->check_period_sec != -1) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kPeriodOverrideSec,
-                             itostr(request_->check_period_sec));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kPeriodOverrideSec,
+                         request_->check_period_sec);
   }
 
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kDedup,
-                           xml::value::kClientRegulated);
-  if (FAILED(hr)) {
-    return hr;
-  }
+  writer->AddAttribute(xml::attribute::kDedup, xml::value::kClientRegulated);
 
   if (request_->dlpref == kDownloadPreferenceCacheable) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kDlPref,
-                             xml::value::kCacheable);
-    if (FAILED(hr)) {
-      return hr;
-    }
-  }
-
-  hr = BuildHwElement(element);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = BuildOsElement(element);
-  if (FAILED(hr)) {
-    return hr;
+    writer->AddAttribute(xml::attribute::kDlPref, xml::value::kCacheable);
   }
 
-  // Add the app element sequence to the request.
-  hr = BuildAppElement(element);
-  if (FAILED(hr)) {
-    return hr;
-  }
+  WriteHwElement(writer);
+  WriteOsElement(writer);
 
-  // Add the request node to the document root.
-  CComPtr<IXMLDOMElement> element_node;
-  hr = element->QueryInterface(&element_node);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = document_->putref_documentElement(element_node);
+  HRESULT hr = WriteAppElement(writer);
   if (FAILED(hr)) {
     return hr;
   }
 
+  writer->EndElement();
   return S_OK;
 }
 
-HRESULT XmlParser::BuildHwElement(IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildHwElement]")));
-
-  ASSERT1(parent_node);
+void XmlParser::WriteHwElement(XmlWriter* writer) {
+  ASSERT1(writer);
   ASSERT1(request_);
 
-  CComPtr<IXMLDOMNode> element;
-  HRESULT hr = CreateElementNode(xml::element::kHw, _T(""), &element);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kPhysMemory,
-                           itostr(request_->hw.physmemory));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSse,
-                           request_->hw.has_sse ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSse2,
-                           request_->hw.has_sse2 ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSse3,
-                           request_->hw.has_sse3 ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSsse3,
-                           request_->hw.has_ssse3 ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSse41,
-                           request_->hw.has_sse41 ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kSse42,
-                           request_->hw.has_sse42 ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kAvx,
-                           request_->hw.has_avx ? _T("1") : _T("0"));
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = parent_node->appendChild(element, NULL);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  return S_OK;
+  const request::Hw& hw = request_->hw;
+
+  writer->StartElement(xml::element::kHw);
+  writer->AddAttribute(xml::attribute::kPhysMemory,
+                       static_cast<int>(hw.physmemory));
+  writer->AddAttribute(xml::attribute::kSse, hw.has_sse ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kSse2,
+                       hw.has_sse2 ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kSse3,
+                       hw.has_sse3 ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kSsse3,
+                       hw.has_ssse3 ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kSse41,
+                       hw.has_sse41 ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kSse42,
+                       hw.has_sse42 ? _T("1") : _T("0"));
+  writer->AddAttribute(xml::attribute::kAvx, hw.has_avx ? _T("1") : _T("0"));
+  writer->EndElement();
 }
 
-HRESULT XmlParser::BuildOsElement(IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildOsElement]")));
-
-  ASSERT1(parent_node);
+void XmlParser::WriteOsElement(XmlWriter* writer) {
+  ASSERT1(writer);
   ASSERT1(request_);
 
-  CComPtr<IXMLDOMNode> element;
-  HRESULT hr = CreateElementNode(xml::element::kOs, _T(""), &element);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kPlatform,
-                           request_->os.platform);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kVersion,
-                           request_->os.version);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kServicePack,
-                           request_->os.service_pack);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = AddXMLAttributeNode(element,
-                           kXmlNamespace,
-                           xml::attribute::kArch,
-                           request_->os.arch);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  hr = parent_node->appendChild(element, NULL);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  return S_OK;
+  writer->StartElement(xml::element::kOs);
+  writer->AddAttribute(xml::attribute::kPlatform, request_->os.platform);
+  writer->AddAttribute(xml::attribute::kVersion, request_->os.version);
+  writer->AddAttribute(xml::attribute::kServicePack,
+                       request_->os.service_pack);
+  writer->AddAttribute(xml::attribute::kArch, request_->os.arch);
+  writer->EndElement();
 }
 
-// Create and add request's to the requests node.
-HRESULT XmlParser::BuildAppElement(IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildAppElement]")));
-
-  ASSERT1(parent_node);
+HRESULT XmlParser::WriteAppElement(XmlWriter* writer) {
+  ASSERT1(writer);
   ASSERT1(request_);
 
   for (size_t i = 0; i < request_->apps.size(); ++i) {
     const request::App& app = request_->apps[i];
 
-    CComPtr<IXMLDOMNode> element;
-    HRESULT hr = CreateElementNode(xml::element::kApp, _T(""), &element);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->StartElement(xml::element::kApp);
 
     ASSERT1(IsGuid(app.app_id));
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kAppId,
-                             app.app_id);
-    if (FAILED(hr)) {
-      return hr;
-    }
-
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kVersion,
-                             app.version);
-    if (FAILED(hr)) {
-      return hr;
-    }
-
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kNextVersion,
-                             app.next_version);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kAppId, app.app_id);
+    writer->AddAttribute(xml::attribute::kVersion, app.version);
+    writer->AddAttribute(xml::attribute::kNextVersion, app.next_version);
 
-    hr = AddAppDefinedAttributes(app, element);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    AddAppDefinedAttributes(app, writer);
 
     if (!app.ap.IsEmpty()) {
-      hr = AddXMLAttributeNode(element,
-                               kXmlNamespace,
-                               xml::attribute::kAdditionalParameters,
-                               app.ap);
-      if (FAILED(hr)) {
-        return hr;
-      }
-    }
-
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kLang,
-                             app.lang);
-    if (FAILED(hr)) {
-      return hr;
-    }
-
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kBrandCode,
-                             app.brand_code);
-    if (FAILED(hr)) {
-      return hr;
+      writer->AddAttribute(xml::attribute::kAdditionalParameters, app.ap);
     }
 
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kClientId,
-                             app.client_id);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kLang, app.lang);
+    writer->AddAttribute(xml::attribute::kBrandCode, app.brand_code);
+    writer->AddAttribute(xml::attribute::kClientId, app.client_id);
 
-    // TODO(omaha3): Determine whether or not the server is able to accept an
-    // empty string here.  If so, remove this IsEmpty() check, and always emit.
     if (!app.experiments.IsEmpty()) {
-      hr = AddXMLAttributeNode(element,
-                               kXmlNamespace,
-                               xml::attribute::kExperiments,
-                               app.experiments);
-      if (FAILED(hr)) {
-        return hr;
-      }
+      writer->AddAttribute(xml::attribute::kExperiments, app.experiments);
     }
 
-    // 0 seconds indicates unknown install time. A new install uses -1 days.
     if (app.install_time_diff_sec) {
       const int installed_full_days =
           static_cast<int>(app.install_time_diff_sec) / kSecondsPerDay;
       ASSERT1(installed_full_days >= 0 || installed_full_days == -1);
-      hr = AddXMLAttributeNode(element,
-                               kXmlNamespace,
-                               xml::attribute::kInstalledAgeDays,
-                               itostr(installed_full_days));
-      if (FAILED(hr)) {
-        return hr;
-      }
+      writer->AddAttribute(xml::attribute::kInstalledAgeDays,
+                           installed_full_days);
     }
 
-    // Three possible categories for value of DayOfInstall:
-    //   -1: it's a new installation.
-    //   0: unknown day of install. Probably it's a legacy app. Skip sending.
-    //   Positive number: will be adjusted to the first day of the install week.
-    //       (install cohort is weekly based).
     if (app.day_of_install != 0) {
       ASSERT1(app.day_of_install >= kMinDaysSinceDatum ||
               app.day_of_install == -1);
-      hr = AddXMLAttributeNode(element,
-                               kXmlNamespace,
-                               xml::attribute::kInstallDate,
-                               itostr(app.day_of_install));
-      if (FAILED(hr)) {
-        return hr;
-      }
+      writer->AddAttribute(xml::attribute::kInstallDate, app.day_of_install);
     }
 
     if (!app.iid.IsEmpty() && app.iid != GuidToString(GUID_NULL)) {
-      hr = AddXMLAttributeNode(element,
-                               kXmlNamespace,
-                               xml::attribute::kInstallationId,
-                               app.iid);
-      if (FAILED(hr)) {
-        return hr;
-      }
+      writer->AddAttribute(xml::attribute::kInstallationId, app.iid);
     }
 
-    hr = AddCohortAttributes(app, element);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    AddCohortAttributes(app, writer);
 
-    hr = BuildUpdateCheckElement(app, element);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    WriteUpdateCheckElement(app, writer);
 
-    hr = BuildPingRequestElement(app, element);
+    HRESULT hr = WritePingRequestElement(app, writer);
     if (FAILED(hr)) {
       return hr;
     }
 
-    hr = BuildDataElement(app, element);
+    hr = WriteDataElement(app, writer);
     if (FAILED(hr)) {
       return hr;
     }
 
-    hr = BuildDidRunElement(app, element);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    WriteDidRunElement(app, writer);
 
-    hr = parent_node->appendChild(element, NULL);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->EndElement();
   }
 
   return S_OK;
 }
 
-HRESULT XmlParser::AddAppDefinedAttributes(const request::App& app,
-                                           IXMLDOMNode* element) {
-  CORE_LOG(L3, (_T("[XmlParser::AddAppDefinedAttributes]")));
-
-  if (app.app_defined_attributes.empty()) {
-    return S_OK;
-  }
+void XmlParser::AddAppDefinedAttributes(const request::App& app,
+                                        XmlWriter* writer) {
+  ASSERT1(writer);
 
   for (size_t i = 0; i < app.app_defined_attributes.size(); ++i) {
     const CString& name(app.app_defined_attributes[i].first);
     const CString& value(app.app_defined_attributes[i].second);
 
     ASSERT1(String_StartsWith(name, xml::attribute::kAppDefinedPrefix, false));
-
-    HRESULT hr = AddXMLAttributeNode(element, kXmlNamespace, name, value);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(name, value);
   }
-
-  return S_OK;
 }
 
-HRESULT XmlParser::AddCohortAttributes(const request::App& app,
-                                       IXMLDOMNode* element) {
-  CORE_LOG(L3, (_T("[XmlParser::AddCohortAttributes]")));
+void XmlParser::AddCohortAttributes(const request::App& app,
+                                    XmlWriter* writer) {
+  ASSERT1(writer);
 
   if (!app.cohort.IsEmpty()) {
-    HRESULT hr = AddXMLAttributeNode(element,
-                                     kXmlNamespace,
-                                     xml::attribute::kCohort,
-                                     app.cohort);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kCohort, app.cohort);
   }
 
   if (!app.cohort_hint.IsEmpty()) {
-    HRESULT hr = AddXMLAttributeNode(element,
-                                     kXmlNamespace,
-                                     xml::attribute::kCohortHint,
-                                     app.cohort_hint);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kCohortHint, app.cohort_hint);
   }
 
   if (!app.cohort_name.IsEmpty()) {
-    HRESULT hr = AddXMLAttributeNode(element,
-                                     kXmlNamespace,
-                                     xml::attribute::kCohortName,
-                                     app.cohort_name);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kCohortName, app.cohort_name);
   }
-
-  return S_OK;
 }
 
-HRESULT XmlParser::BuildUpdateCheckElement(const request::App& app,
-                                           IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildUpdateCheckElement]")));
-  ASSERT1(parent_node);
+void XmlParser::WriteUpdateCheckElement(const request::App& app,
+                                        XmlWriter* writer) {
+  ASSERT1(writer);
 
-  // Create a DOM element only if the update check member is valid.
   if (!app.update_check.is_valid) {
-    return S_OK;
+    return;
   }
 
-  CComPtr<IXMLDOMNode> element;
-  HRESULT hr = CreateElementNode(xml::element::kUpdateCheck, _T(""), &element);
-  if (FAILED(hr)) {
-    return hr;
-  }
+  writer->StartElement(xml::element::kUpdateCheck);
 
   if (app.update_check.is_update_disabled) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kUpdateDisabled,
-                             xml::value::kTrue);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kUpdateDisabled, xml::value::kTrue);
   }
 
   if (!app.update_check.tt_token.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kTTToken,
-                             app.update_check.tt_token);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kTTToken, app.update_check.tt_token);
   }
 
   if (!app.update_check.target_version_prefix.IsEmpty()) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kTargetVersionPrefix,
-                             app.update_check.target_version_prefix);
-    if (FAILED(hr)) {
-      return hr;
-    }
-  }
-
-  hr = parent_node->appendChild(element, NULL);
-  if (FAILED(hr)) {
-    return hr;
+    writer->AddAttribute(xml::attribute::kTargetVersionPrefix,
+                         app.update_check.target_version_prefix);
   }
 
-  return S_OK;
+  writer->EndElement();
 }
 
-// Ping elements are called "event" elements for legacy reasons.
-HRESULT XmlParser::BuildPingRequestElement(const request::App& app,
-                                           IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildPingRequestElement]")));
-  ASSERT1(parent_node);
-
-  // Create a DOM element only if there is are ping_events.
-  if (app.ping_events.empty()) {
-    return S_OK;
-  }
+HRESULT XmlParser::WritePingRequestElement(const request::App& app,
+                                           XmlWriter* writer) {
+  ASSERT1(writer);
 
   PingEventVector::const_iterator it;
   for (it = app.ping_events.begin(); it != app.ping_events.end(); ++it) {
-    const PingEventPtr ping_event = *it;
-    CComPtr<IXMLDOMNode> element;
-    HRESULT hr = CreateElementNode(xml::element::kEvent, _T(""), &element);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->StartElement(xml::element::kEvent);
 
-    hr = ping_event->ToXml(element);
+    HRESULT hr = (*it)->ToXml(writer);
     if (FAILED(hr)) {
       return hr;
     }
 
-    hr = parent_node->appendChild(element, NULL);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->EndElement();
   }
 
   return S_OK;
 }
 
-HRESULT XmlParser::BuildDataElement(const request::App& app,
-                                    IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildDataElement]")));
-  ASSERT1(parent_node);
-
-  // Create a DOM element only if there is a data object.
-  if (app.data.empty()) {
-    return S_OK;
-  }
+HRESULT XmlParser::WriteDataElement(const request::App& app,
+                                    XmlWriter* writer) {
+  ASSERT1(writer);
 
   for (size_t i = 0; i != app.data.size(); ++i) {
-    CComPtr<IXMLDOMNode> element;
-    HRESULT hr = CreateElementNode(xml::element::kData, _T(""), &element);
-    if (FAILED(hr)) {
-      return hr;
-    }
-
     const xml::request::Data& data = app.data[i];
 
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kName,
-                             data.name);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->StartElement(xml::element::kData);
+    writer->AddAttribute(xml::attribute::kName, data.name);
 
     const CString& install_data_index = data.install_data_index;
     const CString& untrusted_data     = data.untrusted_data;
@@ -1534,34 +1322,23 @@ HRESULT XmlParser::BuildDataElement(const request::App& app,
     using xml::value::kUntrusted;
 
     if (data.name == kInstall && !install_data_index.IsEmpty()) {
-      hr = AddXMLAttributeNode(element,
-                               kXmlNamespace,
-                               xml::attribute::kIndex,
-                               data.install_data_index);
+      writer->AddAttribute(xml::attribute::kIndex, install_data_index);
     } else if (data.name == kUntrusted && !untrusted_data.IsEmpty()) {
-      hr = element->put_text(CComBSTR(untrusted_data));
+      writer->WriteText(untrusted_data);
     } else {
       ASSERT1(false);
-      hr = E_UNEXPECTED;
-    }
-
-    if (FAILED(hr)) {
-      return hr;
+      return E_UNEXPECTED;
     }
 
-    hr = parent_node->appendChild(element, NULL);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->EndElement();
   }
 
   return S_OK;
 }
 
-HRESULT XmlParser::BuildDidRunElement(const request::App& app,
-                                      IXMLDOMNode* parent_node) {
-  CORE_LOG(L3, (_T("[XmlParser::BuildDidRunElement]")));
-  ASSERT1(parent_node);
+void XmlParser::WriteDidRunElement(const request::App& app,
+                                   XmlWriter* writer) {
+  ASSERT1(writer);
 
   const bool was_active = app.ping.active == ACTIVE_RUN;
   const bool need_active = app.ping.active != ACTIVE_UNKNOWN;
@@ -1572,119 +1349,150 @@ HRESULT XmlParser::BuildDidRunElement(const request::App& app,
   const bool need_rd = app.ping.day_of_last_roll_call != 0;
   const bool has_freshness = !app.ping.ping_freshness.IsEmpty();
 
-  // Create a DOM element only if the didrun object has actual state.
   if (!need_active && !need_a && !need_r && !need_ad && !need_rd &&
       !has_freshness) {
-    return S_OK;
+    return;
   }
 
   ASSERT1(app.update_check.is_valid);
 
-  CComPtr<IXMLDOMNode> element;
-  HRESULT hr = CreateElementNode(xml::element::kPing, _T(""), &element);
-  if (FAILED(hr)) {
-    return hr;
-  }
+  writer->StartElement(xml::element::kPing);
 
-  // TODO(omaha): Remove "active" attribute after transition.
   if (need_active) {
-    const TCHAR* active_str(was_active ? _T("1") : _T("0"));
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kActive,
-                             active_str);
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kActive,
+                         was_active ? _T("1") : _T("0"));
   }
 
   if (need_a) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kDaysSinceLastActivePing,
-                             itostr(app.ping.days_since_last_active_ping));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kDaysSinceLastActivePing,
+                         app.ping.days_since_last_active_ping);
   }
 
   if (need_r) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kDaysSinceLastRollCall,
-                             itostr(app.ping.days_since_last_roll_call));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kDaysSinceLastRollCall,
+                         app.ping.days_since_last_roll_call);
   }
 
   if (need_ad) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kDayOfLastActivity,
-                             itostr(app.ping.day_of_last_activity));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kDayOfLastActivity,
+                         app.ping.day_of_last_activity);
   }
 
   if (need_rd) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kDayOfLastRollCall,
-                             itostr(app.ping.day_of_last_roll_call));
-    if (FAILED(hr)) {
-      return hr;
-    }
+    writer->AddAttribute(xml::attribute::kDayOfLastRollCall,
+                         app.ping.day_of_last_roll_call);
   }
 
   if (has_freshness) {
-    hr = AddXMLAttributeNode(element,
-                             kXmlNamespace,
-                             xml::attribute::kPingFreshness,
-                             app.ping.ping_freshness);
-    if (FAILED(hr)) {
-      return hr;
+    writer->AddAttribute(xml::attribute::kPingFreshness,
+                         app.ping.ping_freshness);
+  }
+
+  writer->EndElement();
+}
+
+// Handles the elements reported by the XmlSaxParser. The first failure stops
+// the parser.
+class XmlParser::ResponseStreamHandler : public XmlSaxHandler {
+ public:
+  explicit ResponseStreamHandler(XmlParser* xml_parser)
+      : xml_parser_(xml_parser),
+        hr_(S_OK),
+        is_root_(true) {
+    ASSERT1(xml_parser);
+  }
+
+  HRESULT hr() const { return hr_; }
+
+  virtual bool OnStartElement(const XmlSaxElement& element) {
+    const std::string& utf8_name = element.name();
+    const CString name(Utf8ToWideChar(utf8_name.data(),
+                                      static_cast<uint32>(utf8_name.size())));
+    if (is_root_) {
+      is_root_ = false;
+      hr_ = xml_parser_->SelectElementHandlers(name);
+      if (FAILED(hr_)) {
+        return false;
+      }
     }
+
+    const StreamResponseElement response_element(element);
+    hr_ = xml_parser_->HandleElement(name, response_element);
+    return SUCCEEDED(hr_);
   }
 
+  virtual bool OnEndElement(const std::string& name) {
+    UNREFERENCED_PARAMETER(name);
+    return true;
+  }
 
-  hr = parent_node->appendChild(element, NULL);
+ private:
+  XmlParser* xml_parser_;
+  HRESULT hr_;
+  bool is_root_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResponseStreamHandler);
+};
+
+HRESULT XmlParser::DeserializeResponse(const std::vector<uint8>& buffer,
+                                       UpdateResponse* update_response) {
+  ASSERT1(update_response);
+
+  response::Response response;
+  HRESULT hr = DeserializeResponseStream(buffer, &response);
+  if (hr == S_FALSE) {
+    CORE_LOG(L3, (_T("[DeserializeResponse][loading the response in a DOM]")));
+    response = response::Response();
+    hr = DeserializeResponseDom(buffer, &response);
+  }
   if (FAILED(hr)) {
     return hr;
   }
 
+  update_response->response_ = response;
+  update_response->BuildAppIndex();
   return S_OK;
 }
 
-HRESULT XmlParser::CreateElementNode(const TCHAR* name,
-                                     const TCHAR* value,
-                                     IXMLDOMNode** element) {
-  ASSERT1(name);
-  ASSERT1(value);
-  ASSERT1(element);
-
-  // When there is a namespace, the element names get o: prepended to avoid a
-  // size explosion where the namespace uri gets automatically added to every
-  // element by msxml.
-  CString namespace_qualified_name;
-  SafeCStringFormat(&namespace_qualified_name,
-                    kXmlNamespace ? _T("o:%s") : _T("%s"),
-                    name);
-  ASSERT1(document_);
-  HRESULT hr = CreateXMLNode(document_,
-                             NODE_ELEMENT,
-                             namespace_qualified_name,
-                             kXmlNamespace,
-                             value,
-                             element);
-  return hr;
-}
+HRESULT XmlParser::DeserializeResponseStream(const std::vector<uint8>& buffer,
+                                             response::Response* response) {
+  ASSERT1(response);
+
+  if (buffer.empty()) {
+    return E_INVALIDARG;
+  }
 
+  XmlParser xml_parser;
+  xml_parser.response_ = response;
+
+  ResponseStreamHandler handler(&xml_parser);
+  XmlSaxParser sax_parser;
+  const XmlSaxParser::Status status = sax_parser.Parse(
+      reinterpret_cast<const char*>(&buffer.front()),
+      buffer.size(),
+      &handler);
+  switch (status) {
+    case XmlSaxParser::kSucceeded:
+      return S_OK;
 
-HRESULT XmlParser::DeserializeResponse(const std::vector<uint8>& buffer,
-                                       UpdateResponse* update_response) {
-  ASSERT1(update_response);
+    case XmlSaxParser::kAborted:
+      ASSERT1(FAILED(handler.hr()));
+      return handler.hr();
+
+    case XmlSaxParser::kUnsupported:
+      return S_FALSE;
+
+    case XmlSaxParser::kMalformed:
+    default:
+      CORE_LOG(LE, (_T("[XmlSaxParser::Parse failed][offset %Iu]"),
+                    sax_parser.error_offset()));
+      return CI_E_XML_LOAD_ERROR;
+  }
+}
+
+HRESULT XmlParser::DeserializeResponseDom(const std::vector<uint8>& buffer,
+                                          response::Response* response) {
+  ASSERT1(response);
 
   XmlParser xml_parser;
   HRESULT hr = LoadXMLFromRawData(buffer, false, &xml_parser.document_);
@@ -1692,16 +1500,22 @@ HRESULT XmlParser::DeserializeResponse(const std::vector<uint8>& buffer,
     return hr;
   }
 
-  response::Response response;
-  xml_parser.response_ = &response;
+  xml_parser.response_ = response;
+  return xml_parser.Parse();
+}
 
-  hr = xml_parser.Parse();
-  if (FAILED(hr)) {
-    return hr;
+HRESULT XmlParser::SelectElementHandlers(const CString& root_name) {
+  if (root_name == xml::element::kResponse) {
+    InitializeElementHandlers();
+    return S_OK;
   }
 
-  update_response->response_ = response;
-  return S_OK;
+  if (root_name == v2::element::kGUpdate) {
+    InitializeLegacyElementHandlers();
+    return S_OK;
+  }
+
+  return GOOPDATEXML_E_RESPONSENODE;
 }
 
 HRESULT XmlParser::Parse() {
@@ -1723,17 +1537,12 @@ HRESULT XmlParser::Parse() {
     return hr;
   }
 
-  if (root_name == xml::element::kResponse) {
-    InitializeElementHandlers();
-    return TraverseDOM(root_node);
-  }
-
-  if (root_name == v2::element::kGUpdate) {
-    InitializeLegacyElementHandlers();
-    return TraverseDOM(root_node);
+  hr = SelectElementHandlers(CString(root_name));
+  if (FAILED(hr)) {
+    return hr;
   }
 
-  return GOOPDATEXML_E_RESPONSENODE;
+  return TraverseDOM(root_node);
 }
 
 HRESULT XmlParser::TraverseDOM(IXMLDOMNode* node) {
@@ -1793,16 +1602,21 @@ HRESULT XmlParser::VisitElement(IXMLDOMNode* node) {
 
   CORE_LOG(L4, (_T("[element name][%s:%s]"), node_name.uri, node_name.base));
 
+  const DomResponseElement response_element(node);
+  return HandleElement(node_name.base, response_element);
+}
+
+HRESULT XmlParser::HandleElement(const CString& name,
+                                 const ResponseElement& element) {
   // Ignore elements not understood.
-  ElementHandler* element_handler =
-      element_handler_factory_.CreateObject(node_name.base);
-  if (element_handler) {
-    return element_handler->Handle(node, response_);
-  } else {
-    CORE_LOG(LW, (_T("[VisitElement: don't know how to handle %s:%s]"),
-                  node_name.uri, node_name.base));
+  scoped_ptr<ElementHandler> element_handler(
+      element_handler_factory_.CreateObject(name));
+  if (!element_handler.get()) {
+    CORE_LOG(LW, (_T("[HandleElement: don't know how to handle %s]"), name));
+    return S_OK;
   }
-  return S_OK;
+
+  return element_handler->Handle(element, response_);
 }
 
 }  // namespace xml
@@ -34,9 +34,12 @@
 
 namespace omaha {
 
+class XmlWriter;
+
 namespace xml {
 
 class ElementHandler;
+class ResponseElement;
 
 CString ConvertProcessorArchitectureToString(DWORD processor_architecture);
 
@@ -57,60 +60,46 @@ class XmlParser {
   static HRESULT SerializeRequest(const UpdateRequest& update_request,
                                   CString* buffer);
 
+  // Generates the update request as UTF-8, which is the encoding it is sent
+  // in. The request is written directly into the buffer, without building a
+  // DOM. The buffer is replaced, but its memory is reused.
+  static HRESULT SerializeRequest(const UpdateRequest& update_request,
+                                  CStringA* buffer);
+
  private:
   typedef Factory<ElementHandler, CString> ElementHandlerFactory;
 
+  class ResponseStreamHandler;
+
   XmlParser();
   void InitializeElementHandlers();
   void InitializeLegacyElementHandlers();
 
-  // Builds an XML object model corresponding to an xml request.
-  HRESULT BuildDom(const request::Request& request);
-
-  // Builds the 'request' element.
-  HRESULT BuildRequestElement();
-
-  // Creates the 'hw' element.
-  HRESULT BuildHwElement(IXMLDOMNode* parent_node);
-
-  // Creates the 'os' element.
-  HRESULT BuildOsElement(IXMLDOMNode* parent_node);
-
-  // Creates the 'app' element. This is usually a sequence of elements.
-  HRESULT BuildAppElement(IXMLDOMNode* parent_node);
-
-  // Adds attributes under the 'app' element corresponding to values with a '_'
-  // prefix under the ClientState/ClientStateMedium key.
-  HRESULT AddAppDefinedAttributes(const request::App& app,
-                                  IXMLDOMNode* parent_node);
-
-  // Adds cohort attributes under the 'app' element corresponding to values
-  // under the ClientState/{AppID}/Cohort key.
-  HRESULT AddCohortAttributes(const request::App& app, IXMLDOMNode* element);
-
-  // Creates the 'updatecheck' element for an application.
-  HRESULT BuildUpdateCheckElement(const request::App& app,
-                                  IXMLDOMNode* parent_node);
-
-  // Creates Ping aka 'event' elements for an application.
-  HRESULT BuildPingRequestElement(const request::App& app,
-                                  IXMLDOMNode* parent_node);
-
-  // Creates the 'data' element for an application.
-  HRESULT BuildDataElement(const request::App& app,
-                           IXMLDOMNode* parent_node);
-
-  // Creates the 'didrun' aka 'active' aka 'ping' element for an application.
-  HRESULT BuildDidRunElement(const request::App& app,
-                             IXMLDOMNode* parent_node);
-
-  // Serializes the DOM into a string.
-  HRESULT GetXml(CString* buffer);
-
-  // Creates an element in the Update2 xml namespace.
-  HRESULT CreateElementNode(const TCHAR* name,
-                            const TCHAR* value,
-                            IXMLDOMNode** element);
+  // Writes the 'request' element and its children.
+  HRESULT WriteRequestElement(XmlWriter* writer);
+  void WriteHwElement(XmlWriter* writer);
+  void WriteOsElement(XmlWriter* writer);
+  HRESULT WriteAppElement(XmlWriter* writer);
+  void AddAppDefinedAttributes(const request::App& app, XmlWriter* writer);
+  void AddCohortAttributes(const request::App& app, XmlWriter* writer);
+  void WriteUpdateCheckElement(const request::App& app, XmlWriter* writer);
+  HRESULT WritePingRequestElement(const request::App& app, XmlWriter* writer);
+  HRESULT WriteDataElement(const request::App& app, XmlWriter* writer);
+  void WriteDidRunElement(const request::App& app, XmlWriter* writer);
+
+  // Parses the response as it is read, without building a DOM. Returns
+  // S_FALSE if the streaming parser does not support the document, for
+  // instance because it is not encoded in UTF-8.
+  static HRESULT DeserializeResponseStream(const std::vector<uint8>& buffer,
+                                           response::Response* response);
+
+  // Loads the response in a DOM, then parses the DOM.
+  static HRESULT DeserializeResponseDom(const std::vector<uint8>& buffer,
+                                        response::Response* response);
+
+  // Initializes the element handlers for the version of the protocol that
+  // the root element of the response corresponds to.
+  HRESULT SelectElementHandlers(const CString& root_name);
 
   // Starts parsing of the xml document.
   HRESULT Parse();
@@ -121,6 +110,9 @@ class XmlParser {
   // Handles a single node during traversal.
   HRESULT VisitElement(IXMLDOMNode* node);
 
+  // Handles a single element, whichever way the response is parsed.
+  HRESULT HandleElement(const CString& name, const ResponseElement& element);
+
   // The current xml document.
   CComPtr<IXMLDOMDocument> document_;
 
@@ -132,6 +124,8 @@ class XmlParser {
 
   ElementHandlerFactory element_handler_factory_;
 
+  friend class XmlParserTest;
+
   DISALLOW_COPY_AND_ASSIGN(XmlParser);
 };
 
@@ -14,11 +14,21 @@
 // ========================================================================
 
 #include <windows.h>
+#include <utility>
+#include <vector>
 #include "base/utils.h"
 #include "base/scoped_ptr.h"
+#include "omaha/base/app_util.h"
 #include "omaha/base/error.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/path.h"
 #include "omaha/base/reg_key.h"
+#include "omaha/base/string.h"
+#include "omaha/base/xml_utils.h"
 #include "omaha/common/const_group_policy.h"
+#include "omaha/common/ping_event_download_metrics.h"
+#include "omaha/common/xml_const.h"
 #include "omaha/common/xml_parser.h"
 #include "omaha/goopdate/update_response_utils.h"
 #include "omaha/testing/unit_test.h"
@@ -36,6 +46,349 @@ namespace omaha {
 
 namespace xml {
 
+namespace {
+
+std::vector<uint8> ToBuffer(const CStringA& xml) {
+  std::vector<uint8> buffer(xml.GetLength());
+  memcpy(&buffer.front(), xml, buffer.size());
+  return buffer;
+}
+
+// Builds a response of the size that machines with many registered apps get.
+CStringA BuildLargeResponse(int num_apps) {
+  CStringA response("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                    "<response protocol=\"3.0\" server=\"prod\">"
+                    "<daystart elapsed_seconds=\"8400\" "
+                    "elapsed_days=\"3255\"/>");
+  for (int i = 0; i != num_apps; ++i) {
+    response.AppendFormat(
+        "<app appid=\"{%08X-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\" "
+        "cohort=\"1:%d:\" cohortname=\"Stable &amp; Beta\">"
+        "<updatecheck status=\"ok\"><urls>"
+        "<url codebase=\"http://dl.google.com/edgedl/app%d/\"/>"
+        "<url codebase=\"https://dl.google.com/edgedl/app%d/\"/>"
+        "</urls><manifest version=\"1.2.%d.0\"><packages>"
+        "<package hash=\"NT/6ilbSjWgbVqHZ0rT1vTg1coE=\" "
+        "hash_sha256=\"d5e06b4436c5e33f2de88298b890f47815fc657b63b3050d2217c55a"
+        "5d0730b0\" name=\"app%d_installer.exe\" required=\"true\" "
+        "size=\"%d\"/></packages><actions>"
+        "<action arguments=\"--install --app=%d\" event=\"install\" "
+        "needsadmin=\"false\" run=\"app%d_installer.exe\"/>"
+        "<action event=\"postinstall\" onsuccess=\"exitsilentlyonlaunchcmd\"/>"
+        "</actions></manifest></updatecheck>"
+        "<data index=\"verboselogging\" name=\"install\" status=\"ok\">"
+        "{\n \"distribution\": {\n   \"app\": %d\n }\n}\n</data>"
+        "<ping status=\"ok\"/><event status=\"ok\"/></app>",
+        i, i, i, i, i, i, 1000000 + i, i, i, i);
+  }
+  response.Append("</response>");
+  return response;
+}
+
+// Fills in a request for |num_apps| apps, each reporting a few ping events.
+// The values contain markup and characters outside of ASCII, which must be
+// escaped and encoded.
+void BuildLargeRequest(int num_apps, request::Request* xml_request) {
+  xml_request->omaha_version = _T("1.3.33.7");
+  xml_request->omaha_shell_version = _T("1.3.33.5");
+  xml_request->test_source = _T("<dev & \"qa\">");
+  xml_request->request_id = _T("{387E2718-B39C-4458-98CC-24B5293C8385}");
+  xml_request->hw.physmemory = 8;
+  xml_request->hw.has_sse2 = true;
+  xml_request->os.platform = _T("win");
+  xml_request->os.version = _T("10.0.19045.0");
+  xml_request->os.arch = _T("x64");
+
+  for (int i = 0; i != num_apps; ++i) {
+    request::App app;
+    app.app_id.Format(_T("{%08X-D564-463C-AFF1-A69D9E530F96}"), i);
+    app.version.Format(_T("1.2.%d.0"), i);
+    app.lang = _T("fr");
+    app.brand_code = _T("GGLS");
+    app.iid = GuidToString(GUID_NULL);
+    app.ap = _T("x64-stable-statsdef_1");
+    app.experiments = _T("url_exp_2=a|Fri, 14 Aug 2015 16:13:03 GMT");
+    app.cohort.Format(_T("1:%d:"), i);
+    app.cohort_name = _T("Stable \x00e9t\x00e9 \xD83D\xDE00");
+    app.app_defined_attributes.push_back(
+        std::make_pair(CString(_T("_dl_mgr")), CString(_T("a'b\"c"))));
+    app.update_check.is_valid = true;
+    app.ping.active = ACTIVE_RUN;
+    app.ping.days_since_last_active_ping = 3;
+    app.ping.days_since_last_roll_call = 1;
+    app.ping.ping_freshness = _T("{d0d8cb57-ca4a-4e82-8196-84f47c0ca085}");
+
+    request::Data data;
+    data.name = _T("untrusted");
+    data.untrusted_data = _T("a=<b>&c=\"d\"");
+    app.data.push_back(data);
+
+    for (int j = 0; j != 4; ++j) {
+      app.ping_events.push_back(PingEventPtr(
+          new PingEvent(PingEvent::EVENT_UPDATE_COMPLETE,
+                        PingEvent::EVENT_RESULT_SUCCESS,
+                        0,
+                        j,
+                        0,
+                        120,
+                        5000 + j,
+                        1000000,
+                        1000000,
+                        2000)));
+    }
+
+    DownloadMetrics download_metrics;
+    download_metrics.url.Format(_T("http://dl.google.com/app%d?a=1&b=2"), i);
+    download_metrics.downloader = DownloadMetrics::kWinHttp;
+    download_metrics.downloaded_bytes = 1000000;
+    download_metrics.total_bytes = 1000000;
+    download_metrics.download_time_ms = 5000;
+    app.ping_events.push_back(PingEventPtr(
+        new PingEventDownloadMetrics(true,
+                                     PingEvent::EVENT_RESULT_SUCCESS,
+                                     download_metrics)));
+
+    xml_request->apps.push_back(app);
+  }
+}
+
+// A request of unittest_support\serialized_requests.txt. The file holds the
+// documents that the DOM serializer wrote for kGoldenRequests, before
+// XmlWriter replaced it, one document per line.
+struct GoldenRequest {
+  bool is_machine;
+  const TCHAR* uid;
+  const TCHAR* session_id;
+  const TCHAR* install_source;
+  const TCHAR* origin_url;
+  int check_period_sec;
+  const TCHAR* dlpref;
+  int num_apps;
+};
+
+const GoldenRequest kGoldenRequests[] = {
+  {true, _T("{A8B3C1D5-6E7F-4A0B-9C1D-2E3F4A5B6C7D}"), _T("sid"), _T("is"),
+   _T("http://foo/\""), 120000, kDownloadPreferenceCacheable, 1},
+  {false, _T(""), _T(""), _T(""), _T(""), -1, _T(""), 0},
+  {false, _T(""), _T("{2C5F6A1B-3D4E-4F50-8A9B-0C1D2E3F4A5B}"), _T(""), _T(""),
+   -1, _T(""), 50},
+};
+
+// Fills in |xml_request| from |golden_request| alone, so that it does not
+// depend on the machine the test runs on.
+void BuildGoldenRequest(const GoldenRequest& golden_request,
+                        request::Request* xml_request) {
+  *xml_request = request::Request();
+  xml_request->protocol_version = _T("3.0");
+  xml_request->is_machine = golden_request.is_machine;
+  xml_request->uid = golden_request.uid;
+  xml_request->session_id = golden_request.session_id;
+  xml_request->install_source = golden_request.install_source;
+  xml_request->origin_url = golden_request.origin_url;
+  xml_request->check_period_sec = golden_request.check_period_sec;
+  xml_request->dlpref = golden_request.dlpref;
+  BuildLargeRequest(golden_request.num_apps, xml_request);
+}
+
+// Returns the lines of the golden file, without their line breaks.
+HRESULT ReadGoldenRequests(std::vector<CStringA>* requests) {
+  ASSERT1(requests);
+
+  CString path(app_util::GetCurrentModuleDirectory());
+  if (!::PathAppend(CStrBuf(path, MAX_PATH),
+                    _T("unittest_support\\serialized_requests.txt"))) {
+    return E_FAIL;
+  }
+
+  std::vector<byte> buffer;
+  HRESULT hr = ReadEntireFile(path, 0, &buffer);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (buffer.empty()) {
+    return E_UNEXPECTED;
+  }
+
+  const CStringA contents(reinterpret_cast<const char*>(&buffer.front()),
+                          static_cast<int>(buffer.size()));
+  int position = 0;
+  CStringA line(contents.Tokenize("\n", position));
+  while (position != -1) {
+    line.TrimRight('\r');
+    requests->push_back(line);
+    line = contents.Tokenize("\n", position);
+  }
+  return S_OK;
+}
+
+// An element of a request document, with its attributes, text, and child
+// elements.
+struct RequestNode {
+  CString name;
+  std::vector<std::pair<CString, CString> > attributes;
+  CString text;
+  std::vector<RequestNode> children;
+};
+
+// Reads the element |dom_node| of a loaded document into |node|.
+HRESULT ReadRequestNode(IXMLDOMNode* dom_node, RequestNode* node) {
+  ASSERT1(dom_node);
+  ASSERT1(node);
+
+  CComBSTR name;
+  HRESULT hr = dom_node->get_nodeName(&name);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  node->name = name;
+
+  const int num_attributes = GetNumAttributes(dom_node);
+  for (int i = 0; i != num_attributes; ++i) {
+    CString attribute_name;
+    CString attribute_value;
+    hr = ReadAttributeAt(dom_node, i, &attribute_name, &attribute_value);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    node->attributes.push_back(std::make_pair(attribute_name,
+                                              attribute_value));
+  }
+
+  CComPtr<IXMLDOMNodeList> children;
+  hr = dom_node->get_childNodes(&children);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  long num_children = 0;  // NOLINT
+  hr = children->get_length(&num_children);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  for (long i = 0; i != num_children; ++i) {  // NOLINT
+    CComPtr<IXMLDOMNode> child;
+    hr = children->get_item(i, &child);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    DOMNodeType type = NODE_INVALID;
+    hr = child->get_nodeType(&type);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    if (type == NODE_TEXT) {
+      CComBSTR text;
+      hr = child->get_text(&text);
+      if (FAILED(hr)) {
+        return hr;
+      }
+      node->text += text;
+    } else if (type == NODE_ELEMENT) {
+      node->children.push_back(RequestNode());
+      hr = ReadRequestNode(child, &node->children.back());
+      if (FAILED(hr)) {
+        return hr;
+      }
+    }
+  }
+
+  return S_OK;
+}
+
+// Builds |node| in |document| the way the DOM serializer built the request
+// elements, one node per element and attribute.
+HRESULT BuildDomElement(IXMLDOMDocument* document,
+                        const RequestNode& node,
+                        IXMLDOMNode** element) {
+  ASSERT1(document);
+  ASSERT1(element);
+
+  CComPtr<IXMLDOMNode> new_element;
+  HRESULT hr = CreateXMLNode(document,
+                             NODE_ELEMENT,
+                             node.name,
+                             kXmlNamespace,
+                             _T(""),
+                             &new_element);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  for (size_t i = 0; i != node.attributes.size(); ++i) {
+    hr = AddXMLAttributeNode(new_element,
+                             kXmlNamespace,
+                             node.attributes[i].first,
+                             node.attributes[i].second);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  if (!node.text.IsEmpty()) {
+    hr = new_element->put_text(CComBSTR(node.text));
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  for (size_t i = 0; i != node.children.size(); ++i) {
+    CComPtr<IXMLDOMNode> child;
+    hr = BuildDomElement(document, node.children[i], &child);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    hr = new_element->appendChild(child, NULL);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  *element = new_element.Detach();
+  return S_OK;
+}
+
+// Serializes the request |root| as the DOM serializer did: builds the DOM,
+// reads the xml property of the document, and converts it to UTF-8 as
+// NetworkRequest::PostString did.
+HRESULT SerializeRequestWithDom(const RequestNode& root, CStringA* buffer) {
+  ASSERT1(buffer);
+
+  CComPtr<IXMLDOMDocument> document;
+  HRESULT hr = CoCreateSafeDOMDocument(&document);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CComPtr<IXMLDOMNode> element;
+  hr = BuildDomElement(document, root, &element);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  CComQIPtr<IXMLDOMElement> root_element(element);
+  if (!root_element) {
+    return E_NOINTERFACE;
+  }
+  hr = document->putref_documentElement(root_element);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CComBSTR xml_body;
+  hr = document->get_xml(&xml_body);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CString xml(kXmlDirective);
+  xml += xml_body;
+  xml.TrimRight(_T("\r\n"));
+  *buffer = WideToUtf8(xml);
+  return S_OK;
+}
+
+}  // namespace
+
 // TODO(omaha): there were many tests related to
 // updatedev_check_period_override and policy_check_period_override, which
 // the current parser is unaware of. These parameters must be handled outside
@@ -54,6 +407,108 @@ class XmlParserTest : public ::testing::TestWithParam<bool> {
   request::Request& get_xml_request(UpdateRequest* update_request) {
     return update_request->request_;
   }
+
+  static HRESULT DeserializeResponseStream(const std::vector<uint8>& buffer,
+                                           response::Response* response) {
+    return XmlParser::DeserializeResponseStream(buffer, response);
+  }
+
+  static HRESULT DeserializeResponseDom(const std::vector<uint8>& buffer,
+                                        response::Response* response) {
+    return XmlParser::DeserializeResponseDom(buffer, response);
+  }
+
+  // Parses |buffer| with both parsers and expects the same outcome.
+  static void ExpectSameResponses(const std::vector<uint8>& buffer) {
+    response::Response stream_response;
+    response::Response dom_response;
+    const HRESULT stream_hr = DeserializeResponseStream(buffer,
+                                                        &stream_response);
+    const HRESULT dom_hr = DeserializeResponseDom(buffer, &dom_response);
+    EXPECT_EQ(dom_hr, stream_hr);
+    if (FAILED(dom_hr) || FAILED(stream_hr)) {
+      return;
+    }
+    ExpectResponsesEqual(dom_response, stream_response);
+  }
+
+  static void ExpectResponsesEqual(const response::Response& expected,
+                                   const response::Response& actual) {
+    EXPECT_STREQ(expected.protocol, actual.protocol);
+    EXPECT_EQ(expected.day_start.elapsed_seconds,
+              actual.day_start.elapsed_seconds);
+    EXPECT_EQ(expected.day_start.elapsed_days, actual.day_start.elapsed_days);
+    EXPECT_STREQ(expected.sys_req.platform, actual.sys_req.platform);
+    EXPECT_STREQ(expected.sys_req.arch, actual.sys_req.arch);
+    EXPECT_STREQ(expected.sys_req.min_os_version,
+                 actual.sys_req.min_os_version);
+
+    ASSERT_EQ(expected.apps.size(), actual.apps.size());
+    for (size_t i = 0; i != expected.apps.size(); ++i) {
+      const response::App& expected_app = expected.apps[i];
+      const response::App& actual_app = actual.apps[i];
+      EXPECT_STREQ(expected_app.appid, actual_app.appid);
+      EXPECT_STREQ(expected_app.status, actual_app.status);
+      EXPECT_STREQ(expected_app.experiments, actual_app.experiments);
+      EXPECT_STREQ(expected_app.cohort, actual_app.cohort);
+      EXPECT_STREQ(expected_app.cohort_hint, actual_app.cohort_hint);
+      EXPECT_STREQ(expected_app.cohort_name, actual_app.cohort_name);
+      EXPECT_STREQ(expected_app.ping.status, actual_app.ping.status);
+      EXPECT_EQ(expected_app.events.size(), actual_app.events.size());
+
+      const response::UpdateCheck& expected_check = expected_app.update_check;
+      const response::UpdateCheck& actual_check = actual_app.update_check;
+      EXPECT_STREQ(expected_check.status, actual_check.status);
+      EXPECT_STREQ(expected_check.tt_token, actual_check.tt_token);
+      EXPECT_STREQ(expected_check.error_url, actual_check.error_url);
+      EXPECT_TRUE(expected_check.urls == actual_check.urls);
+
+      const InstallManifest& expected_manifest =
+          expected_check.install_manifest;
+      const InstallManifest& actual_manifest = actual_check.install_manifest;
+      EXPECT_STREQ(expected_manifest.version, actual_manifest.version);
+
+      ASSERT_EQ(expected_manifest.packages.size(),
+                actual_manifest.packages.size());
+      for (size_t j = 0; j != expected_manifest.packages.size(); ++j) {
+        const InstallPackage& expected_package = expected_manifest.packages[j];
+        const InstallPackage& actual_package = actual_manifest.packages[j];
+        EXPECT_STREQ(expected_package.name, actual_package.name);
+        EXPECT_EQ(expected_package.is_required, actual_package.is_required);
+        EXPECT_EQ(expected_package.size, actual_package.size);
+        EXPECT_STREQ(expected_package.hash_sha1, actual_package.hash_sha1);
+        EXPECT_STREQ(expected_package.hash_sha256, actual_package.hash_sha256);
+      }
+
+      ASSERT_EQ(expected_manifest.install_actions.size(),
+                actual_manifest.install_actions.size());
+      for (size_t j = 0; j != expected_manifest.install_actions.size(); ++j) {
+        const InstallAction& expected_action =
+            expected_manifest.install_actions[j];
+        const InstallAction& actual_action = actual_manifest.install_actions[j];
+        EXPECT_EQ(expected_action.install_event, actual_action.install_event);
+        EXPECT_EQ(expected_action.needs_admin, actual_action.needs_admin);
+        EXPECT_STREQ(expected_action.program_to_run,
+                     actual_action.program_to_run);
+        EXPECT_STREQ(expected_action.program_arguments,
+                     actual_action.program_arguments);
+        EXPECT_STREQ(expected_action.success_url, actual_action.success_url);
+        EXPECT_EQ(expected_action.terminate_all_browsers,
+                  actual_action.terminate_all_browsers);
+        EXPECT_EQ(expected_action.success_action, actual_action.success_action);
+      }
+
+      ASSERT_EQ(expected_app.data.size(), actual_app.data.size());
+      for (size_t j = 0; j != expected_app.data.size(); ++j) {
+        EXPECT_STREQ(expected_app.data[j].status, actual_app.data[j].status);
+        EXPECT_STREQ(expected_app.data[j].name, actual_app.data[j].name);
+        EXPECT_STREQ(expected_app.data[j].install_data_index,
+                     actual_app.data[j].install_data_index);
+        EXPECT_STREQ(expected_app.data[j].install_data,
+                     actual_app.data[j].install_data);
+      }
+    }
+  }
 };
 
 // Creates a machine update request and serializes it.
@@ -388,6 +843,310 @@ TEST_F(XmlParserTest, Parse_InvalidDataStatusError) {
             update_response_utils::ValidateUntrustedData(app.data));
 }
 
+// Parses the differential patch of a package and the urls it is served from.
+TEST_F(XmlParserTest, Parse_DifferentialPatch) {
+  CStringA buffer_string = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><updatecheck status=\"ok\"><urls><url codebase=\"http://dl.google.com/edgedl/chrome/install/172.37/\" codebasediff=\"http://dl.google.com/edgedl/chrome/diff/172.37/\"/><url codebasediff=\"https://dl.google.com/edgedl/chrome/diff/172.37/\"/></urls><manifest version=\"2.0.172.37\"><packages><package hash_sha256=\"d5e06b4436c5e33f2de88298b890f47815fc657b63b3050d2217c55a5d0730b0\" name=\"chrome_installer.exe\" required=\"true\" size=\"9614320\" namediff=\"chrome_installer_from_2.0.172.30.diff\" sizediff=\"53212\" hashdiff_sha256=\"0b0387a5a55c7122d0503b36b57c19a87f048b89823ed82ff33e5c6344b06e5d\"/><package hash_sha256=\"7a8cc1e8e5f2d05ba1ed47bc4b5ec12fd4a7e62a3eb8d4e9e3e18b2bd3c7d3e5\" name=\"setup.exe\" required=\"true\" size=\"1024\" namediff=\"setup.diff\"/></packages></manifest></updatecheck></app></response>";  // NOLINT
+  std::vector<uint8> buffer(buffer_string.GetLength());
+  memcpy(&buffer.front(), buffer_string, buffer.size());
+
+  scoped_ptr<UpdateResponse> update_response(UpdateResponse::Create());
+  EXPECT_HRESULT_SUCCEEDED(XmlParser::DeserializeResponse(
+      buffer,
+      update_response.get()));
+  const response::Response& xml_response(update_response->response());
+  ASSERT_EQ(1, xml_response.apps.size());
+
+  const response::UpdateCheck& update_check(xml_response.apps[0].update_check);
+  ASSERT_EQ(1, update_check.urls.size());
+  EXPECT_STREQ(_T("http://dl.google.com/edgedl/chrome/install/172.37/"),
+               update_check.urls[0]);
+  ASSERT_EQ(2, update_check.diff_urls.size());
+  EXPECT_STREQ(_T("http://dl.google.com/edgedl/chrome/diff/172.37/"),
+               update_check.diff_urls[0]);
+  EXPECT_STREQ(_T("https://dl.google.com/edgedl/chrome/diff/172.37/"),
+               update_check.diff_urls[1]);
+
+  const InstallManifest& install_manifest(update_check.install_manifest);
+  ASSERT_EQ(2, install_manifest.packages.size());
+
+  const InstallPackage& package(install_manifest.packages[0]);
+  EXPECT_STREQ(_T("chrome_installer_from_2.0.172.30.diff"), package.name_diff);
+  EXPECT_EQ(53212, package.size_diff);
+  EXPECT_STREQ(
+      _T("0b0387a5a55c7122d0503b36b57c19a87f048b89823ed82ff33e5c6344b06e5d"),
+      package.hash_diff_sha256);
+
+  // A patch without a size and a hash is ignored.
+  const InstallPackage& incomplete_package(install_manifest.packages[1]);
+  EXPECT_TRUE(incomplete_package.name_diff.IsEmpty());
+  EXPECT_EQ(0, incomplete_package.size_diff);
+  EXPECT_TRUE(incomplete_package.hash_diff_sha256.IsEmpty());
+}
+
+// Parses the format of the packages which are archives.
+TEST_F(XmlParserTest, Parse_Archive) {
+  CStringA buffer_string = "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><updatecheck status=\"ok\"><urls><url codebase=\"http://dl.google.com/edgedl/chrome/install/172.37/\"/></urls><manifest version=\"2.0.172.37\"><packages><package hash_sha256=\"d5e06b4436c5e33f2de88298b890f47815fc657b63b3050d2217c55a5d0730b0\" name=\"chrome_installer.exe.xz\" required=\"true\" size=\"9614320\" archive=\"xz\"/><package hash_sha256=\"7a8cc1e8e5f2d05ba1ed47bc4b5ec12fd4a7e62a3eb8d4e9e3e18b2bd3c7d3e5\" name=\"resources.7z\" required=\"true\" size=\"1024\" archive=\"7z\"/><package hash_sha256=\"0b0387a5a55c7122d0503b36b57c19a87f048b89823ed82ff33e5c6344b06e5d\" name=\"setup.exe\" required=\"true\" size=\"1024\"/></packages></manifest></updatecheck></app></response>";  // NOLINT
+  std::vector<uint8> buffer(buffer_string.GetLength());
+  memcpy(&buffer.front(), buffer_string, buffer.size());
+
+  scoped_ptr<UpdateResponse> update_response(UpdateResponse::Create());
+  EXPECT_HRESULT_SUCCEEDED(XmlParser::DeserializeResponse(
+      buffer,
+      update_response.get()));
+  const response::Response& xml_response(update_response->response());
+  ASSERT_EQ(1, xml_response.apps.size());
+
+  const InstallManifest& install_manifest(
+      xml_response.apps[0].update_check.install_manifest);
+  ASSERT_EQ(3, install_manifest.packages.size());
+  EXPECT_STREQ(_T("xz"), install_manifest.packages[0].archive);
+  EXPECT_STREQ(_T("7z"), install_manifest.packages[1].archive);
+  EXPECT_TRUE(install_manifest.packages[2].archive.IsEmpty());
+
+  // A format which is not supported makes the response invalid.
+  buffer_string.Replace("archive=\"7z\"", "archive=\"zip\"");
+  buffer.resize(buffer_string.GetLength());
+  memcpy(&buffer.front(), buffer_string, buffer.size());
+  update_response.reset(UpdateResponse::Create());
+  EXPECT_HRESULT_FAILED(XmlParser::DeserializeResponse(
+      buffer,
+      update_response.get()));
+}
+
+// The streaming parser and the DOM produce the same response for the recorded
+// responses and for the offline manifests.
+TEST_F(XmlParserTest, DeserializeResponseStream_SameAsDom) {
+  const char* const kResponses[] = {
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><systemrequirements platform=\"win\" arch=\"x86\" min_os_version=\"6.0\"/><daystart elapsed_seconds=\"8400\" elapsed_days=\"3255\" /><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\" cohort=\"Cohort1\" cohorthint=\"Hint1\" cohortname=\"Name1\" experiments=\"url_exp_2=a|Fri, 14 Aug 2015 16:13:03 GMT\"><updatecheck status=\"ok\"><urls><url codebase=\"http://cache.pack.google.com/edgedl/chrome/install/172.37/\"/></urls><manifest version=\"2.0.172.37\"><packages><package hash_sha256=\"d5e06b4436c5e33f2de88298b890f47815fc657b63b3050d2217c55a5d0730b0\" hash=\"NT/6ilbSjWgbVqHZ0rT1vTg1coE=\" name=\"chrome_installer.exe\" required=\"true\" size=\"9614320\"/></packages><actions><action arguments=\"--do-not-launch-chrome\" event=\"install\" needsadmin=\"false\" run=\"chrome_installer.exe\"/><action event=\"postinstall\" onsuccess=\"exitsilentlyonlaunchcmd\"/></actions></manifest></updatecheck><data index=\"verboselogging\" name=\"install\" status=\"ok\">{\n \"distribution\": {\n   \"verbose_logging\": true\n }\n}\n</data><data name=\"untrusted\" status=\"ok\"/><ping status=\"ok\"/></app></response>",  // NOLINT
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\" ExtraUnsupportedAttribute=\"123\"><daystart elapsed_seconds=\"8400\" elapsed_days=\"3255\" /><UnsupportedElement1 UnsupportedAttribute1=\"some value\" /><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"noupdate\"><updatecheck status=\"noupdate\"/><data index=\"verboselog\" name=\"install\" status=\"error-nodata\"/><ping status=\"ok\"/><event status=\"ok\"/></app><UnsupportedElement2>Some text.<ping status=\"ok\"/></UnsupportedElement2></response>",  // NOLINT
+    "\xEF\xBB\xBF<?xml version=\"1.0\"?>\r\n<!-- comment -->\r\n<o:response xmlns:o=\"http://www.google.com/update2/response\" protocol=\"3.1\">\r\n  <o:app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\" cohortname=\"&quot;Caf&#xE9;&quot; &amp; &#60;co&gt;\">\r\n    <o:updatecheck status=\"ok\" tttoken=\"token\"/>\r\n    <o:data index=\"i\" name=\"install\" status=\"ok\">{\"a\": \"&lt;b&gt;\"}\r\n</o:data>\r\n  </o:app>\r\n</o:response>\r\n",  // NOLINT
+  };
+
+  for (size_t i = 0; i != arraysize(kResponses); ++i) {
+    ExpectSameResponses(ToBuffer(kResponses[i]));
+  }
+
+  ExpectSameResponses(ToBuffer(BuildLargeResponse(50)));
+
+  const TCHAR* const kOfflineManifests[] = {
+    _T("{CDABE316-39CD-43BA-8440-6D1E0547AEE6}.v2.gup"),
+    _T("{CDABE316-39CD-43BA-8440-6D1E0547AEE6}.v3.gup"),
+  };
+  for (size_t i = 0; i != arraysize(kOfflineManifests); ++i) {
+    const CString path(ConcatenatePath(
+        ConcatenatePath(app_util::GetCurrentModuleDirectory(),
+                        _T("unittest_support")),
+        kOfflineManifests[i]));
+    std::vector<uint8> buffer;
+    ASSERT_HRESULT_SUCCEEDED(ReadEntireFile(path, 0, &buffer));
+    ExpectSameResponses(buffer);
+  }
+}
+
+TEST_F(XmlParserTest, DeserializeResponseStream_Errors) {
+  const char* const kResponses[] = {
+    // Unknown root element.
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><request protocol=\"3.0\"/>",
+
+    // Incompatible protocol.
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"4.0\"/>",
+
+    // Invalid package size.
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><updatecheck status=\"ok\"><manifest version=\"1.0\"><packages><package hash=\"abc\" name=\"a.exe\" required=\"true\" size=\"big\"/></packages></manifest></updatecheck></app></response>",  // NOLINT
+
+    // Missing required attribute.
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app status=\"ok\"/></response>",  // NOLINT
+
+    // Install data in a CDATA section instead of a text node.
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><data index=\"i\" name=\"install\" status=\"ok\"><![CDATA[{}]]></data></app></response>",  // NOLINT
+  };
+  const HRESULT kExpectedErrors[] = {
+    GOOPDATEXML_E_RESPONSENODE,
+    GOOPDATEXML_E_XMLVERSION,
+    GOOPDATEXML_E_STRTOUINT,
+    E_FAIL,
+    E_INVALIDARG,
+  };
+  COMPILE_ASSERT(arraysize(kResponses) == arraysize(kExpectedErrors),
+                 responses_and_errors_mismatch);
+
+  for (size_t i = 0; i != arraysize(kResponses); ++i) {
+    response::Response response;
+    EXPECT_EQ(kExpectedErrors[i],
+              DeserializeResponseStream(ToBuffer(kResponses[i]), &response));
+    ExpectSameResponses(ToBuffer(kResponses[i]));
+  }
+
+  // The install data split by a comment or a CDATA section is rejected, as
+  // the DOM does. The DOM asserts on several child nodes, so only the
+  // streaming parser is run.
+  const char* const kSplitInstallData[] = {
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><data index=\"i\" name=\"install\" status=\"ok\">{<!-- c -->}</data></app></response>",  // NOLINT
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?><response protocol=\"3.0\"><app appid=\"{8A69D345-D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"><data index=\"i\" name=\"install\" status=\"ok\">{<![CDATA[]]>}</data></app></response>",  // NOLINT
+  };
+  for (size_t i = 0; i != arraysize(kSplitInstallData); ++i) {
+    response::Response response;
+    EXPECT_EQ(E_INVALIDARG,
+              DeserializeResponseStream(ToBuffer(kSplitInstallData[i]),
+                                        &response));
+  }
+
+  response::Response response;
+  EXPECT_EQ(CI_E_XML_LOAD_ERROR,
+            DeserializeResponseStream(ToBuffer("<response protocol=\"3.0\">"),
+                                      &response));
+  EXPECT_EQ(E_INVALIDARG,
+            DeserializeResponseStream(std::vector<uint8>(), &response));
+}
+
+// The documents which the streaming parser does not support are loaded in a
+// DOM instead.
+TEST_F(XmlParserTest, DeserializeResponse_NotUtf8) {
+  const CString xml(_T("<?xml version=\"1.0\" encoding=\"UTF-16\"?>")
+                    _T("<response protocol=\"3.0\"><app appid=\"{8A69D345-")
+                    _T("D564-463C-AFF1-A69D9E530F96}\" status=\"ok\"/>")
+                    _T("</response>"));
+  std::vector<uint8> buffer(2 + xml.GetLength() * sizeof(TCHAR));
+  buffer[0] = 0xFF;
+  buffer[1] = 0xFE;
+  memcpy(&buffer[2], xml.GetString(), xml.GetLength() * sizeof(TCHAR));
+
+  response::Response response;
+  EXPECT_EQ(S_FALSE, DeserializeResponseStream(buffer, &response));
+
+  scoped_ptr<UpdateResponse> update_response(UpdateResponse::Create());
+  EXPECT_HRESULT_SUCCEEDED(XmlParser::DeserializeResponse(
+      buffer,
+      update_response.get()));
+  ASSERT_EQ(1, update_response->response().apps.size());
+  EXPECT_STREQ(_T("{8A69D345-D564-463C-AFF1-A69D9E530F96}"),
+               update_response->response().apps[0].appid);
+}
+
+// Compares the time it takes to parse a response for 50 apps with the
+// streaming parser and with the DOM.
+TEST_F(XmlParserTest, DISABLED_DeserializeResponse_StreamVersusDomBenchmark) {
+  const int kNumIterations = 200;
+  const std::vector<uint8> buffer(ToBuffer(BuildLargeResponse(50)));
+
+  double stream_ms = 0;
+  double dom_ms = 0;
+  for (int mode = 0; mode != 2; ++mode) {
+    const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+    for (int i = 0; i != kNumIterations; ++i) {
+      response::Response response;
+      ASSERT_HRESULT_SUCCEEDED(mode == 0 ?
+          DeserializeResponseStream(buffer, &response) :
+          DeserializeResponseDom(buffer, &response));
+      ASSERT_EQ(50, response.apps.size());
+    }
+    const double ms = (HighresTimer::GetCurrentTicks() - start_ticks) *
+                      1000.0 / HighresTimer::GetTimerFrequency();
+    (mode == 0 ? stream_ms : dom_ms) = ms / kNumIterations;
+  }
+
+  OPT_LOG(L1, (_T("[response of %d bytes][stream %f ms][DOM %f ms]"),
+               static_cast<int>(buffer.size()), stream_ms, dom_ms));
+}
+
+// The requests written for several apps are well-formed, and the wide string
+// overload returns the same document.
+TEST_F(XmlParserTest, SerializeRequest_LargeRequest) {
+  for (int num_apps = 0; num_apps != 3; ++num_apps) {
+    scoped_ptr<UpdateRequest> update_request(
+        UpdateRequest::Create(true, _T("sid"), _T("is"), _T("http://foo/\"")));
+    BuildLargeRequest(num_apps, &get_xml_request(update_request.get()));
+    CString buffer;
+    EXPECT_HRESULT_SUCCEEDED(XmlParser::SerializeRequest(*update_request,
+                                                         &buffer));
+    CComPtr<IXMLDOMDocument> document;
+    EXPECT_HRESULT_SUCCEEDED(LoadXMLFromMemory(buffer, false, &document));
+  }
+
+  scoped_ptr<UpdateRequest> update_request(
+      UpdateRequest::Create(false, _T(""), _T(""), _T("")));
+  BuildLargeRequest(50, &get_xml_request(update_request.get()));
+
+  CStringA utf8_buffer;
+  EXPECT_HRESULT_SUCCEEDED(XmlParser::SerializeRequest(*update_request,
+                                                       &utf8_buffer));
+  CString buffer;
+  EXPECT_HRESULT_SUCCEEDED(XmlParser::SerializeRequest(*update_request,
+                                                       &buffer));
+  EXPECT_STREQ(utf8_buffer, WideToUtf8(buffer));
+
+  CComPtr<IXMLDOMDocument> document;
+  ASSERT_HRESULT_SUCCEEDED(LoadXMLFromMemory(buffer, false, &document));
+  CComPtr<IXMLDOMNodeList> apps;
+  ASSERT_HRESULT_SUCCEEDED(document->getElementsByTagName(CComBSTR(_T("app")),
+                                                          &apps));
+  long num_apps = 0;  // NOLINT
+  EXPECT_HRESULT_SUCCEEDED(apps->get_length(&num_apps));
+  EXPECT_EQ(50, num_apps);
+}
+
+// The writer writes the same bytes as the DOM serializer it replaced, as
+// recorded in the golden file.
+TEST_F(XmlParserTest, SerializeRequest_SameAsDomGolden) {
+  std::vector<CStringA> golden_requests;
+  ASSERT_HRESULT_SUCCEEDED(ReadGoldenRequests(&golden_requests));
+  ASSERT_EQ(arraysize(kGoldenRequests), golden_requests.size());
+
+  for (size_t i = 0; i != arraysize(kGoldenRequests); ++i) {
+    scoped_ptr<UpdateRequest> update_request(
+        UpdateRequest::Create(false, _T(""), _T(""), _T("")));
+    BuildGoldenRequest(kGoldenRequests[i],
+                       &get_xml_request(update_request.get()));
+
+    CStringA buffer;
+    EXPECT_HRESULT_SUCCEEDED(XmlParser::SerializeRequest(*update_request,
+                                                         &buffer));
+    EXPECT_STREQ(golden_requests[i], buffer) << "golden request " << i;
+  }
+}
+
+// Compares the time it takes to serialize a request for 50 apps, each with
+// five ping events, with the writer and with the DOM, as the request was
+// serialized before. The DOM is built from the elements of the writer output,
+// which are read beforehand.
+TEST_F(XmlParserTest, DISABLED_SerializeRequest_WriterVersusDomBenchmark) {
+  const int kNumIterations = 200;
+  scoped_ptr<UpdateRequest> update_request(
+      UpdateRequest::Create(false, _T(""), _T(""), _T("")));
+  BuildLargeRequest(50, &get_xml_request(update_request.get()));
+
+  CString buffer;
+  ASSERT_HRESULT_SUCCEEDED(XmlParser::SerializeRequest(*update_request,
+                                                       &buffer));
+  CComPtr<IXMLDOMDocument> document;
+  ASSERT_HRESULT_SUCCEEDED(LoadXMLFromMemory(buffer, false, &document));
+  CComPtr<IXMLDOMElement> root_element;
+  ASSERT_HRESULT_SUCCEEDED(document->get_documentElement(&root_element));
+  RequestNode root;
+  ASSERT_HRESULT_SUCCEEDED(ReadRequestNode(root_element, &root));
+
+  // The same buffer is used for all the requests, as a client would.
+  CStringA utf8_buffer;
+  CStringA dom_buffer;
+  double writer_ms = 0;
+  double dom_ms = 0;
+  for (int mode = 0; mode != 2; ++mode) {
+    const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+    for (int i = 0; i != kNumIterations; ++i) {
+      ASSERT_HRESULT_SUCCEEDED(mode == 0 ?
+          XmlParser::SerializeRequest(*update_request, &utf8_buffer) :
+          SerializeRequestWithDom(root, &dom_buffer));
+    }
+    const double ms = (HighresTimer::GetCurrentTicks() - start_ticks) *
+                      1000.0 / HighresTimer::GetTimerFrequency();
+    (mode == 0 ? writer_ms : dom_ms) = ms / kNumIterations;
+  }
+  EXPECT_STREQ(dom_buffer, utf8_buffer);
+
+  OPT_LOG(L1, (_T("[request of %d bytes][writer %f ms][DOM %f ms]"),
+               utf8_buffer.GetLength(), writer_ms, dom_ms));
+}
+
 TEST_F(XmlParserTest, Serialize_WithInvalidXmlCharacters) {
   scoped_ptr<UpdateRequest> update_request(
       UpdateRequest::Create(false, _T("sid"), _T("is"), _T("http://foo/\"")));
@@ -19,6 +19,7 @@
 #include <atlstr.h>
 #include <algorithm>
 
+#include "omaha/base/debug.h"
 #include "omaha/base/scoped_ptr_address.h"
 #include "omaha/base/utils.h"
 #include "omaha/crashhandler/crash_analyzer_checks.h"
@@ -248,19 +249,27 @@ BYTE* CrashAnalyzer::GetThreadStack(BYTE* ptr) const {
 }
 
 size_t CrashAnalyzer::ScanSegmentForPointer(BYTE* ptr, BYTE* pattern) {
+  MemoryScanner scanner;
+  scanner.AddPointer(pattern);
+  std::vector<MemoryScanHit> hits;
+  return ScanSegment(ptr, scanner, &hits);
+}
+
+size_t CrashAnalyzer::ScanSegment(BYTE* ptr,
+                                  const MemoryScanner& scanner,
+                                  std::vector<MemoryScanHit>* hits) {
   BYTE* buffer = 0;
   size_t size = 0;
   if (!ReadMemorySegment(ptr, &buffer, &size)) {
     return 0;
   }
-  size_t matches = 0;
-  for (size_t i = 0; i != size; ++i) {
-    BYTE** cmp = reinterpret_cast<BYTE**>(&buffer[i]);
-    if (*cmp == pattern) {
-      ++matches;
-    }
-  }
-  return matches;
+  return scanner.Scan(buffer, size, hits);
+}
+
+void CrashAnalyzer::RecordSnapshot(MemorySnapshot* snapshot) {
+  ASSERT1(snapshot);
+  NtFunctionsOnStack(this).RecordSegments(snapshot);
+  ShellcodeSprayPattern(this).RecordSegments(snapshot);
 }
 
 void CrashAnalyzer::AddCommentToUserStreams(const CStringA& text) {
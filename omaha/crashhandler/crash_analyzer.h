@@ -24,6 +24,7 @@
 #include "base/basictypes.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/scoped_ptr_address.h"
+#include "omaha/crashhandler/memory_scanner.h"
 #include "third_party/breakpad/src/client/windows/crash_generation/client_info.h"
 
 namespace omaha {
@@ -129,6 +130,14 @@ class CrashAnalyzer {
   BYTE* FindContainingMemorySegment(BYTE* ptr) const;
   BYTE* GetThreadStack(BYTE* ptr) const;
   size_t ScanSegmentForPointer(BYTE* ptr, BYTE* pattern);
+  // Scans the segment at |ptr| once for everything |scanner| looks for.
+  // Returns the number of hits appended to |hits|.
+  size_t ScanSegment(BYTE* ptr,
+                     const MemoryScanner& scanner,
+                     std::vector<MemoryScanHit>* hits);
+  // Records the segments which the stack and the spray checks scan, so that
+  // the checks can be run on the snapshot without the crashed process.
+  void RecordSnapshot(MemorySnapshot* snapshot);
   bool ReadExceptionContext(CONTEXT* context) const;
   bool ReadExceptionRecord(EXCEPTION_RECORD* exception_record) const;
 
@@ -17,9 +17,7 @@
 
 #include <winnt.h>
 
-#include <cstdlib>
-#include <ctime>
-
+#include "omaha/base/debug.h"
 #include "omaha/base/safe_format.h"
 #include "omaha/base/scoped_ptr_address.h"
 
@@ -87,56 +85,136 @@ CrashAnalysisResult WildStackPointer::Run() {
   return ANALYSIS_NORMAL;
 }
 
+namespace {
+
+// Functions which do not exist on this version of Windows are skipped.
+void AddFunctionPointer(HMODULE module,
+                        const char* function_name,
+                        MemoryScanner* scanner) {
+  FARPROC function = ::GetProcAddress(module, function_name);
+  if (function) {
+    scanner->AddPointer(reinterpret_cast<const void*>(function));
+  }
+}
+
+bool IsExecutable(DWORD protect) {
+  return protect == PAGE_EXECUTE ||
+         protect == PAGE_EXECUTE_READ ||
+         protect == PAGE_EXECUTE_READWRITE ||
+         protect == PAGE_EXECUTE_WRITECOPY;
+}
+
+void RecordSegment(CrashAnalyzer* analyzer,
+                   const MemoryMap& map,
+                   BYTE* segment,
+                   MemorySnapshot* snapshot) {
+  MemoryMap::const_iterator it = map.find(segment);
+  BYTE* buffer = 0;
+  size_t size = 0;
+  if (it == map.end() ||
+      !analyzer->ReadMemorySegment(segment, &buffer, &size)) {
+    return;
+  }
+  snapshot->AddRegion(reinterpret_cast<UINT_PTR>(segment),
+                      (*it).second.Protect,
+                      buffer,
+                      size);
+}
+
+// Returns true if the scanner finds a hit in the regions of the snapshot which
+// are executable, or not executable, depending on |executable|.
+bool ScanSnapshot(const MemorySnapshot& snapshot,
+                  bool executable,
+                  const MemoryScanner& scanner) {
+  const std::vector<MemorySnapshot::Region>& regions = snapshot.regions();
+  for (size_t i = 0; i != regions.size(); ++i) {
+    const std::vector<BYTE>& contents = regions[i].contents;
+    if (IsExecutable(regions[i].protect) != executable || contents.empty()) {
+      continue;
+    }
+    std::vector<MemoryScanHit> hits;
+    if (scanner.Scan(&contents.front(), contents.size(), &hits)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
 NtFunctionsOnStack::NtFunctionsOnStack(CrashAnalyzer* analyzer)
     : CrashAnalyzerCheck(analyzer) {}
 
-CrashAnalysisResult NtFunctionsOnStack::Run() {
+void NtFunctionsOnStack::AddFunctionPointers(MemoryScanner* scanner) {
+  ASSERT1(scanner);
+
   // Because the crash handler process is running on the same system
   // as the process which crashed we can assume that they are mapped
   // in the same location in both processes.
   HMODULE ntdll = ::LoadLibraryA("ntdll.dll");
   HMODULE kernel32 = ::LoadLibraryA("kernel32.dll");
-  std::vector<BYTE*> functions;
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(kernel32, "HeapCreate")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(ntdll, "RtlCreateHeap")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(ntdll, "ZwProtectVirtualMemory")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(ntdll, "ZwAllocateVirtualMemory")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(kernel32, "SetProcessDEPPolicy")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(ntdll, "NtSetInformationProcess")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(kernel32, "WriteProcessMemory")));
-  functions.push_back(reinterpret_cast<BYTE*>(
-      ::GetProcAddress(ntdll, "ZwWriteVirtualMemory")));
+  AddFunctionPointer(kernel32, "HeapCreate", scanner);
+  AddFunctionPointer(ntdll, "RtlCreateHeap", scanner);
+  AddFunctionPointer(ntdll, "ZwProtectVirtualMemory", scanner);
+  AddFunctionPointer(ntdll, "ZwAllocateVirtualMemory", scanner);
+  AddFunctionPointer(kernel32, "SetProcessDEPPolicy", scanner);
+  AddFunctionPointer(ntdll, "NtSetInformationProcess", scanner);
+  AddFunctionPointer(kernel32, "WriteProcessMemory", scanner);
+  AddFunctionPointer(ntdll, "ZwWriteVirtualMemory", scanner);
+}
 
+std::vector<BYTE*> NtFunctionsOnStack::FindStackSegments() const {
+  std::vector<BYTE*> stack_segments;
   const ThreadMap contexts = analyzer_.thread_contexts();
   for (ThreadMap::const_iterator i = contexts.begin();
        i != contexts.end();
        ++i) {
     BYTE* stack_segment = analyzer_.FindContainingMemorySegment(
         analyzer_.GetThreadStack((*i).first));
-    if (!stack_segment) {
-      continue;
+    if (stack_segment) {
+      stack_segments.push_back(stack_segment);
     }
-    for (size_t p = 0; p != functions.size(); ++p) {
-      if (analyzer_.ScanSegmentForPointer(stack_segment, functions[p])) {
-        const BYTE* func_ptr = functions[p];
-        CStringA context;
-        SafeCStringAFormat(
-            &context, "The stack for a thread contains pointers commonly used "
-                      "for ROP chains.\n"
-                      "Stack segment: %x\n"
-                      "Suspicious pointer: %x\n",
-                      reinterpret_cast<size_t>(stack_segment),
-                      reinterpret_cast<size_t>(func_ptr));
-        analyzer_.AddCommentToUserStreams(context);
-        return ANALYSIS_NT_FUNC_STACK;
-      }
+  }
+  return stack_segments;
+}
+
+void NtFunctionsOnStack::RecordSegments(MemorySnapshot* snapshot) {
+  ASSERT1(snapshot);
+  const MemoryMap map = analyzer_.memory_regions();
+  const std::vector<BYTE*> stack_segments(FindStackSegments());
+  for (size_t i = 0; i != stack_segments.size(); ++i) {
+    RecordSegment(&analyzer_, map, stack_segments[i], snapshot);
+  }
+}
+
+CrashAnalysisResult NtFunctionsOnStack::RunOnSnapshot(
+    const MemorySnapshot& snapshot) {
+  MemoryScanner scanner;
+  AddFunctionPointers(&scanner);
+  return ScanSnapshot(snapshot, false, scanner) ? ANALYSIS_NT_FUNC_STACK :
+                                                  ANALYSIS_NORMAL;
+}
+
+CrashAnalysisResult NtFunctionsOnStack::Run() {
+  MemoryScanner scanner;
+  AddFunctionPointers(&scanner);
+
+  const std::vector<BYTE*> stack_segments(FindStackSegments());
+  for (size_t i = 0; i != stack_segments.size(); ++i) {
+    BYTE* stack_segment = stack_segments[i];
+    // All the functions are searched for in a single pass over the stack.
+    std::vector<MemoryScanHit> hits;
+    if (analyzer_.ScanSegment(stack_segment, scanner, &hits)) {
+      CStringA context;
+      SafeCStringAFormat(
+          &context, "The stack for a thread contains pointers commonly used "
+                    "for ROP chains.\n"
+                    "Stack segment: %x\n"
+                    "Suspicious pointer: %x\n",
+                    reinterpret_cast<size_t>(stack_segment),
+                    static_cast<size_t>(hits[0].value));
+      analyzer_.AddCommentToUserStreams(context);
+      return ANALYSIS_NT_FUNC_STACK;
     }
   }
   return ANALYSIS_NORMAL;
@@ -237,28 +315,31 @@ const BYTE ShellcodeSprayPattern::kOverlapingInstructions[] = {
     0x04, 0x0C, 0x0D, 0x14, 0x15, 0x1C, 0x1D, 0x24, 0x25, 0x27, 0x2C, 0x2D,
     0x2F, 0x34, 0x35, 0x37, 0x3C, 0x3D, 0x3F, 0x40, 0x41, 0x42, 0x43, 0x44,
     0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F };
-const size_t ShellcodeSprayPattern::kNumSamples = 20;
 const size_t ShellcodeSprayPattern::kMatchCutoff = 50;
 
 ShellcodeSprayPattern::ShellcodeSprayPattern(CrashAnalyzer* analyzer)
     : CrashAnalyzerCheck(analyzer) {}
 
-CrashAnalysisResult ShellcodeSprayPattern::Run() {
-  const std::vector<BYTE> patterns(kOverlapingInstructions,
-      kOverlapingInstructions + sizeof(kOverlapingInstructions));
+void ShellcodeSprayPattern::AddSprayPatterns(MemoryScanner* scanner) {
+  ASSERT1(scanner);
+  for (size_t i = 0; i != arraysize(kOverlapingInstructions); ++i) {
+    scanner->AddRepeatedByte(kOverlapingInstructions[i]);
+  }
+  scanner->set_min_repeated_dwords(kMatchCutoff);
+}
+
+std::vector<BYTE*> ShellcodeSprayPattern::FindUnknownExecSegments() const {
   SYSTEM_INFO system_info = {0};
   ::GetSystemInfo(&system_info);
   const size_t page_size = system_info.dwPageSize;
   const MemoryMap map = analyzer_.memory_regions();
   const ModuleMap modules = analyzer_.modules();
+  std::vector<BYTE*> segments;
   for (MemoryMap::const_iterator it = map.begin();
        it != map.end();
        ++it) {
     BYTE* base_address = (*it).first;
-    if (((*it).second.Protect != PAGE_EXECUTE &&
-         (*it).second.Protect != PAGE_EXECUTE_READ &&
-         (*it).second.Protect != PAGE_EXECUTE_READWRITE &&
-         (*it).second.Protect != PAGE_EXECUTE_WRITECOPY) ||
+    if (!IsExecutable((*it).second.Protect) ||
         modules.find(base_address) != modules.end()) {
       continue;
     }
@@ -275,7 +356,36 @@ CrashAnalysisResult ShellcodeSprayPattern::Run() {
         continue;
       }
     }
-    if (SampleSegmentForRepeatedPatterns(base_address, patterns)) {
+    segments.push_back(base_address);
+  }
+  return segments;
+}
+
+void ShellcodeSprayPattern::RecordSegments(MemorySnapshot* snapshot) {
+  ASSERT1(snapshot);
+  const MemoryMap map = analyzer_.memory_regions();
+  const std::vector<BYTE*> segments(FindUnknownExecSegments());
+  for (size_t i = 0; i != segments.size(); ++i) {
+    RecordSegment(&analyzer_, map, segments[i], snapshot);
+  }
+}
+
+CrashAnalysisResult ShellcodeSprayPattern::RunOnSnapshot(
+    const MemorySnapshot& snapshot) {
+  MemoryScanner scanner;
+  AddSprayPatterns(&scanner);
+  return ScanSnapshot(snapshot, true, scanner) ? ANALYSIS_FOUND_SHELLCODE :
+                                                 ANALYSIS_NORMAL;
+}
+
+CrashAnalysisResult ShellcodeSprayPattern::Run() {
+  MemoryScanner scanner;
+  AddSprayPatterns(&scanner);
+  const std::vector<BYTE*> segments(FindUnknownExecSegments());
+  for (size_t i = 0; i != segments.size(); ++i) {
+    BYTE* base_address = segments[i];
+    std::vector<MemoryScanHit> hits;
+    if (analyzer_.ScanSegment(base_address, scanner, &hits)) {
       CStringA context;
       SafeCStringAFormat(
           &context, "The process has an executable mapping which contains "
@@ -297,64 +407,6 @@ CrashAnalysisResult ShellcodeSprayPattern::Run() {
   return ANALYSIS_NORMAL;
 }
 
-bool ShellcodeSprayPattern::SampleSegmentForRepeatedPatterns(
-    BYTE* ptr,
-    const std::vector<BYTE> patterns) const {
-  BYTE* buffer;
-  size_t size = 0;
-  if (!analyzer_.ReadMemorySegment(ptr, &buffer, &size)) {
-    return false;
-  }
-  srand(static_cast<unsigned int>(time(NULL)));
-  // Rather than scan all executable memory for these patterns we sample random
-  // offsets into the buffer for the patterns we are looking for. When we find
-  // one we scan forward and backward and count the number of adjacent dwords
-  // that match the pattern. We only trigger when we find kMatchCutoff
-  // consecutive dwords matching the same pattern.
-  for (size_t i = 0; i != kNumSamples; ++i) {
-    const size_t offset = rand() % (size - 3);  // NOLINT
-    const DWORD cmp = *(reinterpret_cast<DWORD*>(&buffer[offset]));
-    for (size_t p = 0; p != patterns.size(); ++p) {
-      size_t matches = 0;
-      const DWORD pattern = patterns[p] << 24 |
-                            patterns[p] << 16 |
-                            patterns[p] << 8 |
-                            patterns[p];
-      if (cmp != pattern) {
-        continue;
-      }
-      ++matches;
-      for (size_t forward_off = offset + sizeof(DWORD);
-           forward_off < size - sizeof(DWORD) && matches < kMatchCutoff;
-           forward_off += sizeof(DWORD)) {
-        const DWORD forward_cmp =
-            *(reinterpret_cast<DWORD*>(&buffer[forward_off]));
-        if (forward_cmp != pattern) {
-          break;
-        }
-        ++matches;
-      }
-      for (size_t backward_off =
-              (offset >= sizeof(DWORD)) ? offset - sizeof(DWORD) : offset;
-           backward_off != 0 && matches < kMatchCutoff;
-           backward_off -=
-               (backward_off > sizeof(DWORD)) ? sizeof(DWORD) : backward_off) {
-        const DWORD backward_cmp =
-            *(reinterpret_cast<DWORD*>(&buffer[backward_off]));
-        if (backward_cmp != pattern) {
-          break;
-        }
-        ++matches;
-      }
-      if (matches >= kMatchCutoff) {
-        return true;
-      }
-      break;
-    }
-  }
-  return false;
-}
-
 const DWORD TiBDereference::kTiBBottom = 0x7ef00000;
 const DWORD TiBDereference::kTiBTop = 0x7effffff;
 const DWORD TiBDereference::kSharedUserDataBottom = 0x7ffe0000;
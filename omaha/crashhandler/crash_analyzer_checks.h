@@ -16,6 +16,8 @@
 #ifndef OMAHA_CRASHHANDLER_CRASH_ANALYZER_CHECKS_H_
 #define OMAHA_CRASHHANDLER_CRASH_ANALYZER_CHECKS_H_
 
+#include <vector>
+
 #include "omaha/crashhandler/crash_analyzer.h"
 
 namespace omaha {
@@ -49,6 +51,19 @@ class NtFunctionsOnStack : public CrashAnalyzerCheck {
  public:
   explicit NtFunctionsOnStack(CrashAnalyzer* analyzer);
   virtual CrashAnalysisResult Run();
+
+  // Adds the stack segments of the threads to |snapshot|.
+  void RecordSegments(MemorySnapshot* snapshot);
+
+  // Runs the check on the regions of |snapshot| which are not executable,
+  // which are the stacks that RecordSegments adds. The functions are looked
+  // up in this process, so the snapshot must come from the same system.
+  static CrashAnalysisResult RunOnSnapshot(const MemorySnapshot& snapshot);
+
+ private:
+  static void AddFunctionPointers(MemoryScanner* scanner);
+
+  std::vector<BYTE*> FindStackSegments() const;
 };
 
 // Checks whether PE images are mapped within the process which have been
@@ -62,21 +77,30 @@ class PENotInModuleList : public CrashAnalyzerCheck {
   bool MatchesPESignature(BYTE* buffer, size_t size) const;
 };
 
-// Samples executable mappings within the process to look for sequences
-// of bytes which are commonly used in heap sprays. Specifically these
+// Scans executable mappings within the process for sequences of bytes
+// which are commonly used in heap sprays. Specifically these
 // are patterns which can be used simultaneously as addresses to pivot a
 // vtable, vtable entries, and effective no-op instructions.
 class ShellcodeSprayPattern : public CrashAnalyzerCheck {
  public:
   explicit ShellcodeSprayPattern(CrashAnalyzer* analyzer);
   virtual CrashAnalysisResult Run();
+
+  // Configures |scanner| to report the runs of kMatchCutoff or more
+  // consecutive dwords which repeat one of the spray patterns.
+  static void AddSprayPatterns(MemoryScanner* scanner);
+
+  // Adds the executable segments which the check scans to |snapshot|.
+  void RecordSegments(MemorySnapshot* snapshot);
+
+  // Runs the check on the executable regions of |snapshot|.
+  static CrashAnalysisResult RunOnSnapshot(const MemorySnapshot& snapshot);
+
  private:
-  bool SampleSegmentForRepeatedPatterns(
-      BYTE* ptr,
-      const std::vector<BYTE> patterns) const;
+  // Returns the executable segments which do not belong to a module.
+  std::vector<BYTE*> FindUnknownExecSegments() const;
 
   static const BYTE kOverlapingInstructions[];
-  static const size_t kNumSamples;
   static const size_t kMatchCutoff;
 };
 
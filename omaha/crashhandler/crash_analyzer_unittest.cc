@@ -14,6 +14,9 @@
 // ========================================================================
 
 #include "omaha/crashhandler/crash_analyzer.h"
+#include "omaha/base/file.h"
+#include "omaha/base/utils.h"
+#include "omaha/crashhandler/crash_analyzer_checks.h"
 #include "omaha/testing/unit_test.h"
 #include "third_party/breakpad/src/client/windows/crash_generation/client_info.h"
 
@@ -100,6 +103,26 @@ TEST(CrashAnalyzerTest, ShellcodeSprayPattern) {
   CleanupCrashAnalyzer(analyzer);
 }
 
+// The spray found in the process is found again in the recorded snapshot,
+// once it is read back from the file.
+TEST(CrashAnalyzerTest, ShellcodeSprayPattern_Snapshot) {
+  CrashAnalyzer* analyzer = InitializeCrashAnalyzer(L"ShellcodeSprayPattern");
+  MemorySnapshot snapshot;
+  analyzer->RecordSnapshot(&snapshot);
+  CleanupCrashAnalyzer(analyzer);
+  EXPECT_FALSE(snapshot.regions().empty());
+
+  const CString file_path(GetTempFilename(_T("mss")));
+  ASSERT_FALSE(file_path.IsEmpty());
+  EXPECT_HRESULT_SUCCEEDED(snapshot.WriteToFile(file_path));
+  MemorySnapshot read_snapshot;
+  EXPECT_HRESULT_SUCCEEDED(read_snapshot.ReadFromFile(file_path));
+  EXPECT_HRESULT_SUCCEEDED(File::Remove(file_path));
+
+  EXPECT_EQ(ANALYSIS_FOUND_SHELLCODE,
+            ShellcodeSprayPattern::RunOnSnapshot(read_snapshot));
+}
+
 TEST(CrashAnalyzerTest, ShellcodeJmpCallPop) {
   CrashAnalyzer* analyzer = InitializeCrashAnalyzer(L"ShellcodeJmpCallPop");
   EXPECT_EQ(ANALYSIS_FOUND_SHELLCODE,
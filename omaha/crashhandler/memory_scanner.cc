@@ -0,0 +1,253 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/crashhandler/memory_scanner.h"
+
+#include <algorithm>
+
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+namespace {
+
+void AppendBytes(const void* data, size_t size, std::vector<byte>* buffer) {
+  const byte* bytes = static_cast<const byte*>(data);
+  buffer->insert(buffer->end(), bytes, bytes + size);
+}
+
+// Copies |size| bytes at |*offset| and advances the offset. Returns false if
+// the buffer is too short.
+bool ReadBytes(const std::vector<byte>& buffer,
+               size_t* offset,
+               void* data,
+               size_t size) {
+  if (buffer.size() < *offset || buffer.size() - *offset < size) {
+    return false;
+  }
+  if (size) {
+    memcpy(data, &buffer[*offset], size);
+  }
+  *offset += size;
+  return true;
+}
+
+}  // namespace
+
+MemoryScanner::MemoryScanner()
+    : pointer_filter_(kFilterBits / 8, 0),
+      has_repeated_bytes_(false),
+      min_repeated_dwords_(1) {
+  memset(is_repeated_byte_, 0, sizeof(is_repeated_byte_));
+}
+
+void MemoryScanner::AddPointer(const void* pointer) {
+  const UINT_PTR value = reinterpret_cast<UINT_PTR>(pointer);
+  std::vector<UINT_PTR>::iterator it =
+      std::lower_bound(pointers_.begin(), pointers_.end(), value);
+  if (it != pointers_.end() && *it == value) {
+    return;
+  }
+  pointers_.insert(it, value);
+
+  const size_t index = FilterIndex(value);
+  pointer_filter_[index / 8] |= static_cast<BYTE>(1 << (index % 8));
+}
+
+void MemoryScanner::AddRepeatedByte(BYTE repeated_byte) {
+  is_repeated_byte_[repeated_byte] = true;
+  has_repeated_bytes_ = true;
+}
+
+void MemoryScanner::set_min_repeated_dwords(size_t min_dwords) {
+  ASSERT1(min_dwords > 0);
+  min_repeated_dwords_ = std::max(min_dwords, static_cast<size_t>(1));
+}
+
+size_t MemoryScanner::FilterIndex(UINT_PTR value) {
+#ifdef _WIN64
+  const uint32 folded = static_cast<uint32>(value ^ (value >> 32));
+#else
+  const uint32 folded = static_cast<uint32>(value);
+#endif
+  return ((folded * 2654435761U) >> 16) & (kFilterBits - 1);
+}
+
+bool MemoryScanner::IsPointer(UINT_PTR value) const {
+  const size_t index = FilterIndex(value);
+  if (!(pointer_filter_[index / 8] & (1 << (index % 8)))) {
+    return false;
+  }
+  return std::binary_search(pointers_.begin(), pointers_.end(), value);
+}
+
+// A run of N identical bytes contains N / 4 consecutive dwords made of that
+// byte, whatever the alignment of the run, so the runs are tracked per byte
+// and compared with the minimum when they end.
+size_t MemoryScanner::Scan(const BYTE* buffer,
+                           size_t size,
+                           std::vector<MemoryScanHit>* hits) const {
+  ASSERT1(hits);
+  if (!buffer || !size) {
+    return 0;
+  }
+
+  const size_t num_hits = hits->size();
+  const bool scan_pointers = !pointers_.empty();
+  const size_t min_run_length = min_repeated_dwords_ * sizeof(DWORD);
+  size_t run_start = 0;
+
+  for (size_t i = 0; i != size; ++i) {
+    if (scan_pointers && size - i >= sizeof(UINT_PTR)) {
+      UINT_PTR value = 0;
+      memcpy(&value, buffer + i, sizeof(value));
+      if (IsPointer(value)) {
+        MemoryScanHit hit = {MemoryScanHit::POINTER, i, sizeof(value), value};
+        hits->push_back(hit);
+      }
+    }
+
+    if (has_repeated_bytes_ && buffer[i] != buffer[run_start]) {
+      if (i - run_start >= min_run_length &&
+          is_repeated_byte_[buffer[run_start]]) {
+        MemoryScanHit hit = {MemoryScanHit::REPEATED_BYTE,
+                             run_start,
+                             i - run_start,
+                             buffer[run_start]};
+        hits->push_back(hit);
+      }
+      run_start = i;
+    }
+  }
+
+  if (has_repeated_bytes_ &&
+      size - run_start >= min_run_length &&
+      is_repeated_byte_[buffer[run_start]]) {
+    MemoryScanHit hit = {MemoryScanHit::REPEATED_BYTE,
+                         run_start,
+                         size - run_start,
+                         buffer[run_start]};
+    hits->push_back(hit);
+  }
+
+  return hits->size() - num_hits;
+}
+
+// 'OMSS' when read as bytes.
+const DWORD MemorySnapshot::kMagic = 0x53534D4F;
+const DWORD MemorySnapshot::kVersion = 1;
+
+void MemorySnapshot::AddRegion(uint64 base_address,
+                               DWORD protect,
+                               const BYTE* contents,
+                               size_t size) {
+  ASSERT1(contents || !size);
+  Region region;
+  region.base_address = base_address;
+  region.protect = protect;
+  region.contents.assign(contents, contents + size);
+  regions_.push_back(region);
+}
+
+HRESULT MemorySnapshot::ReadFromFile(const TCHAR* file_path) {
+  ASSERT1(file_path);
+
+  std::vector<byte> buffer;
+  HRESULT hr = ReadEntireFile(file_path, 0, &buffer);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[ReadEntireFile failed][%s][0x%x]"), file_path, hr));
+    return hr;
+  }
+
+  size_t offset = 0;
+  DWORD magic = 0;
+  DWORD version = 0;
+  DWORD num_regions = 0;
+  if (!ReadBytes(buffer, &offset, &magic, sizeof(magic)) ||
+      !ReadBytes(buffer, &offset, &version, sizeof(version)) ||
+      !ReadBytes(buffer, &offset, &num_regions, sizeof(num_regions)) ||
+      magic != kMagic ||
+      version != kVersion) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  std::vector<Region> regions;
+  for (DWORD i = 0; i != num_regions; ++i) {
+    Region region;
+    DWORD size = 0;
+    if (!ReadBytes(buffer, &offset, &region.base_address,
+                   sizeof(region.base_address)) ||
+        !ReadBytes(buffer, &offset, &region.protect, sizeof(region.protect)) ||
+        !ReadBytes(buffer, &offset, &size, sizeof(size)) ||
+        buffer.size() - offset < size) {
+      return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    region.contents.resize(size);
+    VERIFY1(ReadBytes(buffer, &offset,
+                      size ? &region.contents.front() : NULL, size));
+    regions.push_back(region);
+  }
+
+  if (offset != buffer.size()) {
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  regions_.swap(regions);
+  return S_OK;
+}
+
+HRESULT MemorySnapshot::WriteToFile(const TCHAR* file_path) const {
+  ASSERT1(file_path);
+
+  const DWORD num_regions = static_cast<DWORD>(regions_.size());
+  std::vector<byte> buffer;
+  AppendBytes(&kMagic, sizeof(kMagic), &buffer);
+  AppendBytes(&kVersion, sizeof(kVersion), &buffer);
+  AppendBytes(&num_regions, sizeof(num_regions), &buffer);
+  for (size_t i = 0; i != regions_.size(); ++i) {
+    const Region& region = regions_[i];
+    const DWORD size = static_cast<DWORD>(region.contents.size());
+    AppendBytes(&region.base_address, sizeof(region.base_address), &buffer);
+    AppendBytes(&region.protect, sizeof(region.protect), &buffer);
+    AppendBytes(&size, sizeof(size), &buffer);
+    if (size) {
+      AppendBytes(&region.contents.front(), size, &buffer);
+    }
+  }
+
+  return WriteEntireFile(file_path, buffer);
+}
+
+size_t MemorySnapshot::Scan(
+    const MemoryScanner& scanner,
+    std::vector<std::vector<MemoryScanHit> >* hits) const {
+  ASSERT1(hits);
+
+  size_t num_hits = 0;
+  hits->resize(regions_.size());
+  for (size_t i = 0; i != regions_.size(); ++i) {
+    const std::vector<BYTE>& contents = regions_[i].contents;
+    if (contents.empty()) {
+      continue;
+    }
+    num_hits += scanner.Scan(&contents.front(), contents.size(), &(*hits)[i]);
+  }
+  return num_hits;
+}
+
+}  // namespace omaha
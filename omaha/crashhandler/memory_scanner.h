@@ -0,0 +1,139 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Searches a memory segment for a set of pointer values and for runs of
+// repeated bytes in a single pass. The crash analyzer checks use it instead of
+// scanning the same segment once per value.
+//
+// MemorySnapshot holds memory regions that were recorded to a file, so that
+// the scans can be run and measured without a crashed process. The regions
+// are recorded by CrashAnalyzer::RecordSnapshot, and the stack and the spray
+// checks run on them with their RunOnSnapshot functions.
+
+#ifndef OMAHA_CRASHHANDLER_MEMORY_SCANNER_H_
+#define OMAHA_CRASHHANDLER_MEMORY_SCANNER_H_
+
+#include <windows.h>
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace omaha {
+
+struct MemoryScanHit {
+  enum Type {
+    POINTER,
+    REPEATED_BYTE,
+  };
+
+  Type type;
+
+  // Offset of the hit from the start of the scanned buffer.
+  size_t offset;
+
+  // The size of the pointer, or the length of the run of repeated bytes.
+  size_t length;
+
+  // The pointer value, or the repeated byte.
+  UINT_PTR value;
+};
+
+class MemoryScanner {
+ public:
+  MemoryScanner();
+
+  // Reports every byte offset at which |pointer| is stored, aligned or not.
+  void AddPointer(const void* pointer);
+
+  // Reports the runs of |repeated_byte| that contain at least the minimum
+  // number of consecutive dwords made of that byte. The minimum is shared by
+  // all the bytes and defaults to one dword.
+  void AddRepeatedByte(BYTE repeated_byte);
+  void set_min_repeated_dwords(size_t min_dwords);
+
+  // Scans the buffer and appends the hits to |hits|. The pointer hits are in
+  // the order of their offsets, and a run is reported once it ends. Returns
+  // the number of hits found.
+  size_t Scan(const BYTE* buffer,
+              size_t size,
+              std::vector<MemoryScanHit>* hits) const;
+
+ private:
+  // The pointers are hashed into a bitmap which rejects most offsets with a
+  // single lookup. The offsets which pass are searched in |pointers_|.
+  static const size_t kFilterBits = 1 << 16;
+
+  static size_t FilterIndex(UINT_PTR value);
+  bool IsPointer(UINT_PTR value) const;
+
+  // Sorted and unique.
+  std::vector<UINT_PTR> pointers_;
+  std::vector<BYTE> pointer_filter_;
+
+  bool is_repeated_byte_[256];
+  bool has_repeated_bytes_;
+  size_t min_repeated_dwords_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryScanner);
+};
+
+// The recorded memory regions of a process. The file starts with a header
+// followed by the regions. All the fields are little endian.
+//
+//   DWORD  magic ('OMSS')
+//   DWORD  version
+//   DWORD  number of regions
+//   for each region:
+//     uint64 base address
+//     DWORD  protection (PAGE_*)
+//     DWORD  size
+//     BYTE   contents[size]
+class MemorySnapshot {
+ public:
+  struct Region {
+    uint64 base_address;
+    DWORD protect;
+    std::vector<BYTE> contents;
+  };
+
+  MemorySnapshot() {}
+
+  void AddRegion(uint64 base_address,
+                 DWORD protect,
+                 const BYTE* contents,
+                 size_t size);
+
+  HRESULT ReadFromFile(const TCHAR* file_path);
+  HRESULT WriteToFile(const TCHAR* file_path) const;
+
+  // Scans each region and appends the hits to |hits|, one vector per region.
+  // Returns the total number of hits.
+  size_t Scan(const MemoryScanner& scanner,
+              std::vector<std::vector<MemoryScanHit> >* hits) const;
+
+  const std::vector<Region>& regions() const { return regions_; }
+
+ private:
+  static const DWORD kMagic;
+  static const DWORD kVersion;
+
+  std::vector<Region> regions_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemorySnapshot);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_CRASHHANDLER_MEMORY_SCANNER_H_
@@ -0,0 +1,289 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/utils.h"
+#include "omaha/crashhandler/crash_analyzer_checks.h"
+#include "omaha/crashhandler/memory_scanner.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+void StorePointer(const void* pointer, size_t offset, std::vector<BYTE>* data) {
+  ASSERT_LE(offset + sizeof(pointer), data->size());
+  memcpy(&(*data)[offset], &pointer, sizeof(pointer));
+}
+
+// Fills the buffer with bytes which neither repeat nor form the test pointers.
+std::vector<BYTE> MakeNoise(size_t size) {
+  std::vector<BYTE> data(size);
+  for (size_t i = 0; i != size; ++i) {
+    data[i] = static_cast<BYTE>(0x80 + i % 0x70);
+  }
+  return data;
+}
+
+// The values only need to look like pointers.
+const void* const kPointer1 = reinterpret_cast<const void*>(0x77a01234);
+const void* const kPointer2 = reinterpret_cast<const void*>(0x76b0cafe);
+
+}  // namespace
+
+TEST(MemoryScannerTest, Pointers) {
+  MemoryScanner scanner;
+  scanner.AddPointer(kPointer1);
+  scanner.AddPointer(kPointer2);
+  scanner.AddPointer(kPointer1);
+
+  std::vector<BYTE> data(MakeNoise(256));
+  StorePointer(kPointer2, 0, &data);
+  StorePointer(kPointer1, 13, &data);
+  StorePointer(kPointer1, data.size() - sizeof(kPointer1), &data);
+
+  std::vector<MemoryScanHit> hits;
+  EXPECT_EQ(3U, scanner.Scan(&data.front(), data.size(), &hits));
+  ASSERT_EQ(3U, hits.size());
+  EXPECT_EQ(MemoryScanHit::POINTER, hits[0].type);
+  EXPECT_EQ(0U, hits[0].offset);
+  EXPECT_EQ(reinterpret_cast<UINT_PTR>(kPointer2), hits[0].value);
+  EXPECT_EQ(13U, hits[1].offset);
+  EXPECT_EQ(reinterpret_cast<UINT_PTR>(kPointer1), hits[1].value);
+  EXPECT_EQ(data.size() - sizeof(kPointer1), hits[2].offset);
+  EXPECT_EQ(sizeof(kPointer1), hits[2].length);
+
+  // A pointer cut off by the end of the buffer is not reported.
+  hits.clear();
+  EXPECT_EQ(2U, scanner.Scan(&data.front(), data.size() - 1, &hits));
+}
+
+TEST(MemoryScannerTest, RepeatedBytes) {
+  MemoryScanner scanner;
+  scanner.AddRepeatedByte(0x0c);
+  scanner.AddRepeatedByte(0x41);
+  scanner.set_min_repeated_dwords(4);
+
+  std::vector<BYTE> data(MakeNoise(256));
+
+  // Long enough, at an unaligned offset.
+  memset(&data[3], 0x0c, 17);
+
+  // One byte too short.
+  memset(&data[40], 0x41, 15);
+
+  // Long enough, but not one of the bytes.
+  memset(&data[80], 0x90, 32);
+
+  // Long enough, at the end of the buffer.
+  memset(&data[data.size() - 16], 0x41, 16);
+
+  std::vector<MemoryScanHit> hits;
+  EXPECT_EQ(2U, scanner.Scan(&data.front(), data.size(), &hits));
+  ASSERT_EQ(2U, hits.size());
+  EXPECT_EQ(MemoryScanHit::REPEATED_BYTE, hits[0].type);
+  EXPECT_EQ(3U, hits[0].offset);
+  EXPECT_EQ(17U, hits[0].length);
+  EXPECT_EQ(0x0cU, hits[0].value);
+  EXPECT_EQ(data.size() - 16, hits[1].offset);
+  EXPECT_EQ(16U, hits[1].length);
+  EXPECT_EQ(0x41U, hits[1].value);
+}
+
+TEST(MemoryScannerTest, PointersAndRepeatedBytesInOnePass) {
+  MemoryScanner scanner;
+  scanner.AddPointer(kPointer1);
+  scanner.AddRepeatedByte(0x0c);
+  scanner.set_min_repeated_dwords(2);
+
+  std::vector<BYTE> data(MakeNoise(64));
+  memset(&data[8], 0x0c, 8);
+  StorePointer(kPointer1, 32, &data);
+
+  std::vector<MemoryScanHit> hits;
+  EXPECT_EQ(2U, scanner.Scan(&data.front(), data.size(), &hits));
+  ASSERT_EQ(2U, hits.size());
+  EXPECT_EQ(MemoryScanHit::REPEATED_BYTE, hits[0].type);
+  EXPECT_EQ(8U, hits[0].offset);
+  EXPECT_EQ(MemoryScanHit::POINTER, hits[1].type);
+  EXPECT_EQ(32U, hits[1].offset);
+}
+
+TEST(MemoryScannerTest, EmptyScanner) {
+  MemoryScanner scanner;
+  std::vector<BYTE> data(128, 0x0c);
+  std::vector<MemoryScanHit> hits;
+  EXPECT_EQ(0U, scanner.Scan(&data.front(), data.size(), &hits));
+  EXPECT_EQ(0U, scanner.Scan(NULL, 0, &hits));
+  EXPECT_TRUE(hits.empty());
+}
+
+TEST(MemorySnapshotTest, WriteAndRead) {
+  std::vector<BYTE> code(MakeNoise(4096));
+  memset(&code[1000], 0x0d, 400);
+  std::vector<BYTE> stack(MakeNoise(4096));
+  StorePointer(kPointer2, 2048, &stack);
+
+  MemorySnapshot snapshot;
+  snapshot.AddRegion(0x0d0d0000, PAGE_EXECUTE_READWRITE,
+                     &code.front(), code.size());
+  snapshot.AddRegion(0x0012e000, PAGE_READWRITE,
+                     &stack.front(), stack.size());
+  snapshot.AddRegion(0x7ffe0000, PAGE_READONLY, NULL, 0);
+
+  const CString file_path(GetTempFilename(_T("mss")));
+  ASSERT_FALSE(file_path.IsEmpty());
+  EXPECT_HRESULT_SUCCEEDED(snapshot.WriteToFile(file_path));
+
+  MemorySnapshot read_snapshot;
+  EXPECT_HRESULT_SUCCEEDED(read_snapshot.ReadFromFile(file_path));
+  ASSERT_EQ(3U, read_snapshot.regions().size());
+  EXPECT_EQ(0x0d0d0000U, read_snapshot.regions()[0].base_address);
+  EXPECT_EQ(static_cast<DWORD>(PAGE_EXECUTE_READWRITE),
+            read_snapshot.regions()[0].protect);
+  EXPECT_TRUE(code == read_snapshot.regions()[0].contents);
+  EXPECT_TRUE(stack == read_snapshot.regions()[1].contents);
+  EXPECT_TRUE(read_snapshot.regions()[2].contents.empty());
+
+  // The spray check and the stack check find their patterns in the regions
+  // which were read back.
+  MemoryScanner scanner;
+  ShellcodeSprayPattern::AddSprayPatterns(&scanner);
+  scanner.AddPointer(kPointer2);
+  std::vector<std::vector<MemoryScanHit> > hits;
+  EXPECT_EQ(2U, read_snapshot.Scan(scanner, &hits));
+  ASSERT_EQ(3U, hits.size());
+  ASSERT_EQ(1U, hits[0].size());
+  EXPECT_EQ(MemoryScanHit::REPEATED_BYTE, hits[0][0].type);
+  EXPECT_EQ(1000U, hits[0][0].offset);
+  ASSERT_EQ(1U, hits[1].size());
+  EXPECT_EQ(MemoryScanHit::POINTER, hits[1][0].type);
+  EXPECT_EQ(2048U, hits[1][0].offset);
+  EXPECT_TRUE(hits[2].empty());
+
+  EXPECT_HRESULT_SUCCEEDED(File::Remove(file_path));
+}
+
+// The stack check only scans the regions which are not executable, and the
+// spray check only the executable ones.
+TEST(MemorySnapshotTest, ChecksRunOnSnapshot) {
+  const void* heap_create = reinterpret_cast<const void*>(
+      ::GetProcAddress(::GetModuleHandle(_T("kernel32.dll")), "HeapCreate"));
+  ASSERT_TRUE(heap_create);
+
+  std::vector<BYTE> code(MakeNoise(4096));
+  memset(&code[1000], 0x0d, 400);
+  std::vector<BYTE> stack(MakeNoise(4096));
+  StorePointer(heap_create, 2048, &stack);
+
+  MemorySnapshot snapshot;
+  EXPECT_EQ(ANALYSIS_NORMAL, NtFunctionsOnStack::RunOnSnapshot(snapshot));
+  EXPECT_EQ(ANALYSIS_NORMAL, ShellcodeSprayPattern::RunOnSnapshot(snapshot));
+
+  snapshot.AddRegion(0x0d0d0000, PAGE_READWRITE, &code.front(), code.size());
+  snapshot.AddRegion(0x0012e000, PAGE_EXECUTE_READ,
+                     &stack.front(), stack.size());
+  EXPECT_EQ(ANALYSIS_NORMAL, NtFunctionsOnStack::RunOnSnapshot(snapshot));
+  EXPECT_EQ(ANALYSIS_NORMAL, ShellcodeSprayPattern::RunOnSnapshot(snapshot));
+
+  snapshot.AddRegion(0x0e0e0000, PAGE_EXECUTE_READWRITE,
+                     &code.front(), code.size());
+  snapshot.AddRegion(0x0022e000, PAGE_READWRITE,
+                     &stack.front(), stack.size());
+  EXPECT_EQ(ANALYSIS_NT_FUNC_STACK,
+            NtFunctionsOnStack::RunOnSnapshot(snapshot));
+  EXPECT_EQ(ANALYSIS_FOUND_SHELLCODE,
+            ShellcodeSprayPattern::RunOnSnapshot(snapshot));
+}
+
+TEST(MemorySnapshotTest, ReadInvalidFile) {
+  const CString file_path(GetTempFilename(_T("mss")));
+  ASSERT_FALSE(file_path.IsEmpty());
+
+  MemorySnapshot snapshot;
+  std::vector<byte> contents(12, 0);
+  EXPECT_HRESULT_SUCCEEDED(WriteEntireFile(file_path, contents));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            snapshot.ReadFromFile(file_path));
+
+  // A region which is larger than the rest of the file.
+  std::vector<BYTE> data(MakeNoise(64));
+  MemorySnapshot valid_snapshot;
+  valid_snapshot.AddRegion(0x10000, PAGE_READWRITE, &data.front(), data.size());
+  EXPECT_HRESULT_SUCCEEDED(valid_snapshot.WriteToFile(file_path));
+  EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(file_path, 0, &contents));
+  contents.pop_back();
+  EXPECT_HRESULT_SUCCEEDED(WriteEntireFile(file_path, contents));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            snapshot.ReadFromFile(file_path));
+  EXPECT_TRUE(snapshot.regions().empty());
+
+  EXPECT_HRESULT_SUCCEEDED(File::Remove(file_path));
+}
+
+// Compares one pass for all the functions of the stack check with the scan
+// per function which the check did before.
+TEST(MemoryScannerBenchmarkTest, DISABLED_StackScan) {
+  const size_t kStackSize = 1024 * 1024;
+  const size_t kNumFunctions = 8;
+  const int kIterations = 10;
+
+  std::vector<BYTE> stack(MakeNoise(kStackSize));
+  MemoryScanner scanner;
+  std::vector<const void*> functions;
+  for (size_t i = 0; i != kNumFunctions; ++i) {
+    functions.push_back(reinterpret_cast<const void*>(0x77a00000 + i * 0x100));
+    scanner.AddPointer(functions.back());
+  }
+  StorePointer(functions.back(), kStackSize / 2, &stack);
+
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kIterations; ++i) {
+    std::vector<MemoryScanHit> hits;
+    EXPECT_EQ(1U, scanner.Scan(&stack.front(), stack.size(), &hits));
+  }
+  const ULONGLONG single_pass_ticks =
+      HighresTimer::GetCurrentTicks() - start_ticks;
+
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kIterations; ++i) {
+    size_t matches = 0;
+    for (size_t f = 0; f != functions.size(); ++f) {
+      for (size_t offset = 0;
+           offset + sizeof(functions[f]) <= stack.size();
+           ++offset) {
+        const void* value = NULL;
+        memcpy(&value, &stack[offset], sizeof(value));
+        if (value == functions[f]) {
+          ++matches;
+        }
+      }
+    }
+    EXPECT_EQ(1U, matches);
+  }
+  const ULONGLONG per_function_ticks =
+      HighresTimer::GetCurrentTicks() - start_ticks;
+
+  const double ms_per_tick = 1000.0 / HighresTimer::GetTimerFrequency();
+  OPT_LOG(L1, (_T("[stack scan of %d bytes][single pass %f ms]")
+               _T("[per function %f ms]"),
+               static_cast<int>(kStackSize),
+               single_pass_ticks * ms_per_tick / kIterations,
+               per_function_ticks * ms_per_tick / kIterations));
+}
+
+}  // namespace omaha
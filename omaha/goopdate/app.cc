@@ -61,6 +61,9 @@ App::App(const GUID& app_guid, bool is_update, AppBundle* app_bundle)
       post_install_action_(POST_INSTALL_ACTION_DEFAULT),
       can_skip_signature_verification_(false),
       previous_total_download_bytes_(0),
+      written_download_bytes_(0),
+      written_download_progress_tick_(0),
+      download_progress_write_interval_ms_(kMinDownloadProgressWriteIntervalMs),
       num_bytes_downloaded_(0),
       source_url_index_(-1),
       state_cancelled_(STATE_ERROR) {
@@ -93,14 +96,14 @@ App::~App() {
 }
 
 STDMETHODIMP App::get_appId(BSTR* app_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(app_id);
   *app_id = GuidToString(app_guid_).AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP App::get_language(BSTR* language) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(language);
   *language = language_.AllocSysString();
   return S_OK;
@@ -113,7 +116,7 @@ STDMETHODIMP App::put_language(BSTR language) {
 }
 
 STDMETHODIMP App::get_ap(BSTR* ap) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(ap);
   *ap = ap_.AllocSysString();
   return S_OK;
@@ -126,7 +129,7 @@ STDMETHODIMP App::put_ap(BSTR ap) {
 }
 
 STDMETHODIMP App::get_pv(BSTR* pv) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(pv);
   *pv = pv_.AllocSysString();
   return S_OK;
@@ -139,7 +142,7 @@ STDMETHODIMP App::put_pv(BSTR pv) {
 }
 
 STDMETHODIMP App::get_ttToken(BSTR* tt_token) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(tt_token);
   *tt_token = tt_token_.AllocSysString();
   return S_OK;
@@ -152,7 +155,7 @@ STDMETHODIMP App::put_ttToken(BSTR tt_token) {
 }
 
 STDMETHODIMP App::get_iid(BSTR* iid) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(iid);
   *iid = GuidToString(iid_).AllocSysString();
   return S_OK;
@@ -164,7 +167,7 @@ STDMETHODIMP App::put_iid(BSTR iid) {
 }
 
 STDMETHODIMP App::get_brandCode(BSTR* brand_code) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(brand_code);
   *brand_code = brand_code_.AllocSysString();
   return S_OK;
@@ -177,7 +180,7 @@ STDMETHODIMP App::put_brandCode(BSTR brand_code) {
 }
 
 STDMETHODIMP App::get_clientId(BSTR* client_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(client_id);
   *client_id = client_id_.AllocSysString();
   return S_OK;
@@ -190,7 +193,7 @@ STDMETHODIMP App::put_clientId(BSTR client_id) {
 }
 
 STDMETHODIMP App::get_labels(BSTR* labels) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(labels);
   *labels = GetExperimentLabels().AllocSysString();
   return S_OK;
@@ -204,7 +207,7 @@ STDMETHODIMP App::put_labels(BSTR labels) {
 }
 
 STDMETHODIMP App::get_referralId(BSTR* referral_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(referral_id);
   *referral_id = referral_id_.AllocSysString();
   return S_OK;
@@ -217,14 +220,14 @@ STDMETHODIMP App::put_referralId(BSTR referral_id) {
 }
 
 STDMETHODIMP App::get_installTimeDiffSec(UINT* install_time_diff_sec) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(install_time_diff_sec);
   *install_time_diff_sec = install_time_diff_sec_;
   return S_OK;
 }
 
 STDMETHODIMP App::get_isEulaAccepted(VARIANT_BOOL* is_eula_accepted) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(is_eula_accepted);
   *is_eula_accepted = App::is_eula_accepted() ? VARIANT_TRUE : VARIANT_FALSE;
   return S_OK;
@@ -237,7 +240,7 @@ STDMETHODIMP App::put_isEulaAccepted(VARIANT_BOOL is_eula_accepted) {
 }
 
 STDMETHODIMP App::get_displayName(BSTR* display_name) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(display_name);
   *display_name = display_name_.AllocSysString();
   return S_OK;
@@ -250,7 +253,7 @@ STDMETHODIMP App::put_displayName(BSTR display_name) {
 }
 
 STDMETHODIMP App::get_browserType(UINT* browser_type) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(browser_type);
   *browser_type = browser_type_;
   return S_OK;
@@ -266,7 +269,7 @@ STDMETHODIMP App::put_browserType(UINT browser_type) {
 }
 
 STDMETHODIMP App::get_clientInstallData(BSTR* data) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(data);
   *data = client_install_data_.AllocSysString();
   return S_OK;
@@ -279,7 +282,7 @@ STDMETHODIMP App::put_clientInstallData(BSTR data) {
 }
 
 STDMETHODIMP App::get_serverInstallDataIndex(BSTR* index) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(index);
   *index = server_install_data_index_.AllocSysString();
   return S_OK;
@@ -292,7 +295,7 @@ STDMETHODIMP App::put_serverInstallDataIndex(BSTR index) {
 }
 
 STDMETHODIMP App::get_usageStatsEnable(UINT* usage_stats_enable) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(usage_stats_enable);
   *usage_stats_enable = usage_stats_enable_;
   return S_OK;
@@ -310,7 +313,7 @@ STDMETHODIMP App::put_usageStatsEnable(UINT usage_stats_enable) {
 // TODO(omaha3): Replace decisions based on state() with calls to AppState.
 // In this case, there should be a GetCurrentState() method on AppState.
 STDMETHODIMP App::get_currentState(IDispatch** current_state) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   CORE_LOG(L6, (_T("[App::get_currentState][0x%p]"), this));
   ASSERT1(current_state);
@@ -351,7 +354,9 @@ STDMETHODIMP App::get_currentState(IDispatch** current_state) {
                                &total_bytes_to_download,
                                &download_time_remaining_ms,
                                &next_download_retry_time);
-      if (SUCCEEDED(hr)) {
+      if (SUCCEEDED(hr) &&
+          ShouldWriteDownloadProgress(bytes_downloaded,
+                                      total_bytes_to_download)) {
         VERIFY1(SUCCEEDED(AppManager::Instance()->WriteDownloadProgress(
                 *this,
                 bytes_downloaded,
@@ -432,7 +437,7 @@ STDMETHODIMP App::get_currentState(IDispatch** current_state) {
 }
 
 STDMETHODIMP App::get_untrustedData(BSTR* data) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(data);
   *data = untrusted_data_.AllocSysString();
   return S_OK;
@@ -455,7 +460,7 @@ HRESULT App::GetDownloadProgress(uint64* bytes_downloaded,
                                  uint64* bytes_total,
                                  LONG* time_remaining_ms,
                                  uint64* next_retry_time) {
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(model()->IsLockedSharedByCaller());
 
   ASSERT1(bytes_downloaded);
   ASSERT1(bytes_total);
@@ -496,6 +501,7 @@ HRESULT App::GetDownloadProgress(uint64* bytes_downloaded,
 
   ASSERT1(*bytes_downloaded <= *bytes_total);
 
+  __mutexScope(progress_lock_);
   ASSERT1(previous_total_download_bytes_ == *bytes_total ||
           previous_total_download_bytes_ == 0);
   previous_total_download_bytes_ = *bytes_total;
@@ -503,9 +509,35 @@ HRESULT App::GetDownloadProgress(uint64* bytes_downloaded,
   return S_OK;
 }
 
+// The progress is written when it changes, at most once per
+// download_progress_write_interval_ms_, except that the end of the download is
+// always written.
+bool App::ShouldWriteDownloadProgress(uint64 bytes_downloaded,
+                                      uint64 bytes_total) {
+  ASSERT1(model()->IsLockedSharedByCaller());
+  __mutexScope(progress_lock_);
+
+  const DWORD now = ::GetTickCount();
+  const bool is_complete = bytes_downloaded == bytes_total;
+  if (written_download_progress_tick_ != 0) {
+    if (bytes_downloaded == written_download_bytes_) {
+      return false;
+    }
+    if (!is_complete &&
+        now - written_download_progress_tick_ <
+            static_cast<DWORD>(download_progress_write_interval_ms_)) {
+      return false;
+    }
+  }
+
+  written_download_bytes_ = bytes_downloaded;
+  written_download_progress_tick_ = now ? now : 1;
+  return true;
+}
+
 HRESULT App::GetInstallProgress(LONG* install_progress_percentage,
                                 LONG* install_time_remaining_ms) {
-  ASSERT1(model()->IsLockedByCaller());
+  ASSERT1(model()->IsLockedSharedByCaller());
 
   ASSERT1(install_progress_percentage);
   ASSERT1(install_time_remaining_ms);
@@ -539,32 +571,32 @@ HRESULT App::GetInstallProgress(LONG* install_progress_percentage,
 }
 
 AppBundle* App::app_bundle() {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_bundle_;
 }
 
 const AppBundle* App::app_bundle() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_bundle_;
 }
 
 AppVersion* App::current_version() {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return current_version_.get();
 }
 
 const AppVersion* App::current_version() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return current_version_.get();
 }
 
 AppVersion* App::next_version() {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return next_version_.get();
 }
 
 const AppVersion* App::next_version() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return next_version_.get();
 }
 
@@ -592,7 +624,7 @@ CString App::app_guid_string() const {
 }
 
 GUID App::app_guid() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_guid_;
 }
 
@@ -602,38 +634,38 @@ void App::set_app_guid(const GUID& app_guid) {
 }
 
 CString App::language() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return language_;
 }
 
 bool App::is_eula_accepted() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return is_eula_accepted_ == TRISTATE_TRUE;
 }
 
 CString App::display_name() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return display_name_;
 }
 
 CurrentState App::state() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_state_->state();
 }
 
 bool App::is_update() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(current_version_->version().IsEmpty() != is_update_);
   return is_update_;
 }
 
 bool App::is_bundled() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_bundle_->GetNumberOfApps() > 1;
 }
 
 bool App::has_update_available() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return has_update_available_;
 }
 
@@ -643,48 +675,48 @@ void App::set_has_update_available(bool has_update_available) {
 }
 
 GUID App::iid() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return iid_;
 }
 
 CString App::client_id() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return client_id_;
 }
 
 CString App::GetExperimentLabels() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return ExperimentLabels::ReadRegistry(app_bundle_->is_machine(),
                                         app_guid_string());
 }
 
 CString App::GetExperimentLabelsNoTimestamps() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return ExperimentLabels::RemoveTimestamps(GetExperimentLabels());
 }
 
 CString App::referral_id() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return referral_id_;
 }
 
 BrowserType App::browser_type() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return browser_type_;
 }
 
 Tristate App::usage_stats_enable() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return usage_stats_enable_;
 }
 
 CString App::client_install_data() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return client_install_data_;
 }
 
 CString App::server_install_data() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return server_install_data_;
 }
 
@@ -694,23 +726,23 @@ void App::set_server_install_data(const CString& server_install_data) {
 }
 
 CString App::brand_code() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return brand_code_;
 }
 
 // TODO(omaha): for better accuracy, compute the value when used.
 uint32 App::install_time_diff_sec() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return install_time_diff_sec_;
 }
 
 int App::day_of_install() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return day_of_install_;
 }
 
 int App::day_of_last_response() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return day_of_last_response_;
 }
 void App::set_day_of_last_response(int day_num) {
@@ -719,12 +751,12 @@ void App::set_day_of_last_response(int day_num) {
 }
 
 ActiveStates App::did_run() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return did_run_;
 }
 
 int App::days_since_last_active_ping() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return days_since_last_active_ping_;
 }
 
@@ -734,7 +766,7 @@ void App::set_days_since_last_active_ping(int days) {
 }
 
 int App::days_since_last_roll_call() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return days_since_last_roll_call_;
 }
 
@@ -744,7 +776,7 @@ void App::set_days_since_last_roll_call(int days) {
 }
 
 int App::day_of_last_activity() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return day_of_last_activity_;
 }
 
@@ -754,7 +786,7 @@ void App::set_day_of_last_activity(int day_num) {
 }
 
 int App::day_of_last_roll_call() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return day_of_last_roll_call_;
 }
 
@@ -764,27 +796,27 @@ void App::set_day_of_last_roll_call(int day_num) {
 }
 
 CString App::ping_freshness() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return ping_freshness_;
 }
 
 CString App::ap() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return ap_;
 }
 
 std::vector<StringPair> App::app_defined_attributes() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_defined_attributes_;
 }
 
 CString App::tt_token() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return tt_token_;
 }
 
 Cohort App::cohort() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return cohort_;
 }
 
@@ -794,52 +826,52 @@ void App::set_cohort(const Cohort& cohort) {
 }
 
 CString App::server_install_data_index() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return server_install_data_index_;
 }
 
 CString App::untrusted_data() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return untrusted_data_;
 }
 
 HRESULT App::error_code() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return error_context_.error_code;
 }
 
 ErrorContext App::error_context() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return error_context_;
 }
 
 int App::installer_result_code() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return installer_result_code_;
 }
 
 int App::installer_result_extra_code1() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return installer_result_extra_code1_;
 }
 
 const PingEventVector& App::ping_events() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return ping_events_;
 }
 
 AppVersion* App::working_version() {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return working_version_;
 }
 
 const AppVersion* App::working_version() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return working_version_;
 }
 
 bool App::can_skip_signature_verification() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return can_skip_signature_verification_;
 }
 
@@ -855,7 +887,7 @@ void App::set_external_updater_event(HANDLE event_handle) {
 }
 
 int App::source_url_index() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return source_url_index_;
 }
 
@@ -867,7 +899,7 @@ void App::set_source_url_index(int index) {
 
 
 CurrentState App::state_cancelled() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return state_cancelled_;
 }
 
@@ -911,7 +943,7 @@ void App::AddPingEvent(const PingEventPtr& ping_event) {
 }
 
 HRESULT App::CheckGroupPolicy() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   if (is_update_) {
     if (!ConfigManager::Instance()->CanUpdateApp(
@@ -938,7 +970,7 @@ HRESULT App::CheckGroupPolicy() const {
 }
 
 CString App::GetTargetVersionPrefix() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   return ConfigManager::GetTargetVersionPrefix(app_guid_);
 }
@@ -952,12 +984,12 @@ void App::UpdateNumBytesDownloaded(uint64 num_bytes) {
 }
 
 uint64 App::num_bytes_downloaded() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return num_bytes_downloaded_;
 }
 
 uint64 App::GetPackagesTotalSize() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   uint64 total_size = 0;
   const size_t num_packages = working_version_->GetNumberOfPackages();
@@ -977,7 +1009,7 @@ void App::SetCurrentTimeAs(TimeMetricType time_type) {
 
 int App::GetTimeDifferenceMs(TimeMetricType time_start_metric_type,
                              TimeMetricType time_end_metric_type) const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   uint64 start_time_ms = time_metrics_[time_start_metric_type];
   uint64 end_time_ms = time_metrics_[time_end_metric_type];
@@ -1002,7 +1034,7 @@ int App::GetUpdateCheckTimeMs() const {
 }
 
 int App::GetTimeSinceUpdateAvailable() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   if (time_metrics_[TIME_UPDATE_AVAILABLE] == 0 ||
       time_metrics_[TIME_CANCELLED] == 0) {
     return -1;
@@ -1011,7 +1043,7 @@ int App::GetTimeSinceUpdateAvailable() const {
 }
 
 int App::GetTimeSinceDownloadStart() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   if (time_metrics_[TIME_DOWNLOAD_START] == 0 ||
       time_metrics_[TIME_CANCELLED] == 0) {
     return -1;
@@ -1080,6 +1112,16 @@ void App::DownloadComplete() {
   app_state_->DownloadComplete(this);
 }
 
+void App::ApplyingDifferentialPatch() {
+  __mutexScope(model()->lock());
+  app_state_->ApplyingDifferentialPatch(this);
+}
+
+void App::Extracting() {
+  __mutexScope(model()->lock());
+  app_state_->Extracting(this);
+}
+
 void App::MarkReadyToInstall() {
   __mutexScope(model()->lock());
   app_state_->MarkReadyToInstall(this);
@@ -1213,7 +1255,7 @@ void App::SetInstallerResult(const InstallerResultInfo& result_info) {
 }
 
 CString App::GetInstallData() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   ASSERT1(state() >= STATE_UPDATE_AVAILABLE &&
           state() <= STATE_INSTALL_COMPLETE);
@@ -1255,12 +1297,12 @@ STDMETHODIMP AppWrapper::get_command(BSTR command_id, IDispatch** command) {
 
 // IApp.
 STDMETHODIMP AppWrapper::get_appId(BSTR* app_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_appId(app_id);
 }
 
 STDMETHODIMP AppWrapper::get_pv(BSTR* pv) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_pv(pv);
 }
 
@@ -1270,7 +1312,7 @@ STDMETHODIMP AppWrapper::put_pv(BSTR pv) {
 }
 
 STDMETHODIMP AppWrapper::get_language(BSTR* language) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_language(language);
 }
 
@@ -1280,7 +1322,7 @@ STDMETHODIMP AppWrapper::put_language(BSTR language) {
 }
 
 STDMETHODIMP AppWrapper::get_ap(BSTR* ap) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_ap(ap);
 }
 
@@ -1290,7 +1332,7 @@ STDMETHODIMP AppWrapper::put_ap(BSTR ap) {
 }
 
 STDMETHODIMP AppWrapper::get_ttToken(BSTR* tt_token) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_ttToken(tt_token);
 }
 
@@ -1300,7 +1342,7 @@ STDMETHODIMP AppWrapper::put_ttToken(BSTR tt_token) {
 }
 
 STDMETHODIMP AppWrapper::get_iid(BSTR* iid) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_iid(iid);
 }
 
@@ -1310,7 +1352,7 @@ STDMETHODIMP AppWrapper::put_iid(BSTR iid) {
 }
 
 STDMETHODIMP AppWrapper::get_brandCode(BSTR* brand_code) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_brandCode(brand_code);
 }
 
@@ -1320,7 +1362,7 @@ STDMETHODIMP AppWrapper::put_brandCode(BSTR brand_code) {
 }
 
 STDMETHODIMP AppWrapper::get_clientId(BSTR* client_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_clientId(client_id);
 }
 
@@ -1330,7 +1372,7 @@ STDMETHODIMP AppWrapper::put_clientId(BSTR client_id) {
 }
 
 STDMETHODIMP AppWrapper::get_labels(BSTR* labels) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_labels(labels);
 }
 
@@ -1340,7 +1382,7 @@ STDMETHODIMP AppWrapper::put_labels(BSTR labels) {
 }
 
 STDMETHODIMP AppWrapper::get_referralId(BSTR* referral_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_referralId(referral_id);
 }
 
@@ -1350,12 +1392,12 @@ STDMETHODIMP AppWrapper::put_referralId(BSTR referral_id) {
 }
 
 STDMETHODIMP AppWrapper::get_installTimeDiffSec(UINT* install_time_diff_sec) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_installTimeDiffSec(install_time_diff_sec);
 }
 
 STDMETHODIMP AppWrapper::get_isEulaAccepted(VARIANT_BOOL* is_eula_accepted) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_isEulaAccepted(is_eula_accepted);
 }
 
@@ -1365,7 +1407,7 @@ STDMETHODIMP AppWrapper::put_isEulaAccepted(VARIANT_BOOL is_eula_accepted) {
 }
 
 STDMETHODIMP AppWrapper::get_displayName(BSTR* display_name) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_displayName(display_name);
 }
 
@@ -1375,7 +1417,7 @@ STDMETHODIMP AppWrapper::put_displayName(BSTR display_name) {
 }
 
 STDMETHODIMP AppWrapper::get_browserType(UINT* browser_type) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_browserType(browser_type);
 }
 
@@ -1385,7 +1427,7 @@ STDMETHODIMP AppWrapper::put_browserType(UINT browser_type) {
 }
 
 STDMETHODIMP AppWrapper::get_clientInstallData(BSTR* data) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_clientInstallData(data);
 }
 
@@ -1395,7 +1437,7 @@ STDMETHODIMP AppWrapper::put_clientInstallData(BSTR data) {
 }
 
 STDMETHODIMP AppWrapper::get_serverInstallDataIndex(BSTR* index) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_serverInstallDataIndex(index);
 }
 
@@ -1405,7 +1447,7 @@ STDMETHODIMP AppWrapper::put_serverInstallDataIndex(BSTR index) {
 }
 
 STDMETHODIMP AppWrapper::get_untrustedData(BSTR* data) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_untrustedData(data);
 }
 
@@ -1415,7 +1457,7 @@ STDMETHODIMP AppWrapper::put_untrustedData(BSTR data) {
 }
 
 STDMETHODIMP AppWrapper::get_usageStatsEnable(UINT* usage_stats_enable) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_usageStatsEnable(usage_stats_enable);
 }
 
@@ -1425,7 +1467,7 @@ STDMETHODIMP AppWrapper::put_usageStatsEnable(UINT usage_stats_enable) {
 }
 
 STDMETHODIMP AppWrapper::get_currentState(IDispatch** current_state_disp) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_currentState(current_state_disp);
 }
 
@@ -1440,4 +1482,13 @@ void SetAppStateForUnitTest(App* app, fsm::AppState* state) {
   app->ChangeState(state);
 }
 
+// Sets how often app writes the download progress to the registry, so that
+// unit tests can check the throttling without waiting for the interval.
+void SetDownloadProgressWriteIntervalForUnitTest(App* app, int interval_ms) {
+  ASSERT1(app);
+  ASSERT1(interval_ms >= 0);
+  __mutexScope(app->progress_lock_);
+  app->download_progress_write_interval_ms_ = interval_ms;
+}
+
 }  // namespace omaha
@@ -30,6 +30,7 @@
 #include "goopdate/omaha3_idl.h"
 #include "omaha/base/browser_utils.h"
 #include "omaha/base/constants.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/common/app_registry_utils.h"
 #include "omaha/common/const_goopdate.h"
 #include "omaha/common/ping_event.h"
@@ -296,6 +297,14 @@ class App : public ModelObject {
   // Reports that all packages have been downloaded.
   void DownloadComplete();
 
+  // Reports that packages downloaded as differential patches are being
+  // reconstructed. Downloading() is called if a package is then downloaded
+  // in full.
+  void ApplyingDifferentialPatch();
+
+  // Reports that the packages which are archives are being extracted.
+  void Extracting();
+
   // Sets the app to Ready To install.
   void MarkReadyToInstall();
 
@@ -392,10 +401,18 @@ class App : public ModelObject {
   // Sets the app state for unit testing.
   friend void SetAppStateForUnitTest(App* app, fsm::AppState* state);
 
+  // Sets the download progress write interval for unit testing.
+  friend void SetDownloadProgressWriteIntervalForUnitTest(App* app,
+                                                          int interval_ms);
+
   HRESULT GetDownloadProgress(uint64* bytes_downloaded,
                               uint64* bytes_total,
                               LONG* time_remaining_ms,
                               uint64* next_retry_time);
+  // Returns whether the download progress should be written to the registry.
+  // Updates the last written progress if it should.
+  bool ShouldWriteDownloadProgress(uint64 bytes_downloaded,
+                                   uint64 bytes_total);
   HRESULT GetInstallProgress(LONG* install_progress_percentage,
                              LONG* install_time_remaining_ms);
 
@@ -507,8 +524,20 @@ class App : public ModelObject {
   // Should be released when this object is destroyed.
   scoped_event external_updater_event_;
 
+  // get_currentState() only holds the model lock shared, so the members it
+  // updates below are protected by this lock instead.
+  LLock progress_lock_;
+
   uint64 previous_total_download_bytes_;
 
+  // The download progress last written to the registry, and when. Clients
+  // poll the current state many times per second, so the writes are
+  // throttled to one per download_progress_write_interval_ms_, which is
+  // kMinDownloadProgressWriteIntervalMs except in unit tests.
+  uint64 written_download_bytes_;
+  DWORD written_download_progress_tick_;
+  int download_progress_write_interval_ms_;
+
   // Metrics values.
   uint64 num_bytes_downloaded_;
   uint64 time_metrics_[TIME_METRICS_MAX];
@@ -65,7 +65,7 @@ AppBundle::~AppBundle() {
   // Destruction of this object is not serialized. The lifetime of AppBundle
   // objects is controlled by the client and multiple objects can destruct at
   // the same time.
-  ASSERT1(!model()->IsLockedByCaller());
+  ASSERT1(!model()->IsLockedSharedByCaller());
 
   if (send_pings_) {
     HRESULT hr = SendPingEventsAsync();
@@ -96,7 +96,7 @@ ControllingPtr AppBundle::controlling_ptr() {
 }
 
 bool AppBundle::is_pending_non_blocking_call() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return user_work_item_ != NULL;
 }
 
@@ -108,14 +108,14 @@ void AppBundle::set_user_work_item(UserWorkItem* user_work_item) {
 }
 
 HANDLE AppBundle::impersonation_token() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return alt_impersonation_token_.GetHandle() ?
          alt_impersonation_token_.GetHandle() :
          impersonation_token_.GetHandle();
 }
 
 HANDLE AppBundle::primary_token() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return alt_primary_token_.GetHandle() ? alt_primary_token_.GetHandle() :
                                           primary_token_.GetHandle();
 }
@@ -167,12 +167,12 @@ HRESULT AppBundle::CaptureCallerPrimaryToken() {
 }
 
 size_t AppBundle::GetNumberOfApps() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return apps_.size();
 }
 
 App* AppBundle::GetApp(size_t index) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   if (index >= GetNumberOfApps()) {
     ASSERT1(false);
@@ -296,7 +296,7 @@ void AppBundle::SendPingEvents(internal::SendPingEventsParameters params) {
 // IAppBundle.
 STDMETHODIMP AppBundle::get_displayName(BSTR* display_name) {
   ASSERT1(display_name);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *display_name = display_name_.AllocSysString();
   return S_OK;
 }
@@ -309,7 +309,7 @@ STDMETHODIMP AppBundle::put_displayName(BSTR display_name) {
 
 STDMETHODIMP AppBundle::get_installSource(BSTR* install_source) {
   ASSERT1(install_source);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *install_source = install_source_.AllocSysString();
   return S_OK;
 }
@@ -322,7 +322,7 @@ STDMETHODIMP AppBundle::put_installSource(BSTR install_source) {
 
 STDMETHODIMP AppBundle::get_originURL(BSTR* origin_url) {
   ASSERT1(origin_url);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *origin_url = origin_url_.AllocSysString();
   return S_OK;
 }
@@ -335,7 +335,7 @@ STDMETHODIMP AppBundle::put_originURL(BSTR origin_url) {
 
 STDMETHODIMP AppBundle::get_offlineDirectory(BSTR* offline_dir) {
   ASSERT1(offline_dir);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *offline_dir = offline_dir_.AllocSysString();
   return S_OK;
 }
@@ -349,7 +349,7 @@ STDMETHODIMP AppBundle::put_offlineDirectory(BSTR offline_dir) {
 
 STDMETHODIMP AppBundle::get_sessionId(BSTR* session_id) {
   ASSERT1(session_id);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *session_id = session_id_.AllocSysString();
   return S_OK;
 }
@@ -362,7 +362,7 @@ STDMETHODIMP AppBundle::put_sessionId(BSTR session_id) {
 
 STDMETHODIMP AppBundle::get_sendPings(VARIANT_BOOL* send_pings) {
   ASSERT1(send_pings);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *send_pings = send_pings_ ? VARIANT_TRUE : VARIANT_FALSE;
   return S_OK;
 }
@@ -377,7 +377,7 @@ STDMETHODIMP AppBundle::put_sendPings(VARIANT_BOOL send_pings) {
 
 STDMETHODIMP AppBundle::get_priority(long* priority) {  // NOLINT
   ASSERT1(priority);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *priority = priority_;
   return S_OK;
 }
@@ -415,13 +415,13 @@ STDMETHODIMP AppBundle::put_parentHWND(ULONG_PTR hwnd) {
 }
 
 CString AppBundle::display_language() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return display_language_;
 }
 
 STDMETHODIMP AppBundle::get_displayLanguage(BSTR* language) {
   ASSERT1(language);
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   *language = display_language_.AllocSysString();
   return S_OK;
 }
@@ -441,12 +441,12 @@ STDMETHODIMP AppBundle::put_displayLanguage(BSTR language) {
 }
 
 bool AppBundle::is_machine() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return is_machine_;
 }
 
 bool AppBundle::is_auto_update() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return is_auto_update_;
 }
 
@@ -456,27 +456,27 @@ void AppBundle::set_is_auto_update(bool is_auto_update) {
 }
 
 bool AppBundle::is_offline_install() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return !offline_dir_.IsEmpty();
 }
 
 const CString& AppBundle::offline_dir() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return offline_dir_;
 }
 
 const CString& AppBundle::session_id() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return session_id_;
 }
 
 int AppBundle::priority() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return priority_;
 }
 
 ProxyAuthConfig AppBundle::GetProxyAuthConfig() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return ProxyAuthConfig(parent_hwnd_, display_name_);
 }
 
@@ -551,7 +551,7 @@ STDMETHODIMP AppBundle::createAllInstalledApps() {
 STDMETHODIMP AppBundle::get_Count(long* count) {  // NOLINT
   ASSERT1(count);
 
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   const size_t num_apps = apps_.size();
   if (num_apps > LONG_MAX) {
@@ -678,7 +678,7 @@ STDMETHODIMP AppBundle::isBusy(VARIANT_BOOL* is_busy) {
   CORE_LOG(L3, (_T("[AppBundle::isBusy][0x%p]"), this));
   ASSERT1(is_busy);
 
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   *is_busy = IsBusy() ? VARIANT_TRUE : VARIANT_FALSE;
   return S_OK;
@@ -753,7 +753,7 @@ void AppBundle::CompleteAsyncCall() {
 }
 
 bool AppBundle::IsBusy() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   const bool is_busy = app_bundle_state_->IsBusy();
   CORE_LOG(L3, (_T("[AppBundle::isBusy returned][0x%p][%u]"), this, is_busy));
   return is_busy;
@@ -784,7 +784,7 @@ AppBundleWrapper::~AppBundleWrapper() {
 //
 
 STDMETHODIMP AppBundleWrapper::get_displayName(BSTR* display_name) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_displayName(display_name);
 }
 
@@ -794,7 +794,7 @@ STDMETHODIMP AppBundleWrapper::put_displayName(BSTR display_name) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_installSource(BSTR* install_source) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_installSource(install_source);
 }
 
@@ -804,7 +804,7 @@ STDMETHODIMP AppBundleWrapper::put_installSource(BSTR install_source) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_originURL(BSTR* origin_url) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_originURL(origin_url);
 }
 
@@ -814,7 +814,7 @@ STDMETHODIMP AppBundleWrapper::put_originURL(BSTR origin_url) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_offlineDirectory(BSTR* offline_dir) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_offlineDirectory(offline_dir);
 }
 
@@ -824,7 +824,7 @@ STDMETHODIMP AppBundleWrapper::put_offlineDirectory(BSTR offline_dir) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_sessionId(BSTR* session_id) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_sessionId(session_id);
 }
 
@@ -834,7 +834,7 @@ STDMETHODIMP AppBundleWrapper::put_sessionId(BSTR session_id) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_sendPings(VARIANT_BOOL* send_pings) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_sendPings(send_pings);
 }
 
@@ -844,7 +844,7 @@ STDMETHODIMP AppBundleWrapper::put_sendPings(VARIANT_BOOL send_pings) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_priority(long* priority) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_priority(priority);
 }
 
@@ -868,7 +868,7 @@ STDMETHODIMP AppBundleWrapper::put_parentHWND(ULONG_PTR hwnd) {
 }
 
 STDMETHODIMP AppBundleWrapper::get_displayLanguage(BSTR* language) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_displayLanguage(language);
 }
 STDMETHODIMP AppBundleWrapper::put_displayLanguage(BSTR language) {
@@ -912,7 +912,7 @@ STDMETHODIMP AppBundleWrapper::createAllInstalledApps() {
 }
 
 STDMETHODIMP AppBundleWrapper::get_Count(long* count) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_Count(count);
 }
 
@@ -969,7 +969,7 @@ STDMETHODIMP AppBundleWrapper::resume() {
 }
 
 STDMETHODIMP AppBundleWrapper::isBusy(VARIANT_BOOL* is_busy) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->isBusy(is_busy);
 }
 
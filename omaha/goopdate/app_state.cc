@@ -75,6 +75,14 @@ void AppState::DownloadComplete(App* app) {
   HandleInvalidStateTransition(app, _T(__FUNCTION__));
 }
 
+void AppState::ApplyingDifferentialPatch(App* app) {
+  HandleInvalidStateTransition(app, _T(__FUNCTION__));
+}
+
+void AppState::Extracting(App* app) {
+  HandleInvalidStateTransition(app, _T(__FUNCTION__));
+}
+
 void AppState::MarkReadyToInstall(App* app) {
   HandleInvalidStateTransition(app, _T(__FUNCTION__));
 }
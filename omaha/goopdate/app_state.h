@@ -77,6 +77,10 @@ class AppState {
 
   virtual void DownloadComplete(App* app);
 
+  virtual void ApplyingDifferentialPatch(App* app);
+
+  virtual void Extracting(App* app);
+
   virtual void MarkReadyToInstall(App* app);
 
   virtual void QueueInstall(App* app);
@@ -16,6 +16,7 @@
 #include "omaha/goopdate/app_state_download_complete.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/logging.h"
+#include "omaha/goopdate/app_state_extracting.h"
 #include "omaha/goopdate/app_state_ready_to_install.h"
 #include "omaha/goopdate/model.h"
 
@@ -43,8 +44,15 @@ const PingEvent* AppStateDownloadComplete::CreatePingEvent(
   return new PingEvent(event_type, GetCompletionResult(*app), error_code, 0);
 }
 
-// TODO(omaha3): When extraction and differential updates are supported, this
-// method will need to be copied/moved/changed to handle branches in the flow.
+void AppStateDownloadComplete::Extracting(App* app) {
+  CORE_LOG(L3, (_T("[AppStateDownloadComplete::Extracting][0x%p]"), app));
+  ASSERT1(app);
+
+  ChangeState(app, new AppStateExtracting);
+}
+
+// The differential patches are applied before the download is complete, and
+// the apps without archives go to Ready To Install directly.
 void AppStateDownloadComplete::MarkReadyToInstall(App* app) {
   CORE_LOG(L3,
            (_T("[AppStateDownloadComplete::MarkReadyToInstall][0x%p]"), app));
@@ -31,6 +31,8 @@ class AppStateDownloadComplete : public AppState {
   virtual const PingEvent* CreatePingEvent(App* app,
                                            CurrentState previous_state) const;
 
+  virtual void Extracting(App* app);
+
   virtual void MarkReadyToInstall(App* app);
 
  private:
@@ -16,6 +16,7 @@
 #include "omaha/goopdate/app_state_downloading.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/logging.h"
+#include "omaha/goopdate/app_state_applying_differential_patch.h"
 #include "omaha/goopdate/app_state_download_complete.h"
 #include "omaha/goopdate/model.h"
 
@@ -49,6 +50,13 @@ void AppStateDownloading::DownloadComplete(App* app) {
   ChangeState(app, new AppStateDownloadComplete);
 }
 
+void AppStateDownloading::ApplyingDifferentialPatch(App* app) {
+  CORE_LOG(L3, (_T("[AppStateDownloading::ApplyingDifferentialPatch][%p]"),
+                app));
+  ASSERT1(app);
+  ChangeState(app, new AppStateApplyingDifferentialPatch);
+}
+
 }  // namespace fsm
 
 }  // namespace omaha
@@ -33,6 +33,8 @@ class AppStateDownloading : public AppState {
 
   virtual void DownloadComplete(App* app);
 
+  virtual void ApplyingDifferentialPatch(App* app);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(AppStateDownloading);
 };
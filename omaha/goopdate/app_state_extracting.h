@@ -0,0 +1,43 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#ifndef OMAHA_GOOPDATE_APP_STATE_EXTRACTING_H_
+#define OMAHA_GOOPDATE_APP_STATE_EXTRACTING_H_
+
+#include "base/basictypes.h"
+#include "omaha/goopdate/app_state.h"
+
+namespace omaha {
+
+namespace fsm {
+
+// The packages which are archives are extracted after they are downloaded and
+// verified, and before the app is ready to install.
+class AppStateExtracting : public AppState {
+ public:
+  AppStateExtracting();
+  virtual ~AppStateExtracting() {}
+
+  virtual void MarkReadyToInstall(App* app);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AppStateExtracting);
+};
+
+}  // namespace fsm
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_APP_STATE_EXTRACTING_H_
@@ -15,7 +15,12 @@
 
 #include <atlbase.h>
 #include <atlcom.h>
+#include <algorithm>
 #include "omaha/base/error.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/thread.h"
 #include "omaha/base/time.h"
 #include "omaha/common/const_goopdate.h"
 #include "omaha/common/const_group_policy.h"
@@ -23,6 +28,7 @@
 #include "omaha/common/update_request.h"
 #include "omaha/common/update_response.h"
 #include "omaha/goopdate/app_state_checking_for_update.h"
+#include "omaha/goopdate/app_state_downloading.h"
 #include "omaha/goopdate/app_state_installing.h"
 #include "omaha/goopdate/app_state_update_available.h"
 #include "omaha/goopdate/app_state_waiting_to_check_for_update.h"
@@ -53,6 +59,127 @@ const TCHAR* const kChromeClientStateKeyPathUser =
 const TCHAR* const kInstallPolicyApp2 = _T("Install") APP_ID2;
 const TCHAR* const kUpdatePolicyApp2 = _T("Update") APP_ID2;
 
+// Reports the progress of a download of |bytes_total| bytes to a package, in
+// chunks of |chunk_size| bytes, as fast as it can. If |lock_per_chunk| is
+// true, it takes the model lock for every chunk, as Package::OnProgress used
+// to do.
+class FakeDownload : public Runnable {
+ public:
+  FakeDownload(Package* package,
+               const Lockable& model_lock,
+               int bytes_total,
+               int chunk_size,
+               bool lock_per_chunk)
+      : package_(package),
+        model_lock_(model_lock),
+        bytes_total_(bytes_total),
+        chunk_size_(chunk_size),
+        lock_per_chunk_(lock_per_chunk),
+        elapsed_ms_(0) {}
+
+  virtual void Run() {
+    HighresTimer timer;
+    for (int bytes = 0; bytes < bytes_total_;) {
+      bytes = std::min(bytes + chunk_size_, bytes_total_);
+      if (lock_per_chunk_) {
+        __mutexScope(model_lock_);
+        package_->OnProgress(bytes, bytes_total_,
+                             WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+      } else {
+        package_->OnProgress(bytes, bytes_total_,
+                             WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+      }
+    }
+    elapsed_ms_ = timer.GetElapsedMs();
+  }
+
+  int num_chunks() const {
+    return (bytes_total_ + chunk_size_ - 1) / chunk_size_;
+  }
+  uint64 elapsed_ms() const { return elapsed_ms_; }
+
+ private:
+  Package* const package_;
+  const Lockable& model_lock_;
+  const int bytes_total_;
+  const int chunk_size_;
+  const bool lock_per_chunk_;
+  uint64 elapsed_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeDownload);
+};
+
+// Polls the current state of the app until stopped, optionally holding the
+// model lock exclusively as every poll did before the lock could be shared.
+// Records the latency of each poll in power of two microsecond buckets.
+class CurrentStateReader : public Runnable {
+ public:
+  static const int kNumBuckets = 20;
+
+  CurrentStateReader(App* app, bool exclusive, volatile LONG* stop)
+      : app_(app),
+        exclusive_(exclusive),
+        stop_(stop),
+        num_polls_(0),
+        num_failures_(0) {
+    std::fill(histogram_, histogram_ + kNumBuckets, 0);
+  }
+
+  virtual void Run() {
+    while (!::InterlockedCompareExchange(stop_, 0, 0)) {
+      const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+      HRESULT hr = S_OK;
+      if (exclusive_) {
+        __mutexScope(app_->model()->lock());
+        hr = Poll();
+      } else {
+        hr = Poll();
+      }
+      const ULONGLONG latency_us =
+          (HighresTimer::GetCurrentTicks() - start_ticks) * 1000000 /
+          HighresTimer::GetTimerFrequency();
+
+      int bucket = 0;
+      while (bucket < kNumBuckets - 1 && (1ull << bucket) <= latency_us) {
+        ++bucket;
+      }
+      ++histogram_[bucket];
+      ++num_polls_;
+      if (FAILED(hr)) {
+        ++num_failures_;
+      }
+    }
+  }
+
+  int num_polls() const { return num_polls_; }
+  int num_failures() const { return num_failures_; }
+  int histogram(int bucket) const { return histogram_[bucket]; }
+
+ private:
+  HRESULT Poll() {
+    CComPtr<IDispatch> current_state;
+    HRESULT hr = app_->get_currentState(&current_state);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    CComBSTR display_name;
+    hr = app_->get_displayName(&display_name);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    return app_->next_version()->version().IsEmpty() ? E_UNEXPECTED : S_OK;
+  }
+
+  App* const app_;
+  const bool exclusive_;
+  volatile LONG* const stop_;
+  int num_polls_;
+  int num_failures_;
+  int histogram_[kNumBuckets];
+
+  DISALLOW_COPY_AND_ASSIGN(CurrentStateReader);
+};
+
 }  // namespace
 
 class AppTest : public AppTestBaseWithRegistryOverride {
@@ -876,6 +1003,204 @@ TEST_F(AppInstallTest, InstallProgress_InvalidInstallerProgress) {
   EXPECT_EQ(100, local_percentage);
 }
 
+TEST_F(AppInstallTest, DownloadProgress_DoesNotWaitForModelLock) {
+  const int kPackageSize = 1024 * 1024;
+  FileHash hash;
+  hash.sha256 = _T("hash");
+  EXPECT_SUCCEEDED(
+      app_->next_version()->AddPackage(_T("package"), kPackageSize, hash));
+  Package* package = app_->next_version()->GetPackage(0);
+  ASSERT_TRUE(package);
+
+  FakeDownload download(package, app_->model()->lock(), kPackageSize,
+                        16 * 1024, false);
+  {
+    __mutexScope(app_->model()->lock());
+
+    Thread thread;
+    ASSERT_TRUE(thread.Start(&download));
+    EXPECT_TRUE(thread.WaitTillExit(5000));
+  }
+
+  EXPECT_EQ(static_cast<uint64>(kPackageSize), package->bytes_downloaded());
+  EXPECT_EQ(0, package->GetEstimatedRemainingDownloadTimeMs());
+}
+
+TEST_F(AppInstallTest, DownloadProgress_WritesToRegistryAreThrottled) {
+  const int kPackageSize = 1000;
+  FileHash hash;
+  hash.sha256 = _T("hash");
+  EXPECT_SUCCEEDED(
+      app_->next_version()->AddPackage(_T("package"), kPackageSize, hash));
+  Package* package = app_->next_version()->GetPackage(0);
+  ASSERT_TRUE(package);
+  SetAppStateForUnitTest(app_, new fsm::AppStateDownloading);
+
+  // An interval no test run can reach, so that nothing but the throttling
+  // decides which progress is written.
+  const int kLongWriteIntervalMs = 60 * 60 * 1000;
+  SetDownloadProgressWriteIntervalForUnitTest(app_, kLongWriteIntervalMs);
+
+  CComPtr<IDispatch> current_state;
+  package->OnProgress(100, kPackageSize,
+                      WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+  EXPECT_SUCCEEDED(app_->get_currentState(&current_state));
+  current_state.Release();
+
+  DWORD percentage = 0;
+  EXPECT_SUCCEEDED(RegKey::GetValue(kGuid1ClientStateKeyPathUser,
+                                    kRegValueDownloadProgressPercent,
+                                    &percentage));
+  EXPECT_EQ(10u, percentage);
+
+  // Polled again right away, the new progress is not written.
+  package->OnProgress(500, kPackageSize,
+                      WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+  EXPECT_SUCCEEDED(app_->get_currentState(&current_state));
+  current_state.Release();
+  EXPECT_SUCCEEDED(RegKey::GetValue(kGuid1ClientStateKeyPathUser,
+                                    kRegValueDownloadProgressPercent,
+                                    &percentage));
+  EXPECT_EQ(10u, percentage);
+
+  // Once the interval has elapsed, the pending progress is written.
+  SetDownloadProgressWriteIntervalForUnitTest(app_, 0);
+  EXPECT_SUCCEEDED(app_->get_currentState(&current_state));
+  current_state.Release();
+  EXPECT_SUCCEEDED(RegKey::GetValue(kGuid1ClientStateKeyPathUser,
+                                    kRegValueDownloadProgressPercent,
+                                    &percentage));
+  EXPECT_EQ(50u, percentage);
+
+  // The end of the download is written right away.
+  SetDownloadProgressWriteIntervalForUnitTest(app_, kLongWriteIntervalMs);
+  package->OnProgress(kPackageSize, kPackageSize,
+                      WINHTTP_CALLBACK_STATUS_READ_COMPLETE, NULL);
+  EXPECT_SUCCEEDED(app_->get_currentState(&current_state));
+  current_state.Release();
+  EXPECT_SUCCEEDED(RegKey::GetValue(kGuid1ClientStateKeyPathUser,
+                                    kRegValueDownloadProgressPercent,
+                                    &percentage));
+  EXPECT_EQ(100u, percentage);
+}
+
+// Downloads 256 MB in 16 KB chunks as fast as the progress notifications
+// allow, while the current state is polled, first with the model lock taken
+// for every chunk and then without it. A 1 Gbps link delivers about 7,600
+// such chunks per second. Logs the notification throughput and the time
+// the polls spent, including waiting for the model lock.
+TEST_F(AppInstallTest, DISABLED_DownloadProgress_LockContentionBenchmark) {
+  const int kPackageSize = 256 * 1024 * 1024;
+  const int kChunkSize = 16 * 1024;
+  const double kOneGbpsChunksPerSec = 1e9 / 8 / kChunkSize;
+
+  FileHash hash;
+  hash.sha256 = _T("hash");
+  EXPECT_SUCCEEDED(
+      app_->next_version()->AddPackage(_T("package"), kPackageSize, hash));
+  Package* package = app_->next_version()->GetPackage(0);
+  ASSERT_TRUE(package);
+  SetAppStateForUnitTest(app_, new fsm::AppStateDownloading);
+
+  for (int lock_per_chunk = 1; lock_per_chunk >= 0; --lock_per_chunk) {
+    package->OnRequestBegin();
+    FakeDownload download(package, app_->model()->lock(), kPackageSize,
+                          kChunkSize, lock_per_chunk != 0);
+
+    Thread thread;
+    ASSERT_TRUE(thread.Start(&download));
+
+    int num_polls = 0;
+    double total_poll_ms = 0;
+    double max_poll_ms = 0;
+    while (thread.Running()) {
+      const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+      CComPtr<IDispatch> current_state;
+      EXPECT_SUCCEEDED(app_->get_currentState(&current_state));
+      const double poll_ms = (HighresTimer::GetCurrentTicks() - start_ticks) *
+                             1000.0 / HighresTimer::GetTimerFrequency();
+      ++num_polls;
+      total_poll_ms += poll_ms;
+      max_poll_ms = std::max(max_poll_ms, poll_ms);
+    }
+    EXPECT_TRUE(thread.WaitTillExit(1000));
+    EXPECT_EQ(static_cast<uint64>(kPackageSize), package->bytes_downloaded());
+
+    const double chunks_per_sec =
+        download.num_chunks() * 1000.0 / (download.elapsed_ms() + 1);
+    OPT_LOG(L1, (_T("[%s][%f chunks/s][%f Gbps][%d polls][mean %f ms]")
+                 _T("[max %f ms]"),
+                 lock_per_chunk ? _T("lock per chunk") : _T("atomic progress"),
+                 chunks_per_sec, chunks_per_sec / kOneGbpsChunksPerSec,
+                 num_polls, total_poll_ms / std::max(num_polls, 1),
+                 max_poll_ms));
+  }
+}
+
+// Polls the current state from many threads while a download, which takes the
+// model lock exclusively for every chunk, is in progress. The readers first
+// hold the model lock exclusively, as all of them did before the lock could be
+// shared, then share it. Logs the latency histogram of the polls for both.
+TEST_F(AppInstallTest, DISABLED_CurrentState_ConcurrentReadersStressTest) {
+  const int kNumReaders = 16;
+  const int kPackageSize = 64 * 1024 * 1024;
+  const int kChunkSize = 16 * 1024;
+
+  FileHash hash;
+  hash.sha256 = _T("hash");
+  EXPECT_SUCCEEDED(
+      app_->next_version()->AddPackage(_T("package"), kPackageSize, hash));
+  app_->next_version()->set_version(_T("1.2.3.4"));
+  Package* package = app_->next_version()->GetPackage(0);
+  ASSERT_TRUE(package);
+  SetAppStateForUnitTest(app_, new fsm::AppStateDownloading);
+
+  for (int exclusive = 1; exclusive >= 0; --exclusive) {
+    package->OnRequestBegin();
+    FakeDownload download(package, app_->model()->lock(), kPackageSize,
+                          kChunkSize, true);
+
+    volatile LONG stop = 0;
+    scoped_ptr<CurrentStateReader> readers[kNumReaders];
+    Thread reader_threads[kNumReaders];
+    for (int i = 0; i < kNumReaders; ++i) {
+      readers[i].reset(new CurrentStateReader(app_, exclusive != 0, &stop));
+      ASSERT_TRUE(reader_threads[i].Start(readers[i].get()));
+    }
+
+    Thread download_thread;
+    ASSERT_TRUE(download_thread.Start(&download));
+    EXPECT_TRUE(download_thread.WaitTillExit(INFINITE));
+
+    ::InterlockedExchange(&stop, 1);
+    int histogram[CurrentStateReader::kNumBuckets] = {};
+    int num_polls = 0;
+    for (int i = 0; i < kNumReaders; ++i) {
+      EXPECT_TRUE(reader_threads[i].WaitTillExit(INFINITE));
+      EXPECT_EQ(0, readers[i]->num_failures());
+      num_polls += readers[i]->num_polls();
+      for (int j = 0; j < CurrentStateReader::kNumBuckets; ++j) {
+        histogram[j] += readers[i]->histogram(j);
+      }
+    }
+    EXPECT_EQ(static_cast<uint64>(kPackageSize), package->bytes_downloaded());
+    EXPECT_LT(0, num_polls);
+
+    const double chunks_per_sec =
+        download.num_chunks() * 1000.0 / (download.elapsed_ms() + 1);
+    CString buckets;
+    for (int j = 0; j < CurrentStateReader::kNumBuckets; ++j) {
+      if (histogram[j]) {
+        SafeCStringAppendFormat(&buckets, _T("[< %llu us: %d]"),
+                                1ull << j, histogram[j]);
+      }
+    }
+    OPT_LOG(L1, (_T("[%s][%d polls][download %f chunks/s]%s"),
+                 exclusive ? _T("exclusive readers") : _T("shared readers"),
+                 num_polls, chunks_per_sec, buckets));
+  }
+}
+
 // Tests the interface for accessing experiments labels.
 TEST_F(AppInstallTest, ExperimentLabels) {
   // Create a bundle of one app, set an experiment label for that app, and
@@ -41,7 +41,7 @@ AppVersion::~AppVersion() {
 }
 
 CString AppVersion::version() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return version_;
 }
 
@@ -51,12 +51,12 @@ void AppVersion::set_version(const CString& version) {
 }
 
 App* AppVersion::app() {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_;
 }
 
 const App* AppVersion::app() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_;
 }
 
@@ -68,7 +68,7 @@ const App* AppVersion::app() const {
 // InstallManager tests and other tests that need a manifest. This could
 // probably be solved through mocking too.
 const xml::InstallManifest* AppVersion::install_manifest() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return install_manifest_.get();
 }
 
@@ -79,7 +79,7 @@ void AppVersion::set_install_manifest(xml::InstallManifest* install_manifest) {
 }
 
 size_t AppVersion::GetNumberOfPackages() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return packages_.size();
 }
 
@@ -94,7 +94,7 @@ HRESULT AppVersion::AddPackage(const CString& filename,
 }
 
 Package* AppVersion::GetPackage(size_t index) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   if (index >= GetNumberOfPackages()) {
     ASSERT1(false);
@@ -105,7 +105,7 @@ Package* AppVersion::GetPackage(size_t index) {
 }
 
 const Package* AppVersion::GetPackage(size_t index) const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   if (index >= GetNumberOfPackages()) {
     ASSERT1(false);
@@ -116,7 +116,7 @@ const Package* AppVersion::GetPackage(size_t index) const {
 }
 
 const std::vector<CString>& AppVersion::download_base_urls() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(!download_base_urls_.empty());
   return download_base_urls_;
 }
@@ -128,16 +128,28 @@ HRESULT AppVersion::AddDownloadBaseUrl(const CString& base_url) {
   return S_OK;
 }
 
+const std::vector<CString>& AppVersion::diff_download_base_urls() const {
+  __mutexSharedScope(model()->lock());
+  return diff_download_base_urls_;
+}
+
+HRESULT AppVersion::AddDiffDownloadBaseUrl(const CString& base_url) {
+  __mutexScope(model()->lock());
+  ASSERT1(!base_url.IsEmpty());
+  diff_download_base_urls_.push_back(base_url);
+  return S_OK;
+}
+
 // IAppVersion.
 STDMETHODIMP AppVersion::get_version(BSTR* version) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(version);
   *version = version_.AllocSysString();
   return S_OK;
 }
 
 STDMETHODIMP AppVersion::get_packageCount(long* count) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
 
   const size_t num_packages = GetNumberOfPackages();
   if (num_packages > LONG_MAX) {
@@ -161,12 +173,12 @@ STDMETHODIMP AppVersion::get_package(long index, Package** package) {  // NOLINT
 }
 
 STDMETHODIMP AppVersionWrapper::get_version(BSTR* version) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_version(version);
 }
 
 STDMETHODIMP AppVersionWrapper::get_packageCount(long* count) {  // NOLINT
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_packageCount(count);
 }
 
@@ -73,6 +73,11 @@ class AppVersion : public ModelObject {
   // the order they are added.
   HRESULT AddDownloadBaseUrl(const CString& server_url);
 
+  // Returns the servers of the differential patches, which may be empty.
+  const std::vector<CString>& diff_download_base_urls() const;
+
+  HRESULT AddDiffDownloadBaseUrl(const CString& server_url);
+
  private:
 
   // product version "pv".
@@ -83,6 +88,7 @@ class AppVersion : public ModelObject {
   std::vector<Package*> packages_;
 
   std::vector<CString> download_base_urls_;
+  std::vector<CString> diff_download_base_urls_;
 
   App* app_;
 
@@ -28,6 +28,7 @@
 #include <algorithm>
 #include <vector>
 
+#include "omaha/base/binary_patch.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
@@ -35,14 +36,19 @@
 #include "omaha/base/path.h"
 #include "omaha/base/scoped_impersonation.h"
 #include "omaha/base/safe_format.h"
+#include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/base/thread_pool.h"
+#include "omaha/base/thread_pool_callback.h"
 #include "omaha/base/user_rights.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/common/const_goopdate.h"
+#include "omaha/goopdate/download_manager_internal.h"
 #include "omaha/goopdate/model.h"
 #include "omaha/goopdate/package_cache.h"
+#include "omaha/goopdate/package_extractor.h"
 #include "omaha/goopdate/server_resource.h"
 #include "omaha/goopdate/string_formatter.h"
 #include "omaha/goopdate/worker_metrics.h"
@@ -57,6 +63,23 @@ namespace omaha {
 
 namespace {
 
+// How long the thread pool waits for the downloads in progress when the
+// download manager is destroyed. DownloadApp does not return before its
+// downloads complete, therefore there is nothing to wait for normally.
+const int kThreadPoolShutdownDelayMs = 1000;
+
+// The number of threads which extract an archive. The archives with a single
+// xz block or a single solid 7z folder are extracted by one thread.
+const int kMaxExtractionThreads = 4;
+
+// Appended to the name of the directory an archive is extracted to, to name
+// the copy of the archive which is extracted.
+const TCHAR* const kArchiveCopySuffix = _T(".archive");
+
+// A differential patch is applied to the package of the installed version in
+// memory. Larger packages are downloaded in full instead.
+const uint32 kMaxPatchSourceSize = 128 * 1024 * 1024;
+
 // Creates and initializes an instance of the NetworkRequest for the
 // DownloadManager to use. Defines the fallback chain: BITS, WinHttp.
 HRESULT CreateNetworkRequest(NetworkRequest** network_request_ptr) {
@@ -120,6 +143,38 @@ HRESULT ValidateSize(const CString& file_path, uint64 expected_size) {
   return S_OK;
 }
 
+// Returns the error reported when a package cannot be cached. The hash of a
+// package may not match because the file does not have the expected size,
+// which is a more specific error.
+HRESULT GetCachingError(HRESULT hr,
+                        const CString& file_path,
+                        uint64 expected_size) {
+  ASSERT1(FAILED(hr));
+
+  if (hr != SIGS_E_INVALID_SIGNATURE) {
+    set_error_extra_code1(static_cast<int>(hr));
+    return GOOPDATEDOWNLOAD_E_CACHING_FAILED;
+  }
+
+  // TODO(omaha): It would be nice to detect that we downloaded a proxy
+  // page and tell the user this. It would be even better if we could
+  // display it; that would require a lot more plumbing.
+  HRESULT size_hr = ValidateSize(file_path, expected_size);
+  return FAILED(size_hr) ? size_hr : hr;
+}
+
+// Describes a package for the batch operations of the package cache.
+void BuildBatchEntry(const Package* package,
+                     PackageCache::BatchEntry* entry) {
+  ASSERT1(package);
+  ASSERT1(entry);
+
+  entry->app_id = package->app_version()->app()->app_guid_string();
+  entry->version = package->app_version()->version();
+  entry->package_name = package->filename();
+  entry->hash = package->expected_hash();
+}
+
 // Adds the corresponding EVENT_{INSTALL,UPDATE}_DOWNLOAD_FINISH ping events
 // for the |download_metrics| provided as a parameter.
 void AddDownloadMetricsPingEvents(
@@ -137,8 +192,109 @@ void AddDownloadMetricsPingEvents(
   }
 }
 
+// Writes the package reconstructed from a differential patch to a file.
+class FilePatchOutput : public BinaryPatchOutput {
+ public:
+  explicit FilePatchOutput(File* file) : file_(file) {}
+
+  virtual bool Write(const uint8* data, size_t size) {
+    uint32 bytes_written = 0;
+    return SUCCEEDED(file_->Write(data,
+                                  static_cast<uint32>(size),
+                                  &bytes_written)) &&
+           bytes_written == size;
+  }
+
+ private:
+  File* file_;
+
+  DISALLOW_COPY_AND_ASSIGN(FilePatchOutput);
+};
+
 }  // namespace
 
+namespace internal {
+
+ConnectionBudget::ConnectionBudget(int max_connections)
+    : max_connections_(max_connections) {
+  ASSERT1(max_connections > 0);
+  reset(semaphore_,
+        ::CreateSemaphore(NULL, max_connections, max_connections, NULL));
+  ASSERT1(semaphore_);
+}
+
+ConnectionBudget::~ConnectionBudget() {
+}
+
+HRESULT ConnectionBudget::Acquire(HANDLE cancel_event) {
+  ASSERT1(cancel_event);
+
+  // Downloads are not throttled if the semaphore could not be created.
+  if (!semaphore_) {
+    return S_OK;
+  }
+
+  HANDLE handles[] = { cancel_event, get(semaphore_) };
+  const DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                                handles,
+                                                false,
+                                                INFINITE);
+  switch (result) {
+    case WAIT_OBJECT_0:
+      return GOOPDATE_E_CANCELLED;
+    case WAIT_OBJECT_0 + 1:
+      return S_OK;
+    default:
+      return HRESULTFromLastError();
+  }
+}
+
+bool ConnectionBudget::TryAcquire() {
+  return !semaphore_ || ::WaitForSingleObject(get(semaphore_), 0) ==
+                        WAIT_OBJECT_0;
+}
+
+void ConnectionBudget::Release() {
+  if (semaphore_) {
+    VERIFY1(::ReleaseSemaphore(get(semaphore_), 1, NULL));
+  }
+}
+
+RacingProgressCallback::RacingProgressCallback(
+    NetworkRequestCallback* callback)
+    : callback_(callback), has_begun_(false), max_bytes_(0) {
+  ASSERT1(callback);
+}
+
+RacingProgressCallback::~RacingProgressCallback() {
+}
+
+void RacingProgressCallback::OnRequestBegin() {
+  __mutexScope(lock_);
+  if (!has_begun_) {
+    has_begun_ = true;
+    callback_->OnRequestBegin();
+  }
+}
+
+void RacingProgressCallback::OnProgress(int bytes,
+                                        int bytes_total,
+                                        int status,
+                                        const TCHAR* status_text) {
+  __mutexScope(lock_);
+  if (bytes >= max_bytes_) {
+    max_bytes_ = bytes;
+    callback_->OnProgress(bytes, bytes_total, status, status_text);
+  }
+}
+
+void RacingProgressCallback::OnRequestRetryScheduled(time64 next_retry_time) {
+  __mutexScope(lock_);
+  callback_->OnRequestRetryScheduled(next_retry_time);
+}
+
+}  // namespace internal
+
 DownloadManager::DownloadManager(bool is_machine)
     : lock_(NULL), is_machine_(false) {
   CORE_LOG(L3, (_T("[DownloadManager::DownloadManager]")));
@@ -163,6 +319,9 @@ DownloadManager::~DownloadManager() {
   CORE_LOG(L3, (_T("[DownloadManager::~DownloadManager]")));
 
   ASSERT1(!IsBusy());
+  ASSERT1(connection_budgets_.empty());
+
+  thread_pool_.reset();
 
   delete &lock();
   omaha::interlocked_exchange_pointer(&lock_, static_cast<Lockable*>(NULL));
@@ -204,6 +363,20 @@ HRESULT DownloadManager::Initialize() {
     CORE_LOG(LW, (_T("[PurgeOldPackagesIfNecessary failed][0x%08x]"), hr));
   }
 
+  hr = package_cache()->ReverifyCachedPackages();
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[ReverifyCachedPackages failed][0x%08x]"), hr));
+  }
+
+  scoped_ptr<ThreadPool> thread_pool(new ThreadPool);
+  hr = thread_pool->Initialize(kThreadPoolShutdownDelayMs);
+  if (FAILED(hr)) {
+    // The packages are downloaded one at a time without the thread pool.
+    CORE_LOG(LW, (_T("[thread_pool->Initialize failed][0x%08x]"), hr));
+  } else {
+    thread_pool_.reset(thread_pool.release());
+  }
+
   return S_OK;
 }
 
@@ -249,7 +422,6 @@ HRESULT DownloadManager::DownloadApp(App* app) {
   // TODO(omaha3): Could be a problem if we allow installers to request more
   // packages (http://b/1969071), but we will have lots of other problems then.
   AppVersion* app_version = app->working_version();
-  const size_t num_packages = app_version->GetNumberOfPackages();
 
   State* state = NULL;
   HRESULT hr = CreateStateForApp(app, &state);
@@ -260,23 +432,30 @@ HRESULT DownloadManager::DownloadApp(App* app) {
 
   app->Downloading();
 
-  CString message;
-  hr = S_OK;
-
-  for (size_t i = 0; i < num_packages; ++i) {
-    Package* package(app_version->GetPackage(i));
-    hr = DoDownloadPackage(package, state);
-    if (FAILED(hr)) {
-      CORE_LOG(LE, (_T("[DoDownloadPackage failed][%s][%s][0x%08x][%Iu]"),
-                    app->display_name(), package->filename(), hr, i));
-      message = GetMessageForError(ErrorContext(hr, error_extra_code1()),
-                                   app->app_bundle()->display_language());
-      break;
-    }
+  // The packages which are already cached are verified in one batch, so that
+  // they are not hashed one at a time before they would be downloaded.
+  std::vector<const Package*> packages;
+  for (size_t i = 0; i != app_version->GetNumberOfPackages(); ++i) {
+    packages.push_back(app_version->GetPackage(i));
   }
+  std::vector<const Package*> unavailable_packages;
+  GetUnavailablePackages(packages, &unavailable_packages);
 
+  CString message;
+  hr = DoDownloadPackages(app_version, state);
+  if (SUCCEEDED(hr)) {
+    hr = DoApplyPatches(state);
+  }
   if (SUCCEEDED(hr)) {
     app->DownloadComplete();
+    hr = DoCheckArchives(app_version, state);
+  }
+  if (FAILED(hr)) {
+    message = GetMessageForError(ErrorContext(hr, error_extra_code1()),
+                                 app->app_bundle()->display_language());
+  }
+
+  if (SUCCEEDED(hr)) {
     app->MarkReadyToInstall();
   } else {
     app->Error(ErrorContext(hr, error_extra_code1()), message);
@@ -291,6 +470,113 @@ HRESULT DownloadManager::DownloadApp(App* app) {
   return hr;
 }
 
+HRESULT DownloadManager::DoDownloadPackages(AppVersion* app_version,
+                                            State* state) {
+  ASSERT1(app_version);
+  ASSERT1(state);
+
+  App* app = state->app();
+  const size_t num_packages = app_version->GetNumberOfPackages();
+
+  if (num_packages < 2 ||
+      !thread_pool_.get() ||
+      state->connection_budget()->max_connections() < 2) {
+    for (size_t i = 0; i < num_packages; ++i) {
+      Package* package(app_version->GetPackage(i));
+      HRESULT hr = DoDownloadPackage(package, state);
+      if (FAILED(hr)) {
+        CORE_LOG(LE, (_T("[DoDownloadPackage failed][%s][%s][0x%08x][%Iu]"),
+                      app->display_name(), package->filename(), hr, i));
+        return hr;
+      }
+    }
+    return S_OK;
+  }
+
+  // Each package is downloaded by a thread pool thread. The connection budget
+  // of the bundle limits how many of these threads are downloading at a time.
+  scoped_array<PackageDownload> package_downloads(
+      new PackageDownload[num_packages]);
+  for (size_t i = 0; i < num_packages; ++i) {
+    PackageDownload* package_download = &package_downloads[i];
+    package_download->package = app_version->GetPackage(i);
+    package_download->state = state;
+    package_download->impersonation_token =
+        app->app_bundle()->impersonation_token();
+
+    reset(package_download->complete_event,
+          ::CreateEvent(NULL, true, false, NULL));
+    HRESULT hr = package_download->complete_event ? S_OK :
+                                                    HRESULTFromLastError();
+    if (SUCCEEDED(hr)) {
+      scoped_ptr<UserWorkItem> work_item(
+          new ThreadPoolCallBack1<DownloadManager, PackageDownload*>(
+              this,
+              &DownloadManager::DoDownloadPackageAsync,
+              package_download));
+      hr = thread_pool_->QueueUserWorkItem(work_item.get(),
+                                           COINIT_MULTITHREADED,
+                                           WT_EXECUTELONGFUNCTION);
+      if (SUCCEEDED(hr)) {
+        work_item.release();
+        continue;
+      }
+    }
+
+    // The package is downloaded by the calling thread instead.
+    CORE_LOG(LW, (_T("[failed to queue package download][0x%08x][%Iu]"),
+                  hr, i));
+    package_download->result =
+        DoDownloadPackage(package_download->package, state);
+    if (package_download->complete_event) {
+      VERIFY1(::SetEvent(get(package_download->complete_event)));
+    }
+  }
+
+  for (size_t i = 0; i < num_packages; ++i) {
+    if (package_downloads[i].complete_event) {
+      VERIFY1(::WaitForSingleObject(get(package_downloads[i].complete_event),
+                                    INFINITE) == WAIT_OBJECT_0);
+    }
+  }
+
+  // The packages canceled because another package failed do not hide the
+  // error which caused the cancellation.
+  HRESULT hr = S_OK;
+  for (size_t i = 0; i < num_packages; ++i) {
+    const HRESULT package_hr = package_downloads[i].result;
+    if (FAILED(package_hr)) {
+      CORE_LOG(LE, (_T("[DoDownloadPackage failed][%s][%s][0x%08x][%Iu]"),
+                    app->display_name(),
+                    package_downloads[i].package->filename(),
+                    package_hr,
+                    i));
+      if (SUCCEEDED(hr) ||
+          (hr == GOOPDATE_E_CANCELLED && package_hr != GOOPDATE_E_CANCELLED)) {
+        hr = package_hr;
+      }
+    }
+  }
+
+  return hr;
+}
+
+void DownloadManager::DoDownloadPackageAsync(
+    PackageDownload* package_download) {
+  ASSERT1(package_download);
+
+  scoped_impersonation impersonate_user(package_download->impersonation_token);
+
+  State* state = package_download->state;
+  package_download->result = DoDownloadPackage(package_download->package,
+                                               state);
+  if (FAILED(package_download->result)) {
+    VERIFY1(SUCCEEDED(state->CancelNetworkRequests()));
+  }
+
+  VERIFY1(::SetEvent(get(package_download->complete_event)));
+}
+
 HRESULT DownloadManager::GetPackage(const Package* package,
                                     const CString& dir) const {
   const CString app_id(package->app_version()->app()->app_guid_string());
@@ -301,6 +587,21 @@ HRESULT DownloadManager::GetPackage(const Package* package,
 
   CORE_LOG(L3, (_T("[DownloadManager::GetPackage][%s]"), key.ToString()));
 
+  // The members of an archive are copied instead of the archive. They are
+  // extracted from the verified copy in the cache into |dir| when the app is
+  // installed, so that no file outside of the cache and |dir| can replace
+  // them.
+  if (package->archive_format() != ARCHIVE_FORMAT_NONE) {
+    HRESULT hr = ExtractCachedPackage(package, dir);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to extract package][0x%08x]"), hr));
+      ++metric_worker_download_archive_failed;
+      return hr;
+    }
+    ++metric_worker_download_archive_extracted;
+    return S_OK;
+  }
+
   const CString dest_file(ConcatenatePath(dir, package_name));
   CORE_LOG(L3, (_T("[destination file is '%s']"), dest_file));
 
@@ -353,6 +654,9 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
   OPT_LOG(L3, (_T("[DownloadManager::DoDownloadPackage][%s]"),
       key.ToString()));
 
+  // True if a differential patch was downloaded instead of the package.
+  bool is_patch = false;
+
   if (!package_cache()->IsCached(key, package->expected_hash())) {
     CORE_LOG(L3, (_T("[The package is not cached]")));
 
@@ -372,46 +676,96 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
       return GOOPDATE_E_CANNOT_USE_NETWORK;
     }
 
-    CString unique_filename_path;
-    HRESULT hr = BuildUniqueFileName(package_name, &unique_filename_path);
-    if (FAILED(hr)) {
-      CORE_LOG(LE, (_T("[BuildUniqueFileName failed][0x%08x]"), hr));
-      return hr;
-    }
-
-    NetworkRequest* network_request = state->network_request();
-
-    network_request->set_callback(package);
-
     const std::vector<CString> download_base_urls(
         package->app_version()->download_base_urls());
 
-    hr = E_FAIL;
-    app->SetCurrentTimeAs(App::TIME_DOWNLOAD_START);
+    // The urls which can't be built are left empty, so that the index of a url
+    // is the index of its base url.
+    std::vector<CString> urls(download_base_urls.size());
     for (size_t i = 0; i != download_base_urls.size(); ++i) {
-      CString url;
       DWORD url_length(INTERNET_MAX_URL_LENGTH);
-      hr = ::UrlCombine(download_base_urls[i],
-                        package_name,
-                        CStrBuf(url, INTERNET_MAX_URL_LENGTH),
-                        &url_length,
-                        0);
+      HRESULT hr = ::UrlCombine(download_base_urls[i],
+                                package_name,
+                                CStrBuf(urls[i], INTERNET_MAX_URL_LENGTH),
+                                &url_length,
+                                0);
       if (FAILED(hr)) {
+        CORE_LOG(LW, (_T("[UrlCombine failed][0x%08x][%s]"),
+                      hr, download_base_urls[i]));
+        urls[i].Empty();
         continue;
       }
 
-      ASSERT1(static_cast<DWORD>(url.GetLength()) == url_length);
+      ASSERT1(static_cast<DWORD>(urls[i].GetLength()) == url_length);
+    }
+
+    HRESULT hr = E_FAIL;
+    size_t num_urls_tried = 0;
+    app->SetCurrentTimeAs(App::TIME_DOWNLOAD_START);
+
+    // The package is cached once the patch is applied. If the patch can't be
+    // downloaded, the package is downloaded in full.
+    if (CanDownloadPatch(package)) {
+      hr = DoDownloadPatch(package, state);
+      is_patch = SUCCEEDED(hr);
+      if (FAILED(hr) && hr != GOOPDATE_E_CANCELLED) {
+        OPT_LOG(LW, (_T("[DoDownloadPatch failed][0x%08x]"), hr));
+        ++metric_worker_download_diff_failed;
+        package->ClearDiffInfo();
+        hr = E_FAIL;
+      }
+    }
 
-      hr = DoDownloadPackageFromUrl(url, unique_filename_path, package, state);
-      AddDownloadMetricsPingEvents(network_request->download_metrics(), app);
+    const int hedge_delay_ms = cm.GetDownloadHedgeDelayMs();
+    if (FAILED(hr) &&
+        hr != GOOPDATE_E_CANCELLED &&
+        hedge_delay_ms > 0 &&
+        thread_pool_.get() &&
+        urls.size() >= 2 &&
+        !urls[0].IsEmpty() &&
+        !urls[1].IsEmpty()) {
+      size_t url_index = 0;
+      hr = DoDownloadPackageHedged(urls,
+                                   hedge_delay_ms,
+                                   package,
+                                   state,
+                                   &num_urls_tried,
+                                   &url_index);
       if (SUCCEEDED(hr)) {
-        app->set_source_url_index(static_cast<int>(i));
+        app->set_source_url_index(static_cast<int>(url_index));
+      }
+    }
+
+    for (size_t i = num_urls_tried;
+         FAILED(hr) && hr != GOOPDATE_E_CANCELLED && i != urls.size();
+         ++i) {
+      if (urls[i].IsEmpty()) {
+        continue;
+      }
+
+      Transfer transfer;
+      hr = InitializeTransfer(package, state, urls[i], i, package, &transfer);
+      if (FAILED(hr)) {
+        CORE_LOG(LE, (_T("[InitializeTransfer failed][0x%08x]"), hr));
         break;
       }
+
+      hr = state->connection_budget()->Acquire(state->cancel_event());
+      if (SUCCEEDED(hr)) {
+        hr = DoDownloadPackageFromUrl(urls[i],
+                                      transfer.filename,
+                                      package,
+                                      transfer.network_request);
+        state->connection_budget()->Release();
+      }
+
+      transfer.result = hr;
+      CompleteTransfer(&transfer);
+      if (SUCCEEDED(hr)) {
+        app->set_source_url_index(static_cast<int>(i));
+      }
     }
 
-    VERIFY1(SUCCEEDED(network_request->Close()));
-    DeleteBeforeOrAfterReboot(unique_filename_path);
     app->SetCurrentTimeAs(App::TIME_DOWNLOAD_COMPLETE);
 
     if (FAILED(hr)) {
@@ -420,7 +774,8 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
     }
 
     // Assumes that downloaded bytes equal to the expected package size.
-    app->UpdateNumBytesDownloaded(package->expected_size());
+    app->UpdateNumBytesDownloaded(is_patch ? package->diff_expected_size() :
+                                             package->expected_size());
   } else {
     OPT_LOG(L3, (_T("[package is cached]")));
 
@@ -432,22 +787,535 @@ HRESULT DownloadManager::DoDownloadPackage(Package* package, State* state) {
     // final size. See the TODO in the unit tests.
   }
 
-  ASSERT1(package_cache()->IsCached(key, package->expected_hash()));
+  ASSERT1(is_patch || package_cache()->IsCached(key, package->expected_hash()));
+  return S_OK;
+}
+
+bool DownloadManager::CanDownloadPatch(const Package* package) const {
+  ASSERT1(package);
+
+  const AppVersion* app_version = package->app_version();
+  const App* app = app_version->app();
+  if (!package->has_diff() ||
+      !app->is_update() ||
+      app->current_version()->version().IsEmpty() ||
+      app_version->diff_download_base_urls().empty()) {
+    return false;
+  }
+
+  // The package of the installed version may have been purged from the cache
+  // since it was installed.
+  const PackageCache::Key old_key(app->app_guid_string(),
+                                  app->current_version()->version(),
+                                  package->filename());
+  uint64 old_size = 0;
+  HRESULT hr = package_cache()->GetUnverifiedSize(old_key, &old_size);
+  if (FAILED(hr)) {
+    CORE_LOG(L3, (_T("[installed package is not cached][%s][0x%08x]"),
+                  old_key.ToString(), hr));
+    return false;
+  }
+  if (old_size > kMaxPatchSourceSize) {
+    CORE_LOG(L3, (_T("[installed package is too large to patch][%s][%llu]"),
+                  old_key.ToString(), old_size));
+    return false;
+  }
+
+  return true;
+}
+
+// The patches are small, so they are kept in memory once their hash is
+// verified instead of being cached.
+HRESULT DownloadManager::DoDownloadPatch(Package* package, State* state) {
+  ASSERT1(package);
+  ASSERT1(state);
+
+  const CString diff_filename(package->diff_filename());
+  const uint64 diff_size(package->diff_expected_size());
+  const std::vector<CString> diff_base_urls(
+      package->app_version()->diff_download_base_urls());
+
+  std::vector<uint8> expected_digest;
+  if (!SafeHexStringToVector(package->diff_expected_hash().sha256,
+                             &expected_digest)) {
+    return E_INVALIDARG;
+  }
+
+  HRESULT hr = E_FAIL;
+  for (size_t i = 0;
+       FAILED(hr) && hr != GOOPDATE_E_CANCELLED && i != diff_base_urls.size();
+       ++i) {
+    CString url;
+    DWORD url_length(INTERNET_MAX_URL_LENGTH);
+    hr = ::UrlCombine(diff_base_urls[i],
+                      diff_filename,
+                      CStrBuf(url, INTERNET_MAX_URL_LENGTH),
+                      &url_length,
+                      0);
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[UrlCombine failed][0x%08x][%s]"),
+                    hr, diff_base_urls[i]));
+      continue;
+    }
+
+    Transfer transfer;
+    hr = InitializeTransfer(package, state, url, i, package, &transfer);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[InitializeTransfer failed][0x%08x]"), hr));
+      break;
+    }
+
+    hr = state->connection_budget()->Acquire(state->cancel_event());
+    if (SUCCEEDED(hr)) {
+      OPT_LOG(L3, (_T("[starting patch download][from '%s'][to '%s']"),
+                   url, transfer.filename));
+      hr = transfer.network_request->DownloadFile(url, transfer.filename);
+      state->connection_budget()->Release();
+    }
+
+    std::vector<uint8> patch;
+    if (SUCCEEDED(hr)) {
+      hr = ReadEntireFile(transfer.filename,
+                          static_cast<uint32>(diff_size),
+                          &patch);
+    }
+    if (SUCCEEDED(hr)) {
+      CryptoHash crypto(CryptoHash::kSha256);
+      hr = crypto.Validate(patch, expected_digest);
+    }
+
+    transfer.result = hr;
+    CompleteTransfer(&transfer);
+    if (SUCCEEDED(hr)) {
+      state->AddPatch(package, patch);
+    } else {
+      OPT_LOG(LW, (_T("[patch download failed][0x%08x][%s]"), hr, url));
+    }
+  }
+
+  return hr;
+}
+
+HRESULT DownloadManager::DoApplyPatches(State* state) {
+  ASSERT1(state);
+
+  std::vector<PackagePatch> patches;
+  state->TakePatches(&patches);
+  if (patches.empty()) {
+    return S_OK;
+  }
+
+  App* app = state->app();
+  app->ApplyingDifferentialPatch();
+
+  std::vector<Package*> failed_packages;
+  for (size_t i = 0; i != patches.size(); ++i) {
+    Package* package = patches[i].first;
+    HRESULT hr = CallAsSelfAndImpersonate2(
+        this,
+        &DownloadManager::DoApplyPatch,
+        static_cast<const Package*>(package),
+        static_cast<const std::vector<uint8>*>(&patches[i].second));
+    if (SUCCEEDED(hr)) {
+      ++metric_worker_download_diff_applied;
+      continue;
+    }
+
+    OPT_LOG(LW, (_T("[DoApplyPatch failed][%s][0x%08x]"),
+                 package->filename(), hr));
+    ++metric_worker_download_diff_failed;
+    package->ClearDiffInfo();
+    failed_packages.push_back(package);
+  }
+
+  if (failed_packages.empty()) {
+    return S_OK;
+  }
+
+  app->Downloading();
+  for (size_t i = 0; i != failed_packages.size(); ++i) {
+    HRESULT hr = DoDownloadPackage(failed_packages[i], state);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[DoDownloadPackage failed][%s][%s][0x%08x]"),
+                    app->display_name(), failed_packages[i]->filename(), hr));
+      return hr;
+    }
+  }
+
   return S_OK;
 }
 
-HRESULT DownloadManager::DoDownloadPackageFromUrl(const CString& url,
-                                                  const CString& filename,
-                                                  Package* package,
-                                                  State* state) {
+HRESULT DownloadManager::DoApplyPatch(const Package* package,
+                                      const std::vector<uint8>* patch) {
+  ASSERT1(package);
+  ASSERT1(patch);
+  ASSERT1(!patch->empty());
+
+  const App* app = package->app_version()->app();
+  const PackageCache::Key old_key(app->app_guid_string(),
+                                  app->current_version()->version(),
+                                  package->filename());
+
+  OPT_LOG(L3, (_T("[DownloadManager::DoApplyPatch][%s]"), old_key.ToString()));
+
+  std::vector<uint8> old_contents;
+  HRESULT hr = package_cache()->ReadUnverified(old_key,
+                                               kMaxPatchSourceSize,
+                                               &old_contents);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[ReadUnverified failed][0x%08x]"), hr));
+    return hr;
+  }
+
+  CString new_filename;
+  hr = BuildUniqueFileName(package->filename(), &new_filename);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  File new_file;
+  hr = new_file.Open(new_filename, true, false);
+  if (SUCCEEDED(hr)) {
+    FilePatchOutput output(&new_file);
+    if (!ApplyBinaryPatch(old_contents.empty() ? NULL : &old_contents.front(),
+                          old_contents.size(),
+                          &patch->front(),
+                          patch->size(),
+                          &output)) {
+      hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    const HRESULT close_hr = new_file.Close();
+    if (SUCCEEDED(hr)) {
+      hr = close_hr;
+    }
+  }
+
+  // The reconstructed package is verified against the hash of the manifest
+  // when it is cached.
+  if (SUCCEEDED(hr)) {
+    hr = DoCachePackage(package, &new_filename, NULL);
+  }
+
+  DeleteBeforeOrAfterReboot(new_filename);
+  return hr;
+}
+
+HRESULT DownloadManager::DoCheckArchives(AppVersion* app_version,
+                                         State* state) {
+  ASSERT1(app_version);
+  ASSERT1(state);
+
+  std::vector<Package*> archives;
+  for (size_t i = 0; i != app_version->GetNumberOfPackages(); ++i) {
+    Package* package = app_version->GetPackage(i);
+    if (package->archive_format() != ARCHIVE_FORMAT_NONE) {
+      archives.push_back(package);
+    }
+  }
+  if (archives.empty()) {
+    return S_OK;
+  }
+
+  App* app = state->app();
+  app->Extracting();
+
+  for (size_t i = 0; i != archives.size(); ++i) {
+    if (::WaitForSingleObject(state->cancel_event(), 0) == WAIT_OBJECT_0) {
+      return GOOPDATE_E_CANCELLED;
+    }
+
+    HRESULT hr = CallAsSelfAndImpersonate1(this,
+                                           &DownloadManager::DoCheckArchive,
+                                           archives[i]);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[DoCheckArchive failed][%s][%s][0x%08x]"),
+                    app->display_name(), archives[i]->filename(), hr));
+      ++metric_worker_download_archive_failed;
+      return hr;
+    }
+  }
+
+  return S_OK;
+}
+
+// The copy of the archive is only read to check its index. Nothing is kept
+// from it, so it can be in the temporary directory of the user.
+HRESULT DownloadManager::DoCheckArchive(Package* package) {
+  ASSERT1(package);
+
+  const CString app_id(package->app_version()->app()->app_guid_string());
+  const CString version(package->app_version()->version());
+  const CString package_name(package->filename());
+  const PackageCache::Key key(app_id, version, package_name);
+
+  CString archive_file;
+  HRESULT hr = BuildUniqueFileName(package_name, &archive_file);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = package_cache()->Get(key, archive_file, package->expected_hash());
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to get from cache][0x%08x]"), hr));
+    return hr;
+  }
+
+  hr = CheckPackage(archive_file,
+                    package->archive_format(),
+                    GetXzMemberName(package_name));
+  DeleteBeforeOrAfterReboot(archive_file);
+  return hr;
+}
+
+HRESULT DownloadManager::ExtractCachedPackage(const Package* package,
+                                              const CString& dir) const {
+  ASSERT1(package);
+
+  const CString app_id(package->app_version()->app()->app_guid_string());
+  const CString version(package->app_version()->version());
+  const CString package_name(package->filename());
+  const PackageCache::Key key(app_id, version, package_name);
+
+  CORE_LOG(L3, (_T("[DownloadManager::ExtractCachedPackage][%s][%s]"),
+                key.ToString(), dir));
+
+  // The archive is verified against the hash of the manifest as it is copied
+  // out of the cache. The copy is made next to |dir|, and not in a temporary
+  // directory, so that it is as protected as the members it is extracted to.
+  CString archive_file(dir);
+  archive_file.TrimRight(_T('\\'));
+  archive_file += kArchiveCopySuffix;
+  HRESULT hr = package_cache()->Get(key,
+                                    archive_file,
+                                    package->expected_hash());
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to get from cache][0x%08x]"), hr));
+    return hr;
+  }
+
+  hr = ExtractPackage(archive_file,
+                      package->archive_format(),
+                      GetXzMemberName(package_name),
+                      dir,
+                      kMaxExtractionThreads);
+  DeleteBeforeOrAfterReboot(archive_file);
+  return hr;
+}
+
+HRESULT DownloadManager::DoDownloadPackageHedged(
+    const std::vector<CString>& urls,
+    int hedge_delay_ms,
+    Package* package,
+    State* state,
+    size_t* num_urls_tried,
+    size_t* url_index) {
+  ASSERT1(urls.size() >= 2);
+  ASSERT1(hedge_delay_ms > 0);
+  ASSERT1(package);
+  ASSERT1(state);
+  ASSERT1(num_urls_tried);
+  ASSERT1(url_index);
+
+  *num_urls_tried = 0;
+  *url_index = 0;
+
+  internal::ConnectionBudget* connection_budget = state->connection_budget();
+  internal::RacingProgressCallback callback(package);
+
+  Transfer transfers[2];
+  HRESULT hr = InitializeTransfer(package, state, urls[0], 0, &callback,
+                                  &transfers[0]);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  hr = connection_budget->Acquire(state->cancel_event());
+  if (SUCCEEDED(hr)) {
+    hr = StartTransfer(&transfers[0]);
+    if (FAILED(hr)) {
+      connection_budget->Release();
+    }
+  }
+  if (FAILED(hr)) {
+    CompleteTransfer(&transfers[0]);
+    return hr;
+  }
+
+  *num_urls_tried = 1;
+  size_t num_started = 1;
+
+  // The second url is raced only if the first url is slow and a connection is
+  // available right away. Otherwise, the urls are tried in order.
+  if (::WaitForSingleObject(get(transfers[0].complete_event),
+                            hedge_delay_ms) == WAIT_TIMEOUT &&
+      connection_budget->TryAcquire()) {
+    hr = InitializeTransfer(package, state, urls[1], 1, &callback,
+                            &transfers[1]);
+    if (SUCCEEDED(hr)) {
+      hr = StartTransfer(&transfers[1]);
+      if (FAILED(hr)) {
+        CompleteTransfer(&transfers[1]);
+      }
+    }
+
+    if (SUCCEEDED(hr)) {
+      OPT_LOG(L3, (_T("[racing the second url][%s]"), urls[1]));
+      ++metric_worker_download_hedged;
+      *num_urls_tried = 2;
+      num_started = 2;
+    } else {
+      CORE_LOG(LW, (_T("[failed to race the second url][0x%08x]"), hr));
+      connection_budget->Release();
+    }
+  }
+
+  const size_t kNoWinner = num_started;
+  size_t winner = kNoWinner;
+  if (num_started == 1) {
+    VERIFY1(::WaitForSingleObject(get(transfers[0].complete_event),
+                                  INFINITE) == WAIT_OBJECT_0);
+    if (SUCCEEDED(transfers[0].result)) {
+      winner = 0;
+    }
+  } else {
+    HANDLE complete_events[] = { get(transfers[0].complete_event),
+                                 get(transfers[1].complete_event) };
+    const DWORD result = ::WaitForMultipleObjects(arraysize(complete_events),
+                                                  complete_events,
+                                                  false,
+                                                  INFINITE);
+    ASSERT1(result == WAIT_OBJECT_0 || result == WAIT_OBJECT_0 + 1);
+    const size_t first = result == WAIT_OBJECT_0 + 1 ? 1 : 0;
+    const size_t second = 1 - first;
+
+    if (SUCCEEDED(transfers[first].result)) {
+      winner = first;
+      VERIFY1(SUCCEEDED(transfers[second].network_request->Cancel()));
+    }
+
+    VERIFY1(::WaitForSingleObject(complete_events[second],
+                                  INFINITE) == WAIT_OBJECT_0);
+    if (winner == kNoWinner && SUCCEEDED(transfers[second].result)) {
+      winner = second;
+    }
+  }
+
+  // The download metrics of both urls are recorded, including the download
+  // canceled because it lost the race.
+  for (size_t i = 0; i != num_started; ++i) {
+    CompleteTransfer(&transfers[i]);
+  }
+
+  if (winner == kNoWinner) {
+    return transfers[num_started - 1].result;
+  }
+
+  if (winner == 1) {
+    ++metric_worker_download_hedged_won;
+  }
+  *url_index = transfers[winner].url_index;
+  return S_OK;
+}
+
+HRESULT DownloadManager::InitializeTransfer(Package* package,
+                                            State* state,
+                                            const CString& url,
+                                            size_t url_index,
+                                            NetworkRequestCallback* callback,
+                                            Transfer* transfer) {
+  ASSERT1(package);
+  ASSERT1(state);
+  ASSERT1(callback);
+  ASSERT1(transfer);
+  ASSERT1(!transfer->network_request);
+
+  transfer->package = package;
+  transfer->state = state;
+  transfer->url = url;
+  transfer->url_index = url_index;
+  transfer->impersonation_token =
+      state->app()->app_bundle()->impersonation_token();
+
+  HRESULT hr = BuildUniqueFileName(package->filename(), &transfer->filename);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[BuildUniqueFileName failed][0x%08x]"), hr));
+    return hr;
+  }
+
+  hr = state->CreateNetworkRequest(&transfer->network_request);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  transfer->network_request->set_callback(callback);
+  return S_OK;
+}
+
+void DownloadManager::CompleteTransfer(Transfer* transfer) {
+  ASSERT1(transfer);
+  ASSERT1(transfer->network_request);
+
+  AddDownloadMetricsPingEvents(transfer->network_request->download_metrics(),
+                               transfer->state->app());
+
+  VERIFY1(SUCCEEDED(transfer->network_request->Close()));
+  transfer->state->DestroyNetworkRequest(transfer->network_request);
+  transfer->network_request = NULL;
+
+  DeleteBeforeOrAfterReboot(transfer->filename);
+}
+
+HRESULT DownloadManager::StartTransfer(Transfer* transfer) {
+  ASSERT1(transfer);
+  ASSERT1(thread_pool_.get());
+
+  reset(transfer->complete_event, ::CreateEvent(NULL, true, false, NULL));
+  if (!transfer->complete_event) {
+    return HRESULTFromLastError();
+  }
+
+  scoped_ptr<UserWorkItem> work_item(
+      new ThreadPoolCallBack1<DownloadManager, Transfer*>(
+          this,
+          &DownloadManager::DoTransfer,
+          transfer));
+  HRESULT hr = thread_pool_->QueueUserWorkItem(work_item.get(),
+                                               COINIT_MULTITHREADED,
+                                               WT_EXECUTELONGFUNCTION);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[QueueUserWorkItem failed][0x%08x]"), hr));
+    return hr;
+  }
+
+  work_item.release();
+  return S_OK;
+}
+
+void DownloadManager::DoTransfer(Transfer* transfer) {
+  ASSERT1(transfer);
+
+  scoped_impersonation impersonate_user(transfer->impersonation_token);
+
+  transfer->result = DoDownloadPackageFromUrl(transfer->url,
+                                              transfer->filename,
+                                              transfer->package,
+                                              transfer->network_request);
+  transfer->state->connection_budget()->Release();
+
+  VERIFY1(::SetEvent(get(transfer->complete_event)));
+}
+
+HRESULT DownloadManager::DoDownloadPackageFromUrl(
+    const CString& url,
+    const CString& filename,
+    Package* package,
+    NetworkRequest* network_request) {
   OPT_LOG(L3, (_T("[starting download][from '%s'][to '%s']"), url, filename));
 
   // Downloading a file is a blocking call. It assumes the model is not
   // locked by the calling thread, otherwise other threads won't be able to
   // to access the model until the file download is complete.
-  ASSERT1(!package->model()->IsLockedByCaller());
-
-  NetworkRequest* network_request = state->network_request();
+  ASSERT1(!package->model()->IsLockedSharedByCaller());
+  ASSERT1(network_request);
 
   HRESULT hr = network_request->DownloadFile(url, filename);
   if (FAILED(hr)) {
@@ -461,12 +1329,18 @@ HRESULT DownloadManager::DoDownloadPackageFromUrl(const CString& url,
     return hr;
   }
 
-  // A file has been successfully downloaded from current url. Validate the file
-  // and cache it.
-  hr = CallAsSelfAndImpersonate2(this,
-                                 &DownloadManager::CachePackage,
-                                 static_cast<const Package*>(package),
-                                 static_cast<const CString*>(&filename));
+  // A file has been successfully downloaded from current url. Cache it. The
+  // cache copies the file and verifies the hash of the copy. If the network
+  // request hashed the file while it was downloaded, that digest only rejects
+  // a bad download before the file is copied.
+  std::vector<uint8> digest;
+  const bool has_digest = network_request->response_sha256(&digest);
+  hr = CallAsSelfAndImpersonate3(
+      this,
+      &DownloadManager::DoCachePackage,
+      static_cast<const Package*>(package),
+      static_cast<const CString*>(&filename),
+      static_cast<const std::vector<uint8>*>(has_digest ? &digest : NULL));
   if (FAILED(hr)) {
     OPT_LOG(LE, (_T("[DownloadManager::CachePackage failed][%#x]"), hr));
   }
@@ -483,7 +1357,7 @@ void DownloadManager::Cancel(App* app) {
 
   for (size_t i = 0; i != download_state_.size(); ++i) {
     if (app == download_state_[i]->app()) {
-      VERIFY1(SUCCEEDED(download_state_[i]->CancelNetworkRequest()));
+      VERIFY1(SUCCEEDED(download_state_[i]->CancelNetworkRequests()));
     }
   }
 }
@@ -494,7 +1368,7 @@ void DownloadManager::CancelAll() {
   __mutexScope(lock());
 
   for (size_t i = 0; i != download_state_.size(); ++i) {
-    VERIFY1(SUCCEEDED(download_state_[i]->CancelNetworkRequest()));
+    VERIFY1(SUCCEEDED(download_state_[i]->CancelNetworkRequests()));
   }
 }
 
@@ -510,6 +1384,12 @@ HRESULT DownloadManager::PurgeAppLowerVersions(const CString& app_id,
 
 HRESULT DownloadManager::CachePackage(const Package* package,
                                       const CString* filename_path) {
+  return DoCachePackage(package, filename_path, NULL);
+}
+
+HRESULT DownloadManager::DoCachePackage(const Package* package,
+                                        const CString* filename_path,
+                                        const std::vector<uint8>* digest) {
   ASSERT1(package);
   ASSERT1(filename_path);
 
@@ -518,28 +1398,66 @@ HRESULT DownloadManager::CachePackage(const Package* package,
   const CString package_name(package->filename());
   PackageCache::Key key(app_id, version, package_name);
 
-  HRESULT hr = package_cache()->Put(
-      key, *filename_path, package->expected_hash());
-  if (hr != SIGS_E_INVALID_SIGNATURE) {
-    if (FAILED(hr)) {
-      set_error_extra_code1(static_cast<int>(hr));
-      return GOOPDATEDOWNLOAD_E_CACHING_FAILED;
-    }
-    return hr;
+  HRESULT hr = digest ?
+      package_cache()->PutWithDigest(
+          key, *filename_path, package->expected_hash(), *digest) :
+      package_cache()->Put(key, *filename_path, package->expected_hash());
+  if (FAILED(hr)) {
+    return GetCachingError(hr, *filename_path, package->expected_size());
   }
 
-  // Get a more specific error if possible.
-  // TODO(omaha): It would be nice to detect that we downloaded a proxy
-  // page and tell the user this. It would be even better if we could
-  // display it; that would require a lot more plumbing.
-  HRESULT size_hr = ValidateSize(*filename_path, package->expected_size());
-  if (FAILED(size_hr)) {
-    hr = size_hr;
+  return hr;
+}
+
+HRESULT DownloadManager::CachePackages(
+    const std::vector<const Package*>& packages,
+    const std::vector<CString>& filename_paths) {
+  ASSERT1(packages.size() == filename_paths.size());
+
+  std::vector<PackageCache::BatchEntry> entries(packages.size());
+  for (size_t i = 0; i != packages.size(); ++i) {
+    BuildBatchEntry(packages[i], &entries[i]);
+    entries[i].source_file = filename_paths[i];
+  }
+
+  HRESULT hr = package_cache()->PutPackages(&entries);
+  if (SUCCEEDED(hr)) {
+    return S_OK;
+  }
+
+  for (size_t i = 0; i != entries.size(); ++i) {
+    if (FAILED(entries[i].result)) {
+      CORE_LOG(LE, (_T("[failed to cache package][%s][%s][0x%08x]"),
+                    entries[i].app_id, filename_paths[i], entries[i].result));
+      return GetCachingError(entries[i].result,
+                             filename_paths[i],
+                             packages[i]->expected_size());
+    }
   }
 
   return hr;
 }
 
+void DownloadManager::GetUnavailablePackages(
+    const std::vector<const Package*>& packages,
+    std::vector<const Package*>* unavailable_packages) const {
+  ASSERT1(unavailable_packages);
+
+  std::vector<PackageCache::BatchEntry> entries(packages.size());
+  for (size_t i = 0; i != packages.size(); ++i) {
+    BuildBatchEntry(packages[i], &entries[i]);
+  }
+
+  package_cache()->VerifyCachedPackages(&entries);
+
+  unavailable_packages->clear();
+  for (size_t i = 0; i != entries.size(); ++i) {
+    if (FAILED(entries[i].result)) {
+      unavailable_packages->push_back(packages[i]);
+    }
+  }
+}
+
 // The file is initially downloaded to a temporary unique name, to account
 // for the case where the same file is downloaded by multiple callers.
 HRESULT DownloadManager::BuildUniqueFileName(const CString& filename,
@@ -569,27 +1487,12 @@ HRESULT DownloadManager::CreateStateForApp(App* app, State** state) {
 
   *state = NULL;
 
-  NetworkRequest* network_request = NULL;
-  HRESULT hr = CreateNetworkRequest(&network_request);
-  if (FAILED(hr)) {
-    return hr;
-  }
-
-  ASSERT1(network_request);
-
-  const bool use_background_priority =
-                  (app->app_bundle()->priority() < INSTALL_PRIORITY_HIGH);
-  network_request->set_low_priority(use_background_priority);
-
-  network_request->set_proxy_auth_config(
-      app->app_bundle()->GetProxyAuthConfig());
-
-  scoped_ptr<State> state_ptr(new State(app, network_request));
+  __mutexScope(lock());
 
-  __mutexBlock(lock()) {
-    download_state_.push_back(state_ptr.release());
-    *state = download_state_.back();
-  }
+  scoped_ptr<State> state_ptr(
+      new State(app, GetConnectionBudget(app->app_bundle())));
+  download_state_.push_back(state_ptr.release());
+  *state = download_state_.back();
 
   return S_OK;
 }
@@ -602,8 +1505,23 @@ HRESULT DownloadManager::DeleteStateForApp(App* app) {
   typedef std::vector<State*>::iterator Iter;
   for (Iter it(download_state_.begin()); it != download_state_.end(); ++it) {
     if (app == (*it)->app()) {
+      const AppBundle* app_bundle = app->app_bundle();
       delete *it;
       download_state_.erase(it);
+
+      // The connection budget goes away with the last app of the bundle.
+      for (size_t i = 0; i != download_state_.size(); ++i) {
+        if (download_state_[i]->app()->app_bundle() == app_bundle) {
+          return S_OK;
+        }
+      }
+      ConnectionBudgetMap::iterator budget_it(
+          connection_budgets_.find(app_bundle));
+      ASSERT1(budget_it != connection_budgets_.end());
+      if (budget_it != connection_budgets_.end()) {
+        delete budget_it->second;
+        connection_budgets_.erase(budget_it);
+      }
       return S_OK;
     }
   }
@@ -613,24 +1531,145 @@ HRESULT DownloadManager::DeleteStateForApp(App* app) {
   return E_UNEXPECTED;
 }
 
-DownloadManager::State::State(App* app, NetworkRequest* network_request)
-    : app_(app), network_request_(network_request) {
+internal::ConnectionBudget* DownloadManager::GetConnectionBudget(
+    const AppBundle* app_bundle) {
+  ASSERT1(app_bundle);
+
+  ConnectionBudgetMap::const_iterator it(connection_budgets_.find(app_bundle));
+  if (it != connection_budgets_.end()) {
+    return it->second;
+  }
+
+  const int max_connections = ConfigManager::Instance()->
+                                  GetMaxDownloadConnections();
+  CORE_LOG(L3, (_T("[connection budget][0x%p][%d]"),
+                app_bundle, max_connections));
+
+  internal::ConnectionBudget* connection_budget(
+      new internal::ConnectionBudget(max_connections));
+  connection_budgets_[app_bundle] = connection_budget;
+  return connection_budget;
+}
+
+DownloadManager::State::State(App* app,
+                              internal::ConnectionBudget* connection_budget)
+    : app_(app), connection_budget_(connection_budget) {
   ASSERT1(app);
-  ASSERT1(network_request);
+  ASSERT1(connection_budget);
+
+  reset(cancel_event_, ::CreateEvent(NULL, true, false, NULL));
+  ASSERT1(cancel_event_);
 }
 
 DownloadManager::State::~State() {
+  ASSERT1(network_requests_.empty());
+  for (size_t i = 0; i != network_requests_.size(); ++i) {
+    delete network_requests_[i];
+  }
 }
 
-NetworkRequest* DownloadManager::State::network_request() const {
+HRESULT DownloadManager::State::CreateNetworkRequest(
+    NetworkRequest** network_request) {
+  ASSERT1(network_request);
   ASSERT1(ConfigManager::Instance()->CanUseNetwork(
                                          app_->app_bundle()->is_machine()));
 
-  return network_request_.get();
+  *network_request = NULL;
+
+  NetworkRequest* request = NULL;
+  HRESULT hr = omaha::CreateNetworkRequest(&request);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  ASSERT1(request);
+  scoped_ptr<NetworkRequest> request_ptr(request);
+
+  const bool use_background_priority =
+                  (app_->app_bundle()->priority() < INSTALL_PRIORITY_HIGH);
+  request->set_low_priority(use_background_priority);
+
+  request->set_proxy_auth_config(app_->app_bundle()->GetProxyAuthConfig());
+
+  __mutexScope(lock_);
+
+  if (IsHandleSignaled(get(cancel_event_))) {
+    return GOOPDATE_E_CANCELLED;
+  }
+
+  network_requests_.push_back(request_ptr.release());
+  *network_request = request;
+  return S_OK;
+}
+
+void DownloadManager::State::DestroyNetworkRequest(
+    NetworkRequest* network_request) {
+  ASSERT1(network_request);
+
+  __mutexBlock(lock_) {
+    std::vector<NetworkRequest*>::iterator it(
+        std::find(network_requests_.begin(),
+                  network_requests_.end(),
+                  network_request));
+    ASSERT1(it != network_requests_.end());
+    if (it != network_requests_.end()) {
+      network_requests_.erase(it);
+    }
+  }
+
+  delete network_request;
+}
+
+HRESULT DownloadManager::State::CancelNetworkRequests() {
+  __mutexScope(lock_);
+
+  HRESULT hr = ::SetEvent(get(cancel_event_)) ? S_OK : HRESULTFromLastError();
+  for (size_t i = 0; i != network_requests_.size(); ++i) {
+    HRESULT cancel_hr = network_requests_[i]->Cancel();
+    if (SUCCEEDED(hr)) {
+      hr = cancel_hr;
+    }
+  }
+  return hr;
+}
+
+void DownloadManager::State::AddPatch(Package* package,
+                                      const std::vector<uint8>& patch) {
+  ASSERT1(package);
+
+  __mutexScope(lock_);
+  patches_.push_back(std::make_pair(package, patch));
+}
+
+void DownloadManager::State::TakePatches(std::vector<PackagePatch>* patches) {
+  ASSERT1(patches);
+
+  __mutexScope(lock_);
+  patches->clear();
+  patches->swap(patches_);
+}
+
+DownloadManager::Transfer::Transfer()
+    : package(NULL),
+      state(NULL),
+      url_index(0),
+      network_request(NULL),
+      impersonation_token(NULL),
+      result(E_FAIL) {
+}
+
+DownloadManager::Transfer::~Transfer() {
+  ASSERT1(!network_request);
+}
+
+DownloadManager::PackageDownload::PackageDownload()
+    : package(NULL),
+      state(NULL),
+      impersonation_token(NULL),
+      result(E_FAIL) {
 }
 
-HRESULT DownloadManager::State::CancelNetworkRequest() {
-  return network_request_->Cancel();
+DownloadManager::PackageDownload::~PackageDownload() {
 }
 
 }  // namespace omaha
@@ -18,19 +18,33 @@
 
 #include <windows.h>
 #include <atlstr.h>
+#include <map>
+#include <utility>
 #include <vector>
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
 
 namespace omaha {
 
 class App;
+class AppBundle;
+class AppVersion;
 struct ErrorContext;
 class HttpClient;
 struct Lockable;        // TODO(omaha): make Lockable a class.
 class NetworkRequest;
+class NetworkRequestCallback;
 class Package;
 class PackageCache;
+class ThreadPool;
+
+namespace internal {
+
+class ConnectionBudget;
+
+}  // namespace internal
 
 // Public interface for the DownloadManager.
 class DownloadManagerInterface {
@@ -41,10 +55,16 @@ class DownloadManagerInterface {
                                         const CString& version) = 0;
   virtual HRESULT CachePackage(const Package* package,
                                const CString* filename_path) = 0;
+  virtual HRESULT CachePackages(
+      const std::vector<const Package*>& packages,
+      const std::vector<CString>& filename_paths) = 0;
   virtual HRESULT DownloadApp(App* app) = 0;
   virtual HRESULT GetPackage(const Package* package,
                              const CString& dir) const = 0;
   virtual bool IsPackageAvailable(const Package* package) const = 0;
+  virtual void GetUnavailablePackages(
+      const std::vector<const Package*>& packages,
+      std::vector<const Package*>* unavailable_packages) const = 0;
   virtual void Cancel(App* app) = 0;
   virtual void CancelAll() = 0;
   virtual bool IsBusy() const = 0;
@@ -63,7 +83,15 @@ class DownloadManager : public DownloadManagerInterface {
   virtual HRESULT CachePackage(const Package* package,
                                const CString* filename_path);
 
+  // Caches several packages, such as the packages of an offline install. The
+  // files are copied into the cache and the copies are verified in one batch.
+  // Returns the error of the first package which is not cached.
+  virtual HRESULT CachePackages(const std::vector<const Package*>& packages,
+                                const std::vector<CString>& filename_paths);
+
   // Downloads the specified app and stores its packages in the package cache.
+  // The packages are downloaded in parallel, within the connection budget of
+  // the bundle the app belongs to.
   //
   // This is a blocking call. All errors are reported through the return value.
   // Callers may use GetMessageForError() to convert this error value to an
@@ -77,6 +105,13 @@ class DownloadManager : public DownloadManagerInterface {
   // Returns true if the specified package is in the package cache.
   virtual bool IsPackageAvailable(const Package* package) const;
 
+  // Returns the packages which are not in the package cache. The cached
+  // packages are verified in one batch, so that IsPackageAvailable and
+  // GetPackage do not hash them again one at a time.
+  virtual void GetUnavailablePackages(
+      const std::vector<const Package*>& packages,
+      std::vector<const Package*>* unavailable_packages) const;
+
   // Cancels the download of specified app and makes DownloadApp return to the
   // caller at some point in the future. Cancel can be called multiple times
   // until the DownloadApp returns.
@@ -93,27 +128,83 @@ class DownloadManager : public DownloadManagerInterface {
                                     const CString& language);
 
  private:
+  // A package and the differential patch downloaded for it.
+  typedef std::pair<Package*, std::vector<uint8> > PackagePatch;
+
   // Maintains per-app download state.
   class State {
    public:
-    State(App* app, NetworkRequest* network_request);
+    State(App* app, internal::ConnectionBudget* connection_budget);
     ~State();
 
     App* app() const { return app_; }
 
-    NetworkRequest* network_request() const;
+    internal::ConnectionBudget* connection_budget() const {
+      return connection_budget_;
+    }
 
-    HRESULT CancelNetworkRequest();
+    // Signaled when the download of the app is canceled.
+    HANDLE cancel_event() const { return get(cancel_event_); }
+
+    // Creates a network request for one download of one package. The request
+    // is owned by the state object until DestroyNetworkRequest is called.
+    // Fails with GOOPDATE_E_CANCELLED once the download has been canceled.
+    HRESULT CreateNetworkRequest(NetworkRequest** network_request);
+    void DestroyNetworkRequest(NetworkRequest* network_request);
+
+    // Cancels the network requests of the app, including the requests created
+    // after this call.
+    HRESULT CancelNetworkRequests();
+
+    // Keeps the differential patch downloaded for a package until the
+    // packages are downloaded and the patches are applied.
+    void AddPatch(Package* package, const std::vector<uint8>& patch);
+
+    // Removes the patches from the state and returns them.
+    void TakePatches(std::vector<PackagePatch>* patches);
 
    private:
+    LLock lock_;
+
     // Not owned by this object.
     App* app_;
+    internal::ConnectionBudget* connection_budget_;
 
-    scoped_ptr<NetworkRequest> network_request_;
+    scoped_event cancel_event_;
+    std::vector<NetworkRequest*> network_requests_;
+    std::vector<PackagePatch> patches_;
 
     DISALLOW_EVIL_CONSTRUCTORS(State);
   };
 
+  // Describes one download of a package from one url.
+  struct Transfer {
+    Transfer();
+    ~Transfer();
+
+    Package* package;
+    State* state;
+    size_t url_index;
+    CString url;
+    CString filename;
+    NetworkRequest* network_request;
+    HANDLE impersonation_token;
+    HRESULT result;
+    scoped_event complete_event;
+  };
+
+  // Describes the download of one package of an app.
+  struct PackageDownload {
+    PackageDownload();
+    ~PackageDownload();
+
+    Package* package;
+    State* state;
+    HANDLE impersonation_token;
+    HRESULT result;
+    scoped_event complete_event;
+  };
+
   // Creates a download state corresponding to the app. The state object is
   // owned by the download manager. A pointer to the state object is returned
   // to the caller.
@@ -121,11 +212,93 @@ class DownloadManager : public DownloadManagerInterface {
 
   HRESULT DeleteStateForApp(App* app);
 
+  // Returns the connection budget of the bundle, creating it if needed.
+  // Must be called while holding the lock.
+  internal::ConnectionBudget* GetConnectionBudget(const AppBundle* app_bundle);
+
+  // Downloads the packages of an app and returns the first error, in the
+  // order of the packages. The remaining packages are canceled once a package
+  // fails to download.
+  HRESULT DoDownloadPackages(AppVersion* app_version, State* state);
+
+  // Runs in the thread pool.
+  void DoDownloadPackageAsync(PackageDownload* package_download);
+
   HRESULT DoDownloadPackage(Package* package, State* state);
+
+  // Returns true if the package can be reconstructed from a differential
+  // patch and the package of the installed version, which must still be in
+  // the package cache and small enough to be patched in memory.
+  bool CanDownloadPatch(const Package* package) const;
+
+  // Downloads the differential patch of a package, verifies its hash, and
+  // adds it to |state|.
+  HRESULT DoDownloadPatch(Package* package, State* state);
+
+  // Reconstructs the packages from the patches of |state|. The packages whose
+  // patch fails are downloaded in full instead.
+  HRESULT DoApplyPatches(State* state);
+
+  // Applies |patch| to the cached package of the installed version and caches
+  // the result, which is verified like a downloaded package.
+  HRESULT DoApplyPatch(const Package* package,
+                       const std::vector<uint8>* patch);
+
+  // Checks the packages which are archives once all the packages are
+  // downloaded, so that an archive which cannot be extracted fails the
+  // download and not the install. The app is in the extracting state while
+  // they are checked. The members are extracted when the app is installed.
+  HRESULT DoCheckArchives(AppVersion* app_version, State* state);
+
+  // Reads the index of the cached archive of a package.
+  HRESULT DoCheckArchive(Package* package);
+
+  // Extracts the cached archive of a package into |dir|.
+  HRESULT ExtractCachedPackage(const Package* package,
+                               const CString& dir) const;
+
+  // Races the first two urls of a package and cancels the slower download.
+  // Sets |num_urls_tried| to the number of urls the package was downloaded
+  // from, or tried to be downloaded from. |url_index| is the index of the url
+  // the package was downloaded from, when the race succeeds.
+  HRESULT DoDownloadPackageHedged(const std::vector<CString>& urls,
+                                  int hedge_delay_ms,
+                                  Package* package,
+                                  State* state,
+                                  size_t* num_urls_tried,
+                                  size_t* url_index);
+
+  // Prepares |transfer| for downloading the package from one url.
+  HRESULT InitializeTransfer(Package* package,
+                             State* state,
+                             const CString& url,
+                             size_t url_index,
+                             NetworkRequestCallback* callback,
+                             Transfer* transfer);
+
+  // Records the download metrics of a transfer once it has completed and
+  // releases its resources.
+  void CompleteTransfer(Transfer* transfer);
+
+  // Starts |transfer| in the thread pool. Ownership of the connection taken
+  // by the caller moves to the transfer.
+  HRESULT StartTransfer(Transfer* transfer);
+
+  // Runs in the thread pool. Releases the connection of the transfer when
+  // the download completes.
+  void DoTransfer(Transfer* transfer);
+
   HRESULT DoDownloadPackageFromUrl(const CString& url,
                                    const CString& filename,
                                    Package* package,
-                                   State* state);
+                                   NetworkRequest* network_request);
+
+  // Caches a package. If |digest| is not NULL, it contains the SHA-256 digest
+  // of the file computed while the file was downloaded. The digest rejects a
+  // bad download early; the cached copy is hashed in either case.
+  HRESULT DoCachePackage(const Package* package,
+                         const CString* filename_path,
+                         const std::vector<uint8>* digest);
 
   bool is_machine() const;
 
@@ -151,8 +324,16 @@ class DownloadManager : public DownloadManagerInterface {
 
   std::vector<State*> download_state_;
 
+  // Connection budgets of the bundles which have apps downloading.
+  typedef std::map<const AppBundle*, internal::ConnectionBudget*>
+      ConnectionBudgetMap;
+  ConnectionBudgetMap connection_budgets_;
+
   scoped_ptr<PackageCache> package_cache_;
 
+  // Runs the downloads of the packages. It is NULL until Initialize is called.
+  scoped_ptr<ThreadPool> thread_pool_;
+
   friend class DownloadManagerTest;
   DISALLOW_EVIL_CONSTRUCTORS(DownloadManager);
 };
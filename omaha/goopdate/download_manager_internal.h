@@ -0,0 +1,85 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#ifndef OMAHA_GOOPDATE_DOWNLOAD_MANAGER_INTERNAL_H_
+#define OMAHA_GOOPDATE_DOWNLOAD_MANAGER_INTERNAL_H_
+
+#include <windows.h>
+#include "base/basictypes.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/net/network_request.h"
+
+namespace omaha {
+
+namespace internal {
+
+// Limits how many connections the packages of a bundle may use at the same
+// time. The budget is shared by all the apps of the bundle that are
+// downloading.
+class ConnectionBudget {
+ public:
+  explicit ConnectionBudget(int max_connections);
+  ~ConnectionBudget();
+
+  int max_connections() const { return max_connections_; }
+
+  // Waits for a connection to become available. Returns GOOPDATE_E_CANCELLED
+  // if |cancel_event| is signaled first.
+  HRESULT Acquire(HANDLE cancel_event);
+
+  // Returns false right away if all the connections are in use.
+  bool TryAcquire();
+
+  void Release();
+
+ private:
+  const int max_connections_;
+  scoped_handle semaphore_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConnectionBudget);
+};
+
+// Forwards the progress of the downloads racing for the same package to the
+// package. Only the progress of the download that is furthest along is
+// forwarded, so that the progress of the package does not go backwards when
+// another url is tried.
+class RacingProgressCallback : public NetworkRequestCallback {
+ public:
+  explicit RacingProgressCallback(NetworkRequestCallback* callback);
+  virtual ~RacingProgressCallback();
+
+  virtual void OnRequestBegin();
+  virtual void OnProgress(int bytes, int bytes_total,
+                          int status, const TCHAR* status_text);
+  virtual void OnRequestRetryScheduled(time64 next_retry_time);
+
+ private:
+  LLock lock_;
+
+  // Not owned by this object.
+  NetworkRequestCallback* callback_;
+
+  bool has_begun_;
+  int max_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(RacingProgressCallback);
+};
+
+}  // namespace internal
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_DOWNLOAD_MANAGER_INTERNAL_H_
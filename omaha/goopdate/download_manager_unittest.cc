@@ -18,13 +18,16 @@
 #include <windows.h>
 #include <atlstr.h>
 #include "omaha/base/app_util.h"
+#include "omaha/base/constants.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
 #include "omaha/base/path.h"
+#include "omaha/base/reg_key.h"
 #include "omaha/base/safe_format.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/scoped_ptr_address.h"
 #include "omaha/base/signatures.h"
+#include "omaha/base/string.h"
 #include "omaha/base/thread_pool.h"
 #include "omaha/base/timer.h"
 #include "omaha/base/utils.h"
@@ -36,6 +39,7 @@
 #include "omaha/goopdate/app_unittest_base.h"
 #include "omaha/goopdate/download_manager.h"
 #include "omaha/goopdate/file_hash.h"
+#include "omaha/testing/loopback_http_server.h"
 #include "omaha/testing/unit_test.h"
 
 using ::testing::_;
@@ -1106,6 +1110,229 @@ TEST_F(DownloadManagerUserTest, DownloadApp_FallbackToNextUrlIfCachingFails) {
   EXPECT_TRUE(download_manager_->IsPackageAvailable(package));
 }
 
+// Serves the packages from a loopback server, where the latency of each url
+// is controlled by the test.
+class DownloadManagerLoopbackTest : public DownloadManagerUserTest {
+ protected:
+  virtual void SetUp() {
+    DownloadManagerUserTest::SetUp();
+
+    // The contents of all the packages.
+    for (int i = 0; i != 64 * 1024; ++i) {
+      contents_.push_back(static_cast<char>(i * 7));
+    }
+
+    ASSERT_HRESULT_SUCCEEDED(server_.Start());
+  }
+
+  virtual void TearDown() {
+    server_.Stop();
+
+    RegKey::DeleteValue(MACHINE_REG_UPDATE_DEV,
+                        kRegValueMaxDownloadConnections);
+    RegKey::DeleteValue(MACHINE_REG_UPDATE_DEV,
+                        kRegValueDownloadHedgeDelayMs);
+
+    DownloadManagerUserTest::TearDown();
+  }
+
+  // Serves the package |name| from the |directory| of the server.
+  void AddPackage(const CString& directory, const CString& name,
+                  int latency_ms) {
+    server_.AddFile(_T("/") + directory + _T("/") + name,
+                    contents_,
+                    latency_ms);
+  }
+
+  CString GetCodebase(const CString& directory) const {
+    return server_.base_url() + directory + _T("/");
+  }
+
+  // Creates an app which has the packages |package_names|, downloaded from
+  // |directories| in that order.
+  App* CreateApp(const std::vector<CString>& directories,
+                 const std::vector<CString>& package_names) {
+    std::vector<byte> digest;
+    CryptoHash crypto_hash(CryptoHash::kSha256);
+    EXPECT_HRESULT_SUCCEEDED(crypto_hash.Compute(
+        std::vector<byte>(contents_.begin(), contents_.end()), &digest));
+    const CStringA hash_sha256(BytesToHex(digest));
+
+    CStringA urls;
+    for (size_t i = 0; i != directories.size(); ++i) {
+      urls.AppendFormat("<url codebase=\"%s\"/>",
+                        CStringA(GetCodebase(directories[i])));
+    }
+
+    CStringA packages;
+    for (size_t i = 0; i != package_names.size(); ++i) {
+      packages.AppendFormat("<package hash_sha256=\"%s\" name=\"%s\" "
+                            "required=\"true\" size=\"%Iu\"/>",
+                            hash_sha256,
+                            CStringA(package_names[i]),
+                            contents_.size());
+    }
+
+    CStringA buffer_string;
+    buffer_string.Format(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+        "<response protocol=\"3.0\">"
+          "<app appid=\"%s\" status=\"ok\">"
+            "<updatecheck status=\"ok\">"
+              "<urls>%s</urls>"
+              "<manifest version=\"1.0\">"
+                "<packages>%s</packages>"
+              "</manifest>"
+            "</updatecheck>"
+          "</app>"
+        "</response>",
+        CStringA(kAppGuid1), urls, packages);
+
+    App* app = NULL;
+    EXPECT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kAppGuid1), &app));
+    EXPECT_SUCCEEDED(app->put_displayName(CComBSTR(_T("Loopback App"))));
+    EXPECT_SUCCEEDED(app->put_isEulaAccepted(VARIANT_TRUE));
+    EXPECT_HRESULT_SUCCEEDED(
+        LoadBundleFromXml(app_bundle_.get(), buffer_string));
+    SetAppStateWaitingToDownload(app);
+    return app;
+  }
+
+  static CString GetPings(const App* app) {
+    CString pings;
+    const PingEventVector& ping_events(app->ping_events());
+    for (size_t i = 0; i != ping_events.size(); ++i) {
+      SafeCStringAppendFormat(&pings, _T("%s; "), ping_events[i]->ToString());
+    }
+    return pings;
+  }
+
+  LoopbackHttpServer server_;
+  std::string contents_;
+};
+
+// The packages of an app are downloaded at the same time.
+TEST_F(DownloadManagerLoopbackTest, DownloadApp_PackagesInParallel) {
+  const int kLatencyMs = 1000;
+  std::vector<CString> package_names;
+  package_names.push_back(_T("Package1.bin"));
+  package_names.push_back(_T("Package2.bin"));
+  package_names.push_back(_T("Package3.bin"));
+  for (size_t i = 0; i != package_names.size(); ++i) {
+    AddPackage(_T("mirror"), package_names[i], kLatencyMs);
+  }
+
+  App* app = CreateApp(std::vector<CString>(1, _T("mirror")), package_names);
+  EXPECT_SUCCEEDED(download_manager_->DownloadApp(app));
+
+  for (size_t i = 0; i != package_names.size(); ++i) {
+    const Package* package = app->next_version()->GetPackage(i);
+    EXPECT_TRUE(download_manager_->IsPackageAvailable(package));
+    EXPECT_EQ(contents_.size(), package->bytes_downloaded());
+    EXPECT_LE(1, server_.GetRequestCount(_T("/mirror/") + package_names[i]));
+  }
+  EXPECT_LE(2, server_.max_concurrent_requests());
+  EXPECT_EQ(0, app->source_url_index());
+}
+
+// The connection budget of the bundle bounds the concurrent downloads.
+TEST_F(DownloadManagerLoopbackTest, DownloadApp_ConnectionBudget) {
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueMaxDownloadConnections,
+                                    static_cast<DWORD>(1)));
+
+  std::vector<CString> package_names;
+  package_names.push_back(_T("Package1.bin"));
+  package_names.push_back(_T("Package2.bin"));
+  package_names.push_back(_T("Package3.bin"));
+  for (size_t i = 0; i != package_names.size(); ++i) {
+    AddPackage(_T("mirror"), package_names[i], 200);
+  }
+
+  App* app = CreateApp(std::vector<CString>(1, _T("mirror")), package_names);
+  EXPECT_SUCCEEDED(download_manager_->DownloadApp(app));
+
+  for (size_t i = 0; i != package_names.size(); ++i) {
+    EXPECT_TRUE(download_manager_->IsPackageAvailable(
+        app->next_version()->GetPackage(i)));
+  }
+  EXPECT_EQ(1, server_.max_concurrent_requests());
+}
+
+// A slow first url is raced by the second url, which wins.
+TEST_F(DownloadManagerLoopbackTest, DownloadApp_HedgedSlowFirstUrl) {
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadHedgeDelayMs,
+                                    static_cast<DWORD>(200)));
+
+  const int kSlowLatencyMs = 60000;
+  AddPackage(_T("slow"), _T("Package.bin"), kSlowLatencyMs);
+  AddPackage(_T("fast"), _T("Package.bin"), 0);
+
+  std::vector<CString> directories;
+  directories.push_back(_T("slow"));
+  directories.push_back(_T("fast"));
+  App* app = CreateApp(directories, std::vector<CString>(1, _T("Package.bin")));
+
+  Timer timer(true);
+  EXPECT_SUCCEEDED(download_manager_->DownloadApp(app));
+  EXPECT_GT(kSlowLatencyMs / 2, timer.GetMilliseconds());
+
+  const Package* package = app->next_version()->GetPackage(0);
+  EXPECT_TRUE(download_manager_->IsPackageAvailable(package));
+  EXPECT_EQ(contents_.size(), package->bytes_downloaded());
+  EXPECT_EQ(1, app->source_url_index());
+
+  EXPECT_LE(1, server_.GetRequestCount(_T("/slow/Package.bin")));
+  EXPECT_LE(1, server_.GetRequestCount(_T("/fast/Package.bin")));
+
+  // The winning url is reported in the download metrics.
+  EXPECT_NE(-1, GetPings(app).Find(
+      _T("eventtype=1, eventresult=1, errorcode=0, extracode1=0, url=") +
+      GetCodebase(_T("fast")) + _T("Package.bin")));
+}
+
+// A fast first url does not need the second url.
+TEST_F(DownloadManagerLoopbackTest, DownloadApp_HedgedFastFirstUrl) {
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadHedgeDelayMs,
+                                    static_cast<DWORD>(10000)));
+
+  AddPackage(_T("first"), _T("Package.bin"), 0);
+  AddPackage(_T("second"), _T("Package.bin"), 0);
+
+  std::vector<CString> directories;
+  directories.push_back(_T("first"));
+  directories.push_back(_T("second"));
+  App* app = CreateApp(directories, std::vector<CString>(1, _T("Package.bin")));
+
+  EXPECT_SUCCEEDED(download_manager_->DownloadApp(app));
+  EXPECT_TRUE(download_manager_->IsPackageAvailable(
+      app->next_version()->GetPackage(0)));
+  EXPECT_EQ(0, app->source_url_index());
+  EXPECT_EQ(0, server_.GetRequestCount(_T("/second/Package.bin")));
+}
+
+// The second url is tried right away when the first url fails before the
+// hedge delay.
+TEST_F(DownloadManagerLoopbackTest, DownloadApp_HedgedFirstUrlFails) {
+  EXPECT_SUCCEEDED(RegKey::SetValue(MACHINE_REG_UPDATE_DEV,
+                                    kRegValueDownloadHedgeDelayMs,
+                                    static_cast<DWORD>(10000)));
+
+  AddPackage(_T("second"), _T("Package.bin"), 0);
+
+  std::vector<CString> directories;
+  directories.push_back(_T("missing"));
+  directories.push_back(_T("second"));
+  App* app = CreateApp(directories, std::vector<CString>(1, _T("Package.bin")));
+
+  EXPECT_SUCCEEDED(download_manager_->DownloadApp(app));
+  EXPECT_TRUE(download_manager_->IsPackageAvailable(
+      app->next_version()->GetPackage(0)));
+  EXPECT_EQ(1, app->source_url_index());
+}
+
 TEST_F(DownloadManagerUserTest, DownloadApp_EulaNotAccepted) {
   App* app = NULL;
   ASSERT_SUCCEEDED(app_bundle_->createApp(CComBSTR(kAppGuid1), &app));
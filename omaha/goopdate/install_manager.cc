@@ -29,6 +29,7 @@
 #include "omaha/goopdate/app_manager.h"
 #include "omaha/goopdate/installer_wrapper.h"
 #include "omaha/goopdate/model.h"
+#include "omaha/goopdate/package_extractor.h"
 #include "omaha/goopdate/server_resource.h"
 #include "omaha/goopdate/string_formatter.h"
 
@@ -205,6 +206,18 @@ HRESULT InstallManager::InstallApp(bool is_machine,
       }
     }
 
+    // The members of an archive are copied instead of the archive, so the
+    // installer is the member the action runs, or the file an xz package
+    // decompresses to.
+    if (package_manager.archive_format() != ARCHIVE_FORMAT_NONE) {
+      if (is_event_found && !action.program_to_run.IsEmpty()) {
+        installer_path = ConcatenatePath(dir, action.program_to_run);
+      } else if (package_manager.archive_format() == ARCHIVE_FORMAT_XZ) {
+        installer_path = ConcatenatePath(
+            dir, GetXzMemberName(package_manager.filename()));
+      }
+    }
+
     installer_data = app->GetInstallData();
 
     expected_version = next_version.install_manifest()->version;
@@ -44,13 +44,22 @@ class Model {
   explicit Model(WorkerModelInterface* worker);
   virtual ~Model();
 
-  const Lockable& lock() const { return lock_; }
+  // Mutators take the lock exclusively with __mutexScope. Accessors which only
+  // read the model may take it with __mutexSharedScope instead, and must only
+  // call other such accessors while they hold it.
+  const SharedLock& lock() const { return lock_; }
 
-  // Returns true if the model lock is held by the calling thread.
+  // Returns true if the model lock is held exclusively by the calling thread.
   bool IsLockedByCaller() const {
     return ::GetCurrentThreadId() == lock_.GetOwner();
   }
 
+  // Returns true if the model lock is held by the calling thread, either
+  // shared or exclusively.
+  bool IsLockedSharedByCaller() const {
+    return lock_.IsLockedSharedByCaller();
+  }
+
   // Creates an AppBundle object in the model.
   shared_ptr<AppBundle> CreateAppBundle(bool is_machine);
 
@@ -90,8 +99,8 @@ class Model {
  private:
   typedef weak_ptr<AppBundle> AppBundleWeakPtr;
 
-  // Serializes access to the model objects. Consider replacing with SWMR lock.
-  LLock lock_;
+  // Serializes access to the model objects. Readers share it.
+  SharedLock lock_;
 
   std::vector<AppBundleWeakPtr> app_bundles_;
   WorkerModelInterface* worker_;
@@ -20,6 +20,7 @@
 #include "omaha/base/synchronized.h"
 #include "omaha/base/time.h"
 #include "omaha/base/utils.h"
+#include "omaha/common/config_manager.h"
 #include "omaha/goopdate/model.h"
 
 namespace omaha {
@@ -28,9 +29,14 @@ Package::Package(AppVersion* app_version)
     : ModelObject(app_version->model()),
       app_version_(app_version),
       expected_size_(0),
+      diff_expected_size_(0),
+      archive_format_(ARCHIVE_FORMAT_NONE),
       bytes_downloaded_(0),
       bytes_total_(0),
       next_download_retry_time_(0),
+      progress_sample_interval_ms_(
+          ConfigManager::Instance()->GetDownloadProgressSampleIntervalMs()),
+      last_progress_sample_tick_(0),
       progress_sampler_(5 * kMsPerSec,    // Max sample time range.
                         1 * kMsPerSec),   // Min range for meaningful average.
       is_downloading_(false) {
@@ -40,12 +46,12 @@ Package::~Package() {
 }
 
 AppVersion* Package::app_version() {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_version_;
 }
 
 const AppVersion* Package::app_version() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return app_version_;
 }
 
@@ -60,7 +66,7 @@ STDMETHODIMP Package::get_isAvailable(VARIANT_BOOL* is_available) const {
 }
 
 STDMETHODIMP Package::get_filename(BSTR* filename_as_bstr) const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(filename_as_bstr);
   *filename_as_bstr = CComBSTR(filename()).Detach();
   return S_OK;
@@ -69,12 +75,13 @@ STDMETHODIMP Package::get_filename(BSTR* filename_as_bstr) const {
 // status_text can be NULL.
 // TODO(omaha): Change bytes and bytes_total to uint64. Any logging will
 // need to use %llu.
+// This is called for every chunk read from the network, so it does not take
+// the model lock. COM clients polling the state would otherwise contend with
+// the network thread thousands of times per second on fast links.
 void Package::OnProgress(int bytes,
                          int bytes_total,
                          int status,
                          const TCHAR* status_text) {
-  __mutexScope(model()->lock());
-
   UNREFERENCED_PARAMETER(status);
   UNREFERENCED_PARAMETER(status_text);
   ASSERT1(status == WINHTTP_CALLBACK_STATUS_READ_COMPLETE ||
@@ -100,17 +107,39 @@ void Package::OnProgress(int bytes,
   //         bytes_total == static_cast<int>(expected_size_));
   ASSERT1(bytes <= bytes_total);
 
-  bytes_downloaded_ = bytes;
-  bytes_total_ = bytes_total;
+  ::InterlockedExchange(&bytes_total_, bytes_total);
+  ::InterlockedExchange(&bytes_downloaded_, bytes);
+
+  SampleProgress(bytes, bytes == bytes_total);
+}
+
+void Package::SampleProgress(int bytes, bool force) {
+  const LONG now = static_cast<LONG>(::GetTickCount());
+  const LONG last = last_progress_sample_tick_;
+  if (!force &&
+      static_cast<DWORD>(now - last) <
+          static_cast<DWORD>(progress_sample_interval_ms_)) {
+    return;
+  }
 
-  progress_sampler_.AddSampleWithCurrentTimeStamp(bytes_downloaded_);
+  // Another thread has taken this sample.
+  if (::InterlockedCompareExchange(&last_progress_sample_tick_,
+                                   now,
+                                   last) != last) {
+    return;
+  }
+
+  __mutexScope(progress_sampler_lock_);
+  progress_sampler_.AddSampleWithCurrentTimeStamp(bytes);
 }
 
 void Package::OnRequestBegin() {
   __mutexScope(model()->lock());
   next_download_retry_time_ = 0;
-  bytes_downloaded_ = 0;
-  bytes_total_ = 0;
+  ::InterlockedExchange(&bytes_downloaded_, 0);
+  ::InterlockedExchange(&bytes_total_, 0);
+
+  __mutexScope(progress_sampler_lock_);
   progress_sampler_.Reset();
 }
 
@@ -135,54 +164,111 @@ void Package::SetFileInfo(const CString& filename,
 }
 
 CString Package::filename() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(!filename_.IsEmpty());
   return filename_;
 }
 
 uint64 Package::expected_size() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return expected_size_;
 }
 
 FileHash Package::expected_hash() const {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   ASSERT1(!expected_hash_.sha256.IsEmpty() ||!expected_hash_.sha1.IsEmpty());
   return expected_hash_;
 }
 
-uint64 Package::bytes_downloaded() const {
+void Package::SetDiffInfo(const CString& filename,
+                          uint64 size,
+                          const CString& hash_sha256) {
   __mutexScope(model()->lock());
-  return bytes_downloaded_;
+
+  ASSERT1(!filename.IsEmpty());
+  ASSERT1(0 < size);
+  ASSERT1(!hash_sha256.IsEmpty());
+
+  diff_filename_ = filename;
+  diff_expected_size_ = size;
+  diff_expected_hash_.sha256 = hash_sha256;
 }
 
-time64 Package::next_download_retry_time() const {
+void Package::ClearDiffInfo() {
   __mutexScope(model()->lock());
-  return next_download_retry_time_;
+  diff_filename_.Empty();
+  diff_expected_size_ = 0;
+  diff_expected_hash_ = FileHash();
 }
 
-LONG Package::GetEstimatedRemainingDownloadTimeMs() const {
+bool Package::has_diff() const {
+  __mutexSharedScope(model()->lock());
+  return !diff_filename_.IsEmpty();
+}
+
+CString Package::diff_filename() const {
+  __mutexSharedScope(model()->lock());
+  return diff_filename_;
+}
+
+uint64 Package::diff_expected_size() const {
+  __mutexSharedScope(model()->lock());
+  return diff_expected_size_;
+}
+
+FileHash Package::diff_expected_hash() const {
+  __mutexSharedScope(model()->lock());
+  return diff_expected_hash_;
+}
+
+void Package::set_archive_format(ArchiveFormat archive_format) {
   __mutexScope(model()->lock());
+  archive_format_ = archive_format;
+}
+
+ArchiveFormat Package::archive_format() const {
+  __mutexSharedScope(model()->lock());
+  return archive_format_;
+}
 
+uint64 Package::bytes_downloaded() const {
+  return static_cast<uint64>(bytes_downloaded_);
+}
+
+time64 Package::next_download_retry_time() const {
+  __mutexSharedScope(model()->lock());
+  return next_download_retry_time_;
+}
+
+LONG Package::GetEstimatedRemainingDownloadTimeMs() const {
   const LONG kUnknownRemainingTime = -1;
 
-  if (bytes_total_ == 0) {  // Don't know how many bytes to download.
+  // The two values are read separately, so they may belong to two different
+  // progress notifications. This only affects the estimate.
+  const LONG bytes_total = bytes_total_;
+  const LONG bytes_downloaded = bytes_downloaded_;
+
+  if (bytes_total == 0) {  // Don't know how many bytes to download.
     return kUnknownRemainingTime;
   }
 
-  if (bytes_total_ == bytes_downloaded_) {
+  if (bytes_total == bytes_downloaded) {
     return 0;
   }
 
   LONG time_remaining_ms = kUnknownRemainingTime;
-  int average_speed = progress_sampler_.GetAverageProgressPerMs();
+  int average_speed = ProgressSampler<int>::kUnknownProgressPerMs;
+  {
+    __mutexScope(progress_sampler_lock_);
+    average_speed = progress_sampler_.GetAverageProgressPerMs();
+  }
   if (average_speed == ProgressSampler<int>::kUnknownProgressPerMs) {
     return kUnknownRemainingTime;
   }
 
-  if (bytes_total_ >= bytes_downloaded_ && average_speed > 0) {
+  if (bytes_total >= bytes_downloaded && average_speed > 0) {
     time_remaining_ms = static_cast<LONG>(
-        CeilingDivide(bytes_total_ - bytes_downloaded_, average_speed));
+        CeilingDivide(bytes_total - bytes_downloaded, average_speed));
   }
 
   return time_remaining_ms;
@@ -199,7 +285,7 @@ STDMETHODIMP PackageWrapper::get_isAvailable(VARIANT_BOOL* is_available) {
 }
 
 STDMETHODIMP PackageWrapper::get_filename(BSTR* filename) {
-  __mutexScope(model()->lock());
+  __mutexSharedScope(model()->lock());
   return wrapped_obj()->get_filename(filename);
 }
 
@@ -25,7 +25,9 @@
 #include <atlcom.h>
 #include "base/basictypes.h"
 #include "goopdate/omaha3_idl.h"
+#include "omaha/base/archive_extractor.h"
 #include "omaha/base/constants.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/base/time.h"
 #include "omaha/common/progress_sampler.h"
 #include "omaha/goopdate/com_wrapper_creator.h"
@@ -69,6 +71,26 @@ class Package
   // Returns expected file hashes.
   FileHash expected_hash() const;
 
+  // Sets the differential patch which reconstructs this package from the
+  // package of the same name in the installed version of the app.
+  void SetDiffInfo(const CString& filename,
+                   uint64 size,
+                   const CString& hash_sha256);
+
+  // Forgets the differential patch after it failed, so that the package is
+  // downloaded in full.
+  void ClearDiffInfo();
+
+  bool has_diff() const;
+  CString diff_filename() const;
+  uint64 diff_expected_size() const;
+  FileHash diff_expected_hash() const;
+
+  // The package is an archive whose members are extracted before the app is
+  // installed, when the manifest specifies a format.
+  void set_archive_format(ArchiveFormat archive_format);
+  ArchiveFormat archive_format() const;
+
   uint64 bytes_downloaded() const;
 
   time64 next_download_retry_time() const;
@@ -79,6 +101,11 @@ class Package
   LONG GetEstimatedRemainingDownloadTimeMs() const;
 
  private:
+  // Adds |bytes| to the progress samples, unless a sample was added less than
+  // progress_sample_interval_ms_ ago and |force| is false. Does not take the
+  // model lock.
+  void SampleProgress(int bytes, bool force);
+
   // Weak reference to the parent of the package.
   AppVersion* app_version_;
 
@@ -87,10 +114,27 @@ class Package
   uint64 expected_size_;
   FileHash expected_hash_;
 
-  int bytes_downloaded_;
-  int bytes_total_;
+  // The differential patch, if the manifest has one.
+  CString diff_filename_;
+  uint64 diff_expected_size_;
+  FileHash diff_expected_hash_;
+
+  ArchiveFormat archive_format_;
+
+  // The network thread publishes the progress with atomic stores instead of
+  // taking the model lock for every chunk it reads.
+  volatile LONG bytes_downloaded_;
+  volatile LONG bytes_total_;
   time64 next_download_retry_time_;
 
+  // Coalesces the progress notifications into at most one sample per
+  // interval. The tick count of the last sample is updated with a
+  // compare-exchange, so only one thread adds each sample.
+  const int progress_sample_interval_ms_;
+  volatile LONG last_progress_sample_tick_;
+
+  // Protects progress_sampler_, which is not protected by the model lock.
+  mutable LLock progress_sampler_lock_;
   ProgressSampler<int> progress_sampler_;
 
   // True if the package is being downloaded.
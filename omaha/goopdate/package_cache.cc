@@ -15,15 +15,23 @@
 
 #include "omaha/goopdate/package_cache.h"
 #include <shlwapi.h>
+#include <algorithm>
+#include <set>
 #include <vector>
+#include "omaha/base/crc.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/path.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/security/sha.h"
+#include "omaha/base/security/sha256.h"
 #include "omaha/base/string.h"
 #include "omaha/base/signatures.h"
 #include "omaha/base/signaturevalidator.h"
+#include "omaha/base/time.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/goopdate/file_hash.h"
@@ -32,6 +40,188 @@
 
 namespace omaha {
 
+namespace {
+
+// The name of the verified hash index file in the cache root. The cache
+// directory enumeration only looks at subdirectories of the root, therefore
+// the index is never mistaken for a cached package.
+const TCHAR* const kVerifiedHashIndexFileName = _T("verified_hashes.idx");
+
+// The number of space-separated fields before the file key in an index line.
+const int kVerifiedHashIndexFieldCount = 6;
+
+// SHA-256 hashes are hex encoded while SHA-1 hashes are base64 encoded.
+const int kSha256HashStringLength = 64;
+
+// The number of threads which hash the packages verified in a batch.
+const int kMaxVerificationThreads = 4;
+
+// The name of the directory in the cache root where the chunks of the chunked
+// packages are stored. App ids are GUIDs, therefore the name does not clash
+// with the directory of an app.
+const TCHAR* const kChunkStoreDirectoryName = _T("chunks");
+
+// The first line of a chunk manifest.
+const char kChunkManifestHeader[] = "OmahaChunkManifest 1\n";
+
+// How long a chunk is kept after it is written or shared, even when no
+// manifest references it.
+const uint64 kChunkPurgeGracePeriod100ns = kHoursTo100ns;
+
+// The size of the reads when a package is copied into the cache.
+const size_t kCopyBufferSize = 64 * 1024;
+
+// Decodes the expected hash of a package, which is a SHA-256 hash when there
+// is one, and a SHA-1 hash otherwise.
+HRESULT DecodeExpectedHash(const FileHash& hash,
+                           bool* use_sha256,
+                           std::vector<uint8>* expected_hash) {
+  ASSERT1(use_sha256);
+  ASSERT1(expected_hash);
+
+  *use_sha256 = !hash.sha256.IsEmpty();
+  if (*use_sha256) {
+    return SafeHexStringToVector(hash.sha256, expected_hash) ? S_OK :
+                                                               E_INVALIDARG;
+  }
+  return Base64::Decode(hash.sha1, expected_hash);
+}
+
+// Verifies the hash of a package read in memory.
+HRESULT VerifyBufferHash(const std::vector<uint8>& buffer,
+                         const FileHash& hash) {
+  bool use_sha256 = false;
+  std::vector<uint8> expected_hash;
+  HRESULT hr = DecodeExpectedHash(hash, &use_sha256, &expected_hash);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  CryptoHash crypto(use_sha256 ? CryptoHash::kSha256 : CryptoHash::kSha1);
+  if (!crypto.IsValidSize(expected_hash.size())) {
+    return E_INVALIDARG;
+  }
+  return crypto.Validate(buffer, expected_hash);
+}
+
+// Copies |source| to |destination| and hashes the bytes which are copied.
+HRESULT CopyAndHash(HANDLE source, HANDLE destination, HASH_CTX* context) {
+  ASSERT1(context);
+
+  std::vector<uint8> buffer(kCopyBufferSize);
+  for (;;) {
+    DWORD bytes_read = 0;
+    if (!::ReadFile(source,
+                    &buffer.front(),
+                    static_cast<DWORD>(buffer.size()),
+                    &bytes_read,
+                    NULL)) {
+      return HRESULTFromLastError();
+    }
+    if (!bytes_read) {
+      return S_OK;
+    }
+
+    HASH_update(context, &buffer.front(), bytes_read);
+
+    DWORD bytes_written = 0;
+    if (!::WriteFile(destination,
+                     &buffer.front(),
+                     bytes_read,
+                     &bytes_written,
+                     NULL)) {
+      return HRESULTFromLastError();
+    }
+    if (bytes_written != bytes_read) {
+      return HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+    }
+  }
+}
+
+// Copies a package into the cache and verifies the hash of the bytes which
+// are copied. The source is read through a single handle which denies
+// writers, so the copy is the data which is hashed even when the source is
+// in a directory which the user can write to. The destination is deleted if
+// the copy fails or does not match the hash.
+HRESULT CopyAndVerifyHash(const CString& source_file,
+                          const CString& destination_file,
+                          const FileHash& hash) {
+  bool use_sha256 = false;
+  std::vector<uint8> expected_hash;
+  HRESULT hr = DecodeExpectedHash(hash, &use_sha256, &expected_hash);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  const size_t digest_size = use_sha256 ? SHA256_DIGEST_SIZE :
+                                          SHA_DIGEST_SIZE;
+  if (expected_hash.size() != digest_size) {
+    return E_INVALIDARG;
+  }
+
+  scoped_hfile source(::CreateFile(source_file,
+                                   FILE_READ_DATA,
+                                   FILE_SHARE_READ,
+                                   NULL,
+                                   OPEN_EXISTING,
+                                   FILE_FLAG_SEQUENTIAL_SCAN,
+                                   NULL));
+  if (!source) {
+    return HRESULTFromLastError();
+  }
+
+  // When not impersonated, the new file is owned by the process and it
+  // inherits the ACEs of the cache directory.
+  scoped_hfile destination(::CreateFile(destination_file,
+                                        FILE_WRITE_DATA,
+                                        0,
+                                        NULL,
+                                        CREATE_ALWAYS,
+                                        FILE_ATTRIBUTE_NORMAL,
+                                        NULL));
+  if (!destination) {
+    return HRESULTFromLastError();
+  }
+
+  HASH_CTX context;
+  if (use_sha256) {
+    SHA256_init(&context);
+  } else {
+    SHA_init(&context);
+  }
+  hr = CopyAndHash(get(source), get(destination), &context);
+  if (SUCCEEDED(hr) &&
+      memcmp(HASH_final(&context), &expected_hash.front(), digest_size)) {
+    hr = SIGS_E_INVALID_SIGNATURE;
+  }
+
+  reset(destination);
+  if (FAILED(hr)) {
+    ::DeleteFile(destination_file);
+  }
+  return hr;
+}
+
+// Returns the size of the package which the manifest describes.
+uint64 GetChunkedSize(const internal::ChunkManifest& manifest) {
+  uint64 size = 0;
+  for (size_t i = 0; i != manifest.size(); ++i) {
+    size += manifest[i].size;
+  }
+  return size;
+}
+
+// Returns the first error of a batch, or S_OK if all the packages succeeded.
+HRESULT GetFirstError(const std::vector<PackageCache::BatchEntry>& entries) {
+  for (size_t i = 0; i != entries.size(); ++i) {
+    if (FAILED(entries[i].result)) {
+      return entries[i].result;
+    }
+  }
+  return S_OK;
+}
+
+}  // namespace
+
 namespace internal {
 
 bool PackageSortByTimePredicate(const PackageInfo& package1,
@@ -106,7 +296,8 @@ HRESULT FindDirectoryPackagesInfo(const CString& dir_path,
   do {
     switch (dir_type) {
       case CACHE_DIRECTORY_ROOT:
-        if (IsSubDirectoryFindData(find_data)) {
+        if (IsSubDirectoryFindData(find_data) &&
+            _tcsicmp(find_data.cFileName, kChunkStoreDirectoryName) != 0) {
           CString app_dir = ConcatenatePath(dir_path, find_data.cFileName);
           hr = FindAppPackagesInfo(app_dir, packages_info);
         }
@@ -143,6 +334,221 @@ CString GetHashString(const FileHash& hash) {
   return hash.sha256.IsEmpty() ? hash.sha1 : hash.sha256;
 }
 
+HRESULT GetFileIdentity(const CString& filename, VerifiedHashRecord* record) {
+  ASSERT1(record);
+
+  scoped_hfile file(::CreateFile(filename,
+                                 FILE_READ_ATTRIBUTES,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                 FILE_SHARE_DELETE,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL));
+  if (!file) {
+    return HRESULTFromLastError();
+  }
+
+  BY_HANDLE_FILE_INFORMATION file_info = {0};
+  if (!::GetFileInformationByHandle(get(file), &file_info)) {
+    return HRESULTFromLastError();
+  }
+
+  ULARGE_INTEGER value = {0};
+  value.LowPart = file_info.nFileSizeLow;
+  value.HighPart = file_info.nFileSizeHigh;
+  record->file_size = value.QuadPart;
+
+  value.LowPart = file_info.ftLastWriteTime.dwLowDateTime;
+  value.HighPart = file_info.ftLastWriteTime.dwHighDateTime;
+  record->last_write_time = value.QuadPart;
+
+  value.LowPart = file_info.nFileIndexLow;
+  value.HighPart = file_info.nFileIndexHigh;
+  record->file_index = value.QuadPart;
+
+  record->volume_serial_number = file_info.dwVolumeSerialNumber;
+
+  return S_OK;
+}
+
+bool IsSameFileIdentity(const VerifiedHashRecord& record1,
+                        const VerifiedHashRecord& record2) {
+  return record1.file_size == record2.file_size &&
+         record1.last_write_time == record2.last_write_time &&
+         record1.volume_serial_number == record2.volume_serial_number &&
+         record1.file_index == record2.file_index;
+}
+
+void SerializeVerifiedHashIndex(const VerifiedHashIndex& index,
+                                std::vector<uint8>* buffer) {
+  ASSERT1(buffer);
+
+  CString text;
+  for (VerifiedHashIndex::const_iterator it = index.begin();
+       it != index.end();
+       ++it) {
+    const VerifiedHashRecord& record = it->second;
+    SafeCStringAppendFormat(&text,
+                            _T("%I64u %I64u %u %I64u %I64u %s %s\n"),
+                            record.file_size,
+                            record.last_write_time,
+                            record.volume_serial_number,
+                            record.file_index,
+                            record.verified_time,
+                            record.hash,
+                            it->first);
+  }
+
+  buffer->clear();
+  WideToUtf8Vector(text, buffer);
+}
+
+void DeserializeVerifiedHashIndex(const std::vector<uint8>& buffer,
+                                  VerifiedHashIndex* index) {
+  ASSERT1(index);
+  index->clear();
+
+  if (buffer.empty()) {
+    return;
+  }
+
+  const CString text(Utf8ToWideChar(reinterpret_cast<const char*>(&buffer[0]),
+                                    static_cast<uint32>(buffer.size())));
+  std::vector<CString> lines;
+  TextToLines(text, _T("\n"), &lines);
+
+  for (size_t i = 0; i != lines.size(); ++i) {
+    const CString& line = lines[i];
+
+    std::vector<CString> fields;
+    int start = 0;
+    while (fields.size() != kVerifiedHashIndexFieldCount) {
+      const int end = line.Find(_T(' '), start);
+      if (end <= start) {
+        break;
+      }
+      fields.push_back(line.Mid(start, end - start));
+      start = end + 1;
+    }
+
+    const CString key(line.Mid(start));
+    if (fields.size() != kVerifiedHashIndexFieldCount || key.IsEmpty()) {
+      CORE_LOG(LW, (_T("[skipping malformed verified hash record][%s]"), line));
+      continue;
+    }
+
+    VerifiedHashRecord record;
+    record.file_size = _tcstoui64(fields[0], NULL, 10);
+    record.last_write_time = _tcstoui64(fields[1], NULL, 10);
+    record.volume_serial_number =
+        static_cast<uint32>(_tcstoui64(fields[2], NULL, 10));
+    record.file_index = _tcstoui64(fields[3], NULL, 10);
+    record.verified_time = _tcstoui64(fields[4], NULL, 10);
+    record.hash = fields[5];
+    (*index)[key] = record;
+  }
+}
+
+void FindChunkBoundaries(const uint8* data,
+                         size_t size,
+                         std::vector<size_t>* chunk_ends) {
+  ASSERT1(data || !size);
+  ASSERT1(chunk_ends);
+  chunk_ends->clear();
+
+  // The handle is shared and must not be deleted.
+  const CRC* crc = CRC::Default(32, kChunkWindowSize);
+
+  size_t start = 0;
+  while (start < size) {
+    const size_t max_end = std::min(size, start + kMaxChunkSize);
+    size_t end = max_end;
+    if (max_end - start > kMinChunkSize) {
+      // The CRC covers the window of bytes which ends at offset i.
+      size_t i = start + kMinChunkSize;
+      uint64 lo = 0;
+      uint64 hi = 0;
+      crc->Empty(&lo, &hi);
+      crc->Extend(&lo, &hi, data + i - kChunkWindowSize, kChunkWindowSize);
+      for (; i != max_end; ++i) {
+        if (!(lo & kChunkBoundaryMask)) {
+          end = i;
+          break;
+        }
+        crc->Roll(&lo, &hi, data[i - kChunkWindowSize], data[i]);
+      }
+    }
+
+    chunk_ends->push_back(end);
+    start = end;
+  }
+}
+
+bool IsChunkManifest(const uint8* data, size_t size) {
+  const size_t header_size = arraysize(kChunkManifestHeader) - 1;
+  return size >= header_size &&
+         memcmp(data, kChunkManifestHeader, header_size) == 0;
+}
+
+void SerializeChunkManifest(const ChunkManifest& manifest,
+                            std::vector<uint8>* buffer) {
+  ASSERT1(buffer);
+
+  CString text(kChunkManifestHeader);
+  for (size_t i = 0; i != manifest.size(); ++i) {
+    SafeCStringAppendFormat(&text,
+                            _T("%u %s\n"),
+                            manifest[i].size,
+                            manifest[i].hash);
+  }
+
+  buffer->clear();
+  WideToUtf8Vector(text, buffer);
+}
+
+bool DeserializeChunkManifest(const std::vector<uint8>& buffer,
+                              ChunkManifest* manifest) {
+  ASSERT1(manifest);
+  manifest->clear();
+
+  if (buffer.empty() || !IsChunkManifest(&buffer[0], buffer.size())) {
+    return false;
+  }
+
+  const CString text(Utf8ToWideChar(reinterpret_cast<const char*>(&buffer[0]),
+                                    static_cast<uint32>(buffer.size())));
+  std::vector<CString> lines;
+  TextToLines(text, _T("\n"), &lines);
+
+  // The first line is the header.
+  for (size_t i = 1; i < lines.size(); ++i) {
+    const CString& line = lines[i];
+    if (line.IsEmpty()) {
+      continue;
+    }
+
+    const int separator = line.Find(_T(' '));
+    const CString hash(line.Mid(separator + 1));
+    const uint64 size = separator > 0 ?
+        _tcstoui64(line.Left(separator), NULL, 10) : 0;
+
+    bool is_hex = hash.GetLength() == kSha256HashStringLength;
+    for (int j = 0; is_hex && j != hash.GetLength(); ++j) {
+      is_hex = !!_istxdigit(hash[j]);
+    }
+    if (!is_hex || !size || size > kMaxChunkSize) {
+      CORE_LOG(LE, (_T("[malformed chunk manifest line][%s]"), line));
+      manifest->clear();
+      return false;
+    }
+
+    manifest->push_back(ChunkReference(hash, static_cast<uint32>(size)));
+  }
+
+  return true;
+}
+
 }  // namespace internal
 
 PackageCache::PackageCache() {
@@ -151,6 +557,14 @@ PackageCache::PackageCache() {
 
   cache_size_limit_bytes_ = 1024 * 1024 * static_cast<uint64>(
     ConfigManager::Instance()->GetPackageCacheSizeLimitMBytes());
+
+  reverify_interval_sec_ =
+    ConfigManager::Instance()->GetPackageCacheReverifyIntervalSec();
+
+  is_chunk_store_enabled_ =
+    ConfigManager::Instance()->IsPackageCacheChunkStoreEnabled();
+
+  chunk_purge_grace_period_100ns_ = kChunkPurgeGracePeriod100ns;
 }
 
 PackageCache::~PackageCache() {
@@ -173,6 +587,8 @@ HRESULT PackageCache::Initialize(const CString& cache_root) {
 
   cache_root_ = cache_root;
 
+  LoadVerifiedHashIndex();
+
   return S_OK;
 }
 
@@ -184,16 +600,116 @@ bool PackageCache::IsCached(const Key& key, const FileHash& hash) const {
 
   CString filename;
   HRESULT hr = BuildCacheFileNameForKey(key, &filename);
+  if (FAILED(hr) || !File::Exists(filename)) {
+    return false;
+  }
+
+  internal::ChunkManifest manifest;
+  hr = LoadChunkManifest(filename, &manifest);
   if (FAILED(hr)) {
     return false;
   }
+  if (hr == S_FALSE) {
+    return SUCCEEDED(VerifyCachedFileHash(filename, hash));
+  }
+
+  // Like a full copy, a chunked package verified before is trusted as long as
+  // its manifest is not modified and its chunks are stored.
+  if (HasCurrentVerifiedHashRecord(filename, hash)) {
+    size_t i = 0;
+    while (i != manifest.size() &&
+           File::Exists(GetChunkFileName(manifest[i].hash))) {
+      ++i;
+    }
+    if (i == manifest.size()) {
+      return true;
+    }
+  }
 
-  return File::Exists(filename) && SUCCEEDED(VerifyHash(filename, hash));
+  return SUCCEEDED(VerifyChunkedPackage(filename, manifest, hash));
+}
+
+void PackageCache::VerifyCachedPackages(
+    std::vector<BatchEntry>* entries) const {
+  ASSERT1(entries);
+  CORE_LOG(L3, (_T("[PackageCache::VerifyCachedPackages][%Iu packages]"),
+                entries->size()));
+
+  __mutexScope(cache_lock_);
+
+  // Only the full copies which would be hashed by IsCached are hashed in the
+  // batch. The other packages go through IsCached, which does not hash the
+  // packages with a current record and checks the chunked packages.
+  std::vector<FileHashVerification> files;
+  std::vector<size_t> file_entries;
+  for (size_t i = 0; i != entries->size(); ++i) {
+    BatchEntry& entry = (*entries)[i];
+    const Key key(entry.app_id, entry.version, entry.package_name);
+
+    CString filename;
+    HRESULT hr = BuildCacheFileNameForKey(key, &filename);
+    if (FAILED(hr)) {
+      entry.result = hr;
+      continue;
+    }
+    if (!File::Exists(filename)) {
+      entry.result = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+      continue;
+    }
+
+    internal::ChunkManifest manifest;
+    if (LoadChunkManifest(filename, &manifest) == S_FALSE &&
+        !HasCurrentVerifiedHashRecord(filename, entry.hash)) {
+      const bool use_sha256 = !entry.hash.sha256.IsEmpty();
+      files.push_back(FileHashVerification(
+          filename,
+          use_sha256 ? entry.hash.sha256 : entry.hash.sha1,
+          use_sha256));
+      file_entries.push_back(i);
+      continue;
+    }
+
+    entry.result = IsCached(key, entry.hash) ? S_OK :
+                                               SIGS_E_INVALID_SIGNATURE;
+  }
+
+  if (files.empty()) {
+    return;
+  }
+
+  HighresTimer verification_timer;
+  VerifyFileHashes(&files, kMaxVerificationThreads);
+  CORE_LOG(L3, (_T("[verified %Iu packages][%d ms]"),
+                files.size(), verification_timer.GetElapsedMs()));
+
+  for (size_t i = 0; i != files.size(); ++i) {
+    BatchEntry& entry = (*entries)[file_entries[i]];
+    entry.result = files[i].result;
+    if (SUCCEEDED(entry.result)) {
+      UpdateVerifiedHashIndex(files[i].file, entry.hash);
+    } else {
+      RemoveFromVerifiedHashIndex(files[i].file);
+    }
+  }
 }
 
 HRESULT PackageCache::Put(const Key& key,
                           const CString& source_file,
                           const FileHash& hash) {
+  return DoPut(key, source_file, hash, NULL);
+}
+
+HRESULT PackageCache::PutWithDigest(const Key& key,
+                                    const CString& source_file,
+                                    const FileHash& hash,
+                                    const std::vector<uint8>& source_sha256) {
+  return DoPut(key, source_file, hash, &source_sha256);
+}
+
+HRESULT PackageCache::DoPut(const Key& key,
+                            const CString& source_file,
+                            const FileHash& hash,
+                            const std::vector<uint8>* source_sha256) {
   ++metric_worker_package_cache_put_total;
   CORE_LOG(L3, (_T("[PackageCache::Put][key '%s'][source_file '%s'][hash %s]"),
                 key.ToString(), source_file, internal::GetHashString(hash)));
@@ -205,45 +721,173 @@ HRESULT PackageCache::Put(const Key& key,
     return E_INVALIDARG;
   }
 
+  // The digest of the source rejects a bad download before it is copied. It
+  // does not stand in for hashing the copy, since the source is not in the
+  // cache and may be replaced after it was hashed.
+  const bool is_source_digest_usable = source_sha256 && !hash.sha256.IsEmpty();
+  if (is_source_digest_usable) {
+    std::vector<uint8> expected_sha256;
+    if (!SafeHexStringToVector(hash.sha256, &expected_sha256)) {
+      return E_INVALIDARG;
+    }
+    if (expected_sha256 != *source_sha256) {
+      CORE_LOG(LE, (_T("[source digest does not match][expected hash %s]"),
+                    hash.sha256));
+      return SIGS_E_INVALID_SIGNATURE;
+    }
+  }
+
   CString destination_file;
-  HRESULT hr = BuildCacheFileNameForKey(key, &destination_file);
-  CORE_LOG(L3, (_T("[destination file '%s']"), destination_file));
+  HRESULT hr = PrepareCacheFileForKey(key, &destination_file);
   if (FAILED(hr)) {
     return hr;
   }
 
-  hr = CreateDir(GetDirectoryFromPath(destination_file), NULL);
-  if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[failed to create cache directory][0x%08x][%s]"),
-                  hr, destination_file));
-    return hr;
+  if (is_chunk_store_enabled_) {
+    // The package is verified after it is read, so that the chunks are known
+    // to match the hash even if the source file is modified meanwhile. The
+    // digest of the source is not enough, since the source may have been
+    // replaced after it was hashed.
+    std::vector<uint8> contents;
+    hr = ReadEntireFileShareMode(source_file, 0, FILE_SHARE_READ, &contents);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to read file][0x%08x][%s]"),
+                    hr, source_file));
+      return hr;
+    }
+
+    hr = VerifyBufferHash(contents, hash);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to verify hash for file '%s'][expected %s]"),
+                    source_file, internal::GetHashString(hash)));
+      return hr;
+    }
+
+    const bool is_replaced = File::Exists(destination_file);
+    hr = PutChunkedPackage(contents, destination_file);
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to put chunked package][0x%08x][%s]"),
+                    hr, destination_file));
+      ::DeleteFile(destination_file);
+      RemoveFromVerifiedHashIndex(destination_file);
+      return hr;
+    }
+
+    UpdateVerifiedHashIndex(destination_file, hash);
+    if (is_replaced) {
+      PurgeUnreferencedChunks();
+    }
+
+    ++metric_worker_package_cache_put_succeeded;
+    return S_OK;
   }
 
   // TODO(omaha): consider not overwriting the file if the file is
   // in the cache and it is valid.
 
-  // When not impersonated, File::Copy resets the ownership of the destination
-  // file and it inherits ACEs from the new parent directory.
-  hr = File::Copy(source_file, destination_file, true);
-  if (FAILED(hr)) {
-    CORE_LOG(LE, (_T("[failed to copy file to cache][0x%08x][%s]"),
-                  hr, destination_file));
-    return hr;
-  }
-
-  hr = VerifyHash(destination_file, hash);
+  // The copy in the cache is always hashed, even when the digest of the
+  // source is known, because the source file may have been replaced since it
+  // was hashed.
+  hr = CopyAndVerifyHash(source_file, destination_file, hash);
   if (FAILED(hr)) {
     CORE_LOG(LE,
-        (_T("[failed to verify hash for file '%s'][expected hash %s]"),
-        destination_file, internal::GetHashString(hash)));
-    VERIFY1(::DeleteFile(destination_file));
+        (_T("[failed to copy and verify file '%s'][0x%08x][expected hash %s]"),
+        destination_file, hr, internal::GetHashString(hash)));
+    RemoveFromVerifiedHashIndex(destination_file);
     return hr;
   }
 
+  UpdateVerifiedHashIndex(destination_file, hash);
+
   ++metric_worker_package_cache_put_succeeded;
   return S_OK;
 }
 
+HRESULT PackageCache::PutPackages(std::vector<BatchEntry>* entries) {
+  ASSERT1(entries);
+  CORE_LOG(L3, (_T("[PackageCache::PutPackages][%Iu packages]"),
+                entries->size()));
+
+  __mutexScope(cache_lock_);
+
+  // A chunked package is verified in memory before it is split, therefore
+  // the packages are put one at a time.
+  if (is_chunk_store_enabled_) {
+    for (size_t i = 0; i != entries->size(); ++i) {
+      BatchEntry& entry = (*entries)[i];
+      const Key key(entry.app_id, entry.version, entry.package_name);
+      entry.result = DoPut(key, entry.source_file, entry.hash, NULL);
+    }
+    return GetFirstError(*entries);
+  }
+
+  // The copies in the cache are hashed rather than the sources, since a
+  // source may be replaced after it is hashed.
+  std::vector<FileHashVerification> files;
+  std::vector<size_t> file_entries;
+  for (size_t i = 0; i != entries->size(); ++i) {
+    ++metric_worker_package_cache_put_total;
+
+    BatchEntry& entry = (*entries)[i];
+    const Key key(entry.app_id, entry.version, entry.package_name);
+    if (key.app_id().IsEmpty() || key.version().IsEmpty() ||
+        key.package_name().IsEmpty()) {
+      entry.result = E_INVALIDARG;
+      continue;
+    }
+
+    CString destination_file;
+    entry.result = PrepareCacheFileForKey(key, &destination_file);
+    if (FAILED(entry.result)) {
+      continue;
+    }
+
+    // When not impersonated, File::Copy resets the ownership of the
+    // destination file and it inherits ACEs from the new parent directory.
+    entry.result = File::Copy(entry.source_file, destination_file, true);
+    if (FAILED(entry.result)) {
+      CORE_LOG(LE, (_T("[failed to copy file to cache][0x%08x][%s]"),
+                    entry.result, destination_file));
+      ::DeleteFile(destination_file);
+      RemoveFromVerifiedHashIndex(destination_file);
+      continue;
+    }
+
+    const bool use_sha256 = !entry.hash.sha256.IsEmpty();
+    files.push_back(FileHashVerification(
+        destination_file,
+        use_sha256 ? entry.hash.sha256 : entry.hash.sha1,
+        use_sha256));
+    file_entries.push_back(i);
+  }
+
+  if (!files.empty()) {
+    HighresTimer verification_timer;
+    VerifyFileHashes(&files, kMaxVerificationThreads);
+    CORE_LOG(L3, (_T("[verified %Iu packages][%d ms]"),
+                  files.size(), verification_timer.GetElapsedMs()));
+  }
+
+  for (size_t i = 0; i != files.size(); ++i) {
+    BatchEntry& entry = (*entries)[file_entries[i]];
+    entry.result = files[i].result;
+    if (FAILED(entry.result)) {
+      CORE_LOG(LE, (_T("[failed to verify hash for file '%s'][0x%08x]")
+                    _T("[expected hash %s]"),
+                    files[i].file, entry.result,
+                    internal::GetHashString(entry.hash)));
+      ::DeleteFile(files[i].file);
+      RemoveFromVerifiedHashIndex(files[i].file);
+      continue;
+    }
+
+    UpdateVerifiedHashIndex(files[i].file, entry.hash);
+    ++metric_worker_package_cache_put_succeeded;
+  }
+
+  return GetFirstError(*entries);
+}
+
 HRESULT PackageCache::Get(const Key& key,
                           const CString& destination_file,
                           const FileHash& hash) const {
@@ -268,7 +912,16 @@ HRESULT PackageCache::Get(const Key& key,
     return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
   }
 
-  hr = VerifyHash(source_file, hash);
+  internal::ChunkManifest manifest;
+  hr = LoadChunkManifest(source_file, &manifest);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (hr == S_OK) {
+    return GetChunkedPackage(source_file, manifest, destination_file, hash);
+  }
+
+  hr = VerifyCachedFileHash(source_file, hash);
   if (FAILED(hr)) {
     CORE_LOG(LE, (_T("[failed to verify hash for file '%s'][expected hash %s]"),
         source_file, internal::GetHashString(hash)));
@@ -278,6 +931,94 @@ HRESULT PackageCache::Get(const Key& key,
   return File::Copy(source_file, destination_file, true);
 }
 
+HRESULT PackageCache::LoadUnverified(const Key& key,
+                                     CString* source_file,
+                                     internal::ChunkManifest* manifest) const {
+  ASSERT1(source_file);
+  ASSERT1(manifest);
+
+  if (key.app_id().IsEmpty() || key.version().IsEmpty() ||
+      key.package_name().IsEmpty()) {
+    return E_INVALIDARG;
+  }
+
+  HRESULT hr = BuildCacheFileNameForKey(key, source_file);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  if (!File::Exists(*source_file)) {
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+  }
+
+  return LoadChunkManifest(*source_file, manifest);
+}
+
+HRESULT PackageCache::ReadUnverified(const Key& key,
+                                     uint32 max_size,
+                                     std::vector<uint8>* contents) const {
+  CORE_LOG(L3, (_T("[PackageCache::ReadUnverified][key '%s']"),
+                key.ToString()));
+  ASSERT1(contents);
+
+  __mutexScope(cache_lock_);
+
+  CString source_file;
+  internal::ChunkManifest manifest;
+  HRESULT hr = LoadUnverified(key, &source_file, &manifest);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (hr == S_FALSE) {
+    return ReadEntireFileShareMode(source_file,
+                                   max_size,
+                                   FILE_SHARE_READ,
+                                   contents);
+  }
+
+  if (max_size != 0 && GetChunkedSize(manifest) > max_size) {
+    return MEM_E_INVALID_SIZE;
+  }
+
+  contents->clear();
+  std::vector<uint8> chunk;
+  for (size_t i = 0; i != manifest.size(); ++i) {
+    hr = ReadChunk(manifest[i], &chunk);
+    if (FAILED(hr)) {
+      contents->clear();
+      return hr;
+    }
+    contents->insert(contents->end(), chunk.begin(), chunk.end());
+  }
+
+  return S_OK;
+}
+
+HRESULT PackageCache::GetUnverifiedSize(const Key& key, uint64* size) const {
+  ASSERT1(size);
+
+  __mutexScope(cache_lock_);
+
+  CString source_file;
+  internal::ChunkManifest manifest;
+  HRESULT hr = LoadUnverified(key, &source_file, &manifest);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  if (hr == S_FALSE) {
+    uint32 file_size = 0;
+    hr = File::GetFileSizeUnopen(source_file, &file_size);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    *size = file_size;
+    return S_OK;
+  }
+
+  *size = GetChunkedSize(manifest);
+  return S_OK;
+}
+
 HRESULT PackageCache::Purge(const Key& key) {
   CORE_LOG(L3, (_T("[PackageCache::Purge][key '%s']"), key.ToString()));
 
@@ -346,8 +1087,11 @@ HRESULT PackageCache::PurgeAppLowerVersions(const CString& app_id,
     CString version_dir = ConcatenatePath(app_id_path, find_data.cFileName);
     hr = DeleteBeforeOrAfterReboot(version_dir);
     CORE_LOG(L3, (_T("[Purge version][%s][0x%x]"), version_dir, hr));
+    RemoveFromVerifiedHashIndex(version_dir);
   } while (::FindNextFile(get(hfind), &find_data));
 
+  PurgeUnreferencedChunks();
+
   return S_OK;
 }
 
@@ -403,11 +1147,17 @@ HRESULT PackageCache::PurgeOldPackagesIfNecessary() const {
 
   FILETIME expiration_time = GetCacheExpirationTime();
 
+  // The chunks shared by several chunked packages only count towards the size
+  // of the most recent package which contains them.
+  const bool has_chunks = File::IsDirectory(GetChunkStoreDirectory());
+  std::set<CString> counted_chunks;
+
   // Delete cached package based on the package info.
   std::vector<internal::PackageInfo>::const_iterator it;
   uint64 total_cache_size = 0;
   for (it = packages_info.begin(); it != packages_info.end(); ++it) {
-    total_cache_size += it->file_size.QuadPart;
+    total_cache_size += has_chunks ?
+        GetStoredPackageSize(*it, &counted_chunks) : it->file_size.QuadPart;
     if (total_cache_size > cache_size_limit_bytes_) {
       break;  // Remaining packages should be deleted as size limit is reached.
     }
@@ -416,8 +1166,105 @@ HRESULT PackageCache::PurgeOldPackagesIfNecessary() const {
     }
   }
 
+  const bool is_purged = it != packages_info.end();
   for (; it != packages_info.end(); ++it) {
     hr = DeleteBeforeOrAfterReboot(it->file_name);
+    RemoveFromVerifiedHashIndex(it->file_name);
+  }
+
+  if (is_purged && has_chunks) {
+    PurgeUnreferencedChunks();
+  }
+
+  return hr;
+}
+
+HRESULT PackageCache::ReverifyCachedPackages() const {
+  __mutexScope(cache_lock_);
+
+  if (!reverify_interval_sec_) {
+    return S_OK;
+  }
+
+  CORE_LOG(L3, (_T("[PackageCache::ReverifyCachedPackages]")));
+
+  // Hashes all the packages due for reverification as one batch, which
+  // verifies them concurrently. Missing packages fail the verification too.
+  // The chunked packages are rebuilt to be hashed, one at a time, after the
+  // full copies are hashed.
+  std::vector<FileHashVerification> files;
+  std::vector<FileHashVerification> chunked_files;
+  std::vector<internal::ChunkManifest> chunked_manifests;
+  for (internal::VerifiedHashIndex::const_iterator it =
+           verified_hash_index_.begin();
+       it != verified_hash_index_.end();
+       ++it) {
+    if (IsVerifiedHashRecordCurrent(it->second)) {
+      continue;
+    }
+
+    const CString filename(ConcatenatePath(cache_root_, it->first));
+    const bool use_sha256 =
+        it->second.hash.GetLength() == kSha256HashStringLength;
+    const FileHashVerification verification(filename,
+                                            it->second.hash,
+                                            use_sha256);
+    internal::ChunkManifest manifest;
+    if (LoadChunkManifest(filename, &manifest) == S_OK) {
+      chunked_files.push_back(verification);
+      chunked_manifests.push_back(manifest);
+    } else {
+      files.push_back(verification);
+    }
+  }
+
+  if (files.empty() && chunked_files.empty()) {
+    return S_OK;
+  }
+
+  HighresTimer verification_timer;
+  if (!files.empty()) {
+    VerifyFileHashes(&files, kMaxVerificationThreads);
+  }
+  for (size_t i = 0; i != chunked_files.size(); ++i) {
+    FileHash hash;
+    if (chunked_files[i].use_sha256) {
+      hash.sha256 = chunked_files[i].expected_hash;
+    } else {
+      hash.sha1 = chunked_files[i].expected_hash;
+    }
+    chunked_files[i].result = VerifyChunkedPackage(chunked_files[i].file,
+                                                   chunked_manifests[i],
+                                                   hash);
+    files.push_back(chunked_files[i]);
+  }
+  CORE_LOG(L3, (_T("[reverified %u packages][%d ms]"),
+                files.size(), verification_timer.GetElapsedMs()));
+
+  HRESULT hr = S_OK;
+  bool is_purged = false;
+  for (size_t i = 0; i != files.size(); ++i) {
+    const CString& filename = files[i].file;
+    if (SUCCEEDED(files[i].result)) {
+      FileHash hash;
+      if (files[i].use_sha256) {
+        hash.sha256 = files[i].expected_hash;
+      } else {
+        hash.sha1 = files[i].expected_hash;
+      }
+      UpdateVerifiedHashIndex(filename, hash);
+      continue;
+    }
+
+    CORE_LOG(LW, (_T("[purging package failing reverification][%s][0x%08x]"),
+                  filename, files[i].result));
+    hr = DeleteBeforeOrAfterReboot(filename);
+    RemoveFromVerifiedHashIndex(filename);
+    is_purged = true;
+  }
+
+  if (is_purged) {
+    PurgeUnreferencedChunks();
   }
 
   return hr;
@@ -433,7 +1280,10 @@ HRESULT PackageCache::Delete(const CString& app_id,
     return hr;
   }
 
-  return DeleteBeforeOrAfterReboot(filename);
+  RemoveFromVerifiedHashIndex(filename);
+  hr = DeleteBeforeOrAfterReboot(filename);
+  PurgeUnreferencedChunks();
+  return hr;
 }
 
 CString PackageCache::cache_root() const {
@@ -447,7 +1297,336 @@ CString PackageCache::cache_root() const {
 
 uint64 PackageCache::Size() const {
   uint64 result(0);
-  return SUCCEEDED(GetDirectorySize(cache_root_, &result)) ? result : 0;
+  if (FAILED(GetDirectorySize(cache_root_, &result))) {
+    return 0;
+  }
+
+  // The verified hash index is bookkeeping and not part of the cached data.
+  uint32 index_size(0);
+  if (SUCCEEDED(File::GetFileSizeUnopen(GetVerifiedHashIndexFileName(),
+                                        &index_size))) {
+    ASSERT1(result >= index_size);
+    result -= index_size;
+  }
+
+  return result;
+}
+
+HRESULT PackageCache::PutChunkedPackage(const std::vector<uint8>& contents,
+                                        const CString& manifest_file) {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  const CString chunk_dir(GetChunkStoreDirectory());
+  HRESULT hr = CreateDir(chunk_dir, NULL);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[CreateDir failed][0x%x][%s]"), hr, chunk_dir));
+    return hr;
+  }
+
+  const uint8* data = contents.empty() ? NULL : &contents.front();
+  std::vector<size_t> chunk_ends;
+  internal::FindChunkBoundaries(data, contents.size(), &chunk_ends);
+
+  CryptoHash crypto(CryptoHash::kSha256);
+  internal::ChunkManifest manifest;
+  size_t start = 0;
+  for (size_t i = 0; i != chunk_ends.size(); ++i) {
+    const std::vector<uint8> chunk(data + start, data + chunk_ends[i]);
+    start = chunk_ends[i];
+
+    std::vector<uint8> chunk_hash;
+    hr = crypto.Compute(chunk, &chunk_hash);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    const internal::ChunkReference reference(
+        BytesToHex(chunk_hash),
+        static_cast<uint32>(chunk.size()));
+    manifest.push_back(reference);
+
+    // The write time of a shared chunk is renewed, so that another process
+    // which purges the unreferenced chunks leaves it alone until the manifest
+    // which references it is written. The chunk is stored again if it was
+    // purged meanwhile.
+    const CString chunk_file(GetChunkFileName(reference.hash));
+    if (File::Exists(chunk_file)) {
+      FILETIME now = {0};
+      ::GetSystemTimeAsFileTime(&now);
+      if (SUCCEEDED(File::SetFileTime(chunk_file, NULL, NULL, &now))) {
+        metric_worker_package_cache_chunk_bytes_shared += chunk.size();
+        continue;
+      }
+    }
+
+    // The chunk is written next to its final name and then renamed, so that
+    // an interrupted write never leaves a truncated chunk behind.
+    const CString temp_file(chunk_file + _T(".tmp"));
+    hr = WriteEntireFile(temp_file, chunk);
+    if (SUCCEEDED(hr)) {
+      hr = File::Move(temp_file, chunk_file, true);
+    }
+    if (FAILED(hr)) {
+      CORE_LOG(LE, (_T("[failed to store chunk][0x%08x][%s]"),
+                    hr, chunk_file));
+      ::DeleteFile(temp_file);
+      return hr;
+    }
+    metric_worker_package_cache_chunk_bytes_stored += chunk.size();
+  }
+
+  std::vector<uint8> buffer;
+  internal::SerializeChunkManifest(manifest, &buffer);
+  return WriteEntireFile(manifest_file, buffer);
+}
+
+HRESULT PackageCache::LoadChunkManifest(
+    const CString& filename,
+    internal::ChunkManifest* manifest) const {
+  ASSERT1(manifest);
+
+  uint8 header[arraysize(kChunkManifestHeader) - 1] = {0};
+  uint32 bytes_read = 0;
+  {
+    File file;
+    HRESULT hr = file.OpenShareMode(filename, false, false, FILE_SHARE_READ);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    hr = file.Read(sizeof(header), header, &bytes_read);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  if (!internal::IsChunkManifest(header, bytes_read)) {
+    return S_FALSE;
+  }
+
+  std::vector<uint8> buffer;
+  HRESULT hr = ReadEntireFileShareMode(filename, 0, FILE_SHARE_READ, &buffer);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  if (!internal::DeserializeChunkManifest(buffer, manifest)) {
+    CORE_LOG(LE, (_T("[invalid chunk manifest][%s]"), filename));
+    return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+  }
+
+  return S_OK;
+}
+
+HRESULT PackageCache::ReadChunk(const internal::ChunkReference& chunk,
+                                std::vector<uint8>* contents) const {
+  ASSERT1(contents);
+
+  const CString chunk_file(GetChunkFileName(chunk.hash));
+  HRESULT hr = ReadEntireFileShareMode(chunk_file,
+                                       0,
+                                       FILE_SHARE_READ,
+                                       contents);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to read chunk][0x%08x][%s]"), hr, chunk_file));
+    return hr;
+  }
+
+  std::vector<uint8> expected_hash;
+  VERIFY1(SafeHexStringToVector(chunk.hash, &expected_hash));
+  hr = contents->size() == chunk.size ?
+      CryptoHash(CryptoHash::kSha256).Validate(*contents, expected_hash) :
+      SIGS_E_INVALID_SIGNATURE;
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[chunk does not match its hash][0x%08x][%s]"),
+                  hr, chunk_file));
+    ::DeleteFile(chunk_file);
+    return hr;
+  }
+
+  return S_OK;
+}
+
+HRESULT PackageCache::GetChunkedPackage(const CString& manifest_file,
+                                        const internal::ChunkManifest& manifest,
+                                        const CString& destination_file,
+                                        const FileHash& hash) const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  // File::Open does not truncate an existing file.
+  if (File::Exists(destination_file)) {
+    HRESULT hr = File::Remove(destination_file);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
+  HRESULT hr = S_OK;
+  {
+    File file;
+    hr = file.Open(destination_file, true, false);
+    if (FAILED(hr)) {
+      return hr;
+    }
+
+    std::vector<uint8> chunk;
+    for (size_t i = 0; i != manifest.size() && SUCCEEDED(hr); ++i) {
+      hr = ReadChunk(manifest[i], &chunk);
+      if (SUCCEEDED(hr)) {
+        uint32 bytes_written = 0;
+        hr = file.Write(&chunk.front(),
+                        static_cast<uint32>(chunk.size()),
+                        &bytes_written);
+      }
+    }
+  }
+
+  if (SUCCEEDED(hr) && !HasCurrentVerifiedHashRecord(manifest_file, hash)) {
+    hr = VerifyHash(destination_file, hash);
+    if (SUCCEEDED(hr)) {
+      UpdateVerifiedHashIndex(manifest_file, hash);
+    }
+  }
+
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to get chunked package '%s'][0x%08x]"),
+                  manifest_file, hr));
+    RemoveFromVerifiedHashIndex(manifest_file);
+    ::DeleteFile(destination_file);
+    return hr;
+  }
+
+  return S_OK;
+}
+
+HRESULT PackageCache::VerifyChunkedPackage(
+    const CString& manifest_file,
+    const internal::ChunkManifest& manifest,
+    const FileHash& hash) const {
+  const CString temp_file(GetTempFilenameAt(cache_root_, _T("chk")));
+  if (temp_file.IsEmpty()) {
+    return E_FAIL;
+  }
+
+  HRESULT hr = GetChunkedPackage(manifest_file, manifest, temp_file, hash);
+  ::DeleteFile(temp_file);
+  return hr;
+}
+
+uint64 PackageCache::GetStoredPackageSize(
+    const internal::PackageInfo& package_info,
+    std::set<CString>* counted_chunks) const {
+  ASSERT1(counted_chunks);
+
+  uint64 size = package_info.file_size.QuadPart;
+  internal::ChunkManifest manifest;
+  if (LoadChunkManifest(package_info.file_name, &manifest) != S_OK) {
+    return size;
+  }
+
+  for (size_t i = 0; i != manifest.size(); ++i) {
+    CString hash(manifest[i].hash);
+    hash.MakeLower();
+    if (counted_chunks->insert(hash).second) {
+      size += manifest[i].size;
+    }
+  }
+
+  return size;
+}
+
+void PackageCache::PurgeUnreferencedChunks() const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  const CString chunk_dir(GetChunkStoreDirectory());
+  if (!File::IsDirectory(chunk_dir)) {
+    return;
+  }
+
+  std::vector<internal::PackageInfo> packages_info;
+  HRESULT hr = internal::FindAllPackagesInfo(cache_root_, &packages_info);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[FindAllPackagesInfo failed][0x%x]"), hr));
+    return;
+  }
+
+  std::set<CString> referenced_chunks;
+  for (size_t i = 0; i != packages_info.size(); ++i) {
+    internal::ChunkManifest manifest;
+    hr = LoadChunkManifest(packages_info[i].file_name, &manifest);
+    if (hr == HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT)) {
+      continue;
+    }
+    if (FAILED(hr)) {
+      // The chunks of a manifest which can't be read may still be in use.
+      CORE_LOG(LW, (_T("[not purging chunks][0x%x][%s]"),
+                    hr, packages_info[i].file_name));
+      return;
+    }
+
+    for (size_t j = 0; j != manifest.size(); ++j) {
+      CString hash(manifest[j].hash);
+      hash.MakeLower();
+      referenced_chunks.insert(hash);
+    }
+  }
+
+  WIN32_FIND_DATA find_data = {0};
+  scoped_hfind hfind(::FindFirstFile(chunk_dir + _T("\\*"), &find_data));
+  if (!hfind) {
+    return;
+  }
+
+  // The lock of the cache is not shared with the other processes, which may
+  // be storing chunks that their manifests do not reference yet. The chunks
+  // and the temporary files written during the grace period are kept.
+  const uint64 now = GetCurrent100NSTime();
+  int num_purged = 0;
+  do {
+    if (!internal::IsFileFindData(find_data)) {
+      continue;
+    }
+    const uint64 write_time = FileTimeToTime64(find_data.ftLastWriteTime);
+    if (write_time + chunk_purge_grace_period_100ns_ > now) {
+      continue;
+    }
+
+    CString hash(find_data.cFileName);
+    hash.MakeLower();
+    if (referenced_chunks.find(hash) == referenced_chunks.end()) {
+      VERIFY1(::DeleteFile(ConcatenatePath(chunk_dir, find_data.cFileName)));
+      ++num_purged;
+    }
+  } while (::FindNextFile(get(hfind), &find_data));
+
+  CORE_LOG(L3, (_T("[purged %d unreferenced chunks]"), num_purged));
+}
+
+CString PackageCache::GetChunkStoreDirectory() const {
+  return ConcatenatePath(cache_root_, kChunkStoreDirectoryName);
+}
+
+CString PackageCache::GetChunkFileName(const CString& hash) const {
+  return ConcatenatePath(GetChunkStoreDirectory(), hash);
+}
+
+HRESULT PackageCache::PrepareCacheFileForKey(const Key& key,
+                                             CString* destination_file) const {
+  ASSERT1(destination_file);
+
+  HRESULT hr = BuildCacheFileNameForKey(key, destination_file);
+  CORE_LOG(L3, (_T("[destination file '%s']"), *destination_file));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  hr = CreateDir(GetDirectoryFromPath(*destination_file), NULL);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to create cache directory][0x%08x][%s]"),
+                  hr, *destination_file));
+    return hr;
+  }
+
+  return S_OK;
 }
 
 HRESULT PackageCache::BuildCacheFileNameForKey(const Key& key,
@@ -498,5 +1677,167 @@ HRESULT PackageCache::VerifyHash(const CString& filename,
   return hr;
 }
 
+bool PackageCache::HasCurrentVerifiedHashRecord(const CString& filename,
+                                                const FileHash& hash) const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  const CString key(GetVerifiedHashIndexKey(filename));
+  internal::VerifiedHashIndex::const_iterator it =
+      verified_hash_index_.find(key);
+  if (it == verified_hash_index_.end() ||
+      it->second.hash != internal::GetHashString(hash) ||
+      !IsVerifiedHashRecordCurrent(it->second)) {
+    return false;
+  }
+
+  internal::VerifiedHashRecord current;
+  if (FAILED(internal::GetFileIdentity(filename, &current)) ||
+      !internal::IsSameFileIdentity(current, it->second)) {
+    return false;
+  }
+
+  CORE_LOG(L3, (_T("[verified hash record found][%s]"), filename));
+  return true;
+}
+
+HRESULT PackageCache::VerifyCachedFileHash(const CString& filename,
+                                           const FileHash& hash) const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  if (HasCurrentVerifiedHashRecord(filename, hash)) {
+    return S_OK;
+  }
+
+  HRESULT hr = VerifyHash(filename, hash);
+  if (FAILED(hr)) {
+    RemoveFromVerifiedHashIndex(filename);
+    return hr;
+  }
+
+  UpdateVerifiedHashIndex(filename, hash);
+  return S_OK;
+}
+
+void PackageCache::UpdateVerifiedHashIndex(const CString& filename,
+                                           const FileHash& hash) const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  internal::VerifiedHashRecord record;
+  HRESULT hr = internal::GetFileIdentity(filename, &record);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[GetFileIdentity failed][%s][0x%08x]"), filename, hr));
+    RemoveFromVerifiedHashIndex(filename);
+    return;
+  }
+
+  record.hash = internal::GetHashString(hash);
+  record.verified_time = GetCurrent100NSTime();
+  verified_hash_index_[GetVerifiedHashIndexKey(filename)] = record;
+
+  SaveVerifiedHashIndex();
+}
+
+void PackageCache::RemoveFromVerifiedHashIndex(const CString& path) const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  const CString key(GetVerifiedHashIndexKey(path));
+
+  bool is_modified = false;
+  internal::VerifiedHashIndex::iterator it = verified_hash_index_.begin();
+  while (it != verified_hash_index_.end()) {
+    // An empty key matches the cache root, therefore all records.
+    const bool is_match = key.IsEmpty() ||
+                          it->first == key ||
+                          String_StartsWith(it->first, key + _T("\\"), false);
+    if (is_match) {
+      it = verified_hash_index_.erase(it);
+      is_modified = true;
+    } else {
+      ++it;
+    }
+  }
+
+  if (is_modified) {
+    SaveVerifiedHashIndex();
+  }
+}
+
+bool PackageCache::IsVerifiedHashRecordCurrent(
+    const internal::VerifiedHashRecord& record) const {
+  if (!reverify_interval_sec_) {
+    return true;
+  }
+
+  const uint64 now = GetCurrent100NSTime();
+  const uint64 interval = static_cast<uint64>(reverify_interval_sec_) *
+                          kSecsTo100ns;
+  return record.verified_time <= now && now - record.verified_time < interval;
+}
+
+CString PackageCache::GetVerifiedHashIndexKey(const CString& filename) const {
+  CString key(filename);
+  if (String_StartsWith(key, cache_root_, true)) {
+    key = key.Mid(cache_root_.GetLength());
+  }
+  key.TrimLeft(_T('\\'));
+  key.MakeLower();
+  return key;
+}
+
+CString PackageCache::GetVerifiedHashIndexFileName() const {
+  return ConcatenatePath(cache_root_, kVerifiedHashIndexFileName);
+}
+
+void PackageCache::LoadVerifiedHashIndex() {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  verified_hash_index_.clear();
+
+  const CString index_file(GetVerifiedHashIndexFileName());
+  if (!File::Exists(index_file)) {
+    return;
+  }
+
+  std::vector<uint8> buffer;
+  HRESULT hr = ReadEntireFile(index_file, 0, &buffer);
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[failed to read verified hash index][0x%08x]"), hr));
+    return;
+  }
+
+  internal::DeserializeVerifiedHashIndex(buffer, &verified_hash_index_);
+  CORE_LOG(L3, (_T("[loaded verified hash index][%d records]"),
+                verified_hash_index_.size()));
+}
+
+void PackageCache::SaveVerifiedHashIndex() const {
+  ASSERT1(::GetCurrentThreadId() == cache_lock_.GetOwner());
+
+  const CString index_file(GetVerifiedHashIndexFileName());
+  if (verified_hash_index_.empty()) {
+    if (File::Exists(index_file)) {
+      VERIFY1(SUCCEEDED(File::Remove(index_file)));
+    }
+    return;
+  }
+
+  std::vector<uint8> buffer;
+  internal::SerializeVerifiedHashIndex(verified_hash_index_, &buffer);
+
+  // Writes the new index next to the old one and then replaces it, so that
+  // an interrupted write never leaves a truncated index behind.
+  const CString temp_file(index_file + _T(".tmp"));
+  HRESULT hr = WriteEntireFile(temp_file, buffer);
+  if (SUCCEEDED(hr)) {
+    hr = File::Move(temp_file, index_file, true);
+  }
+
+  if (FAILED(hr)) {
+    CORE_LOG(LW, (_T("[failed to save verified hash index][0x%08x]"), hr));
+    ::DeleteFile(temp_file);
+    ::DeleteFile(index_file);
+  }
+}
+
 }  // namespace omaha
 
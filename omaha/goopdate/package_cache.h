@@ -18,15 +18,16 @@
 
 #include <windows.h>
 #include <atlstr.h>
+#include <set>
 #include <vector>
 #include "base/basictypes.h"
 #include "base/synchronized.h"
 #include "omaha/base/safe_format.h"
+#include "omaha/goopdate/file_hash.h"
+#include "omaha/goopdate/package_cache_internal.h"
 
 namespace omaha {
 
-struct FileHash;
-
 class PackageCache {
  public:
   // Defines the key that uniquely identifies the packages in the cache.
@@ -60,6 +61,23 @@ class PackageCache {
     DISALLOW_COPY_AND_ASSIGN(Key);
   };
 
+  // A package which is verified or cached in a batch with other packages.
+  struct BatchEntry {
+    BatchEntry() : result(E_PENDING) {}
+
+    CString app_id;
+    CString version;
+    CString package_name;
+    FileHash hash;
+
+    // The file to cache, for PutPackages.
+    CString source_file;
+
+    // S_OK if the package is in the cache and matches its hash, or the error
+    // otherwise.
+    HRESULT result;
+  };
+
   PackageCache();
   ~PackageCache();
 
@@ -69,12 +87,45 @@ class PackageCache {
               const CString& source_file,
               const FileHash& hash);
 
+  // Same as Put but the caller provides the SHA-256 digest of the source file,
+  // computed for instance while the file was downloaded. When the expected
+  // hash is a SHA-256 hash, a digest which does not match fails before the
+  // file is copied. The copy in the cache is hashed in either case.
+  HRESULT PutWithDigest(const Key& key,
+                        const CString& source_file,
+                        const FileHash& hash,
+                        const std::vector<uint8>& source_sha256);
+
+  // Caches several packages. The files are copied into the cache, then the
+  // copies are hashed concurrently in one batch, like the reverification.
+  // The result of each package is set in its entry. Returns S_OK if all the
+  // packages are cached, or the first error otherwise.
+  HRESULT PutPackages(std::vector<BatchEntry>* entries);
+
   HRESULT Get(const Key& key,
               const CString& destination_file,
               const FileHash& hash) const;
 
   bool IsCached(const Key& key, const FileHash& hash) const;
 
+  // Same as IsCached for several packages. The full copies which have no
+  // current verified hash record are hashed concurrently in one batch, so
+  // the next IsCached and Get calls do not hash them one at a time.
+  void VerifyCachedPackages(std::vector<BatchEntry>* entries) const;
+
+  // Reads a cached package whose hash is not known, such as the package of a
+  // previous version which a differential patch is applied to. The caller
+  // must verify whatever it builds from the contents. Fails with
+  // MEM_E_INVALID_SIZE if the package is larger than |max_size|, unless
+  // |max_size| is 0.
+  HRESULT ReadUnverified(const Key& key,
+                         uint32 max_size,
+                         std::vector<uint8>* contents) const;
+
+  // Returns the size of a cached package whose hash is not known, without
+  // reading the package. Fails if the package is not cached.
+  HRESULT GetUnverifiedSize(const Key& key, uint64* size) const;
+
   HRESULT Purge(const Key& key);
 
   HRESULT PurgeVersion(const CString& app_id, const CString& version);
@@ -91,8 +142,15 @@ class PackageCache {
   // purging oldest ones.
   HRESULT PurgeOldPackagesIfNecessary() const;
 
-  // Returns the total size of all files in the cache. Returns 0 if the size
-  // cannot be determined or the cache is empty.
+  // Hashes again the cached packages whose verified hash records are older
+  // than the reverification interval and purges the packages that do not
+  // match their recorded hash anymore. Does nothing unless the paranoid
+  // verification mode is enabled by the PackageCacheReverifySec override.
+  HRESULT ReverifyCachedPackages() const;
+
+  // Returns the total size of all files in the cache, with the chunks shared
+  // by several packages counted once. Returns 0 if the size cannot be
+  // determined or the cache is empty.
   uint64 Size() const;
 
   CString cache_root() const;
@@ -103,12 +161,100 @@ class PackageCache {
  private:
   friend class PackageCacheTest;
 
+  // Caches the file. |source_sha256| is optional and it contains the digest of
+  // the source file.
+  HRESULT DoPut(const Key& key,
+                const CString& source_file,
+                const FileHash& hash,
+                const std::vector<uint8>* source_sha256);
+
+  // Builds the name of the cached file of a package and creates its
+  // directory.
+  HRESULT PrepareCacheFileForKey(const Key& key,
+                                 CString* destination_file) const;
+
+  // Splits the package into chunks, stores the chunks which are not stored
+  // yet, and writes the manifest of the package.
+  HRESULT PutChunkedPackage(const std::vector<uint8>& contents,
+                            const CString& manifest_file);
+
+  // Loads the manifest of a cached package. Returns S_FALSE if the cached
+  // file is a full copy of the package instead of a manifest.
+  HRESULT LoadChunkManifest(const CString& filename,
+                            internal::ChunkManifest* manifest) const;
+
+  // Finds the cached file of a package whose hash is not known, and loads its
+  // manifest. Returns S_FALSE if the cached file is a full copy of the
+  // package. The cache lock must be held by the caller.
+  HRESULT LoadUnverified(const Key& key,
+                         CString* source_file,
+                         internal::ChunkManifest* manifest) const;
+
+  // Reads a stored chunk and checks it against its hash. A chunk which does
+  // not match its hash is deleted, so that it is stored again by the next
+  // package which contains it.
+  HRESULT ReadChunk(const internal::ChunkReference& chunk,
+                    std::vector<uint8>* contents) const;
+
+  // Rebuilds a chunked package into the destination file. The package is
+  // hashed unless the verified hash index has a current record for the
+  // manifest and the hash, since the chunks are checked as they are read.
+  HRESULT GetChunkedPackage(const CString& manifest_file,
+                            const internal::ChunkManifest& manifest,
+                            const CString& destination_file,
+                            const FileHash& hash) const;
+
+  // Verifies a chunked package by rebuilding it into a temporary file.
+  HRESULT VerifyChunkedPackage(const CString& manifest_file,
+                               const internal::ChunkManifest& manifest,
+                               const FileHash& hash) const;
+
+  // Returns the size the package adds to the cache when the chunks in
+  // |counted_chunks| are already accounted for, and adds the chunks of the
+  // package to |counted_chunks|.
+  uint64 GetStoredPackageSize(const internal::PackageInfo& package_info,
+                              std::set<CString>* counted_chunks) const;
+
+  // Deletes the stored chunks which no cached package refers to.
+  void PurgeUnreferencedChunks() const;
+
+  CString GetChunkStoreDirectory() const;
+  CString GetChunkFileName(const CString& hash) const;
+
   HRESULT BuildCacheFileNameForKey(const Key& key, CString* filename) const;
   HRESULT BuildCacheFileName(const CString& app_id,
                              const CString& version,
                              const CString& package_name,
                              CString* filename) const;
 
+  // Returns true if the verified hash index has a current record for the file
+  // and the hash, and the file was not modified since it was verified.
+  bool HasCurrentVerifiedHashRecord(const CString& filename,
+                                    const FileHash& hash) const;
+
+  // Verifies the hash of a file in the cache. The file is only hashed when the
+  // verified hash index has no current record for the file and the hash.
+  HRESULT VerifyCachedFileHash(const CString& filename,
+                               const FileHash& hash) const;
+
+  // Records that the file currently matches the hash and persists the index.
+  void UpdateVerifiedHashIndex(const CString& filename,
+                               const FileHash& hash) const;
+
+  // Removes the records of the files under the path and persists the index.
+  // The path can be a file or a directory in the cache.
+  void RemoveFromVerifiedHashIndex(const CString& path) const;
+
+  // Returns true if a record is recent enough to be trusted without hashing
+  // the file again.
+  bool IsVerifiedHashRecordCurrent(
+      const internal::VerifiedHashRecord& record) const;
+
+  CString GetVerifiedHashIndexKey(const CString& filename) const;
+  CString GetVerifiedHashIndexFileName() const;
+  void LoadVerifiedHashIndex();
+  void SaveVerifiedHashIndex() const;
+
   // Deletes the cache entries that match the app_id, version, and package_name.
   // If the parameters are empty, the function deletes the packages of versions
   // of apps, respectively.
@@ -128,8 +274,26 @@ class PackageCache {
   // size, files will be purged using a least-recently-added metric.
   uint64 cache_size_limit_bytes_;
 
+  // How long, in seconds, a verified hash record is trusted before the file
+  // is hashed again. Zero means the records are trusted for as long as the
+  // file is not modified.
+  int reverify_interval_sec_;
+
+  // True if the packages are put in the cache as chunks. The cached packages
+  // are read in either layout regardless of this setting.
+  bool is_chunk_store_enabled_;
+
+  // The unreferenced chunks which were written or shared more recently are
+  // not purged, since another process may be putting a package which
+  // references them.
+  uint64 chunk_purge_grace_period_100ns_;
+
   CString cache_root_;
 
+  // Avoids hashing the same unmodified package on every IsCached and Get call.
+  // It is loaded from the cache root when the cache is initialized.
+  mutable internal::VerifiedHashIndex verified_hash_index_;
+
   LLock cache_lock_;
 
   DISALLOW_COPY_AND_ASSIGN(PackageCache);
@@ -18,6 +18,7 @@
 
 #include <windows.h>
 #include <atlstr.h>
+#include <map>
 #include <vector>
 #include "base/basictypes.h"
 #include "base/synchronized.h"
@@ -77,6 +78,92 @@ HRESULT FindDirectoryPackagesInfo(const CString& dir_path,
 
 void SortPackageInfoByTime(std::vector<PackageInfo>* packages_info);
 
+// Records the identity of a cached file at the time its hash was verified.
+// As long as the size, the last write time, and the file id of the file do not
+// change, the file is assumed to still match the recorded hash.
+struct VerifiedHashRecord {
+  VerifiedHashRecord()
+      : file_size(0),
+        last_write_time(0),
+        volume_serial_number(0),
+        file_index(0),
+        verified_time(0) {}
+
+  uint64 file_size;
+  uint64 last_write_time;
+  uint32 volume_serial_number;
+  uint64 file_index;
+
+  // The time, in 100ns units, when the hash of the file was last computed.
+  uint64 verified_time;
+
+  // The expected hash the file was verified against.
+  CString hash;
+};
+
+// Maps the path of a cached file, relative to the cache root and lowercased,
+// to its verification record.
+typedef std::map<CString, VerifiedHashRecord> VerifiedHashIndex;
+
+// Fills in the identity members of |record| for the file. The hash and the
+// verification time are not modified.
+HRESULT GetFileIdentity(const CString& filename, VerifiedHashRecord* record);
+
+// Returns true if the two records describe the same unmodified file.
+bool IsSameFileIdentity(const VerifiedHashRecord& record1,
+                        const VerifiedHashRecord& record2);
+
+// Serializes the index as UTF-8 text, one record per line.
+void SerializeVerifiedHashIndex(const VerifiedHashIndex& index,
+                                std::vector<uint8>* buffer);
+
+// Deserializes the index. Malformed lines are skipped so that a corrupted
+// index only results in the affected files being hashed again.
+void DeserializeVerifiedHashIndex(const std::vector<uint8>& buffer,
+                                  VerifiedHashIndex* index);
+
+// When the chunk store is enabled, the packages are split into chunks whose
+// boundaries depend on the content only: a chunk ends where the rolling CRC of
+// the last kChunkWindowSize bytes has its low bits clear. An edit in a new
+// version of a package only changes the chunks around it, and the chunks are
+// stored once no matter how many packages contain them.
+const size_t kChunkWindowSize = 48;
+const size_t kMinChunkSize = 16 * 1024;
+const size_t kMaxChunkSize = 256 * 1024;
+const uint64 kChunkBoundaryMask = 64 * 1024 - 1;
+
+// Splits the data into content-defined chunks and returns the offset of the
+// end of each chunk. Empty data has no chunks.
+void FindChunkBoundaries(const uint8* data,
+                         size_t size,
+                         std::vector<size_t>* chunk_ends);
+
+// A chunk of a package, identified by its hex encoded SHA-256 hash.
+struct ChunkReference {
+  ChunkReference() : size(0) {}
+  ChunkReference(const CString& hash, uint32 size) : hash(hash), size(size) {}
+
+  CString hash;
+  uint32 size;
+};
+
+// The chunks of a package, in order. A chunked package is cached as its
+// manifest under the app, version, and package name of the package.
+typedef std::vector<ChunkReference> ChunkManifest;
+
+// Returns true if the data starts like a serialized manifest. The cached
+// packages which do not are full copies of the packages.
+bool IsChunkManifest(const uint8* data, size_t size);
+
+// Serializes the manifest as UTF-8 text, one chunk per line.
+void SerializeChunkManifest(const ChunkManifest& manifest,
+                            std::vector<uint8>* buffer);
+
+// Deserializes the manifest. Unlike the verified hash index, a manifest is
+// rejected as a whole if any of its lines is malformed.
+bool DeserializeChunkManifest(const std::vector<uint8>& buffer,
+                              ChunkManifest* manifest);
+
 }  // namespace internal
 
 }  // namespace omaha
@@ -13,15 +13,21 @@
 // limitations under the License.
 // ========================================================================
 
+#include <algorithm>
 #include "omaha/base/app_util.h"
 #include "omaha/base/error.h"
 #include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
 #include "omaha/base/path.h"
 #include "omaha/base/safe_format.h"
+#include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
+#include "omaha/base/time.h"
 #include "omaha/base/utils.h"
 #include "omaha/goopdate/file_hash.h"
 #include "omaha/goopdate/package_cache.h"
+#include "omaha/goopdate/package_cache_internal.h"
 #include "omaha/testing/unit_test.h"
 
 namespace omaha {
@@ -35,6 +41,57 @@ const TCHAR* kFile2Sha1Hash = _T("Igq6bYaeXFJCjH770knXyJ6V53s=");
 const TCHAR* kFile2Sha256Hash =
     _T("f0bbd84d7ec364f6c33161d781b49d840ed792b8b10668c4180b9e6e128d0bc9");
 
+// A linear congruential generator for the synthetic packages, so that the
+// tests do not depend on the state of the CRT generator.
+class TestRandom {
+ public:
+  explicit TestRandom(uint32 seed) : state_(seed) {}
+
+  // The low bits of the state repeat quickly, therefore only the high bits
+  // are returned.
+  uint32 Next() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_ >> 16;
+  }
+
+ private:
+  uint32 state_;
+};
+
+std::vector<uint8> MakeSyntheticPackage(size_t size, TestRandom* random) {
+  std::vector<uint8> data(size);
+  for (size_t i = 0; i != size; ++i) {
+    data[i] = static_cast<uint8>(random->Next());
+  }
+  return data;
+}
+
+// Makes the next version of a synthetic package by replacing, inserting, and
+// deleting short ranges of bytes.
+std::vector<uint8> EditSyntheticPackage(const std::vector<uint8>& data,
+                                        int num_edits,
+                                        TestRandom* random) {
+  std::vector<uint8> edited(data);
+  for (int i = 0; i < num_edits; ++i) {
+    const size_t pos = random->Next() * 4096 % (edited.size() - 256);
+    const size_t length = random->Next() % 256 + 1;
+    switch (random->Next() % 3) {
+      case 0:
+        for (size_t j = 0; j != length; ++j) {
+          edited[pos + j] = static_cast<uint8>(random->Next());
+        }
+        break;
+      case 1:
+        edited.insert(edited.begin() + pos, length, static_cast<uint8>(i));
+        break;
+      default:
+        edited.erase(edited.begin() + pos, edited.begin() + pos + length);
+        break;
+    }
+  }
+  return edited;
+}
+
 }  // namespace
 
 class PackageCacheTest : public testing::TestWithParam<bool> {
@@ -77,6 +134,9 @@ class PackageCacheTest : public testing::TestWithParam<bool> {
     EXPECT_FALSE(String_EndsWith(cache_root_, _T("\\"), true));
     EXPECT_HRESULT_SUCCEEDED(package_cache_.Initialize(cache_root_));
     EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAll());
+
+    // The tests purge the chunks they have just written.
+    SetChunkPurgeGracePeriod(0);
   }
 
   virtual void TearDown() {
@@ -117,6 +177,101 @@ class PackageCacheTest : public testing::TestWithParam<bool> {
     package_cache_.cache_time_limit_days_ = limit_days;
   }
 
+  void SetReverifyIntervalSec(int interval_sec) {
+    package_cache_.reverify_interval_sec_ = interval_sec;
+  }
+
+  void SetChunkStoreEnabled(bool is_enabled) {
+    package_cache_.is_chunk_store_enabled_ = is_enabled;
+  }
+
+  void SetChunkPurgeGracePeriod(uint64 grace_period_100ns) {
+    package_cache_.chunk_purge_grace_period_100ns_ = grace_period_100ns;
+  }
+
+  CString GetChunkStoreDirectory() const {
+    return ConcatenatePath(cache_root_, _T("chunks"));
+  }
+
+  std::vector<CString> GetStoredChunks() const {
+    std::vector<CString> chunks;
+    File::GetWildcards(GetChunkStoreDirectory(), _T("*"), &chunks);
+    return chunks;
+  }
+
+  // Writes the package to a temporary file and computes its hash.
+  void WriteSyntheticPackage(const std::vector<uint8>& contents,
+                             CString* filename,
+                             FileHash* hash) const {
+    *filename = GetTempFilename(_T("ut_"));
+    ASSERT_FALSE(filename->IsEmpty());
+    ASSERT_HRESULT_SUCCEEDED(WriteEntireFile(*filename, contents));
+
+    std::vector<uint8> digest;
+    CryptoHash sha1(CryptoHash::kSha1);
+    ASSERT_HRESULT_SUCCEEDED(sha1.Compute(contents, &digest));
+    ASSERT_HRESULT_SUCCEEDED(Base64::Encode(digest, &hash->sha1, false));
+
+    hash->sha256.Empty();
+    if (GetParam()) {
+      CryptoHash sha256(CryptoHash::kSha256);
+      ASSERT_HRESULT_SUCCEEDED(sha256.Compute(contents, &digest));
+      hash->sha256 = BytesToHex(digest);
+    }
+  }
+
+  void ExpectCachedContents(const Key& key,
+                            const FileHash& hash,
+                            const std::vector<uint8>& expected_contents) {
+    const CString destination_file(GetTempFilename(_T("ut_")));
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.Get(key, destination_file, hash));
+
+    std::vector<uint8> contents;
+    EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(destination_file, 0, &contents));
+    EXPECT_TRUE(expected_contents == contents);
+    EXPECT_TRUE(::DeleteFile(destination_file));
+
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.ReadUnverified(key, 0, &contents));
+    EXPECT_TRUE(expected_contents == contents);
+  }
+
+  size_t GetVerifiedHashIndexSize(const PackageCache& package_cache) const {
+    return package_cache.verified_hash_index_.size();
+  }
+
+  // Overwrites the beginning of the cached file without changing its size or
+  // its last write time, which the verified hash index can't detect.
+  void TamperCachedFile(const Key& key) {
+    CString cached_file_name;
+    EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key, &cached_file_name));
+
+    FILETIME created = {0};
+    FILETIME accessed = {0};
+    FILETIME modified = {0};
+    EXPECT_HRESULT_SUCCEEDED(File::GetFileTime(cached_file_name,
+                                               &created,
+                                               &accessed,
+                                               &modified));
+    {
+      File file;
+      EXPECT_HRESULT_SUCCEEDED(file.Open(cached_file_name, true, false));
+      const byte kGarbage[] = {0xba, 0xad, 0xf0, 0x0d};
+      uint32 bytes_written = 0;
+      EXPECT_HRESULT_SUCCEEDED(file.WriteAt(0,
+                                            kGarbage,
+                                            static_cast<uint32>(
+                                                arraysize(kGarbage)),
+                                            0,
+                                            &bytes_written));
+      EXPECT_EQ(arraysize(kGarbage), bytes_written);
+      EXPECT_HRESULT_SUCCEEDED(file.Close());
+    }
+    EXPECT_HRESULT_SUCCEEDED(File::SetFileTime(cached_file_name,
+                                               &created,
+                                               &accessed,
+                                               &modified));
+  }
+
   const CString cache_root_;
   CString source_file1_;
   FileHash hash_file1_;
@@ -288,6 +443,47 @@ TEST_P(PackageCacheTest, BadKeyTest) {
       package_cache_.Put(key_empty_name, _T("a"), bad_hash));
 }
 
+// The packages of previous versions are read without their hash, in both
+// layouts of the cache, for the differential patches.
+TEST_P(PackageCacheTest, ReadUnverified) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+
+  uint64 size = 0;
+  std::vector<uint8> contents;
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            package_cache_.GetUnverifiedSize(key1, &size));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND),
+            package_cache_.ReadUnverified(key1, 0, &contents));
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  SetChunkStoreEnabled(true);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.GetUnverifiedSize(key1, &size));
+  EXPECT_EQ(size_file1_, size);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.GetUnverifiedSize(key2, &size));
+  EXPECT_EQ(size_file2_, size);
+
+  const uint32 max_size1 = static_cast<uint32>(size_file1_);
+  const uint32 max_size2 = static_cast<uint32>(size_file2_);
+  EXPECT_HRESULT_SUCCEEDED(
+      package_cache_.ReadUnverified(key1, max_size1, &contents));
+  EXPECT_EQ(size_file1_, contents.size());
+  EXPECT_HRESULT_SUCCEEDED(
+      package_cache_.ReadUnverified(key2, max_size2, &contents));
+  EXPECT_EQ(size_file2_, contents.size());
+
+  EXPECT_EQ(MEM_E_INVALID_SIZE,
+            package_cache_.ReadUnverified(key1, max_size1 - 1, &contents));
+  EXPECT_EQ(MEM_E_INVALID_SIZE,
+            package_cache_.ReadUnverified(key2, max_size2 - 1, &contents));
+}
+
 TEST_P(PackageCacheTest, PurgeVersionTest) {
   // Cache two files for two versions of the same app.
   Key key11(_T("app1"), _T("ver1"), _T("package1"));
@@ -546,7 +742,722 @@ TEST_P(PackageCacheTest, VerifyHash) {
             PackageCache::VerifyHash(source_file1_, hash_file2_));
 }
 
+TEST_P(PackageCacheTest, PutWithDigest) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+
+  std::vector<uint8> digest;
+  EXPECT_TRUE(SafeHexStringToVector(CString(kFile1Sha256Hash), &digest));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PutWithDigest(key1,
+                                                        source_file1_,
+                                                        hash_file1_,
+                                                        digest));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_EQ(size_file1_, package_cache_.Size());
+  EXPECT_EQ(1, GetVerifiedHashIndexSize(package_cache_));
+}
+
+TEST_P(PackageCacheTest, PutWithDigest_Mismatch) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+
+  // The digest of another file does not match the expected hash. Without a
+  // SHA-256 expected hash, the digest is ignored and the file is hashed.
+  std::vector<uint8> digest;
+  EXPECT_TRUE(SafeHexStringToVector(CString(kFile2Sha256Hash), &digest));
+  HRESULT hr = package_cache_.PutWithDigest(key1,
+                                            source_file1_,
+                                            hash_file1_,
+                                            digest);
+  if (GetParam()) {
+    EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, hr);
+    EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+    EXPECT_EQ(0, package_cache_.Size());
+  } else {
+    EXPECT_HRESULT_SUCCEEDED(hr);
+    EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  }
+}
+
+// The digest of a source file which is replaced after it is hashed does not
+// stand in for the hash of the copy in the cache.
+TEST_P(PackageCacheTest, PutWithDigest_SourceReplaced) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+
+  std::vector<uint8> digest;
+  EXPECT_TRUE(SafeHexStringToVector(CString(kFile1Sha256Hash), &digest));
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE,
+            package_cache_.PutWithDigest(key1,
+                                         source_file2_,
+                                         hash_file1_,
+                                         digest));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_EQ(0, package_cache_.Size());
+  EXPECT_EQ(0, GetVerifiedHashIndexSize(package_cache_));
+}
+
+TEST_P(PackageCacheTest, VerifiedHashIndex_PersistsAcrossInstances) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+  EXPECT_EQ(2, GetVerifiedHashIndexSize(package_cache_));
+
+  // The index is not accounted for in the size of the cache.
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache_.Size());
+
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_EQ(2, GetVerifiedHashIndexSize(package_cache));
+  EXPECT_TRUE(package_cache.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache.IsCached(key2, hash_file2_));
+  EXPECT_FALSE(package_cache.IsCached(key1, hash_file2_));
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Purge(key1));
+  EXPECT_EQ(1, GetVerifiedHashIndexSize(package_cache));
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache.PurgeAll());
+  EXPECT_EQ(0, GetVerifiedHashIndexSize(package_cache));
+  EXPECT_EQ(0, package_cache.Size());
+}
+
+TEST_P(PackageCacheTest, VerifiedHashIndex_ModifiedFileIsHashedAgain) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+
+  // Replacing the cached file changes its identity.
+  CString cached_file_name;
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key1, &cached_file_name));
+  EXPECT_HRESULT_SUCCEEDED(File::Copy(source_file2_, cached_file_name, true));
+
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_EQ(0, GetVerifiedHashIndexSize(package_cache_));
+
+  CString destination_file = GetTempFilename(_T("ut_"));
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE,
+            package_cache_.Get(key1, destination_file, hash_file1_));
+  ::DeleteFile(destination_file);
+}
+
+TEST_P(PackageCacheTest, VerifiedHashIndex_ParanoidMode) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+
+  // The verified record is trusted since the identity of the file is intact.
+  TamperCachedFile(key1);
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+
+  // Without the paranoid mode, reverification does nothing.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.ReverifyCachedPackages());
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+
+  // Once the records are older than the interval, the tampered package is
+  // detected and purged while the other package is kept.
+  SetReverifyIntervalSec(1);
+  ::Sleep(1100);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.ReverifyCachedPackages());
+  EXPECT_EQ(1, GetVerifiedHashIndexSize(package_cache_));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+  EXPECT_EQ(size_file2_, package_cache_.Size());
+}
+
+TEST_P(PackageCacheTest, PutPackages) {
+  std::vector<PackageCache::BatchEntry> entries(3);
+  entries[0].app_id = _T("app1");
+  entries[0].version = _T("ver1");
+  entries[0].package_name = _T("package1");
+  entries[0].hash = hash_file1_;
+  entries[0].source_file = source_file1_;
+  entries[1].app_id = _T("app2");
+  entries[1].version = _T("ver2");
+  entries[1].package_name = _T("package2");
+  entries[1].hash = hash_file2_;
+  entries[1].source_file = source_file2_;
+  entries[2].app_id = _T("app3");
+  entries[2].version = _T("ver3");
+  entries[2].package_name = _T("package3");
+  entries[2].hash = hash_file2_;
+  entries[2].source_file = source_file1_;
+
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, package_cache_.PutPackages(&entries));
+  EXPECT_HRESULT_SUCCEEDED(entries[0].result);
+  EXPECT_HRESULT_SUCCEEDED(entries[1].result);
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, entries[2].result);
+
+  // The copy which does not match its hash is deleted.
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  Key key3(_T("app3"), _T("ver3"), _T("package3"));
+  EXPECT_EQ(2, GetVerifiedHashIndexSize(package_cache_));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+  EXPECT_FALSE(package_cache_.IsCached(key3, hash_file2_));
+  EXPECT_EQ(size_file1_ + size_file2_, package_cache_.Size());
+}
+
+TEST_P(PackageCacheTest, PutPackages_ChunkStore) {
+  SetChunkStoreEnabled(true);
+
+  std::vector<PackageCache::BatchEntry> entries(2);
+  entries[0].app_id = _T("app1");
+  entries[0].version = _T("ver1");
+  entries[0].package_name = _T("package1");
+  entries[0].hash = hash_file1_;
+  entries[0].source_file = source_file1_;
+  entries[1].app_id = _T("app2");
+  entries[1].version = _T("ver2");
+  entries[1].package_name = _T("package2");
+  entries[1].hash = hash_file1_;
+  entries[1].source_file = source_file2_;
+
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, package_cache_.PutPackages(&entries));
+  EXPECT_HRESULT_SUCCEEDED(entries[0].result);
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, entries[1].result);
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_FALSE(package_cache_.IsCached(key2, hash_file1_));
+}
+
+TEST_P(PackageCacheTest, VerifyCachedPackages) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  Key key3(_T("app3"), _T("ver3"), _T("package3"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key3,
+                                              source_file2_,
+                                              hash_file2_));
+
+  // Without the index, the packages are hashed again.
+  EXPECT_TRUE(::DeleteFile(ConcatenatePath(cache_root_,
+                                           _T("verified_hashes.idx"))));
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_EQ(0, GetVerifiedHashIndexSize(package_cache));
+
+  std::vector<PackageCache::BatchEntry> entries(4);
+  entries[0].app_id = _T("app1");
+  entries[0].version = _T("ver1");
+  entries[0].package_name = _T("package1");
+  entries[0].hash = hash_file1_;
+  entries[1].app_id = _T("app2");
+  entries[1].version = _T("ver2");
+  entries[1].package_name = _T("package2");
+  entries[1].hash = hash_file2_;
+  entries[2].app_id = _T("app3");
+  entries[2].version = _T("ver3");
+  entries[2].package_name = _T("package3");
+  entries[2].hash = hash_file1_;
+  entries[3].app_id = _T("app4");
+  entries[3].version = _T("ver4");
+  entries[3].package_name = _T("package4");
+  entries[3].hash = hash_file1_;
+
+  package_cache.VerifyCachedPackages(&entries);
+  EXPECT_HRESULT_SUCCEEDED(entries[0].result);
+  EXPECT_HRESULT_SUCCEEDED(entries[1].result);
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE, entries[2].result);
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), entries[3].result);
+
+  // The packages which match are recorded, so that IsCached does not hash
+  // them again.
+  EXPECT_EQ(2, GetVerifiedHashIndexSize(package_cache));
+  EXPECT_TRUE(package_cache.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache.IsCached(key2, hash_file2_));
+  EXPECT_TRUE(package_cache.IsCached(key3, hash_file2_));
+}
+
+TEST_P(PackageCacheTest, ChunkStore_PutGet) {
+  SetChunkStoreEnabled(true);
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file2_));
+  EXPECT_FALSE(GetStoredChunks().empty());
+
+  // The packages are cached as small manifests next to the chunks.
+  CString cached_file_name;
+  EXPECT_HRESULT_SUCCEEDED(BuildCacheFileNameForKey(key1, &cached_file_name));
+  uint32 manifest_size = 0;
+  EXPECT_HRESULT_SUCCEEDED(File::GetFileSizeUnopen(cached_file_name,
+                                                   &manifest_size));
+  EXPECT_GT(size_file1_ / 100, manifest_size);
+  EXPECT_GT(size_file1_ + size_file2_ + 4096, package_cache_.Size());
+
+  std::vector<uint8> contents1;
+  std::vector<uint8> contents2;
+  EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(source_file1_, 0, &contents1));
+  EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(source_file2_, 0, &contents2));
+  ExpectCachedContents(key1, hash_file1_, contents1);
+  ExpectCachedContents(key2, hash_file2_, contents2);
+
+  // A new instance reads the chunked packages without hashing them again.
+  PackageCache package_cache;
+  EXPECT_HRESULT_SUCCEEDED(package_cache.Initialize(cache_root_));
+  EXPECT_TRUE(package_cache.IsCached(key1, hash_file1_));
+
+  // Purging a package purges the chunks which only it contains.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Purge(key1));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+  EXPECT_GT(size_file2_ + 4096, package_cache_.Size());
+  ExpectCachedContents(key2, hash_file2_, contents2);
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeApp(_T("app2")));
+  EXPECT_TRUE(GetStoredChunks().empty());
+  EXPECT_EQ(0, package_cache_.Size());
+}
+
+TEST_P(PackageCacheTest, ChunkStore_PutBadHash) {
+  SetChunkStoreEnabled(true);
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE,
+            package_cache_.Put(key1, source_file1_, hash_file2_));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(GetStoredChunks().empty());
+  EXPECT_EQ(0, package_cache_.Size());
+}
+
+// The chunks which were just written may belong to a package which another
+// process is putting, so they are only purged after the grace period. The
+// temporary files of the interrupted writes are purged with them.
+TEST_P(PackageCacheTest, ChunkStore_RecentChunksAreNotPurged) {
+  SetChunkStoreEnabled(true);
+  SetChunkPurgeGracePeriod(kHoursTo100ns);
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  const std::vector<CString> chunks(GetStoredChunks());
+  ASSERT_FALSE(chunks.empty());
+
+  const CString temp_file(chunks[0] + _T(".tmp"));
+  EXPECT_HRESULT_SUCCEEDED(File::Copy(chunks[0], temp_file, true));
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Purge(key1));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_EQ(chunks.size() + 1, GetStoredChunks().size());
+
+  // The package shares the chunks which were kept.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_EQ(chunks.size() + 1, GetStoredChunks().size());
+
+  SetChunkPurgeGracePeriod(0);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Purge(key1));
+  EXPECT_TRUE(GetStoredChunks().empty());
+}
+
+TEST_P(PackageCacheTest, ChunkStore_VersionsShareChunks) {
+  SetChunkStoreEnabled(true);
+
+  const size_t kPackageSize = 2 * 1024 * 1024;
+  const int kNumVersions = 4;
+
+  TestRandom random(1);
+  std::vector<std::vector<uint8> > versions;
+  versions.push_back(MakeSyntheticPackage(kPackageSize, &random));
+  for (int i = 1; i < kNumVersions; ++i) {
+    versions.push_back(EditSyntheticPackage(versions.back(), 2, &random));
+  }
+
+  std::vector<FileHash> hashes(kNumVersions);
+  for (int i = 0; i < kNumVersions; ++i) {
+    CString source_file;
+    WriteSyntheticPackage(versions[i], &source_file, &hashes[i]);
+    CString version;
+    SafeCStringFormat(&version, _T("1.0.0.%d"), i);
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(
+        Key(_T("app1"), version, _T("package1")), source_file, hashes[i]));
+    EXPECT_TRUE(::DeleteFile(source_file));
+  }
+
+  // Each version only adds the chunks around its edits, instead of a full
+  // copy of the package.
+  EXPECT_GT(kPackageSize * 2, package_cache_.Size());
+
+  for (int i = 0; i < kNumVersions; ++i) {
+    CString version;
+    SafeCStringFormat(&version, _T("1.0.0.%d"), i);
+    ExpectCachedContents(Key(_T("app1"), version, _T("package1")),
+                         hashes[i],
+                         versions[i]);
+  }
+
+  // The chunks of the purged versions which the remaining version contains
+  // are kept.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeAppLowerVersions(_T("app1"),
+                                                                _T("1.0.0.3")));
+  ExpectCachedContents(Key(_T("app1"), _T("1.0.0.3"), _T("package1")),
+                       hashes[3],
+                       versions[3]);
+  EXPECT_GT(versions[3].size() + 4096, package_cache_.Size());
+}
+
+TEST_P(PackageCacheTest, ChunkStore_CorruptedChunkIsStoredAgain) {
+  SetChunkStoreEnabled(true);
+
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+
+  const std::vector<CString> chunks(GetStoredChunks());
+  ASSERT_FALSE(chunks.empty());
+  {
+    File file;
+    EXPECT_HRESULT_SUCCEEDED(file.Open(chunks[0], true, false));
+    const byte kGarbage[] = {0xba, 0xad, 0xf0, 0x0d};
+    uint32 bytes_written = 0;
+    EXPECT_HRESULT_SUCCEEDED(file.WriteAt(0,
+                                          kGarbage,
+                                          static_cast<uint32>(
+                                              arraysize(kGarbage)),
+                                          0,
+                                          &bytes_written));
+    EXPECT_HRESULT_SUCCEEDED(file.Close());
+  }
+
+  // The chunks are checked against their hash even when the package is
+  // trusted, and the corrupted chunk is deleted.
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  EXPECT_EQ(SIGS_E_INVALID_SIGNATURE,
+            package_cache_.Get(key1, destination_file, hash_file1_));
+  EXPECT_FALSE(File::Exists(destination_file));
+  EXPECT_FALSE(File::Exists(chunks[0]));
+  EXPECT_FALSE(package_cache_.IsCached(key1, hash_file1_));
+
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_EQ(chunks.size(), GetStoredChunks().size());
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Get(key1,
+                                              destination_file,
+                                              hash_file1_));
+  EXPECT_TRUE(File::AreFilesIdentical(source_file1_, destination_file));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+}
+
+TEST_P(PackageCacheTest, ChunkStore_BothLayoutsAreRead) {
+  Key key1(_T("app1"), _T("ver1"), _T("package1"));
+  Key key2(_T("app2"), _T("ver2"), _T("package2"));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key1,
+                                              source_file1_,
+                                              hash_file1_));
+  EXPECT_TRUE(GetStoredChunks().empty());
+
+  SetChunkStoreEnabled(true);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+  EXPECT_TRUE(package_cache_.IsCached(key1, hash_file1_));
+  EXPECT_TRUE(package_cache_.IsCached(key2, hash_file2_));
+
+  SetChunkStoreEnabled(false);
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Get(key2,
+                                              destination_file,
+                                              hash_file2_));
+  EXPECT_TRUE(File::AreFilesIdentical(source_file2_, destination_file));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Get(key1,
+                                              destination_file,
+                                              hash_file1_));
+  EXPECT_TRUE(File::AreFilesIdentical(source_file1_, destination_file));
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  // The chunks of a chunked package replaced by a full copy are purged along
+  // with the next purged package.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(key2,
+                                              source_file2_,
+                                              hash_file2_));
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.Purge(key1));
+  EXPECT_TRUE(GetStoredChunks().empty());
+  EXPECT_EQ(size_file2_, package_cache_.Size());
+}
+
+TEST_P(PackageCacheTest, ChunkStore_SizeLimitCountsSharedChunksOnce) {
+  SetChunkStoreEnabled(true);
+  SetCacheSizeLimitMB(2);
+
+  const size_t kPackageSize = 1024 * 1024;
+  const int kNumVersions = 4;
+
+  TestRandom random(2);
+  std::vector<uint8> contents(MakeSyntheticPackage(kPackageSize, &random));
+  for (int i = 0; i < kNumVersions; ++i) {
+    CString source_file;
+    FileHash hash;
+    WriteSyntheticPackage(contents, &source_file, &hash);
+    CString version;
+    SafeCStringFormat(&version, _T("1.0.0.%d"), i);
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(
+        Key(_T("app1"), version, _T("package1")), source_file, hash));
+    EXPECT_TRUE(::DeleteFile(source_file));
+    contents = EditSyntheticPackage(contents, 1, &random);
+  }
+
+  // The full copies would not fit in the limit.
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeOldPackagesIfNecessary());
+  std::vector<internal::PackageInfo> packages_info;
+  EXPECT_HRESULT_SUCCEEDED(internal::FindAllPackagesInfo(cache_root_,
+                                                         &packages_info));
+  EXPECT_EQ(kNumVersions, packages_info.size());
+  EXPECT_GE(2 * 1024 * 1024, package_cache_.Size());
+
+  SetCacheSizeLimitMB(1);
+  EXPECT_HRESULT_SUCCEEDED(package_cache_.PurgeOldPackagesIfNecessary());
+  EXPECT_GE(1024 * 1024, package_cache_.Size());
+  packages_info.clear();
+  internal::FindAllPackagesInfo(cache_root_, &packages_info);
+  EXPECT_GT(kNumVersions, packages_info.size());
+}
+
+// Puts and gets versions of a synthetic package the size of a typical
+// installer, and logs how much of the cache the shared chunks save.
+TEST_P(PackageCacheTest, DISABLED_ChunkStore_Benchmark) {
+  SetChunkStoreEnabled(true);
+
+  const size_t kPackageSize = 8 * 1024 * 1024;
+  const int kNumVersions = 8;
+
+  TestRandom random(3);
+  std::vector<std::vector<uint8> > versions;
+  versions.push_back(MakeSyntheticPackage(kPackageSize, &random));
+  for (int i = 1; i < kNumVersions; ++i) {
+    versions.push_back(EditSyntheticPackage(versions.back(), 8, &random));
+  }
+
+  std::vector<CString> source_files(kNumVersions);
+  std::vector<FileHash> hashes(kNumVersions);
+  uint64 total_size = 0;
+  for (int i = 0; i < kNumVersions; ++i) {
+    WriteSyntheticPackage(versions[i], &source_files[i], &hashes[i]);
+    total_size += versions[i].size();
+  }
+
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kNumVersions; ++i) {
+    CString version;
+    SafeCStringFormat(&version, _T("1.0.0.%d"), i);
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.Put(
+        Key(_T("app1"), version, _T("package1")), source_files[i], hashes[i]));
+  }
+  const ULONGLONG put_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+
+  const CString destination_file(GetTempFilename(_T("ut_")));
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i < kNumVersions; ++i) {
+    CString version;
+    SafeCStringFormat(&version, _T("1.0.0.%d"), i);
+    EXPECT_HRESULT_SUCCEEDED(package_cache_.Get(
+        Key(_T("app1"), version, _T("package1")), destination_file,
+        hashes[i]));
+  }
+  const ULONGLONG get_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+
+  for (int i = 0; i < kNumVersions; ++i) {
+    EXPECT_TRUE(::DeleteFile(source_files[i]));
+  }
+  EXPECT_TRUE(::DeleteFile(destination_file));
+
+  const uint64 cache_size = package_cache_.Size();
+  EXPECT_GT(total_size / 4, cache_size);
+
+  const double ms_per_tick = 1000.0 / HighresTimer::GetTimerFrequency();
+  const double put_ms = put_ticks * ms_per_tick;
+  const double get_ms = get_ticks * ms_per_tick;
+  OPT_LOG(L1, (_T("[%d versions of %d bytes][%s][cache size %llu bytes]")
+               _T("[dedup ratio %f][put %f MB/s][get %f MB/s]"),
+               kNumVersions, static_cast<int>(kPackageSize),
+               GetParam() ? _T("SHA-256") : _T("SHA-1"), cache_size,
+               static_cast<double>(total_size) / cache_size,
+               total_size / 1000.0 / put_ms, total_size / 1000.0 / get_ms));
+}
+
 INSTANTIATE_TEST_CASE_P(Sha1OrSha256, PackageCacheTest, ::testing::Bool());
 
-}  // namespace omaha
+TEST(PackageCacheInternalTest, VerifiedHashIndex_SerializeDeserialize) {
+  internal::VerifiedHashIndex index;
+
+  internal::VerifiedHashRecord record1;
+  record1.file_size = 870400;
+  record1.last_write_time = 129876543210987654ULL;
+  record1.volume_serial_number = 0xdeadbeef;
+  record1.file_index = 0x0001000000001234ULL;
+  record1.verified_time = 129876543299999999ULL;
+  record1.hash = kFile1Sha256Hash;
+  index[_T("app1\\ver1\\package name with spaces.exe")] = record1;
+
+  internal::VerifiedHashRecord record2;
+  record2.file_size = 479848;
+  record2.hash = kFile2Sha1Hash;
+  index[_T("app2\\ver2\\package2")] = record2;
+
+  std::vector<uint8> buffer;
+  internal::SerializeVerifiedHashIndex(index, &buffer);
+
+  internal::VerifiedHashIndex actual;
+  internal::DeserializeVerifiedHashIndex(buffer, &actual);
+  ASSERT_EQ(2, actual.size());
+
+  const internal::VerifiedHashRecord& actual1 =
+      actual[_T("app1\\ver1\\package name with spaces.exe")];
+  EXPECT_TRUE(internal::IsSameFileIdentity(record1, actual1));
+  EXPECT_EQ(record1.verified_time, actual1.verified_time);
+  EXPECT_STREQ(record1.hash, actual1.hash);
+
+  const internal::VerifiedHashRecord& actual2 =
+      actual[_T("app2\\ver2\\package2")];
+  EXPECT_TRUE(internal::IsSameFileIdentity(record2, actual2));
+  EXPECT_STREQ(record2.hash, actual2.hash);
+}
+
+TEST(PackageCacheInternalTest, VerifiedHashIndex_MalformedLinesAreSkipped) {
+  const char kIndex[] =
+      "1 2 3 4 5 hash app1\\ver1\\package1\n"
+      "garbage\n"
+      "1 2 3 4 5 hash\n"
+      "6 7 8 9 10 hash2 app2\\ver2\\package2\n";
+  std::vector<uint8> buffer(kIndex, kIndex + arraysize(kIndex) - 1);
+
+  internal::VerifiedHashIndex index;
+  internal::DeserializeVerifiedHashIndex(buffer, &index);
+  ASSERT_EQ(2, index.size());
+  EXPECT_EQ(1, index[_T("app1\\ver1\\package1")].file_size);
+  EXPECT_EQ(9, index[_T("app2\\ver2\\package2")].file_index);
+  EXPECT_STREQ(_T("hash2"), index[_T("app2\\ver2\\package2")].hash);
+}
+
+TEST(PackageCacheInternalTest, FindChunkBoundaries) {
+  std::vector<size_t> chunk_ends;
+  internal::FindChunkBoundaries(NULL, 0, &chunk_ends);
+  EXPECT_TRUE(chunk_ends.empty());
+
+  TestRandom random(4);
+  const std::vector<uint8> small(MakeSyntheticPackage(1000, &random));
+  internal::FindChunkBoundaries(&small.front(), small.size(), &chunk_ends);
+  ASSERT_EQ(1, chunk_ends.size());
+  EXPECT_EQ(small.size(), chunk_ends[0]);
+
+  const std::vector<uint8> data(MakeSyntheticPackage(4 * 1024 * 1024,
+                                                     &random));
+  internal::FindChunkBoundaries(&data.front(), data.size(), &chunk_ends);
+  ASSERT_LT(1, chunk_ends.size());
+  EXPECT_EQ(data.size(), chunk_ends.back());
+  size_t start = 0;
+  for (size_t i = 0; i != chunk_ends.size(); ++i) {
+    const size_t chunk_size = chunk_ends[i] - start;
+    EXPECT_GE(internal::kMaxChunkSize, chunk_size);
+    if (i + 1 != chunk_ends.size()) {
+      EXPECT_LE(internal::kMinChunkSize, chunk_size);
+    }
+    start = chunk_ends[i];
+  }
+
+  // The boundaries are found again after an insertion, therefore the chunks
+  // after the insertion are the same.
+  std::vector<uint8> edited(data);
+  const size_t kInsertionOffset = 1000000;
+  edited.insert(edited.begin() + kInsertionOffset, 100, 0x5a);
+  std::vector<size_t> edited_chunk_ends;
+  internal::FindChunkBoundaries(&edited.front(),
+                                edited.size(),
+                                &edited_chunk_ends);
+  size_t num_shared_boundaries = 0;
+  for (size_t i = 0; i != chunk_ends.size(); ++i) {
+    const size_t expected_end = chunk_ends[i] < kInsertionOffset ?
+        chunk_ends[i] : chunk_ends[i] + 100;
+    if (std::binary_search(edited_chunk_ends.begin(),
+                           edited_chunk_ends.end(),
+                           expected_end)) {
+      ++num_shared_boundaries;
+    }
+  }
+  EXPECT_LE(chunk_ends.size() - 2, num_shared_boundaries);
+
+  // Runs of zeros have no boundaries besides the maximum chunk size.
+  const std::vector<uint8> zeros(1024 * 1024, 0);
+  internal::FindChunkBoundaries(&zeros.front(), zeros.size(), &chunk_ends);
+  EXPECT_GE(zeros.size() / internal::kMinChunkSize, chunk_ends.size());
+}
+
+TEST(PackageCacheInternalTest, ChunkManifest_SerializeDeserialize) {
+  internal::ChunkManifest manifest;
+  manifest.push_back(internal::ChunkReference(
+      _T("49b45f78865621b154fa65089f955182345a67f9746841e43e2d6daa288988d0"),
+      65536));
+  manifest.push_back(internal::ChunkReference(
+      _T("f0bbd84d7ec364f6c33161d781b49d840ed792b8b10668c4180b9e6e128d0bc9"),
+      17));
+
+  std::vector<uint8> buffer;
+  internal::SerializeChunkManifest(manifest, &buffer);
+  EXPECT_TRUE(internal::IsChunkManifest(&buffer.front(), buffer.size()));
+
+  internal::ChunkManifest actual;
+  EXPECT_TRUE(internal::DeserializeChunkManifest(buffer, &actual));
+  ASSERT_EQ(2, actual.size());
+  EXPECT_STREQ(manifest[0].hash, actual[0].hash);
+  EXPECT_EQ(65536, actual[0].size);
+  EXPECT_STREQ(manifest[1].hash, actual[1].hash);
+  EXPECT_EQ(17, actual[1].size);
+
+  // The manifest of an empty package has no chunks.
+  internal::SerializeChunkManifest(internal::ChunkManifest(), &buffer);
+  EXPECT_TRUE(internal::DeserializeChunkManifest(buffer, &actual));
+  EXPECT_TRUE(actual.empty());
+}
 
+TEST(PackageCacheInternalTest, ChunkManifest_MalformedManifestsAreRejected) {
+  const char* const kManifests[] = {
+    "",
+    "MZ\x90\x00",
+    "OmahaChunkManifest 2\n",
+    "OmahaChunkManifest 1\ngarbage\n",
+    "OmahaChunkManifest 1\n"
+        "0 49b45f78865621b154fa65089f955182345a67f9746841e43e2d6daa288988d0\n",
+    "OmahaChunkManifest 1\n"
+        "999999 49b45f78865621b154fa65089f955182345a67f9746841e43e2d6daa2889\n",
+    "OmahaChunkManifest 1\n"
+        "10 ..\\..\\..\\windows\\system32\\drivers\\etc\\hosts\n",
+  };
+
+  for (size_t i = 0; i != arraysize(kManifests); ++i) {
+    std::vector<uint8> buffer(kManifests[i],
+                              kManifests[i] + strlen(kManifests[i]));
+    internal::ChunkManifest manifest;
+    EXPECT_FALSE(internal::DeserializeChunkManifest(buffer, &manifest)) << i;
+    EXPECT_TRUE(manifest.empty());
+  }
+}
+
+}  // namespace omaha
@@ -0,0 +1,477 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/goopdate/package_extractor.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "base/scoped_ptr.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/path.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/string.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR* const kXzExtension = _T(".xz");
+
+// Reads or writes |size| bytes at |offset| of a file opened for overlapped
+// I/O, so that the threads do not share a file pointer.
+HRESULT TransferAt(HANDLE file,
+                   uint64 offset,
+                   uint8* data,
+                   DWORD size,
+                   bool write) {
+  ASSERT1(file);
+  ASSERT1(data);
+
+  scoped_event transfer_event(::CreateEvent(NULL, true, false, NULL));
+  if (!transfer_event) {
+    return HRESULTFromLastError();
+  }
+
+  OVERLAPPED overlapped = {0};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+  overlapped.hEvent = get(transfer_event);
+  const BOOL result = write ?
+      ::WriteFile(file, data, size, NULL, &overlapped) :
+      ::ReadFile(file, data, size, NULL, &overlapped);
+  if (!result && ::GetLastError() != ERROR_IO_PENDING) {
+    return HRESULTFromLastError();
+  }
+
+  DWORD transferred = 0;
+  if (!::GetOverlappedResult(file, &overlapped, &transferred, true)) {
+    return HRESULTFromLastError();
+  }
+  return transferred == size ? S_OK : HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+}
+
+// Converts the name of a member to a path relative to the extraction
+// directory. Rejects the names which could refer to a file outside of the
+// directory: absolute paths, drive letters and streams, and the components
+// which Windows reduces to "." or "..".
+bool GetMemberPath(const std::wstring& name, CString* path) {
+  ASSERT1(path);
+
+  CString member_path(name.c_str());
+  member_path.Replace(_T('/'), _T('\\'));
+  if (member_path.IsEmpty() || member_path.Find(_T(':')) != -1) {
+    return false;
+  }
+
+  int start = 0;
+  for (;;) {
+    const int end = member_path.Find(_T('\\'), start);
+    CString component(end == -1 ? member_path.Mid(start) :
+                                  member_path.Mid(start, end - start));
+    component.TrimRight(_T(". "));
+    if (component.IsEmpty()) {
+      return false;
+    }
+    if (end == -1) {
+      break;
+    }
+    start = end + 1;
+  }
+
+  *path = member_path;
+  return true;
+}
+
+class FileInput : public ArchiveInput {
+ public:
+  FileInput() : size_(0) {}
+  virtual ~FileInput() {}
+
+  HRESULT Open(const CString& filename) {
+    reset(file_, ::CreateFile(filename,
+                              FILE_READ_DATA,
+                              FILE_SHARE_READ,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_FLAG_OVERLAPPED,
+                              NULL));
+    if (!file_) {
+      return HRESULTFromLastError();
+    }
+
+    LARGE_INTEGER size = {0};
+    if (!::GetFileSizeEx(get(file_), &size)) {
+      return HRESULTFromLastError();
+    }
+    size_ = static_cast<uint64>(size.QuadPart);
+    return S_OK;
+  }
+
+  virtual uint64 GetSize() {
+    return size_;
+  }
+
+  virtual bool ReadAt(uint64 offset, uint8* data, size_t size) {
+    if (!size) {
+      return true;
+    }
+    if (size > MAXDWORD) {
+      return false;
+    }
+    return SUCCEEDED(TransferAt(get(file_),
+                                offset,
+                                data,
+                                static_cast<DWORD>(size),
+                                false));
+  }
+
+ private:
+  scoped_hfile file_;
+  uint64 size_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileInput);
+};
+
+// Creates the members under a directory. The files are created with their
+// final size when the archive is opened, and each file is opened again when
+// its first chunk is decoded and closed after its last chunk, so that the
+// archives with many members do not keep all of them open.
+class FileOutput : public ArchiveOutput {
+ public:
+  explicit FileOutput(const CString& dir) : dir_(dir), error_(S_OK) {}
+
+  virtual ~FileOutput() {
+    for (size_t i = 0; i != members_.size(); ++i) {
+      if (members_[i].file) {
+        VERIFY1(::CloseHandle(members_[i].file));
+      }
+    }
+  }
+
+  // Returns the first error of the file system, or S_OK.
+  HRESULT error() const {
+    __mutexScope(lock_);
+    return error_;
+  }
+
+  virtual bool CreateMember(size_t index,
+                            const std::wstring& name,
+                            uint64 size,
+                            bool is_directory) {
+    ASSERT1(index == members_.size());
+    UNREFERENCED_PARAMETER(index);
+
+    CString member_path;
+    if (!GetMemberPath(name, &member_path)) {
+      CORE_LOG(LE, (_T("[invalid member name][%s]"), name.c_str()));
+      return false;
+    }
+
+    Member member;
+    member.path = ConcatenatePath(dir_, member_path);
+    member.size = size;
+    members_.push_back(member);
+
+    if (is_directory) {
+      return CheckResult(CreateDir(member.path, NULL));
+    }
+
+    if (!CheckResult(CreateDir(GetDirectoryFromPath(member.path), NULL))) {
+      return false;
+    }
+
+    // The names are unique, so a member never replaces another one.
+    scoped_hfile file(::CreateFile(member.path,
+                                   FILE_WRITE_DATA,
+                                   0,
+                                   NULL,
+                                   CREATE_NEW,
+                                   FILE_ATTRIBUTE_NORMAL,
+                                   NULL));
+    if (!file) {
+      return CheckResult(HRESULTFromLastError());
+    }
+
+    LARGE_INTEGER file_size = {0};
+    file_size.QuadPart = static_cast<LONGLONG>(size);
+    if (size && (!::SetFilePointerEx(get(file), file_size, NULL, FILE_BEGIN) ||
+                 !::SetEndOfFile(get(file)))) {
+      return CheckResult(HRESULTFromLastError());
+    }
+    return true;
+  }
+
+  virtual bool WriteMember(size_t index,
+                           uint64 offset,
+                           const uint8* data,
+                           size_t size) {
+    ASSERT1(index < members_.size());
+    ASSERT1(size <= MAXDWORD);
+
+    HANDLE file = NULL;
+    {
+      __mutexScope(lock_);
+      Member& member = members_[index];
+      if (!member.file) {
+        HANDLE new_file = ::CreateFile(member.path,
+                                       FILE_WRITE_DATA,
+                                       0,
+                                       NULL,
+                                       OPEN_EXISTING,
+                                       FILE_FLAG_OVERLAPPED,
+                                       NULL);
+        if (new_file == INVALID_HANDLE_VALUE) {
+          return CheckResultLocked(HRESULTFromLastError());
+        }
+        member.file = new_file;
+      }
+      file = member.file;
+    }
+
+    const HRESULT hr = TransferAt(file,
+                                  offset,
+                                  const_cast<uint8*>(data),
+                                  static_cast<DWORD>(size),
+                                  true);
+
+    __mutexScope(lock_);
+    if (FAILED(hr)) {
+      return CheckResultLocked(hr);
+    }
+
+    // The file is closed once all of its chunks are written, so no other
+    // thread is using the handle.
+    Member& member = members_[index];
+    member.bytes_written += size;
+    if (member.bytes_written == member.size) {
+      VERIFY1(::CloseHandle(member.file));
+      member.file = NULL;
+    }
+    return true;
+  }
+
+ private:
+  struct Member {
+    Member() : size(0), bytes_written(0), file(NULL) {}
+
+    CString path;
+    uint64 size;
+    uint64 bytes_written;
+    HANDLE file;
+  };
+
+  // Records the first error and returns true if |hr| succeeded.
+  bool CheckResult(HRESULT hr) {
+    __mutexScope(lock_);
+    return CheckResultLocked(hr);
+  }
+
+  bool CheckResultLocked(HRESULT hr) {
+    if (FAILED(hr) && SUCCEEDED(error_)) {
+      CORE_LOG(LE, (_T("[FileOutput failed][0x%08x]"), hr));
+      error_ = hr;
+    }
+    return SUCCEEDED(hr);
+  }
+
+  const CString dir_;
+  std::vector<Member> members_;
+  HRESULT error_;
+  mutable LLock lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileOutput);
+};
+
+// Checks the names of the members without creating them.
+class IndexOutput : public ArchiveOutput {
+ public:
+  IndexOutput() {}
+  virtual ~IndexOutput() {}
+
+  virtual bool CreateMember(size_t,
+                            const std::wstring& name,
+                            uint64,
+                            bool) {
+    CString member_path;
+    if (!GetMemberPath(name, &member_path)) {
+      CORE_LOG(LE, (_T("[invalid member name][%s]"), name.c_str()));
+      return false;
+    }
+    return true;
+  }
+
+  virtual bool WriteMember(size_t, uint64, const uint8*, size_t) {
+    ASSERT1(false);
+    return false;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(IndexOutput);
+};
+
+// Extracts the tasks of the archive until none are left. Called by each
+// thread. Once a task fails, the tasks which have not started are skipped.
+class ExtractionRunner : public Runnable {
+ public:
+  explicit ExtractionRunner(ArchiveExtractor* extractor)
+      : extractor_(extractor),
+        next_task_(0),
+        has_failed_(0) {
+    ASSERT1(extractor);
+  }
+
+  virtual ~ExtractionRunner() {}
+
+  bool has_failed() const { return has_failed_ != 0; }
+
+  virtual void Run() {
+    for (;;) {
+      const size_t next = static_cast<size_t>(
+          ::InterlockedIncrement(&next_task_) - 1);
+      if (next >= extractor_->num_tasks() || has_failed_) {
+        return;
+      }
+
+      if (!extractor_->ExtractTask(next)) {
+        CORE_LOG(LE, (_T("[ExtractTask failed][%Iu]"), next));
+        ::InterlockedExchange(&has_failed_, 1);
+      }
+    }
+  }
+
+ private:
+  ArchiveExtractor* extractor_;
+  volatile LONG next_task_;
+  volatile LONG has_failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ExtractionRunner);
+};
+
+}  // namespace
+
+HRESULT ExtractPackage(const CString& archive_file,
+                       ArchiveFormat format,
+                       const CString& xz_member_name,
+                       const CString& dir,
+                       int max_threads) {
+  CORE_LOG(L3, (_T("[ExtractPackage][%s][%s]"), archive_file, dir));
+  ASSERT1(format != ARCHIVE_FORMAT_NONE);
+  ASSERT1(max_threads > 0);
+
+  FileInput input;
+  HRESULT hr = input.Open(archive_file);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to open archive][0x%08x]"), hr));
+    return hr;
+  }
+
+  hr = CreateDir(dir, NULL);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[CreateDir failed][%s][0x%08x]"), dir, hr));
+    return hr;
+  }
+
+  // The archives which are invalid or which use methods which are not
+  // supported fail with ERROR_INVALID_DATA, unless the file system failed.
+  FileOutput output(dir);
+  ArchiveExtractor extractor;
+  if (!extractor.Open(&input, xz_member_name.GetString(), &output) ||
+      extractor.format() != format) {
+    hr = FAILED(output.error()) ? output.error() :
+                                  HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    CORE_LOG(LE, (_T("[failed to open archive][%d][0x%08x]"),
+                  extractor.format(), hr));
+    return hr;
+  }
+
+  // The calling thread extracts tasks along with the worker threads. If a
+  // worker thread fails to start, the other threads extract its tasks.
+  ExtractionRunner runner(&extractor);
+  const size_t num_threads = std::min(static_cast<size_t>(max_threads),
+                                      extractor.num_tasks());
+  scoped_array<Thread> threads(num_threads > 1 ?
+                               new Thread[num_threads - 1] :
+                               NULL);
+  size_t num_started_threads = 0;
+  for (; num_started_threads + 1 < num_threads; ++num_started_threads) {
+    if (!threads[num_started_threads].Start(&runner)) {
+      CORE_LOG(LW, (_T("[failed to start extraction thread][0x%08x]"),
+                    HRESULTFromLastError()));
+      break;
+    }
+  }
+
+  runner.Run();
+
+  for (size_t i = 0; i != num_started_threads; ++i) {
+    VERIFY1(threads[i].WaitTillExit(INFINITE));
+  }
+
+  if (runner.has_failed()) {
+    hr = FAILED(output.error()) ? output.error() :
+                                  HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    CORE_LOG(LE, (_T("[failed to extract archive][0x%08x]"), hr));
+    return hr;
+  }
+
+  CORE_LOG(L3, (_T("[extracted][%Iu members][%I64u bytes][%Iu tasks]")
+                _T("[%Iu threads]"),
+                extractor.members().size(), extractor.unpacked_size(),
+                extractor.num_tasks(), num_started_threads + 1));
+  return S_OK;
+}
+
+HRESULT CheckPackage(const CString& archive_file,
+                     ArchiveFormat format,
+                     const CString& xz_member_name) {
+  CORE_LOG(L3, (_T("[CheckPackage][%s]"), archive_file));
+  ASSERT1(format != ARCHIVE_FORMAT_NONE);
+
+  FileInput input;
+  HRESULT hr = input.Open(archive_file);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[failed to open archive][0x%08x]"), hr));
+    return hr;
+  }
+
+  IndexOutput output;
+  ArchiveExtractor extractor;
+  if (!extractor.Open(&input, xz_member_name.GetString(), &output) ||
+      extractor.format() != format) {
+    CORE_LOG(LE, (_T("[invalid archive][%d]"), extractor.format()));
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+
+  CORE_LOG(L3, (_T("[checked][%Iu members][%I64u bytes][%Iu tasks]"),
+                extractor.members().size(), extractor.unpacked_size(),
+                extractor.num_tasks()));
+  return S_OK;
+}
+
+CString GetXzMemberName(const CString& package_name) {
+  const int extension_length = lstrlen(kXzExtension);
+  if (package_name.GetLength() > extension_length &&
+      String_EndsWith(package_name, kXzExtension, true)) {
+    return package_name.Left(package_name.GetLength() - extension_length);
+  }
+  return package_name;
+}
+
+}  // namespace omaha
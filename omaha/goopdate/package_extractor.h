@@ -0,0 +1,52 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Extracts the packages which are archives into a directory. The tasks of
+// the archive, its xz blocks or 7z folders, are decoded on several threads.
+
+#ifndef OMAHA_GOOPDATE_PACKAGE_EXTRACTOR_H_
+#define OMAHA_GOOPDATE_PACKAGE_EXTRACTOR_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include "omaha/base/archive_extractor.h"
+
+namespace omaha {
+
+// Extracts |archive_file| into |dir|, which is created if needed, using up to
+// |max_threads| threads including the calling thread. Fails if the archive is
+// not in |format|, if a member name is not a relative path, or if a member
+// does not match its CRC. The member of an xz archive is named
+// |xz_member_name|.
+HRESULT ExtractPackage(const CString& archive_file,
+                       ArchiveFormat format,
+                       const CString& xz_member_name,
+                       const CString& dir,
+                       int max_threads);
+
+// Reads the index of |archive_file| without decoding the members. Fails
+// like ExtractPackage when the archive is not in |format|, uses methods which
+// are not supported, or has a member name which is not a relative path.
+HRESULT CheckPackage(const CString& archive_file,
+                     ArchiveFormat format,
+                     const CString& xz_member_name);
+
+// Returns the name of the file an xz package decompresses to: the name of
+// the package without its ".xz" extension.
+CString GetXzMemberName(const CString& package_name);
+
+}  // namespace omaha
+
+#endif  // OMAHA_GOOPDATE_PACKAGE_EXTRACTOR_H_
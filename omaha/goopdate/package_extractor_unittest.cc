@@ -0,0 +1,183 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include <vector>
+#include "omaha/base/app_util.h"
+#include "omaha/base/error.h"
+#include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/path.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/utils.h"
+#include "omaha/goopdate/package_extractor.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+// SaveArguments.exe.xz is compressed with "xz --x86 --block-size=16KiB", so
+// it has several blocks which are extracted as separate tasks.
+const TCHAR* const kXzPackage = _T("SaveArguments.exe.xz");
+const TCHAR* const kXzMember = _T("SaveArguments.exe");
+
+}  // namespace
+
+class PackageExtractorTest : public testing::Test {
+ protected:
+  PackageExtractorTest() : dir_(GetUniqueTempDirectoryName()) {
+    const CString unittest_support(ConcatenatePath(
+        app_util::GetCurrentModuleDirectory(), _T("unittest_support")));
+    xz_package_ = ConcatenatePath(unittest_support, kXzPackage);
+    expected_file_ = ConcatenatePath(unittest_support, kXzMember);
+  }
+
+  virtual void SetUp() {
+    EXPECT_TRUE(File::Exists(xz_package_));
+    EXPECT_TRUE(File::Exists(expected_file_));
+  }
+
+  virtual void TearDown() {
+    if (File::Exists(dir_)) {
+      EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(dir_));
+    }
+  }
+
+  void ExpectExtractedFile(const CString& name) {
+    std::vector<byte> expected;
+    std::vector<byte> extracted;
+    EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(expected_file_, 0, &expected));
+    EXPECT_HRESULT_SUCCEEDED(
+        ReadEntireFile(ConcatenatePath(dir_, name), 0, &extracted));
+    EXPECT_FALSE(expected.empty());
+    EXPECT_TRUE(expected == extracted);
+  }
+
+  const CString dir_;
+  CString xz_package_;
+  CString expected_file_;
+};
+
+TEST_F(PackageExtractorTest, GetXzMemberName) {
+  EXPECT_STREQ(_T("setup.exe"), GetXzMemberName(_T("setup.exe.xz")));
+  EXPECT_STREQ(_T("setup.exe"), GetXzMemberName(_T("setup.exe.XZ")));
+  EXPECT_STREQ(_T("setup.exe"), GetXzMemberName(_T("setup.exe")));
+  EXPECT_STREQ(_T(".xz"), GetXzMemberName(_T(".xz")));
+  EXPECT_STREQ(_T("setup.xz.exe"), GetXzMemberName(_T("setup.xz.exe")));
+}
+
+TEST_F(PackageExtractorTest, ExtractPackage_Xz) {
+  EXPECT_HRESULT_SUCCEEDED(ExtractPackage(xz_package_,
+                                          ARCHIVE_FORMAT_XZ,
+                                          kXzMember,
+                                          dir_,
+                                          1));
+  ExpectExtractedFile(kXzMember);
+}
+
+TEST_F(PackageExtractorTest, ExtractPackage_XzOnSeveralThreads) {
+  EXPECT_HRESULT_SUCCEEDED(ExtractPackage(xz_package_,
+                                          ARCHIVE_FORMAT_XZ,
+                                          _T("setup.exe"),
+                                          dir_,
+                                          4));
+  ExpectExtractedFile(_T("setup.exe"));
+}
+
+TEST_F(PackageExtractorTest, ExtractPackage_FormatMismatch) {
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            ExtractPackage(xz_package_,
+                           ARCHIVE_FORMAT_7Z,
+                           kXzMember,
+                           dir_,
+                           1));
+}
+
+TEST_F(PackageExtractorTest, ExtractPackage_NotAnArchive) {
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            ExtractPackage(expected_file_,
+                           ARCHIVE_FORMAT_XZ,
+                           kXzMember,
+                           dir_,
+                           1));
+}
+
+TEST_F(PackageExtractorTest, ExtractPackage_InvalidMemberNames) {
+  const TCHAR* const kInvalidNames[] = {
+    _T(""),
+    _T("..\\setup.exe"),
+    _T("dir\\..\\..\\setup.exe"),
+    _T("c:\\setup.exe"),
+    _T("setup.exe:stream"),
+    _T("dir\\ \\setup.exe"),
+  };
+  for (size_t i = 0; i != arraysize(kInvalidNames); ++i) {
+    EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+              ExtractPackage(xz_package_,
+                             ARCHIVE_FORMAT_XZ,
+                             kInvalidNames[i],
+                             dir_,
+                             1)) << kInvalidNames[i];
+  }
+}
+
+TEST_F(PackageExtractorTest, ExtractPackage_MissingArchive) {
+  EXPECT_FAILED(ExtractPackage(ConcatenatePath(dir_, _T("missing.xz")),
+                               ARCHIVE_FORMAT_XZ,
+                               kXzMember,
+                               dir_,
+                               1));
+}
+
+TEST_F(PackageExtractorTest, CheckPackage) {
+  EXPECT_HRESULT_SUCCEEDED(CheckPackage(xz_package_,
+                                        ARCHIVE_FORMAT_XZ,
+                                        kXzMember));
+  EXPECT_FALSE(File::Exists(ConcatenatePath(dir_, kXzMember)));
+
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            CheckPackage(xz_package_, ARCHIVE_FORMAT_7Z, kXzMember));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            CheckPackage(expected_file_, ARCHIVE_FORMAT_XZ, kXzMember));
+  EXPECT_EQ(HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+            CheckPackage(xz_package_, ARCHIVE_FORMAT_XZ, _T("..\\setup.exe")));
+}
+
+TEST_F(PackageExtractorTest, DISABLED_ExtractPackage_Benchmark) {
+  const int kNumExtractions = 20;
+  const int kThreads[] = {1, 4};
+
+  for (size_t i = 0; i != arraysize(kThreads); ++i) {
+    const ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+    for (int j = 0; j < kNumExtractions; ++j) {
+      CString name;
+      SafeCStringFormat(&name, _T("setup%d.exe"), j);
+      EXPECT_HRESULT_SUCCEEDED(ExtractPackage(xz_package_,
+                                              ARCHIVE_FORMAT_XZ,
+                                              name,
+                                              dir_,
+                                              kThreads[i]));
+    }
+    const ULONGLONG ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+    EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(dir_));
+
+    const double ms = ticks * 1000.0 / HighresTimer::GetTimerFrequency();
+    OPT_LOG(L1, (_T("[%d extractions of %s][%d threads][%f ms]"),
+                 kNumExtractions, kXzPackage, kThreads[i], ms));
+  }
+}
+
+}  // namespace omaha
@@ -184,8 +184,7 @@ HRESULT BuildApp(const xml::UpdateResponse* update_response,
 
   const CString& app_id = app->app_guid_string();
 
-  const xml::response::App* response_app(GetApp(update_response->response(),
-                                                app_id));
+  const xml::response::App* response_app(update_response->GetApp(app_id));
   ASSERT1(response_app);
   const xml::response::UpdateCheck& update_check = response_app->update_check;
 
@@ -208,6 +207,14 @@ HRESULT BuildApp(const xml::UpdateResponse* update_response,
     }
   }
 
+  for (size_t i = 0; i < update_check.diff_urls.size(); ++i) {
+    HRESULT hr =
+        next_version->AddDiffDownloadBaseUrl(update_check.diff_urls[i]);
+    if (FAILED(hr)) {
+      return hr;
+    }
+  }
+
   for (size_t i = 0; i < update_check.install_manifest.packages.size(); ++i) {
     const xml::InstallPackage& package(
         update_check.install_manifest.packages[i]);
@@ -218,6 +225,20 @@ HRESULT BuildApp(const xml::UpdateResponse* update_response,
     if (FAILED(hr)) {
       return hr;
     }
+
+    if (!package.name_diff.IsEmpty() && package.size_diff > 0) {
+      next_version->GetPackage(next_version->GetNumberOfPackages() - 1)->
+          SetDiffInfo(package.name_diff,
+                      package.size_diff,
+                      package.hash_diff_sha256);
+    }
+
+    if (!package.archive.IsEmpty()) {
+      next_version->GetPackage(next_version->GetNumberOfPackages() - 1)->
+          set_archive_format(
+              package.archive.CompareNoCase(xml::value::kArchive7z) == 0 ?
+                  ARCHIVE_FORMAT_7Z : ARCHIVE_FORMAT_XZ);
+    }
   }
 
   if (!app->untrusted_data().IsEmpty()) {
@@ -258,8 +279,7 @@ xml::UpdateResponseResult GetResult(const xml::UpdateResponse* update_response,
                                     const CString& app_name,
                                     const CString& language) {
   ASSERT1(update_response);
-  const xml::response::App* response_app(GetApp(update_response->response(),
-                                                appid));
+  const xml::response::App* response_app(update_response->GetApp(appid));
 
   StringFormatter formatter(language);
   CString text;
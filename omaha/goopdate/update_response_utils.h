@@ -26,6 +26,8 @@ class App;
 
 namespace update_response_utils {
 
+// Looks the app up with a linear scan of |response|. When the response is
+// held by an UpdateResponse, UpdateResponse::GetApp uses its app index.
 const xml::response::App* GetApp(const xml::response::Response& response,
                                  const CString& appid);
 
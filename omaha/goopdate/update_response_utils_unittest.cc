@@ -17,7 +17,10 @@
 #include "omaha/base/app_util.h"
 #include "omaha/base/constants.h"
 #include "omaha/base/error.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
 #include "omaha/base/system_info.h"
+#include "omaha/base/utils.h"
 #include "omaha/goopdate/app_unittest_base.h"
 #include "omaha/goopdate/resource_manager.h"
 #include "omaha/goopdate/update_response_utils.h"
@@ -151,6 +154,79 @@ TEST(UpdateResponseUtilsGetAppTest, ResponseAppIdAllUpperCase) {
   EXPECT_EQ(&response.apps[0], GetApp(response, kAppIdWithLowerCase));
 }
 
+TEST(UpdateResponseUtilsGetAppTest, UpdateResponseAppIndex) {
+  xml::response::Response response;
+  xml::response::App app;
+  app.status = xml::response::kStatusOkValue;
+  app.appid = kAppId1;
+  response.apps.push_back(app);
+  app.appid = kAppIdWithLowerCase;
+  response.apps.push_back(app);
+  app.appid = kAppId1;
+  response.apps.push_back(app);
+
+  scoped_ptr<xml::UpdateResponse> update_response(
+      xml::UpdateResponse::Create());
+  EXPECT_EQ(NULL, update_response->GetApp(kAppId1));
+
+  SetResponseForUnitTest(update_response.get(), response);
+  const xml::response::Response& indexed = update_response->response();
+
+  // Duplicate app ids resolve to the first app, as with the linear scan.
+  EXPECT_EQ(&indexed.apps[0], update_response->GetApp(kAppId1));
+  EXPECT_EQ(&indexed.apps[1], update_response->GetApp(kAppIdWithLowerCase));
+  EXPECT_EQ(&indexed.apps[1],
+            update_response->GetApp(kAppIdWithLowerCaseAllUpperCase));
+  EXPECT_EQ(NULL, update_response->GetApp(kAppId2));
+  EXPECT_EQ(NULL, update_response->GetApp(_T("")));
+}
+
+// Compares the time it takes to look up every app of a 500-app response with
+// the linear scan and with the app index of UpdateResponse.
+TEST(UpdateResponseUtilsGetAppTest,
+     DISABLED_AppIndexVersusLinearScanBenchmark) {
+  const int kNumApps = 500;
+  xml::response::Response response;
+  std::vector<CString> app_ids;
+  for (int i = 0; i != kNumApps; ++i) {
+    xml::response::App app;
+    app.status = xml::response::kStatusOkValue;
+    EXPECT_SUCCEEDED(GetGuid(&app.appid));
+    response.apps.push_back(app);
+
+    // Look the apps up in lower case, as app GUIDs may differ in case.
+    app_ids.push_back(app.appid);
+    app_ids.back().MakeLower();
+  }
+
+  scoped_ptr<xml::UpdateResponse> update_response(
+      xml::UpdateResponse::Create());
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  SetResponseForUnitTest(update_response.get(), response);
+  const double index_build_ms =
+      (HighresTimer::GetCurrentTicks() - start_ticks) * 1000.0 /
+      HighresTimer::GetTimerFrequency();
+
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i != kNumApps; ++i) {
+    ASSERT_EQ(&response.apps[i], GetApp(response, app_ids[i]));
+  }
+  const double linear_ms = (HighresTimer::GetCurrentTicks() - start_ticks) *
+                           1000.0 / HighresTimer::GetTimerFrequency();
+
+  const xml::response::Response& indexed = update_response->response();
+  start_ticks = HighresTimer::GetCurrentTicks();
+  for (int i = 0; i != kNumApps; ++i) {
+    ASSERT_EQ(&indexed.apps[i], update_response->GetApp(app_ids[i]));
+  }
+  const double index_ms = (HighresTimer::GetCurrentTicks() - start_ticks) *
+                          1000.0 / HighresTimer::GetTimerFrequency();
+
+  OPT_LOG(L1, (_T("[%d apps][linear scan %f ms][app index %f ms]")
+               _T("[building it %f ms]"),
+               kNumApps, linear_ms, index_ms, index_build_ms));
+}
+
 TEST_F(UpdateResponseUtilsGetResultTest, EmptyResponse) {
   EXPECT_TRUE(kAppNotFoundResult ==
               GetResult(update_response_.get(), kAppId1, _T(""), _T("en")));
@@ -17,6 +17,7 @@
 #include "omaha/goopdate/worker_internal.h"
 #include <atlbase.h>
 #include <atlstr.h>
+#include <algorithm>
 #include "omaha/base/app_util.h"
 #include "omaha/base/const_object_names.h"
 #include "omaha/base/debug.h"
@@ -228,11 +229,123 @@ void SendCupFailurePing(bool is_machine,
   }
 }
 
+DownloadPipeline::DownloadPipeline(AppBundle* app_bundle,
+                                   DownloadManagerInterface* download_manager,
+                                   int depth)
+    : app_bundle_(app_bundle),
+      download_manager_(download_manager),
+      depth_(depth > 1 ? depth : 1),
+      next_download_(1) {
+  ASSERT1(app_bundle);
+  ASSERT1(download_manager);
+  download_complete_events_.resize(app_bundle_->GetNumberOfApps(), NULL);
+}
+
+DownloadPipeline::~DownloadPipeline() {
+  // The downloads use the bundle and the download manager, so they must
+  // complete before the caller can release them.
+  for (size_t i = 0; i != download_complete_events_.size(); ++i) {
+    HANDLE download_complete_event = download_complete_events_[i];
+    if (download_complete_event) {
+      VERIFY1(::WaitForSingleObject(download_complete_event, INFINITE) ==
+              WAIT_OBJECT_0);
+      VERIFY1(::CloseHandle(download_complete_event));
+    }
+  }
+}
+
+void DownloadPipeline::StartDownloads(size_t index) {
+  const size_t num_apps = download_complete_events_.size();
+  const size_t end = std::min(num_apps, index + depth_);
+
+  if (next_download_ <= index) {
+    next_download_ = index + 1;
+  }
+
+  for (; next_download_ < end; ++next_download_) {
+    App* app = app_bundle_->GetApp(next_download_);
+
+    // Apps that were downloaded earlier or do not need a download are handled
+    // by WaitForDownload when their turn comes.
+    if (app->state() != STATE_WAITING_TO_DOWNLOAD) {
+      continue;
+    }
+
+    HANDLE download_complete_event = ::CreateEvent(NULL, true, false, NULL);
+    if (!download_complete_event) {
+      HRESULT hr = HRESULTFromLastError();
+      CORE_LOG(LW, (_T("[CreateEvent failed][0x%08x]"), hr));
+      continue;
+    }
+    download_complete_events_[next_download_] = download_complete_event;
+
+    typedef ThreadPoolCallBack1<DownloadPipeline, size_t> Callback;
+    scoped_ptr<Callback> callback(new Callback(this,
+                                               &DownloadPipeline::DownloadApp,
+                                               next_download_));
+    HRESULT hr = Goopdate::Instance().QueueUserWorkItem(callback.get(),
+                                                        COINIT_MULTITHREADED,
+                                                        WT_EXECUTELONGFUNCTION);
+    if (FAILED(hr)) {
+      CORE_LOG(LW, (_T("[QueueUserWorkItem failed][0x%08x]"), hr));
+      download_complete_events_[next_download_] = NULL;
+      VERIFY1(::CloseHandle(download_complete_event));
+      continue;
+    }
+
+    // Transfers the ownership of the callback to the thread pool.
+    callback.release();
+
+    CORE_LOG(L3, (_T("[DownloadPipeline][started download ahead][%Iu]"),
+                  next_download_));
+  }
+}
+
+void DownloadPipeline::WaitForDownload(size_t index) {
+  ASSERT1(index < download_complete_events_.size());
+
+  HANDLE download_complete_event = download_complete_events_[index];
+  if (download_complete_event) {
+    VERIFY1(::WaitForSingleObject(download_complete_event, INFINITE) ==
+            WAIT_OBJECT_0);
+    VERIFY1(::CloseHandle(download_complete_event));
+    download_complete_events_[index] = NULL;
+  }
+
+  // Downloads the app in this thread if it was not downloaded ahead. This is a
+  // no-op for apps that do not need a download.
+  App* app = app_bundle_->GetApp(index);
+  if (!download_complete_event || app->state() == STATE_WAITING_TO_DOWNLOAD) {
+    // This is a blocking call on the network.
+    app->Download(download_manager_);
+  }
+}
+
+void DownloadPipeline::DownloadApp(size_t index) {
+  CORE_LOG(L3, (_T("[DownloadPipeline::DownloadApp][%Iu]"), index));
+
+  {
+    scoped_impersonation impersonate_user(app_bundle_->impersonation_token());
+    HRESULT hr = impersonate_user.result();
+    if (SUCCEEDED(hr)) {
+      // This is a blocking call on the network.
+      App* app = app_bundle_->GetApp(index);
+      app->Download(download_manager_);
+    } else {
+      // WaitForDownload downloads the app in the installing thread instead.
+      CORE_LOG(LE, (_T("[Impersonation failed][0x%08x]"), hr));
+    }
+  }
+
+  VERIFY1(::SetEvent(download_complete_events_[index]));
+}
+
 }  // namespace internal
 
 Worker::Worker()
     : is_machine_(false),
       lock_count_(0),
+      download_pipeline_depth_(1),
       single_instance_hr_(E_FAIL) {
   CORE_LOG(L1, (_T("[Worker::Worker]")));
 
@@ -325,6 +438,11 @@ HRESULT Worker::Initialize(bool is_machine) {
     return hr;
   }
 
+  download_pipeline_depth_ =
+      ConfigManager::Instance()->GetDownloadPipelineDepth();
+  CORE_LOG(L3, (_T("[download pipeline depth][%d]"),
+                download_pipeline_depth_));
+
   download_manager_.reset(new DownloadManager(is_machine_));
 
   hr = download_manager_->Initialize();
@@ -636,10 +754,22 @@ void Worker::DownloadAndInstallHelper(AppBundle* app_bundle) {
             app->state() == STATE_WAITING_TO_INSTALL ||
             app->state() == STATE_NO_UPDATE ||
             app->state() == STATE_ERROR);
+  }
+
+  // The apps are installed one at a time in bundle order while the apps after
+  // the one being installed are downloaded in the thread pool.
+  internal::DownloadPipeline download_pipeline(app_bundle,
+                                               download_manager_.get(),
+                                               download_pipeline_depth_);
+
+  for (size_t i = 0; i != num_apps; ++i) {
+    App* app = app_bundle->GetApp(i);
+
+    download_pipeline.StartDownloads(i);
 
     // Download the app if it has not already been downloaded.
     // This is a blocking call on the network.
-    app->Download(download_manager_.get());
+    download_pipeline.WaitForDownload(i);
 
     ASSERT1(app->state() == STATE_READY_TO_INSTALL ||    // Downloaded above.
             app->state() == STATE_WAITING_TO_INSTALL ||  // Downloaded earlier.
@@ -838,38 +968,47 @@ HRESULT Worker::CacheOfflinePackages(AppBundle* app_bundle) {
   CORE_LOG(L3, (_T("[Worker::CacheOfflinePackages]")));
   ASSERT1(app_bundle);
 
+  // The packages of the bundle are verified and cached in batches, which hash
+  // the packages concurrently instead of one at a time.
+  std::vector<const Package*> packages;
   for (size_t i = 0; i != app_bundle->GetNumberOfApps(); ++i) {
-    App* app = app_bundle->GetApp(i);
-    AppVersion* app_version = app->working_version();
-    const size_t num_packages = app_version->GetNumberOfPackages();
-
-    for (size_t j = 0; j < num_packages; ++j) {
-      Package* package(app_version->GetPackage(j));
-      if (download_manager_->IsPackageAvailable(package)) {
-        continue;
-      }
+    AppVersion* app_version = app_bundle->GetApp(i)->working_version();
+    for (size_t j = 0; j < app_version->GetNumberOfPackages(); ++j) {
+      packages.push_back(app_version->GetPackage(j));
+    }
+  }
 
-      CString offline_app_dir = ConcatenatePath(app_bundle->offline_dir(),
-                                                app->app_guid_string());
-      CString offline_package_path = ConcatenatePath(offline_app_dir,
-                                                     package->filename());
-      if (!File::Exists(offline_package_path)) {
-        HRESULT hr = offline_utils::FindV2OfflinePackagePath(
-            offline_app_dir, &offline_package_path);
-        if (FAILED(hr)) {
-          CORE_LOG(LE, (_T("[FindOfflinePackagePath failed][0x%x]"), hr));
-          return hr;
-        }
-      }
+  std::vector<const Package*> unavailable_packages;
+  download_manager_->GetUnavailablePackages(packages, &unavailable_packages);
+  if (unavailable_packages.empty()) {
+    return S_OK;
+  }
 
-      HRESULT hr = download_manager_->CachePackage(package,
-                                                   &offline_package_path);
+  std::vector<CString> offline_package_paths;
+  for (size_t i = 0; i != unavailable_packages.size(); ++i) {
+    const Package* package = unavailable_packages[i];
+    const CString app_id(package->app_version()->app()->app_guid_string());
+    CString offline_app_dir = ConcatenatePath(app_bundle->offline_dir(),
+                                              app_id);
+    CString offline_package_path = ConcatenatePath(offline_app_dir,
+                                                   package->filename());
+    if (!File::Exists(offline_package_path)) {
+      HRESULT hr = offline_utils::FindV2OfflinePackagePath(
+          offline_app_dir, &offline_package_path);
       if (FAILED(hr)) {
-        CORE_LOG(LE, (_T("[CachePackage failed][%s][%s][0x%x][%Iu]"),
-                      app->app_guid_string(), offline_package_path, hr, j));
+        CORE_LOG(LE, (_T("[FindOfflinePackagePath failed][0x%x]"), hr));
         return hr;
       }
     }
+    offline_package_paths.push_back(offline_package_path);
+  }
+
+  HRESULT hr = download_manager_->CachePackages(unavailable_packages,
+                                                offline_package_paths);
+  if (FAILED(hr)) {
+    CORE_LOG(LE, (_T("[CachePackages failed][0x%x][%Iu packages]"),
+                  hr, unavailable_packages.size()));
+    return hr;
   }
 
   return S_OK;
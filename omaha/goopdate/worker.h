@@ -180,6 +180,11 @@ class Worker : public WorkerModelInterface, public ShutdownCallback {
 
   bool is_machine_;
   int lock_count_;
+
+  // Number of apps of a bundle that may be downloading at the same time while
+  // the apps ahead of them are installed.
+  int download_pipeline_depth_;
+
   HRESULT single_instance_hr_;
   scoped_ptr<ProgramInstance> single_instance_;
   scoped_ptr<Reactor>         reactor_;
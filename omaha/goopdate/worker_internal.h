@@ -17,9 +17,14 @@
 #define OMAHA_GOOPDATE_WORKER_INTERNAL_H_
 
 #include <windows.h>
+#include <vector>
+#include "base/basictypes.h"
 
 namespace omaha {
 
+class AppBundle;
+class DownloadManagerInterface;
+
 namespace xml {
 
 class UpdateRequest;
@@ -35,6 +40,45 @@ void RecordUpdateAvailableUsageStats();
 // is destroyed.
 HRESULT AddUninstalledAppsPings(AppBundle* app_bundle);
 
+// Downloads the apps of a bundle ahead of their installation. While the app at
+// index i is the next one to install, the apps after it, up to index
+// i + depth - 1, are downloaded concurrently in the thread pool. A depth of 1
+// downloads every app in the installing thread, right before it is installed.
+class DownloadPipeline {
+ public:
+  DownloadPipeline(AppBundle* app_bundle,
+                   DownloadManagerInterface* download_manager,
+                   int depth);
+
+  // Waits for the downloads that are still running.
+  ~DownloadPipeline();
+
+  // Starts the downloads ahead of the app at |index|, which is the next app to
+  // install.
+  void StartDownloads(size_t index);
+
+  // Blocks until the app at |index| is downloaded. Downloads the app in the
+  // calling thread if its download was not started ahead.
+  void WaitForDownload(size_t index);
+
+ private:
+  // Runs in the thread pool.
+  void DownloadApp(size_t index);
+
+  AppBundle* app_bundle_;
+  DownloadManagerInterface* download_manager_;
+  const size_t depth_;
+
+  // Index of the next app that may be downloaded ahead.
+  size_t next_download_;
+
+  // Signaled when the download started ahead for the corresponding app
+  // completes. NULL if no download was started ahead for the app.
+  std::vector<HANDLE> download_complete_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(DownloadPipeline);
+};
+
 }  // namespace internal
 
 }  // namespace omaha
@@ -23,8 +23,19 @@ DEFINE_METRIC_count(worker_download_succeeded);
 
 DEFINE_METRIC_count(worker_download_skipped_bits_machine);
 
+DEFINE_METRIC_count(worker_download_hedged);
+DEFINE_METRIC_count(worker_download_hedged_won);
+
+DEFINE_METRIC_count(worker_download_diff_applied);
+DEFINE_METRIC_count(worker_download_diff_failed);
+
+DEFINE_METRIC_count(worker_download_archive_extracted);
+DEFINE_METRIC_count(worker_download_archive_failed);
+
 DEFINE_METRIC_count(worker_package_cache_put_total);
 DEFINE_METRIC_count(worker_package_cache_put_succeeded);
+DEFINE_METRIC_count(worker_package_cache_chunk_bytes_stored);
+DEFINE_METRIC_count(worker_package_cache_chunk_bytes_shared);
 
 DEFINE_METRIC_count(worker_install_execute_total);
 DEFINE_METRIC_count(worker_install_execute_msi_total);
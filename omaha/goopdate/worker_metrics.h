@@ -30,12 +30,35 @@ DECLARE_METRIC_count(worker_download_succeeded);
 // How many times the download manager skipped BITS due to machine install.
 DECLARE_METRIC_count(worker_download_skipped_bits_machine);
 
+// How many times the download manager raced a second url against the first
+// url of a package.
+DECLARE_METRIC_count(worker_download_hedged);
+// How many times the second url won the race.
+DECLARE_METRIC_count(worker_download_hedged_won);
+
+// How many packages were reconstructed from differential patches, and how many
+// patches failed to download or to apply, in which case the package was
+// downloaded in full.
+DECLARE_METRIC_count(worker_download_diff_applied);
+DECLARE_METRIC_count(worker_download_diff_failed);
+
+// How many packages were extracted from archives, and how many archives
+// failed to extract.
+DECLARE_METRIC_count(worker_download_archive_extracted);
+DECLARE_METRIC_count(worker_download_archive_failed);
+
 // How many times the package cache attempted to put the temporary file
 // to the cache directory.
 DECLARE_METRIC_count(worker_package_cache_put_total);
 // How many times the package cache successfully copied the temporary file
 // to the cache directory.
 DECLARE_METRIC_count(worker_package_cache_put_succeeded);
+// How many bytes of the packages put in the chunk store of the package cache
+// were stored as new chunks.
+DECLARE_METRIC_count(worker_package_cache_chunk_bytes_stored);
+// How many bytes of the packages put in the chunk store of the package cache
+// were already stored as chunks of other packages.
+DECLARE_METRIC_count(worker_package_cache_chunk_bytes_shared);
 
 // How many times ExecuteAndWaitForInstaller was called.
 DECLARE_METRIC_count(worker_install_execute_total);
@@ -13,11 +13,16 @@
 // limitations under the License.
 // ========================================================================
 
+#include <algorithm>
 #include <utility>
+#include <vector>
 
 #include "base/scoped_ptr.h"
 #include "omaha/base/app_util.h"
 #include "omaha/base/const_addresses.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/utils.h"
+#include "omaha/common/app_registry_utils.h"
 #include "omaha/common/config_manager.h"
 #include "omaha/common/update_response.h"
 #include "omaha/common/web_services_client.h"
@@ -155,6 +160,9 @@ class MockDownloadManager : public DownloadManagerInterface {
       HRESULT(const CString&, const CString&));
   MOCK_METHOD2(CachePackage,
       HRESULT(const Package*, const CString*));
+  MOCK_METHOD2(CachePackages,
+      HRESULT(const std::vector<const Package*>&,
+              const std::vector<CString>&));
   MOCK_METHOD1(DownloadApp,
       HRESULT(App* app));
   MOCK_METHOD1(DownloadPackage,
@@ -169,6 +177,9 @@ class MockDownloadManager : public DownloadManagerInterface {
       bool());
   MOCK_CONST_METHOD1(IsPackageAvailable,
       bool(const Package* package));      // NOLINT
+  MOCK_CONST_METHOD2(GetUnavailablePackages,
+      void(const std::vector<const Package*>&,
+           std::vector<const Package*>*));
 };
 
 class MockInstallManager : public InstallManagerInterface {
@@ -217,6 +228,192 @@ void WaitForAppToEnterState(const App& app,
   EXPECT_EQ(expected_state, app.state());
 }
 
+// Fake managers that take a fixed time for each app and record the order in
+// which every download and install starts and ends. The fake download manager
+// may be called from several threads at the same time.
+struct ManagerEvent {
+  ManagerEvent() : app(NULL), is_install(false), start(0), end(0) {}
+
+  App* app;
+  bool is_install;
+
+  // Numbers of the sequence of the timeline, which order the events.
+  int start;
+  int end;
+};
+
+class ManagerTimeline {
+ public:
+  ManagerTimeline() : sequence_(0), num_downloads_started_(0) {}
+
+  // Returns the next number of the sequence.
+  int Next() {
+    __mutexScope(lock_);
+    return ++sequence_;
+  }
+
+  // Returns the next number of the sequence and counts the download.
+  int StartDownload() {
+    __mutexScope(lock_);
+    ++num_downloads_started_;
+    return ++sequence_;
+  }
+
+  // Returns true once |num_downloads| downloads have started, or false if
+  // they do not start within |timeout_ms|.
+  bool WaitForDownloadsToStart(int num_downloads, int timeout_ms) const {
+    const int kPeriodMs = 10;
+    for (int waited_ms = 0;
+         num_downloads_started() < num_downloads;
+         waited_ms += kPeriodMs) {
+      if (waited_ms >= timeout_ms) {
+        return false;
+      }
+      ::Sleep(kPeriodMs);
+    }
+    return true;
+  }
+
+  int num_downloads_started() const {
+    __mutexScope(lock_);
+    return num_downloads_started_;
+  }
+
+  void Record(const ManagerEvent& event) {
+    __mutexScope(lock_);
+    events_.push_back(event);
+  }
+
+  std::vector<ManagerEvent> events() const {
+    __mutexScope(lock_);
+    return events_;
+  }
+
+ private:
+  LLock lock_;
+  int sequence_;
+  int num_downloads_started_;
+  std::vector<ManagerEvent> events_;
+
+  DISALLOW_COPY_AND_ASSIGN(ManagerTimeline);
+};
+
+class FakeDownloadManager : public DownloadManagerInterface {
+ public:
+  FakeDownloadManager(ManagerTimeline* timeline, int download_time_ms)
+      : timeline_(timeline), download_time_ms_(download_time_ms) {}
+
+  virtual HRESULT Initialize() { return S_OK; }
+  virtual HRESULT PurgeAppLowerVersions(const CString&, const CString&) {
+    return S_OK;
+  }
+  virtual HRESULT CachePackage(const Package*, const CString*) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT CachePackages(const std::vector<const Package*>&,
+                                const std::vector<CString>&) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT GetPackage(const Package*, const CString&) const {
+    return E_NOTIMPL;
+  }
+  virtual bool IsPackageAvailable(const Package*) const { return false; }
+  virtual void GetUnavailablePackages(
+      const std::vector<const Package*>& packages,
+      std::vector<const Package*>* unavailable_packages) const {
+    *unavailable_packages = packages;
+  }
+  virtual void Cancel(App*) {}
+  virtual void CancelAll() {}
+  virtual bool IsBusy() const { return false; }
+
+  virtual HRESULT DownloadApp(App* app) {
+    ManagerEvent event;
+    event.app = app;
+    event.start = timeline_->StartDownload();
+
+    app->Downloading();
+    ::Sleep(download_time_ms_);
+    app->DownloadComplete();
+    app->MarkReadyToInstall();
+
+    event.end = timeline_->Next();
+    timeline_->Record(event);
+    return S_OK;
+  }
+
+ private:
+  ManagerTimeline* timeline_;
+  const int download_time_ms_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeDownloadManager);
+};
+
+class FakeInstallManager : public InstallManagerInterface {
+ public:
+  FakeInstallManager(ManagerTimeline* timeline,
+                     int install_time_ms,
+                     int num_apps)
+      : timeline_(timeline),
+        install_time_ms_(install_time_ms),
+        num_apps_(num_apps),
+        num_installs_(0),
+        wait_for_next_download_(false) {}
+
+  virtual HRESULT Initialize() { return S_OK; }
+  virtual CString install_working_dir() const {
+    return app_util::GetTempDir();
+  }
+
+  // When set, an install does not complete before the download of the next
+  // app has started, so that a pipelined download overlaps the install no
+  // matter how the threads are scheduled.
+  void set_wait_for_next_download(bool wait_for_next_download) {
+    wait_for_next_download_ = wait_for_next_download;
+  }
+
+  virtual void InstallApp(App* app, const CString& dir) {
+    UNREFERENCED_PARAMETER(dir);
+
+    ManagerEvent event;
+    event.app = app;
+    event.is_install = true;
+    event.start = timeline_->Next();
+
+    app->Installing();
+    ::Sleep(install_time_ms_);
+
+    // The installs run one at a time, so the count needs no lock.
+    ++num_installs_;
+    if (wait_for_next_download_) {
+      EXPECT_TRUE(timeline_->WaitForDownloadsToStart(
+          std::min(num_installs_ + 1, num_apps_), kWaitTimeoutMs));
+    }
+
+    AppManager& app_manager = *AppManager::Instance();
+    __mutexScope(app_manager.GetRegistryStableStateLock());
+
+    InstallerResultInfo result_info;
+    result_info.type = INSTALLER_RESULT_SUCCESS;
+    result_info.text = _T("success");
+    app->ReportInstallerComplete(result_info);
+
+    event.end = timeline_->Next();
+    timeline_->Record(event);
+  }
+
+ private:
+  static const int kWaitTimeoutMs = 10000;
+
+  ManagerTimeline* timeline_;
+  const int install_time_ms_;
+  const int num_apps_;
+  int num_installs_;
+  bool wait_for_next_download_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeInstallManager);
+};
+
 // Assumes the caller has verified the bundle is busy. Otherwise, this could
 // return before the bundle enters the busy state.
 void WaitForBundleToBeReady(const AppBundle& app_bundle, int timeout_sec) {
@@ -273,6 +470,10 @@ class WorkerTest : public testing::Test {
     worker_->install_manager_.reset(install_manager);
   }
 
+  void SetWorkerDownloadPipelineDepth(int depth) {
+    worker_->download_pipeline_depth_ = depth;
+  }
+
   const bool is_machine_;
   Goopdate goopdate_;
   Worker* worker_;
@@ -477,6 +678,9 @@ TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_AlreadyDownloaded) {
 }
 
 TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_NotAlreadyDownloaded) {
+  // Each app is downloaded right before it is installed.
+  SetWorkerDownloadPipelineDepth(1);
+
   SetAppStateUpdateAvailable(app1_);
   SetAppStateUpdateAvailable(app2_);
 
@@ -511,6 +715,45 @@ TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_NotAlreadyDownloaded) {
   EXPECT_EQ(STATE_INSTALL_COMPLETE, app2_->state());
 }
 
+// The second app may be downloaded before the first app is installed, but the
+// apps are installed in bundle order.
+TEST_F(WorkerMockedManagersTest, DownloadAndInstallAsync_Pipelined) {
+  SetWorkerDownloadPipelineDepth(2);
+
+  SetAppStateUpdateAvailable(app1_);
+  SetAppStateUpdateAvailable(app2_);
+
+  EXPECT_CALL(*mock_install_manager_, install_working_dir())
+      .WillRepeatedly(Return(app_util::GetTempDir()));
+
+  EXPECT_CALL(*mock_download_manager_, DownloadApp(app1_))
+      .WillOnce(SimulateDownloadAppStateTransition());
+  EXPECT_CALL(*mock_download_manager_, DownloadApp(app2_))
+      .WillOnce(SimulateDownloadAppStateTransition());
+  {
+    ::testing::InSequence dummy;
+    EXPECT_CALL(*mock_install_manager_, InstallApp(app1_, _))
+        .WillOnce(SimulateInstallAppStateTransition());
+    EXPECT_CALL(*mock_install_manager_, InstallApp(app2_, _))
+        .WillOnce(SimulateInstallAppStateTransition());
+  }
+
+  __mutexBlock(worker_->model()->lock()) {
+    EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
+
+    EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app1_->state());
+    EXPECT_EQ(STATE_WAITING_TO_DOWNLOAD, app2_->state());
+
+    SetAppBundleStateForUnitTest(app_bundle_.get(),
+                                 new fsm::AppBundleStateBusy);
+    EXPECT_TRUE(app_bundle_->IsBusy());
+  }
+
+  WaitForBundleToBeReady(*app_bundle_, 5);
+  EXPECT_EQ(STATE_INSTALL_COMPLETE, app1_->state());
+  EXPECT_EQ(STATE_INSTALL_COMPLETE, app2_->state());
+}
+
 TEST_F(WorkerMockedManagersTest, DownloadAsync_Then_DownloadAndInstallAsync) {
   SetAppStateUpdateAvailable(app1_);
   SetAppStateUpdateAvailable(app2_);
@@ -596,6 +839,153 @@ TEST_F(WorkerMockedManagersTest, UpdateAllAppsAsync) {
 // TODO(omaha): Add tests for app already in error state, app failing download
 // or install, all apps failed or failing, etc.
 
+// Runs a bundle of six apps against fake managers that take the same time to
+// download and to install each app.
+class WorkerPipelineTest : public WorkerWithBundleTest {
+ protected:
+  static const int kNumApps = 6;
+  static const int kDownloadTimeMs = 100;
+  static const int kInstallTimeMs = 100;
+
+  WorkerPipelineTest() : WorkerWithBundleTest(), install_manager_(NULL) {}
+
+  virtual void SetUp() {
+    WorkerWithBundleTest::SetUp();
+
+    for (int i = 0; i != kNumApps; ++i) {
+      CString app_id;
+      EXPECT_SUCCEEDED(GetGuid(&app_id));
+      App* app = NULL;
+      EXPECT_SUCCEEDED(app_bundle_->createApp(CComBSTR(app_id), &app));
+      EXPECT_SUCCEEDED(app->put_isEulaAccepted(VARIANT_TRUE));
+      SetAppStateUpdateAvailable(app);
+      apps_.push_back(app);
+    }
+
+    // The Worker takes ownership of the fake managers.
+    SetWorkerDownloadManager(new FakeDownloadManager(&timeline_,
+                                                     kDownloadTimeMs));
+    install_manager_ = new FakeInstallManager(&timeline_,
+                                              kInstallTimeMs,
+                                              kNumApps);
+    SetWorkerInstallManager(install_manager_);
+  }
+
+  virtual void TearDown() {
+    for (size_t i = 0; i != apps_.size(); ++i) {
+      const CString app_id(apps_[i]->app_guid_string());
+      RegKey::DeleteKey(
+          app_registry_utils::GetAppClientStateKey(is_machine_, app_id));
+    }
+    apps_.clear();
+
+    WorkerWithBundleTest::TearDown();
+  }
+
+  // Downloads and installs the bundle.
+  void DownloadAndInstall(int pipeline_depth) {
+    SetWorkerDownloadPipelineDepth(pipeline_depth);
+
+    __mutexBlock(worker_->model()->lock()) {
+      EXPECT_SUCCEEDED(worker_->DownloadAndInstallAsync(app_bundle_.get()));
+
+      SetAppBundleStateForUnitTest(app_bundle_.get(),
+                                   new fsm::AppBundleStateBusy);
+      EXPECT_TRUE(app_bundle_->IsBusy());
+    }
+
+    WaitForBundleToBeReady(*app_bundle_, 30);
+
+    for (size_t i = 0; i != apps_.size(); ++i) {
+      EXPECT_EQ(STATE_INSTALL_COMPLETE, apps_[i]->state());
+    }
+  }
+
+  // Returns the index of the app in the bundle.
+  size_t IndexOf(const App* app) const {
+    for (size_t i = 0; i != apps_.size(); ++i) {
+      if (apps_[i] == app) {
+        return i;
+      }
+    }
+    ADD_FAILURE() << _T("Unknown app.");
+    return apps_.size();
+  }
+
+  // Checks that the apps are installed one at a time in bundle order, each
+  // after its own download, and that no more than |pipeline_depth| downloads
+  // run at the same time. Returns the number of apps whose download started
+  // before the install of the previous app ended.
+  int CheckTimeline(int pipeline_depth) const {
+    const std::vector<ManagerEvent> events(timeline_.events());
+    std::vector<ManagerEvent> downloads(apps_.size());
+    std::vector<ManagerEvent> installs;
+    for (size_t i = 0; i != events.size(); ++i) {
+      if (events[i].is_install) {
+        installs.push_back(events[i]);
+      } else {
+        downloads[IndexOf(events[i].app)] = events[i];
+      }
+    }
+
+    EXPECT_EQ(apps_.size(), installs.size());
+    if (apps_.size() != installs.size()) {
+      return 0;
+    }
+
+    int num_downloads_ahead = 0;
+    for (size_t i = 0; i != installs.size(); ++i) {
+      EXPECT_EQ(apps_[i], installs[i].app);
+      EXPECT_EQ(apps_[i], downloads[i].app);
+      EXPECT_LT(downloads[i].end, installs[i].start);
+      if (i > 0) {
+        EXPECT_LT(installs[i - 1].end, installs[i].start);
+        if (downloads[i].start < installs[i - 1].end) {
+          ++num_downloads_ahead;
+        }
+      }
+    }
+
+    for (size_t i = 0; i != downloads.size(); ++i) {
+      int num_concurrent_downloads = 0;
+      for (size_t j = 0; j != downloads.size(); ++j) {
+        if (downloads[j].start < downloads[i].end &&
+            downloads[i].start < downloads[j].end) {
+          ++num_concurrent_downloads;
+        }
+      }
+      EXPECT_LE(num_concurrent_downloads, pipeline_depth);
+    }
+    return num_downloads_ahead;
+  }
+
+  ManagerTimeline timeline_;
+  std::vector<App*> apps_;
+
+  // Owned by the worker.
+  FakeInstallManager* install_manager_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WorkerPipelineTest);
+};
+
+// Without pipelining, an app is downloaded after the previous app has been
+// installed.
+TEST_F(WorkerPipelineTest, DownloadAndInstallAsync_Serial) {
+  DownloadAndInstall(1);
+
+  EXPECT_EQ(0, CheckTimeline(1));
+}
+
+// With pipelining, the download of every app after the first one starts
+// before the install of the previous app ends.
+TEST_F(WorkerPipelineTest, DownloadAndInstallAsync_Pipelined) {
+  install_manager_->set_wait_for_next_download(true);
+  DownloadAndInstall(3);
+
+  EXPECT_EQ(kNumApps - 1, CheckTimeline(3));
+}
+
 //
 // Large Tests
 // These are large tests because they use threads and access the network.
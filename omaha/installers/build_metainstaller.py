@@ -38,9 +38,9 @@ def BuildMetaInstaller(
     additional_payload_contents_dependencies=None,
     output_dir='$STAGING_DIR',
     installers_sources_path='$MAIN_DIR/installers',
-    lzma_path='$THIRD_PARTY/lzma/files/lzma.exe',
     resmerge_path='$MAIN_DIR/tools/resmerge.exe',
-    bcj2_path='$OBJ_ROOT/mi_exe_stub/x86_encoder/bcj2.exe'):
+    builder_path='$OBJ_ROOT/mi_exe_stub/x86_encoder/metainstaller_builder.exe',
+    payload_cache_dir='$TARGET_ROOT/payload_cache'):
   """Build a meta-installer.
 
     Builds a full meta-installer, which is a meta-installer containing a full
@@ -63,9 +63,12 @@ def BuildMetaInstaller(
     output_dir: path to the directory that will contain the metainstaller
     installers_sources_path: path to the directory containing the source files
         for building the metainstaller
-    lzma_path: path to lzma.exe
     resmerge_path: path to resmerge.exe
-    bcj2_path: path to bcj2.exe
+    builder_path: path to metainstaller_builder.exe, which must come from the
+        same build as the empty meta-installer, since it encodes the payload
+        that the meta-installer decodes
+    payload_cache_dir: path to the directory where the compressed payloads are
+        cached by the hash of their tarball
 
   Returns:
     Target nodes.
@@ -74,9 +77,9 @@ def BuildMetaInstaller(
     Nothing.
   """
 
-  # Payload .tar.lzma
+  # Payload .tar.lzma2
   tarball_filename = '%spayload%s.tar' % (prefix, suffix)
-  payload_filename = tarball_filename + '.lzma'
+  payload_filename = tarball_filename + '.lzma2'
 
   # Collect a list of all the files to include in the payload
   payload_file_names = omaha_version_info.GetMetainstallerPayloadFilenames()
@@ -98,26 +101,17 @@ def BuildMetaInstaller(
   if additional_payload_contents_dependencies:
     env.Depends(tarball_output, additional_payload_contents_dependencies)
 
-  # Preprocess the tarball to increase compressibility
-  bcj_filename = '%spayload%s.tar.bcj' % (prefix, suffix)
-  # TODO(omaha): Add the bcj2 path as an optional parameter.
-  bcj_output = env.Command(
-      target=bcj_filename,
-      source=tarball_output,
-      action='%s "$SOURCES" "$TARGET"' % bcj2_path,
-  )
-  env.Depends(bcj_output, bcj2_path)
-
-  # Compress the tarball
-  lzma_env = env.Clone()
-  lzma_env.Append(
-      LZMAFLAGS=[],
-  )
-  lzma_output = lzma_env.Command(
+  # Preprocess the tarball with BCJ2 to increase compressibility and compress
+  # it with LZMA2 on all the processors. The payload is cached by the hash of
+  # the tarball, so that a tarball which has already been compressed, by this
+  # build or by a previous one, is not compressed again.
+  lzma_output = env.Command(
       target=payload_filename,
-      source=bcj_output,
-      action='%s e $SOURCES $TARGET $LZMAFLAGS' % lzma_path,
+      source=tarball_output,
+      action='%s compress "$SOURCES" "$TARGET" "%s"' % (builder_path,
+                                                       payload_cache_dir),
   )
+  env.Depends(lzma_output, builder_path)
 
   # Construct the resource generation script
   manifest_path = installers_sources_path + '/installers.manifest'
@@ -27,6 +27,7 @@ import codecs
 import os
 import sys
 import re
+import subprocess
 import urllib
 
 class Bundle:
@@ -178,11 +179,14 @@ def BuildTagStringForBundle(bundle):
   return args
 
 def TagOneFile(file, app, applytag_exe_name):
-  """Tags one file with the information contained inside the application.
+  """Starts tagging one file with the information contained inside the
+     application.
   Args:
     file: The input file to be stamped.
     app: Contains all the application data.
     applytag_exe_name: The full path of applytag.exe.
+  Returns:
+    The applytag.exe process, or None if it was not started.
   """
   tag_string = BuildTagStringForBundle(app)
 
@@ -190,7 +194,7 @@ def TagOneFile(file, app, applytag_exe_name):
   if not os.path.exists(file):
     print 'Could not find file %s required for creating %s' % \
           (file, output_path)
-    return False
+    return None
 
   arguments = [applytag_exe_name,
                file,
@@ -199,8 +203,7 @@ def TagOneFile(file, app, applytag_exe_name):
                'append'
               ]
   print 'Building %s with tag %s' % (output_path, tag_string)
-  os.spawnv(os.P_WAIT, applytag_exe_name, arguments)
-  return True
+  return subprocess.Popen(arguments)
 
 def GetAllSetupExeInDirectory(dir):
   """Creates a number of application specific binaries for the
@@ -223,7 +226,8 @@ def GetAllSetupExeInDirectory(dir):
 
 def TagBinary(apps, file, applytag_exe_name):
   """Creates a number of application specific binaries for the
-     passed in binary.
+     passed in binary. The binaries are tagged by as many applytag.exe
+     processes at once as there are processors.
   Args:
     apps: Dictionary of key=lang, value=[Application].
     file: The input file to be stamped.
@@ -231,9 +235,17 @@ def TagBinary(apps, file, applytag_exe_name):
   """
   if not apps:
     return
+  max_processes = max(1, int(os.environ.get('NUMBER_OF_PROCESSORS', 1)))
+  processes = []
   for apps_lang in apps:
     for app in apps[apps_lang]:
-      TagOneFile(file, app, applytag_exe_name)
+      if len(processes) == max_processes:
+        processes.pop(0).wait()
+      process = TagOneFile(file, app, applytag_exe_name)
+      if process:
+        processes.append(process)
+  for process in processes:
+    process.wait()
 
 def PrintUsage():
   print ''
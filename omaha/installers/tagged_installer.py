@@ -14,19 +14,26 @@
 # limitations under the License.
 # ========================================================================
 
+import codecs
 import os
 import re
 
 from installers import tag_meta_installers
 
+_METAINSTALLER_BUILDER = (
+    '$OBJ_ROOT/mi_exe_stub/x86_encoder/metainstaller_builder.exe')
 
-def TagOneBundle(env, bundle, untagged_binary_path, output_dir):
-  tag_str = tag_meta_installers.BuildTagStringForBundle(bundle)
 
+def _GetRelativeOutputPath(bundle):
   # Need to find relative path to output file under source dir, to allow
   # it to be redirected under the output directory.
   indx = bundle.output_file_name.find('installers')
-  relative_filepath = bundle.output_file_name[indx+len('installers')+1:]
+  return bundle.output_file_name[indx+len('installers')+1:]
+
+
+def TagOneBundle(env, bundle, untagged_binary_path, output_dir):
+  tag_str = tag_meta_installers.BuildTagStringForBundle(bundle)
+  relative_filepath = _GetRelativeOutputPath(bundle)
 
   tag_exe = '$TESTS_DIR/ApplyTag.exe'
 
@@ -43,6 +50,57 @@ def TagOneBundle(env, bundle, untagged_binary_path, output_dir):
   return tag_output
 
 
+def _WriteTagList(target, source, env):
+  """Writes the tag list of metainstaller_builder, which is UTF-8."""
+  tag_list_file = codecs.open(str(target[0]), 'w', 'utf8')
+  tag_list_file.write(source[0].get_contents().decode('utf8'))
+  tag_list_file.close()
+
+
+def TagBundles(env, bundles, untagged_binary_path, output_dir,
+               builder_path=_METAINSTALLER_BUILDER):
+  """Tags the untagged binary for all the bundles with a single command.
+
+     Unlike TagOneBundle(), which runs ApplyTag.exe once per bundle,
+     metainstaller_builder.exe tags the copies for all the languages and
+     bundles on all the processors.
+
+  Returns:
+    The tagged installers.
+  """
+  if not bundles:
+    return []
+
+  targets = []
+  tag_list = u''
+  installers_txt_filenames = []
+  for bundle in bundles:
+    target = '%s/%s' % (output_dir, _GetRelativeOutputPath(bundle))
+    targets.append(target)
+    tag_list += u'%s\t%s\n' % (env.File(target).abspath,
+                                tag_meta_installers.BuildTagStringForBundle(
+                                    bundle))
+    if bundle.installers_txt_filename not in installers_txt_filenames:
+      installers_txt_filenames.append(bundle.installers_txt_filename)
+
+  tag_list_output = env.Command(
+      target='tag_list_%s.txt' % os.path.basename(untagged_binary_path),
+      source=env.Value(tag_list.encode('utf8')),
+      action=_WriteTagList,
+  )
+
+  tag_output = env.Command(
+      target=targets,
+      source=[untagged_binary_path, tag_list_output],
+      action='%s tag "${SOURCES[0]}" "${SOURCES[1]}"' % builder_path,
+  )
+
+  # Add extra (hidden) dependencies plus a dependency on the builder.
+  env.Depends(tag_output, installers_txt_filenames + [builder_path])
+
+  return tag_output
+
+
 def _ReadAllBundleInstallerFiles(installers_txt_files_path):
   """Enumerates all the .*_installers.txt files in the installers_txt_files_path
      directory, and creates bundles corresponding to the info in each line in
@@ -83,12 +141,13 @@ def CreateTaggedInstallers(env, installers_txt_files_path, product_name,
   untagged_binary = '%s%sSetup.exe' % (prefix, product_name)
 
   tag_meta_installers.SetOutputFileNames(untagged_binary, bundles, '')
+  all_bundles = []
   for bundles_lang in bundles.itervalues():
-    for bundle in bundles_lang:
-      TagOneBundle(
-          env=env,
-          bundle=bundle,
-          untagged_binary_path='$STAGING_DIR/%s' % (untagged_binary),
-          output_dir='$TARGET_ROOT/Tagged_Installers',
-      )
+    all_bundles += bundles_lang
+  TagBundles(
+      env=env,
+      bundles=all_bundles,
+      untagged_binary_path='$STAGING_DIR/%s' % (untagged_binary),
+      output_dir='$TARGET_ROOT/Tagged_Installers',
+  )
 
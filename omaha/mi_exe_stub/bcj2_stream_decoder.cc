@@ -0,0 +1,321 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// The decoding logic mirrors Bcj2_Decode in third_party/lzma/files/C/Bcj2.c,
+// with the loop state moved into the class so that the main stream can be
+// supplied in pieces.
+
+#include "omaha/mi_exe_stub/bcj2_stream_decoder.h"
+
+namespace omaha {
+
+namespace {
+
+const int kNumTopBits = 24;
+const uint32 kTopValue = static_cast<uint32>(1) << kNumTopBits;
+
+const int kNumBitModelTotalBits = 11;
+const uint32 kBitModelTotal = 1 << kNumBitModelTotalBits;
+const int kNumMoveBits = 5;
+
+// Number of bytes used to initialize the range decoder.
+const int kRangeDecoderInitSize = 5;
+
+bool IsJcc(uint8 b0, uint8 b1) {
+  return b0 == 0x0F && (b1 & 0xF0) == 0x80;
+}
+
+bool IsJ(uint8 b0, uint8 b1) {
+  return (b1 & 0xFE) == 0xE8 || IsJcc(b0, b1);
+}
+
+// Reads a little-endian value from the header.
+uint32 ReadUInt32(const uint8* p) {
+  return static_cast<uint32>(p[0]) |
+         (static_cast<uint32>(p[1]) << 8) |
+         (static_cast<uint32>(p[2]) << 16) |
+         (static_cast<uint32>(p[3]) << 24);
+}
+
+}  // namespace
+
+Bcj2StreamDecoder::Bcj2StreamDecoder(OutputCallback callback,
+                                     void* callback_context)
+    : callback_(callback),
+      callback_context_(callback_context),
+      state_(STATE_HEADER),
+      header_bytes_(0),
+      original_size_(0),
+      main_stream_remaining_(0),
+      side_streams_size_(0),
+      side_streams_bytes_(0),
+      call_(NULL),
+      call_end_(NULL),
+      jump_(NULL),
+      jump_end_(NULL),
+      rc_(NULL),
+      rc_end_(NULL),
+      range_(0),
+      code_(0),
+      prev_byte_(0),
+      out_pos_(0),
+      output_buffer_(new uint8[kOutputBufferSize]),
+      output_buffer_bytes_(0) {
+  _ASSERTE(callback_);
+  for (int i = 0; i != kNumProbs; ++i) {
+    probs_[i] = kBitModelTotal >> 1;
+  }
+}
+
+Bcj2StreamDecoder::~Bcj2StreamDecoder() {
+}
+
+bool Bcj2StreamDecoder::Write(const uint8* data, size_t size) {
+  while (size > 0) {
+    switch (state_) {
+      case STATE_HEADER: {
+        size_t count = kHeaderSize - header_bytes_;
+        if (count > size) {
+          count = size;
+        }
+        memcpy(header_ + header_bytes_, data, count);
+        header_bytes_ += count;
+        data += count;
+        size -= count;
+        if (header_bytes_ == kHeaderSize && !OnHeaderComplete()) {
+          return false;
+        }
+        break;
+      }
+
+      case STATE_SIDE_STREAMS: {
+        size_t count = side_streams_size_ - side_streams_bytes_;
+        if (count > size) {
+          count = size;
+        }
+        memcpy(side_streams_.get() + side_streams_bytes_, data, count);
+        side_streams_bytes_ += count;
+        data += count;
+        size -= count;
+        if (side_streams_bytes_ == side_streams_size_ &&
+            !OnSideStreamsComplete()) {
+          return false;
+        }
+        break;
+      }
+
+      case STATE_MAIN_STREAM: {
+        size_t count = main_stream_remaining_;
+        if (count > size) {
+          count = size;
+        }
+        if (!DecodeMainStream(data, count)) {
+          return false;
+        }
+        data += count;
+        size -= count;
+        break;
+      }
+
+      case STATE_DONE:
+        return true;
+
+      default:
+        _ASSERTE(false);
+        return false;
+    }
+  }
+
+  return true;
+}
+
+bool Bcj2StreamDecoder::OnHeaderComplete() {
+  original_size_ = ReadUInt32(header_);
+  const uint32 main_size = ReadUInt32(header_ + 1 * sizeof(uint32));  // NOLINT
+  const uint32 call_size = ReadUInt32(header_ + 2 * sizeof(uint32));  // NOLINT
+  const uint32 jump_size = ReadUInt32(header_ + 3 * sizeof(uint32));  // NOLINT
+  const uint32 rc_size = ReadUInt32(header_ + 4 * sizeof(uint32));    // NOLINT
+
+  side_streams_size_ = static_cast<size_t>(call_size) + jump_size;
+  if (side_streams_size_ < call_size ||
+      side_streams_size_ + rc_size < side_streams_size_) {
+    return false;
+  }
+  side_streams_size_ += rc_size;
+  main_stream_remaining_ = main_size;
+
+  // The range coder stream always holds at least the initialization bytes.
+  side_streams_.reset(new uint8[side_streams_size_ ? side_streams_size_ : 1]);
+  call_ = side_streams_.get();
+  call_end_ = call_ + call_size;
+  jump_ = call_end_;
+  jump_end_ = jump_ + jump_size;
+  rc_ = jump_end_;
+  rc_end_ = rc_ + rc_size;
+
+  state_ = STATE_SIDE_STREAMS;
+  return side_streams_size_ ? true : OnSideStreamsComplete();
+}
+
+bool Bcj2StreamDecoder::OnSideStreamsComplete() {
+  if (rc_end_ - rc_ < kRangeDecoderInitSize) {
+    return false;
+  }
+
+  code_ = 0;
+  range_ = 0xFFFFFFFF;
+  for (int i = 0; i != kRangeDecoderInitSize; ++i) {
+    code_ = (code_ << 8) | *rc_++;
+  }
+
+  if (original_size_ == 0) {
+    state_ = STATE_DONE;
+    return true;
+  }
+
+  if (main_stream_remaining_ == 0) {
+    return false;
+  }
+
+  state_ = STATE_MAIN_STREAM;
+  return true;
+}
+
+bool Bcj2StreamDecoder::DecodeMainStream(const uint8* data, size_t size) {
+  _ASSERTE(state_ == STATE_MAIN_STREAM);
+  _ASSERTE(size <= main_stream_remaining_);
+
+  for (size_t i = 0; i != size; ++i) {
+    const uint8 b = data[i];
+    --main_stream_remaining_;
+
+    if (!PutByte(b)) {
+      return false;
+    }
+    if (out_pos_ == original_size_) {
+      break;
+    }
+
+    if (!IsJ(prev_byte_, b)) {
+      prev_byte_ = b;
+      continue;
+    }
+
+    uint16* prob = NULL;
+    if (b == 0xE8) {
+      prob = &probs_[prev_byte_];
+    } else if (b == 0xE9) {
+      prob = &probs_[256];
+    } else {
+      prob = &probs_[257];
+    }
+
+    bool bit = false;
+    if (!DecodeBit(prob, &bit)) {
+      return false;
+    }
+    if (!bit) {
+      prev_byte_ = b;
+      continue;
+    }
+
+    const uint8* v = NULL;
+    if (b == 0xE8) {
+      if (call_end_ - call_ < 4) {
+        return false;
+      }
+      v = call_;
+      call_ += 4;
+    } else {
+      if (jump_end_ - jump_ < 4) {
+        return false;
+      }
+      v = jump_;
+      jump_ += 4;
+    }
+
+    const uint32 dest = ((static_cast<uint32>(v[0]) << 24) |
+                         (static_cast<uint32>(v[1]) << 16) |
+                         (static_cast<uint32>(v[2]) << 8) |
+                         static_cast<uint32>(v[3])) - (out_pos_ + 4);
+    for (int j = 0; j != 4 && out_pos_ != original_size_; ++j) {
+      if (!PutByte(static_cast<uint8>(dest >> (8 * j)))) {
+        return false;
+      }
+    }
+    if (out_pos_ == original_size_) {
+      break;
+    }
+    prev_byte_ = static_cast<uint8>(dest >> 24);
+  }
+
+  if (out_pos_ == original_size_) {
+    if (!Flush()) {
+      return false;
+    }
+    state_ = STATE_DONE;
+    return true;
+  }
+
+  // Running out of main stream before the decoded size is reached means the
+  // container is corrupt.
+  return main_stream_remaining_ != 0;
+}
+
+bool Bcj2StreamDecoder::DecodeBit(uint16* prob, bool* bit) {
+  _ASSERTE(prob);
+  _ASSERTE(bit);
+
+  const uint32 ttt = *prob;
+  const uint32 bound = (range_ >> kNumBitModelTotalBits) * ttt;
+  if (code_ < bound) {
+    range_ = bound;
+    *prob = static_cast<uint16>(ttt + ((kBitModelTotal - ttt) >> kNumMoveBits));
+    *bit = false;
+  } else {
+    range_ -= bound;
+    code_ -= bound;
+    *prob = static_cast<uint16>(ttt - (ttt >> kNumMoveBits));
+    *bit = true;
+  }
+
+  if (range_ < kTopValue) {
+    if (rc_ == rc_end_) {
+      return false;
+    }
+    range_ <<= 8;
+    code_ = (code_ << 8) | *rc_++;
+  }
+  return true;
+}
+
+bool Bcj2StreamDecoder::PutByte(uint8 b) {
+  _ASSERTE(out_pos_ < original_size_);
+
+  output_buffer_[output_buffer_bytes_++] = b;
+  ++out_pos_;
+  return output_buffer_bytes_ == kOutputBufferSize ? Flush() : true;
+}
+
+bool Bcj2StreamDecoder::Flush() {
+  if (!output_buffer_bytes_) {
+    return true;
+  }
+  const size_t size = output_buffer_bytes_;
+  output_buffer_bytes_ = 0;
+  return callback_(callback_context_, output_buffer_.get(), size);
+}
+
+}  // namespace omaha
@@ -0,0 +1,111 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Incremental decoder for the BCJ2 container written by x86_encoder/bcj2.exe.
+//
+// The container starts with five 32-bit ints: the decoded size followed by
+// the sizes of the main, call, jump and range coder streams. The call, jump
+// and range coder streams come next and the main stream is last. The side
+// streams are small and are buffered in full; the main stream is decoded as
+// it is written to the decoder and handed to the output callback in bounded
+// chunks, so the decoded data is never held in memory as a whole.
+
+#ifndef OMAHA_MI_EXE_STUB_BCJ2_STREAM_DECODER_H_
+#define OMAHA_MI_EXE_STUB_BCJ2_STREAM_DECODER_H_
+
+#include <windows.h>
+
+#pragma warning(push)
+// C4310: cast truncates constant value
+#pragma warning(disable : 4310)
+#include "base/basictypes.h"
+#pragma warning(pop)
+#include "base/scoped_ptr.h"
+
+namespace omaha {
+
+class Bcj2StreamDecoder {
+ public:
+  // Receives the decoded data. Returns false to abort decoding.
+  typedef bool (*OutputCallback)(void* context, const uint8* data, size_t size);
+
+  Bcj2StreamDecoder(OutputCallback callback, void* callback_context);
+  ~Bcj2StreamDecoder();
+
+  // Consumes the next |size| bytes of the container. Returns false if the
+  // container is malformed or if the output callback fails. Bytes written
+  // after the decoded size has been reached are ignored, as Bcj2_Decode does.
+  bool Write(const uint8* data, size_t size);
+
+  // Returns true once all the decoded data has been passed to the callback.
+  bool done() const { return state_ == STATE_DONE; }
+
+  static const size_t kOutputBufferSize = 64 * 1024;
+
+ private:
+  enum State {
+    STATE_HEADER,
+    STATE_SIDE_STREAMS,
+    STATE_MAIN_STREAM,
+    STATE_DONE,
+  };
+
+  static const int kHeaderSize = 5 * sizeof(uint32);  // NOLINT
+  static const int kNumProbs = 256 + 2;
+
+  bool OnHeaderComplete();
+  bool OnSideStreamsComplete();
+  bool DecodeMainStream(const uint8* data, size_t size);
+  bool DecodeBit(uint16* prob, bool* bit);
+  bool PutByte(uint8 b);
+  bool Flush();
+
+  OutputCallback callback_;
+  void* callback_context_;
+  State state_;
+
+  uint8 header_[kHeaderSize];
+  size_t header_bytes_;
+
+  uint32 original_size_;
+  uint32 main_stream_remaining_;
+  scoped_array<uint8> side_streams_;
+  size_t side_streams_size_;
+  size_t side_streams_bytes_;
+
+  // Read positions in the call, jump and range coder streams.
+  const uint8* call_;
+  const uint8* call_end_;
+  const uint8* jump_;
+  const uint8* jump_end_;
+  const uint8* rc_;
+  const uint8* rc_end_;
+
+  // Range decoder state, carried across calls to Write.
+  uint16 probs_[kNumProbs];
+  uint32 range_;
+  uint32 code_;
+  uint8 prev_byte_;
+
+  uint32 out_pos_;
+  scoped_array<uint8> output_buffer_;
+  size_t output_buffer_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(Bcj2StreamDecoder);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_MI_EXE_STUB_BCJ2_STREAM_DECODER_H_
@@ -0,0 +1,149 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/mi_exe_stub/bcj2_stream_decoder.h"
+#include <string>
+#include <vector>
+#include "omaha/base/app_util.h"
+#include "omaha/base/utils.h"
+#include "omaha/mi_exe_stub/x86_encoder/bcj2_encoder.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+bool AppendOutput(void* context, const uint8* data, size_t size) {
+  EXPECT_LE(size, Bcj2StreamDecoder::kOutputBufferSize);
+  std::string* output = static_cast<std::string*>(context);
+  output->append(reinterpret_cast<const char*>(data), size);
+  return true;
+}
+
+bool FailOutput(void* context, const uint8* data, size_t size) {
+  UNREFERENCED_PARAMETER(context);
+  UNREFERENCED_PARAMETER(data);
+  UNREFERENCED_PARAMETER(size);
+  return false;
+}
+
+void AppendUInt32(uint32 value, std::string* container) {
+  container->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Builds a container in the same layout as x86_encoder/bcj2.exe.
+std::string EncodeContainer(const std::string& input) {
+  std::string main_stream;
+  std::string call_stream;
+  std::string jump_stream;
+  std::string rc_stream;
+  EXPECT_TRUE(Bcj2Encode(input,
+                         &main_stream,
+                         &call_stream,
+                         &jump_stream,
+                         &rc_stream));
+
+  std::string container;
+  AppendUInt32(static_cast<uint32>(input.size()), &container);
+  AppendUInt32(static_cast<uint32>(main_stream.size()), &container);
+  AppendUInt32(static_cast<uint32>(call_stream.size()), &container);
+  AppendUInt32(static_cast<uint32>(jump_stream.size()), &container);
+  AppendUInt32(static_cast<uint32>(rc_stream.size()), &container);
+  container += call_stream;
+  container += jump_stream;
+  container += rc_stream;
+  container += main_stream;
+  return container;
+}
+
+bool DecodeInChunks(const std::string& container,
+                    size_t chunk_size,
+                    std::string* output) {
+  Bcj2StreamDecoder decoder(&AppendOutput, output);
+  for (size_t i = 0; i < container.size(); i += chunk_size) {
+    const size_t size = std::min(chunk_size, container.size() - i);
+    if (!decoder.Write(reinterpret_cast<const uint8*>(container.data()) + i,
+                       size)) {
+      return false;
+    }
+  }
+  return decoder.done();
+}
+
+}  // namespace
+
+TEST(Bcj2StreamDecoderTest, EmptyBuffer) {
+  const std::string container(EncodeContainer(std::string()));
+
+  std::string output;
+  EXPECT_TRUE(DecodeInChunks(container, container.size(), &output));
+  EXPECT_TRUE(output.empty());
+}
+
+// Decodes the unit test module, which contains plenty of calls and jumps, in
+// chunks of various sizes.
+TEST(Bcj2StreamDecoderTest, Chunked) {
+  CString module_path = app_util::GetModulePath(NULL);
+  ASSERT_FALSE(module_path.IsEmpty());
+
+  std::vector<byte> raw_file;
+  ASSERT_HRESULT_SUCCEEDED(
+      ReadEntireFileShareMode(module_path, 0, FILE_SHARE_READ, &raw_file));
+  const std::string input(reinterpret_cast<char*>(&raw_file[0]),
+                          raw_file.size());
+  const std::string container(EncodeContainer(input));
+
+  const size_t kChunkSizes[] = { 1, 7, 4096, 1024 * 1024, container.size() };
+  for (size_t i = 0; i != arraysize(kChunkSizes); ++i) {
+    std::string output;
+    EXPECT_TRUE(DecodeInChunks(container, kChunkSizes[i], &output));
+    EXPECT_TRUE(input == output) << "Chunk size: " << kChunkSizes[i];
+  }
+}
+
+TEST(Bcj2StreamDecoderTest, Truncated) {
+  const std::string input(100000, '\xe8');
+  const std::string container(EncodeContainer(input));
+
+  std::string output;
+  EXPECT_FALSE(DecodeInChunks(container.substr(0, container.size() - 1),
+                              container.size(),
+                              &output));
+  EXPECT_GT(input.size(), output.size());
+}
+
+TEST(Bcj2StreamDecoderTest, CorruptHeader) {
+  std::string container(EncodeContainer("hello world"));
+
+  // Claims a range coder stream too short to initialize the decoder.
+  const uint32 kRangeCoderStreamSize = 1;
+  memcpy(&container[4 * sizeof(uint32)],  // NOLINT
+         &kRangeCoderStreamSize,
+         sizeof(kRangeCoderStreamSize));
+
+  std::string output;
+  EXPECT_FALSE(DecodeInChunks(container, container.size(), &output));
+}
+
+TEST(Bcj2StreamDecoderTest, CallbackFailureAbortsDecoding) {
+  const std::string container(EncodeContainer("hello world"));
+
+  Bcj2StreamDecoder decoder(&FailOutput, NULL);
+  EXPECT_FALSE(decoder.Write(
+      reinterpret_cast<const uint8*>(container.data()), container.size()));
+  EXPECT_FALSE(decoder.done());
+}
+
+}  // namespace omaha
@@ -57,12 +57,12 @@
 #include "omaha/base/system_info.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/const_cmd_line.h"
+#include "omaha/mi_exe_stub/bcj2_stream_decoder.h"
 #include "omaha/mi_exe_stub/process.h"
 #include "omaha/mi_exe_stub/mi.grh"
 #include "omaha/mi_exe_stub/tar.h"
 extern "C" {
-#include "third_party/lzma/files/C/Bcj2.h"
-#include "third_party/lzma/files/C/LzmaDec.h"
+#include "third_party/lzma/files/C/Lzma2Dec.h"
 }
 
 namespace omaha  {
@@ -171,15 +171,11 @@ class MetaInstaller {
     if (CreateUniqueTempDirectory() != 0) {
       return -1;
     }
-    scoped_hfile tarball_file(ExtractTarballToTempLocation());
-    if (!valid(tarball_file)) {
-      return -1;
-    }
 
     // Extract files from the archive and run the first EXE we find in it.
-    Tar tar(temp_dir_, get(tarball_file), true);
+    Tar tar(temp_dir_, true);
     tar.SetCallback(TarFileCallback, this);
-    if (!tar.ExtractToDir()) {
+    if (!ExtractPayload(&tar)) {
       return -1;
     }
 
@@ -347,12 +343,7 @@ class MetaInstaller {
       return false;
     }
 
-    if (!CreateTempSubdirectory(program_files_dir)) {
-      return false;
-    }
-
-    temp_root_dir_ = program_files_dir;
-    return true;
+    return CreateTempSubdirectory(program_files_dir);
   }
 
   // Create a temp directory under %TMP%.
@@ -365,12 +356,7 @@ class MetaInstaller {
       return false;
     }
 
-    if (!CreateTempSubdirectory(user_tmp_dir)) {
-      return false;
-    }
-
-    temp_root_dir_ = user_tmp_dir;
-    return true;
+    return CreateTempSubdirectory(user_tmp_dir);
   }
 
   // Creates a temp directory to hold the embedded setup files. First attempts
@@ -380,46 +366,28 @@ class MetaInstaller {
     return CreateProgramFilesTempDir() || CreateUserTempDir() ? 0 : -1;
   }
 
-  HANDLE ExtractTarballToTempLocation() {
-    HANDLE tarball_file = INVALID_HANDLE_VALUE;
-    TCHAR tarball_filename[MAX_PATH] = {0};
-    if (::GetTempFileName(temp_root_dir_,
-                          _T("GUT"),
-                          0,  // form a unique filename
-                          tarball_filename)) {
-      files_to_delete_.Add(tarball_filename);
-      HRSRC res_info = ::FindResource(NULL,
-                                      MAKEINTRESOURCE(IDR_PAYLOAD),
-                                      _T("B"));
-      if (NULL != res_info) {
-        HGLOBAL resource = ::LoadResource(NULL, res_info);
-        if (NULL != resource) {
-          LPVOID resource_pointer = ::LockResource(resource);
-          if (NULL != resource_pointer) {
-            tarball_file = ::CreateFile(tarball_filename,
-                                        GENERIC_READ | GENERIC_WRITE,
-                                        0,
-                                        NULL,
-                                        OPEN_ALWAYS,
-                                        0,
-                                        NULL);
-            if (INVALID_HANDLE_VALUE != tarball_file) {
-              LARGE_INTEGER file_position = {};
-              if (0 != DecompressBufferToFile(
-                      static_cast<const uint8*>(resource_pointer),
-                      ::SizeofResource(NULL, res_info),
-                      tarball_file) ||
-                  !::SetFilePointerEx(tarball_file, file_position, NULL,
-                                      FILE_BEGIN)) {
-                ::CloseHandle(tarball_file);
-                tarball_file = INVALID_HANDLE_VALUE;
-              }
-            }
-          }
-        }
-      }
+  bool ExtractPayload(Tar* tar) {
+    _ASSERTE(tar);
+
+    HRSRC res_info = ::FindResource(NULL,
+                                    MAKEINTRESOURCE(IDR_PAYLOAD),
+                                    _T("B"));
+    if (NULL == res_info) {
+      return false;
+    }
+    HGLOBAL resource = ::LoadResource(NULL, res_info);
+    if (NULL == resource) {
+      return false;
     }
-    return tarball_file;
+    LPVOID resource_pointer = ::LockResource(resource);
+    if (NULL == resource_pointer) {
+      return false;
+    }
+
+    return 0 == DecompressBufferToTar(
+        static_cast<const uint8*>(resource_pointer),
+        ::SizeofResource(NULL, res_info),
+        tar);
   }
 
   bool CopyMetainstallerToTempLocation() {
@@ -487,6 +455,11 @@ class MetaInstaller {
     mi->HandleTarFile(filename);
   }
 
+  static bool TarWriteCallback(void* context, const uint8* data, size_t size) {
+    Tar* tar = reinterpret_cast<Tar*>(context);
+    return tar->Write(data, size);
+  }
+
   // TODO(omaha): reimplement the relevant files in the LZMA SDK to optimize
   // for size. We'll have to release the modifications (LZMA SDK is CDDL/CDL),
   // which shouldn't be a problem.
@@ -500,89 +473,92 @@ class MetaInstaller {
     delete[] address;
   }
 
-  // Decompress the content of the memory buffer into the file
-  static int DecompressBufferToFile(const uint8* packed_buffer,
-                                    size_t packed_size,
-                                    HANDLE file) {
+  // Decompresses the content of the memory buffer and feeds the tarball it
+  // contains to |tar| as the data is decoded. Memory use is bounded by the
+  // LZMA2 dictionary and the BCJ2 side streams; neither the BCJ2 main stream
+  // nor the tarball are ever held in memory as a whole or written to disk.
+  // The payload is the LZMA2 property byte and the unpacked size, followed by
+  // the LZMA2 stream; see mi_exe_stub/x86_encoder/payload_encoder.h.
+  static int DecompressBufferToTar(const uint8* packed_buffer,
+                                   size_t packed_size,
+                                   Tar* tar) {
     // need header and len minimally
-    if (packed_size < LZMA_PROPS_SIZE + 8) {
+    if (packed_size < 1 + 8) {
       return -1;
     }
 
-    // Note this code won't properly handle decoding large files, since uint32
-    // is used in several places to count size.
     ISzAlloc allocators = { &MyAlloc, &MyFree };
-    CLzmaDec lzma_state;
-    LzmaDec_Construct(&lzma_state);
-    LzmaDec_Allocate(&lzma_state, packed_buffer, LZMA_PROPS_SIZE, &allocators);
-    LzmaDec_Init(&lzma_state);
-    packed_buffer += LZMA_PROPS_SIZE;
-    packed_size -= LZMA_PROPS_SIZE;
-
-    // TODO(omaha): make this independent of endianness.
-    uint64 unpacked_size_64 = *reinterpret_cast<const uint64*>(packed_buffer);
-    size_t unpacked_size = static_cast<size_t>(unpacked_size_64);
-    packed_buffer += sizeof(unpacked_size_64);
-    packed_size -= sizeof(unpacked_size_64);
-
-    scoped_array<uint8> unpacked_buffer(new uint8[unpacked_size]);
-
-    ELzmaStatus status = static_cast<ELzmaStatus>(0);
-    SRes result = LzmaDec_DecodeToBuf(
-        &lzma_state,
-        unpacked_buffer.get(),
-        &unpacked_size,
-        packed_buffer,
-        &packed_size,
-        LZMA_FINISH_END,
-        &status);
-    LzmaDec_Free(&lzma_state, &allocators);
-    if (SZ_OK != result) {
+    CLzma2Dec lzma2_state;
+    Lzma2Dec_Construct(&lzma2_state);
+    if (SZ_OK != Lzma2Dec_Allocate(&lzma2_state,
+                                   *packed_buffer,
+                                   &allocators)) {
       return -1;
     }
+    Lzma2Dec_Init(&lzma2_state);
+    ++packed_buffer;
+    --packed_size;
 
-#if 0
-    // Reverse BCJ coding.
-    uint32 x86_conversion_state;
-    x86_Convert_Init(x86_conversion_state);
-    x86_Convert(unpacked_buffer.get(), unpacked_size, 0, &x86_conversion_state,
-                0 /* decoding */);
-#else
-    // Reverse BCJ2 coding.
-    const uint8* p = unpacked_buffer.get();
-    uint32 original_size = *reinterpret_cast<const uint32*>(p);
-    p += sizeof(uint32);  // NOLINT
-    uint32 stream0_size = *reinterpret_cast<const uint32*>(p);
-    p += sizeof(uint32);  // NOLINT
-    uint32 stream1_size = *reinterpret_cast<const uint32*>(p);
-    p += sizeof(uint32);  // NOLINT
-    uint32 stream2_size = *reinterpret_cast<const uint32*>(p);
-    p += sizeof(uint32);  // NOLINT
-    uint32 stream3_size = *reinterpret_cast<const uint32*>(p);
-    p += sizeof(uint32);  // NOLINT
-
-    scoped_array<uint8> output_buffer(new uint8[original_size]);
-    if (SZ_OK != Bcj2_Decode(p,
-                             stream0_size,
-                             p + stream0_size,
-                             stream1_size,
-                             p + stream0_size + stream1_size,
-                             stream2_size,
-                             p + stream0_size + stream1_size + stream2_size,
-                             stream3_size,
-                             output_buffer.get(), original_size)) {
-      return 1;
-    }
-#endif
+    // The dictionary of the LZMA decoder is the output of the LZMA2 decoder.
+    CLzmaDec& lzma_state = lzma2_state.decoder;
+
+    // TODO(omaha): make this independent of endianness.
+    uint64 unpacked_size = *reinterpret_cast<const uint64*>(packed_buffer);
+    packed_buffer += sizeof(unpacked_size);
+    packed_size -= sizeof(unpacked_size);
+
+    // Reverse BCJ2 coding as the data comes out of the LZMA2 decoder.
+    Bcj2StreamDecoder bcj2_decoder(&TarWriteCallback, tar);
+
+    int result = 0;
+    while (unpacked_size > 0) {
+      // The dictionary is used as a circular buffer. Each pass decodes at
+      // most up to the end of the dictionary and hands the new bytes on.
+      if (lzma_state.dicPos == lzma_state.dicBufSize) {
+        lzma_state.dicPos = 0;
+      }
+      const SizeT dic_pos = lzma_state.dicPos;
+      SizeT dic_limit = lzma_state.dicBufSize;
+      ELzmaFinishMode finish_mode = LZMA_FINISH_ANY;
+      if (unpacked_size <= dic_limit - dic_pos) {
+        dic_limit = dic_pos + static_cast<SizeT>(unpacked_size);
+        finish_mode = LZMA_FINISH_END;
+      }
+
+      SizeT in_size = packed_size;
+      ELzmaStatus status = static_cast<ELzmaStatus>(0);
+      if (SZ_OK != Lzma2Dec_DecodeToDic(&lzma2_state,
+                                        dic_limit,
+                                        packed_buffer,
+                                        &in_size,
+                                        finish_mode,
+                                        &status)) {
+        result = -1;
+        break;
+      }
+      packed_buffer += in_size;
+      packed_size -= in_size;
+
+      const SizeT out_size = lzma_state.dicPos - dic_pos;
+      if (!out_size && !in_size) {
+        // The payload is truncated.
+        result = -1;
+        break;
+      }
+      unpacked_size -= out_size;
 
-    DWORD written;
-    if (!::WriteFile(file, output_buffer.get(), original_size, &written,
-                     NULL) ||
-        written != original_size) {
-        return -1;
+      if (out_size &&
+          !bcj2_decoder.Write(lzma_state.dic + dic_pos, out_size)) {
+        result = -1;
+        break;
+      }
     }
+    Lzma2Dec_Free(&lzma2_state, &allocators);
 
-    return 0;
+    if (result == 0 && (!bcj2_decoder.done() || !tar->done())) {
+      result = -1;
+    }
+    return result;
   }
 
   HINSTANCE instance_;
@@ -591,7 +567,6 @@ class MetaInstaller {
   DWORD exit_code_;
   CSimpleArray<CString> files_to_delete_;
   CString temp_dir_;
-  CString temp_root_dir_;
 };
 
 HRESULT CheckOSRequirements() {
@@ -31,100 +31,144 @@ const char kUstarDone[5] = { '\0', '\0', '\0', '\0', '\0' };
 
 }  // namespace
 
-Tar::Tar(const CString& target_dir, HANDLE file_handle, bool delete_when_done)
+Tar::Tar(const CString& target_dir, bool delete_when_done)
     : target_directory_name_(target_dir),
-      file_handle_(file_handle),
       delete_when_done_(delete_when_done),
       callback_(NULL),
-      callback_context_(NULL) {}
+      callback_context_(NULL),
+      state_(STATE_HEADER),
+      header_bytes_(0),
+      current_file_(INVALID_HANDLE_VALUE),
+      file_bytes_remaining_(0),
+      padding_bytes_remaining_(0) {}
 
 Tar::~Tar() {
+  if (current_file_ != INVALID_HANDLE_VALUE) {
+    // Extraction did not complete. Remove the partially written file.
+    ::CloseHandle(current_file_);
+    ::DeleteFile(current_filename_);
+  }
   for (int i = 0; i != files_to_delete_.GetSize(); ++i) {
     DeleteFile(files_to_delete_[i]);
   }
 }
 
-bool Tar::ExtractToDir() {
-  bool done = false;
-  do {
-    if (!ExtractOneFile(&done)) {
-      return false;
+bool Tar::Write(const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    switch (state_) {
+      case STATE_HEADER: {
+        size_t count = sizeof(header_) - header_bytes_;
+        if (count > size) {
+          count = size;
+        }
+        memcpy(reinterpret_cast<char*>(&header_) + header_bytes_, p, count);
+        header_bytes_ += count;
+        p += count;
+        size -= count;
+        if (header_bytes_ == sizeof(header_)) {
+          header_bytes_ = 0;
+          if (!OnHeaderComplete()) {
+            return false;
+          }
+        }
+        break;
+      }
+
+      case STATE_FILE_DATA: {
+        DWORD count = file_bytes_remaining_;
+        if (count > size) {
+          count = static_cast<DWORD>(size);
+        }
+        DWORD bytes_handled = 0;
+        if (!::WriteFile(current_file_, p, count, &bytes_handled, NULL) ||
+            bytes_handled != count) {
+          return false;
+        }
+        file_bytes_remaining_ -= count;
+        p += count;
+        size -= count;
+        if (!file_bytes_remaining_ && !OnFileComplete()) {
+          return false;
+        }
+        break;
+      }
+
+      case STATE_PADDING: {
+        DWORD count = padding_bytes_remaining_;
+        if (count > size) {
+          count = static_cast<DWORD>(size);
+        }
+        padding_bytes_remaining_ -= count;
+        p += count;
+        size -= count;
+        if (!padding_bytes_remaining_) {
+          state_ = STATE_HEADER;
+        }
+        break;
+      }
+
+      case STATE_DONE:
+        // The rest of the archive is end-of-archive padding.
+        return true;
+
+      default:
+        return false;
     }
-  } while (!done);
+  }
   return true;
 }
 
-bool Tar::ExtractOneFile(bool *done) {
-  USTARHeader header;
-  DWORD bytes_handled;
-  bool result = true;
-  BOOL file_result;
-
-  file_result = ::ReadFile(file_handle_, &header, sizeof(USTARHeader),
-      &bytes_handled, NULL);
-  if (!file_result || bytes_handled != sizeof(USTARHeader)) {
-    return false;
-  }
-  if (0 == memcmp(header.magic, kUstarDone, arraysize(kUstarDone) - 1)) {
+bool Tar::OnHeaderComplete() {
+  if (0 == memcmp(header_.magic, kUstarDone, arraysize(kUstarDone) - 1)) {
     // We're probably done, since we read the final block of all zeroes.
-    *done = true;
+    state_ = STATE_DONE;
     return true;
   }
-  if (0 != memcmp(header.magic, kUstarMagic, arraysize(kUstarMagic) - 1)) {
+  if (0 != memcmp(header_.magic, kUstarMagic, arraysize(kUstarMagic) - 1)) {
     return false;
   }
-  CString new_filename(target_directory_name_);
-  new_filename += "\\";
-  new_filename += header.name;
-  HANDLE new_file = ::CreateFile(new_filename, GENERIC_WRITE, 0, NULL,
+
+  // The name field is not terminated when it uses all kNameSize characters.
+  char name[kNameSize + 1] = {0};
+  memcpy(name, header_.name, kNameSize);
+
+  current_filename_ = target_directory_name_;
+  current_filename_ += "\\";
+  current_filename_ += name;
+  current_file_ = ::CreateFile(current_filename_, GENERIC_WRITE, 0, NULL,
       CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
-  if (new_file == INVALID_HANDLE_VALUE) {
+  if (current_file_ == INVALID_HANDLE_VALUE) {
     return false;
   }
+
   // We don't check for conversion errors because the input data is fixed at
   // build time, so it'll either always work or never work, and we won't ship
   // one that never works.
-  DWORD tar_file_size = strtol(header.size, NULL, 8);  // NOLINT
-  DWORD next_offset = ::SetFilePointer(file_handle_, 0, NULL, FILE_CURRENT) +
-      tar_file_size + (512 - tar_file_size & 0x1ff);
-  while (tar_file_size > 0) {
-    const int kCopyBufferSize = 256 * 1024;
-    char copy_buffer[kCopyBufferSize];
-    DWORD bytes_to_handle = kCopyBufferSize;
-    if (bytes_to_handle > tar_file_size) {
-      bytes_to_handle = tar_file_size;
-    }
-    file_result = ::ReadFile(file_handle_, copy_buffer, bytes_to_handle,
-        &bytes_handled, NULL);
-    if (!file_result) {
-      result = false;
-      break;
-    } else {
-      file_result = ::WriteFile(new_file, copy_buffer, bytes_to_handle,
-          &bytes_handled, NULL);
-      if (!file_result) {
-        result = false;
-        break;
-      } else {
-        tar_file_size -= bytes_to_handle;
-      }
-    }
-  }
-  CloseHandle(new_file);
-  if (result) {
-    if (delete_when_done_) {
-      files_to_delete_.Add(new_filename);
-    }
-    if (callback_ != NULL) {
-      callback_(callback_context_, new_filename);
-    }
+  file_bytes_remaining_ = strtol(header_.size, NULL, 8);  // NOLINT
+  padding_bytes_remaining_ = (512 - file_bytes_remaining_) & 0x1ff;
+  state_ = STATE_FILE_DATA;
+
+  return file_bytes_remaining_ ? true : OnFileComplete();
+}
+
+bool Tar::OnFileComplete() {
+  const bool result = !!::CloseHandle(current_file_);
+  current_file_ = INVALID_HANDLE_VALUE;
+  if (!result) {
+    ::DeleteFile(current_filename_);
+    return false;
   }
 
-  if (INVALID_SET_FILE_POINTER != next_offset) {
-    SetFilePointer(file_handle_, next_offset, NULL, FILE_BEGIN);
+  if (delete_when_done_) {
+    files_to_delete_.Add(current_filename_);
+  }
+  if (callback_ != NULL) {
+    callback_(callback_context_, current_filename_);
   }
 
-  return result;
+  state_ = padding_bytes_remaining_ ? STATE_PADDING : STATE_HEADER;
+  return true;
 }
 
 }  // namespace omaha
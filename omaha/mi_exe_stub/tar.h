@@ -48,9 +48,13 @@ typedef struct {
 
 // Supports untarring of files from a tar-format archive. Pretty minimal;
 // doesn't work with everything in the USTAR format.
+//
+// The archive is supplied incrementally through Write(). Each file is created
+// as soon as its header arrives and its contents are written out as they
+// arrive, so the archive itself never needs to be stored.
 class Tar {
  public:
-  Tar(const CString& target_dir, HANDLE file_handle, bool delete_when_done);
+  Tar(const CString& target_dir, bool delete_when_done);
   ~Tar();
 
   typedef void (*TarFileCallback)(void* context, const TCHAR* filename);
@@ -60,19 +64,38 @@ class Tar {
     callback_context_ = callback_context;
   }
 
-  // Extracts all files in archive to directory specified in constructor.
-  // Directory must exist. Returns true if successful.
-  bool ExtractToDir();
+  // Consumes the next |size| bytes of the archive and extracts the files they
+  // complete to the directory specified in the constructor. Directory must
+  // exist. Returns false on error.
+  bool Write(const void* data, size_t size);
+
+  // Returns true once the end-of-archive block has been consumed.
+  bool done() const { return state_ == STATE_DONE; }
 
  private:
-  HANDLE file_handle_;
+  enum State {
+    STATE_HEADER,
+    STATE_FILE_DATA,
+    STATE_PADDING,
+    STATE_DONE,
+  };
+
+  bool OnHeaderComplete();
+  bool OnFileComplete();
+
   CString target_directory_name_;
   bool delete_when_done_;
   CSimpleArray<CString> files_to_delete_;
   TarFileCallback callback_;
   void* callback_context_;
 
-  bool ExtractOneFile(bool* done);
+  State state_;
+  USTARHeader header_;
+  size_t header_bytes_;
+  HANDLE current_file_;
+  CString current_filename_;
+  DWORD file_bytes_remaining_;
+  DWORD padding_bytes_remaining_;
 };
 
 }  // namespace omaha
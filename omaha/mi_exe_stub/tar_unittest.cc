@@ -0,0 +1,158 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/mi_exe_stub/tar.h"
+#include <string>
+#include <vector>
+#include "omaha/base/app_util.h"
+#include "omaha/base/file.h"
+#include "omaha/base/path.h"
+#include "omaha/base/utils.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const int kBlockSize = 512;
+
+void AppendFile(const char* name, const std::string& contents,
+                std::string* archive) {
+  USTARHeader header = {0};
+  strcpy_s(header.name, arraysize(header.name), name);
+  sprintf_s(header.size, arraysize(header.size), "%011o",  // NOLINT
+            static_cast<unsigned int>(contents.size()));
+  memcpy(header.magic, "ustar", 6);
+  archive->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  archive->append(contents);
+  archive->append((kBlockSize - contents.size()) & (kBlockSize - 1), '\0');
+}
+
+void AppendEndOfArchive(std::string* archive) {
+  archive->append(2 * kBlockSize, '\0');
+}
+
+void RecordFile(void* context, const TCHAR* filename) {
+  std::vector<CString>* files = static_cast<std::vector<CString>*>(context);
+  files->push_back(filename);
+}
+
+}  // namespace
+
+class TarTest : public testing::TestWithParam<size_t> {
+ protected:
+  virtual void SetUp() {
+    target_dir_ = ConcatenatePath(app_util::GetTempDir(), _T("tar_unittest"));
+    EXPECT_HRESULT_SUCCEEDED(CreateDir(target_dir_, NULL));
+  }
+
+  virtual void TearDown() {
+    EXPECT_HRESULT_SUCCEEDED(DeleteDirectory(target_dir_));
+  }
+
+  static std::string ReadFileContents(const CString& path) {
+    std::vector<byte> buffer;
+    EXPECT_HRESULT_SUCCEEDED(ReadEntireFile(path, 0, &buffer));
+    return buffer.empty() ? std::string() :
+        std::string(reinterpret_cast<const char*>(&buffer[0]), buffer.size());
+  }
+
+  CString target_dir_;
+};
+
+INSTANTIATE_TEST_CASE_P(ChunkSizes, TarTest,
+                        ::testing::Values(1, 511, 512, 4096, 1024 * 1024));
+
+// Files are extracted as the archive is written, whatever the chunk size.
+TEST_P(TarTest, Write) {
+  const std::string contents1(1000, 'a');
+  const std::string contents2(kBlockSize, 'b');
+  std::string archive;
+  AppendFile("first.exe", contents1, &archive);
+  AppendFile("empty.txt", std::string(), &archive);
+  AppendFile("second.gup", contents2, &archive);
+  AppendEndOfArchive(&archive);
+
+  std::vector<CString> files;
+  {
+    Tar tar(target_dir_, false);
+    tar.SetCallback(&RecordFile, &files);
+
+    const size_t chunk_size = GetParam();
+    for (size_t i = 0; i < archive.size(); i += chunk_size) {
+      const size_t size = std::min(chunk_size, archive.size() - i);
+      ASSERT_TRUE(tar.Write(archive.data() + i, size));
+
+      // The first file is reported as soon as its last byte is written.
+      if (i + size >= kBlockSize + contents1.size()) {
+        ASSERT_LE(1, files.size());
+      }
+    }
+    EXPECT_TRUE(tar.done());
+  }
+
+  ASSERT_EQ(3, files.size());
+  EXPECT_STREQ(ConcatenatePath(target_dir_, _T("first.exe")), files[0]);
+  EXPECT_STREQ(ConcatenatePath(target_dir_, _T("empty.txt")), files[1]);
+  EXPECT_STREQ(ConcatenatePath(target_dir_, _T("second.gup")), files[2]);
+
+  EXPECT_TRUE(contents1 == ReadFileContents(files[0]));
+  EXPECT_TRUE(ReadFileContents(files[1]).empty());
+  EXPECT_TRUE(contents2 == ReadFileContents(files[2]));
+}
+
+TEST_P(TarTest, Write_Truncated) {
+  std::string archive;
+  AppendFile("first.exe", std::string(1000, 'a'), &archive);
+  archive.resize(archive.size() - 100);
+
+  std::vector<CString> files;
+  {
+    Tar tar(target_dir_, false);
+    tar.SetCallback(&RecordFile, &files);
+    EXPECT_TRUE(tar.Write(archive.data(), archive.size()));
+    EXPECT_FALSE(tar.done());
+  }
+
+  // The partially written file is removed.
+  EXPECT_TRUE(files.empty());
+  EXPECT_FALSE(File::Exists(ConcatenatePath(target_dir_, _T("first.exe"))));
+}
+
+TEST_P(TarTest, Write_BadMagic) {
+  std::string archive;
+  AppendFile("first.exe", std::string(10, 'a'), &archive);
+  archive[offsetof(USTARHeader, magic)] = 'x';
+
+  Tar tar(target_dir_, false);
+  EXPECT_FALSE(tar.Write(archive.data(), archive.size()));
+}
+
+TEST_P(TarTest, DeleteWhenDone) {
+  std::string archive;
+  AppendFile("first.exe", std::string(10, 'a'), &archive);
+  AppendEndOfArchive(&archive);
+
+  const CString path(ConcatenatePath(target_dir_, _T("first.exe")));
+  {
+    Tar tar(target_dir_, true);
+    EXPECT_TRUE(tar.Write(archive.data(), archive.size()));
+    EXPECT_TRUE(tar.done());
+    EXPECT_TRUE(File::Exists(path));
+  }
+  EXPECT_FALSE(File::Exists(path));
+}
+
+}  // namespace omaha
@@ -22,7 +22,7 @@
 
 #include "base/basictypes.h"
 #include "base/scoped_ptr.h"
-#include "omaha/mi_exe_stub/x86_encoder/bcj2_encoder.h"
+#include "omaha/mi_exe_stub/x86_encoder/payload_encoder.h"
 #include "third_party/smartany/scoped_any.h"
 
 int wmain(int argc, WCHAR* argv[], WCHAR* env[]) {
@@ -52,80 +52,16 @@ int wmain(int argc, WCHAR* argv[], WCHAR* env[]) {
     return 4;
   }
 
-  std::string out1;
-  std::string out2;
-  std::string out3;
-  std::string out4;
-  if (!omaha::Bcj2Encode(std::string(reinterpret_cast<char*>(buffer.get()),
-                                     file_size),
-                         &out1, &out2, &out3, &out4)) {
+  std::string output;
+  if (!omaha::Bcj2EncodeContainer(
+          std::string(reinterpret_cast<char*>(buffer.get()), file_size),
+          &output)) {
     return 5;
   }
-
-  // The format of BCJ2 file is very primitive.
-  // Header is 5 32-bit ints, with the following information:
-  //   unpacked size
-  //   size of stream 1
-  //   size of stream 2
-  //   size of stream 3
-  //   size of stream 4
-  const size_t output_buffer_length = 5 * sizeof(uint32) +  // NOLINT
-      out1.size() + out2.size() + out3.size() + out4.size();
-  if (output_buffer_length > DWORD_MAX) {
+  if (output.size() > DWORD_MAX) {
     return 13;
   }
 
-  size_t buffer_remaining = output_buffer_length;
-  scoped_array<uint8> output_buffer(new uint8[output_buffer_length]);
-  uint8* p = output_buffer.get();
-  *reinterpret_cast<uint32*>(p) = bytes_read;
-  p += sizeof(uint32);                                                // NOLINT
-  buffer_remaining -= sizeof(uint32);                                 // NOLINT
-  *reinterpret_cast<uint32*>(p) = static_cast<uint32>(out1.size());
-  p += sizeof(uint32);                                                // NOLINT
-  buffer_remaining -= sizeof(uint32);                                 // NOLINT
-  *reinterpret_cast<uint32*>(p) = static_cast<uint32>(out2.size());
-  p += sizeof(uint32);                                                // NOLINT
-  buffer_remaining -= sizeof(uint32);                                 // NOLINT
-  *reinterpret_cast<uint32*>(p) = static_cast<uint32>(out3.size());
-  p += sizeof(uint32);                                                // NOLINT
-  buffer_remaining -= sizeof(uint32);                                 // NOLINT
-  *reinterpret_cast<uint32*>(p) = static_cast<uint32>(out4.size());
-  p += sizeof(uint32);                                                // NOLINT
-  buffer_remaining -= sizeof(uint32);                                 // NOLINT
-  if (!out1.empty()) {
-    if (0 != memcpy_s(p, buffer_remaining, &out1[0], out1.size())) {
-      return 9;
-    }
-    p += out1.size();
-    buffer_remaining -= out1.size();
-  }
-  if (!out2.empty()) {
-    if (0 != memcpy_s(p, buffer_remaining, &out2[0], out2.size())) {
-      return 10;
-    }
-    p += out2.size();
-    buffer_remaining -= out2.size();
-  }
-  if (!out3.empty()) {
-    if (0 != memcpy_s(p, buffer_remaining, &out3[0], out3.size())) {
-      return 11;
-    }
-    p += out3.size();
-    buffer_remaining -= out3.size();
-  }
-  if (!out4.empty()) {
-    if (0 != memcpy_s(p, buffer_remaining, &out4[0], out4.size())) {
-      return 12;
-    }
-    p += out4.size();
-    buffer_remaining -= out4.size();
-  }
-  if (p != output_buffer.get() + output_buffer_length ||
-      0 != buffer_remaining) {
-    return 8;
-  }
-
   reset(file, ::CreateFile(argv[2], GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0,
                            NULL));
   if (!valid(file)) {
@@ -134,8 +70,8 @@ int wmain(int argc, WCHAR* argv[], WCHAR* env[]) {
 
   DWORD bytes_written = 0;
   if (!::WriteFile(get(file),
-                   output_buffer.get(),
-                   static_cast<DWORD>(output_buffer_length),
+                   output.data(),
+                   static_cast<DWORD>(output.size()),
                    &bytes_written, NULL)) {
     return 7;
   }
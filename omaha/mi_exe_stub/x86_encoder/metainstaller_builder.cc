@@ -0,0 +1,314 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Builds the parts of the metainstallers which used to be built one file at a
+// time by bcj2.exe, lzma.exe and ApplyTag.exe:
+//   metainstaller_builder compress <tarball> <payload> [<cache_dir>]
+//     Encodes the payload of a metainstaller on all the processors. The
+//     payloads are cached in <cache_dir> by the hash of the tarball, so that
+//     the payload of a tarball is only compressed once.
+//   metainstaller_builder tag <signed_file> <tag_list>
+//     Appends a tag to copies of the signed file, for each line of the UTF-8
+//     <tag_list>, which is "<tagged_file>\t<tag>". The copies are tagged on
+//     all the processors.
+// The commands print the time they took, so that the build logs show the
+// time spent on the metainstallers.
+
+#include <windows.h>
+#include <stdio.h>
+#include <tchar.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/scoped_ptr.h"
+#include "omaha/base/apply_tag.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/file.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/path.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/string.h"
+#include "omaha/base/thread.h"
+#include "omaha/base/utils.h"
+#include "omaha/mi_exe_stub/x86_encoder/payload_encoder.h"
+
+namespace omaha {
+
+namespace {
+
+int GetNumberOfProcessors() {
+  SYSTEM_INFO system_info = {0};
+  ::GetSystemInfo(&system_info);
+  return std::max(1, static_cast<int>(system_info.dwNumberOfProcessors));
+}
+
+HRESULT ReadFileToString(const TCHAR* path, std::string* data) {
+  std::vector<byte> buffer;
+  HRESULT hr = ReadEntireFileShareMode(path, 0, FILE_SHARE_READ, &buffer);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  data->assign(buffer.begin(), buffer.end());
+  return S_OK;
+}
+
+HRESULT WriteStringToFile(const TCHAR* path, const std::string& data) {
+  return WriteEntireFile(path, std::vector<byte>(data.begin(), data.end()));
+}
+
+HRESULT CreateParentDir(const TCHAR* path) {
+  const CString dir(GetDirectoryFromPath(path));
+  if (dir.IsEmpty() || File::Exists(dir)) {
+    return S_OK;
+  }
+  return CreateDir(dir, NULL);
+}
+
+int Compress(const TCHAR* tarball_path,
+             const TCHAR* payload_path,
+             const TCHAR* cache_dir) {
+  HighresTimer timer;
+
+  std::string tarball;
+  HRESULT hr = ReadFileToString(tarball_path, &tarball);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not read %s [0x%08x]\n"), tarball_path, hr);
+    return hr;
+  }
+
+  PayloadEncoderOptions options;
+  options.num_threads = GetNumberOfProcessors();
+
+  CString cache_path;
+  if (cache_dir) {
+    const std::string key(GetPayloadCacheKey(tarball, options));
+    cache_path = ConcatenatePath(
+        cache_dir,
+        Utf8ToWideChar(key.c_str(), static_cast<uint32>(key.size())) +
+            _T(".payload"));
+    if (File::Exists(cache_path)) {
+      hr = File::Copy(cache_path, payload_path, true);
+      if (SUCCEEDED(hr)) {
+        _tprintf(_T("%s: cached payload of %Iu bytes in %I64u ms\n"),
+                 payload_path, tarball.size(), timer.GetElapsedMs());
+        return 0;
+      }
+      _tprintf(_T("Could not copy %s [0x%08x]\n"), cache_path, hr);
+    }
+  }
+
+  std::string payload;
+  if (!EncodePayload(tarball, options, &payload)) {
+    _tprintf(_T("Could not encode %s\n"), tarball_path);
+    return E_FAIL;
+  }
+
+  hr = WriteStringToFile(payload_path, payload);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not write %s [0x%08x]\n"), payload_path, hr);
+    return hr;
+  }
+
+  // Several builds may share the cache, so the payload is written to a file
+  // of its own and renamed. The build does not fail if the payload cannot be
+  // cached; the next build compresses the tarball again.
+  if (cache_dir) {
+    CString temp_path;
+    SafeCStringFormat(&temp_path, _T("%s.%u.tmp"),
+                      cache_path, ::GetCurrentProcessId());
+    hr = CreateDir(cache_dir, NULL);
+    if (SUCCEEDED(hr)) {
+      hr = File::Copy(payload_path, temp_path, true);
+    }
+    if (SUCCEEDED(hr)) {
+      hr = File::Move(temp_path, cache_path, true);
+    }
+    if (FAILED(hr)) {
+      _tprintf(_T("Could not cache %s [0x%08x]\n"), payload_path, hr);
+      ::DeleteFile(temp_path);
+    }
+  }
+
+  _tprintf(_T("%s: compressed %Iu bytes to %Iu bytes on %d threads ")
+           _T("in %I64u ms\n"),
+           payload_path, tarball.size(), payload.size(), options.num_threads,
+           timer.GetElapsedMs());
+  return 0;
+}
+
+struct TagJob {
+  CString tagged_file;
+  std::string tag;
+};
+
+// Tags the copies of the signed file until none are left. Called by each
+// thread. The copies which fail are reported, and the other copies are still
+// tagged.
+class TagRunner : public Runnable {
+ public:
+  TagRunner(const CString& signed_file, const std::vector<TagJob>& jobs)
+      : signed_file_(signed_file),
+        jobs_(jobs),
+        next_job_(0),
+        has_failed_(0) {
+  }
+
+  virtual ~TagRunner() {}
+
+  bool has_failed() const { return has_failed_ != 0; }
+
+  virtual void Run() {
+    for (;;) {
+      const size_t next = static_cast<size_t>(
+          ::InterlockedIncrement(&next_job_) - 1);
+      if (next >= jobs_.size()) {
+        return;
+      }
+
+      const TagJob& job = jobs_[next];
+      HRESULT hr = CreateParentDir(job.tagged_file);
+      if (SUCCEEDED(hr)) {
+        ApplyTag apply_tag;
+        hr = apply_tag.Init(signed_file_,
+                            job.tag.c_str(),
+                            static_cast<int>(job.tag.size()),
+                            job.tagged_file,
+                            true);
+        if (SUCCEEDED(hr)) {
+          hr = apply_tag.EmbedTagString();
+        }
+      }
+      if (FAILED(hr)) {
+        _tprintf(_T("Could not tag %s [0x%08x]\n"), job.tagged_file, hr);
+        ::InterlockedExchange(&has_failed_, 1);
+      }
+    }
+  }
+
+ private:
+  const CString signed_file_;
+  const std::vector<TagJob>& jobs_;
+  volatile LONG next_job_;
+  volatile LONG has_failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(TagRunner);
+};
+
+HRESULT ReadTagList(const TCHAR* tag_list_path, std::vector<TagJob>* jobs) {
+  std::string tag_list;
+  HRESULT hr = ReadFileToString(tag_list_path, &tag_list);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  size_t line_start = 0;
+  while (line_start < tag_list.size()) {
+    size_t line_end = tag_list.find('\n', line_start);
+    if (line_end == std::string::npos) {
+      line_end = tag_list.size();
+    }
+    std::string line(tag_list, line_start, line_end - line_start);
+    line_start = line_end + 1;
+
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+      line.resize(line.size() - 1);
+    }
+    if (line.empty()) {
+      continue;
+    }
+
+    const size_t separator = line.find('\t');
+    if (separator == std::string::npos || !separator ||
+        separator + 1 == line.size()) {
+      return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    TagJob job;
+    job.tagged_file = Utf8ToWideChar(line.c_str(),
+                                     static_cast<uint32>(separator));
+    job.tag = line.substr(separator + 1);
+    jobs->push_back(job);
+  }
+  return S_OK;
+}
+
+int Tag(const TCHAR* signed_file, const TCHAR* tag_list_path) {
+  HighresTimer timer;
+
+  std::vector<TagJob> jobs;
+  HRESULT hr = ReadTagList(tag_list_path, &jobs);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not read %s [0x%08x]\n"), tag_list_path, hr);
+    return hr;
+  }
+
+  // The calling thread tags copies along with the worker threads. If a
+  // worker thread fails to start, the other threads tag its copies.
+  TagRunner runner(signed_file, jobs);
+  const size_t num_threads = std::max<size_t>(
+      1, std::min(static_cast<size_t>(GetNumberOfProcessors()), jobs.size()));
+  scoped_array<Thread> threads(num_threads > 1 ?
+                               new Thread[num_threads - 1] :
+                               NULL);
+  size_t num_started_threads = 0;
+  for (; num_started_threads + 1 < num_threads; ++num_started_threads) {
+    if (!threads[num_started_threads].Start(&runner)) {
+      break;
+    }
+  }
+
+  runner.Run();
+
+  for (size_t i = 0; i != num_started_threads; ++i) {
+    VERIFY1(threads[i].WaitTillExit(INFINITE));
+  }
+
+  if (runner.has_failed()) {
+    return E_FAIL;
+  }
+
+  _tprintf(_T("%s: tagged %Iu copies on %Iu threads in %I64u ms\n"),
+           signed_file, jobs.size(), num_started_threads + 1,
+           timer.GetElapsedMs());
+  return 0;
+}
+
+void PrintUsage() {
+  _tprintf(_T("Usage:\n")
+           _T("  metainstaller_builder compress <tarball> <payload> ")
+           _T("[<cache_dir>]\n")
+           _T("  metainstaller_builder tag <signed_file> <tag_list>\n"));
+}
+
+}  // namespace
+
+}  // namespace omaha
+
+int _tmain(int argc, TCHAR* argv[]) {
+  if (argc >= 4 && argc <= 5 && _tcscmp(argv[1], _T("compress")) == 0) {
+    return omaha::Compress(argv[2], argv[3], argc == 5 ? argv[4] : NULL);
+  }
+  if (argc == 4 && _tcscmp(argv[1], _T("tag")) == 0) {
+    if (!omaha::File::Exists(argv[2])) {
+      _tprintf(_T("File \"%s\" not found!\n"), argv[2]);
+      return -1;
+    }
+    return omaha::Tag(argv[2], argv[3]);
+  }
+
+  omaha::PrintUsage();
+  return -1;
+}
@@ -0,0 +1,211 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/mi_exe_stub/x86_encoder/payload_encoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "base/basictypes.h"
+#include "omaha/mi_exe_stub/x86_encoder/bcj2_encoder.h"
+extern "C" {
+#include "third_party/lzma/files/C/Lzma2Enc.h"
+#include "third_party/lzma/files/C/Sha256.h"
+}
+
+namespace omaha {
+
+namespace {
+
+// Changes whenever the format of the payload or the encoder changes, so that
+// the payloads which are cached are not used anymore.
+const char kPayloadFormat[] = "lzma2-bcj2-1";
+
+const size_t kMinBlockSize = 64 * 1024;
+const uint32 kMinDictionarySize = 1 << 12;
+
+void AppendUint32(uint32 value, std::string* output) {
+  for (int i = 0; i != 4; ++i) {
+    output->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+void AppendUint64(uint64 value, std::string* output) {
+  for (int i = 0; i != 8; ++i) {
+    output->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+void* AllocateMemory(void*, size_t size) {
+  return size ? malloc(size) : NULL;
+}
+
+void FreeMemory(void*, void* address) {
+  free(address);
+}
+
+ISzAlloc allocator = { &AllocateMemory, &FreeMemory };
+
+// The streams of the LZMA SDK are structures of function pointers, which are
+// the first member of the structures that implement them.
+struct StringInStream {
+  ISeqInStream stream;
+  const std::string* data;
+  size_t position;
+};
+
+SRes ReadString(void* p, void* buf, size_t* size) {
+  StringInStream* in = static_cast<StringInStream*>(p);
+  const size_t remaining = in->data->size() - in->position;
+  *size = std::min(*size, remaining);
+  if (*size) {
+    memcpy(buf, in->data->data() + in->position, *size);
+    in->position += *size;
+  }
+  return SZ_OK;
+}
+
+struct StringOutStream {
+  ISeqOutStream stream;
+  std::string* data;
+};
+
+size_t WriteString(void* p, const void* buf, size_t size) {
+  StringOutStream* out = static_cast<StringOutStream*>(p);
+  out->data->append(static_cast<const char*>(buf), size);
+  return size;
+}
+
+}  // namespace
+
+PayloadEncoderOptions::PayloadEncoderOptions()
+    : level(5),
+      block_size(kDefaultPayloadBlockSize),
+      num_threads(1) {
+}
+
+bool Bcj2EncodeContainer(const std::string& input, std::string* output) {
+  if (input.size() > kuint32max) {
+    return false;
+  }
+
+  std::string out1;
+  std::string out2;
+  std::string out3;
+  std::string out4;
+  if (!Bcj2Encode(input, &out1, &out2, &out3, &out4)) {
+    return false;
+  }
+  if (out1.size() > kuint32max || out2.size() > kuint32max ||
+      out3.size() > kuint32max || out4.size() > kuint32max) {
+    return false;
+  }
+
+  output->clear();
+  output->reserve(5 * sizeof(uint32) +                                // NOLINT
+                  out1.size() + out2.size() + out3.size() + out4.size());
+  AppendUint32(static_cast<uint32>(input.size()), output);
+  AppendUint32(static_cast<uint32>(out1.size()), output);
+  AppendUint32(static_cast<uint32>(out2.size()), output);
+  AppendUint32(static_cast<uint32>(out3.size()), output);
+  AppendUint32(static_cast<uint32>(out4.size()), output);
+  output->append(out2);
+  output->append(out3);
+  output->append(out4);
+  output->append(out1);
+  return true;
+}
+
+bool EncodePayload(const std::string& tarball,
+                   const PayloadEncoderOptions& options,
+                   std::string* payload) {
+  if (options.level < 0 || options.level > 9 ||
+      options.block_size < kMinBlockSize || options.num_threads < 1) {
+    return false;
+  }
+
+  std::string container;
+  if (!Bcj2EncodeContainer(tarball, &container)) {
+    return false;
+  }
+
+  // The dictionary does not need to be larger than a block, since the blocks
+  // are independent, or than the container. A smaller dictionary is less
+  // memory for the metainstaller to allocate.
+  CLzma2EncProps props;
+  Lzma2EncProps_Init(&props);
+  props.lzmaProps.level = options.level;
+  props.lzmaProps.dictSize = static_cast<uint32>(std::max<size_t>(
+      kMinDictionarySize, std::min(options.block_size, container.size())));
+  props.blockSize = options.block_size;
+
+  // The match finder of each block runs on the thread of the block, since
+  // the blocks already keep the threads busy. The payload is split in blocks
+  // even if there is a single thread, because the encoder compresses the
+  // input as a single block otherwise, and the payload would depend on the
+  // number of threads.
+  props.lzmaProps.numThreads = 1;
+  props.numBlockThreads = std::max(options.num_threads, 2);
+  props.numTotalThreads = props.numBlockThreads;
+
+  CLzma2EncHandle encoder = Lzma2Enc_Create(&allocator, &allocator);
+  if (!encoder) {
+    return false;
+  }
+
+  payload->clear();
+  payload->reserve(kPayloadHeaderSize + container.size() / 2);
+
+  StringInStream in = { { &ReadString }, &container, 0 };
+  StringOutStream out = { { &WriteString }, payload };
+  SRes result = Lzma2Enc_SetProps(encoder, &props);
+  if (result == SZ_OK) {
+    payload->push_back(static_cast<char>(Lzma2Enc_WriteProperties(encoder)));
+    AppendUint64(container.size(), payload);
+    result = Lzma2Enc_Encode(encoder, &out.stream, &in.stream, NULL);
+  }
+  Lzma2Enc_Destroy(encoder);
+
+  return result == SZ_OK;
+}
+
+std::string GetPayloadCacheKey(const std::string& tarball,
+                               const PayloadEncoderOptions& options) {
+  std::string parameters(kPayloadFormat, arraysize(kPayloadFormat));
+  AppendUint32(static_cast<uint32>(options.level), &parameters);
+  AppendUint64(options.block_size, &parameters);
+
+  CSha256 sha256;
+  Sha256_Init(&sha256);
+  Sha256_Update(&sha256,
+                reinterpret_cast<const Byte*>(parameters.data()),
+                parameters.size());
+  Sha256_Update(&sha256,
+                reinterpret_cast<const Byte*>(tarball.data()),
+                tarball.size());
+  Byte digest[SHA256_DIGEST_SIZE] = {0};
+  Sha256_Final(&sha256, digest);
+
+  const char kHexDigits[] = "0123456789abcdef";
+  std::string key;
+  for (size_t i = 0; i != arraysize(digest); ++i) {
+    key.push_back(kHexDigits[digest[i] >> 4]);
+    key.push_back(kHexDigits[digest[i] & 0xf]);
+  }
+  return key;
+}
+
+}  // namespace omaha
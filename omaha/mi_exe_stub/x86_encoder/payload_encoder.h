@@ -0,0 +1,81 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// Encodes the payload of the metainstaller. The tarball is BCJ2 encoded and
+// the result is compressed with LZMA2. The format of the payload is:
+//   the LZMA2 property byte, which encodes the size of the dictionary
+//   the size of the BCJ2 container as a little-endian 64-bit integer
+//   the LZMA2 stream
+// The LZMA2 stream is made of blocks which are compressed independently, so
+// that the blocks are compressed on several threads. The size of the blocks
+// does not depend on the number of threads, so the payload of a tarball is
+// the same on every build machine, which is what allows the builds to cache
+// it. The code does not depend on Windows.
+
+#ifndef OMAHA_MI_EXE_STUB_X86_ENCODER_PAYLOAD_ENCODER_H_
+#define OMAHA_MI_EXE_STUB_X86_ENCODER_PAYLOAD_ENCODER_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace omaha {
+
+// The LZMA2 property byte and the unpacked size.
+const size_t kPayloadHeaderSize = 1 + 8;
+
+// Larger blocks compress better, since each block starts with an empty
+// dictionary, and smaller blocks are compressed on more threads. The size of
+// the dictionary is the size of the blocks, which bounds the memory that the
+// metainstaller allocates to decompress the payload.
+const size_t kDefaultPayloadBlockSize = 4 * 1024 * 1024;
+
+struct PayloadEncoderOptions {
+  PayloadEncoderOptions();
+
+  // The LZMA compression level, from 0 to 9. The default is the level of
+  // lzma.exe.
+  int level;
+
+  size_t block_size;
+
+  // The number of blocks which are compressed at the same time. It does not
+  // change the payload.
+  int num_threads;
+};
+
+// Builds the container of the BCJ2 streams of |input|, which is what
+// bcj2.exe writes:
+//   the size of |input| and the sizes of streams 1 to 4, as little-endian
+//     32-bit integers
+//   streams 2, 3 and 4
+//   stream 1
+// The main stream goes last so that the metainstaller can buffer the small
+// side streams and decode the main stream as it is decompressed.
+bool Bcj2EncodeContainer(const std::string& input, std::string* output);
+
+// Encodes |tarball| into the payload of the metainstaller.
+bool EncodePayload(const std::string& tarball,
+                   const PayloadEncoderOptions& options,
+                   std::string* payload);
+
+// Returns the hex SHA-256 of |tarball| and of the options which change the
+// payload. Builds use it to find the payload of a tarball which has already
+// been compressed.
+std::string GetPayloadCacheKey(const std::string& tarball,
+                               const PayloadEncoderOptions& options);
+
+}  // namespace omaha
+
+#endif  // OMAHA_MI_EXE_STUB_X86_ENCODER_PAYLOAD_ENCODER_H_
@@ -0,0 +1,329 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/mi_exe_stub/x86_encoder/payload_encoder.h"
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/logging.h"
+#include "omaha/mi_exe_stub/x86_encoder/bcj2_encoder.h"
+#include "omaha/testing/unit_test.h"
+extern "C" {
+#include "third_party/lzma/files/C/Bcj2.h"
+#include "third_party/lzma/files/C/Lzma2Dec.h"
+#include "third_party/lzma/files/C/LzmaEnc.h"
+}
+
+namespace omaha {
+
+namespace {
+
+void* AllocateMemory(void*, size_t size) {
+  return size ? malloc(size) : NULL;
+}
+
+void FreeMemory(void*, void* address) {
+  free(address);
+}
+
+ISzAlloc allocator = { &AllocateMemory, &FreeMemory };
+
+uint32 GetUint32(const std::string& data, size_t offset) {
+  uint32 value = 0;
+  for (int i = 3; i >= 0; --i) {
+    value = value << 8 | static_cast<uint8>(data[offset + i]);
+  }
+  return value;
+}
+
+uint64 GetUint64(const std::string& data, size_t offset) {
+  uint64 value = 0;
+  for (int i = 7; i >= 0; --i) {
+    value = value << 8 | static_cast<uint8>(data[offset + i]);
+  }
+  return value;
+}
+
+// Builds |size| bytes which compress like code: calls to a few functions,
+// repeated instruction sequences, strings, and random bytes. A linear
+// congruential generator is used so that the data does not depend on the
+// state of the CRT generator.
+std::string BuildCodeLikeData(size_t size, uint32 seed) {
+  const char* const kStrings[] = {
+    "GoogleUpdate", "appguid", "needsadmin", "%s\\%s.exe", "Software\\",
+  };
+  const uint8 kSequence[] = {
+    0x55, 0x8b, 0xec, 0x83, 0xec, 0x10, 0x53, 0x56, 0x57, 0x8b, 0x7d, 0x08,
+  };
+
+  uint32 state = seed;
+  std::string data;
+  data.reserve(size + 16);
+  while (data.size() < size) {
+    state = state * 1103515245 + 12345;
+    const uint32 random = state >> 8;
+    switch (random % 4) {
+      case 0: {
+        // A CALL to one of 64 functions, which BCJ2 makes absolute.
+        const uint32 target = (random >> 2) % 64 * 4096;
+        const uint32 relative = target - static_cast<uint32>(data.size() + 5);
+        data.push_back(static_cast<char>(0xe8));
+        for (int i = 0; i != 4; ++i) {
+          data.push_back(static_cast<char>(relative >> (8 * i)));
+        }
+        break;
+      }
+      case 1:
+        data.append(reinterpret_cast<const char*>(kSequence),
+                    arraysize(kSequence));
+        break;
+      case 2:
+        data.append(kStrings[(random >> 2) % arraysize(kStrings)]);
+        break;
+      default:
+        data.push_back(static_cast<char>(random >> 2));
+        break;
+    }
+  }
+  data.resize(size);
+  return data;
+}
+
+// Decodes a payload the way the metainstaller does, except that the BCJ2
+// container is held in memory.
+bool DecodePayload(const std::string& payload, std::string* tarball) {
+  if (payload.size() < kPayloadHeaderSize) {
+    return false;
+  }
+
+  std::string container(static_cast<size_t>(GetUint64(payload, 1)), '\0');
+  CLzma2Dec decoder;
+  Lzma2Dec_Construct(&decoder);
+  if (SZ_OK != Lzma2Dec_Allocate(&decoder,
+                                 static_cast<Byte>(payload[0]),
+                                 &allocator)) {
+    return false;
+  }
+  Lzma2Dec_Init(&decoder);
+  SizeT out_size = container.size();
+  SizeT in_size = payload.size() - kPayloadHeaderSize;
+  ELzmaStatus status = static_cast<ELzmaStatus>(0);
+  const SRes result = Lzma2Dec_DecodeToBuf(
+      &decoder,
+      reinterpret_cast<Byte*>(container.empty() ? NULL : &container[0]),
+      &out_size,
+      reinterpret_cast<const Byte*>(payload.data()) + kPayloadHeaderSize,
+      &in_size,
+      LZMA_FINISH_END,
+      &status);
+  Lzma2Dec_Free(&decoder, &allocator);
+  if (result != SZ_OK || out_size != container.size() ||
+      status != LZMA_STATUS_FINISHED_WITH_MARK) {
+    return false;
+  }
+
+  const size_t kContainerHeaderSize = 5 * sizeof(uint32);  // NOLINT
+  if (container.size() < kContainerHeaderSize) {
+    return false;
+  }
+  const size_t sizes[4] = {
+    GetUint32(container, 4),
+    GetUint32(container, 8),
+    GetUint32(container, 12),
+    GetUint32(container, 16),
+  };
+  if (kContainerHeaderSize + sizes[0] + sizes[1] + sizes[2] + sizes[3] !=
+      container.size()) {
+    return false;
+  }
+  const Byte* streams = reinterpret_cast<const Byte*>(container.data()) +
+                        kContainerHeaderSize;
+  const Byte* stream2 = streams;
+  const Byte* stream3 = stream2 + sizes[1];
+  const Byte* stream4 = stream3 + sizes[2];
+  const Byte* stream1 = stream4 + sizes[3];
+
+  tarball->assign(GetUint32(container, 0), '\0');
+  return SZ_OK == Bcj2_Decode(
+      stream1, sizes[0],
+      stream2, sizes[1],
+      stream3, sizes[2],
+      stream4, sizes[3],
+      reinterpret_cast<Byte*>(tarball->empty() ? NULL : &(*tarball)[0]),
+      tarball->size());
+}
+
+}  // namespace
+
+TEST(PayloadEncoderTest, Bcj2EncodeContainer) {
+  const std::string input(BuildCodeLikeData(100000, 1));
+  std::string container;
+  ASSERT_TRUE(Bcj2EncodeContainer(input, &container));
+
+  std::string out1;
+  std::string out2;
+  std::string out3;
+  std::string out4;
+  ASSERT_TRUE(Bcj2Encode(input, &out1, &out2, &out3, &out4));
+  EXPECT_EQ(input.size(), GetUint32(container, 0));
+  EXPECT_EQ(out1.size(), GetUint32(container, 4));
+  EXPECT_EQ(out2.size(), GetUint32(container, 8));
+  EXPECT_EQ(out3.size(), GetUint32(container, 12));
+  EXPECT_EQ(out4.size(), GetUint32(container, 16));
+  EXPECT_EQ(out2 + out3 + out4 + out1, container.substr(20));
+}
+
+TEST(PayloadEncoderTest, EncodePayload) {
+  const std::string tarball(BuildCodeLikeData(300000, 2));
+  std::string payload;
+  ASSERT_TRUE(EncodePayload(tarball, PayloadEncoderOptions(), &payload));
+  EXPECT_LT(payload.size(), tarball.size() / 2);
+
+  std::string decoded;
+  ASSERT_TRUE(DecodePayload(payload, &decoded));
+  EXPECT_TRUE(tarball == decoded);
+}
+
+TEST(PayloadEncoderTest, EncodePayload_Empty) {
+  std::string payload;
+  ASSERT_TRUE(EncodePayload(std::string(), PayloadEncoderOptions(), &payload));
+
+  std::string decoded("not empty");
+  ASSERT_TRUE(DecodePayload(payload, &decoded));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(PayloadEncoderTest, EncodePayload_SeveralBlocks) {
+  const std::string tarball(BuildCodeLikeData(1000000, 3));
+  PayloadEncoderOptions options;
+  options.block_size = 64 * 1024;
+  options.num_threads = 4;
+  std::string payload;
+  ASSERT_TRUE(EncodePayload(tarball, options, &payload));
+
+  std::string decoded;
+  ASSERT_TRUE(DecodePayload(payload, &decoded));
+  EXPECT_TRUE(tarball == decoded);
+}
+
+TEST(PayloadEncoderTest, EncodePayload_SameOnAnyNumberOfThreads) {
+  const std::string tarball(BuildCodeLikeData(1000000, 4));
+  PayloadEncoderOptions options;
+  options.block_size = 128 * 1024;
+
+  std::string expected;
+  ASSERT_TRUE(EncodePayload(tarball, options, &expected));
+  for (int num_threads = 2; num_threads <= 5; ++num_threads) {
+    options.num_threads = num_threads;
+    std::string payload;
+    ASSERT_TRUE(EncodePayload(tarball, options, &payload));
+    EXPECT_TRUE(expected == payload) << num_threads;
+  }
+}
+
+TEST(PayloadEncoderTest, EncodePayload_InvalidOptions) {
+  const std::string tarball(BuildCodeLikeData(1000, 5));
+  std::string payload;
+
+  PayloadEncoderOptions options;
+  options.level = 10;
+  EXPECT_FALSE(EncodePayload(tarball, options, &payload));
+
+  options = PayloadEncoderOptions();
+  options.block_size = 1024;
+  EXPECT_FALSE(EncodePayload(tarball, options, &payload));
+
+  options = PayloadEncoderOptions();
+  options.num_threads = 0;
+  EXPECT_FALSE(EncodePayload(tarball, options, &payload));
+}
+
+TEST(PayloadEncoderTest, GetPayloadCacheKey) {
+  const std::string tarball(BuildCodeLikeData(10000, 6));
+  const PayloadEncoderOptions options;
+  const std::string key(GetPayloadCacheKey(tarball, options));
+  EXPECT_EQ(64, key.size());
+  EXPECT_EQ(std::string::npos, key.find_first_not_of("0123456789abcdef"));
+  EXPECT_EQ(key, GetPayloadCacheKey(tarball, options));
+
+  // The number of threads does not change the payload.
+  PayloadEncoderOptions other_options;
+  other_options.num_threads = 8;
+  EXPECT_EQ(key, GetPayloadCacheKey(tarball, other_options));
+
+  other_options = PayloadEncoderOptions();
+  other_options.level = 9;
+  EXPECT_NE(key, GetPayloadCacheKey(tarball, other_options));
+
+  other_options = PayloadEncoderOptions();
+  other_options.block_size *= 2;
+  EXPECT_NE(key, GetPayloadCacheKey(tarball, other_options));
+
+  std::string other_tarball(tarball);
+  other_tarball[other_tarball.size() / 2] ^= 1;
+  EXPECT_NE(key, GetPayloadCacheKey(other_tarball, options));
+}
+
+// Compares the payload with what bcj2.exe and lzma.exe produced, which is
+// the BCJ2 container compressed as a single LZMA stream with a dictionary of
+// 16 MB.
+TEST(PayloadEncoderTest, DISABLED_Benchmark) {
+  const size_t kTarballSize = 8 * 1024 * 1024;
+  const int kThreads[] = {1, 2, 4};
+
+  const std::string tarball(BuildCodeLikeData(kTarballSize, 7));
+  const double ms_per_tick = 1000.0 / HighresTimer::GetTimerFrequency();
+
+  ULONGLONG start_ticks = HighresTimer::GetCurrentTicks();
+  std::string container;
+  ASSERT_TRUE(Bcj2EncodeContainer(tarball, &container));
+  CLzmaEncProps props;
+  LzmaEncProps_Init(&props);
+  std::vector<Byte> lzma(container.size() + container.size() / 2 + 1024);
+  SizeT lzma_size = lzma.size();
+  Byte lzma_props[LZMA_PROPS_SIZE] = {0};
+  SizeT lzma_props_size = LZMA_PROPS_SIZE;
+  ASSERT_EQ(SZ_OK, LzmaEncode(&lzma.front(), &lzma_size,
+                              reinterpret_cast<const Byte*>(container.data()),
+                              container.size(), &props,
+                              lzma_props, &lzma_props_size, 0, NULL,
+                              &allocator, &allocator));
+  const ULONGLONG lzma_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+  OPT_LOG(L1, (_T("[bcj2.exe and lzma.exe][%f ms][%d bytes]"),
+               lzma_ticks * ms_per_tick,
+               static_cast<int>(LZMA_PROPS_SIZE + 8 + lzma_size)));
+
+  PayloadEncoderOptions options;
+  for (size_t i = 0; i != arraysize(kThreads); ++i) {
+    options.num_threads = kThreads[i];
+    start_ticks = HighresTimer::GetCurrentTicks();
+    std::string payload;
+    ASSERT_TRUE(EncodePayload(tarball, options, &payload));
+    const ULONGLONG ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+    OPT_LOG(L1, (_T("[payload on %d threads][%f ms][%d bytes]"),
+                 kThreads[i], ticks * ms_per_tick,
+                 static_cast<int>(payload.size())));
+  }
+
+  start_ticks = HighresTimer::GetCurrentTicks();
+  EXPECT_FALSE(GetPayloadCacheKey(tarball, options).empty());
+  const ULONGLONG key_ticks = HighresTimer::GetCurrentTicks() - start_ticks;
+  OPT_LOG(L1, (_T("[cache key of a %d byte tarball][%f ms]"),
+               static_cast<int>(kTarballSize), key_ticks * ms_per_tick));
+}
+
+}  // namespace omaha
@@ -878,4 +878,9 @@ bool BitsRequest::download_metrics(DownloadMetrics* dm) const {
   }
 }
 
+bool BitsRequest::response_sha256(std::vector<uint8>* digest) const {
+  UNREFERENCED_PARAMETER(digest);
+  return false;
+}
+
 }   // namespace omaha
@@ -119,6 +119,10 @@ class BitsRequest : public HttpRequestInterface {
 
   virtual bool download_metrics(DownloadMetrics* download_metrics) const;
 
+  // BITS writes the response file itself, therefore the response is not
+  // hashed while it is received.
+  virtual bool response_sha256(std::vector<uint8>* digest) const;
+
   // Sets the minimum length of time that BITS waits after encountering a
   // transient error condition before trying to transfer the file.
   // The default value is 600 seconds.
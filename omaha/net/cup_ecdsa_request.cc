@@ -507,4 +507,9 @@ bool CupEcdsaRequest::download_metrics(DownloadMetrics* dm) const {
   return false;
 }
 
+bool CupEcdsaRequest::response_sha256(std::vector<uint8>* digest) const {
+  UNREFERENCED_PARAMETER(digest);
+  return false;
+}
+
 }   // namespace omaha
@@ -90,6 +90,8 @@ class CupEcdsaRequest : public HttpRequestInterface {
 
   virtual bool download_metrics(DownloadMetrics* download_metrics) const;
 
+  virtual bool response_sha256(std::vector<uint8>* digest) const;
+
  private:
   friend class CupEcdsaRequestTest;
 
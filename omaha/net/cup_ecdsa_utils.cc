@@ -17,17 +17,37 @@
 
 #include <limits>
 #include <vector>
+#include "base/scoped_ptr.h"
 #include "omaha/base/debug.h"
 #include "omaha/base/error.h"
 #include "omaha/base/logging.h"
 #include "omaha/base/security/p256.h"
 #include "omaha/base/security/p256_ecdsa.h"
 #include "omaha/base/security/sha256.h"
+#include "omaha/base/synchronized.h"
 
 namespace omaha {
 
 namespace internal {
 
+namespace {
+
+// The tables of the public keys which signatures were verified with. The keys
+// are compiled in, so there are only a few, and the tables live until the
+// process exits.
+struct PublicKeyTable {
+  p256_int gx;
+  p256_int gy;
+  p256_point_table* table;
+};
+
+const int kMaxPublicKeyTables = 4;
+PublicKeyTable public_key_tables[kMaxPublicKeyTables];
+int num_public_key_tables = 0;
+LLock public_key_tables_lock;
+
+}  // namespace
+
 bool SafeSHA256Hash(const void* data, size_t len,
                     std::vector<uint8>* hash_out) {
   const size_t kMaxLen = static_cast<size_t>(std::numeric_limits<int>::max());
@@ -279,6 +299,33 @@ void EcdsaPublicKey::DecodeFromBuffer(const uint8* encoded_pkey_in) {
   ASSERT1(p256_is_valid_point(&gx_, &gy_));
 }
 
+const p256_point_table* GetPublicKeyTable(const EcdsaPublicKey& public_key) {
+  __mutexScope(public_key_tables_lock);
+
+  for (int i = 0; i < num_public_key_tables; ++i) {
+    const PublicKeyTable& entry = public_key_tables[i];
+    if (p256_cmp(&entry.gx, public_key.gx()) == 0 &&
+        p256_cmp(&entry.gy, public_key.gy()) == 0) {
+      return entry.table;
+    }
+  }
+
+  if (num_public_key_tables == kMaxPublicKeyTables) {
+    return NULL;
+  }
+
+  scoped_ptr<p256_point_table> table(new p256_point_table);
+  if (!p256_point_table_init(public_key.gx(), public_key.gy(), table.get())) {
+    return NULL;
+  }
+
+  PublicKeyTable& entry = public_key_tables[num_public_key_tables++];
+  entry.gx = *public_key.gx();
+  entry.gy = *public_key.gy();
+  entry.table = table.release();
+  return entry.table;
+}
+
 COMPILE_ASSERT(SHA256_DIGEST_SIZE == P256_NBYTES, sha256_digest_isnt_256_bits);
 
 bool VerifyEcdsaSignature(const EcdsaPublicKey& public_key,
@@ -291,6 +338,12 @@ bool VerifyEcdsaSignature(const EcdsaPublicKey& public_key,
   p256_int digest_as_int;
   p256_from_bin(&digest.front(), &digest_as_int);
 
+  const p256_point_table* table = GetPublicKeyTable(public_key);
+  if (table) {
+    return p256_ecdsa_verify_with_table(table, &digest_as_int,
+                                        signature.r(), signature.s()) != 0;
+  }
+
   return p256_ecdsa_verify(public_key.gx(), public_key.gy(),
                            &digest_as_int,
                            signature.r(), signature.s()) != 0;
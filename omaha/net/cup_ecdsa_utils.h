@@ -82,6 +82,12 @@ class EcdsaPublicKey {
   DISALLOW_COPY_AND_ASSIGN(EcdsaPublicKey);
 };
 
+// Returns the precomputed multiples of |public_key|, which make verifying its
+// signatures several times faster. Filling a table costs about twenty
+// verifications, so the table is filled on first use and shared by every
+// request made with the key. Returns NULL if too many keys have tables.
+const p256_point_table* GetPublicKeyTable(const EcdsaPublicKey& public_key);
+
 bool VerifyEcdsaSignature(const EcdsaPublicKey& public_key,
                           const std::vector<uint8>& buffer,
                           const EcdsaSignature& signature);
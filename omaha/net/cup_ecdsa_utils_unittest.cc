@@ -497,6 +497,28 @@ TEST(EcdsaPublicKey, DecodeFromBuffer_ProdKey) {
   key.DecodeFromBuffer(kProdKey);
 }
 
+TEST(EcdsaPublicKey, GetPublicKeyTable) {
+  EcdsaPublicKey test_key1, test_key2, prod_key;
+
+  uint8 kTestKey[] =
+#include "omaha/net/cup_ecdsa_pubkey.3.h"
+  ;   // NOLINT
+  uint8 kProdKey[] =
+#include "omaha/net/cup_ecdsa_pubkey.7.h"
+  ;   // NOLINT
+
+  test_key1.DecodeFromBuffer(kTestKey);
+  test_key2.DecodeFromBuffer(kTestKey);
+  prod_key.DecodeFromBuffer(kProdKey);
+
+  const p256_point_table* test_table = GetPublicKeyTable(test_key1);
+  const p256_point_table* prod_table = GetPublicKeyTable(prod_key);
+  ASSERT_TRUE(test_table);
+  ASSERT_TRUE(prod_table);
+  EXPECT_NE(test_table, prod_table);
+  EXPECT_EQ(test_table, GetPublicKeyTable(test_key2));
+}
+
 }  // namespace internal
 
 }  // namespace omaha
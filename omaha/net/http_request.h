@@ -100,6 +100,12 @@ class HttpRequestInterface {
   // they are meaningful for download requests only. Download requests are the
   // requests where the response goes to a file.
   virtual bool download_metrics(DownloadMetrics* download_metrics) const = 0;
+
+  // Returns true if the SHA-256 digest of the response was computed while the
+  // response was received and copies the digest in the |digest| function
+  // parameter. The digest is available after a successful Send() call and only
+  // for download requests, where the response goes to a file.
+  virtual bool response_sha256(std::vector<uint8>* digest) const = 0;
 };
 
 }   // namespace omaha
@@ -280,6 +280,32 @@ void NetworkConfig::SetConfigurationOverride(
   }
 }
 
+void NetworkConfig::SetProxyRaceWinner(const ProxyConfig& winner) {
+  __mutexBlock(lock_) {
+    proxy_race_winner_.reset(new ProxyConfig);
+    *proxy_race_winner_ = winner;
+  }
+}
+
+void NetworkConfig::PreferProxyRaceWinner(
+    std::vector<ProxyConfig>* configurations) const {
+  ASSERT1(configurations);
+  __mutexBlock(lock_) {
+    if (!proxy_race_winner_.get()) {
+      return;
+    }
+    const size_t winner_hash = hash_value(*proxy_race_winner_);
+    for (size_t i = 0; i != configurations->size(); ++i) {
+      if (hash_value((*configurations)[i]) == winner_hash) {
+        std::rotate(configurations->begin(),
+                    configurations->begin() + i,
+                    configurations->begin() + i + 1);
+        return;
+      }
+    }
+  }
+}
+
 // Serializes configurations for debugging purposes.
 CString NetworkConfig::ToString(const ProxyConfig& config) {
   CString result;
@@ -516,8 +542,10 @@ HRESULT NetworkConfig::SaveProxyConfig(const ProxyConfig& config) {
   }
 
   CString current_configuration;
-  if (SUCCEEDED(key.GetValue(kRegValueSource, &current_configuration)) &&
-      current_configuration != new_configuration) {
+  if (SUCCEEDED(key.GetValue(kRegValueSource, &current_configuration))) {
+    if (current_configuration == new_configuration) {
+      return S_OK;
+    }
     NET_LOG(L3, (_T("[Network configuration changed from %s to %s"),
         current_configuration, new_configuration));
   }
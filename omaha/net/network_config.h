@@ -169,6 +169,14 @@ class NetworkConfig {
   // configuration if the parameter is NULL.
   void SetConfigurationOverride(const ProxyConfig* configuration_override);
 
+  // Remembers the proxy configuration which won the last proxy race, so that
+  // the requests which follow in this process try it first.
+  void SetProxyRaceWinner(const ProxyConfig& winner);
+
+  // Moves the proxy race winner to the front of |configurations|, if it is
+  // one of them.
+  void PreferProxyRaceWinner(std::vector<ProxyConfig>* configurations) const;
+
   // True if the CUP test keys are being used to negotiate the CUP
   // credentials.
   bool static IsUsingCupTestKeys();
@@ -259,6 +267,7 @@ class NetworkConfig {
   bool is_initialized_;
 
   scoped_ptr<ProxyConfig> configuration_override_;
+  scoped_ptr<ProxyConfig> proxy_race_winner_;
 
   Session session_;
   scoped_ptr<HttpClient> http_client_;
@@ -190,6 +190,39 @@ TEST_F(NetworkConfigTest, ConfigurationOverride) {
   EXPECT_EQ(E_FAIL, network_config->GetConfigurationOverride(&actual));
 }
 
+TEST_F(NetworkConfigTest, PreferProxyRaceWinner) {
+  NetworkConfig* network_config = NULL;
+  EXPECT_HRESULT_SUCCEEDED(
+      NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+
+  ProxyConfig direct_config;
+  ProxyConfig wpad_config;
+  wpad_config.auto_detect = true;
+  ProxyConfig named_proxy_config;
+  named_proxy_config.proxy = _T("race-winner.google.com:3128");
+
+  std::vector<ProxyConfig> configurations;
+  configurations.push_back(wpad_config);
+  configurations.push_back(direct_config);
+  configurations.push_back(named_proxy_config);
+
+  network_config->SetProxyRaceWinner(named_proxy_config);
+  network_config->PreferProxyRaceWinner(&configurations);
+  ASSERT_EQ(3, configurations.size());
+  EXPECT_STREQ(named_proxy_config.proxy, configurations[0].proxy);
+  EXPECT_TRUE(configurations[1].auto_detect);
+  EXPECT_FALSE(configurations[2].auto_detect);
+  EXPECT_TRUE(configurations[2].proxy.IsEmpty());
+
+  // The configurations are left as they are when the winner is not one of
+  // them.
+  configurations.erase(configurations.begin());
+  network_config->PreferProxyRaceWinner(&configurations);
+  ASSERT_EQ(2, configurations.size());
+  EXPECT_TRUE(configurations[0].auto_detect);
+  EXPECT_FALSE(configurations[1].auto_detect);
+}
+
 TEST_F(NetworkConfigTest, GetProxyForUrlLocal) {
   CString pac_file_path = app_util::GetModuleDirectory(NULL);
   ASSERT_FALSE(pac_file_path.IsEmpty());
@@ -101,6 +101,10 @@ std::vector<DownloadMetrics> NetworkRequest::download_metrics() const {
   return impl_->download_metrics();
 }
 
+bool NetworkRequest::response_sha256(std::vector<uint8>* digest) const {
+  return impl_->response_sha256(digest);
+}
+
 HRESULT NetworkRequest::QueryHeadersString(uint32 info_level,
                                            const TCHAR* name,
                                            CString* value) {
@@ -116,4 +120,9 @@ void NetworkRequest::set_proxy_configuration(
   return impl_->set_proxy_configuration(proxy_configuration);
 }
 
+void NetworkRequest::set_proxy_race(int max_configurations,
+                                    int stagger_delay_ms) {
+  return impl_->set_proxy_race(max_configurations, stagger_delay_ms);
+}
+
 }  // namespace omaha
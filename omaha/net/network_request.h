@@ -154,6 +154,11 @@ class NetworkRequest {
   // Returns the download metrics corresponding to a download request.
   std::vector<DownloadMetrics> download_metrics() const;
 
+  // Returns true if the SHA-256 digest of the file downloaded by the last
+  // DownloadFile call was computed while the file was received, in which case
+  // the digest is copied in the |digest| parameter.
+  bool response_sha256(std::vector<uint8>* digest) const;
+
   void set_proxy_auth_config(const ProxyAuthConfig& proxy_auth_config);
 
   // Sets the number of retries for the request. The retry mechanism uses
@@ -184,6 +189,15 @@ class NetworkRequest {
   // automatically.
   void set_proxy_configuration(const ProxyConfig* proxy_configuration);
 
+  // Sends the request over the preferred proxy configuration and, if it has
+  // not completed after |stagger_delay_ms|, races the next
+  // |max_configurations| - 1 detected configurations in the background,
+  // starting them |stagger_delay_ms| apart. If the request fails, it is sent
+  // next over the first configuration to receive a response. The race is
+  // disabled by default, and when |max_configurations| is less than 2 or
+  // |stagger_delay_ms| is 0.
+  void set_proxy_race(int max_configurations, int stagger_delay_ms);
+
  private:
   // Uses pimpl idiom to minimize dependencies on implementation details.
   scoped_ptr<internal::NetworkRequestImpl> impl_;
@@ -38,6 +38,7 @@
 #include "omaha/net/http_client.h"
 #include "omaha/net/net_utils.h"
 #include "omaha/net/network_config.h"
+#include "omaha/net/proxy_race.h"
 
 namespace omaha {
 
@@ -98,6 +99,8 @@ NetworkRequestImpl::NetworkRequestImpl(
         low_priority_(false),
         initial_retry_delay_ms_(kDefaultTimeBetweenRetriesMs),
         retry_delay_jitter_ms_(kDefaultRetryTimeJitterMs),
+        proxy_race_size_(0),
+        proxy_race_delay_ms_(0),
         callback_(NULL),
         request_buffer_(NULL),
         request_buffer_length_(0),
@@ -147,6 +150,7 @@ void NetworkRequestImpl::Reset() {
   last_hr_               = S_OK;
   last_http_status_code_ = 0;
   download_metrics_.clear();
+  response_sha256_.clear();
 }
 
 HRESULT NetworkRequestImpl::Close() {
@@ -336,6 +340,35 @@ HRESULT NetworkRequestImpl::DoSendWithRetries() {
   return hr;
 }
 
+HRESULT NetworkRequestImpl::UseProxyRaceWinner(DelayedProxyRace* proxy_race) {
+  ASSERT1(proxy_race);
+  ASSERT1(proxy_configurations_.size() >= 2);
+
+  size_t winner = 0;
+  HRESULT hr = proxy_race->Wait(get(event_cancel_), &winner);
+  SafeCStringAppendFormat(&trace_, _T("Proxy race=0x%08x, winner=%d\r\n"),
+                          hr, static_cast<int>(winner));
+  if (FAILED(hr)) {
+    NET_LOG(LW, (_T("[proxy race failed][0x%08x]"), hr));
+    return hr;
+  }
+
+  // The race is run over the fallback configurations. The winner is tried
+  // next and the other fallbacks keep their order.
+  const size_t index = winner + 1;
+  ASSERT1(index < proxy_configurations_.size());
+  std::rotate(proxy_configurations_.begin() + 1,
+              proxy_configurations_.begin() + index,
+              proxy_configurations_.begin() + index + 1);
+
+  NetworkConfig* network_config = NULL;
+  if (SUCCEEDED(NetworkConfigManager::Instance().GetUserNetworkConfig(
+          &network_config))) {
+    network_config->SetProxyRaceWinner(proxy_configurations_[1]);
+  }
+  return S_OK;
+}
+
 HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
                                    CString* response_headers,
                                    std::vector<uint8>* response) {
@@ -355,11 +388,33 @@ HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
   CString error_response_headers;
   std::vector<uint8> error_response;
 
-  // Tries out all the available configurations until one of them succeeds.
-  // TODO(omaha): remember the last good configuration and prefer that for
-  // future requests.
   HRESULT hr = S_OK;
   ASSERT1(!proxy_configurations_.empty());
+
+  // The request is sent over the preferred configuration right away. If it
+  // has not completed after the race delay, the fallback configurations are
+  // raced in the background, so that the one to try next is known by the
+  // time the request fails.
+  scoped_ptr<DelayedProxyRace> proxy_race;
+  if (proxy_race_size_ >= 2 &&
+      proxy_race_delay_ms_ > 0 &&
+      proxy_configurations_.size() >= 2) {
+    proxy_race.reset(new DelayedProxyRace(network_session_.session_handle,
+                                          proxy_auth_config_));
+    const std::vector<ProxyConfig> fallbacks(proxy_configurations_.begin() + 1,
+                                             proxy_configurations_.end());
+    hr = proxy_race->Start(url_,
+                           fallbacks,
+                           proxy_race_size_ - 1,
+                           proxy_race_delay_ms_,
+                           proxy_race_delay_ms_);
+    if (FAILED(hr)) {
+      NET_LOG(LW, (_T("[failed to start proxy race][0x%08x]"), hr));
+      proxy_race.reset();
+    }
+  }
+
+  // Tries out all the available configurations until one of them succeeds.
   for (size_t i = 0; i != proxy_configurations_.size(); ++i) {
     cur_proxy_config_ = &proxy_configurations_[i];
     hr = DoSendWithConfig(http_status_code, response_headers, response);
@@ -377,6 +432,12 @@ HRESULT NetworkRequestImpl::DoSend(int* http_status_code,
         retry_after_seconds_ > 0) {
       break;
     }
+
+    if (i == 0 && proxy_race.get() &&
+        UseProxyRaceWinner(proxy_race.get()) == GOOPDATE_E_CANCELLED) {
+      hr = GOOPDATE_E_CANCELLED;
+      break;
+    }
   }
 
   // There are only four possible outcomes: success, cancel, BITS disabled
@@ -542,6 +603,11 @@ HRESULT NetworkRequestImpl::DoSendHttpRequest(
     download_metrics_.push_back(download_metrics);
   }
 
+  response_sha256_.clear();
+  if (SUCCEEDED(last_hr_)) {
+    cur_http_request_->response_sha256(&response_sha256_);
+  }
+
   if (last_hr_ == GOOPDATE_E_CANCELLED) {
     return last_hr_;
   }
@@ -688,6 +754,11 @@ void NetworkRequestImpl::DetectProxyConfiguration(
   // the order of existing configurations.
   NetworkConfig::RemoveDuplicates(proxy_configurations);
   ASSERT1(!proxy_configurations->empty());
+
+  // The winner of a proxy race in this process is tried first.
+  if (network_config) {
+    network_config->PreferProxyRaceWinner(proxy_configurations);
+  }
 }
 
 bool NetworkRequestImpl::CanRetryRequest() {
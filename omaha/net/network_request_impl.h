@@ -29,6 +29,8 @@
 
 namespace omaha {
 
+class DelayedProxyRace;
+
 namespace internal {
 
 // The class structure is as following:
@@ -99,12 +101,27 @@ class NetworkRequestImpl {
     }
   }
 
+  void set_proxy_race(int max_configurations, int stagger_delay_ms) {
+    ASSERT1(stagger_delay_ms >= 0);
+    proxy_race_size_ = max_configurations;
+    proxy_race_delay_ms_ = stagger_delay_ms;
+  }
+
   CString trace() const { return trace_; }
 
   std::vector<DownloadMetrics> download_metrics() const {
     return download_metrics_;
   }
 
+  bool response_sha256(std::vector<uint8>* digest) const {
+    ASSERT1(digest);
+    if (response_sha256_.empty()) {
+      return false;
+    }
+    *digest = response_sha256_;
+    return true;
+  }
+
   // Detects the available proxy configurations and returns the chain of
   // configurations to be used.
   void DetectProxyConfiguration(
@@ -139,6 +156,11 @@ class NetworkRequestImpl {
                             CString* response_headers,
                             std::vector<uint8>* response);
 
+  // Waits for the race of the fallback configurations, once the request has
+  // failed over the preferred configuration, and moves the winner to the
+  // front of the fallbacks. The fallbacks are left as is if the race fails.
+  HRESULT UseProxyRaceWinner(DelayedProxyRace* proxy_race);
+
   // Returns true if we should continue to retry a network request, false if
   // we should bail out early.
   bool CanRetryRequest();
@@ -177,6 +199,8 @@ class NetworkRequestImpl {
   bool     low_priority_;
   int      initial_retry_delay_ms_;
   int      retry_delay_jitter_ms_;
+  int      proxy_race_size_;
+  int      proxy_race_delay_ms_;
 
   // Output data members.
   int      http_status_code_;
@@ -221,6 +245,10 @@ class NetworkRequestImpl {
 
   std::vector<DownloadMetrics> download_metrics_;
 
+  // The digest of the downloaded file, if the http request that downloaded
+  // the file computed it while receiving the response.
+  std::vector<uint8> response_sha256_;
+
   static const int kDefaultTimeBetweenRetriesMs      = 5000;    // 5 seconds.
   static const int kServerErrMinTimeBetweenRetriesMs = 20000;   // 20 seconds.
   static const int kMaxTimeBetweenRetriesMs          = 100000;  // 100 seconds.
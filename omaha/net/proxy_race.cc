@@ -0,0 +1,360 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/net/proxy_race.h"
+#include <algorithm>
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
+#include "omaha/base/thread.h"
+#include "omaha/net/http_client.h"
+#include "omaha/net/simple_request.h"
+
+namespace omaha {
+
+// Sends a HEAD request over one proxy configuration in its own thread, then
+// signals the event shared by the racers of the race.
+class ProxyRace::Racer : public Runnable {
+ public:
+  Racer(const CString& url,
+        const ProxyConfig& proxy_config,
+        HINTERNET session_handle,
+        const ProxyAuthConfig& proxy_auth_config,
+        HANDLE done_event)
+      : done_event_(done_event),
+        hr_(E_PENDING),
+        http_status_code_(0),
+        is_done_(false),
+        is_canceled_(false) {
+    request_.set_url(url);
+    request_.set_session_handle(session_handle);
+    request_.set_proxy_configuration(proxy_config);
+    request_.set_proxy_auth_config(proxy_auth_config);
+    request_.set_head_request(true);
+  }
+
+  virtual ~Racer() {}
+
+  bool Start() {
+    return thread_.Start(this);
+  }
+
+  // Cancels the request and waits for the thread to exit.
+  void Cancel() {
+    __mutexBlock(lock_) {
+      is_canceled_ = true;
+      request_.Cancel();
+    }
+    if (thread_.Running()) {
+      VERIFY1(thread_.WaitTillExit(INFINITE));
+    }
+  }
+
+  bool is_done() const {
+    __mutexScope(lock_);
+    return is_done_;
+  }
+
+  HRESULT hr() const {
+    __mutexScope(lock_);
+    return hr_;
+  }
+
+  int http_status_code() const {
+    __mutexScope(lock_);
+    return http_status_code_;
+  }
+
+ private:
+  virtual void Run() {
+    // The request is not sent if the race has ended before the thread runs,
+    // since a request canceled before it is sent would run to completion.
+    bool is_canceled = false;
+    __mutexBlock(lock_) {
+      is_canceled = is_canceled_;
+    }
+
+    HRESULT hr = GOOPDATE_E_CANCELLED;
+    if (!is_canceled) {
+      hr = request_.Send();
+    }
+    const int http_status_code = request_.GetHttpStatusCode();
+    request_.Close();
+
+    __mutexBlock(lock_) {
+      hr_ = hr;
+      http_status_code_ = http_status_code;
+      is_done_ = true;
+    }
+    VERIFY1(::SetEvent(done_event_));
+  }
+
+  SimpleRequest request_;
+  Thread thread_;
+  HANDLE done_event_;    // Not owned by this class.
+
+  HRESULT hr_;
+  int http_status_code_;
+  bool is_done_;
+  bool is_canceled_;
+
+  LLock lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(Racer);
+};
+
+ProxyRace::ProxyRace(HINTERNET session_handle,
+                     const ProxyAuthConfig& proxy_auth_config)
+    : session_handle_(session_handle),
+      proxy_auth_config_(proxy_auth_config) {
+}
+
+ProxyRace::~ProxyRace() {
+}
+
+bool ProxyRace::IsResponseReceived(int http_status_code) {
+  switch (http_status_code) {
+    case HTTP_STATUS_PROXY_AUTH_REQ:
+    case HTTP_STATUS_BAD_GATEWAY:
+    case HTTP_STATUS_GATEWAY_TIMEOUT:
+      return false;
+    default:
+      return HttpClient::GetStatusCodeClass(http_status_code) !=
+             HttpClient::STATUS_CODE_NOCODE;
+  }
+}
+
+HRESULT ProxyRace::Run(const CString& url,
+                       const std::vector<ProxyConfig>& proxy_configurations,
+                       size_t max_racers,
+                       int stagger_delay_ms,
+                       HANDLE cancel_event,
+                       size_t* winner) {
+  ASSERT1(!url.IsEmpty());
+  ASSERT1(stagger_delay_ms >= 0);
+  ASSERT1(cancel_event);
+  ASSERT1(winner);
+
+  *winner = 0;
+
+  const size_t num_racers = std::min(max_racers, proxy_configurations.size());
+  if (!num_racers) {
+    return E_INVALIDARG;
+  }
+
+  scoped_event done_event(::CreateEvent(NULL, false, false, NULL));
+  if (!done_event) {
+    return HRESULTFromLastError();
+  }
+
+  std::vector<Racer*> racers;
+  HRESULT hr = E_FAIL;
+  bool should_start_racer = true;
+  DWORD racer_start_time_ms = 0;
+  bool is_race_over = false;
+  while (!is_race_over) {
+    // Starts the next racer when the race begins, when the stagger delay has
+    // elapsed, or when all the racers started so far have failed.
+    if (should_start_racer) {
+      ASSERT1(racers.size() < num_racers);
+      const ProxyConfig& proxy_config = proxy_configurations[racers.size()];
+      NET_LOG(L3, (_T("[ProxyRace][starting racer][%s]"),
+                   NetworkConfig::ToString(proxy_config)));
+      Racer* racer = new Racer(url,
+                               proxy_config,
+                               session_handle_,
+                               proxy_auth_config_,
+                               get(done_event));
+      racers.push_back(racer);
+      if (!racer->Start()) {
+        hr = HRESULTFromLastError();
+        NET_LOG(LE, (_T("[ProxyRace][failed to start racer][0x%08x]"), hr));
+        break;
+      }
+      racer_start_time_ms = ::GetTickCount();
+      should_start_racer = false;
+    }
+
+    DWORD timeout_ms = INFINITE;
+    if (racers.size() < num_racers) {
+      const DWORD elapsed_ms = ::GetTickCount() - racer_start_time_ms;
+      timeout_ms = elapsed_ms < static_cast<DWORD>(stagger_delay_ms) ?
+                   stagger_delay_ms - elapsed_ms : 0;
+    }
+
+    HANDLE handles[] = {cancel_event, get(done_event)};
+    const DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                                  handles,
+                                                  false,
+                                                  timeout_ms);
+    if (result == WAIT_TIMEOUT) {
+      should_start_racer = true;
+      continue;
+    }
+    if (result == WAIT_OBJECT_0) {
+      hr = GOOPDATE_E_CANCELLED;
+      break;
+    }
+    if (result != WAIT_OBJECT_0 + 1) {
+      hr = HRESULTFromLastError();
+      break;
+    }
+
+    // The event is auto-reset, so all the racers are looked at, in case
+    // several of them have finished.
+    bool are_all_done = true;
+    for (size_t i = 0; i != racers.size() && !is_race_over; ++i) {
+      if (!racers[i]->is_done()) {
+        are_all_done = false;
+      } else if (IsResponseReceived(racers[i]->http_status_code())) {
+        *winner = i;
+        hr = S_OK;
+        is_race_over = true;
+      }
+    }
+
+    if (is_race_over || !are_all_done) {
+      continue;
+    }
+
+    if (racers.size() < num_racers) {
+      should_start_racer = true;
+    } else {
+      // No configuration worked. The error of the preferred configuration is
+      // returned, as NetworkRequestImpl does.
+      hr = racers[0]->hr();
+      if (SUCCEEDED(hr)) {
+        hr = HRESULTFromHttpStatusCode(racers[0]->http_status_code());
+      }
+      is_race_over = true;
+    }
+  }
+
+  for (size_t i = 0; i != racers.size(); ++i) {
+    racers[i]->Cancel();
+    delete racers[i];
+  }
+
+  NET_LOG(L3, (_T("[ProxyRace::Run][0x%08x][winner=%d]"),
+               hr, static_cast<int>(*winner)));
+  return hr;
+}
+
+DelayedProxyRace::DelayedProxyRace(HINTERNET session_handle,
+                                   const ProxyAuthConfig& proxy_auth_config)
+    : proxy_race_(session_handle, proxy_auth_config),
+      max_racers_(0),
+      start_delay_ms_(0),
+      stagger_delay_ms_(0),
+      hr_(E_PENDING),
+      winner_(0) {
+}
+
+DelayedProxyRace::~DelayedProxyRace() {
+  Stop();
+}
+
+HRESULT DelayedProxyRace::Start(
+    const CString& url,
+    const std::vector<ProxyConfig>& proxy_configurations,
+    size_t max_racers,
+    int start_delay_ms,
+    int stagger_delay_ms) {
+  ASSERT1(start_delay_ms >= 0);
+  ASSERT1(!thread_.Running());
+
+  url_ = url;
+  proxy_configurations_ = proxy_configurations;
+  max_racers_ = max_racers;
+  start_delay_ms_ = start_delay_ms;
+  stagger_delay_ms_ = stagger_delay_ms;
+
+  reset(start_event_, ::CreateEvent(NULL, true, false, NULL));
+  reset(stop_event_, ::CreateEvent(NULL, true, false, NULL));
+  if (!start_event_ || !stop_event_) {
+    return HRESULTFromLastError();
+  }
+
+  if (!thread_.Start(this)) {
+    return HRESULTFromLastError();
+  }
+  return S_OK;
+}
+
+HRESULT DelayedProxyRace::Wait(HANDLE cancel_event, size_t* winner) {
+  ASSERT1(cancel_event);
+  ASSERT1(winner);
+  ASSERT1(thread_.GetThreadHandle());
+
+  *winner = 0;
+
+  VERIFY1(::SetEvent(get(start_event_)));
+
+  HANDLE handles[] = {cancel_event, thread_.GetThreadHandle()};
+  const DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                                handles,
+                                                false,
+                                                INFINITE);
+  HRESULT hr = S_OK;
+  if (result == WAIT_OBJECT_0) {
+    hr = GOOPDATE_E_CANCELLED;
+  } else if (result != WAIT_OBJECT_0 + 1) {
+    hr = HRESULTFromLastError();
+  }
+  if (FAILED(hr)) {
+    Stop();
+    return hr;
+  }
+
+  *winner = winner_;
+  return hr_;
+}
+
+void DelayedProxyRace::Stop() {
+  if (stop_event_) {
+    VERIFY1(::SetEvent(get(stop_event_)));
+  }
+  if (thread_.Running()) {
+    VERIFY1(thread_.WaitTillExit(INFINITE));
+  }
+}
+
+void DelayedProxyRace::Run() {
+  HANDLE handles[] = {get(stop_event_), get(start_event_)};
+  const DWORD result = ::WaitForMultipleObjects(arraysize(handles),
+                                                handles,
+                                                false,
+                                                start_delay_ms_);
+  if (result == WAIT_OBJECT_0) {
+    hr_ = GOOPDATE_E_CANCELLED;
+    return;
+  }
+  if (result == WAIT_FAILED) {
+    hr_ = HRESULTFromLastError();
+    return;
+  }
+
+  NET_LOG(L3, (_T("[DelayedProxyRace][starting race]")));
+  hr_ = proxy_race_.Run(url_,
+                        proxy_configurations_,
+                        max_racers_,
+                        stagger_delay_ms_,
+                        get(stop_event_),
+                        &winner_);
+}
+
+}  // namespace omaha
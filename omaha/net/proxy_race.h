@@ -0,0 +1,131 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// ProxyRace finds a proxy configuration which works without waiting for the
+// configurations before it to time out. A HEAD request for the url is sent
+// over the first configuration. If it has not received a response after a
+// delay, or if it fails, a HEAD request is sent over the next configuration,
+// and so on. The first configuration to receive a response from the server
+// wins and the other requests are canceled.
+//
+// Only HEAD requests are raced, so that the request itself is sent once, over
+// the winning configuration. Sending POST requests, such as update checks,
+// over several configurations could deliver them several times to the server.
+// The server answers the HEAD request for such urls with an error, such as
+// 405 Method Not Allowed, which still shows that it can be reached.
+//
+// DelayedProxyRace runs the race in the background, only once the request
+// sent over the preferred configuration has stalled or failed.
+
+#ifndef OMAHA_NET_PROXY_RACE_H_
+#define OMAHA_NET_PROXY_RACE_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/thread.h"
+#include "omaha/net/network_config.h"
+
+namespace omaha {
+
+class ProxyRace {
+ public:
+  ProxyRace(HINTERNET session_handle,
+            const ProxyAuthConfig& proxy_auth_config);
+  ~ProxyRace();
+
+  // Races the first |max_racers| configurations, starting them
+  // |stagger_delay_ms| apart. Returns S_OK and the index of the winning
+  // configuration in |winner|. Returns GOOPDATE_E_CANCELLED if |cancel_event|
+  // is signaled, or the error of the first configuration if none of the
+  // configurations received a response.
+  HRESULT Run(const CString& url,
+              const std::vector<ProxyConfig>& proxy_configurations,
+              size_t max_racers,
+              int stagger_delay_ms,
+              HANDLE cancel_event,
+              size_t* winner);
+
+ private:
+  class Racer;
+
+  // Returns true if |http_status_code| shows that the request went through
+  // the proxy configuration and reached the server. Any status counts, even
+  // an error, since the server may not accept HEAD requests for the url. The
+  // exceptions are 407, which proxies return when they require
+  // authentication, and 502 and 504, which they return when they cannot reach
+  // the server.
+  static bool IsResponseReceived(int http_status_code);
+
+  HINTERNET session_handle_;   // Not owned by this class.
+  ProxyAuthConfig proxy_auth_config_;
+
+  friend class ProxyRaceTest;
+
+  DISALLOW_COPY_AND_ASSIGN(ProxyRace);
+};
+
+// Runs a ProxyRace in its own thread once |start_delay_ms| has elapsed, so
+// that the request can be sent over the preferred configuration meanwhile.
+// The race does not start if it is stopped during the delay.
+class DelayedProxyRace : public Runnable {
+ public:
+  DelayedProxyRace(HINTERNET session_handle,
+                   const ProxyAuthConfig& proxy_auth_config);
+  virtual ~DelayedProxyRace();
+
+  // Starts the thread of the race. The arguments are the ones of
+  // ProxyRace::Run.
+  HRESULT Start(const CString& url,
+                const std::vector<ProxyConfig>& proxy_configurations,
+                size_t max_racers,
+                int start_delay_ms,
+                int stagger_delay_ms);
+
+  // Waits for the race to end, and starts it right away if it is still
+  // waiting for the start delay. Returns the result of ProxyRace::Run, or
+  // GOOPDATE_E_CANCELLED if |cancel_event| is signaled first.
+  HRESULT Wait(HANDLE cancel_event, size_t* winner);
+
+  // Cancels the race and waits for its thread to exit.
+  void Stop();
+
+ private:
+  virtual void Run();
+
+  ProxyRace proxy_race_;
+  Thread thread_;
+
+  CString url_;
+  std::vector<ProxyConfig> proxy_configurations_;
+  size_t max_racers_;
+  int start_delay_ms_;
+  int stagger_delay_ms_;
+
+  scoped_event start_event_;    // Ends the start delay.
+  scoped_event stop_event_;     // Cancels the race.
+
+  // The result of the race. They are read once the thread has exited.
+  HRESULT hr_;
+  size_t winner_;
+
+  DISALLOW_COPY_AND_ASSIGN(DelayedProxyRace);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_NET_PROXY_RACE_H_
@@ -0,0 +1,406 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// The proxies are loopback servers, which serve the absolute urls they
+// receive. The url which is requested is not local, so that WinHttp does not
+// bypass the proxies.
+
+#include <windows.h>
+#include <winhttp.h>
+#include <atlstr.h>
+#include <string>
+#include <vector>
+#include "omaha/base/error.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/time.h"
+#include "omaha/net/detector.h"
+#include "omaha/net/network_config.h"
+#include "omaha/net/network_request.h"
+#include "omaha/net/proxy_race.h"
+#include "omaha/net/simple_request.h"
+#include "omaha/testing/loopback_http_server.h"
+#include "omaha/testing/unit_test.h"
+
+namespace omaha {
+
+namespace {
+
+const TCHAR kUrl[] = _T("http://proxy-race.example.com/file");
+
+// Like the update check url, the url only accepts POST requests.
+const TCHAR kPostOnlyUrl[] = _T("http://proxy-race.example.com/update");
+
+// Long enough for a request to never complete during a test.
+const int kNeverMs = 60000;
+
+// Detects the same proxy configuration every time.
+class FixedProxyDetector : public ProxyDetectorInterface {
+ public:
+  explicit FixedProxyDetector(const ProxyConfig& config) : config_(config) {}
+
+  virtual HRESULT Detect(ProxyConfig* config) {
+    *config = config_;
+    return S_OK;
+  }
+
+  virtual const TCHAR* source() { return config_.source; }
+
+ private:
+  const ProxyConfig config_;
+
+  DISALLOW_COPY_AND_ASSIGN(FixedProxyDetector);
+};
+
+}  // namespace
+
+class ProxyRaceTest : public testing::Test {
+ protected:
+  ProxyRaceTest() : session_handle_(NULL) {}
+
+  virtual void SetUp() {
+    NetworkConfig* network_config = NULL;
+    EXPECT_HRESULT_SUCCEEDED(
+        NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+    session_handle_ = network_config->session().session_handle;
+
+    reset(cancel_event_, ::CreateEvent(NULL, true, false, NULL));
+    ASSERT_TRUE(cancel_event_);
+  }
+
+  virtual void TearDown() {
+    NetworkConfig* network_config = NULL;
+    EXPECT_HRESULT_SUCCEEDED(
+        NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+    network_config->Clear();
+  }
+
+  // Starts a proxy which answers after |latency_ms|.
+  void StartProxy(LoopbackHttpServer* proxy, int latency_ms) {
+    proxy->AddFile(_T("/file"), "contents", latency_ms);
+    ASSERT_HRESULT_SUCCEEDED(proxy->Start());
+  }
+
+  // Starts a proxy which answers after |latency_ms| and which only accepts
+  // POST requests for kPostOnlyUrl.
+  void StartPostOnlyProxy(LoopbackHttpServer* proxy, int latency_ms) {
+    proxy->AddPostOnlyFile(_T("/update"), "response", latency_ms);
+    ASSERT_HRESULT_SUCCEEDED(proxy->Start());
+  }
+
+  // Returns a named proxy configuration for |proxy|. The port of a proxy
+  // which has been stopped refuses the connections.
+  static ProxyConfig GetProxyConfig(const LoopbackHttpServer& proxy) {
+    CString host_port(proxy.base_url());
+    host_port.Replace(_T("http://"), _T(""));
+    host_port.TrimRight(_T('/'));
+
+    ProxyConfig config;
+    config.source = _T("ProxyRaceTest");
+    config.proxy = host_port;
+    return config;
+  }
+
+  // Makes |configs| the configurations that NetworkRequest detects, in this
+  // order and before the static configurations. The detectors are cleared by
+  // TearDown.
+  static void SetDetectedConfigurations(
+      const std::vector<ProxyConfig>& configs) {
+    NetworkConfig* network_config = NULL;
+    EXPECT_HRESULT_SUCCEEDED(
+        NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+    network_config->Clear();
+    for (size_t i = 0; i != configs.size(); ++i) {
+      ProxyConfig config(configs[i]);
+      config.priority = ProxyConfig::PROXY_PRIORITY_OVERRIDE;
+      network_config->Add(new FixedProxyDetector(config));
+    }
+  }
+
+  HRESULT RunRace(const std::vector<ProxyConfig>& configs,
+                  size_t max_racers,
+                  int stagger_delay_ms,
+                  size_t* winner) {
+    ProxyRace proxy_race(session_handle_, ProxyAuthConfig(NULL, CString()));
+    return proxy_race.Run(kUrl,
+                          configs,
+                          max_racers,
+                          stagger_delay_ms,
+                          get(cancel_event_),
+                          winner);
+  }
+
+  static bool IsResponseReceived(int http_status_code) {
+    return ProxyRace::IsResponseReceived(http_status_code);
+  }
+
+  HRESULT StartDelayedRace(const std::vector<ProxyConfig>& configs,
+                           int start_delay_ms,
+                           DelayedProxyRace* proxy_race) {
+    return proxy_race->Start(kUrl, configs, configs.size(), start_delay_ms, 0);
+  }
+
+  HINTERNET session_handle_;
+  scoped_event cancel_event_;
+};
+
+TEST_F(ProxyRaceTest, IsResponseReceived) {
+  EXPECT_FALSE(IsResponseReceived(0));
+  EXPECT_TRUE(IsResponseReceived(HTTP_STATUS_OK));
+  EXPECT_TRUE(IsResponseReceived(HTTP_STATUS_MOVED));
+  EXPECT_TRUE(IsResponseReceived(HTTP_STATUS_BAD_METHOD));
+  EXPECT_TRUE(IsResponseReceived(HTTP_STATUS_NOT_FOUND));
+  EXPECT_TRUE(IsResponseReceived(HTTP_STATUS_SERVER_ERROR));
+  EXPECT_TRUE(IsResponseReceived(HTTP_STATUS_SERVICE_UNAVAIL));
+  EXPECT_FALSE(IsResponseReceived(HTTP_STATUS_PROXY_AUTH_REQ));
+  EXPECT_FALSE(IsResponseReceived(HTTP_STATUS_BAD_GATEWAY));
+  EXPECT_FALSE(IsResponseReceived(HTTP_STATUS_GATEWAY_TIMEOUT));
+}
+
+// A configuration wins when the server rejects the HEAD request, since the
+// server was reached.
+TEST_F(ProxyRaceTest, PostOnlyUrlIsReached) {
+  LoopbackHttpServer slow_proxy;
+  LoopbackHttpServer proxy;
+  StartPostOnlyProxy(&slow_proxy, kNeverMs);
+  StartPostOnlyProxy(&proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(slow_proxy));
+  configs.push_back(GetProxyConfig(proxy));
+
+  ProxyRace proxy_race(session_handle_, ProxyAuthConfig(NULL, CString()));
+  const uint64 start_ms = GetCurrentMsTime();
+  size_t winner = 0;
+  EXPECT_HRESULT_SUCCEEDED(proxy_race.Run(kPostOnlyUrl,
+                                          configs,
+                                          configs.size(),
+                                          100,
+                                          get(cancel_event_),
+                                          &winner));
+  EXPECT_EQ(1, static_cast<int>(winner));
+  EXPECT_GT(static_cast<uint64>(kNeverMs), GetCurrentMsTime() - start_ms);
+  EXPECT_EQ(1, proxy.num_requests());
+  EXPECT_EQ(0, proxy.GetRequestCount(_T("/update")));
+}
+
+// NetworkRequest races its fallback configurations when the preferred one
+// fails, and posts the request once, over the winner. The fallback before the
+// winner stalls, so the request only completes in time if the race picks the
+// configuration which reaches the server.
+TEST_F(ProxyRaceTest, NetworkRequestPostsOverWinner) {
+  LoopbackHttpServer refusing_proxy;
+  LoopbackHttpServer slow_proxy;
+  LoopbackHttpServer proxy;
+  StartProxy(&refusing_proxy, 0);
+  refusing_proxy.Stop();
+  StartPostOnlyProxy(&slow_proxy, kNeverMs);
+  StartPostOnlyProxy(&proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(refusing_proxy));
+  configs.push_back(GetProxyConfig(slow_proxy));
+  configs.push_back(GetProxyConfig(proxy));
+  SetDetectedConfigurations(configs);
+
+  NetworkConfig* network_config = NULL;
+  EXPECT_HRESULT_SUCCEEDED(
+      NetworkConfigManager::Instance().GetUserNetworkConfig(&network_config));
+  NetworkRequest network_request(network_config->session());
+  network_request.AddHttpRequest(new SimpleRequest);
+  network_request.set_num_retries(0);
+  network_request.set_proxy_race(3, 100);
+
+  const uint64 start_ms = GetCurrentMsTime();
+  std::vector<uint8> response;
+  EXPECT_HRESULT_SUCCEEDED(
+      network_request.PostString(kPostOnlyUrl, _T("request"), &response));
+  EXPECT_GT(static_cast<uint64>(kNeverMs), GetCurrentMsTime() - start_ms);
+  EXPECT_EQ(HTTP_STATUS_OK, network_request.http_status_code());
+  EXPECT_EQ(std::string("response"),
+            std::string(response.begin(), response.end()));
+
+  // The race sent a HEAD request over each fallback and the request was
+  // posted over the winner only.
+  EXPECT_EQ(1, slow_proxy.num_requests());
+  EXPECT_EQ(0, slow_proxy.GetRequestCount(_T("/update")));
+  EXPECT_EQ(1, proxy.GetRequestCount(_T("/update")));
+  EXPECT_NE(-1, network_request.trace().Find(_T("winner=1")));
+}
+
+// The second configuration is not tried when the first one answers before
+// the stagger delay.
+TEST_F(ProxyRaceTest, FirstConfigurationWins) {
+  LoopbackHttpServer fast_proxy;
+  LoopbackHttpServer other_proxy;
+  StartProxy(&fast_proxy, 0);
+  StartProxy(&other_proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(fast_proxy));
+  configs.push_back(GetProxyConfig(other_proxy));
+
+  size_t winner = 1;
+  EXPECT_HRESULT_SUCCEEDED(RunRace(configs, 2, kNeverMs, &winner));
+  EXPECT_EQ(0, static_cast<int>(winner));
+  EXPECT_EQ(1, fast_proxy.num_requests());
+  EXPECT_EQ(0, other_proxy.num_requests());
+
+  // Only HEAD requests are sent.
+  EXPECT_EQ(0, fast_proxy.GetRequestCount(_T("/file")));
+}
+
+// A configuration which fails does not hold up the next one until the
+// stagger delay elapses.
+TEST_F(ProxyRaceTest, RefusedConfigurationIsSkipped) {
+  LoopbackHttpServer refusing_proxy;
+  LoopbackHttpServer fast_proxy;
+  StartProxy(&refusing_proxy, 0);
+  refusing_proxy.Stop();
+  StartProxy(&fast_proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(refusing_proxy));
+  configs.push_back(GetProxyConfig(fast_proxy));
+
+  const uint64 start_ms = GetCurrentMsTime();
+  size_t winner = 0;
+  EXPECT_HRESULT_SUCCEEDED(RunRace(configs, 2, kNeverMs, &winner));
+  EXPECT_EQ(1, static_cast<int>(winner));
+  EXPECT_GT(static_cast<uint64>(kNeverMs), GetCurrentMsTime() - start_ms);
+}
+
+// A slow configuration is raced against the next one after the stagger
+// delay, and the slow request is canceled when the next one wins.
+TEST_F(ProxyRaceTest, SlowConfigurationIsRaced) {
+  LoopbackHttpServer slow_proxy;
+  LoopbackHttpServer fast_proxy;
+  StartProxy(&slow_proxy, kNeverMs);
+  StartProxy(&fast_proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(slow_proxy));
+  configs.push_back(GetProxyConfig(fast_proxy));
+
+  const uint64 start_ms = GetCurrentMsTime();
+  size_t winner = 0;
+  EXPECT_HRESULT_SUCCEEDED(RunRace(configs, 2, 100, &winner));
+  EXPECT_EQ(1, static_cast<int>(winner));
+  EXPECT_GT(static_cast<uint64>(kNeverMs), GetCurrentMsTime() - start_ms);
+  EXPECT_EQ(1, slow_proxy.num_requests());
+}
+
+// Only the first |max_racers| configurations are raced.
+TEST_F(ProxyRaceTest, MaxRacers) {
+  LoopbackHttpServer slow_proxy;
+  LoopbackHttpServer fast_proxy;
+  StartProxy(&slow_proxy, 500);
+  StartProxy(&fast_proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(slow_proxy));
+  configs.push_back(GetProxyConfig(fast_proxy));
+
+  size_t winner = 1;
+  EXPECT_HRESULT_SUCCEEDED(RunRace(configs, 1, 0, &winner));
+  EXPECT_EQ(0, static_cast<int>(winner));
+  EXPECT_EQ(0, fast_proxy.num_requests());
+}
+
+TEST_F(ProxyRaceTest, NoConfigurationWorks) {
+  LoopbackHttpServer refusing_proxy;
+  StartProxy(&refusing_proxy, 0);
+  refusing_proxy.Stop();
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(refusing_proxy));
+  configs.push_back(GetProxyConfig(refusing_proxy));
+
+  size_t winner = 0;
+  const HRESULT hr = RunRace(configs, 2, kNeverMs, &winner);
+  EXPECT_TRUE(FAILED(hr));
+  EXPECT_NE(GOOPDATE_E_CANCELLED, hr);
+}
+
+TEST_F(ProxyRaceTest, Canceled) {
+  LoopbackHttpServer slow_proxy;
+  StartProxy(&slow_proxy, kNeverMs);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(slow_proxy));
+  configs.push_back(GetProxyConfig(slow_proxy));
+
+  EXPECT_TRUE(::SetEvent(get(cancel_event_)));
+
+  size_t winner = 0;
+  EXPECT_EQ(GOOPDATE_E_CANCELLED, RunRace(configs, 2, kNeverMs, &winner));
+}
+
+// The race does not start when it is stopped during the start delay.
+TEST_F(ProxyRaceTest, DelayedRaceStoppedBeforeStart) {
+  LoopbackHttpServer proxy;
+  StartProxy(&proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(proxy));
+
+  DelayedProxyRace proxy_race(session_handle_,
+                              ProxyAuthConfig(NULL, CString()));
+  EXPECT_HRESULT_SUCCEEDED(StartDelayedRace(configs, kNeverMs, &proxy_race));
+  proxy_race.Stop();
+  EXPECT_EQ(0, proxy.num_requests());
+}
+
+// Waiting for the race starts it without waiting for the start delay.
+TEST_F(ProxyRaceTest, DelayedRaceStartsWhenWaitedFor) {
+  LoopbackHttpServer refusing_proxy;
+  LoopbackHttpServer fast_proxy;
+  StartProxy(&refusing_proxy, 0);
+  refusing_proxy.Stop();
+  StartProxy(&fast_proxy, 0);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(refusing_proxy));
+  configs.push_back(GetProxyConfig(fast_proxy));
+
+  DelayedProxyRace proxy_race(session_handle_,
+                              ProxyAuthConfig(NULL, CString()));
+  EXPECT_HRESULT_SUCCEEDED(StartDelayedRace(configs, kNeverMs, &proxy_race));
+
+  const uint64 start_ms = GetCurrentMsTime();
+  size_t winner = 0;
+  EXPECT_HRESULT_SUCCEEDED(proxy_race.Wait(get(cancel_event_), &winner));
+  EXPECT_EQ(1, static_cast<int>(winner));
+  EXPECT_GT(static_cast<uint64>(kNeverMs), GetCurrentMsTime() - start_ms);
+  EXPECT_EQ(1, fast_proxy.num_requests());
+}
+
+TEST_F(ProxyRaceTest, DelayedRaceCanceled) {
+  LoopbackHttpServer slow_proxy;
+  StartProxy(&slow_proxy, kNeverMs);
+
+  std::vector<ProxyConfig> configs;
+  configs.push_back(GetProxyConfig(slow_proxy));
+
+  DelayedProxyRace proxy_race(session_handle_,
+                              ProxyAuthConfig(NULL, CString()));
+  EXPECT_HRESULT_SUCCEEDED(StartDelayedRace(configs, 0, &proxy_race));
+  EXPECT_TRUE(::SetEvent(get(cancel_event_)));
+
+  size_t winner = 0;
+  EXPECT_EQ(GOOPDATE_E_CANCELLED,
+            proxy_race.Wait(get(cancel_event_), &winner));
+}
+
+}  // namespace omaha
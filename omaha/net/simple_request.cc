@@ -58,6 +58,7 @@ SimpleRequest::TransientRequestState::TransientRequestState()
       current_bytes(0),
       request_begin_ms(0),
       request_end_ms(0) {
+  SHA256_init(&sha256_context);
 }
 
 SimpleRequest::TransientRequestState::~TransientRequestState() {
@@ -66,6 +67,7 @@ SimpleRequest::TransientRequestState::~TransientRequestState() {
 SimpleRequest::SimpleRequest()
     : request_buffer_(NULL),
       request_buffer_length_(0),
+      is_head_request_(false),
       proxy_auth_config_(NULL, CString()),
       is_canceled_(false),
       is_closed_(false),
@@ -228,14 +230,15 @@ HRESULT SimpleRequest::Send() {
       if (!IsPauseSupported() || request_state_ == NULL) {
         request_state_.reset(new TransientRequestState);
       } else {
-        // Discard all previous download states except content_length and
-        // current_bytes for resume purpose. These two states will be validated
-        // against the previously (partially) downloaded file when reopens the
-        // target file.
+        // Discard all previous download states except content_length,
+        // current_bytes, and the partial hash for resume purpose. These states
+        // will be validated against the previously (partially) downloaded
+        // file when reopens the target file.
         scoped_ptr<TransientRequestState> request_state(
             new TransientRequestState);
         request_state->content_length = request_state_->content_length;
         request_state->current_bytes = request_state_->current_bytes;
+        request_state->sha256_context = request_state_->sha256_context;
 
         request_state_.swap(request_state);
       }
@@ -328,7 +331,9 @@ HRESULT SimpleRequest::Connect() {
     request_state_->is_https = true;
     flags |= WINHTTP_FLAG_SECURE;
   }
-  const TCHAR* verb = IsPostRequest() ? _T("POST") : _T("GET");
+  ASSERT1(!(IsPostRequest() && is_head_request_));
+  const TCHAR* verb = IsPostRequest() ? _T("POST") :
+                      is_head_request_ ? _T("HEAD") : _T("GET");
   hr = winhttp_adapter_->OpenRequest(verb, request_state_->url_path,
                                      NULL, WINHTTP_NO_REFERER,
                                      WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
@@ -601,6 +606,11 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
     return S_OK;
   }
 
+  // The response to a HEAD request has a Content-Length header but no body.
+  if (is_head_request_) {
+    return S_OK;
+  }
+
   int content_length = 0;
   winhttp_adapter_->QueryRequestHeadersInt(WINHTTP_QUERY_CONTENT_LENGTH,
                                            WINHTTP_HEADER_NAME_BY_INDEX,
@@ -615,6 +625,13 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
       request_state_->http_status_code == HTTP_STATUS_OK ||
       request_state_->http_status_code == HTTP_STATUS_PARTIAL_CONTENT;
 
+  // The file is written from the beginning unless a download is resumed, in
+  // which case the hash of the bytes already written is continued.
+  if (request_state_->current_bytes == 0) {
+    SHA256_init(&request_state_->sha256_context);
+  }
+  request_state_->response_sha256.clear();
+
   std::vector<uint8> buffer;
   do  {
     DWORD bytes_available(0);
@@ -639,6 +656,9 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
           return HRESULTFromLastError();
         }
         ASSERT1(num_bytes == buffer.size());
+        SHA256_update(&request_state_->sha256_context,
+                      &buffer.front(),
+                      static_cast<unsigned int>(buffer.size()));
       } else {
         request_state_->response.insert(request_state_->response.end(),
                                         buffer.begin(),
@@ -675,6 +695,12 @@ HRESULT SimpleRequest::ReceiveData(HANDLE file_handle) {
     return HRESULT_FROM_WIN32(ERROR_WINHTTP_CONNECTION_ERROR);
   }
 
+  if (!filename_.IsEmpty()) {
+    const uint8* digest = SHA256_final(&request_state_->sha256_context);
+    request_state_->response_sha256.assign(digest,
+                                           digest + SHA256_DIGEST_SIZE);
+  }
+
   download_completed_ = true;
   return hr;
 }
@@ -878,4 +904,14 @@ bool SimpleRequest::download_metrics(DownloadMetrics* dm) const {
   }
 }
 
+bool SimpleRequest::response_sha256(std::vector<uint8>* digest) const {
+  ASSERT1(digest);
+  if (request_state_.get() && !request_state_->response_sha256.empty()) {
+    *digest = request_state_->response_sha256;
+    return true;
+  } else {
+    return false;
+  }
+}
+
 }  // namespace omaha
@@ -30,6 +30,7 @@
 #include "omaha/base/debug.h"
 #include "omaha/base/scoped_any.h"
 #include "omaha/base/synchronized.h"
+#include "omaha/base/security/sha256.h"
 #include "omaha/net/http_request.h"
 #include "omaha/net/network_config.h"
 
@@ -109,6 +110,14 @@ class SimpleRequest : public HttpRequestInterface {
 
   virtual bool download_metrics(DownloadMetrics* download_metrics) const;
 
+  virtual bool response_sha256(std::vector<uint8>* digest) const;
+
+  // Sends a HEAD request instead of a GET request. Only the status code and
+  // the headers of the response are received.
+  void set_head_request(bool is_head_request) {
+    is_head_request_ = is_head_request;
+  }
+
  private:
   HRESULT DoSend();
   HRESULT OpenDestinationFile(HANDLE* file_handle);
@@ -162,6 +171,14 @@ class SimpleRequest : public HttpRequestInterface {
     uint64 request_begin_ms;
     uint64 request_end_ms;
     scoped_ptr<DownloadMetrics> download_metrics;
+
+    // The hash of the bytes written to the file so far. It is carried over
+    // when a download is resumed, so that the digest of a file downloaded
+    // with range requests covers the whole file.
+    LITE_SHA256_CTX sha256_context;
+
+    // The digest of the downloaded file, set when the download completes.
+    std::vector<uint8> response_sha256;
   };
 
   LLock lock_;
@@ -174,6 +191,7 @@ class SimpleRequest : public HttpRequestInterface {
   CString filename_;
   const void* request_buffer_;          // Contains the request body for POST.
   size_t      request_buffer_length_;   // Length of the request body.
+  bool is_head_request_;
   CString additional_headers_;
   CString user_agent_;
   ProxyAuthConfig proxy_auth_config_;
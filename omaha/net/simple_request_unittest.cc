@@ -26,6 +26,7 @@
 #include "omaha/base/const_addresses.h"
 #include "omaha/base/error.h"
 #include "omaha/base/scope_guard.h"
+#include "omaha/base/signatures.h"
 #include "omaha/base/string.h"
 #include "omaha/base/utils.h"
 #include "omaha/common/ping_event_download_metrics.h"
@@ -179,6 +180,10 @@ void SimpleRequestTest::SimpleGet(const CString& url,
   EXPECT_STREQ(url, dm.url);
   EXPECT_EQ(DownloadMetrics::kWinHttp, dm.downloader);
   EXPECT_EQ(0, dm.error);
+
+  // The response is not hashed when it is not written to a file.
+  std::vector<uint8> digest;
+  EXPECT_FALSE(simple_request.response_sha256(&digest));
 }
 
 void SimpleRequestTest::SimpleDownloadFile(const CString& url,
@@ -193,6 +198,15 @@ void SimpleRequestTest::SimpleDownloadFile(const CString& url,
   int http_status = simple_request.GetHttpStatusCode();
   EXPECT_TRUE(http_status == HTTP_STATUS_OK ||
               http_status == HTTP_STATUS_PARTIAL_CONTENT);
+
+  // The digest computed during the download matches the hash of the file.
+  std::vector<uint8> digest;
+  EXPECT_TRUE(simple_request.response_sha256(&digest));
+
+  std::vector<uint8> expected_digest;
+  CryptoHash crypto(CryptoHash::kSha256);
+  EXPECT_HRESULT_SUCCEEDED(crypto.Compute(filename, 0, &expected_digest));
+  EXPECT_TRUE(expected_digest == digest);
 }
 
 void SimpleRequestTest::SimpleDownloadFilePauseAndResume(
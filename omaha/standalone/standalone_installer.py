@@ -161,7 +161,6 @@ def BuildOfflineInstaller(
     is_official=False,
     installers_sources_path='$MAIN_DIR/installers',
     enterprise_installers_sources_path='$MAIN_DIR/enterprise/installer',
-    lzma_path='$THIRD_PARTY/lzma/files/lzma.exe',
     resmerge_path='$MAIN_DIR/tools/resmerge'):
   """Builds the standalone installers specified by offline_installer.
 
@@ -181,7 +180,6 @@ def BuildOfflineInstaller(
         for building the metainstaller
     enterprise_installers_sources_path: path to the directory containing the
         source files for building enterprise installers
-    lzma_path: path to lzma.exe
     resmerge_path: path to resmerge.exe
 
   Returns:
@@ -251,9 +249,10 @@ def BuildOfflineInstaller(
       INSTALLER_VERSIONS=version_list
       )
 
-  # Use the BCJ2 tool from the official build we're using to generate this
-  # metainstaller, not the current build directory.
-  bcj2_path = omaha_files_path + '/bcj2.exe'
+  # Use the builder from the official build we're using to generate this
+  # metainstaller, not the current build directory, since the payload format
+  # must match the metainstaller of that build.
+  builder_path = omaha_files_path + '/metainstaller_builder.exe'
 
   additional_payload_contents.append(manifest_file_path)
 
@@ -282,9 +281,8 @@ def BuildOfflineInstaller(
       additional_payload_contents_dependencies=offline_installers_file_path,
       output_dir=output_dir,
       installers_sources_path=installers_sources_path,
-      lzma_path=lzma_path,
       resmerge_path=resmerge_path,
-      bcj2_path=bcj2_path
+      builder_path=builder_path
   )
 
   standalone_installer_path = '%s/%s' % (output_dir, target_name)
@@ -350,13 +348,15 @@ def BuildOfflineInstaller(
         bundles[key] = new_bundles_list
 
     tag_meta_installers.SetOutputFileNames(target_name, bundles, '')
+    all_bundles = []
     for bundles_lang in bundles.itervalues():
-      for bundle in bundles_lang:
-        results += tagged_installer.TagOneBundle(
-            env=env,
-            bundle=bundle,
-            untagged_binary_path=standalone_installer_path,
-            output_dir='$TARGET_ROOT/Tagged_Offline_Installers',
-        )
+      all_bundles += bundles_lang
+    results += tagged_installer.TagBundles(
+        env=env,
+        bundles=all_bundles,
+        untagged_binary_path=standalone_installer_path,
+        output_dir='$TARGET_ROOT/Tagged_Offline_Installers',
+        builder_path=builder_path,
+    )
 
   return results
@@ -15,7 +15,11 @@
 //
 // Implements metrics and metrics collections
 #include "omaha/statsreport/metrics.h"
-#include "omaha/base/synchronized.h"
+#include <intrin.h>
+#include <malloc.h>
+#include <algorithm>
+
+#pragma intrinsic(_InterlockedCompareExchange64)
 
 namespace stats_report {
 // Make sure global stats collection is placed in zeroed storage so as to avoid
@@ -24,41 +28,66 @@ MetricCollectionBase g_global_metric_storage = { 0, 0 };
 MetricCollection &g_global_metrics =
                   *static_cast<MetricCollection*>(&g_global_metric_storage);
 
-#pragma warning(push)
-// C4640: construction of local static object is not thread-safe.
-// C4073: initializers put in library initialization area.
-#pragma warning(disable : 4640 4073)
+namespace {
 
-// Serialize all metric manipulation and access under this lock.
-//
-// Initializes g_lock before other global objects of user defined types.
-// It assumes the program is single threaded while executing CRT startup and
-// exit code.
-#pragma init_seg(lib)
-omaha::LLock g_lock;
-#pragma warning(pop)
-
-class MetricBase::ObjectLock {
-public:
-  ObjectLock(const MetricBase *metric) : metric_(metric) {
-    metric_->Lock();
+// The 64-bit atomic operations are built on the compare-exchange intrinsic,
+// which is available to 32-bit code on all the supported versions of Windows.
+int64 AtomicRead(const volatile int64 *target) {
+  return _InterlockedCompareExchange64(const_cast<volatile int64*>(target),
+                                       0,
+                                       0);
+}
+
+int64 AtomicExchange(volatile int64 *target, int64 value) {
+  int64 old_value = *target;
+  for (;;) {
+    const int64 previous_value =
+        _InterlockedCompareExchange64(target, value, old_value);
+    if (previous_value == old_value)
+      return old_value;
+    old_value = previous_value;
   }
+}
 
-  ~ObjectLock() {
-    metric_->Unlock();
+void AtomicAdd(volatile int64 *target, int64 addend) {
+  int64 old_value = *target;
+  for (;;) {
+    const int64 previous_value =
+        _InterlockedCompareExchange64(target, old_value + addend, old_value);
+    if (previous_value == old_value)
+      return;
+    old_value = previous_value;
   }
+}
 
-private:
-  MetricBase const *const metric_;
-  DISALLOW_EVIL_CONSTRUCTORS(MetricBase::ObjectLock);
-};
+void AtomicMin(volatile int64 *target, int64 value) {
+  int64 old_value = *target;
+  while (value < old_value) {
+    const int64 previous_value =
+        _InterlockedCompareExchange64(target, value, old_value);
+    if (previous_value == old_value)
+      return;
+    old_value = previous_value;
+  }
+}
 
-void MetricBase::Lock() const {
-  g_lock.Lock();
+void AtomicMax(volatile int64 *target, int64 value) {
+  int64 old_value = *target;
+  while (value > old_value) {
+    const int64 previous_value =
+        _InterlockedCompareExchange64(target, value, old_value);
+    if (previous_value == old_value)
+      return;
+    old_value = previous_value;
+  }
 }
 
-void MetricBase::Unlock() const {
-  g_lock.Unlock();
+}  // namespace
+
+int MetricBase::ShardIndex() {
+  // Thread ids are multiples of four.
+  return static_cast<int>(::GetCurrentThreadId() >> 2) &
+         (kNumMetricShards - 1);
 }
 
 MetricBase::MetricBase(const char *name,
@@ -74,6 +103,14 @@ MetricBase::MetricBase(const char *name, MetricType type)
     : name_(name), type_(type), next_(NULL), coll_(NULL) {
 }
 
+void *MetricBase::operator new(size_t size) {
+  return _aligned_malloc(size, kMetricShardSize);
+}
+
+void MetricBase::operator delete(void *p) {
+  _aligned_free(p);
+}
+
 MetricBase::~MetricBase() {
   if (coll_) {
     DCHECK_EQ(this, coll_->first_);
@@ -86,103 +123,158 @@ MetricBase::~MetricBase() {
   }
 }
 
+IntegerMetricBase::IntegerMetricBase(const char *name,
+                                     MetricType type,
+                                     MetricCollectionBase *coll,
+                                     int num_shards)
+    : MetricBase(name, type, coll), num_shards_(num_shards) {
+  DCHECK(num_shards_ == 1 || num_shards_ == kNumMetricShards);
+  memset(shards_, 0, sizeof(shards_));
+}
+
+IntegerMetricBase::IntegerMetricBase(const char *name,
+                                     MetricType type,
+                                     int64 value,
+                                     int num_shards)
+    : MetricBase(name, type), num_shards_(num_shards) {
+  DCHECK(num_shards_ == 1 || num_shards_ == kNumMetricShards);
+  memset(shards_, 0, sizeof(shards_));
+  shards_[0].value = value;
+}
+
+MetricShard &IntegerMetricBase::shard() {
+  return shards_[ShardIndex() & (num_shards_ - 1)];
+}
+
 void IntegerMetricBase::Set(int64 value) {
-  ObjectLock lock(this);
-  value_ = value;
+  Exchange(value);
 }
 
 int64 IntegerMetricBase::value() const {
-  ObjectLock lock(this);
-  int64 ret = value_;
+  int64 ret = 0;
+  for (int i = 0; i < num_shards_; ++i)
+    ret += AtomicRead(&shards_[i].value);
   return ret;
 }
 
 void IntegerMetricBase::Increment() {
-  ObjectLock lock(this);
-  ++value_;
+  AtomicAdd(&shard().value, 1);
 }
 
 void IntegerMetricBase::Decrement() {
-  ObjectLock lock(this);
-  --value_;
+  AtomicAdd(&shard().value, -1);
 }
 
 void IntegerMetricBase::Add(int64 value){
-  ObjectLock lock(this);
-  value_ += value;
+  AtomicAdd(&shard().value, value);
 }
 
 void IntegerMetricBase::Subtract(int64 value) {
-  ObjectLock lock(this);
-  if (value_ < value)
-    value_ = 0;
-  else
-    value_ -= value;
+  DCHECK_EQ(1, num_shards_);
+
+  volatile int64 *target = &shards_[0].value;
+  int64 old_value = *target;
+  for (;;) {
+    const int64 new_value = old_value < value ? 0 : old_value - value;
+    const int64 previous_value =
+        _InterlockedCompareExchange64(target, new_value, old_value);
+    if (previous_value == old_value)
+      return;
+    old_value = previous_value;
+  }
 }
 
-int64 CountMetric::Reset() {
-  ObjectLock lock(this);
-  int64 ret = value_;
-  value_ = 0;
+int64 IntegerMetricBase::Exchange(int64 value) {
+  int64 ret = AtomicExchange(&shards_[0].value, value);
+  for (int i = 1; i < num_shards_; ++i)
+    ret += AtomicExchange(&shards_[i].value, 0);
   return ret;
 }
 
-TimingMetric::TimingData TimingMetric::Reset() {
-  ObjectLock lock(this);
-  TimingData ret = data_;
+int64 CountMetric::Reset() {
+  return Exchange(0);
+}
+
+TimingMetric::TimingMetric(const char *name, const TimingData &value)
+    : MetricBase(name, kTimingType) {
   Clear();
+  if (0 != value.count) {
+    shards_[0].count = value.count;
+    shards_[0].sum = value.sum;
+    shards_[0].minimum = value.minimum;
+    shards_[0].maximum = value.maximum;
+  }
+}
+
+TimingMetric::TimingData TimingMetric::Reset() {
+  TimingData ret = { 0 };
+  int64 minimum = kint64max;
+  int64 maximum = kint64min;
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    TimingShard &shard = shards_[i];
+    ret.count += static_cast<uint32>(AtomicExchange(&shard.count, 0));
+    ret.sum += AtomicExchange(&shard.sum, 0);
+    minimum = std::min(minimum, AtomicExchange(&shard.minimum, kint64max));
+    maximum = std::max(maximum, AtomicExchange(&shard.maximum, kint64min));
+  }
+
+  // The minimum or the maximum of a sample split by the reset may be missing.
+  if (0 != ret.count) {
+    ret.minimum = minimum != kint64max ? minimum : ret.sum / ret.count;
+    ret.maximum = maximum != kint64min ? maximum : ret.sum / ret.count;
+  }
   return ret;
 }
 
-uint32 TimingMetric::count() const {
-  ObjectLock lock(this);
-  uint32 ret = data_.count;
+TimingMetric::TimingData TimingMetric::Fold() const {
+  TimingData ret = { 0 };
+  int64 minimum = kint64max;
+  int64 maximum = kint64min;
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    const TimingShard &shard = shards_[i];
+    ret.count += static_cast<uint32>(AtomicRead(&shard.count));
+    ret.sum += AtomicRead(&shard.sum);
+    minimum = std::min(minimum, AtomicRead(&shard.minimum));
+    maximum = std::max(maximum, AtomicRead(&shard.maximum));
+  }
+
+  if (0 != ret.count) {
+    ret.minimum = minimum != kint64max ? minimum : ret.sum / ret.count;
+    ret.maximum = maximum != kint64min ? maximum : ret.sum / ret.count;
+  }
   return ret;
 }
 
+uint32 TimingMetric::count() const {
+  return Fold().count;
+}
+
 int64 TimingMetric::sum() const {
-  ObjectLock lock(this);
-  int64 ret = data_.sum;
-  return ret;
+  return Fold().sum;
 }
 
 int64 TimingMetric::minimum() const {
-  ObjectLock lock(this);
-  int64 ret = data_.minimum;
-  return ret;
+  return Fold().minimum;
 }
 
 int64 TimingMetric::maximum() const {
-  ObjectLock lock(this);
-  int64 ret = data_.maximum;
-  return ret;
+  return Fold().maximum;
 }
 
 int64 TimingMetric::average() const {
-  ObjectLock lock(this);
+  const TimingData data = Fold();
 
   int64 ret = 0;
-  if (0 == data_.count) {
-    DCHECK_EQ(0, data_.sum);
+  if (0 == data.count) {
+    DCHECK_EQ(0, data.sum);
   } else {
-    ret = data_.sum / data_.count;
+    ret = data.sum / data.count;
   }
   return ret;
 }
 
 void TimingMetric::AddSample(int64 time_ms) {
-  ObjectLock lock(this);
-  if (0 == data_.count) {
-    data_.minimum = time_ms;
-    data_.maximum = time_ms;
-  } else {
-    if (data_.minimum > time_ms)
-      data_.minimum = time_ms;
-    if (data_.maximum < time_ms)
-      data_.maximum = time_ms;
-  }
-  data_.count++;
-  data_.sum += time_ms;
+  AddSamples(1, time_ms);
 }
 
 void TimingMetric::AddSamples(int64 count, int64 total_time_ms) {
@@ -191,37 +283,33 @@ void TimingMetric::AddSamples(int64 count, int64 total_time_ms) {
 
   int64 time_ms = total_time_ms / count;
 
-  ObjectLock lock(this);
-  if (0 == data_.count) {
-    data_.minimum = time_ms;
-    data_.maximum = time_ms;
-  } else {
-    if (data_.minimum > time_ms)
-      data_.minimum = time_ms;
-    if (data_.maximum < time_ms)
-      data_.maximum = time_ms;
-  }
+  // The minimum and the maximum are updated first, so that a reset between the
+  // updates does not leave a count without a minimum and a maximum.
+  TimingShard &shard = shards_[ShardIndex()];
+  AtomicMin(&shard.minimum, time_ms);
+  AtomicMax(&shard.maximum, time_ms);
 
   // TODO(omaha): truncation from 64 to 32 may occur here.
   DCHECK_LE(count, kuint32max);
-  data_.count += static_cast<uint32>(count);
-  data_.sum += total_time_ms;
+  AtomicAdd(&shard.sum, total_time_ms);
+  AtomicAdd(&shard.count, count);
 }
 
 void TimingMetric::Clear() {
-  memset(&data_, 0, sizeof(data_));
+  memset(shards_, 0, sizeof(shards_));
+  for (int i = 0; i < kNumMetricShards; ++i) {
+    shards_[i].minimum = kint64max;
+    shards_[i].maximum = kint64min;
+  }
 }
 
 void BoolMetric::Set(bool value) {
-  ObjectLock lock(this);
-  value_ = value ? kBoolTrue : kBoolFalse;
+  ::InterlockedExchange(&value_, value ? kBoolTrue : kBoolFalse);
 }
 
 BoolMetric::TristateBoolValue BoolMetric::Reset() {
-  ObjectLock lock(this);
-  TristateBoolValue ret = value_;
-  value_ = kBoolUnset;
-  return ret;
+  return static_cast<TristateBoolValue>(
+      ::InterlockedExchange(&value_, kBoolUnset));
 }
 
 void MetricCollection::Initialize() {
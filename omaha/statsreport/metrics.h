@@ -17,6 +17,7 @@
 #ifndef OMAHA_STATSREPORT_METRICS_H__
 #define OMAHA_STATSREPORT_METRICS_H__
 
+#include <windows.h>
 #include <iterator>
 #include "base/basictypes.h"
 #include "omaha/base/highres_timer-win32.h"
@@ -106,6 +107,41 @@ class TimingMetric;
 class IntegerMetric;
 class BoolMetric;
 
+/// Number of shards the hot metrics spread their updates over. A thread
+/// always updates the shard picked by its thread id, so the threads updating
+/// the same metric rarely contend for the same cache line. The shards are
+/// folded together when the metric is read or reset, which the aggregators
+/// do when they aggregate the metrics.
+const int kNumMetricShards = 8;
+
+/// Size of the cache line the shards are padded and aligned to. The shards
+/// repeat it as a literal, which __declspec(align) requires.
+const int kMetricShardSize = 64;
+
+/// A value updated with atomic operations, in a cache line of its own.
+struct __declspec(align(64)) MetricShard {
+  volatile int64 value;
+  char padding[kMetricShardSize - sizeof(int64)];
+};
+
+/// The samples of a timing metric collected by a shard.
+struct __declspec(align(64)) TimingShard {
+  volatile int64 count;
+  volatile int64 sum;
+  volatile int64 minimum;
+  volatile int64 maximum;
+  char padding[kMetricShardSize - 4 * sizeof(int64)];
+};
+
+COMPILE_ASSERT(sizeof(MetricShard) == kMetricShardSize,
+               metric_shard_is_not_a_cache_line);
+COMPILE_ASSERT(__alignof(MetricShard) == kMetricShardSize,
+               metric_shard_is_not_aligned);
+COMPILE_ASSERT(sizeof(TimingShard) == kMetricShardSize,
+               timing_shard_is_not_a_cache_line);
+COMPILE_ASSERT(__alignof(TimingShard) == kMetricShardSize,
+               timing_shard_is_not_aligned);
+
 /// Base class for all stats instances.
 /// Stats instances are chained together against a MetricCollection to
 /// allow enumerating stats.
@@ -137,10 +173,14 @@ public:
   // TODO(omaha): does this need to be virtual?
   virtual ~MetricBase() = 0;
 
+  /// The metrics created on the heap are aligned like the static ones, since
+  /// operator new does not align their shards on cache lines.
+  static void *operator new(size_t size);
+  static void operator delete(void *p);
+
 protected:
-  class ObjectLock;
-  void Lock() const;
-  void Unlock() const;
+  /// Returns the index of the shard the current thread updates.
+  static int ShardIndex();
 
   /// Constructs a MetricBase and adds to the provided MetricCollection.
   /// @note Metrics can only be constructed up to the point where the
@@ -265,7 +305,9 @@ extern MetricCollectionBase g_global_metric_storage;
 /// And more conveniently accessed through here
 extern MetricCollection &g_global_metrics;
 
-/// Base class for integer metrics
+/// Base class for integer metrics.
+/// The value is updated with atomic operations and without locking. It may be
+/// spread over several shards, which are summed up to get the value.
 class IntegerMetricBase: public MetricBase {
 public:
   /// Sets the current value
@@ -279,35 +321,47 @@ public:
   void operator += (int64 addend) { Add(addend); }
 
 protected:
+  /// @param num_shards is either 1 or kNumMetricShards
   IntegerMetricBase(const char *name,
                     MetricType type,
-                    MetricCollectionBase *coll)
-      : MetricBase(name, type, coll), value_(0) {
-  }
-  IntegerMetricBase(const char *name, MetricType type, int64 value)
-      : MetricBase(name, type), value_(value) {
-  }
+                    MetricCollectionBase *coll,
+                    int num_shards);
+  IntegerMetricBase(const char *name,
+                    MetricType type,
+                    int64 value,
+                    int num_shards);
 
   void Increment();
   void Decrement();
   void Add(int64 value);
+
+  /// Subtracts without going below zero.
+  /// @note only supported by metrics with a single shard.
   void Subtract(int64 value);
 
-  int64 value_;
+  /// Replaces the value with the provided value and returns the previous one.
+  int64 Exchange(int64 value);
 
 private:
+  /// Returns the shard the current thread updates.
+  MetricShard &shard();
+
+  int const num_shards_;
+  MetricShard shards_[kNumMetricShards];
+
   DISALLOW_EVIL_CONSTRUCTORS(IntegerMetricBase);
 };
 
 /// A count metric is a cumulative counter of events.
+/// The count is sharded, since counts are incremented from many threads.
 class CountMetric: public IntegerMetricBase {
 public:
   CountMetric(const char *name, MetricCollectionBase *coll)
-      : IntegerMetricBase(name, kCountType, coll) {
+      : IntegerMetricBase(name, kCountType, coll, kNumMetricShards) {
   }
 
   CountMetric(const char *name, int64 value)
-      : IntegerMetricBase(name, kCountType, value) {
+      : IntegerMetricBase(name, kCountType, value, kNumMetricShards) {
   }
 
   /// Nulls the metric and returns the current values.
@@ -317,6 +371,10 @@ private:
   DISALLOW_EVIL_CONSTRUCTORS(CountMetric);
 };
 
+/// The samples are collected without locking into per-thread shards, which
+/// keep their own count, sum, minimum and maximum.
+/// A sample added while the metric is reset may be split between the data
+/// returned by Reset() and the data collected afterwards.
 class TimingMetric: public MetricBase {
 public:
   struct TimingData {
@@ -333,9 +391,7 @@ public:
     Clear();
   }
 
-  TimingMetric(const char *name, const TimingData &value)
-      : MetricBase(name, kTimingType), data_(value) {
-  }
+  TimingMetric(const char *name, const TimingData &value);
 
   uint32 count() const;
   int64 sum() const;
@@ -366,7 +422,10 @@ private:
 
   void Clear();
 
-  TimingData data_;
+  /// Folds the shards together.
+  TimingData Fold() const;
+
+  TimingShard shards_[kNumMetricShards];
 };
 
 /// A convenience class to sample the time from construction to destruction
@@ -419,14 +478,15 @@ private:
 
 /// An integer metric is used to sample values that vary over time.
 /// On aggregation the instantaneous value of the integer metric is captured.
+/// The value is kept in a single shard, since it is set and clamped as a whole.
 class IntegerMetric: public IntegerMetricBase {
 public:
   IntegerMetric(const char *name, MetricCollectionBase *coll)
-      : IntegerMetricBase(name, kIntegerType, coll) {
+      : IntegerMetricBase(name, kIntegerType, coll, 1) {
   }
 
   IntegerMetric(const char *name, int64 value)
-      : IntegerMetricBase(name, kIntegerType, value) {
+      : IntegerMetricBase(name, kIntegerType, value, 1) {
   }
 
   void operator = (int64 value)   { Set(value); }
@@ -463,7 +523,7 @@ public:
     switch (value) {
      case kBoolFalse:
      case kBoolTrue:
-      value_ = static_cast<TristateBoolValue>(value);
+      value_ = static_cast<LONG>(value);
       break;
 
      default:
@@ -482,13 +542,15 @@ public:
   /// Nulls the metric and returns the current values.
   TristateBoolValue Reset();
 
-  /// Returns the current value - not threadsafe
-  TristateBoolValue value() const { return value_; };
+  /// Returns the current value
+  TristateBoolValue value() const {
+    return static_cast<TristateBoolValue>(value_);
+  }
 
 private:
   DISALLOW_EVIL_CONSTRUCTORS(BoolMetric);
 
-  TristateBoolValue value_;
+  volatile LONG value_;
 };
 
 inline CountMetric &MetricBase::AsCount() {
@@ -17,6 +17,9 @@
 #include <new>
 
 #include "gtest/gtest.h"
+#include "base/scoped_ptr.h"
+#include "omaha/base/highres_timer-win32.h"
+#include "omaha/base/synchronized.h"
 #include "omaha/statsreport/metrics.h"
 
 DECLARE_METRIC_count(count);
@@ -61,6 +64,81 @@ protected:
   BoolMetric bool_;
 };
 
+const int kNumThreads = 8;
+
+// Runs |operation| |num_operations| times on each of |num_threads| threads
+// and returns the elapsed time in milliseconds.
+class ThreadedOperation {
+public:
+  typedef void (*Operation)(void *context, int i);
+
+  ThreadedOperation(Operation operation, void *context, int num_operations)
+      : operation_(operation), context_(context),
+        num_operations_(num_operations) {
+  }
+
+  double Run(int num_threads) {
+    HANDLE threads[kNumThreads] = { 0 };
+    DCHECK_LE(num_threads, kNumThreads);
+
+    const ULONGLONG start_ticks = omaha::HighresTimer::GetCurrentTicks();
+    for (int i = 0; i < num_threads; ++i) {
+      threads[i] = ::CreateThread(NULL, 0, &ThreadProc, this, 0, NULL);
+      EXPECT_TRUE(NULL != threads[i]);
+    }
+    EXPECT_EQ(WAIT_OBJECT_0,
+              ::WaitForMultipleObjects(num_threads, threads, true, INFINITE));
+    const ULONGLONG end_ticks = omaha::HighresTimer::GetCurrentTicks();
+
+    for (int i = 0; i < num_threads; ++i)
+      ::CloseHandle(threads[i]);
+
+    return static_cast<double>(end_ticks - start_ticks) * 1000 /
+           omaha::HighresTimer::GetTimerFrequency();
+  }
+
+private:
+  static DWORD WINAPI ThreadProc(void *param) {
+    ThreadedOperation *self = static_cast<ThreadedOperation*>(param);
+    for (int i = 0; i < self->num_operations_; ++i)
+      self->operation_(self->context_, i);
+    return 0;
+  }
+
+  Operation operation_;
+  void *context_;
+  int num_operations_;
+};
+
+void IncrementCount(void *context, int) {
+  ++*static_cast<CountMetric*>(context);
+}
+
+void AddTimingSample(void *context, int i) {
+  static_cast<TimingMetric*>(context)->AddSample(i % 100);
+}
+
+void AddToInteger(void *context, int) {
+  *static_cast<IntegerMetric*>(context) += 2;
+}
+
+void SetBool(void *context, int i) {
+  static_cast<BoolMetric*>(context)->Set((i & 1) != 0);
+}
+
+// A counter serialized by a single lock, which is how all the metrics used
+// to be updated.
+struct LockedCounter {
+  omaha::LLock lock;
+  int64 value;
+};
+
+void IncrementLockedCounter(void *context, int) {
+  LockedCounter *counter = static_cast<LockedCounter*>(context);
+  __mutexScope(counter->lock);
+  ++counter->value;
+}
+
 } // namespace
 
 // Validates that the above-declared metrics are available
@@ -359,3 +437,84 @@ TEST_F(MetricsTest, SimpleConstruction) {
   EXPECT_TRUE(NULL == bool_false.next());
 }
 
+// The updates made concurrently from several threads are all accounted for.
+TEST_F(MetricsTest, ConcurrentUpdates) {
+  const int kNumOperations = 10000;
+  CountMetric count("count", &coll_);
+  TimingMetric timing("timing", &coll_);
+  IntegerMetric integer("integer", &coll_);
+
+  ThreadedOperation(&IncrementCount, &count, kNumOperations).Run(kNumThreads);
+  ThreadedOperation(&AddTimingSample, &timing, kNumOperations).Run(
+      kNumThreads);
+  ThreadedOperation(&AddToInteger, &integer, kNumOperations).Run(kNumThreads);
+
+  EXPECT_EQ(kNumThreads * kNumOperations, count.value());
+  EXPECT_EQ(kNumThreads * kNumOperations, count.Reset());
+  EXPECT_EQ(0, count.value());
+
+  TimingMetric::TimingData data = timing.Reset();
+  EXPECT_EQ(kNumThreads * kNumOperations, data.count);
+  EXPECT_EQ(kNumThreads * (kNumOperations / 100) * (99 * 100 / 2), data.sum);
+  EXPECT_EQ(0, data.minimum);
+  EXPECT_EQ(99, data.maximum);
+  EXPECT_EQ(0, timing.count());
+
+  EXPECT_EQ(2 * kNumThreads * kNumOperations, integer.value());
+  integer -= 4 * kNumThreads * kNumOperations;
+  EXPECT_EQ(0, integer.value());
+}
+
+// The shards are aligned on cache lines, including for the metrics created
+// on the heap.
+TEST_F(MetricsTest, ShardsAreAligned) {
+  const CountMetric count("count", 0);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(&count) % kMetricShardSize);
+
+  scoped_ptr<CountMetric> heap_count(new CountMetric("heap_count", 0));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(heap_count.get()) %
+               kMetricShardSize);
+
+  TimingMetric::TimingData data = { 0 };
+  scoped_ptr<TimingMetric> heap_timing(new TimingMetric("heap_timing", data));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(heap_timing.get()) %
+               kMetricShardSize);
+}
+
+// Measures how the metric updates scale with the number of threads, compared
+// with a counter serialized by a single lock.
+TEST_F(MetricsTest, DISABLED_ContentionBenchmark) {
+  const int kNumOperations = 200000;
+  CountMetric count("count", &coll_);
+  TimingMetric timing("timing", &coll_);
+  IntegerMetric integer("integer", &coll_);
+  BoolMetric boolean("boolean", &coll_);
+  LockedCounter locked_counter;
+  locked_counter.value = 0;
+
+  struct {
+    const char *name;
+    ThreadedOperation::Operation operation;
+    void *context;
+  } const benchmarks[] = {
+    { "locked counter", &IncrementLockedCounter, &locked_counter },
+    { "count", &IncrementCount, &count },
+    { "timing", &AddTimingSample, &timing },
+    { "integer", &AddToInteger, &integer },
+    { "bool", &SetBool, &boolean },
+  };
+
+  for (size_t i = 0; i != arraysize(benchmarks); ++i) {
+    for (int num_threads = 1; num_threads <= kNumThreads; num_threads *= 2) {
+      const double duration_ms =
+          ThreadedOperation(benchmarks[i].operation,
+                            benchmarks[i].context,
+                            kNumOperations).Run(num_threads);
+      LOG(INFO) << benchmarks[i].name << ", " << num_threads << " threads: "
+                << duration_ms * 1000000 / (num_threads * kNumOperations)
+                << " ns/operation";
+    }
+  }
+
+  EXPECT_EQ(locked_counter.value, count.value());
+}
@@ -0,0 +1,471 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+
+#include "omaha/testing/loopback_http_server.h"
+#include <winsock2.h>
+#include <algorithm>
+#include "base/scoped_ptr.h"
+#include "omaha/base/debug.h"
+#include "omaha/base/error.h"
+#include "omaha/base/logging.h"
+#include "omaha/base/safe_format.h"
+#include "omaha/base/utils.h"
+
+namespace omaha {
+
+namespace {
+
+const size_t kMaxRequestSize = 16 * 1024;
+const size_t kMaxBodySize = 4 * 1024 * 1024;
+const size_t kSendChunkSize = 64 * 1024;
+
+// The content of the files never changes while the server is running.
+const char kLastModified[] = "Fri, 01 Jan 2010 00:00:00 GMT";
+
+// Returns the value of the header |name| of |request|, which must be in lower
+// case, or an empty string if the request does not have the header.
+std::string GetHeader(const std::string& request, const char* name) {
+  std::string lower_request(request);
+  std::transform(lower_request.begin(), lower_request.end(),
+                 lower_request.begin(), ::tolower);
+
+  const std::string key(std::string("\r\n") + name + ":");
+  const size_t begin = lower_request.find(key);
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+
+  size_t value_begin = begin + key.size();
+  const size_t value_end = request.find("\r\n", value_begin);
+  while (value_begin < value_end && request[value_begin] == ' ') {
+    ++value_begin;
+  }
+  return request.substr(value_begin, value_end - value_begin);
+}
+
+// Parses a "bytes=first-last" or "bytes=first-" range. Returns false if the
+// range is malformed or not satisfiable.
+bool ParseRange(const std::string& range,
+                size_t size,
+                size_t* first,
+                size_t* last) {
+  unsigned int range_first = 0;
+  unsigned int range_last = 0;
+  const int num_fields = sscanf_s(range.c_str(), "bytes=%u-%u",  // NOLINT
+                                  &range_first, &range_last);
+  if (num_fields < 1 || range_first >= size) {
+    return false;
+  }
+
+  *first = range_first;
+  *last = num_fields == 2 ? std::min<size_t>(range_last, size - 1) : size - 1;
+  return *first <= *last;
+}
+
+}  // namespace
+
+LoopbackHttpServer::LoopbackHttpServer()
+    : num_requests_(0),
+      num_concurrent_requests_(0),
+      max_concurrent_requests_(0),
+      is_wsa_initialized_(false),
+      listen_socket_(INVALID_SOCKET),
+      port_(0) {
+  reset(stop_event_, ::CreateEvent(NULL, true, false, NULL));
+  ASSERT1(stop_event_);
+}
+
+LoopbackHttpServer::~LoopbackHttpServer() {
+  Stop();
+}
+
+HRESULT LoopbackHttpServer::Start() {
+  ASSERT1(listen_socket_ == INVALID_SOCKET);
+
+  WSADATA wsa_data = {0};
+  int error = ::WSAStartup(MAKEWORD(2, 2), &wsa_data);
+  if (error) {
+    return HRESULT_FROM_WIN32(error);
+  }
+  is_wsa_initialized_ = true;
+
+  SOCKET listen_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_socket == INVALID_SOCKET) {
+    return HRESULT_FROM_WIN32(::WSAGetLastError());
+  }
+  listen_socket_ = listen_socket;
+
+  sockaddr_in address = {0};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+  int address_size = sizeof(address);
+  if (::bind(listen_socket,
+             reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) == SOCKET_ERROR ||
+      ::getsockname(listen_socket,
+                    reinterpret_cast<sockaddr*>(&address),
+                    &address_size) == SOCKET_ERROR ||
+      ::listen(listen_socket, SOMAXCONN) == SOCKET_ERROR) {
+    return HRESULT_FROM_WIN32(::WSAGetLastError());
+  }
+  port_ = ::ntohs(address.sin_port);
+
+  reset(accept_thread_,
+        ::CreateThread(NULL, 0, &AcceptThreadProc, this, 0, NULL));
+  if (!accept_thread_) {
+    return HRESULTFromLastError();
+  }
+
+  CORE_LOG(L3, (_T("[LoopbackHttpServer::Start][%s]"), base_url()));
+  return S_OK;
+}
+
+void LoopbackHttpServer::Stop() {
+  VERIFY1(::SetEvent(get(stop_event_)));
+
+  if (listen_socket_ != INVALID_SOCKET) {
+    VERIFY1(::closesocket(listen_socket_) == 0);
+    listen_socket_ = INVALID_SOCKET;
+  }
+
+  if (accept_thread_) {
+    VERIFY1(::WaitForSingleObject(get(accept_thread_), INFINITE) ==
+            WAIT_OBJECT_0);
+    reset(accept_thread_);
+  }
+
+  // No connections are accepted from this point on. The open connections are
+  // shut down to unblock the threads serving them.
+  std::vector<HANDLE> connection_threads;
+  __mutexBlock(lock_) {
+    for (size_t i = 0; i != connection_sockets_.size(); ++i) {
+      ::shutdown(connection_sockets_[i], SD_BOTH);
+    }
+    connection_threads.swap(connection_threads_);
+  }
+
+  for (size_t i = 0; i != connection_threads.size(); ++i) {
+    VERIFY1(::WaitForSingleObject(connection_threads[i], INFINITE) ==
+            WAIT_OBJECT_0);
+    VERIFY1(::CloseHandle(connection_threads[i]));
+  }
+
+  if (is_wsa_initialized_) {
+    VERIFY1(::WSACleanup() == 0);
+    is_wsa_initialized_ = false;
+  }
+}
+
+void LoopbackHttpServer::AddFile(const CString& path,
+                                 const std::string& contents,
+                                 int latency_ms) {
+  ASSERT1(!path.IsEmpty() && path[0] == _T('/'));
+  ASSERT1(latency_ms >= 0);
+
+  __mutexScope(lock_);
+  File& file = files_[std::string(CStringA(path))];
+  file.contents = contents;
+  file.latency_ms = latency_ms;
+  file.is_post_only = false;
+}
+
+void LoopbackHttpServer::AddPostOnlyFile(const CString& path,
+                                         const std::string& contents,
+                                         int latency_ms) {
+  AddFile(path, contents, latency_ms);
+
+  __mutexScope(lock_);
+  files_[std::string(CStringA(path))].is_post_only = true;
+}
+
+CString LoopbackHttpServer::base_url() const {
+  CString url;
+  SafeCStringFormat(&url, _T("http://127.0.0.1:%d/"), port_);
+  return url;
+}
+
+int LoopbackHttpServer::GetRequestCount(const CString& path) const {
+  __mutexScope(lock_);
+  std::map<std::string, File>::const_iterator it(
+      files_.find(std::string(CStringA(path))));
+  return it != files_.end() ? it->second.num_requests : 0;
+}
+
+std::vector<std::string> LoopbackHttpServer::GetPostRequests(
+    const CString& path) const {
+  __mutexScope(lock_);
+  std::map<std::string, File>::const_iterator it(
+      files_.find(std::string(CStringA(path))));
+  return it != files_.end() ? it->second.post_requests :
+                              std::vector<std::string>();
+}
+
+int LoopbackHttpServer::num_requests() const {
+  __mutexScope(lock_);
+  return num_requests_;
+}
+
+int LoopbackHttpServer::max_concurrent_requests() const {
+  __mutexScope(lock_);
+  return max_concurrent_requests_;
+}
+
+DWORD WINAPI LoopbackHttpServer::AcceptThreadProc(void* param) {
+  static_cast<LoopbackHttpServer*>(param)->AcceptConnections();
+  return 0;
+}
+
+DWORD WINAPI LoopbackHttpServer::ConnectionThreadProc(void* param) {
+  scoped_ptr<Connection> connection(static_cast<Connection*>(param));
+  connection->server->ServeConnection(connection->socket);
+  return 0;
+}
+
+void LoopbackHttpServer::AcceptConnections() {
+  for (;;) {
+    SOCKET socket = ::accept(listen_socket_, NULL, NULL);
+    if (socket == INVALID_SOCKET) {
+      // The listening socket is closed when the server stops.
+      return;
+    }
+
+    __mutexScope(lock_);
+
+    if (IsHandleSignaled(get(stop_event_))) {
+      VERIFY1(::closesocket(socket) == 0);
+      return;
+    }
+
+    Connection* connection = new Connection;
+    connection->server = this;
+    connection->socket = socket;
+    HANDLE thread = ::CreateThread(NULL, 0, &ConnectionThreadProc,
+                                   connection, 0, NULL);
+    if (!thread) {
+      delete connection;
+      VERIFY1(::closesocket(socket) == 0);
+      continue;
+    }
+
+    connection_sockets_.push_back(socket);
+    connection_threads_.push_back(thread);
+  }
+}
+
+void LoopbackHttpServer::ServeConnection(UINT_PTR socket) {
+  std::string pending;
+  std::string request;
+  std::string body;
+  while (ReadRequest(socket, &pending, &request, &body) &&
+         ServeRequest(socket, request, body)) {
+  }
+
+  __mutexBlock(lock_) {
+    std::vector<UINT_PTR>::iterator it(std::find(connection_sockets_.begin(),
+                                                 connection_sockets_.end(),
+                                                 socket));
+    ASSERT1(it != connection_sockets_.end());
+    connection_sockets_.erase(it);
+  }
+
+  VERIFY1(::closesocket(socket) == 0);
+}
+
+bool LoopbackHttpServer::ReadRequest(UINT_PTR socket,
+                                     std::string* pending,
+                                     std::string* request,
+                                     std::string* body) {
+  ASSERT1(pending);
+  ASSERT1(request);
+  ASSERT1(body);
+
+  request->clear();
+  body->clear();
+  size_t body_size = 0;
+
+  for (;;) {
+    if (request->empty()) {
+      const size_t end = pending->find("\r\n\r\n");
+      if (end != std::string::npos) {
+        *request = pending->substr(0, end + 2);
+        pending->erase(0, end + 4);
+        body_size = strtoul(GetHeader(*request, "content-length").c_str(),
+                            NULL,
+                            10);
+        if (body_size > kMaxBodySize) {
+          return false;
+        }
+      } else if (pending->size() > kMaxRequestSize) {
+        return false;
+      }
+    }
+
+    if (!request->empty() && pending->size() >= body_size) {
+      *body = pending->substr(0, body_size);
+      pending->erase(0, body_size);
+      return true;
+    }
+
+    char buffer[4096] = {0};
+    const int bytes = ::recv(socket, buffer, sizeof(buffer), 0);
+    if (bytes <= 0) {
+      return false;
+    }
+    pending->append(buffer, bytes);
+  }
+}
+
+bool LoopbackHttpServer::ServeRequest(UINT_PTR socket,
+                                      const std::string& request,
+                                      const std::string& body) {
+  char method[16] = {0};
+  char path[1024] = {0};
+  if (sscanf_s(request.c_str(), "%15s %1023s",  // NOLINT
+               method, arraysize(method),
+               path, arraysize(path)) != 2) {
+    return false;
+  }
+
+  // A proxy receives the absolute url of the resource. Only its path is
+  // looked up.
+  const char* resource = path;
+  const char kHttpScheme[] = "http://";
+  if (_strnicmp(path, kHttpScheme, arraysize(kHttpScheme) - 1) == 0) {
+    resource = strchr(path + arraysize(kHttpScheme) - 1, '/');
+    if (!resource) {
+      resource = "/";
+    }
+  }
+
+  // A POST is answered like a GET, without the support for ranges.
+  const bool is_post = strcmp(method, "POST") == 0;
+  const bool is_get = is_post || strcmp(method, "GET") == 0;
+  const bool is_head = strcmp(method, "HEAD") == 0;
+  const bool keep_alive = _stricmp(GetHeader(request, "connection").c_str(),
+                                   "close") != 0;
+
+  std::string contents;
+  int latency_ms = 0;
+  bool is_found = false;
+  bool is_post_only = false;
+  __mutexBlock(lock_) {
+    ++num_requests_;
+    std::map<std::string, File>::iterator it(files_.find(resource));
+    if (it != files_.end()) {
+      is_found = true;
+      contents = it->second.contents;
+      latency_ms = it->second.latency_ms;
+      is_post_only = it->second.is_post_only;
+      if (is_get) {
+        ++it->second.num_requests;
+      }
+      if (is_post) {
+        it->second.post_requests.push_back(request + "\r\n" + body);
+      }
+    }
+  }
+
+  if (is_get) {
+    OnRequestBegin();
+  }
+
+  // The injected latency is cut short when the server stops.
+  const bool is_stopping =
+      ::WaitForSingleObject(get(stop_event_), latency_ms) == WAIT_OBJECT_0;
+
+  bool result = false;
+  if (!is_stopping) {
+    CStringA headers;
+    size_t first = 0;
+    size_t last = 0;
+    const std::string range(is_post ? std::string() :
+                                      GetHeader(request, "range"));
+
+    if (!is_get && !is_head) {
+      headers = "HTTP/1.1 501 Not Implemented\r\nContent-Length: 0\r\n";
+    } else if (!is_found) {
+      headers = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n";
+    } else if (is_post_only && !is_post) {
+      headers = "HTTP/1.1 405 Method Not Allowed\r\n"
+                "Allow: POST\r\n"
+                "Content-Length: 0\r\n";
+    } else if (range.empty() || contents.empty()) {
+      first = 0;
+      last = contents.size();
+      headers.Format("HTTP/1.1 200 OK\r\nContent-Length: %Iu\r\n",
+                     contents.size());
+    } else if (ParseRange(range, contents.size(), &first, &last)) {
+      headers.Format("HTTP/1.1 206 Partial Content\r\n"
+                     "Content-Length: %Iu\r\n"
+                     "Content-Range: bytes %Iu-%Iu/%Iu\r\n",
+                     last - first + 1, first, last, contents.size());
+      ++last;
+    } else {
+      headers.Format("HTTP/1.1 416 Requested Range Not Satisfiable\r\n"
+                     "Content-Length: 0\r\n"
+                     "Content-Range: bytes */%Iu\r\n",
+                     contents.size());
+    }
+
+    headers.AppendFormat("Content-Type: application/octet-stream\r\n"
+                         "Accept-Ranges: bytes\r\n"
+                         "Last-Modified: %s\r\n"
+                         "Connection: %s\r\n\r\n",
+                         kLastModified,
+                         keep_alive ? "keep-alive" : "close");
+
+    result = Send(socket, headers, headers.GetLength());
+    if (is_get) {
+      for (size_t i = first; result && i < last; i += kSendChunkSize) {
+        result = Send(socket,
+                      contents.data() + i,
+                      std::min(kSendChunkSize, last - i));
+      }
+    }
+  }
+
+  if (is_get) {
+    OnRequestEnd();
+  }
+
+  return result && keep_alive;
+}
+
+bool LoopbackHttpServer::Send(UINT_PTR socket, const char* data, size_t size) {
+  while (size > 0) {
+    const int bytes = ::send(socket, data, static_cast<int>(size), 0);
+    if (bytes <= 0) {
+      return false;
+    }
+    data += bytes;
+    size -= bytes;
+  }
+  return true;
+}
+
+void LoopbackHttpServer::OnRequestBegin() {
+  __mutexScope(lock_);
+  ++num_concurrent_requests_;
+  max_concurrent_requests_ = std::max(max_concurrent_requests_,
+                                      num_concurrent_requests_);
+}
+
+void LoopbackHttpServer::OnRequestEnd() {
+  __mutexScope(lock_);
+  --num_concurrent_requests_;
+}
+
+}  // namespace omaha
@@ -0,0 +1,142 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// A minimal HTTP/1.1 server listening on the loopback interface, for the unit
+// tests which download files without depending on the network. Responses can
+// be delayed to simulate slow servers. The server handles GET and HEAD
+// requests, persistent connections, and single byte ranges, which is what
+// WinHttp and BITS need to download a file. Requests for absolute urls are
+// served as well, so that the server can stand in for a proxy. POST requests
+// are recorded and answered with the contents of the file, so that the server
+// can also stand in for the update and ping servers.
+
+#ifndef OMAHA_TESTING_LOOPBACK_HTTP_SERVER_H_
+#define OMAHA_TESTING_LOOPBACK_HTTP_SERVER_H_
+
+#include <windows.h>
+#include <atlstr.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "base/basictypes.h"
+#include "omaha/base/scoped_any.h"
+#include "omaha/base/synchronized.h"
+
+namespace omaha {
+
+class LoopbackHttpServer {
+ public:
+  LoopbackHttpServer();
+  ~LoopbackHttpServer();
+
+  // Starts serving on an ephemeral port of 127.0.0.1.
+  HRESULT Start();
+
+  // Stops serving. The requests waiting for their latency to elapse are
+  // aborted. Called by the destructor.
+  void Stop();
+
+  // Serves |contents| at |path|, which starts with a slash. The response
+  // headers of each request for the file are sent after |latency_ms|.
+  void AddFile(const CString& path,
+               const std::string& contents,
+               int latency_ms);
+
+  // Serves |contents| at |path| to POST requests only, like AddFile. The other
+  // requests for the file are answered with 405 Method Not Allowed, as the
+  // update server does.
+  void AddPostOnlyFile(const CString& path,
+                       const std::string& contents,
+                       int latency_ms);
+
+  // Returns "http://127.0.0.1:<port>/".
+  CString base_url() const;
+
+  // Returns how many GET and POST requests have been received for |path|.
+  int GetRequestCount(const CString& path) const;
+
+  // Returns the POST requests received for |path|, in the order they were
+  // received. Each request is its headers followed by its body.
+  std::vector<std::string> GetPostRequests(const CString& path) const;
+
+  // Returns how many requests have been received, for any path and method.
+  int num_requests() const;
+
+  // Returns the largest number of GET requests that were served at the same
+  // time.
+  int max_concurrent_requests() const;
+
+ private:
+  struct File {
+    File() : latency_ms(0), is_post_only(false), num_requests(0) {}
+
+    std::string contents;
+    int latency_ms;
+    bool is_post_only;
+    int num_requests;
+    std::vector<std::string> post_requests;
+  };
+
+  struct Connection {
+    LoopbackHttpServer* server;
+    UINT_PTR socket;
+  };
+
+  static DWORD WINAPI AcceptThreadProc(void* param);
+  static DWORD WINAPI ConnectionThreadProc(void* param);
+
+  void AcceptConnections();
+  void ServeConnection(UINT_PTR socket);
+
+  // Reads the headers and the body of the next request from the connection.
+  // Returns false when the connection is closed.
+  bool ReadRequest(UINT_PTR socket,
+                   std::string* pending,
+                   std::string* request,
+                   std::string* body);
+
+  // Sends the response to |request|. Returns false if the connection must be
+  // closed.
+  bool ServeRequest(UINT_PTR socket,
+                    const std::string& request,
+                    const std::string& body);
+
+  bool Send(UINT_PTR socket, const char* data, size_t size);
+
+  void OnRequestBegin();
+  void OnRequestEnd();
+
+  LLock lock_;
+  std::map<std::string, File> files_;
+  int num_requests_;
+  int num_concurrent_requests_;
+  int max_concurrent_requests_;
+
+  bool is_wsa_initialized_;
+  UINT_PTR listen_socket_;
+  int port_;
+
+  // Signaled when the server stops.
+  scoped_event stop_event_;
+  scoped_handle accept_thread_;
+  std::vector<HANDLE> connection_threads_;
+  std::vector<UINT_PTR> connection_sockets_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoopbackHttpServer);
+};
+
+}  // namespace omaha
+
+#endif  // OMAHA_TESTING_LOOPBACK_HTTP_SERVER_H_
@@ -28,6 +28,7 @@
 #include "omaha/base/vistautil.h"
 #include "omaha/common/command_line.h"
 #include "omaha/common/command_line_builder.h"
+#include "omaha/common/config_manager.h"
 #include "omaha/common/const_goopdate.h"
 
 namespace omaha {
@@ -119,6 +120,9 @@ void OverrideSpecifiedRegistryHives(const CString& hive_override_key_name,
     ASSERT_SUCCEEDED(::RegOverridePredefKey(HKEY_CURRENT_USER,
                                             user_key.Key()));
   }
+
+  // The cached configuration was read from the hives before the override.
+  ConfigManager::Instance()->InvalidateSnapshot();
 }
 
 // When tests execute programs (i.e. with ShellExecute or indirectly), Windows
@@ -154,6 +158,7 @@ void OverrideRegistryHivesWithExecutionPermissions(
 void RestoreRegistryHives() {
   ASSERT_SUCCEEDED(::RegOverridePredefKey(HKEY_LOCAL_MACHINE, NULL));
   ASSERT_SUCCEEDED(::RegOverridePredefKey(HKEY_CURRENT_USER, NULL));
+  ConfigManager::Instance()->InvalidateSnapshot();
 }
 
 void SetPsexecDir(const CString& dir) {
@@ -0,0 +1,154 @@
+// Copyright 2026 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ========================================================================
+//
+// A tool to create the differential patches served in the update responses,
+// and to apply them for testing. The SHA256 hash it prints for a patch is the
+// value of the hashdiff_sha256 attribute of the package.
+
+#include <Windows.h>
+#include <TCHAR.h>
+#include <vector>
+#include "omaha/base/binary_patch.h"
+#include "omaha/base/file.h"
+#include "omaha/base/signatures.h"
+#include "omaha/base/string.h"
+#include "omaha/base/utils.h"
+
+using omaha::ApplyBinaryPatch;
+using omaha::BytesToHex;
+using omaha::CreateBinaryPatch;
+using omaha::CryptoHash;
+using omaha::File;
+using omaha::ReadEntireFile;
+using omaha::WriteEntireFile;
+
+namespace {
+
+void PrintUsage() {
+  _tprintf(_T("Usage: BinaryDiff create <old_file> <new_file> <patch_file>\n"));
+  _tprintf(_T("       BinaryDiff apply <old_file> <patch_file> <new_file>\n"));
+}
+
+const uint8* DataOrNull(const std::vector<byte>& data) {
+  return data.empty() ? NULL : &data.front();
+}
+
+HRESULT ReadInput(const TCHAR* file, std::vector<byte>* contents) {
+  if (!File::Exists(file)) {
+    _tprintf(_T("File \"%s\" not found!\n"), file);
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+  }
+  HRESULT hr = ReadEntireFile(file, 0, contents);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not read \"%s\" hr = %x\n"), file, hr);
+  }
+  return hr;
+}
+
+HRESULT PrintSha256(const TCHAR* label, const std::vector<byte>& contents) {
+  std::vector<byte> hash;
+  CryptoHash crypto(CryptoHash::kSha256);
+  HRESULT hr = crypto.Compute(contents, &hash);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not hash the %s hr = %x\n"), label, hr);
+    return hr;
+  }
+  _tprintf(_T("%s size %u sha256 %s\n"),
+           label,
+           static_cast<unsigned int>(contents.size()),
+           static_cast<const TCHAR*>(BytesToHex(hash)));
+  return S_OK;
+}
+
+HRESULT Create(const TCHAR* old_file,
+               const TCHAR* new_file,
+               const TCHAR* patch_file) {
+  std::vector<byte> old_data;
+  std::vector<byte> new_data;
+  HRESULT hr = ReadInput(old_file, &old_data);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = ReadInput(new_file, &new_data);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  std::vector<byte> patch;
+  if (!CreateBinaryPatch(DataOrNull(old_data), old_data.size(),
+                         DataOrNull(new_data), new_data.size(),
+                         &patch)) {
+    _tprintf(_T("Could not create the patch.\n"));
+    return E_FAIL;
+  }
+
+  hr = WriteEntireFile(patch_file, patch);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not write \"%s\" hr = %x\n"), patch_file, hr);
+    return hr;
+  }
+  return PrintSha256(_T("patch"), patch);
+}
+
+HRESULT Apply(const TCHAR* old_file,
+              const TCHAR* patch_file,
+              const TCHAR* new_file) {
+  std::vector<byte> old_data;
+  std::vector<byte> patch;
+  HRESULT hr = ReadInput(old_file, &old_data);
+  if (FAILED(hr)) {
+    return hr;
+  }
+  hr = ReadInput(patch_file, &patch);
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  std::vector<byte> new_data;
+  if (!ApplyBinaryPatch(DataOrNull(old_data), old_data.size(),
+                        DataOrNull(patch), patch.size(),
+                        &new_data)) {
+    _tprintf(_T("The patch is invalid or was created for another file.\n"));
+    return E_FAIL;
+  }
+
+  hr = WriteEntireFile(new_file, new_data);
+  if (FAILED(hr)) {
+    _tprintf(_T("Could not write \"%s\" hr = %x\n"), new_file, hr);
+    return hr;
+  }
+  return PrintSha256(_T("new file"), new_data);
+}
+
+}  // namespace
+
+int _tmain(int argc, TCHAR* argv[]) {
+  if (argc != 5) {
+    _tprintf(_T("Incorrect number of arguments!\n"));
+    PrintUsage();
+    return -1;
+  }
+
+  if (_tcsicmp(argv[1], _T("create")) == 0) {
+    return Create(argv[2], argv[3], argv[4]);
+  }
+  if (_tcsicmp(argv[1], _T("apply")) == 0) {
+    return Apply(argv[2], argv[3], argv[4]);
+  }
+
+  _tprintf(_T("Unknown command \"%s\"!\n"), argv[1]);
+  PrintUsage();
+  return -1;
+}